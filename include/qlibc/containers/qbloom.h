@@ -0,0 +1,100 @@
+/******************************************************************************
+ * qLibc
+ *
+ * Copyright (c) 2010-2014 Seungyoung Kim.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *****************************************************************************/
+
+/**
+ * Bloom filter container that works in preallocated fixed size memory.
+ *
+ * @file qbloom.h
+ */
+
+#ifndef _QBLOOM_H
+#define _QBLOOM_H
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "qtype.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* types */
+typedef struct qbloom_data_s qbloom_data_t;
+typedef struct qbloom_s qbloom_t;
+
+/* public functions */
+enum {
+    QBLOOM_COUNTING = (0x01)    /*!< 4-bit counters to support remove() */
+};
+
+extern qbloom_t *qbloom(void *memory, size_t memsize, size_t maxkeys,
+                        int options);
+extern size_t qbloom_calculate_memsize(size_t maxkeys, double fprate,
+                                       int options);
+
+/**
+ * qbloom memory structure
+ */
+struct qbloom_data_s {
+    uint64_t ncells;    /*!< number of bits or counters */
+    int nhash;          /*!< number of hash functions */
+    int options;        /*!< options given at initialization */
+    volatile int64_t num;  /*!< number of added keys */
+};
+
+/**
+ * qbloom container object
+ */
+struct qbloom_s {
+    /* encapsulated member functions */
+    bool (*add) (qbloom_t *bloom, const char *key);
+    bool (*adddata) (qbloom_t *bloom, const void *data, size_t size);
+
+    bool (*check) (qbloom_t *bloom, const char *key);
+    bool (*checkdata) (qbloom_t *bloom, const void *data, size_t size);
+
+    bool (*remove) (qbloom_t *bloom, const char *key);
+    bool (*removedata) (qbloom_t *bloom, const void *data, size_t size);
+
+    size_t (*size) (qbloom_t *bloom);
+    void (*clear) (qbloom_t *bloom);
+    bool (*debug) (qbloom_t *bloom, FILE *out);
+
+    void (*free) (qbloom_t *bloom);
+
+    /* private variables */
+    qbloom_data_t *data;
+    unsigned char *cells;   /*!< bit or counter array */
+};
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*_QBLOOM_H */
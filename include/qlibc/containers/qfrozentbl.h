@@ -0,0 +1,93 @@
+/******************************************************************************
+ * qLibc
+ *
+ * Copyright (c) 2010-2014 Seungyoung Kim.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *****************************************************************************/
+
+/**
+ * Immutable perfect-hash table container.
+ *
+ * @file qfrozentbl.h
+ */
+
+#ifndef _QFROZENTBL_H
+#define _QFROZENTBL_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "qtype.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* types */
+typedef struct qfrozentbl_s qfrozentbl_t;
+
+/* public functions */
+enum {
+    QFROZENTBL_CASEINSENSITIVE = (0x01)  /*!< keys are case insensitive */
+};
+
+extern qfrozentbl_t *qfrozentbl(const qnobj_t *objs, size_t num,
+                                int options);
+
+/**
+ * qfrozentbl container object structure
+ */
+struct qfrozentbl_s {
+    /* encapsulated member functions */
+    void *(*get) (qfrozentbl_t *tbl, const char *name, size_t *size,
+                  bool newmem);
+    char *(*getstr) (qfrozentbl_t *tbl, const char *name, bool newmem);
+    int64_t (*getint) (qfrozentbl_t *tbl, const char *name);
+
+    bool (*getnext) (qfrozentbl_t *tbl, qnobj_t *obj, int *idx, bool newmem);
+
+    size_t (*size) (qfrozentbl_t *tbl);
+    bool (*debug) (qfrozentbl_t *tbl, FILE *out);
+    bool (*stats) (qfrozentbl_t *tbl, qstats_t *stats);
+    void (*free) (qfrozentbl_t *tbl);
+
+    /* private variables - do not access directly */
+    int options;        /*!< options */
+    size_t num;         /*!< number of keys, also number of slots */
+    size_t nbuckets;    /*!< number of displacement buckets */
+    uint64_t seed;      /*!< seed the displacements were found with */
+    uint32_t *displace; /*!< displacement of each bucket */
+    uint32_t *offsets;  /*!< record offset of each slot, in 8 bytes */
+    char *records;      /*!< key/value records in slot order */
+    size_t keybytes;    /*!< bytes of keys including terminators */
+    size_t valuebytes;  /*!< bytes of values */
+    size_t memsize;     /*!< bytes of the whole allocation */
+};
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*_QFROZENTBL_H */
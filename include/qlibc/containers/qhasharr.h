@@ -35,6 +35,7 @@
 #ifndef _QHASHARR_H
 #define _QHASHARR_H
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
 #include <stdint.h>
@@ -45,8 +46,8 @@ extern "C" {
 #endif
 
 /* tunable knobs */
-#define _Q_HASHARR_KEYSIZE (16)    /*!< knob for maximum key size. */
-#define _Q_HASHARR_VALUESIZE (32)  /*!< knob for maximum data size in a slot. */
+#define _Q_HASHARR_KEYSIZE (16)    /*!< default maximum key size. */
+#define _Q_HASHARR_VALUESIZE (32)  /*!< default maximum data size in a slot. */
 
 /* types */
 typedef struct qhasharr_slot_s qhasharr_slot_t;
@@ -54,11 +55,28 @@ typedef struct qhasharr_data_s qhasharr_data_t;
 typedef struct qhasharr_s qhasharr_t;
 
 /* public functions */
+enum {
+    QHASHARR_FASTHASH = (0x01),         /*!< use qhashxx32() for hashing */
+    QHASHARR_FINGERPRINT = (0x01 << 1), /*!< murmur3 key fingerprint */
+    QHASHARR_CONCURRENT = (0x01 << 2),  /*!< built-in spinlock & seqlock */
+    QHASHARR_EVICT = (0x01 << 3)        /*!< CLOCK eviction when full */
+};
+
 extern qhasharr_t *qhasharr(void *memory, size_t memsize);
+extern qhasharr_t *qhasharr_opt(void *memory, size_t memsize, int keysize,
+                                int valuesize, int options);
 extern size_t qhasharr_calculate_memsize(int max);
+extern size_t qhasharr_calculate_memsize_opt(int max, int keysize,
+                                             int valuesize);
+extern qhasharr_t *qhasharr_mmap(const char *filepath, int maxslots,
+                                 int keysize, int valuesize, int options);
 
 /**
  * qhasharr internal data slot structure
+ *
+ * A slot is followed by variable sized data area. The size of the area is
+ * decided at initialization time, so slots must be addressed by the slot size
+ * recorded in qhasharr_data_t, not by array index.
  */
 struct qhasharr_slot_s {
     short  count;   /*!< hash collision counter. 0 indicates empty slot,
@@ -66,34 +84,38 @@ struct qhasharr_slot_s {
                      indicating linked block */
     uint32_t  hash; /*!< key hash. we use FNV32 */
 
-    uint8_t size;   /*!< value size in this slot*/
+    uint16_t size;  /*!< value size in this slot*/
     int link;       /*!< next link */
+    uint8_t ref;    /*!< reference bit for QHASHARR_EVICT */
+    uint32_t expire;  /*!< expiration time in epoch seconds, 0 for none */
+
+    uint16_t  keylen;              /*!< original key length */
+    unsigned char keymd5[16];      /*!< md5 or murmur3 fingerprint
+                                        of the truncated key */
 
-    union {
-        /*!< key/value data */
-        struct _Q_HASHARR_SLOT_KEYVAL {
-            unsigned char value[_Q_HASHARR_VALUESIZE];  /*!< value */
-
-            char key[_Q_HASHARR_KEYSIZE];  /*!< key string, can be cut */
-            uint16_t  keylen;              /*!< original key length */
-            unsigned char keymd5[16];      /*!< md5 hash of the key */
-        } pair;
-
-        /*!< extended data block, used only when the count value is -2 */
-        struct _Q_HASHARR_SLOT_EXT {
-            unsigned char value[sizeof(struct _Q_HASHARR_SLOT_KEYVAL)];
-        } ext;
-    } data;
+    /*!< value[valuesize] followed by key[keysize]. an extended data block,
+         whose count is -2, uses the whole area for value. */
+    unsigned char data[];
 };
 
 /**
  * qhasharr memory structure
+ *
+ * It's followed by maxslots slots and a bitmap of empty slots, one bit per
+ * slot rounded up to 64-bit words.
  */
 struct qhasharr_data_s {
     int maxslots;       /*!< number of maximum slots */
     int usedslots;      /*!< number of used slots */
     int num;            /*!< number of stored keys */
-    qhasharr_slot_t *slots;  /*!< data area pointer */
+    int options;        /*!< options given at initialization */
+    int keysize;        /*!< key size in a slot */
+    int valuesize;      /*!< value size in a slot */
+    size_t slotsize;    /*!< size of a slot including data area */
+    int clockhand;      /*!< next slot to inspect for eviction */
+    int compacthand;    /*!< next slot to inspect for compaction */
+    volatile uint32_t lock; /*!< writer spinlock (QHASHARR_CONCURRENT) */
+    volatile uint32_t seq;  /*!< modification sequence, odd while writing */
 };
 
 /**
@@ -106,22 +128,46 @@ struct qhasharr_s {
     bool (*putstr) (qhasharr_t *tbl, const char *key, const char *str);
     bool (*putstrf) (qhasharr_t *tbl, const char *key, const char *format, ...);
     bool (*putint) (qhasharr_t *tbl, const char *key, int64_t num);
+    bool (*putttl) (qhasharr_t *tbl, const char *key, const void *value,
+                    size_t size, int ttl);
 
     void *(*get) (qhasharr_t *tbl, const char *key, size_t *size);
     char *(*getstr) (qhasharr_t *tbl, const char *key);
     int64_t (*getint) (qhasharr_t *tbl, const char *key);
     bool (*getnext) (qhasharr_t *tbl, qnobj_t *obj, int *idx);
+    void (*iterbegin) (qhasharr_t *tbl, qiter_t *it);
+    bool (*iternext) (qhasharr_t *tbl, qiter_t *it);
+    void (*iterend) (qhasharr_t *tbl, qiter_t *it);
+
+    bool (*update) (qhasharr_t *tbl, const char *key, size_t size, int ttl,
+                    void (*callback) (void *userdata, void *value,
+                                      bool created),
+                    void *userdata);
 
     bool (*remove) (qhasharr_t *tbl, const char *key);
 
     int  (*size) (qhasharr_t *tbl, int *maxslots, int *usedslots);
     void (*clear) (qhasharr_t *tbl);
     bool (*debug) (qhasharr_t *tbl, FILE *out);
+    bool (*stats) (qhasharr_t *tbl, qstats_t *stats);
+    bool (*sync) (qhasharr_t *tbl);
+    int  (*compact) (qhasharr_t *tbl, int maxscan);
 
     void (*free) (qhasharr_t *tbl);
 
     /* private variables */
     qhasharr_data_t *data;
+    qhasharr_slot_t *slots;  /*!< data area pointer */
+    uint64_t *freemap;  /*!< bitmap of empty slots, follows the slots */
+    void *map;          /*!< mapped file made by qhasharr_mmap() */
+    size_t mapsize;     /*!< size of the mapped file */
+
+    /* per-handle statistics, not shared with other processes */
+    uint64_t lockwaitns;  /*!< time spent waiting for writers */
+    uint64_t gethits;   /*!< lookup counters, kept with BUILD_STATS */
+    uint64_t getmisses;
+    uint64_t puthits;
+    uint64_t putmisses;
 };
 
 #ifdef __cplusplus
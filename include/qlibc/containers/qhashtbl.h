@@ -39,6 +39,8 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include "qtype.h"
+#include "qpool.h"
+#include "qfrozentbl.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -46,10 +48,16 @@ extern "C" {
 
 /* types */
 typedef struct qhashtbl_s qhashtbl_t;
+typedef struct qhashtbl_flatslot_s qhashtbl_flatslot_t;
 
 /* public functions */
 enum {
-    QHASHTBL_THREADSAFE = (0x01)  /*!< make it thread-safe */
+    QHASHTBL_THREADSAFE = (0x01),       /*!< make it thread-safe */
+    QHASHTBL_RESIZABLE = (0x01 << 1),   /*!< grow/shrink slots as needed */
+    QHASHTBL_OPENADDR = (0x01 << 2),    /*!< use open-addressing engine */
+    QHASHTBL_CONCURRENT = (0x01 << 3),  /*!< use lock-striped rwlocks */
+    QHASHTBL_FASTHASH = (0x01 << 4),    /*!< use qhashxx32() for hashing */
+    QHASHTBL_NODEPOOL = (0x01 << 5)     /*!< allocate objects from a pool */
 };
 
 extern qhashtbl_t *qhashtbl(size_t range, int options);  /*!< qhashtbl constructor */
@@ -63,18 +71,37 @@ struct qhashtbl_s {
     bool (*putstr) (qhashtbl_t *tbl, const char *name, const char *str);
     bool (*putstrf) (qhashtbl_t *tbl, const char *name, const char *format, ...);
     bool (*putint) (qhashtbl_t *tbl, const char *name, const int64_t num);
+    bool (*putref) (qhashtbl_t *tbl, const char *name, void *data, size_t size);
+    bool (*puthashed) (qhashtbl_t *tbl, const char *name, size_t namelen,
+                       uint32_t hash, const void *data, size_t size);
+    size_t (*putbatch) (qhashtbl_t *tbl, const qnobj_t *objs, size_t num);
 
     void *(*get) (qhashtbl_t *tbl, const char *name, size_t *size, bool newmem);
     char *(*getstr) (qhashtbl_t *tbl, const char *name, bool newmem);
     int64_t (*getint) (qhashtbl_t *tbl, const char *name);
+    void *(*gethashed) (qhashtbl_t *tbl, const char *name, size_t namelen,
+                        uint32_t hash, size_t *size, bool newmem);
+    size_t (*getbatch) (qhashtbl_t *tbl, qnobj_t *objs, size_t num,
+                        bool newmem);
 
     bool (*getnext) (qhashtbl_t *tbl, qhnobj_t *obj, bool newmem);
+    void (*iterbegin) (qhashtbl_t *tbl, qiter_t *it);
+    bool (*iternext) (qhashtbl_t *tbl, qiter_t *it);
+    void (*iterend) (qhashtbl_t *tbl, qiter_t *it);
 
     bool (*remove) (qhashtbl_t *tbl, const char *name);
+    bool (*removehashed) (qhashtbl_t *tbl, const char *name, size_t namelen,
+                          uint32_t hash);
+
+    uint32_t (*hash) (qhashtbl_t *tbl, const char *name, size_t namelen);
 
     size_t (*size) (qhashtbl_t *tbl);
     void (*clear) (qhashtbl_t *tbl);
     bool (*debug) (qhashtbl_t *tbl, FILE *out);
+    bool (*stats) (qhashtbl_t *tbl, qstats_t *stats);
+    bool (*snapshot) (qhashtbl_t *tbl, const char *filepath);
+    ssize_t (*restore) (qhashtbl_t *tbl, const char *filepath);
+    qfrozentbl_t *(*freeze) (qhashtbl_t *tbl);
 
     void (*lock) (qhashtbl_t *tbl);
     void (*unlock) (qhashtbl_t *tbl);
@@ -86,6 +113,30 @@ struct qhashtbl_s {
     size_t num;         /*!< number of objects in this table */
     size_t range;       /*!< hash range, vertical number of slots */
     qhnobj_t **slots;   /*!< slot pointer container */
+
+    bool resizable;     /*!< QHASHTBL_RESIZABLE option is given */
+    size_t minrange;    /*!< initial range, never shrink below this */
+    size_t oldrange;    /*!< range of old slots while rehashing */
+    size_t rehashidx;   /*!< next old slot index to migrate */
+    qhnobj_t **oldslots;  /*!< old slots while rehashing, otherwise NULL */
+    bool traversing;    /*!< getnext() is traversing, shrink is deferred */
+
+    qhashtbl_flatslot_t *flatslots; /*!< probe array in QHASHTBL_OPENADDR */
+    char *arena;        /*!< key/value storage in QHASHTBL_OPENADDR */
+    size_t arenasize;   /*!< allocated size of arena */
+    size_t arenaused;   /*!< used bytes of arena including garbage */
+    size_t arenagarbage;  /*!< bytes of removed records in arena */
+
+    pthread_rwlock_t *stripes;  /*!< slot locks in QHASHTBL_CONCURRENT */
+    size_t nstripes;    /*!< number of slot locks */
+
+    qpool_t *pool;      /*!< object pool in QHASHTBL_NODEPOOL */
+
+    uint64_t stripewaitns;  /*!< time spent waiting for slot locks */
+    uint64_t gethits;   /*!< lookup counters, kept with BUILD_STATS */
+    uint64_t getmisses;
+    uint64_t puthits;
+    uint64_t putmisses;
 };
 
 #ifdef __cplusplus
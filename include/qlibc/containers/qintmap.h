@@ -0,0 +1,114 @@
+/******************************************************************************
+ * qLibc
+ *
+ * Copyright (c) 2010-2014 Seungyoung Kim.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *****************************************************************************/
+
+/**
+ * Integer-key hash map container.
+ *
+ * @file qintmap.h
+ */
+
+#ifndef _QINTMAP_H
+#define _QINTMAP_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "qtype.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* types */
+typedef struct qintmap_s qintmap_t;
+typedef struct qintmap_obj_s qintmap_obj_t;
+typedef struct qintmap_slot_s qintmap_slot_t;
+
+/* public functions */
+enum {
+    QINTMAP_THREADSAFE = (0x01)     /*!< make it thread-safe */
+};
+
+extern qintmap_t *qintmap(size_t range, int options);  /*!< qintmap constructor */
+
+/**
+ * qintmap object data structure, filled by getnext().
+ */
+struct qintmap_obj_s {
+    uint64_t key;       /*!< key */
+    void *data;         /*!< data */
+    size_t size;        /*!< data size */
+};
+
+/**
+ * qintmap container object structure
+ */
+struct qintmap_s {
+    /* encapsulated member functions */
+    bool (*put) (qintmap_t *map, uint64_t key, const void *data, size_t size);
+    bool (*putint) (qintmap_t *map, uint64_t key, int64_t num);
+    bool (*putptr) (qintmap_t *map, uint64_t key, const void *ptr);
+
+    void *(*get) (qintmap_t *map, uint64_t key, size_t *size, bool newmem);
+    int64_t (*getint) (qintmap_t *map, uint64_t key);
+    void *(*getptr) (qintmap_t *map, uint64_t key);
+    bool (*getnext) (qintmap_t *map, qintmap_obj_t *obj, int *idx,
+                     bool newmem);
+
+    bool (*remove) (qintmap_t *map, uint64_t key);
+
+    size_t (*size) (qintmap_t *map);
+    void (*clear) (qintmap_t *map);
+    bool (*debug) (qintmap_t *map, FILE *out);
+    bool (*stats) (qintmap_t *map, qstats_t *stats);
+
+    void (*lock) (qintmap_t *map);
+    void (*unlock) (qintmap_t *map);
+
+    void (*free) (qintmap_t *map);
+
+    /* private variables - do not access directly */
+    qmutex_t *qmutex;   /*!< initialized when QINTMAP_THREADSAFE is given */
+    size_t num;         /*!< number of objects in this map */
+    size_t range;       /*!< number of slots, power of 2 */
+    int shift;          /*!< 64 - log2(range) */
+    qintmap_slot_t *slots;  /*!< probe array */
+    size_t heapbytes;   /*!< bytes of values allocated out of slots */
+
+    uint64_t gethits;   /*!< lookup counters, kept with BUILD_STATS */
+    uint64_t getmisses;
+    uint64_t puthits;
+    uint64_t putmisses;
+};
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*_QINTMAP_H */
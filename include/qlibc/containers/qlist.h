@@ -40,6 +40,7 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include "qtype.h"
+#include "qpool.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -50,7 +51,8 @@ typedef struct qlist_s qlist_t;
 
 /* public functions */
 enum {
-    QLIST_THREADSAFE = (0x01)  /*!< make it thread-safe */
+    QLIST_THREADSAFE = (0x01),      /*!< make it thread-safe */
+    QLIST_NODEPOOL = (0x01 << 1)    /*!< pool nodes and inline small data */
 };
 
 extern qlist_t *qlist(int options); /*!< qlist constructor */
@@ -70,6 +72,9 @@ struct qlist_s {
     void *(*getlast)(qlist_t *list, size_t *size, bool newmem);
     void *(*getat)(qlist_t *list, int index, size_t *size, bool newmem);
     bool (*getnext)(qlist_t *list, qdlobj_t *obj, bool newmem);
+    void (*iterbegin)(qlist_t *list, qiter_t *it);
+    bool (*iternext)(qlist_t *list, qiter_t *it);
+    void (*iterend)(qlist_t *list, qiter_t *it);
 
     void *(*popfirst)(qlist_t *list, size_t *size);
     void *(*poplast)(qlist_t *list, size_t *size);
@@ -80,6 +85,8 @@ struct qlist_s {
     bool (*removeat)(qlist_t *list, int index);
 
     void (*reverse)(qlist_t *list);
+    void (*sort)(qlist_t *list,
+                 int (*cmp)(const qdlobj_t *obj1, const qdlobj_t *obj2));
     void (*clear)(qlist_t *list);
 
     size_t (*size)(qlist_t *list);
@@ -88,6 +95,9 @@ struct qlist_s {
     void *(*toarray)(qlist_t *list, size_t *size);
     char *(*tostring)(qlist_t *list);
     bool (*debug)(qlist_t *list, FILE *out);
+    bool (*stats)(qlist_t *list, qstats_t *stats);
+    bool (*snapshot)(qlist_t *list, const char *filepath);
+    ssize_t (*restore)(qlist_t *list, const char *filepath);
 
     void (*lock)(qlist_t *list);
     void (*unlock)(qlist_t *list);
@@ -102,6 +112,14 @@ struct qlist_s {
 
     qdlobj_t *first;   /*!< first object pointer */
     qdlobj_t *last;    /*!< last object pointer */
+    qdlobj_t *finger;  /*!< last accessed object by index */
+    size_t fingeridx;  /*!< index of finger object */
+
+    qpool_t *pool;     /*!< node pool, initialized when QLIST_NODEPOOL is given */
+
+    uint64_t gethits;  /*!< access counters, kept with BUILD_STATS */
+    uint64_t getmisses;
+    uint64_t putmisses;
 };
 
 #ifdef __cplusplus
@@ -39,6 +39,8 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include "qtype.h"
+#include "qpool.h"
+#include "qfrozentbl.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -46,6 +48,7 @@ extern "C" {
 
 /* types */
 typedef struct qlisttbl_s qlisttbl_t;
+typedef struct qlisttbl_idxslot_s qlisttbl_idxslot_t;
 
 /* public functions */
 enum {
@@ -54,6 +57,9 @@ enum {
     QLISTTBL_CASEINSENSITIVE = (0x01 << 2), /*!< keys are case insensitive */
     QLISTTBL_INSERTTOP       = (0x01 << 3), /*!< insert new key at the top */
     QLISTTBL_LOOKUPFORWARD   = (0x01 << 4), /*!< find key from the top (default: backward) */
+    QLISTTBL_NODEPOOL        = (0x01 << 5), /*!< allocate objects from a pool */
+    QLISTTBL_HASHINDEX       = (0x01 << 6), /*!< index keys for O(1) lookups */
+    QLISTTBL_REFERENCE       = (0x01 << 7), /*!< store names and data by reference */
 };
 
 extern qlisttbl_t *qlisttbl(int options);  /*!< qlisttbl constructor */
@@ -67,21 +73,28 @@ struct qlisttbl_s {
     bool (*putstr) (qlisttbl_t *tbl, const char *name, const char *str);
     bool (*putstrf) (qlisttbl_t *tbl, const char *name, const char *format, ...);
     bool (*putint) (qlisttbl_t *tbl, const char *name, int64_t num);
+    size_t (*putbatch) (qlisttbl_t *tbl, const qnobj_t *objs, size_t num);
 
     void *(*get) (qlisttbl_t *tbl, const char *name, size_t *size, bool newmem);
     char *(*getstr) (qlisttbl_t *tbl, const char *name, bool newmem);
     int64_t (*getint) (qlisttbl_t *tbl, const char *name);
+    size_t (*getbatch) (qlisttbl_t *tbl, qnobj_t *objs, size_t num, bool newmem);
 
     qobj_t *(*getmulti) (qlisttbl_t *tbl, const char *name, bool newmem, size_t *numobjs);
     void (*freemulti) (qobj_t *objs);
 
     bool (*getnext) (qlisttbl_t *tbl, qdlnobj_t *obj, const char *name, bool newmem);
+    void (*iterbegin) (qlisttbl_t *tbl, qiter_t *it);
+    bool (*iternext) (qlisttbl_t *tbl, qiter_t *it);
+    void (*iterend) (qlisttbl_t *tbl, qiter_t *it);
 
     size_t (*remove) (qlisttbl_t *tbl, const char *name);
     bool (*removeobj) (qlisttbl_t *tbl, const qdlnobj_t *obj);
 
     size_t (*size) (qlisttbl_t *tbl);
     void (*sort) (qlisttbl_t *tbl);
+    void (*sortby) (qlisttbl_t *tbl,
+                    int (*cmp)(const qdlnobj_t *obj1, const qdlnobj_t *obj2));
     void (*clear) (qlisttbl_t *tbl);
 
     bool (*save) (qlisttbl_t *tbl, const char *filepath, char sepchar,
@@ -89,6 +102,10 @@ struct qlisttbl_s {
     ssize_t (*load) (qlisttbl_t *tbl, const char *filepath, char sepchar,
                      bool decode);
     bool (*debug) (qlisttbl_t *tbl, FILE *out);
+    bool (*stats) (qlisttbl_t *tbl, qstats_t *stats);
+    bool (*snapshot) (qlisttbl_t *tbl, const char *filepath);
+    ssize_t (*restore) (qlisttbl_t *tbl, const char *filepath);
+    qfrozentbl_t *(*freeze) (qlisttbl_t *tbl);
 
     void (*lock) (qlisttbl_t *tbl);
     void (*unlock) (qlisttbl_t *tbl);
@@ -105,11 +122,29 @@ struct qlisttbl_s {
     bool keepsorted;       /*!< keep table in sorted (default: insertion order) */
     bool inserttop;        /*!< add new key at the top. (default: bottom) */
     bool lookupforward;    /*!< find keys from the top. (default: backward) */
+    bool reference;        /*!< names and data are not copied */
 
     qmutex_t *qmutex;   /*!< initialized when QLISTTBL_OPT_THREADSAFE is given */
     size_t num;         /*!< number of elements */
     qdlnobj_t *first;   /*!< first object pointer */
     qdlnobj_t *last;    /*!< last object pointer */
+    qpool_t *pool;      /*!< object pool in QLISTTBL_NODEPOOL */
+
+    qlisttbl_idxslot_t *idxslots;  /*!< key index in QLISTTBL_HASHINDEX */
+    size_t idxrange;    /*!< number of index slots, power of 2 */
+
+    uint64_t gethits;   /*!< lookup counters, kept with BUILD_STATS */
+    uint64_t getmisses;
+    uint64_t puthits;
+    uint64_t putmisses;
+};
+
+/**
+ * qlisttbl key index slot. Objects in a slot are chained in table order.
+ */
+struct qlisttbl_idxslot_s {
+    qdlnobj_t *head;    /*!< first object in this slot */
+    qdlnobj_t *tail;    /*!< last object in this slot */
 };
 
 #ifdef __cplusplus
@@ -0,0 +1,88 @@
+/******************************************************************************
+ * qLibc
+ *
+ * Copyright (c) 2010-2014 Seungyoung Kim.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *****************************************************************************/
+
+/**
+ * Fixed-size object pool container.
+ *
+ * @file qpool.h
+ */
+
+#ifndef _QPOOL_H
+#define _QPOOL_H
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include "qtype.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* types */
+typedef struct qpool_s qpool_t;
+
+/* public functions */
+enum {
+    QPOOL_THREADSAFE = (0x01)  /*!< make it thread-safe */
+};
+
+extern qpool_t *qpool(size_t objsize, int options); /*!< qpool constructor */
+
+/**
+ * qpool container object
+ */
+struct qpool_s {
+    /* encapsulated member functions */
+    void *(*alloc)(qpool_t *pool);
+    void (*release)(qpool_t *pool, void *obj);
+
+    size_t (*size)(qpool_t *pool);
+    void (*clear)(qpool_t *pool);
+
+    void (*lock)(qpool_t *pool);
+    void (*unlock)(qpool_t *pool);
+
+    void (*free)(qpool_t *pool);
+
+    /* private variables - do not access directly */
+    qmutex_t *qmutex;   /*!< initialized when QPOOL_THREADSAFE is given */
+    size_t objsize;     /*!< object size, aligned */
+    size_t num;         /*!< number of objects in use */
+
+    void *chunks;       /*!< list of allocated chunks */
+    size_t chunkobjs;   /*!< number of objects in the next chunk */
+    void *freelist;     /*!< list of released objects */
+    char *avail;        /*!< never used area of the newest chunk */
+    char *availend;     /*!< end of the never used area */
+};
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _QPOOL_H */
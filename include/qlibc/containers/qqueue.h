@@ -35,10 +35,11 @@
 #ifndef _QQUEUE_H
 #define _QQUEUE_H
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
 #include <stdint.h>
-#include "qlist.h"
+#include "qtype.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -49,10 +50,12 @@ typedef struct qqueue_s qqueue_t;
 
 /* public functions */
 enum {
-    QQUEUE_THREADSAFE = (QLIST_THREADSAFE)  /*!< make it thread-safe */
+    QQUEUE_THREADSAFE = (0x01),     /*!< make it thread-safe */
+    QQUEUE_SPSC = (0x01 << 1)       /*!< single producer and consumer */
 };
 
 extern qqueue_t *qqueue(int options);
+extern qqueue_t *qqueue_lockfree(size_t capacity, int options);
 
 /**
  * qqueue container object structure
@@ -69,6 +72,7 @@ struct qqueue_s {
     char *(*popstr) (qqueue_t *stack);
     int64_t (*popint) (qqueue_t *stack);
     void *(*popat) (qqueue_t *stack, int index, size_t *size);
+    void *(*popwait) (qqueue_t *stack, size_t *size, int timeoutms);
 
     void *(*get) (qqueue_t *stack, size_t *size, bool newmem);
     char *(*getstr) (qqueue_t *stack);
@@ -81,7 +85,12 @@ struct qqueue_s {
     void (*free) (qqueue_t *stack);
 
     /* private variables - do not access directly */
-    qlist_t  *list;  /*!< data container */
+    struct qring_s *ring;      /*!< ring buffer engine */
+    struct qlfring_s *lfring;  /*!< lock-free engine of qqueue_lockfree() */
+
+    pthread_mutex_t waitlock;  /*!< mutex for waitcond */
+    pthread_cond_t waitcond;   /*!< signaled on push when waiters exist */
+    volatile int waiters;      /*!< number of threads in popwait() */
 };
 
 #ifdef __cplusplus
@@ -0,0 +1,83 @@
+/******************************************************************************
+ * qLibc
+ *
+ * Copyright (c) 2010-2014 Seungyoung Kim.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *****************************************************************************/
+
+/**
+ * Read-copy-update container publishing immutable objects to readers.
+ *
+ * @file qrcu.h
+ */
+
+#ifndef _QRCU_H
+#define _QRCU_H
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "qtype.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* types */
+typedef struct qrcu_s qrcu_t;
+
+#define QRCU_SHARDS     (16)    /*!< number of reader counter shards */
+
+/* public functions */
+extern qrcu_t *qrcu(void *obj, void (*freeobj)(void *obj));
+
+/**
+ * qrcu container object structure
+ */
+struct qrcu_s {
+    /* encapsulated member functions */
+    void *(*acquire) (qrcu_t *rcu, int *token);
+    void (*release) (qrcu_t *rcu, int token);
+    bool (*publish) (qrcu_t *rcu, void *obj);
+    uint64_t (*version) (qrcu_t *rcu);
+    void (*free) (qrcu_t *rcu);
+
+    /* private variables - do not access directly */
+    void *obj;              /*!< current object */
+    void (*freeobj)(void *obj);  /*!< destructor of retired objects */
+    uint64_t nversions;     /*!< number of publish() calls */
+    int phase;              /*!< reader counters new readers go to */
+    pthread_mutex_t wlock;  /*!< serializes publish() */
+    struct {
+        int64_t readers;    /*!< readers in the shard */
+        int64_t pad[7];
+    } counters[2][QRCU_SHARDS];  /*!< cache-line sized counters per phase */
+};
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*_QRCU_H */
@@ -0,0 +1,116 @@
+/******************************************************************************
+ * qLibc
+ *
+ * Copyright (c) 2010-2014 Seungyoung Kim.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *****************************************************************************/
+
+/**
+ * Skip List container.
+ *
+ * @file qskiplist.h
+ */
+
+#ifndef _QSKIPLIST_H
+#define _QSKIPLIST_H
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "qtype.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* types */
+typedef struct qskiplist_s qskiplist_t;
+typedef struct qskiplist_obj_s qskiplist_obj_t;
+
+/* public functions */
+enum {
+    QSKIPLIST_THREADSAFE = (0x01)   /*!< make it thread-safe */
+};
+
+extern qskiplist_t *qskiplist(int options);  /*!< qskiplist constructor */
+
+/**
+ * qskiplist container object structure
+ */
+struct qskiplist_s {
+    /* encapsulated member functions */
+    bool (*put) (qskiplist_t *tbl, const char *name, const void *data,
+                 size_t size);
+    bool (*putstr) (qskiplist_t *tbl, const char *name, const char *str);
+    bool (*putstrf) (qskiplist_t *tbl, const char *name, const char *format,
+                     ...);
+    bool (*putint) (qskiplist_t *tbl, const char *name, int64_t num);
+
+    void *(*get) (qskiplist_t *tbl, const char *name, size_t *size,
+                  bool newmem);
+    char *(*getstr) (qskiplist_t *tbl, const char *name, bool newmem);
+    int64_t (*getint) (qskiplist_t *tbl, const char *name);
+
+    bool (*getnext) (qskiplist_t *tbl, qskiplist_obj_t *obj, bool newmem);
+    bool (*getrange) (qskiplist_t *tbl, qskiplist_obj_t *obj,
+                      const char *min, const char *max, bool newmem);
+    bool (*getprefix) (qskiplist_t *tbl, qskiplist_obj_t *obj,
+                       const char *prefix, bool newmem);
+
+    bool (*remove) (qskiplist_t *tbl, const char *name);
+
+    size_t (*size) (qskiplist_t *tbl);
+    void (*clear) (qskiplist_t *tbl);
+    bool (*debug) (qskiplist_t *tbl, FILE *out);
+
+    void (*lock) (qskiplist_t *tbl);
+    void (*unlock) (qskiplist_t *tbl);
+
+    void (*free) (qskiplist_t *tbl);
+
+    /* private variables - do not access directly */
+    qmutex_t *qmutex;   /*!< initialized when QSKIPLIST_THREADSAFE is given */
+    size_t num;         /*!< number of objects in this table */
+    int level;          /*!< highest level in use */
+    uint32_t seed;      /*!< random state for levels of new objects */
+    qskiplist_obj_t **head;  /*!< forward links from the head, per level */
+};
+
+/**
+ * qskiplist object structure
+ */
+struct qskiplist_obj_s {
+    char *name;         /*!< object name */
+    void *data;         /*!< data */
+    size_t size;        /*!< data size */
+
+    int level;          /*!< number of forward links */
+    qskiplist_obj_t **next;  /*!< forward links, next[0] is the next object */
+};
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*_QSKIPLIST_H */
@@ -35,10 +35,11 @@
 #ifndef _QSTACK_H
 #define _QSTACK_H
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
 #include <stdint.h>
-#include "qlist.h"
+#include "qtype.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -49,7 +50,7 @@ typedef struct qstack_s qstack_t;
 
 /* public functions */
 enum {
-    QSTACK_THREADSAFE = (QLIST_THREADSAFE)  /*!< make it thread-safe */
+    QSTACK_THREADSAFE = (0x01)  /*!< make it thread-safe */
 };
 
 extern qstack_t *qstack(int options);
@@ -81,7 +82,7 @@ struct qstack_s {
     void (*free) (qstack_t *stack);
 
     /* private variables - do not access directly */
-    qlist_t  *list;  /*!< data container */
+    struct qring_s *ring;  /*!< ring buffer engine */
 };
 
 #ifdef __cplusplus
@@ -0,0 +1,84 @@
+/******************************************************************************
+ * qLibc
+ *
+ * Copyright (c) 2010-2014 Seungyoung Kim.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *****************************************************************************/
+
+/**
+ * Growable string buffer.
+ *
+ * @file qstrbuf.h
+ */
+
+#ifndef _QSTRBUF_H
+#define _QSTRBUF_H
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdarg.h>
+#include "qtype.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* types */
+typedef struct qstrbuf_s qstrbuf_t;
+
+/* public functions */
+extern qstrbuf_t *qstrbuf(size_t initsize);
+
+/**
+ * qstrbuf container object
+ */
+struct qstrbuf_s {
+    /* encapsulated member functions */
+    bool (*append) (qstrbuf_t *sb, const char *str);
+    bool (*append_n) (qstrbuf_t *sb, const void *data, size_t size);
+    bool (*appendf) (qstrbuf_t *sb, const char *format, ...);
+    bool (*vappendf) (qstrbuf_t *sb, const char *format, va_list arg);
+
+    bool (*reserve) (qstrbuf_t *sb, size_t size);
+    bool (*truncate) (qstrbuf_t *sb, size_t len);
+
+    char *(*getstr) (qstrbuf_t *sb, bool newmem);
+    char *(*steal) (qstrbuf_t *sb, size_t *len);
+    size_t (*length) (qstrbuf_t *sb);
+
+    void (*clear) (qstrbuf_t *sb);
+    void (*free) (qstrbuf_t *sb);
+
+    /* private variables - do not access directly */
+    char *buf;      /*!< string data, always terminated by '\0' */
+    size_t len;     /*!< length of string data */
+    size_t cap;     /*!< allocated size of buf */
+    size_t initsize;  /*!< initial allocation size */
+};
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _QSTRBUF_H */
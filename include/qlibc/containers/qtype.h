@@ -51,14 +51,21 @@ typedef struct qnobj_s qnobj_t;      /*!< named-object type*/
 typedef struct qdlobj_s qdlobj_t;    /*!< doubly-linked-object type*/
 typedef struct qdlnobj_s qdlnobj_t;  /*!< doubly-linked-named-object type*/
 typedef struct qhnobj_s qhnobj_t;    /*!< hashed-named-object type*/
+typedef struct qstats_s qstats_t;    /*!< container statistics type*/
+typedef struct qiter_s qiter_t;      /*!< container iterator type*/
 
 /**
  * qlibc pthread mutex data structure.
  */
 struct qmutex_s {
     pthread_mutex_t mutex;  /*!< pthread mutex */
+    pthread_rwlock_t rwlock;  /*!< pthread rwlock, used when shared is set */
+    bool shared;            /*!< reader/writer lock */
     pthread_t owner;        /*!< mutex owner thread id */
     int count;              /*!< recursive lock counter */
+    uint64_t waitns;        /*!< total nanoseconds spent waiting to enter */
+    const char *label;      /*!< source file of the owning container */
+    void *lockstats;        /*!< counters and histograms, BUILD_LOCKSTATS */
 };
 
 /**
@@ -95,6 +102,7 @@ struct qdlobj_s {
  */
 struct qdlnobj_s {
     uint32_t hash;      /*!< 32bit-hash value of object name */
+    uint32_t inlsize;   /*!< inline bytes for short name and data */
     char *name;         /*!< object name */
     void *data;         /*!< data */
     size_t size;        /*!< data size */
@@ -108,13 +116,60 @@ struct qdlnobj_s {
  */
 struct qhnobj_s {
     uint32_t hash;      /*!< 32bit-hash value of object name */
+    uint32_t inlsize;   /*!< inline bytes for short name and data */
     char *name;         /*!< object name */
     void *data;         /*!< data */
     size_t size;        /*!< data size */
+    bool isref;         /*!< name and data are owned by user */
 
     qhnobj_t *next;     /*!< for chaining next collision object */
 };
 
+/**
+ * iterator data structure, used by iterbegin(), iternext() and iterend()
+ * of containers. name and data point into the container and are valid
+ * until the next iternext() or iterend() call.
+ */
+struct qiter_s {
+    const char *name;   /*!< object name, NULL for unnamed objects */
+    size_t namelen;     /*!< name length */
+    const void *data;   /*!< data */
+    size_t size;        /*!< data size */
+
+    /* private variables - do not access directly */
+    void *cursor;       /*!< current object */
+    size_t idx;         /*!< next slot index */
+    void *buf;          /*!< buffer for data split over slots */
+    size_t bufsize;     /*!< allocated size of buf */
+};
+
+/**
+ * container statistics data structure, filled by stats() of qhashtbl,
+ * qhasharr, qlisttbl and qlist.
+ *
+ * Hit and miss counters are kept only when the library is configured with
+ * --enable-stats, otherwise they're always 0.
+ */
+struct qstats_s {
+    size_t num;         /*!< number of objects */
+    size_t slots;       /*!< number of hash slots, 0 if not hashed */
+    size_t usedslots;   /*!< number of slots in use */
+    double loadfactor;  /*!< objects (or used slots) per slot */
+    size_t maxchain;    /*!< longest collision chain or probe length */
+    size_t collisions;  /*!< objects not stored at the head of their slot */
+
+    size_t keybytes;    /*!< bytes used by keys */
+    size_t valuebytes;  /*!< bytes used by values */
+    size_t overhead;    /*!< bytes used by the container itself */
+
+    uint64_t lockwaitns;  /*!< total nanoseconds spent waiting for locks */
+
+    uint64_t gethits;   /*!< lookups which found an object */
+    uint64_t getmisses; /*!< lookups which found nothing */
+    uint64_t puthits;   /*!< stores which replaced an existing key */
+    uint64_t putmisses; /*!< stores which added a new object */
+};
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,467 @@
+/******************************************************************************
+ * qLibc
+ *
+ * Copyright (c) 2010-2014 Seungyoung Kim.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *****************************************************************************/
+
+/**
+ * Header-only typed containers with inline operations.
+ *
+ * @file qtyped.h
+ */
+
+#ifndef _QTYPED_H
+#define _QTYPED_H
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Hash and equality functions for QTYPED_HASHTBL().
+ */
+static inline uint32_t qtyped_hash_int(uint64_t key) {
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    return (uint32_t) key;
+}
+
+static inline uint32_t qtyped_hash_str(const char *key) {
+    uint32_t hash = 2166136261U;  // FNV-1a
+    for (; *key != '\0'; key++) {
+        hash ^= (unsigned char) *key;
+        hash *= 16777619U;
+    }
+    return hash;
+}
+
+#define QTYPED_EQ_INT(a, b)     ((a) == (b))
+#define QTYPED_EQ_STR(a, b)     (strcmp((a), (b)) == 0)
+
+/**
+ * Define a vector of T named name_t.
+ *
+ * Elements are kept by value in a contiguous array.
+ *
+ * @code
+ *  QTYPED_VECTOR(intvec, int)
+ *
+ *  intvec_t *v = intvec(0);
+ *  intvec_add(v, 10);
+ *  int *p = intvec_getat(v, -1);  // last element
+ *  intvec_removeat(v, 0);
+ *  intvec_free(v);
+ * @endcode
+ */
+#define QTYPED_VECTOR(name, T)                                              \
+typedef struct name##_s {                                                   \
+    T *data;            /*!< elements */                                    \
+    size_t num;         /*!< number of elements */                          \
+    size_t cap;         /*!< allocated number of elements */                \
+} name##_t;                                                                 \
+                                                                            \
+static inline bool name##_reserve(name##_t *v, size_t cap) {                \
+    if (cap <= v->cap)                                                      \
+        return true;                                                        \
+    T *data = (T *) realloc(v->data, cap * sizeof(T));                      \
+    if (data == NULL) {                                                     \
+        errno = ENOMEM;                                                     \
+        return false;                                                       \
+    }                                                                       \
+    v->data = data;                                                         \
+    v->cap = cap;                                                           \
+    return true;                                                            \
+}                                                                           \
+                                                                            \
+static inline name##_t *name(size_t cap) {                                  \
+    name##_t *v = (name##_t *) calloc(1, sizeof(name##_t));                 \
+    if (v == NULL) {                                                        \
+        errno = ENOMEM;                                                     \
+        return NULL;                                                        \
+    }                                                                       \
+    if (name##_reserve(v, cap) == false) {                                  \
+        free(v);                                                            \
+        return NULL;                                                        \
+    }                                                                       \
+    return v;                                                               \
+}                                                                           \
+                                                                            \
+static inline bool name##_add(name##_t *v, T value) {                       \
+    if (v->num == v->cap                                                    \
+            && name##_reserve(v, (v->cap > 0) ? v->cap * 2 : 16) == false) \
+        return false;                                                       \
+    v->data[v->num++] = value;                                              \
+    return true;                                                            \
+}                                                                           \
+                                                                            \
+/* negative index counts from the end. */                                   \
+static inline T *name##_getat(name##_t *v, int index) {                     \
+    if (index < 0)                                                          \
+        index += (int) v->num;                                              \
+    if (index < 0 || (size_t) index >= v->num) {                            \
+        errno = ERANGE;                                                     \
+        return NULL;                                                        \
+    }                                                                       \
+    return &v->data[index];                                                 \
+}                                                                           \
+                                                                            \
+static inline bool name##_setat(name##_t *v, int index, T value) {          \
+    T *p = name##_getat(v, index);                                          \
+    if (p == NULL)                                                          \
+        return false;                                                       \
+    *p = value;                                                             \
+    return true;                                                            \
+}                                                                           \
+                                                                            \
+static inline bool name##_removeat(name##_t *v, int index) {                \
+    T *p = name##_getat(v, index);                                          \
+    if (p == NULL)                                                          \
+        return false;                                                       \
+    v->num--;                                                               \
+    memmove(p, p + 1, (size_t) ((v->data + v->num) - p) * sizeof(T));       \
+    return true;                                                            \
+}                                                                           \
+                                                                            \
+static inline size_t name##_size(name##_t *v) {                             \
+    return v->num;                                                          \
+}                                                                           \
+                                                                            \
+static inline void name##_clear(name##_t *v) {                              \
+    v->num = 0;                                                             \
+}                                                                           \
+                                                                            \
+static inline void name##_free(name##_t *v) {                               \
+    free(v->data);                                                          \
+    free(v);                                                                \
+}
+
+/**
+ * Define a FIFO queue of T named name_t.
+ *
+ * Elements are kept by value in a ring buffer which grows by doubling.
+ *
+ * @code
+ *  QTYPED_QUEUE(jobq, struct job)
+ *
+ *  jobq_t *q = jobq(0);  // unlimited
+ *  jobq_push(q, job);
+ *  struct job next;
+ *  while (jobq_pop(q, &next) == true) { ... }
+ *  jobq_free(q);
+ * @endcode
+ */
+#define QTYPED_QUEUE(name, T)                                               \
+typedef struct name##_s {                                                   \
+    T *data;            /*!< ring buffer */                                 \
+    size_t head;        /*!< index of the oldest element */                 \
+    size_t num;         /*!< number of elements */                          \
+    size_t cap;         /*!< allocated number of elements, power of 2 */    \
+    size_t max;         /*!< maximum number of elements, 0 for unlimited */ \
+} name##_t;                                                                 \
+                                                                            \
+static inline name##_t *name(size_t max) {                                  \
+    name##_t *q = (name##_t *) calloc(1, sizeof(name##_t));                 \
+    if (q == NULL) {                                                        \
+        errno = ENOMEM;                                                     \
+        return NULL;                                                        \
+    }                                                                       \
+    q->max = max;                                                           \
+    return q;                                                               \
+}                                                                           \
+                                                                            \
+static inline bool name##_grow_(name##_t *q) {                              \
+    size_t cap = (q->cap > 0) ? q->cap * 2 : 16;                            \
+    T *data = (T *) malloc(cap * sizeof(T));                                \
+    if (data == NULL) {                                                     \
+        errno = ENOMEM;                                                     \
+        return false;                                                       \
+    }                                                                       \
+    size_t first = q->cap - q->head;                                        \
+    if (first > q->num)                                                     \
+        first = q->num;                                                     \
+    if (q->num > 0) {                                                       \
+        memcpy(data, q->data + q->head, first * sizeof(T));                 \
+        memcpy(data + first, q->data, (q->num - first) * sizeof(T));        \
+    }                                                                       \
+    free(q->data);                                                          \
+    q->data = data;                                                         \
+    q->head = 0;                                                            \
+    q->cap = cap;                                                           \
+    return true;                                                            \
+}                                                                           \
+                                                                            \
+static inline bool name##_push(name##_t *q, T value) {                      \
+    if (q->max > 0 && q->num >= q->max) {                                   \
+        errno = ENOBUFS;                                                    \
+        return false;                                                       \
+    }                                                                       \
+    if (q->num == q->cap && name##_grow_(q) == false)                       \
+        return false;                                                       \
+    q->data[(q->head + q->num) & (q->cap - 1)] = value;                     \
+    q->num++;                                                               \
+    return true;                                                            \
+}                                                                           \
+                                                                            \
+/* get the oldest element without removing it. */                           \
+static inline bool name##_get(name##_t *q, T *value) {                      \
+    if (q->num == 0) {                                                      \
+        errno = ENOENT;                                                     \
+        return false;                                                       \
+    }                                                                       \
+    if (value != NULL)                                                      \
+        *value = q->data[q->head];                                          \
+    return true;                                                            \
+}                                                                           \
+                                                                            \
+static inline bool name##_pop(name##_t *q, T *value) {                      \
+    if (name##_get(q, value) == false)                                      \
+        return false;                                                       \
+    q->head = (q->head + 1) & (q->cap - 1);                                 \
+    q->num--;                                                               \
+    return true;                                                            \
+}                                                                           \
+                                                                            \
+/* index 0 is the oldest, negative index counts from the newest. */        \
+static inline T *name##_getat(name##_t *q, int index) {                     \
+    if (index < 0)                                                          \
+        index += (int) q->num;                                              \
+    if (index < 0 || (size_t) index >= q->num) {                            \
+        errno = ERANGE;                                                     \
+        return NULL;                                                        \
+    }                                                                       \
+    return &q->data[(q->head + (size_t) index) & (q->cap - 1)];             \
+}                                                                           \
+                                                                            \
+static inline size_t name##_size(name##_t *q) {                             \
+    return q->num;                                                          \
+}                                                                           \
+                                                                            \
+static inline void name##_clear(name##_t *q) {                              \
+    q->head = 0;                                                            \
+    q->num = 0;                                                             \
+}                                                                           \
+                                                                            \
+static inline void name##_free(name##_t *q) {                               \
+    free(q->data);                                                          \
+    free(q);                                                                \
+}
+
+/**
+ * Define a hash table from K to V named name_t.
+ *
+ * hashfn(key) returns uint32_t hash of a key and eqfn(a, b) tells whether
+ * two keys are the same. They can be functions or macros, so comparisons
+ * get inlined. Keys and values are kept by value in open-addressing arrays
+ * with linear probing. Pointer keys like strings aren't copied, so the
+ * pointed memory must stay valid while it's in the table.
+ *
+ * @code
+ *  QTYPED_HASHTBL(wordcnt, const char *, int, qtyped_hash_str,
+ *                 QTYPED_EQ_STR)
+ *
+ *  wordcnt_t *tbl = wordcnt(0);
+ *  int *cnt = wordcnt_get(tbl, word);
+ *  if (cnt != NULL) (*cnt)++;
+ *  else wordcnt_put(tbl, word, 1);
+ *
+ *  size_t idx = 0;
+ *  const char *key;
+ *  int *value;
+ *  while (wordcnt_getnext(tbl, &idx, &key, &value) == true) { ... }
+ *  wordcnt_free(tbl);
+ * @endcode
+ *
+ * @note
+ *  The table isn't thread-safe, and put() and remove() can move entries,
+ *  so pointers from get() and getnext() are valid until the next put() or
+ *  remove().
+ */
+#define QTYPED_HASHTBL(name, K, V, hashfn, eqfn)                            \
+typedef struct name##_s {                                                   \
+    uint32_t *hashes;   /*!< hash of each slot, 0 for empty slot */         \
+    K *keys;                                                                \
+    V *values;                                                              \
+    size_t num;         /*!< number of entries */                           \
+    size_t mask;        /*!< number of slots - 1, slots are power of 2 */   \
+} name##_t;                                                                 \
+                                                                            \
+static inline uint32_t name##_hash_(K key) {                                \
+    uint32_t hash = (uint32_t) (hashfn(key));                               \
+    return (hash != 0) ? hash : 1;                                          \
+}                                                                           \
+                                                                            \
+static inline bool name##_resize_(name##_t *tbl, size_t nslots) {           \
+    uint32_t *hashes = (uint32_t *) calloc(nslots, sizeof(uint32_t));       \
+    K *keys = (K *) malloc(nslots * sizeof(K));                             \
+    V *values = (V *) malloc(nslots * sizeof(V));                           \
+    if (hashes == NULL || keys == NULL || values == NULL) {                 \
+        free(hashes);                                                       \
+        free(keys);                                                         \
+        free(values);                                                       \
+        errno = ENOMEM;                                                     \
+        return false;                                                       \
+    }                                                                       \
+    size_t i, mask = nslots - 1;                                            \
+    for (i = 0; tbl->hashes != NULL && i <= tbl->mask; i++) {               \
+        if (tbl->hashes[i] == 0)                                            \
+            continue;                                                       \
+        size_t idx = tbl->hashes[i] & mask;                                 \
+        while (hashes[idx] != 0)                                            \
+            idx = (idx + 1) & mask;                                         \
+        hashes[idx] = tbl->hashes[i];                                       \
+        keys[idx] = tbl->keys[i];                                           \
+        values[idx] = tbl->values[i];                                       \
+    }                                                                       \
+    free(tbl->hashes);                                                      \
+    free(tbl->keys);                                                        \
+    free(tbl->values);                                                      \
+    tbl->hashes = hashes;                                                   \
+    tbl->keys = keys;                                                       \
+    tbl->values = values;                                                   \
+    tbl->mask = mask;                                                       \
+    return true;                                                            \
+}                                                                           \
+                                                                            \
+/* range is the expected number of entries, 0 for default. */               \
+static inline name##_t *name(size_t range) {                                \
+    name##_t *tbl = (name##_t *) calloc(1, sizeof(name##_t));               \
+    if (tbl == NULL) {                                                      \
+        errno = ENOMEM;                                                     \
+        return NULL;                                                        \
+    }                                                                       \
+    size_t nslots = 16;                                                     \
+    while (nslots * 3 < range * 4)                                          \
+        nslots *= 2;                                                        \
+    if (name##_resize_(tbl, nslots) == false) {                             \
+        free(tbl);                                                          \
+        return NULL;                                                        \
+    }                                                                       \
+    return tbl;                                                             \
+}                                                                           \
+                                                                            \
+/* slot index of the key, otherwise the empty slot which ended probing. */  \
+static inline size_t name##_find_(name##_t *tbl, K key, uint32_t hash) {    \
+    size_t idx = hash & tbl->mask;                                          \
+    while (tbl->hashes[idx] != 0) {                                         \
+        if (tbl->hashes[idx] == hash && eqfn(tbl->keys[idx], key))          \
+            break;                                                          \
+        idx = (idx + 1) & tbl->mask;                                        \
+    }                                                                       \
+    return idx;                                                             \
+}                                                                           \
+                                                                            \
+/* put or replace. */                                                       \
+static inline bool name##_put(name##_t *tbl, K key, V value) {              \
+    if ((tbl->num + 1) * 4 > (tbl->mask + 1) * 3                            \
+            && name##_resize_(tbl, (tbl->mask + 1) * 2) == false)           \
+        return false;                                                       \
+    uint32_t hash = name##_hash_(key);                                      \
+    size_t idx = name##_find_(tbl, key, hash);                              \
+    if (tbl->hashes[idx] == 0) {                                            \
+        tbl->hashes[idx] = hash;                                            \
+        tbl->keys[idx] = key;                                               \
+        tbl->num++;                                                         \
+    }                                                                       \
+    tbl->values[idx] = value;                                               \
+    return true;                                                            \
+}                                                                           \
+                                                                            \
+static inline V *name##_get(name##_t *tbl, K key) {                         \
+    size_t idx = name##_find_(tbl, key, name##_hash_(key));                 \
+    if (tbl->hashes[idx] == 0) {                                            \
+        errno = ENOENT;                                                     \
+        return NULL;                                                        \
+    }                                                                       \
+    return &tbl->values[idx];                                               \
+}                                                                           \
+                                                                            \
+/* entries after the removed one are shifted back, no tombstone is left. */ \
+static inline bool name##_remove(name##_t *tbl, K key) {                    \
+    size_t idx = name##_find_(tbl, key, name##_hash_(key));                 \
+    if (tbl->hashes[idx] == 0) {                                            \
+        errno = ENOENT;                                                     \
+        return false;                                                       \
+    }                                                                       \
+    size_t next;                                                            \
+    for (next = (idx + 1) & tbl->mask; tbl->hashes[next] != 0;              \
+            next = (next + 1) & tbl->mask) {                                \
+        size_t home = tbl->hashes[next] & tbl->mask;                        \
+        if (((next - home) & tbl->mask) < ((next - idx) & tbl->mask))       \
+            continue;                                                       \
+        tbl->hashes[idx] = tbl->hashes[next];                               \
+        tbl->keys[idx] = tbl->keys[next];                                   \
+        tbl->values[idx] = tbl->values[next];                               \
+        idx = next;                                                         \
+    }                                                                       \
+    tbl->hashes[idx] = 0;                                                   \
+    tbl->num--;                                                             \
+    return true;                                                            \
+}                                                                           \
+                                                                            \
+/* idx must be 0 at first call. key or value can be NULL. */                \
+static inline bool name##_getnext(name##_t *tbl, size_t *idx, K *key,       \
+                                  V **value) {                              \
+    for (; *idx <= tbl->mask; (*idx)++) {                                   \
+        if (tbl->hashes[*idx] == 0)                                         \
+            continue;                                                       \
+        if (key != NULL)                                                    \
+            *key = tbl->keys[*idx];                                         \
+        if (value != NULL)                                                  \
+            *value = &tbl->values[*idx];                                    \
+        (*idx)++;                                                           \
+        return true;                                                        \
+    }                                                                       \
+    errno = ENOENT;                                                         \
+    return false;                                                           \
+}                                                                           \
+                                                                            \
+static inline size_t name##_size(name##_t *tbl) {                           \
+    return tbl->num;                                                        \
+}                                                                           \
+                                                                            \
+static inline void name##_clear(name##_t *tbl) {                            \
+    memset(tbl->hashes, 0, (tbl->mask + 1) * sizeof(uint32_t));             \
+    tbl->num = 0;                                                           \
+}                                                                           \
+                                                                            \
+static inline void name##_free(name##_t *tbl) {                             \
+    free(tbl->hashes);                                                      \
+    free(tbl->keys);                                                        \
+    free(tbl->values);                                                      \
+    free(tbl);                                                              \
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _QTYPED_H */
@@ -35,10 +35,11 @@
 #ifndef _QVECTOR_H
 #define _QVECTOR_H
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
 #include <stdint.h>
-#include "qlist.h"
+#include "qtype.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -49,7 +50,7 @@ typedef struct qvector_s qvector_t;
 
 /* public functions */
 enum {
-    QVECTOR_THREADSAFE = (QLIST_THREADSAFE)  /*!< make it thread-safe */
+    QVECTOR_THREADSAFE = (0x01)  /*!< make it thread-safe */
 };
 
 extern qvector_t *qvector(int options);
@@ -63,6 +64,11 @@ struct qvector_s {
     bool (*addstr) (qvector_t *vector, const char *str);
     bool (*addstrf) (qvector_t *vector, const char *format, ...);
 
+    void *(*getat) (qvector_t *vector, int index, size_t *size, bool newmem);
+    bool (*setat) (qvector_t *vector, int index, const void *data,
+                   size_t size);
+    bool (*removeat) (qvector_t *vector, int index);
+
     void *(*toarray) (qvector_t *vector, size_t *size);
     char *(*tostring) (qvector_t *vector);
 
@@ -70,11 +76,25 @@ struct qvector_s {
     size_t (*datasize) (qvector_t *vector);
     void (*clear) (qvector_t *vector);
     bool (*debug) (qvector_t *vector, FILE *out);
+    bool (*snapshot) (qvector_t *vector, const char *filepath);
+    ssize_t (*restore) (qvector_t *vector, const char *filepath);
+
+    void (*lock) (qvector_t *vector);
+    void (*unlock) (qvector_t *vector);
 
     void (*free) (qvector_t *vector);
 
     /* private variables - do not access directly */
-    qlist_t *list;  /*!< data container */
+    qmutex_t *qmutex;  /*!< initialized when QVECTOR_THREADSAFE is given */
+    void *data;        /*!< contiguous element data */
+    size_t datasum;    /*!< total sum of element sizes */
+    size_t datacap;    /*!< allocated size of data */
+    size_t num;        /*!< number of elements */
+    size_t objsize;    /*!< element size if all elements have same size,
+                            0 if sizes vary */
+    size_t *offsets;   /*!< element offsets, num + 1 entries.
+                            only used when sizes vary */
+    size_t offcap;     /*!< allocated number of offsets */
 };
 
 #ifdef __cplusplus
@@ -49,6 +49,8 @@ extern "C" {
 /* public functions */
 extern qlisttbl_t *qconfig_parse_file(qlisttbl_t *tbl, const char *filepath, char sepchar);
 extern qlisttbl_t *qconfig_parse_str(qlisttbl_t *tbl, const char *str, char sepchar);
+extern qlisttbl_t *qconfig_parse_cached(qlisttbl_t *tbl, const char *filepath,
+                                        char sepchar, const char *snappath);
 
 #ifdef __cplusplus
 }
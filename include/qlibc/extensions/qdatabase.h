@@ -41,6 +41,8 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <pthread.h>
+#include "../containers/qhashtbl.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -53,12 +55,18 @@ extern "C" {
 
 /* types */
 typedef struct qdbresult_s qdbresult_t;
+typedef struct qdbstmt_s qdbstmt_t;
 typedef struct qdb_s qdb_t;
+typedef struct qdbpool_s qdbpool_t;
 
 /* public functions */
 extern qdb_t *qdb(const char *dbtype,
                   const char *addr, int port, const char *database,
                   const char *username, const char *password, bool autocommit);
+extern qdbpool_t *qdbpool(const char *dbtype,
+                          const char *addr, int port, const char *username,
+                          const char *password, const char *database,
+                          bool autocommit, int maxconns, int pingidlems);
 
 /**
  * qdbresult object structure
@@ -70,6 +78,9 @@ struct qdbresult_s {
     int (*getint) (qdbresult_t *result, const char *field);
     int (*get_int_at) (qdbresult_t *result, int idx);
     bool (*getnext) (qdbresult_t *result);
+    int (*getbatch) (qdbresult_t *result, const char **values,
+                     size_t *lengths, int maxrows);
+    int (*get_colidx) (qdbresult_t *result, const char *field);
 
     int (*get_cols) (qdbresult_t *result);
     int (*get_rows) (qdbresult_t *result);
@@ -85,6 +96,52 @@ struct qdbresult_s {
     MYSQL_ROW  row;
     int cols;
     int cursor;
+
+    qhashtbl_t *colidx;  /*!< lower-cased column name to column number */
+    bool nocolidx;       /*!< column names can't be indexed */
+    void *arena;         /*!< copies of batched values (qstrbuf_t) */
+    size_t *offsets;     /*!< offsets of batched values in arena */
+    size_t maxoffsets;   /*!< allocated size of offsets */
+
+    /* prepared statement results */
+    qdbstmt_t *stmt;
+    MYSQL_BIND *binds;
+    char **bufs;
+    unsigned long *lengths;
+    my_bool *isnulls;
+#endif
+};
+
+/**
+ * qdbstmt prepared statement object structure
+ */
+struct qdbstmt_s {
+    /* capsulated member functions */
+    bool (*bind_int) (qdbstmt_t *stmt, int idx, int64_t num);
+    bool (*bind_double) (qdbstmt_t *stmt, int idx, double num);
+    bool (*bind_str) (qdbstmt_t *stmt, int idx, const char *str);
+    bool (*bind_blob) (qdbstmt_t *stmt, int idx, const void *data,
+                       size_t size);
+    bool (*bind_null) (qdbstmt_t *stmt, int idx);
+
+    int (*execute_update) (qdbstmt_t *stmt);
+    qdbresult_t *(*execute_query) (qdbstmt_t *stmt);
+
+    int (*get_params) (qdbstmt_t *stmt);
+    void (*free) (qdbstmt_t *stmt);
+
+    /* private variables - do not access directly */
+    qdb_t *db;        /*!< connection the statement is prepared on */
+    char *query;      /*!< SQL text, the key in the statement cache */
+    bool cached;      /*!< kept in the statement cache */
+    bool inuse;       /*!< handed out by prepare() and not freed yet */
+
+#ifdef _Q_ENABLE_MYSQL
+    /* private variables for mysql database - do not access directly */
+    MYSQL_STMT *mstmt;
+    int nparams;
+    MYSQL_BIND *params;
+    void *values;     /*!< storage of bound numbers and lengths */
 #endif
 };
 
@@ -99,6 +156,10 @@ struct qdb_s {
 
     qdbresult_t *(*execute_query) (qdb_t *db, const char *query);
     qdbresult_t *(*execute_queryf) (qdb_t *db, const char *format, ...);
+    int (*execute_batch) (qdb_t *db, const char *prefix, const char **values,
+                          int cols, int rows);
+
+    qdbstmt_t *(*prepare) (qdb_t *db, const char *query);
 
     bool (*begin_tran) (qdb_t *db);
     bool (*end_tran) (qdb_t *db, bool commit);
@@ -115,6 +176,7 @@ struct qdb_s {
     qmutex_t *qmutex;
 
     bool connected;   /*!< if opened true, if closed false */
+    qhashtbl_t *stmts;  /*!< prepared statements cache, keyed by SQL text */
 
     struct {
         char *dbtype;
@@ -133,6 +195,34 @@ struct qdb_s {
 #endif
 };
 
+/**
+ * qdbpool object structure
+ */
+struct qdbpool_s {
+    /* encapsulated member functions */
+    qdb_t *(*get) (qdbpool_t *pool, int timeoutms);
+    void (*release) (qdbpool_t *pool, qdb_t *db);
+    int (*ping) (qdbpool_t *pool);
+    size_t (*size) (qdbpool_t *pool);
+    void (*clear) (qdbpool_t *pool);
+    void (*free) (qdbpool_t *pool);
+
+    /* private variables - do not access directly */
+    pthread_mutex_t mutex;  /*!< protects idle and num */
+    pthread_cond_t cond;    /*!< signaled when a connection is released */
+    qdb_t *conf;      /*!< unopened qdb_t holding the connection information */
+
+    struct {
+        qdb_t *db;
+        long since;   /*!< released time in miliseconds */
+    } *idle;          /*!< idle connections, most recently used last */
+    int nidle;        /*!< number of idle connections */
+    int num;          /*!< connections, both checked out and idle */
+
+    int maxconns;     /*!< maximum number of connections */
+    int pingidlems;   /*!< ping idle connections older than this on get() */
+};
+
 #ifdef __cplusplus
 }
 #endif
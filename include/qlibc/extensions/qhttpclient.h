@@ -40,6 +40,8 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <pthread.h>
+#include "../utilities/qsocket.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -47,12 +49,16 @@ extern "C" {
 
 /* types */
 typedef struct qhttpclient_s  qhttpclient_t;
+typedef struct qhttpclient_pool_s  qhttpclient_pool_t;
+typedef struct qhttpclient_multi_s  qhttpclient_multi_t;
 
 /* constants */
 #define QHTTPCLIENT_NAME "qLibc"
 
 /* public functions */
 extern qhttpclient_t *qhttpclient(const char *hostname, int port);
+extern qhttpclient_pool_t *qhttpclient_pool(int maxperhost, int idletimeoutms);
+extern qhttpclient_multi_t *qhttpclient_multi(int timeoutms);
 
 /**
  * qhttpclient object structure
@@ -63,6 +69,7 @@ struct qhttpclient_s {
     void (*settimeout) (qhttpclient_t *client, int timeoutms);
     void (*setkeepalive) (qhttpclient_t *client, bool keepalive);
     void (*setuseragent) (qhttpclient_t *client, const char *useragent);
+    void (*setsockopts) (qhttpclient_t *client, const qsocket_opts_t *opts);
 
     bool (*open) (qhttpclient_t *client);
 
@@ -84,10 +91,30 @@ struct qhttpclient_s {
                   size_t *contentslength,
                   qlisttbl_t *reqheaders, qlisttbl_t *resheaders);
 
+    bool (*pipeline) (qhttpclient_t *client, const char *method,
+                      const char *uri, qlisttbl_t *reqheaders,
+                      void (*callback) (void *userdata, int rescode,
+                                        qlisttbl_t *resheaders,
+                                        void *content, size_t contentslength),
+                      void *userdata);
+    int (*flush) (qhttpclient_t *client);
+    bool (*stream) (qhttpclient_t *client, const char *method,
+                    const char *uri, const void *data, size_t size,
+                    int *rescode, qlisttbl_t *reqheaders,
+                    qlisttbl_t *resheaders,
+                    bool (*callback) (void *userdata, const void *data,
+                                      size_t size),
+                    void *userdata);
+
     bool (*sendrequest) (qhttpclient_t *client, const char *method,
                          const char *uri, qlisttbl_t *reqheaders);
     int (*readresponse) (qhttpclient_t *client, qlisttbl_t *resheaders,
                          off_t *contentlength);
+    off_t (*readbody) (qhttpclient_t *client, qlisttbl_t *resheaders,
+                       off_t contentlength,
+                       bool (*callback) (void *userdata, const void *data,
+                                         size_t size),
+                       void *userdata);
 
     ssize_t (*gets) (qhttpclient_t *client, char *buf, size_t bufsize);
     ssize_t (*read) (qhttpclient_t *client, void *buf, size_t nbytes);
@@ -102,18 +129,69 @@ struct qhttpclient_s {
     /* private variables - do not access directly */
     int socket;  /*!< socket descriptor */
     void *ssl;   /*!< will be used if SSL has been enabled at compile time */
+    void *reader; /*!< buffered reader(qio_reader_t) of the connection */
+    void *queue;  /*!< pipelined requests (qlist_t) waiting for flush() */
 
-    struct sockaddr_in addr;
+    struct sockaddr_in addr;  /*!< IPv4 address, zeroed for IPv6-only hosts */
     char *hostname;
     int port;
 
     int timeoutms;    /*< wait timeout miliseconds*/
     bool keepalive;   /*< keep-alive flag */
     char *useragent;  /*< user-agent name */
+    qsocket_opts_t sockopts;  /*< options of new connections */
 
     bool connclose;   /*< response keep-alive flag for a last request */
 };
 
+/**
+ * qhttpclient_pool object structure
+ */
+struct qhttpclient_pool_s {
+    /* encapsulated member functions */
+    qhttpclient_t *(*get) (qhttpclient_pool_t *pool, const char *hostname,
+                           int port, bool ssl, int timeoutms);
+    void (*release) (qhttpclient_pool_t *pool, qhttpclient_t *client);
+    size_t (*size) (qhttpclient_pool_t *pool);
+    void (*clear) (qhttpclient_pool_t *pool);
+    void (*free) (qhttpclient_pool_t *pool);
+
+    /* private variables - do not access directly */
+    pthread_mutex_t mutex;  /*!< protects hosts */
+    pthread_cond_t cond;    /*!< signaled when a connection is released */
+    void *hosts;            /*!< list of per host:port connection sets */
+
+    int maxperhost;     /*< maximum connections per host, 0 for unlimited */
+    int idletimeoutms;  /*< idle connection lifetime, 0 for unlimited */
+};
+
+/**
+ * qhttpclient_multi object structure
+ */
+struct qhttpclient_multi_s {
+    /* encapsulated member functions */
+    bool (*add) (qhttpclient_multi_t *multi, const char *hostname, int port,
+                 const char *method, const char *uri,
+                 qlisttbl_t *reqheaders, const void *data, size_t size,
+                 void (*callback) (void *userdata, int rescode,
+                                   qlisttbl_t *resheaders, void *content,
+                                   size_t contentslength),
+                 void *userdata);
+    int (*run) (qhttpclient_multi_t *multi, int timeoutms);
+    void (*setsockopts) (qhttpclient_multi_t *multi,
+                         const qsocket_opts_t *opts);
+    size_t (*size) (qhttpclient_multi_t *multi);
+    void (*free) (qhttpclient_multi_t *multi);
+
+    /* private variables - do not access directly */
+    int epfd;         /*!< epoll descriptor, -1 when poll() is used */
+    void *reqs;       /*!< list of requests in flight */
+    size_t num;       /*!< number of requests in flight */
+    int timeoutms;    /*< per request timeout, 0 for no limit */
+    char *useragent;  /*< user-agent name */
+    qsocket_opts_t sockopts;  /*< options of new connections */
+};
+
 #ifdef __cplusplus
 }
 #endif
@@ -54,6 +54,9 @@ typedef struct qlog_s qlog_t;
 /* constants */
 #define QLOG_OPT_THREADSAFE  (0x01)
 #define QLOG_OPT_FLUSH       (0x01 << 1)
+#define QLOG_OPT_ASYNC       (0x01 << 2)
+#define QLOG_OPT_ASYNC_DROP  (0x01 << 3)
+#define QLOG_OPT_TIMESTAMP   (0x01 << 4)
 
 /* public functions */
 extern qlog_t *qlog(const char *filepathfmt, mode_t mode, int rotateinterval, int options);
@@ -80,9 +83,12 @@ struct qlog_s {
     int rotateinterval; /*!< log file will be rotate in this interval seconds */
     int nextrotate;  /*!< next rotate universal time, seconds */
     bool logflush;   /*!< flag for immediate flushing */
+    bool timestamp;  /*!< flag for prefixing lines with local time */
 
     FILE *outfp;    /*!< stream pointer for duplication */
     bool outflush;  /*!< flag for immediate flushing for duplicated stream */
+
+    void *async;    /*!< background writer, used with QLOG_OPT_ASYNC */
 };
 
 #ifdef __cplusplus
@@ -39,6 +39,8 @@
 #define _QTOKENBUCKET_H
 
 #include <stdbool.h>
+#include <stdint.h>
+#include "../containers/qhasharr.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -46,6 +48,8 @@ extern "C" {
 
 /* types */
 typedef struct qtokenbucket_s qtokenbucket_t;
+typedef struct qtokenbucket_sharded_s qtokenbucket_sharded_t;
+typedef struct qtokenbucket_table_s qtokenbucket_table_t;
 
 /* public functions */
 extern void qtokenbucket_init(qtokenbucket_t *bucket, int init_tokens,
@@ -53,6 +57,24 @@ extern void qtokenbucket_init(qtokenbucket_t *bucket, int init_tokens,
 extern bool qtokenbucket_consume(qtokenbucket_t *bucket, int tokens);
 extern long qtokenbucket_waittime(qtokenbucket_t *bucket, int tokens);
 
+extern bool qtokenbucket_sharded_init(qtokenbucket_sharded_t *bucket,
+                                      int init_tokens, int max_tokens,
+                                      int tokens_per_sec);
+extern bool qtokenbucket_sharded_consume(qtokenbucket_sharded_t *bucket,
+                                         int tokens);
+extern long qtokenbucket_sharded_waittime(qtokenbucket_sharded_t *bucket,
+                                          int tokens);
+
+extern qtokenbucket_table_t *qtokenbucket_table(qhasharr_t *store,
+                                                int max_tokens,
+                                                int tokens_per_sec,
+                                                int idle_sec);
+extern bool qtokenbucket_table_consume(qtokenbucket_table_t *tbl,
+                                       const char *key, int tokens);
+extern long qtokenbucket_table_waittime(qtokenbucket_table_t *tbl,
+                                        const char *key, int tokens);
+extern void qtokenbucket_table_free(qtokenbucket_table_t *tbl);
+
 /**
  * qtokenbucket internal data structure
  */
@@ -63,6 +85,38 @@ struct qtokenbucket_s {
     long last_fill; /*!< last refill time in Millisecond. */
 };
 
+#define QTOKENBUCKET_SHARDS     (16)    /*!< number of token shards */
+
+/**
+ * qtokenbucket_sharded internal data structure. It has no pointers, so it
+ * can be placed in shared memory to limit multiple processes together.
+ */
+struct qtokenbucket_sharded_s {
+    /* private variables - do not access directly */
+    int64_t max_tokens;     /*!< maximum number of tokens, 1/1000 unit */
+    int64_t tokens_per_sec; /*!< fill rate per second */
+    int64_t batch;          /*!< tokens moved to a shard at once, 1/1000 unit */
+    int64_t pad0[5];
+    int64_t tokens;         /*!< tokens in the central pool, 1/1000 unit */
+    int64_t last_fill;      /*!< last refill time in nanoseconds */
+    int64_t pad1[6];
+    struct {
+        int64_t tokens;     /*!< tokens cached by the shard, 1/1000 unit */
+        int64_t pad[7];
+    } shards[QTOKENBUCKET_SHARDS];  /*!< cache-line sized token shards */
+};
+
+/**
+ * qtokenbucket_table internal data structure
+ */
+struct qtokenbucket_table_s {
+    /* private variables - do not access directly */
+    qhasharr_t *store;  /*!< table keeping a bucket per key */
+    int max_tokens;     /*!< maximum number of tokens of a bucket */
+    int tokens_per_sec; /*!< fill rate per second */
+    int idle_sec;       /*!< idle buckets expire after this */
+};
+
 #ifdef __cplusplus
 }
 #endif
@@ -39,9 +39,21 @@
 extern "C" {
 #endif
 
+/* public functions */
+enum {
+    QSHM_POSIX = (0x01),            /*!< shm_open()/memfd backend */
+    QSHM_HUGEPAGE = (0x01 << 1),    /*!< back the segment by huge pages */
+    QSHM_POPULATE = (0x01 << 2),    /*!< pre-fault pages on qshm_get() */
+    QSHM_INTERLEAVE = (0x01 << 3),  /*!< interleave pages over NUMA nodes */
+    QSHM_LOCAL = (0x01 << 4)        /*!< place pages on the local NUMA node */
+};
+
 extern int qshm_init(const char *keyfile, int keyid, size_t size,
                      bool recreate);
+extern int qshm_init_opt(const char *keyfile, int keyid, size_t size,
+                         bool recreate, int options);
 extern int qshm_getid(const char *keyfile, int keyid);
+extern int qshm_getid_opt(const char *keyfile, int keyid, int options);
 extern void *qshm_get(int shmid);
 extern bool qshm_free(int shmid);
 
@@ -0,0 +1,71 @@
+/******************************************************************************
+ * qLibc
+ *
+ * Copyright (c) 2010-2014 Seungyoung Kim.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *****************************************************************************/
+
+/**
+ * qshmlock header file.
+ *
+ * @file qshmlock.h
+ */
+
+#ifndef _QSHMLOCK_H
+#define _QSHMLOCK_H
+
+#include <stdbool.h>
+#include <pthread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* types */
+typedef struct qshmlock_s qshmlock_t;
+
+/* public functions */
+extern bool qshmlock_init(qshmlock_t *lock);
+extern bool qshmlock_enter(qshmlock_t *lock, bool *recovered);
+extern bool qshmlock_enter_nowait(qshmlock_t *lock, bool *recovered);
+extern bool qshmlock_enter_timed(qshmlock_t *lock, int maxwaitms,
+                                 bool *recovered);
+extern bool qshmlock_leave(qshmlock_t *lock);
+extern bool qshmlock_check(qshmlock_t *lock);
+extern bool qshmlock_free(qshmlock_t *lock);
+
+/**
+ * qshmlock structure. Place it in shared memory.
+ */
+struct qshmlock_s {
+    /* private variables - do not access directly */
+    pthread_mutex_t mutex;  /*!< process-shared and robust mutex */
+    bool ownerdied;  /*!< recovered by qshmlock_check(), not reported yet */
+};
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*_QSHMLOCK_H */
@@ -0,0 +1,70 @@
+/******************************************************************************
+ * qLibc
+ *
+ * Copyright (c) 2010-2014 Seungyoung Kim.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *****************************************************************************/
+
+/**
+ * qshmq header file.
+ *
+ * @file qshmq.h
+ */
+
+#ifndef _QSHMQ_H
+#define _QSHMQ_H
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* types */
+typedef struct qshmq_s qshmq_t;
+
+/* public functions */
+extern size_t qshmq_memsize(size_t capacity);
+extern qshmq_t *qshmq_init(void *mem, size_t memsize);
+extern qshmq_t *qshmq_attach(void *mem);
+
+extern bool qshmq_push(qshmq_t *q, const void *data, size_t size, int waitms);
+extern void *qshmq_reserve(qshmq_t *q, size_t size, int waitms);
+extern bool qshmq_commit(qshmq_t *q, void *ptr);
+
+extern void *qshmq_peek(qshmq_t *q, size_t *size, int waitms);
+extern bool qshmq_consume(qshmq_t *q);
+extern ssize_t qshmq_pop(qshmq_t *q, void *buf, size_t bufsize, int waitms);
+
+extern size_t qshmq_capacity(qshmq_t *q);
+extern size_t qshmq_used(qshmq_t *q);
+extern bool qshmq_free(qshmq_t *q);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*_QSHMQ_H */
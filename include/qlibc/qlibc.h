@@ -44,6 +44,14 @@
 #include "containers/qqueue.h"
 #include "containers/qstack.h"
 #include "containers/qvector.h"
+#include "containers/qpool.h"
+#include "containers/qskiplist.h"
+#include "containers/qbloom.h"
+#include "containers/qrcu.h"
+#include "containers/qfrozentbl.h"
+#include "containers/qintmap.h"
+#include "containers/qtyped.h"
+#include "containers/qstrbuf.h"
 
 /* utilities */
 #include "utilities/qcount.h"
@@ -54,11 +62,14 @@
 #include "utilities/qsocket.h"
 #include "utilities/qstring.h"
 #include "utilities/qsystem.h"
+#include "utilities/qthreadpool.h"
 #include "utilities/qtime.h"
 
 /* ipc */
 #include "ipc/qsem.h"
 #include "ipc/qshm.h"
+#include "ipc/qshmlock.h"
+#include "ipc/qshmq.h"
 
 #endif /*_QLIBC_H */
 
@@ -37,6 +37,7 @@
 
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -46,6 +47,17 @@ extern int64_t qcount_read(const char *filepath);
 extern bool qcount_save(const char *filepath, int64_t number);
 extern int64_t qcount_update(const char *filepath, int64_t number);
 
+/* in-memory counter registry */
+typedef struct qcount_s qcount_t;
+
+extern size_t qcount_memsize(int max);
+extern qcount_t *qcount(void *mem, size_t memsize, int syncsec);
+extern qcount_t *qcount_attach(void *mem, int syncsec);
+extern int64_t qcount_add(qcount_t *cnt, const char *filepath, int64_t number);
+extern int64_t qcount_get(qcount_t *cnt, const char *filepath);
+extern bool qcount_sync(qcount_t *cnt);
+extern void qcount_free(qcount_t *cnt);
+
 #ifdef __cplusplus
 }
 #endif
@@ -37,20 +37,56 @@
 
 #include <stdlib.h>
 #include <stdbool.h>
+#include <sys/types.h>
 #include "../containers/qlisttbl.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/* types */
+typedef struct qcodec_s qcodec_t;
+
+/* codec types */
+enum {
+    QCODEC_BASE64_ENCODE = 0,
+    QCODEC_BASE64_DECODE,
+    QCODEC_HEX_ENCODE,
+    QCODEC_HEX_DECODE,
+    QCODEC_URL_ENCODE,
+    QCODEC_URL_DECODE,
+};
+
 extern qlisttbl_t *qparse_queries(qlisttbl_t *tbl, const char *query,
                                   char equalchar, char sepchar, int *count);
+extern int qparse_queries_inplace(char *query, char equalchar, char sepchar,
+                                  qnobj_t *objs, int maxobjs);
 extern char *qurl_encode(const void *bin, size_t size);
 extern size_t qurl_decode(char *str);
+extern ssize_t qurl_encode_into(const void *bin, size_t size, char *buf,
+                                size_t bufsize);
+extern ssize_t qurl_decode_into(const char *str, size_t len, void *buf,
+                                size_t bufsize);
 extern char *qbase64_encode(const void *bin, size_t size);
 extern size_t qbase64_decode(char *str);
+extern ssize_t qbase64_encode_into(const void *bin, size_t size, char *buf,
+                                   size_t bufsize);
+extern ssize_t qbase64_decode_into(const char *str, size_t len, void *buf,
+                                   size_t bufsize);
 extern char *qhex_encode(const void *bin, size_t size);
 extern size_t qhex_decode(char *str);
+extern ssize_t qhex_encode_into(const void *bin, size_t size, char *buf,
+                                size_t bufsize);
+extern ssize_t qhex_decode_into(const char *str, size_t len, void *buf,
+                                size_t bufsize);
+
+extern qcodec_t *qcodec(int type);
+extern size_t qcodec_bound(qcodec_t *codec, size_t size);
+extern ssize_t qcodec_update(qcodec_t *codec, const void *in, size_t size,
+                             void *out, size_t outsize);
+extern ssize_t qcodec_final(qcodec_t *codec, void *out, size_t outsize);
+extern void qcodec_reset(qcodec_t *codec);
+extern void qcodec_free(qcodec_t *codec);
 
 #ifdef __cplusplus
 }
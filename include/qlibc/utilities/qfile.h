@@ -46,6 +46,8 @@ extern bool qfile_lock(int fd);
 extern bool qfile_unlock(int fd);
 extern bool qfile_exist(const char *filepath);
 extern void *qfile_load(const char *filepath, size_t *nbytes);
+extern void *qfile_map(const char *filepath, size_t *nbytes);
+extern bool qfile_unmap(void *map, size_t nbytes);
 extern void *qfile_read(FILE *fp, size_t *nbytes);
 extern ssize_t qfile_save(const char *filepath, const void *buf, size_t size,
                           bool append);
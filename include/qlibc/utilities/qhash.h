@@ -47,12 +47,20 @@ extern bool qhashmd5(const void *data, size_t nbytes, void *retbuf);
 extern bool qhashmd5_file(const char *filepath, off_t offset, ssize_t nbytes,
                           void *retbuf);
 
+extern bool qhashtree(const void *data, size_t nbytes, size_t chunksize,
+                      int nthreads, void *retbuf);
+extern bool qhashtree_file(const char *filepath, off_t offset, ssize_t nbytes,
+                           size_t chunksize, int nthreads, void *retbuf);
+
 extern uint32_t qhashfnv1_32(const void *data, size_t nbytes);
 extern uint64_t qhashfnv1_64(const void *data, size_t nbytes);
 
 extern uint32_t qhashmurmur3_32(const void *data, size_t nbytes);
 extern bool qhashmurmur3_128(const void *data, size_t nbytes, void *retbuf);
 
+extern uint64_t qhashxx64(const void *data, size_t nbytes);
+extern uint32_t qhashxx32(const void *data, size_t nbytes);
+
 #ifdef __cplusplus
 }
 #endif
@@ -37,21 +37,42 @@
 
 #include <stdlib.h>
 #include <stdbool.h>
+#include <sys/uio.h>
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/* types */
+typedef struct qio_reader_s qio_reader_t;
+
 extern int qio_wait_readable(int fd, int timeoutms);
 extern int qio_wait_writable(int fd, int timeoutms);
 extern ssize_t qio_read(int fd, void *buf, size_t nbytes, int timeoutms);
 extern ssize_t qio_write(int fd, const void *data, size_t nbytes,
                          int timeoutms);
+extern ssize_t qio_writev(int fd, const struct iovec *iov, int iovcnt,
+                          int timeoutms);
 extern off_t qio_send(int outfd, int infd, off_t nbytes, int timeoutms);
 extern ssize_t qio_gets(int fd, char *buf, size_t bufsize, int timeoutms);
 extern ssize_t qio_puts(int fd, const char *str, int timeoutms);
 extern ssize_t qio_printf(int fd, int timeoutms, const char *format, ...);
 
+extern qio_reader_t *qio_reader(int fd, size_t bufsize);
+extern qio_reader_t *qio_reader_custom(ssize_t (*readfn)(void *arg, void *buf,
+                                                         size_t nbytes,
+                                                         int timeoutms),
+                                       void *arg, size_t bufsize);
+extern ssize_t qio_reader_gets(qio_reader_t *reader, char *buf,
+                               size_t bufsize, int timeoutms);
+extern ssize_t qio_reader_read(qio_reader_t *reader, void *buf,
+                               size_t nbytes, int timeoutms);
+extern off_t qio_reader_send(qio_reader_t *reader, int outfd, off_t nbytes,
+                             int timeoutms);
+extern size_t qio_reader_pending(qio_reader_t *reader);
+extern void qio_reader_reset(qio_reader_t *reader);
+extern void qio_reader_free(qio_reader_t *reader);
+
 #ifdef __cplusplus
 }
 #endif
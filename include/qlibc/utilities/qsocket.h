@@ -37,16 +37,42 @@
 
 #include <stdlib.h>
 #include <stdbool.h>
+#include <sys/socket.h>
 #include <netinet/in.h>
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+#define QSOCKET_MAXADDRS    (8)  /*!< addresses of a host tried to connect */
+
+/* types */
+typedef struct qsocket_opts_s qsocket_opts_t;
+
+/**
+ * Socket tuning profile. Zero fields leave the system defaults alone.
+ */
+struct qsocket_opts_s {
+    bool nodelay;       /*!< TCP_NODELAY, don't hold back small writes */
+    bool quickack;      /*!< TCP_QUICKACK, don't delay ACKs */
+    bool fastopen;      /*!< TCP_FASTOPEN_CONNECT, data in SYN on reconnect */
+    bool reuseport;     /*!< SO_REUSEPORT */
+    int sndbuf;         /*!< SO_SNDBUF bytes */
+    int rcvbuf;         /*!< SO_RCVBUF bytes */
+    int busypollus;     /*!< SO_BUSY_POLL microseconds */
+    int lingersec;      /*!< SO_LINGER seconds */
+};
+
 extern int qsocket_open(const char *hostname, int port, int timeoutms);
+extern int qsocket_open_opts(const char *hostname, int port, int timeoutms,
+                             const qsocket_opts_t *opts);
+extern bool qsocket_set_opts(int sockfd, const qsocket_opts_t *opts);
 extern bool qsocket_close(int sockfd, int timeoutms);
 extern bool qsocket_get_addr(struct sockaddr_in *addr, const char *hostname,
                              int port);
+extern int qsocket_resolve(struct sockaddr_storage *addrs, int maxaddrs,
+                           const char *hostname, int port);
+extern void qsocket_set_dnscache(int ttlms, size_t maxhosts);
 extern char *qsocket_get_localaddr(char *buf, size_t bufsize);
 
 #ifdef __cplusplus
@@ -50,6 +50,8 @@ extern char *qstrtrim_tail(char *str);
 extern char *qstrunchar(char *str, char head, char tail);
 extern char *qstrreplace(const char *mode, char *srcstr, const char *tokstr,
                          const char *word);
+extern char *qstrreplace_multi(const char *srcstr, const char **tokens,
+                               const char **words, size_t num);
 extern char *qstrcpy(char *dst, size_t size, const char *src);
 extern char *qstrncpy(char *dst, size_t size, const char *src, size_t nbytes);
 extern char *qstrdupf(const char *format, ...);
@@ -35,12 +35,41 @@
 #ifndef _QSYSTEM_H
 #define _QSYSTEM_H
 
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/* types */
+typedef struct qlibc_allocator_s qlibc_allocator_t;
+
+/**
+ * Allocator used for all memory qlibc allocates, see qlibc_set_allocator().
+ */
+struct qlibc_allocator_s {
+    void *(*malloc) (void *arg, size_t size);
+    void *(*realloc) (void *arg, void *ptr, size_t size);
+    void (*free) (void *arg, void *ptr, size_t size); /*!< size 0: unknown */
+    size_t (*usable_size) (void *arg, void *ptr); /*!< can be NULL */
+    void *arg;          /*!< passed to every call, for arena or accounting */
+};
+
 extern const char *qgetenv(const char *envname, const char *nullstr);
 extern char *qsyscmd(const char *cmd);
+extern bool qlockstats_dump(FILE *out, bool json);
+extern void qlockstats_reset(void);
+
+extern bool qlibc_set_allocator(const qlibc_allocator_t *allocator);
+extern void *qlibc_malloc(size_t size);
+extern void *qlibc_calloc(size_t nmemb, size_t size);
+extern void *qlibc_realloc(void *ptr, size_t size);
+extern char *qlibc_strdup(const char *str);
+extern void qlibc_free(void *ptr);
+extern void qlibc_free_sized(void *ptr, size_t size);
+extern size_t qlibc_usable_size(void *ptr);
 
 #ifdef __cplusplus
 }
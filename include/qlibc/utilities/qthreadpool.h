@@ -0,0 +1,94 @@
+/******************************************************************************
+ * qLibc
+ *
+ * Copyright (c) 2010-2014 Seungyoung Kim.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *****************************************************************************/
+
+/**
+ * Thread pool.
+ *
+ * @file qthreadpool.h
+ */
+
+#ifndef _QTHREADPOOL_H
+#define _QTHREADPOOL_H
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* types */
+typedef struct qthreadpool_s qthreadpool_t;
+typedef struct qthreadpool_future_s qthreadpool_future_t;
+
+/* public functions */
+extern qthreadpool_t *qthreadpool(int nthreads);
+extern qthreadpool_t *qthreadpool_shared(void);
+
+/**
+ * qthreadpool object structure
+ */
+struct qthreadpool_s {
+    /* encapsulated member functions */
+    bool (*submit) (qthreadpool_t *pool, void *(*func)(void *arg), void *arg);
+    qthreadpool_future_t *(*async) (qthreadpool_t *pool,
+                                    void *(*func)(void *arg), void *arg);
+    bool (*done) (qthreadpool_t *pool, qthreadpool_future_t *future);
+    void *(*get) (qthreadpool_t *pool, qthreadpool_future_t *future);
+    bool (*parallel_for) (qthreadpool_t *pool, size_t begin, size_t end,
+                          size_t grain,
+                          void (*func)(void *arg, size_t begin, size_t end),
+                          void *arg);
+
+    bool (*wait) (qthreadpool_t *pool);
+    size_t (*size) (qthreadpool_t *pool);
+    size_t (*pending) (qthreadpool_t *pool);
+    void (*free) (qthreadpool_t *pool);
+
+    /* private variables - do not access directly */
+    struct qthreadpool_worker_s *workers;  /*!< worker threads */
+    int nworkers;            /*!< number of workers */
+    size_t next;             /*!< round-robin worker of outside submits */
+    size_t unfinished;       /*!< tasks submitted but not completed */
+    size_t queued;           /*!< tasks queued but not started */
+    bool stop;               /*!< workers exit when set */
+    bool shared;             /*!< made by qthreadpool_shared() */
+
+    pthread_mutex_t sleeplock;  /*!< mutex for sleepcond and donecond */
+    pthread_cond_t sleepcond;   /*!< signaled on submit if workers sleep */
+    pthread_cond_t donecond;    /*!< broadcast on completion if waited */
+    int sleepers;            /*!< number of workers waiting for tasks */
+    int waiters;             /*!< number of threads waiting on donecond */
+};
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*_QTHREADPOOL_H */
@@ -37,13 +37,24 @@
 
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <time.h>
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/* buffer size for qtime_gmt_httpstr(), "Sun, 06 Nov 1994 08:49:37 GMT" */
+#define QTIME_HTTPSTR_SIZE  (30)
+
 extern long qtime_current_milli(void);
+extern int64_t qtime_monotonic_ns(void);
+extern long qtime_monotonic_coarse_ms(void);
+
+extern bool qtime_cached_start(int intervalms);
+extern void qtime_cached_stop(void);
+extern long qtime_cached_ms(void);
+extern time_t qtime_cached_time(void);
 
 extern char *qtime_localtime_strf(char *buf, int size, time_t utctime,
                                   const char *format);
@@ -53,6 +64,7 @@ extern char *qtime_gmt_strf(char *buf, int size, time_t utctime,
                             const char *format);
 extern char *qtime_gmt_str(time_t utctime);
 extern const char *qtime_gmt_staticstr(time_t utctime);
+extern size_t qtime_gmt_httpstr(char *buf, time_t utctime);
 extern time_t qtime_parse_gmtstr(const char *gmtstr);
 
 #ifdef __cplusplus
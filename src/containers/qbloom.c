@@ -0,0 +1,526 @@
+/******************************************************************************
+ * qLibc
+ *
+ * Copyright (c) 2010-2014 Seungyoung Kim.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *****************************************************************************/
+
+/**
+ * @file qbloom.c Bloom filter implementation.
+ *
+ * qbloom is a compact probabilistic membership filter. It answers whether a
+ * key may have been added or definitely hasn't, so it can sit in front of
+ * any table to skip lookups that would miss. A check never gives false
+ * negatives, but gives false positives at the rate chosen at sizing time.
+ *
+ * Like qhasharr, the filter works in fixed size flat memory given by user
+ * such as shared memory, and all the information is kept in that memory.
+ * Cells are updated by atomic operations, so the filter can be shared by
+ * threads and processes without any lock.
+ *
+ * Keys are hashed once by qhashmurmur3_128() and the 128-bit hash is split
+ * into two 64-bit hashes to derive all the cell positions by double hashing.
+ *
+ * With QBLOOM_COUNTING option, each cell is a 4-bit counter instead of a bit
+ * so keys can be removed at the cost of 4 times bigger memory. A counter
+ * which reached its maximum stays there, to never bring false negatives.
+ *
+ * @code
+ *  // a filter for 10000 keys with 1% false positive rate.
+ *  size_t memsize = qbloom_calculate_memsize(10000, 0.01, 0);
+ *  void *memory = malloc(memsize);
+ *  qbloom_t *bloom = qbloom(memory, memsize, 10000, 0);
+ *
+ *  // add keys along with the table.
+ *  tbl->putstr(tbl, "key1", "value1");
+ *  bloom->add(bloom, "key1");
+ *
+ *  // skip the lookup if the key is definitely not there.
+ *  char *value = NULL;
+ *  if (bloom->check(bloom, "key1") == true) {
+ *      value = tbl->getstr(tbl, "key1", false);
+ *  }
+ *
+ *  // free reference object and memory.
+ *  bloom->free(bloom);
+ *  free(memory);
+ * @endcode
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <errno.h>
+#include "qinternal.h"
+#include "utilities/qhash.h"
+#include "containers/qbloom.h"
+
+#ifndef _DOXYGEN_SKIP
+
+#define MAX_NHASH       (32)
+#define COUNTER_MAX     (0x0f)
+#define LN2             (0.69314718055994530942)
+
+static bool add(qbloom_t *bloom, const char *key);
+static bool adddata(qbloom_t *bloom, const void *data, size_t size);
+static bool check(qbloom_t *bloom, const char *key);
+static bool checkdata(qbloom_t *bloom, const void *data, size_t size);
+static bool remove_(qbloom_t *bloom, const char *key);
+static bool removedata(qbloom_t *bloom, const void *data, size_t size);
+
+static size_t size(qbloom_t *bloom);
+static void clear(qbloom_t *bloom);
+static bool debug(qbloom_t *bloom, FILE *out);
+
+static void free_(qbloom_t *bloom);
+
+// internal usages
+static void _positions(qbloom_t *bloom, const void *data, size_t size,
+                       uint64_t *positions);
+static unsigned int _get_cell(qbloom_t *bloom, uint64_t pos);
+static void _inc_cell(qbloom_t *bloom, uint64_t pos);
+static void _dec_cell(qbloom_t *bloom, uint64_t pos);
+static double _ln(double x);
+
+#endif
+
+/**
+ * Get how much memory is needed for a filter.
+ *
+ * @param maxkeys   expected number of keys.
+ * @param fprate    desired false positive rate, between 0 and 1.
+ * @param options   QBLOOM_COUNTING if the filter will be made with it.
+ *
+ * @return memory size needed, or 0 for invalid arguments.
+ *
+ * @note
+ *  The size is computed for optimal number of hash functions, which
+ *  qbloom() chooses from the memory size and maxkeys.
+ */
+size_t qbloom_calculate_memsize(size_t maxkeys, double fprate, int options) {
+    if (maxkeys == 0 || !(fprate > 0.0 && fprate < 1.0))
+        return 0;
+
+    // m = -n * ln(p) / (ln 2)^2
+    double ncells = -(double) maxkeys * _ln(fprate) / (LN2 * LN2);
+    size_t cellsperbyte = (options & QBLOOM_COUNTING) ? 2 : 8;
+    size_t nbytes = ((size_t) ncells + cellsperbyte) / cellsperbyte;
+    return sizeof(qbloom_data_t) + nbytes;
+}
+
+/**
+ * Initialize a bloom filter.
+ *
+ * @param memory    a pointer of data memory.
+ * @param memsize   a size of data memory, 0 for using existing data.
+ * @param maxkeys   expected number of keys, ignored when memsize is 0.
+ * @param options   combination of initialization options.
+ *
+ * @return qbloom_t container pointer, otherwise returns NULL.
+ * @retval errno  will be set in error condition.
+ *  - EINVAL : Invalid argument or assigned memory is too small.
+ *  - ENOMEM : Memory allocation failure.
+ *
+ * @code
+ *  [CREATOR SIDE]
+ *  size_t memsize = qbloom_calculate_memsize(10000, 0.01, QBLOOM_COUNTING);
+ *  int shmid = qshm_init("/tmp/some_id_file", 'b', memsize, true);
+ *  qbloom_t *bloom = qbloom(qshm_get(shmid), memsize, 10000,
+ *                           QBLOOM_COUNTING);
+ *
+ *  [USER SIDE]
+ *  int shmid = qshm_getid("/tmp/some_id_file", 'b');
+ *  qbloom_t *bloom = qbloom(qshm_get(shmid), 0, 0, 0);
+ * @endcode
+ *
+ * @note
+ *  Available options:
+ *   - QBLOOM_COUNTING - use 4-bit counters to support remove().
+ *  The number of hash functions is chosen as (cells / maxkeys) * ln 2, which
+ *  gives the lowest false positive rate when maxkeys keys are added.
+ */
+qbloom_t *qbloom(void *memory, size_t memsize, size_t maxkeys, int options) {
+    if (memory == NULL) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    qbloom_data_t *data = (qbloom_data_t *) memory;
+    if (memsize > 0) {
+        if (maxkeys == 0 || memsize <= sizeof(qbloom_data_t)) {
+            errno = EINVAL;
+            return NULL;
+        }
+        size_t cellsperbyte = (options & QBLOOM_COUNTING) ? 2 : 8;
+        uint64_t ncells = (uint64_t) (memsize - sizeof(qbloom_data_t))
+                * cellsperbyte;
+        int nhash = (int) ((double) ncells / (double) maxkeys * LN2 + 0.5);
+        if (nhash < 1)
+            nhash = 1;
+        else if (nhash > MAX_NHASH)
+            nhash = MAX_NHASH;
+
+        memset((void *) data, 0, memsize);
+        data->ncells = ncells;
+        data->nhash = nhash;
+        data->options = options;
+        data->num = 0;
+    }
+
+    // Create the filter object.
+    qbloom_t *bloom = (qbloom_t *) qlibc_calloc(1, sizeof(qbloom_t));
+    if (bloom == NULL) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    // assign methods
+    bloom->add = add;
+    bloom->adddata = adddata;
+    bloom->check = check;
+    bloom->checkdata = checkdata;
+    bloom->remove = remove_;
+    bloom->removedata = removedata;
+
+    bloom->size = size;
+    bloom->clear = clear;
+    bloom->debug = debug;
+
+    bloom->free = free_;
+
+    bloom->data = data;
+    bloom->cells = (unsigned char *) memory + sizeof(qbloom_data_t);
+
+    return bloom;
+}
+
+/**
+ * qbloom->add(): Add a key into this filter.
+ *
+ * @param bloom     qbloom_t container pointer.
+ * @param key       key string
+ *
+ * @return true if successful, otherwise returns false
+ * @retval errno will be set in error condition.
+ *  - EINVAL : Invalid argument.
+ */
+static bool add(qbloom_t *bloom, const char *key) {
+    if (key == NULL) {
+        errno = EINVAL;
+        return false;
+    }
+    return adddata(bloom, key, strlen(key));
+}
+
+/**
+ * qbloom->adddata(): Add a binary key into this filter.
+ *
+ * @param bloom     qbloom_t container pointer.
+ * @param data      key data
+ * @param size      size of key data
+ *
+ * @return true if successful, otherwise returns false
+ * @retval errno will be set in error condition.
+ *  - EINVAL : Invalid argument.
+ */
+static bool adddata(qbloom_t *bloom, const void *data, size_t size) {
+    if (data == NULL) {
+        errno = EINVAL;
+        return false;
+    }
+
+    uint64_t positions[MAX_NHASH];
+    _positions(bloom, data, size, positions);
+    int i;
+    for (i = 0; i < bloom->data->nhash; i++) {
+        _inc_cell(bloom, positions[i]);
+    }
+    __sync_fetch_and_add(&bloom->data->num, 1);
+
+    return true;
+}
+
+/**
+ * qbloom->check(): Check whether a key may be in this filter.
+ *
+ * @param bloom     qbloom_t container pointer.
+ * @param key       key string
+ *
+ * @return true if the key may have been added, false if it definitely
+ *  hasn't been added.
+ * @retval errno will be set in error condition.
+ *  - ENOENT : Key is not in the filter.
+ *  - EINVAL : Invalid argument.
+ */
+static bool check(qbloom_t *bloom, const char *key) {
+    if (key == NULL) {
+        errno = EINVAL;
+        return false;
+    }
+    return checkdata(bloom, key, strlen(key));
+}
+
+/**
+ * qbloom->checkdata(): Check whether a binary key may be in this filter.
+ *
+ * @param bloom     qbloom_t container pointer.
+ * @param data      key data
+ * @param size      size of key data
+ *
+ * @return true if the key may have been added, false if it definitely
+ *  hasn't been added.
+ * @retval errno will be set in error condition.
+ *  - ENOENT : Key is not in the filter.
+ *  - EINVAL : Invalid argument.
+ */
+static bool checkdata(qbloom_t *bloom, const void *data, size_t size) {
+    if (data == NULL) {
+        errno = EINVAL;
+        return false;
+    }
+
+    uint64_t positions[MAX_NHASH];
+    _positions(bloom, data, size, positions);
+    int i;
+    for (i = 0; i < bloom->data->nhash; i++) {
+        if (_get_cell(bloom, positions[i]) == 0) {
+            errno = ENOENT;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * qbloom->remove(): Remove a key from this filter.
+ *
+ * @param bloom     qbloom_t container pointer.
+ * @param key       key string
+ *
+ * @return true if successful, otherwise returns false
+ * @retval errno will be set in error condition.
+ *  - ENOENT : Key is not in the filter.
+ *  - ENOTSUP : The filter is not made with QBLOOM_COUNTING option.
+ *  - EINVAL : Invalid argument.
+ *
+ * @note
+ *  Only keys which have been added should be removed. Removing a key which
+ *  passed check() as a false positive brings false negatives of other keys.
+ */
+static bool remove_(qbloom_t *bloom, const char *key) {
+    if (key == NULL) {
+        errno = EINVAL;
+        return false;
+    }
+    return removedata(bloom, key, strlen(key));
+}
+
+/**
+ * qbloom->removedata(): Remove a binary key from this filter.
+ *
+ * @param bloom     qbloom_t container pointer.
+ * @param data      key data
+ * @param size      size of key data
+ *
+ * @return true if successful, otherwise returns false
+ * @retval errno will be set in error condition.
+ *  - ENOENT : Key is not in the filter.
+ *  - ENOTSUP : The filter is not made with QBLOOM_COUNTING option.
+ *  - EINVAL : Invalid argument.
+ */
+static bool removedata(qbloom_t *bloom, const void *data, size_t size) {
+    if (data == NULL) {
+        errno = EINVAL;
+        return false;
+    }
+    if (!(bloom->data->options & QBLOOM_COUNTING)) {
+        errno = ENOTSUP;
+        return false;
+    }
+
+    uint64_t positions[MAX_NHASH];
+    _positions(bloom, data, size, positions);
+    int i;
+    for (i = 0; i < bloom->data->nhash; i++) {
+        if (_get_cell(bloom, positions[i]) == 0) {
+            errno = ENOENT;
+            return false;
+        }
+    }
+    for (i = 0; i < bloom->data->nhash; i++) {
+        _dec_cell(bloom, positions[i]);
+    }
+    __sync_fetch_and_sub(&bloom->data->num, 1);
+
+    return true;
+}
+
+/**
+ * qbloom->size(): Returns the number of keys added into this filter.
+ *
+ * @param bloom     qbloom_t container pointer.
+ *
+ * @return number of keys added and not removed.
+ */
+static size_t size(qbloom_t *bloom) {
+    int64_t num = bloom->data->num;
+    return (num > 0) ? (size_t) num : 0;
+}
+
+/**
+ * qbloom->clear(): Clears this filter so that it will contain no keys.
+ *
+ * @param bloom     qbloom_t container pointer.
+ *
+ * @note
+ *  It's not atomic against concurrent add().
+ */
+static void clear(qbloom_t *bloom) {
+    size_t cellsperbyte = (bloom->data->options & QBLOOM_COUNTING) ? 2 : 8;
+    memset((void *) bloom->cells, 0, bloom->data->ncells / cellsperbyte);
+    bloom->data->num = 0;
+}
+
+/**
+ * qbloom->debug(): Print out filter information for debugging purpose.
+ *
+ * @param bloom     qbloom_t container pointer.
+ * @param out       output stream
+ *
+ * @return true if successful, otherwise returns false.
+ * @retval errno will be set in error condition.
+ *  - EIO : Invalid output stream.
+ */
+static bool debug(qbloom_t *bloom, FILE *out) {
+    if (out == NULL) {
+        errno = EIO;
+        return false;
+    }
+
+    uint64_t i, used = 0;
+    for (i = 0; i < bloom->data->ncells; i++) {
+        if (_get_cell(bloom, i) != 0)
+            used++;
+    }
+    fprintf(out, "cells=%" PRIu64 ", used=%" PRIu64 ", nhash=%d, keys=%zu%s\n",
+            bloom->data->ncells, used, bloom->data->nhash, size(bloom),
+            (bloom->data->options & QBLOOM_COUNTING) ? ", counting" : "");
+
+    return true;
+}
+
+/**
+ * qbloom->free(): De-allocate filter reference object.
+ *
+ * @param bloom     qbloom_t container pointer.
+ *
+ * @note
+ *  This does not de-allocate memory but only function reference object.
+ *  Data memory such as shared memory must be de-allocated separately.
+ */
+static void free_(qbloom_t *bloom) {
+    qlibc_free(bloom);
+}
+
+#ifndef _DOXYGEN_SKIP
+
+// cell positions of a key by double hashing.
+static void _positions(qbloom_t *bloom, const void *data, size_t size,
+                       uint64_t *positions) {
+    uint64_t hash[2];
+    qhashmurmur3_128(data, size, hash);
+    uint64_t h1 = hash[0], h2 = hash[1] | 1;  // h2 must not be 0
+    int i;
+    for (i = 0; i < bloom->data->nhash; i++) {
+        positions[i] = (h1 + (uint64_t) i * h2) % bloom->data->ncells;
+    }
+}
+
+static unsigned int _get_cell(qbloom_t *bloom, uint64_t pos) {
+    if (bloom->data->options & QBLOOM_COUNTING) {
+        unsigned char byte = ((volatile unsigned char *) bloom->cells)[pos / 2];
+        return (pos & 1) ? (byte >> 4) : (byte & 0x0f);
+    }
+    return (((volatile unsigned char *) bloom->cells)[pos / 8]
+            >> (pos % 8)) & 0x01;
+}
+
+static void _inc_cell(qbloom_t *bloom, uint64_t pos) {
+    if (!(bloom->data->options & QBLOOM_COUNTING)) {
+        __sync_fetch_and_or(&bloom->cells[pos / 8],
+                            (unsigned char) (0x01 << (pos % 8)));
+        return;
+    }
+
+    unsigned char *byte = &bloom->cells[pos / 2];
+    int shift = (pos & 1) ? 4 : 0;
+    unsigned char old, new;
+    do {
+        old = *(volatile unsigned char *) byte;
+        if (((old >> shift) & 0x0f) == COUNTER_MAX)
+            return;  // saturated
+        new = old + (unsigned char) (0x01 << shift);
+    } while (__sync_val_compare_and_swap(byte, old, new) != old);
+}
+
+static void _dec_cell(qbloom_t *bloom, uint64_t pos) {
+    unsigned char *byte = &bloom->cells[pos / 2];
+    int shift = (pos & 1) ? 4 : 0;
+    unsigned char old, new;
+    do {
+        old = *(volatile unsigned char *) byte;
+        unsigned int count = (old >> shift) & 0x0f;
+        if (count == 0 || count == COUNTER_MAX)
+            return;  // saturated counters never go down
+        new = old - (unsigned char) (0x01 << shift);
+    } while (__sync_val_compare_and_swap(byte, old, new) != old);
+}
+
+// natural logarithm for sizing without depending on libm.
+static double _ln(double x) {
+    int exp = 0;
+    while (x >= 2.0) {
+        x /= 2.0;
+        exp++;
+    }
+    while (x < 1.0) {
+        x *= 2.0;
+        exp--;
+    }
+
+    // ln(x) = 2 * atanh((x - 1) / (x + 1)) for x in [1, 2)
+    double y = (x - 1.0) / (x + 1.0), y2 = y * y, term = y, sum = 0.0;
+    int i;
+    for (i = 1; i < 40; i += 2) {
+        sum += term / i;
+        term *= y2;
+    }
+    return 2.0 * sum + exp * LN2;
+}
+
+#endif /* _DOXYGEN_SKIP */
@@ -0,0 +1,778 @@
+/******************************************************************************
+ * qLibc
+ *
+ * Copyright (c) 2010-2014 Seungyoung Kim.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *****************************************************************************/
+
+/**
+ * @file qfrozentbl.c Immutable perfect-hash table implementation.
+ *
+ * qfrozentbl is built once from a fixed set of keys and can't be modified
+ * afterwards. It suits tables such as HTTP header names, configuration keys
+ * and MIME types which are looked up often and never change.
+ *
+ * Keys are placed by a minimal perfect hash function found with the
+ * compress, hash and displace (CHD) algorithm. Keys are split into small
+ * buckets and each bucket gets a displacement which moves all of its keys
+ * to free slots. A lookup hashes the key once, reads the displacement of
+ * its bucket and compares the key in the only slot it can be in. There are
+ * as many slots as keys, so nothing is wasted on empty slots or chains.
+ *
+ * The displacements, the slot offsets and the key/value records are stored
+ * in a single allocation.
+ *
+ * @code
+ *  [Conceptional Data Structure Diagram]
+ *
+ *  key -> hash -> bucket -> displacement -> slot -> record
+ *
+ *  displace [ d0 ][ d1 ][ d2 ]...       (4 bytes per 4 keys)
+ *  offsets  [ o0 ][ o1 ][ o2 ][ o3 ]... (4 bytes per key)
+ *  records  [ namelen|check|size|name|data ][ ... ]
+ * @endcode
+ *
+ * @code
+ *  // build from an array
+ *  qnobj_t objs[] = {
+ *      { "html", "text/html", 10 },
+ *      { "css",  "text/css",  9 },
+ *      { "png",  "image/png", 10 }
+ *  };
+ *  qfrozentbl_t *mime = qfrozentbl(objs, 3, QFROZENTBL_CASEINSENSITIVE);
+ *
+ *  // or freeze a table
+ *  qfrozentbl_t *frozen = tbl->freeze(tbl);
+ *
+ *  char *type = mime->getstr(mime, "PNG", false);
+ *
+ *  mime->free(mime);
+ * @endcode
+ *
+ * @note
+ *  It's safe to read from multiple threads without locking since nothing
+ *  is modified after construction.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <errno.h>
+#include "qinternal.h"
+#include "utilities/qhash.h"
+#include "containers/qfrozentbl.h"
+
+#ifndef _DOXYGEN_SKIP
+
+#define BUCKET_KEYS     (4)         /*!< average keys in a bucket */
+#define MAX_SEEDS       (32)        /*!< hash seeds to try */
+#define MAX_ROUNDS      (64)        /*!< slot steps to try on a bucket */
+
+/* key/value record, followed by the name and the data 8-byte aligned. */
+struct _rec_s {
+    uint32_t namelen;
+    uint32_t check;     /*!< upper half of the key hash */
+    uint64_t size;
+};
+
+#define REC_ALIGN(n)        (((n) + 7) & ~((size_t) 7))
+#define REC_LEN(namelen, size)                                          \
+    (sizeof(struct _rec_s) + REC_ALIGN((namelen) + 1) + REC_ALIGN(size))
+#define REC_NAME(r)         ((char *) (r) + sizeof(struct _rec_s))
+#define REC_DATA(r)         (REC_NAME(r) + REC_ALIGN((r)->namelen + 1))
+#define REC_AT(tbl, slot)                                               \
+    ((struct _rec_s *) ((tbl)->records + ((size_t) (tbl)->offsets[slot] * 8)))
+
+/* a key while building. */
+struct _key_s {
+    uint64_t base;      /*!< hash of the key */
+    size_t idx;         /*!< index in objs */
+    size_t namelen;
+    uint32_t bucket;
+    uint32_t h1;        /*!< first slot of the key */
+    uint32_t h2;        /*!< slot step of the key */
+};
+
+static void *get(qfrozentbl_t *tbl, const char *name, size_t *size,
+                 bool newmem);
+static char *getstr(qfrozentbl_t *tbl, const char *name, bool newmem);
+static int64_t getint(qfrozentbl_t *tbl, const char *name);
+static bool getnext(qfrozentbl_t *tbl, qnobj_t *obj, int *idx, bool newmem);
+static size_t size(qfrozentbl_t *tbl);
+static bool debug(qfrozentbl_t *tbl, FILE *out);
+static bool stats(qfrozentbl_t *tbl, qstats_t *stats);
+static void free_(qfrozentbl_t *tbl);
+
+static uint64_t _mix(uint64_t x);
+static uint64_t _basehash(int options, const char *name, size_t namelen);
+static void _keyhash(uint64_t base, uint64_t seed, size_t num,
+                     size_t nbuckets, uint32_t *bucket, uint32_t *h1,
+                     uint32_t *h2);
+static uint32_t _slot(uint32_t h1, uint32_t h2, uint32_t d, size_t num);
+static bool _samename(int options, const char *a, const char *b, size_t len);
+static size_t _dedup(const qnobj_t *objs, struct _key_s *keys, size_t num,
+                     int options);
+static bool _place(struct _key_s *keys, size_t num, size_t nbuckets,
+                   uint64_t seed, uint32_t *displace, size_t *slotkey);
+static struct _rec_s *_find(qfrozentbl_t *tbl, const char *name);
+
+#endif
+
+/**
+ * Build an immutable table from an array of named objects.
+ *
+ * @param objs      array of objects. Names must be NULL terminated.
+ * @param num       number of objects.
+ * @param options   combination of initialization options.
+ *
+ * @return a pointer of malloced qfrozentbl_t in case of successful,
+ *         otherwise returns NULL.
+ * @retval errno will be set in error condition.
+ *  - EINVAL  : Invalid argument.
+ *  - ENOMEM  : Memory allocation failure.
+ *  - EDEADLK : No perfect hash function found, practically never.
+ *
+ * @code
+ *  qfrozentbl_t *tbl = qfrozentbl(objs, num, 0);
+ * @endcode
+ *
+ * @note
+ *  Available options:
+ *   - QFROZENTBL_CASEINSENSITIVE - keys are case insensitive.
+ *  When a name appears more than once, the first one is kept. Names and
+ *  data are copied into the table, so objs can be freed afterwards.
+ */
+qfrozentbl_t *qfrozentbl(const qnobj_t *objs, size_t num, int options) {
+    if ((objs == NULL && num > 0) || num >= UINT32_MAX) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    struct _key_s *keys = NULL;
+    size_t *slotkey = NULL;
+    uint32_t *displace = NULL;
+    if (num > 0) {
+        keys = (struct _key_s *) qlibc_malloc(sizeof(struct _key_s) * num);
+        slotkey = (size_t *) qlibc_malloc(sizeof(size_t) * num);
+        displace = (uint32_t *) qlibc_malloc(sizeof(uint32_t) * num);
+        if (keys == NULL || slotkey == NULL || displace == NULL) {
+            errno = ENOMEM;
+            goto fail;
+        }
+    }
+
+    // drop duplicated names.
+    size_t i;
+    for (i = 0; i < num; i++) {
+        if (objs[i].name == NULL || (objs[i].data == NULL && objs[i].size > 0)) {
+            errno = EINVAL;
+            goto fail;
+        }
+    }
+    num = _dedup(objs, keys, num, options);
+    if (num == (size_t) -1)
+        goto fail;
+
+    // find a seed making a perfect hash.
+    size_t nbuckets = (num + BUCKET_KEYS - 1) / BUCKET_KEYS;
+    uint64_t seed = 0;
+    if (num > 0) {
+        int attempt;
+        for (attempt = 0; attempt < MAX_SEEDS; attempt++) {
+            seed = _mix(0x9E3779B97F4A7C15ULL * (attempt + 1));
+            if (_place(keys, num, nbuckets, seed, displace, slotkey) == true)
+                break;
+            if (errno == ENOMEM)
+                goto fail;
+        }
+        if (attempt == MAX_SEEDS) {
+            errno = EDEADLK;
+            goto fail;
+        }
+    }
+
+    // lay out records in slot order.
+    size_t keybytes = 0, valuebytes = 0, recbytes = 0;
+    for (i = 0; i < num; i++) {
+        const qnobj_t *obj = &objs[keys[i].idx];
+        keybytes += keys[i].namelen + 1;
+        valuebytes += obj->size;
+        recbytes += REC_LEN(keys[i].namelen, obj->size);
+    }
+    if (recbytes / 8 >= UINT32_MAX) {
+        errno = EINVAL;
+        goto fail;
+    }
+
+    size_t hdrsize = REC_ALIGN(sizeof(qfrozentbl_t));
+    size_t dispsize = REC_ALIGN(sizeof(uint32_t) * nbuckets);
+    size_t offsize = REC_ALIGN(sizeof(uint32_t) * num);
+    size_t memsize = hdrsize + dispsize + offsize + recbytes;
+    qfrozentbl_t *tbl = (qfrozentbl_t *) qlibc_calloc(1, memsize);
+    if (tbl == NULL) {
+        errno = ENOMEM;
+        goto fail;
+    }
+    tbl->options = options;
+    tbl->num = num;
+    tbl->nbuckets = nbuckets;
+    tbl->seed = seed;
+    tbl->displace = (uint32_t *) ((char *) tbl + hdrsize);
+    tbl->offsets = (uint32_t *) ((char *) tbl->displace + dispsize);
+    tbl->records = (char *) tbl->offsets + offsize;
+    tbl->keybytes = keybytes;
+    tbl->valuebytes = valuebytes;
+    tbl->memsize = memsize;
+    if (nbuckets > 0)
+        memcpy(tbl->displace, displace, sizeof(uint32_t) * nbuckets);
+
+    size_t off = 0, slot;
+    for (slot = 0; slot < num; slot++) {
+        struct _key_s *key = &keys[slotkey[slot]];
+        const qnobj_t *obj = &objs[key->idx];
+        struct _rec_s *rec = (struct _rec_s *) (tbl->records + off);
+        rec->namelen = (uint32_t) key->namelen;
+        rec->check = (uint32_t) (key->base >> 32);
+        rec->size = obj->size;
+        memcpy(REC_NAME(rec), obj->name, key->namelen + 1);
+        if (obj->size > 0)
+            memcpy(REC_DATA(rec), obj->data, obj->size);
+        tbl->offsets[slot] = (uint32_t) (off / 8);
+        off += REC_LEN(key->namelen, obj->size);
+    }
+
+    qlibc_free(keys);
+    qlibc_free(slotkey);
+    qlibc_free(displace);
+
+    // member methods
+    tbl->get = get;
+    tbl->getstr = getstr;
+    tbl->getint = getint;
+    tbl->getnext = getnext;
+    tbl->size = size;
+    tbl->debug = debug;
+    tbl->stats = stats;
+    tbl->free = free_;
+
+    return tbl;
+
+fail:
+    qlibc_free(keys);
+    qlibc_free(slotkey);
+    qlibc_free(displace);
+    return NULL;
+}
+
+/**
+ * qfrozentbl->get(): Get an object from this table.
+ *
+ * @param tbl       qfrozentbl_t container pointer.
+ * @param name      key name.
+ * @param size      if not NULL, oject size will be stored.
+ * @param newmem    whether or not to allocate memory for the data.
+ *
+ * @return a pointer of data if the key is found, otherwise returns NULL.
+ * @retval errno will be set in error condition.
+ *  - ENOENT : No such key found.
+ *  - EINVAL : Invalid argument.
+ *  - ENOMEM : Memory allocation failure.
+ *
+ * @note
+ *  Without newmem, the returned pointer points into the table and stays
+ *  valid until the table is freed. It must not be modified. Data is 8-byte
+ *  aligned.
+ */
+static void *get(qfrozentbl_t *tbl, const char *name, size_t *size,
+                 bool newmem) {
+    if (name == NULL) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    struct _rec_s *rec = _find(tbl, name);
+    if (rec == NULL) {
+        errno = ENOENT;
+        return NULL;
+    }
+
+    void *data = REC_DATA(rec);
+    if (newmem == true) {
+        data = qlibc_malloc(rec->size);
+        if (data == NULL) {
+            errno = ENOMEM;
+            return NULL;
+        }
+        memcpy(data, REC_DATA(rec), rec->size);
+    }
+    if (size != NULL)
+        *size = rec->size;
+
+    return data;
+}
+
+/**
+ * qfrozentbl->getstr(): Finds an object with given name and returns as
+ * string type.
+ *
+ * @param tbl       qfrozentbl_t container pointer.
+ * @param name      key name
+ * @param newmem    whether or not to allocate memory for the data.
+ *
+ * @return a pointer of data if the key is found, otherwise returns NULL.
+ * @retval errno will be set in error condition.
+ *  - ENOENT : No such key found.
+ *  - EINVAL : Invalid argument.
+ *  - ENOMEM : Memory allocation failure.
+ */
+static char *getstr(qfrozentbl_t *tbl, const char *name, bool newmem) {
+    return (char *) get(tbl, name, NULL, newmem);
+}
+
+/**
+ * qfrozentbl->getint(): Finds an object with given name and returns as
+ * integer type.
+ *
+ * @param tbl       qfrozentbl_t container pointer.
+ * @param name      key name
+ *
+ * @return value integer if successful, otherwise(not found) returns 0
+ * @retval errno will be set in error condition.
+ *  - ENOENT : No such key found.
+ *  - EINVAL : Invalid argument.
+ */
+static int64_t getint(qfrozentbl_t *tbl, const char *name) {
+    char *str = getstr(tbl, name, false);
+    return (str != NULL) ? atoll(str) : 0;
+}
+
+/**
+ * qfrozentbl->getnext(): Get next element.
+ *
+ * @param tbl       qfrozentbl_t container pointer.
+ * @param obj       found data will be stored in this object
+ * @param idx       index pointer, must be 0 for the first call.
+ * @param newmem    whether or not to allocate memory for the data.
+ *
+ * @return true if found otherwise returns false
+ * @retval errno will be set in error condition.
+ *  - ENOENT : No next element.
+ *  - ENOMEM : Memory allocation failure.
+ *
+ * @code
+ *  int idx = 0;
+ *  qnobj_t obj;
+ *  while (tbl->getnext(tbl, &obj, &idx, false) == true) {
+ *    printf("NAME=%s, DATA=%s, SIZE=%zu\n",
+ *           obj.name, (char *) obj.data, obj.size);
+ *  }
+ * @endcode
+ *
+ * @note
+ *  Keys are returned in slot order. With newmem, obj.name and obj.data
+ *  must be freed by the caller.
+ */
+static bool getnext(qfrozentbl_t *tbl, qnobj_t *obj, int *idx, bool newmem) {
+    if (obj == NULL || idx == NULL) {
+        errno = EINVAL;
+        return false;
+    }
+    if (*idx < 0 || (size_t) *idx >= tbl->num) {
+        errno = ENOENT;
+        return false;
+    }
+
+    struct _rec_s *rec = REC_AT(tbl, *idx);
+    if (newmem == true) {
+        obj->name = qlibc_strdup(REC_NAME(rec));
+        obj->data = qlibc_malloc(rec->size);
+        if (obj->name == NULL || obj->data == NULL) {
+            qlibc_free(obj->name);
+            qlibc_free(obj->data);
+            errno = ENOMEM;
+            return false;
+        }
+        memcpy(obj->data, REC_DATA(rec), rec->size);
+    } else {
+        obj->name = REC_NAME(rec);
+        obj->data = REC_DATA(rec);
+    }
+    obj->size = rec->size;
+    (*idx)++;
+
+    return true;
+}
+
+/**
+ * qfrozentbl->size(): Returns the number of keys in this table.
+ *
+ * @param tbl       qfrozentbl_t container pointer.
+ *
+ * @return number of elements stored
+ */
+static size_t size(qfrozentbl_t *tbl) {
+    return tbl->num;
+}
+
+/**
+ * qfrozentbl->debug(): Print table for debugging purpose
+ *
+ * @param tbl       qfrozentbl_t container pointer.
+ * @param out       output stream
+ *
+ * @return true if successful, otherwise returns false.
+ * @retval errno will be set in error condition.
+ *  - EIO : Invalid output stream.
+ */
+static bool debug(qfrozentbl_t *tbl, FILE *out) {
+    if (out == NULL) {
+        errno = EIO;
+        return false;
+    }
+
+    int idx = 0;
+    qnobj_t obj;
+    while (getnext(tbl, &obj, &idx, false) == true) {
+        fprintf(out, "%s=", obj.name);
+        _q_humanOut(out, obj.data, obj.size, MAX_HUMANOUT);
+        fprintf(out, " (%zu, slot=%d)\n", obj.size, idx - 1);
+    }
+
+    return true;
+}
+
+/**
+ * qfrozentbl->stats(): Get statistics of this table.
+ *
+ * @param tbl   qfrozentbl_t container pointer.
+ * @param stats statistics will be stored here.
+ *
+ * @return true if successful, otherwise returns false.
+ * @retval errno will be set in error condition.
+ *  - EINVAL : Invalid argument.
+ *
+ * @note
+ *  Every key is in its own slot, so maxchain is 1 and there are no
+ *  collisions. Overhead includes the alignment padding of the records.
+ */
+static bool stats(qfrozentbl_t *tbl, qstats_t *stats) {
+    if (stats == NULL) {
+        errno = EINVAL;
+        return false;
+    }
+    memset((void *) stats, 0, sizeof(qstats_t));
+
+    stats->num = tbl->num;
+    stats->slots = tbl->num;
+    stats->usedslots = tbl->num;
+    stats->loadfactor = (tbl->num > 0) ? 1.0 : 0.0;
+    stats->maxchain = (tbl->num > 0) ? 1 : 0;
+    stats->keybytes = tbl->keybytes;
+    stats->valuebytes = tbl->valuebytes;
+    stats->overhead = tbl->memsize - tbl->keybytes - tbl->valuebytes;
+
+    return true;
+}
+
+/**
+ * qfrozentbl->free(): De-allocate table.
+ *
+ * @param tbl       qfrozentbl_t container pointer.
+ */
+static void free_(qfrozentbl_t *tbl) {
+    qlibc_free(tbl);
+}
+
+#ifndef _DOXYGEN_SKIP
+
+// splitmix64 finalizer.
+static uint64_t _mix(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xBF58476D1CE4E5B9ULL;
+    x ^= x >> 27;
+    x *= 0x94D049BB133111EBULL;
+    x ^= x >> 31;
+    return x;
+}
+
+// FNV-1a over lower-cased bytes for case-insensitive keys.
+static uint64_t _basehash(int options, const char *name, size_t namelen) {
+    if (!(options & QFROZENTBL_CASEINSENSITIVE))
+        return qhashxx64(name, namelen);
+
+    uint64_t h = 0xCBF29CE484222325ULL;
+    size_t i;
+    for (i = 0; i < namelen; i++) {
+        h ^= (uint64_t) tolower((unsigned char) name[i]);
+        h *= 0x100000001B3ULL;
+    }
+    return _mix(h);
+}
+
+// bucket, first slot and slot step of a key, by multiply-shift reduction.
+static void _keyhash(uint64_t base, uint64_t seed, size_t num,
+                     size_t nbuckets, uint32_t *bucket, uint32_t *h1,
+                     uint32_t *h2) {
+    uint64_t h = _mix(base ^ seed);
+    uint64_t g = _mix(h);
+    *bucket = (uint32_t) (((h >> 32) * nbuckets) >> 32);
+    *h1 = (uint32_t) (((h & 0xFFFFFFFFULL) * num) >> 32);
+    *h2 = (uint32_t) (((g & 0xFFFFFFFFULL) * num) >> 32);
+}
+
+static uint32_t _slot(uint32_t h1, uint32_t h2, uint32_t d, size_t num) {
+    uint64_t d0 = d / num;
+    uint64_t d1 = d - (d0 * num);
+    return (uint32_t) ((h1 + (d0 * h2) + d1) % num);
+}
+
+static bool _samename(int options, const char *a, const char *b, size_t len) {
+    if (options & QFROZENTBL_CASEINSENSITIVE)
+        return (strncasecmp(a, b, len) == 0);
+    return (memcmp(a, b, len) == 0);
+}
+
+// hash the keys and drop later duplicates, -1 if distinct keys collide.
+// equal keys have equal hashes, so only keys grouped together by the hash
+// are compared.
+static size_t _dedup(const qnobj_t *objs, struct _key_s *keys, size_t num,
+                     int options) {
+    size_t i;
+    for (i = 0; i < num; i++) {
+        keys[i].idx = i;
+        keys[i].namelen = strlen(objs[i].name);
+        keys[i].base = _basehash(options, objs[i].name, keys[i].namelen);
+    }
+    if (num < 2)
+        return num;
+
+    size_t *gstart = (size_t *) qlibc_calloc(num + 1, sizeof(size_t));
+    size_t *gkeys = (size_t *) qlibc_malloc(sizeof(size_t) * num);
+    if (gstart == NULL || gkeys == NULL) {
+        qlibc_free(gstart);
+        qlibc_free(gkeys);
+        errno = ENOMEM;
+        return (size_t) -1;
+    }
+    for (i = 0; i < num; i++) {
+        gstart[((keys[i].base >> 32) * num >> 32) + 1]++;
+    }
+    for (i = 0; i < num; i++) {
+        gstart[i + 1] += gstart[i];
+    }
+    for (i = 0; i < num; i++) {
+        gkeys[gstart[(keys[i].base >> 32) * num >> 32]++] = i;
+    }
+
+    // groups are in index order, so the first of duplicates is kept.
+    bool collided = false;
+    size_t g, start = 0;
+    for (g = 0; g < num && collided == false; g++) {
+        size_t end = gstart[g], j, k;
+        for (j = start + 1; j < end; j++) {
+            struct _key_s *key = &keys[gkeys[j]];
+            for (k = start; k < j; k++) {
+                struct _key_s *prev = &keys[gkeys[k]];
+                if (prev->idx == (size_t) -1 || prev->base != key->base)
+                    continue;
+                if (prev->namelen != key->namelen
+                    || _samename(options, objs[prev->idx].name,
+                                 objs[key->idx].name, key->namelen) == false) {
+                    collided = true;
+                }
+                key->idx = (size_t) -1;
+                break;
+            }
+        }
+        start = end;
+    }
+    qlibc_free(gstart);
+    qlibc_free(gkeys);
+    if (collided == true) {
+        // no seed can tell them apart.
+        errno = EDEADLK;
+        return (size_t) -1;
+    }
+
+    size_t n = 0;
+    for (i = 0; i < num; i++) {
+        if (keys[i].idx != (size_t) -1)
+            keys[n++] = keys[i];
+    }
+    return n;
+}
+
+// find displacements of all buckets. slotkey maps slots to keys.
+static bool _place(struct _key_s *keys, size_t num, size_t nbuckets,
+                   uint64_t seed, uint32_t *displace, size_t *slotkey) {
+    size_t *bstart = (size_t *) qlibc_calloc(nbuckets + 1, sizeof(size_t));
+    size_t *bkeys = (size_t *) qlibc_malloc(sizeof(size_t) * num);
+    size_t *order = (size_t *) qlibc_malloc(sizeof(size_t) * nbuckets);
+    uint64_t *used = (uint64_t *) qlibc_calloc((num + 63) / 64, sizeof(uint64_t));
+    size_t *sizecnt = NULL;
+    bool ok = false;
+    errno = ENOMEM;
+    if (bstart == NULL || bkeys == NULL || order == NULL || used == NULL)
+        goto done;
+
+    // group keys by bucket.
+    size_t i;
+    for (i = 0; i < num; i++) {
+        _keyhash(keys[i].base, seed, num, nbuckets, &keys[i].bucket,
+                 &keys[i].h1, &keys[i].h2);
+        bstart[keys[i].bucket + 1]++;
+    }
+    size_t maxsize = 0;
+    for (i = 0; i < nbuckets; i++) {
+        if (bstart[i + 1] > maxsize)
+            maxsize = bstart[i + 1];
+        bstart[i + 1] += bstart[i];
+    }
+    for (i = 0; i < num; i++) {
+        bkeys[bstart[keys[i].bucket]++] = i;
+    }
+    for (i = nbuckets; i > 0; i--) {
+        bstart[i] = bstart[i - 1];
+    }
+    bstart[0] = 0;
+
+    // place larger buckets first while there's room.
+    sizecnt = (size_t *) qlibc_calloc(maxsize + 2, sizeof(size_t));
+    uint64_t *pos = (uint64_t *) qlibc_malloc(sizeof(uint64_t) * (maxsize + 1));
+    if (sizecnt == NULL || pos == NULL) {
+        qlibc_free(pos);
+        goto done;
+    }
+    for (i = 0; i < nbuckets; i++) {
+        sizecnt[maxsize - (bstart[i + 1] - bstart[i]) + 1]++;
+    }
+    for (i = 0; i <= maxsize; i++) {
+        sizecnt[i + 1] += sizecnt[i];
+    }
+    for (i = 0; i < nbuckets; i++) {
+        order[sizecnt[maxsize - (bstart[i + 1] - bstart[i])]++] = i;
+    }
+
+    // displacement d0 * num + d1 must fit in 32 bits.
+    uint64_t rounds = ((uint64_t) UINT32_MAX / num);
+    if (rounds > MAX_ROUNDS)
+        rounds = MAX_ROUNDS;
+
+    errno = EDEADLK;
+    size_t nextfree = 0;
+    for (i = 0; i < nbuckets; i++) {
+        size_t b = order[i];
+        size_t *bk = &bkeys[bstart[b]];
+        size_t bsize = bstart[b + 1] - bstart[b];
+        displace[b] = 0;
+        if (bsize == 0)
+            continue;
+
+        // a single key goes to any free slot.
+        if (bsize == 1) {
+            while (used[nextfree / 64] & (1ULL << (nextfree % 64))) nextfree++;
+            struct _key_s *key = &keys[bk[0]];
+            displace[b] = (uint32_t) ((nextfree + num - key->h1) % num);
+            used[nextfree / 64] |= (1ULL << (nextfree % 64));
+            slotkey[nextfree] = bk[0];
+            continue;
+        }
+
+        // slots of the keys move together by d1 for each step d0.
+        uint64_t d0, d1 = 0;
+        size_t j, k;
+        for (d0 = 0; d0 < rounds; d0++) {
+            for (j = 0; j < bsize; j++) {
+                struct _key_s *key = &keys[bk[j]];
+                pos[j] = (key->h1 + (d0 * key->h2)) % num;
+                for (k = 0; k < j && pos[k] != pos[j]; k++);
+                if (k < j)
+                    break;
+            }
+            if (j < bsize)
+                continue;
+
+            for (d1 = 0; d1 < num; d1++) {
+                for (j = 0; j < bsize; j++) {
+                    uint64_t slot = pos[j] + d1;
+                    if (slot >= num)
+                        slot -= num;
+                    if (used[slot / 64] & (1ULL << (slot % 64)))
+                        break;
+                }
+                if (j == bsize)
+                    break;
+            }
+            if (d1 < num)
+                break;
+        }
+        if (d0 == rounds) {
+            qlibc_free(pos);
+            goto done;
+        }
+
+        displace[b] = (uint32_t) ((d0 * num) + d1);
+        for (j = 0; j < bsize; j++) {
+            uint64_t slot = pos[j] + d1;
+            if (slot >= num)
+                slot -= num;
+            used[slot / 64] |= (1ULL << (slot % 64));
+            slotkey[slot] = bk[j];
+        }
+    }
+    qlibc_free(pos);
+    ok = true;
+
+done:
+    qlibc_free(bstart);
+    qlibc_free(bkeys);
+    qlibc_free(order);
+    qlibc_free(used);
+    qlibc_free(sizecnt);
+    return ok;
+}
+
+static struct _rec_s *_find(qfrozentbl_t *tbl, const char *name) {
+    if (tbl->num == 0)
+        return NULL;
+
+    size_t namelen = strlen(name);
+    uint64_t base = _basehash(tbl->options, name, namelen);
+    uint32_t bucket, h1, h2;
+    _keyhash(base, tbl->seed, tbl->num, tbl->nbuckets, &bucket, &h1, &h2);
+    uint32_t slot = _slot(h1, h2, tbl->displace[bucket], tbl->num);
+
+    struct _rec_s *rec = REC_AT(tbl, slot);
+    if (rec->check != (uint32_t) (base >> 32) || rec->namelen != namelen
+        || _samename(tbl->options, REC_NAME(rec), name, namelen) == false) {
+        return NULL;
+    }
+    return rec;
+}
+
+#endif /* _DOXYGEN_SKIP */
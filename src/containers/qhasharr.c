@@ -33,7 +33,8 @@
  * fixed size static memory like shared-memory and memory-mapped file.
  * The creator qhasharr() initializes static memory to makes small slots in it.
  * The default slot size factors are defined in _Q_HASHARR_KEYSIZE and
- * _Q_HASHARR_VALUESIZE. And they are applied at compile time.
+ * _Q_HASHARR_VALUESIZE. They can be chosen at initialization time with
+ * qhasharr_opt() and are recorded in the table memory.
  *
  * The value part of an element will be stored across several slots if it's size
  * exceeds the slot size. But the key part of an element will be truncated if
@@ -46,20 +47,43 @@
  * wrong element in case a key exceeds the limit, has same length and MD5 hash
  * with lookup key. But this possibility is extreamly low and almost never
  * happen in practice. If you happpen to want to make sure everything,
- * you set _Q_HASHARR_KEYSIZE big enough at compile time to make sure all keys
+ * you set the key size big enough with qhasharr_opt() to make sure all keys
  * fits in it.
  *
- * qhasharr hash-table does not support thread-safe. So users should handle
- * race conditions on application side by raising user lock before calling
- * functions which modify the table data.
+ * With QHASHARR_FINGERPRINT option, a 128-bit Murmur3 fingerprint is stored
+ * instead of MD5. It's much cheaper to compute, so lookups of long keys get
+ * faster. In both modes the fingerprint is computed at most once per call.
+ *
+ * qhasharr hash-table does not support thread-safe by default. So users should
+ * handle race conditions on application side by raising user lock before
+ * calling functions which modify the table data. Or initialize the table with
+ * QHASHARR_CONCURRENT option, then writers are serialized by a spinlock in the
+ * table memory and readers run without any lock, validating what they've read
+ * against a sequence counter which every write bumps. No system call is made
+ * on either path, so it fits well for a cache shared by several processes.
+ *
+ * qhasharr_mmap() keeps the table in a memory-mapped file, so a cache can
+ * survive restarts without being rebuilt. The file starts with a header
+ * recording format version, slot geometry and a checksum of the table taken
+ * at the last checkpoint, made by sync() or free(). When the file is opened
+ * again and the checksum still matches, the slots are used as they are.
+ * Otherwise the file is considered inconsistent, for example the process
+ * crashed after modifying it, and the table starts over empty.
+ *
+ * A bitmap of empty slots follows the slots, so a free slot is found by
+ * scanning 64 slots per word instead of visiting slots one by one. After
+ * heavy churn, collided keys and the extension blocks of long values can be
+ * left far from where they belong. compact() moves them back near their
+ * home slot and previous block, a bounded number of slots per call, so it
+ * can be run from time to time without stalling other users of the table.
  *
  * @code
  *  [Data Structure Diagram]
  *
  *  +--[Static Flat Memory Area]-----------------------------------------------+
- *  | +-[Header]---------+ +-[Slot 0]---+ +-[Slot 1]---+        +-[Slot N]---+ |
- *  | |Private table data| |KEY A|DATA A| |KEY B|DATA B|  ....  |KEY N|DATA N| |
- *  | +------------------+ +------------+ +------------+        +------------+ |
+ *  | +-[Header]---------+ +-[Slot 0]---+       +-[Slot N]---+ +-[Free Map]--+ |
+ *  | |Private table data| |KEY A|DATA A|  ...  |KEY N|DATA N| |1 bit / slot | |
+ *  | +------------------+ +------------+       +------------+ +-------------+ |
  *  +--------------------------------------------------------------------------+
  *
  *  Below diagram shows how a big value is stored.
@@ -143,14 +167,40 @@
 #include <stdarg.h>
 #include <string.h>
 #include <errno.h>
+#include <sched.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "qinternal.h"
 #include "utilities/qhash.h"
+#include "utilities/qtime.h"
 #include "containers/qhasharr.h"
 
 #ifndef _DOXYGEN_SKIP
 
+#define SPIN_YIELD_COUNT    (1000)
+
+// slots are variable sized, so they must be accessed through these macros.
+#define _SLOT(tbl, idx)                                                     \
+    ((qhasharr_slot_t *) ((char *) (tbl)->slots                             \
+                          + (size_t) (idx) * (tbl)->data->slotsize))
+#define _SLOT_VALUE(tbl, idx)   (_SLOT(tbl, idx)->data)
+#define _SLOT_KEY(tbl, idx)                                                 \
+    ((char *) _SLOT(tbl, idx)->data + (tbl)->data->valuesize)
+
+// bitmap of empty slots, a set bit is an empty slot.
+#define _FREEMAP_WORDS(max)     (((size_t) (max) + 63) / 64)
+#define _FREEMAP_SET(tbl, idx)                                              \
+    ((tbl)->freemap[(idx) / 64] |= (1ULL << ((idx) % 64)))
+#define _FREEMAP_CLR(tbl, idx)                                              \
+    ((tbl)->freemap[(idx) / 64] &= ~(1ULL << ((idx) % 64)))
+
 static bool put(qhasharr_t *tbl, const char *key, const void *value,
                 size_t size);
+static bool putttl(qhasharr_t *tbl, const char *key, const void *value,
+                   size_t size, int ttl);
 static bool putstr(qhasharr_t *tbl, const char *key, const char *str);
 static bool putstrf(qhasharr_t *tbl, const char *key, const char *format, ...);
 static bool putint(qhasharr_t *tbl, const char *key, int64_t num);
@@ -159,25 +209,76 @@ static void *get(qhasharr_t *tbl, const char *key, size_t *size);
 static char *getstr(qhasharr_t *tbl, const char *key);
 static int64_t getint(qhasharr_t *tbl, const char *key);
 static bool getnext(qhasharr_t *tbl, qnobj_t *obj, int *idx);
+static void iterbegin(qhasharr_t *tbl, qiter_t *it);
+static bool iternext(qhasharr_t *tbl, qiter_t *it);
+static void iterend(qhasharr_t *tbl, qiter_t *it);
+
+static bool update(qhasharr_t *tbl, const char *key, size_t size, int ttl,
+                   void (*callback) (void *userdata, void *value,
+                                     bool created),
+                   void *userdata);
 
 static bool remove_(qhasharr_t *tbl, const char *key);
 
 static int size(qhasharr_t *tbl, int *maxslots, int *usedslots);
 static void clear(qhasharr_t *tbl);
 static bool debug(qhasharr_t *tbl, FILE *out);
+static bool stats(qhasharr_t *tbl, qstats_t *stats);
+static bool sync_(qhasharr_t *tbl);
+static int compact(qhasharr_t *tbl, int maxscan);
 
 static void free_(qhasharr_t *tbl);
 
 // internal usages
+static size_t _slot_size(int keysize, int valuesize);
+static bool _put(qhasharr_t *tbl, const char *key, const void *value,
+                 size_t size, uint32_t expire, bool *replaced);
+static bool _remove(qhasharr_t *tbl, const char *key);
+static bool _remove_idx(qhasharr_t *tbl, int idx);
+static bool _evict(qhasharr_t *tbl, bool expiredonly);
+static bool _expired(qhasharr_t *tbl, int idx);
+static int _slots_needed(qhasharr_t *tbl, size_t size);
+static void _spin_lock(qhasharr_t *tbl);
+static void _write_lock(qhasharr_t *tbl);
+static void _write_unlock(qhasharr_t *tbl);
+static uint32_t _read_begin(qhasharr_t *tbl);
+static bool _read_retry(qhasharr_t *tbl, uint32_t seq);
+static void _add_wait(qhasharr_t *tbl, int64_t waitstart);
+static unsigned int _hash(qhasharr_t *tbl, const char *key);
 static int _find_empty(qhasharr_t *tbl, int startidx);
 static int _get_idx(qhasharr_t *tbl, const char *key, unsigned int hash);
+static void _fingerprint(qhasharr_t *tbl, const char *key, size_t keylen,
+                         unsigned char *retbuf);
 static void *_get_data(qhasharr_t *tbl, int idx, size_t *size);
+static size_t _data_size(qhasharr_t *tbl, int idx);
+static void _copy_data(qhasharr_t *tbl, int idx, void *value, size_t valsize);
 static bool _put_data(qhasharr_t *tbl, int idx, unsigned int hash,
                       const char *key, const void *value, size_t size,
-                      int count);
+                      int count, uint32_t expire);
 static bool _copy_slot(qhasharr_t *tbl, int idx1, int idx2);
+static bool _move_slot(qhasharr_t *tbl, int idx1, int idx2);
 static bool _remove_slot(qhasharr_t *tbl, int idx);
+static void _freemap_reset(qhasharr_t *tbl);
+static int _distance(qhasharr_t *tbl, int idx1, int idx2);
 static bool _remove_data(qhasharr_t *tbl, int idx);
+static uint64_t _checksum(qhasharr_t *tbl);
+
+// header of a table file made by qhasharr_mmap(), table memory follows it.
+#define FILE_MAGIC      "QHASHARR"
+#define FILE_VERSION    (2)
+#define FILE_HDRSIZE    (64)
+
+struct qhasharr_filehdr_s {
+    char magic[8];      // FILE_MAGIC
+    uint32_t version;   // FILE_VERSION
+    uint32_t hdrsize;   // FILE_HDRSIZE
+    uint64_t memsize;   // size of table memory
+    int32_t maxslots;   // slot geometry and options
+    int32_t keysize;
+    int32_t valuesize;
+    int32_t options;
+    uint64_t checksum;  // checksum of table memory at the last checkpoint
+};
 
 #endif
 
@@ -192,8 +293,27 @@ static bool _remove_data(qhasharr_t *tbl, int idx);
  *  This can be used for calculating minimum memory size for N slots.
  */
 size_t qhasharr_calculate_memsize(int max) {
+    return qhasharr_calculate_memsize_opt(max, 0, 0);
+}
+
+/**
+ * Get how much memory is needed for N slots of given slot geometry.
+ *
+ * @param max       a number of maximum internal slots
+ * @param keysize   key size in a slot, 0 for _Q_HASHARR_KEYSIZE.
+ * @param valuesize value size in a slot, 0 for _Q_HASHARR_VALUESIZE.
+ *
+ * @return memory size needed
+ *
+ * @code
+ *  // 10000 slots which can hold 200 bytes value without linking slots.
+ *  size_t memsize = qhasharr_calculate_memsize_opt(10000, 0, 200);
+ * @endcode
+ */
+size_t qhasharr_calculate_memsize_opt(int max, int keysize, int valuesize) {
     size_t memsize = sizeof(qhasharr_data_t)
-            + (sizeof(qhasharr_slot_t) * (max));
+            + (_slot_size(keysize, valuesize) * (max))
+            + (_FREEMAP_WORDS(max) * sizeof(uint64_t));
     return memsize;
 }
 
@@ -221,15 +341,74 @@ size_t qhasharr_calculate_memsize(int max) {
  * @endcode
  */
 qhasharr_t *qhasharr(void *memory, size_t memsize) {
+    return qhasharr_opt(memory, memsize, 0, 0, 0);
+}
+
+/**
+ * Initialize static hash table with options.
+ *
+ * @param memory    a pointer of data memory.
+ * @param memsize   a size of data memory, 0 for using existing data.
+ * @param keysize   key size in a slot, 0 for _Q_HASHARR_KEYSIZE.
+ * @param valuesize value size in a slot, 0 for _Q_HASHARR_VALUESIZE.
+ * @param options   combination of initialization options.
+ *
+ * @return qhasharr_t container pointer, otherwise returns NULL.
+ * @retval errno  will be set in error condition.
+ *  - EINVAL : Assigned memory is too small. It must bigger enough to allocate
+ *  at least 1 slot. Or slot geometry is out of range.
+ *
+ * @code
+ *  // slots for 200 bytes values.
+ *  size_t memsize = qhasharr_calculate_memsize_opt(1000, 0, 200);
+ *  void *memory = malloc(memsize);
+ *  qhasharr_t *tbl = qhasharr_opt(memory, memsize, 0, 200, QHASHARR_FASTHASH);
+ * @endcode
+ *
+ * @note
+ *  Available options:
+ *   - QHASHARR_FASTHASH - hash keys with qhashxx32() instead of
+ *     qhashmurmur3_32().
+ *   - QHASHARR_FINGERPRINT - verify truncated keys with a 128-bit
+ *     qhashmurmur3_128() fingerprint instead of MD5.
+ *   - QHASHARR_CONCURRENT - make the table safe to share between threads
+ *     and processes. Writers are serialized by a spinlock kept in the table
+ *     memory, readers don't lock at all but retry when they overlap a writer.
+ *   - QHASHARR_EVICT - evict least recently used objects approximately by
+ *     CLOCK algorithm when the table is full, instead of failing put().
+ *  Slot geometry and options are stored in the table memory, so those
+ *  arguments are ignored when memsize is 0 and existing data is used.
+ *  A value bigger than valuesize is stored across linked slots, so choose
+ *  valuesize close to the size of most values.
+ */
+qhasharr_t *qhasharr_opt(void *memory, size_t memsize, int keysize,
+                         int valuesize, int options) {
     // Structure memory.
     qhasharr_data_t *data = (qhasharr_data_t *) memory;
 
     // Initialize data if memsize is set or use existing data.
     if (memsize > 0) {
-        // calculate max
-        int maxslots = (memsize - sizeof(qhasharr_data_t))
-                / sizeof(qhasharr_slot_t);
-        if (maxslots < 1 || memsize <= sizeof(qhasharr_t)) {
+        if (keysize == 0)
+            keysize = _Q_HASHARR_KEYSIZE;
+        if (valuesize == 0)
+            valuesize = _Q_HASHARR_VALUESIZE;
+        if (keysize < 0 || keysize > UINT16_MAX || valuesize < 0
+                || valuesize > UINT16_MAX) {
+            errno = EINVAL;
+            return NULL;
+        }
+
+        // calculate max. every slot takes a bit of the free map also.
+        size_t slotsize = _slot_size(keysize, valuesize);
+        size_t max = (memsize <= sizeof(qhasharr_data_t)) ? 0 :
+                (memsize - sizeof(qhasharr_data_t)) * 8 / (slotsize * 8 + 1);
+        while (max > 0
+                && qhasharr_calculate_memsize_opt(max, keysize, valuesize)
+                        > memsize) {
+            max--;
+        }
+        int maxslots = (max > INT32_MAX) ? INT32_MAX : (int) max;
+        if (maxslots < 1) {
             errno = EINVAL;
             return NULL;
         }
@@ -239,13 +418,14 @@ qhasharr_t *qhasharr(void *memory, size_t memsize) {
         data->maxslots = maxslots;
         data->usedslots = 0;
         data->num = 0;
+        data->options = options;
+        data->keysize = keysize;
+        data->valuesize = valuesize;
+        data->slotsize = slotsize;
     }
 
-    // Set data address. Shared memory returns virtul address.
-    data->slots = (qhasharr_slot_t *) (memory + sizeof(qhasharr_data_t));
-
     // Create the table object.
-    qhasharr_t *tbl = (qhasharr_t *) malloc(sizeof(qhasharr_t));
+    qhasharr_t *tbl = (qhasharr_t *) qlibc_malloc(sizeof(qhasharr_t));
     if (tbl == NULL) {
         errno = ENOMEM;
         return NULL;
@@ -257,22 +437,180 @@ qhasharr_t *qhasharr(void *memory, size_t memsize) {
     tbl->putstr = putstr;
     tbl->putstrf = putstrf;
     tbl->putint = putint;
+    tbl->putttl = putttl;
 
     tbl->get = get;
     tbl->getstr = getstr;
     tbl->getint = getint;
     tbl->getnext = getnext;
+    tbl->iterbegin = iterbegin;
+    tbl->iternext = iternext;
+    tbl->iterend = iterend;
+
+    tbl->update = update;
 
     tbl->remove = remove_;
 
     tbl->size = size;
     tbl->clear = clear;
     tbl->debug = debug;
+    tbl->stats = stats;
+    tbl->sync = sync_;
+    tbl->compact = compact;
 
     tbl->free = free_;
 
     tbl->data = data;
 
+    // Set data address. Shared memory returns virtual address which can be
+    // different in each process, so we keep it in the process local object.
+    tbl->slots = (qhasharr_slot_t *) (memory + sizeof(qhasharr_data_t));
+    tbl->freemap = (uint64_t *) ((char *) tbl->slots
+                                 + data->slotsize * (size_t) data->maxslots);
+    if (memsize > 0)
+        _freemap_reset(tbl);
+
+    return tbl;
+}
+
+/**
+ * Initialize static hash table in a memory-mapped file.
+ *
+ * @param filepath  path of the table file.
+ * @param maxslots  number of slots, 0 for opening existing file only.
+ * @param keysize   key size in a slot, 0 for _Q_HASHARR_KEYSIZE.
+ * @param valuesize value size in a slot, 0 for _Q_HASHARR_VALUESIZE.
+ * @param options   combination of initialization options.
+ *
+ * @return qhasharr_t container pointer, otherwise returns NULL.
+ * @retval errno  will be set in error condition.
+ *  - EINVAL : Invalid argument.
+ *  - ENOENT : maxslots is 0 and the file doesn't exist or is empty.
+ *  - EBADMSG : maxslots is 0 and the file is not a consistent table.
+ *  - ENOMEM : Memory allocation failure.
+ *  - and errors of open(), ftruncate() and mmap().
+ *
+ * @code
+ *  // warm start with the table left by previous run if any.
+ *  qhasharr_t *tbl = qhasharr_mmap("/var/cache/app.tbl", 10000, 0, 0, 0);
+ *
+ *  (...use the table...)
+ *
+ *  // checkpoint from time to time.
+ *  tbl->sync(tbl);
+ *
+ *  // checkpoint and unmap.
+ *  tbl->free(tbl);
+ * @endcode
+ *
+ * @note
+ *  The existing table in the file is used only if its format version, slot
+ *  geometry and options are the same as given ones, and it's consistent with
+ *  the checksum taken at the last checkpoint. Otherwise the file is
+ *  initialized as a new empty table. When maxslots is 0, the geometry of the
+ *  file is used and an inconsistent file is an error instead.
+ *  The file is mapped shared, so several processes can open the same file as
+ *  a shared table. QHASHARR_CONCURRENT option makes it safe for them.
+ */
+qhasharr_t *qhasharr_mmap(const char *filepath, int maxslots, int keysize,
+                          int valuesize, int options) {
+    if (filepath == NULL || maxslots < 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+    if (keysize == 0)
+        keysize = _Q_HASHARR_KEYSIZE;
+    if (valuesize == 0)
+        valuesize = _Q_HASHARR_VALUESIZE;
+
+    int fd = open(filepath, (maxslots > 0) ? (O_RDWR | O_CREAT) : O_RDWR,
+                  0644);
+    if (fd < 0)
+        return NULL;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return NULL;
+    }
+
+    // see if the file has a usable table.
+    struct qhasharr_filehdr_s hdr;
+    bool reuse = false;
+    if (st.st_size > FILE_HDRSIZE
+            && pread(fd, &hdr, sizeof(hdr), 0) == sizeof(hdr)
+            && !memcmp(hdr.magic, FILE_MAGIC, sizeof(hdr.magic))
+            && hdr.version == FILE_VERSION && hdr.hdrsize == FILE_HDRSIZE
+            && (off_t) (FILE_HDRSIZE + hdr.memsize) == st.st_size) {
+        reuse = (maxslots == 0)
+                || (hdr.maxslots == maxslots && hdr.keysize == keysize
+                    && hdr.valuesize == valuesize && hdr.options == options);
+    }
+    if (reuse == false && maxslots == 0) {
+        close(fd);
+        errno = (st.st_size == 0) ? ENOENT : EBADMSG;
+        return NULL;
+    }
+
+    size_t memsize = (reuse == true) ? (size_t) hdr.memsize
+            : qhasharr_calculate_memsize_opt(maxslots, keysize, valuesize);
+    size_t mapsize = FILE_HDRSIZE + memsize;
+    if (reuse == false && ftruncate(fd, (off_t) mapsize) != 0) {
+        close(fd);
+        return NULL;
+    }
+
+    void *map = mmap(NULL, mapsize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return NULL;
+
+    struct qhasharr_filehdr_s *filehdr = (struct qhasharr_filehdr_s *) map;
+    void *memory = (char *) map + FILE_HDRSIZE;
+    qhasharr_t *tbl = qhasharr_opt(memory, (reuse == true) ? 0 : memsize,
+                                   keysize, valuesize, options);
+    if (tbl == NULL) {
+        munmap(map, mapsize);
+        return NULL;
+    }
+    tbl->map = map;
+    tbl->mapsize = mapsize;
+
+    if (reuse == true && filehdr->checksum != _checksum(tbl)) {
+        if (maxslots == 0) {
+            munmap(map, mapsize);
+            qlibc_free(tbl);
+            errno = EBADMSG;
+            return NULL;
+        }
+        // start over with a new table.
+        reuse = false;
+        qlibc_free(tbl);
+        tbl = qhasharr_opt(memory, memsize, keysize, valuesize, options);
+        if (tbl == NULL) {
+            munmap(map, mapsize);
+            return NULL;
+        }
+        tbl->map = map;
+        tbl->mapsize = mapsize;
+    }
+
+    if (reuse == true) {
+        // consistent table can't have been locked by a writer.
+        tbl->data->lock = 0;
+    } else {
+        memset((void *) filehdr, 0, FILE_HDRSIZE);
+        memcpy(filehdr->magic, FILE_MAGIC, sizeof(filehdr->magic));
+        filehdr->version = FILE_VERSION;
+        filehdr->hdrsize = FILE_HDRSIZE;
+        filehdr->memsize = memsize;
+        filehdr->maxslots = tbl->data->maxslots;
+        filehdr->keysize = tbl->data->keysize;
+        filehdr->valuesize = tbl->data->valuesize;
+        filehdr->options = tbl->data->options;
+        sync_(tbl);
+    }
+
     return tbl;
 }
 
@@ -292,92 +630,66 @@ qhasharr_t *qhasharr(void *memory, size_t memsize) {
  */
 static bool put(qhasharr_t *tbl, const char *key, const void *value,
                 size_t size) {
-    if (tbl == NULL || key == NULL || value == NULL) {
+    return putttl(tbl, key, value, size, 0);
+}
+
+/**
+ * qhasharr->putttl(): Put an object into this table with time-to-live.
+ *
+ * @param tbl       qhasharr_t container pointer.
+ * @param key       key string
+ * @param value     value object data
+ * @param size      size of value
+ * @param ttl       time-to-live in seconds, 0 for no expiration.
+ *
+ * @return true if successful, otherwise returns false
+ * @retval errno will be set in error condition.
+ *  - ENOBUFS   : Table doesn't have enough space to store the object.
+ *  - EINVAL    : Invalid argument.
+ *  - EFAULT    : Unexpected error. Data structure is not constant.
+ *
+ * @note
+ *  An expired object is not visible to get() and getnext() anymore, and its
+ *  slots are reclaimed when the same key is put again or when the table runs
+ *  out of space. With QHASHARR_EVICT option, a full table evicts cold
+ *  objects by CLOCK algorithm instead of failing with ENOBUFS.
+ *
+ * @code
+ *  // keep it for 10 minutes.
+ *  tbl->putttl(tbl, "session", data, datasize, 600);
+ * @endcode
+ */
+static bool putttl(qhasharr_t *tbl, const char *key, const void *value,
+                   size_t size, int ttl) {
+    if (tbl == NULL || key == NULL || value == NULL || ttl < 0) {
         errno = EINVAL;
         return false;
     }
 
     qhasharr_data_t *data = tbl->data;
 
-    // check full
-    if (data->usedslots >= data->maxslots) {
-        DEBUG("hasharr: put %s - FULL", key);
+    // never fits even in an empty table.
+    if (_slots_needed(tbl, size) > data->maxslots) {
         errno = ENOBUFS;
         return false;
     }
 
-    // get hash integer
-    unsigned int hash = qhashmurmur3_32(key, strlen(key)) % data->maxslots;
-
-    // check, is slot empty
-    if (data->slots[hash].count == 0) {  // empty slot
-        // put data
-        if (_put_data(tbl, hash, hash, key, value, size, 1) == false) {
-            DEBUG("hasharr: FAILED put(new) %s", key);
-            return false;
-        } DEBUG("hasharr: put(new) %s (idx=%d,hash=%u,tot=%d)",
-                key, hash, hash, data->usedslots);
-    } else if (data->slots[hash].count > 0) {  // same key or hash collision
-        // check same key;
-        int idx = _get_idx(tbl, key, hash);
-        if (idx >= 0) {  // same key
-            // remove and recall
-            remove_(tbl, key);
-            return put(tbl, key, value, size);
-        } else {  // no same key, just hash collision
-            // find empty slot
-            int idx = _find_empty(tbl, hash);
-            if (idx < 0) {
-                errno = ENOBUFS;
-                return false;
-            }
-
-            // put data. -1 is used for collision resolution (idx != hash);
-            if (_put_data(tbl, idx, hash, key, value, size, -1) == false) {
-                DEBUG("hasharr: FAILED put(col) %s", key);
-                return false;
-            }
-
-            // increase counter from leading slot
-            data->slots[hash].count++;
-
-            DEBUG("hasharr: put(col) %s (idx=%d,hash=%u,tot=%d)",
-                    key, idx, hash, data->usedslots);
-        }
-    } else {
-        // in case of -1 or -2, move it. -1 used for collision resolution,
-        // -2 used for oversized value data.
-
-        // find empty slot
-        int idx = _find_empty(tbl, hash + 1);
-        if (idx < 0) {
-            errno = ENOBUFS;
-            return false;
-        }
-
-        // move dup slot to empty
-        _copy_slot(tbl, idx, hash);
-        _remove_slot(tbl, hash);
-
-        // in case of -2, adjust link of mother
-        if (data->slots[idx].count == -2) {
-            data->slots[data->slots[idx].hash].link = idx;
-            if (data->slots[idx].link != -1) {
-                data->slots[data->slots[idx].link].hash = idx;
-            }
-        }
-
-        // store data
-        if (_put_data(tbl, hash, hash, key, value, size, 1) == false) {
-            DEBUG("hasharr: FAILED put(swp) %s", key);
-            return false;
-        }
+    uint32_t expire = (ttl > 0) ? (uint32_t) (time(NULL) + ttl) : 0;
 
-        DEBUG("hasharr: put(swp) %s (idx=%u,hash=%u,tot=%d)",
-                key, hash, hash, data->usedslots);
+    bool replaced = false;
+    _write_lock(tbl);
+    bool ret = _put(tbl, key, value, size, expire, &replaced);
+    while (ret == false && errno == ENOBUFS
+            && _evict(tbl, !(data->options & QHASHARR_EVICT)) == true) {
+        ret = _put(tbl, key, value, size, expire, &replaced);
     }
+    _write_unlock(tbl);
 
-    return true;
+    if (ret == true && replaced == true)
+        Q_STATS_INC(tbl->puthits);
+    else if (ret == true)
+        Q_STATS_INC(tbl->putmisses);
+    return ret;
 }
 
 /**
@@ -421,7 +733,7 @@ static bool putstrf(qhasharr_t *tbl, const char *key, const char *format, ...) {
     }
 
     bool ret = putstr(tbl, key, str);
-    free(str);
+    qlibc_free(str);
     return ret;
 }
 
@@ -470,18 +782,32 @@ static void *get(qhasharr_t *tbl, const char *key, size_t *size) {
         return NULL;
     }
 
-    qhasharr_data_t *data = tbl->data;
-
     // get hash integer
-    unsigned int hash = qhashmurmur3_32(key, strlen(key)) % data->maxslots;
+    unsigned int hash = _hash(tbl, key);
 
-    int idx = _get_idx(tbl, key, hash);
-    if (idx < 0) {
-        errno = ENOENT;
-        return NULL;
+    // readers don't lock. retry if a writer has changed the table meanwhile.
+    while (true) {
+        uint32_t seq = _read_begin(tbl);
+        int idx = _get_idx(tbl, key, hash);
+        if (idx >= 0 && _expired(tbl, idx))
+            idx = -1;
+        void *value = (idx >= 0) ? _get_data(tbl, idx, size) : NULL;
+        if (_read_retry(tbl, seq) == false) {
+            if (idx < 0) {
+                Q_STATS_INC(tbl->getmisses);
+                errno = ENOENT;
+                return NULL;
+            }
+            Q_STATS_INC(tbl->gethits);
+            if (!_SLOT(tbl, idx)->ref
+                    && (tbl->data->options & QHASHARR_EVICT)) {
+                // mark as recently used for CLOCK eviction.
+                _SLOT(tbl, idx)->ref = 1;
+            }
+            return value;
+        }
+        qlibc_free(value);
     }
-
-    return _get_data(tbl, idx, size);
 }
 
 /**
@@ -522,7 +848,7 @@ static int64_t getint(qhasharr_t *tbl, const char *key) {
     char *str = getstr(tbl, key);
     if (str != NULL) {
         num = atoll(str);
-        free(str);
+        qlibc_free(str);
     }
 
     return num;
@@ -554,7 +880,7 @@ static int64_t getint(qhasharr_t *tbl, const char *key) {
  * @note
  *  Please be aware a key name will be returned with truncated length
  *  because key name is truncated when it put into the table if it's length is
- *  longer than _Q_HASHARR_KEYSIZE.
+ *  longer than the key size of the slot.
  */
 static bool getnext(qhasharr_t *tbl, qnobj_t *obj, int *idx) {
     if (tbl == NULL || obj == NULL || idx == NULL) {
@@ -565,25 +891,34 @@ static bool getnext(qhasharr_t *tbl, qnobj_t *obj, int *idx) {
     qhasharr_data_t *data = tbl->data;
 
     for (; *idx < data->maxslots; (*idx)++) {
-        if (data->slots[*idx].count == 0 || data->slots[*idx].count == -2) {
+        uint32_t seq = _read_begin(tbl);
+        if (_SLOT(tbl, *idx)->count == 0 || _SLOT(tbl, *idx)->count == -2
+                || _expired(tbl, *idx)) {
             continue;
         }
 
-        size_t keylen = data->slots[*idx].data.pair.keylen;
-        if (keylen > _Q_HASHARR_KEYSIZE)
-            keylen = _Q_HASHARR_KEYSIZE;
+        size_t keylen = _SLOT(tbl, *idx)->keylen;
+        if (keylen > data->keysize)
+            keylen = data->keysize;
 
-        obj->name = (char *) malloc(keylen + 1);
+        obj->name = (char *) qlibc_malloc(keylen + 1);
         if (obj->name == NULL) {
             errno = ENOMEM;
             return false;
         }
-        memcpy(obj->name, data->slots[*idx].data.pair.key, keylen);
+        memcpy(obj->name, _SLOT_KEY(tbl, *idx), keylen);
         obj->name[keylen] = '\0';
 
         obj->data = _get_data(tbl, *idx, &obj->size);
+        if (_read_retry(tbl, seq) == true) {
+            // slot was changed while reading, read it again.
+            qlibc_free(obj->name);
+            qlibc_free(obj->data);
+            (*idx)--;
+            continue;
+        }
         if (obj->data == NULL) {
-            free(obj->name);
+            qlibc_free(obj->name);
             errno = ENOMEM;
             return false;
         }
@@ -597,101 +932,224 @@ static bool getnext(qhasharr_t *tbl, qnobj_t *obj, int *idx) {
 }
 
 /**
- * qhasharr->remove(): Remove an object from this table.
+ * qhasharr->iterbegin(): Start traversal without copying elements.
  *
- * @param tbl       qhasharr_t container pointer.
- * @param key       key string
+ * @param tbl   qhasharr_t container pointer.
+ * @param it    iterator to initialize.
  *
- * @return true if successful, otherwise(not found) returns false
- * @retval errno will be set in error condition.
- *  - ENOENT    : No such key found.
- *  - EINVAL    : Invald argument.
- *  - EFAULT        : Unexpected error. Data structure is not constant.
+ * @code
+ *  qiter_t it;
+ *  tbl->iterbegin(tbl, &it);
+ *  while (tbl->iternext(tbl, &it) == true) {
+ *    printf("NAME=%.*s, SIZE=%zu\n", (int) it.namelen, it.name, it.size);
+ *  }
+ *  tbl->iterend(tbl, &it);
+ * @endcode
+ *
+ * @note
+ *  In QHASHARR_CONCURRENT mode, writers of every process wait until
+ *  iterend() while readers go on. Otherwise nothing is locked and the
+ *  table must not be modified until iterend(), which must always be
+ *  called.
  */
-static bool remove_(qhasharr_t *tbl, const char *key) {
-    if (tbl == NULL || key == NULL) {
-        errno = EINVAL;
-        return false;
-    }
+static void iterbegin(qhasharr_t *tbl, qiter_t *it) {
+    memset((void *) it, 0, sizeof(qiter_t));
+    if (tbl->data->options & QHASHARR_CONCURRENT)
+        _spin_lock(tbl);
+}
 
+/**
+ * qhasharr->iternext(): Get next element between iterbegin() and iterend().
+ *
+ * @param tbl   qhasharr_t container pointer.
+ * @param it    iterator started by iterbegin().
+ *
+ * @return true if found otherwise returns false
+ * @retval errno will be set in error condition.
+ *  - ENOENT : No next element.
+ *  - ENOMEM : Memory allocation failed.
+ *  - EFAULT : Broken link.
+ *
+ * @note
+ *  it.name is the truncated key stored in the slot. It's not NULL
+ *  terminated, so use it.namelen. it.data points into the slot when the
+ *  value fits in a single slot, otherwise the value is gathered into a
+ *  buffer of the iterator which is reused for the following elements.
+ */
+static bool iternext(qhasharr_t *tbl, qiter_t *it) {
     qhasharr_data_t *data = tbl->data;
 
-    // get hash integer
-    unsigned int hash = qhashmurmur3_32(key, strlen(key)) % data->maxslots;
-
-    int idx = _get_idx(tbl, key, hash);
-    if (idx < 0) {
-        DEBUG("not found %s", key);
-        errno = ENOENT;
-        return false;
-    }
+    for (; it->idx < (size_t) data->maxslots; it->idx++) {
+        qhasharr_slot_t *slot = _SLOT(tbl, it->idx);
+        if (slot->count == 0 || slot->count == -2
+                || _expired(tbl, it->idx)) {
+            continue;
+        }
 
-    if (data->slots[idx].count == 1) {
-        // just remove
-        _remove_data(tbl, idx);
-        DEBUG("hasharr: rem %s (idx=%d,tot=%d)", key, idx, data->usedslots);
-    } else if (data->slots[idx].count > 1) {  // leading slot and has dup
-        // find dup
-        int idx2;
-        for (idx2 = idx + 1;; idx2++) {
-            if (idx2 >= data->maxslots)
-                idx2 = 0;
-            if (idx2 == idx) {
-                DEBUG("hasharr: [BUG] failed to remove dup key %s.", key);
-                errno = EFAULT;
+        it->name = (const char *) _SLOT_KEY(tbl, it->idx);
+        it->namelen = (slot->keylen > data->keysize) ? data->keysize
+                                                     : slot->keylen;
+        if (slot->link == -1) {
+            it->data = _SLOT_VALUE(tbl, it->idx);
+            it->size = slot->size;
+        } else {
+            size_t valsize = _data_size(tbl, it->idx);
+            if (valsize == (size_t) -1)
                 return false;
+            if (valsize > it->bufsize) {
+                void *buf = qlibc_realloc(it->buf, valsize);
+                if (buf == NULL) {
+                    errno = ENOMEM;
+                    return false;
+                }
+                it->buf = buf;
+                it->bufsize = valsize;
             }
-            if (data->slots[idx2].count == -1
-                    && data->slots[idx2].hash == hash) {
-                break;
-            }
-        }
-
-        // move to leading slot
-        int backupcount = data->slots[idx].count;
-        _remove_data(tbl, idx);  // remove leading data
-        _copy_slot(tbl, idx, idx2);  // copy slot
-        _remove_slot(tbl, idx2);  // remove moved slot
-
-        data->slots[idx].count = backupcount - 1;  // adjust collision counter
-        if (data->slots[idx].link != -1) {
-            data->slots[data->slots[idx].link].hash = idx;
-        }
-
-        DEBUG("hasharr: rem(lead) %s (idx=%d,tot=%d)",
-                key, idx, data->usedslots);
-    } else {  // in case of -1. used for collision resolution
-        // decrease counter from leading slot
-        if (data->slots[data->slots[idx].hash].count <= 1) {
-            DEBUG("hasharr: [BUG] failed to remove  %s. "
-                    "counter of leading slot mismatch.", key);
-            errno = EFAULT;
-            return false;
+            _copy_data(tbl, it->idx, it->buf, valsize);
+            it->data = it->buf;
+            it->size = valsize;
         }
-        data->slots[data->slots[idx].hash].count--;
 
-        // remove data
-        _remove_data(tbl, idx);
-        DEBUG("hasharr: rem(dup) %s (idx=%d,tot=%d)", key, idx, data->usedslots);
+        it->idx++;
+        return true;
     }
 
-    return true;
+    errno = ENOENT;
+    return false;
 }
 
 /**
- * qhasharr->size(): Returns the number of objects in this table.
- *
- * @param tbl       qhasharr_t container pointer.
+ * qhasharr->iterend(): Finish traversal started by iterbegin().
  *
- * @return a number of elements stored.
+ * @param tbl   qhasharr_t container pointer.
+ * @param it    iterator started by iterbegin().
  */
-static int size(qhasharr_t *tbl, int *maxslots, int *usedslots) {
-    if (tbl == NULL) {
-        errno = EINVAL;
-        return -1;
-    }
+static void iterend(qhasharr_t *tbl, qiter_t *it) {
+    if (tbl->data->options & QHASHARR_CONCURRENT)
+        __sync_lock_release(&tbl->data->lock);
+    qlibc_free(it->buf);
+    it->buf = NULL;
+    it->bufsize = 0;
+}
 
-    qhasharr_data_t *data = tbl->data;
+/**
+ * qhasharr->update(): Modify an object in place, creating it if missing.
+ *
+ * @param tbl       qhasharr_t container pointer.
+ * @param key       key string.
+ * @param size      value size. It must fit in a single slot.
+ * @param ttl       time to live in seconds from now, 0 for no expiration.
+ *                  It's renewed on every update.
+ * @param callback  function modifying the value. created is true when the
+ *                  object didn't exist, then value is zero filled.
+ * @param userdata  argument passed to the callback.
+ *
+ * @return true if successful, otherwise returns false
+ * @retval errno will be set in error condition.
+ *  - EINVAL    : Invalid argument or size is bigger than the slot value size.
+ *  - ENOBUFS   : Table doesn't have enough space to store the object.
+ *  - EFAULT    : Unexpected error. Data structure is not constant.
+ *
+ * @code
+ *  static void count(void *userdata, void *value, bool created) {
+ *    int64_t n;
+ *    memcpy(&n, value, sizeof(n));
+ *    n++;
+ *    memcpy(value, &n, sizeof(n));
+ *  }
+ *
+ *  tbl->update(tbl, "hits", sizeof(int64_t), 0, count, NULL);
+ * @endcode
+ *
+ * @note
+ *  The callback runs under the writer lock with QHASHARR_CONCURRENT, so it
+ *  should be short and must not call other methods of the table. The value
+ *  isn't aligned, so access it with memcpy(). An existing object with a
+ *  different size is replaced by a new zero filled one.
+ */
+static bool update(qhasharr_t *tbl, const char *key, size_t size, int ttl,
+                   void (*callback) (void *userdata, void *value,
+                                     bool created),
+                   void *userdata) {
+    if (tbl == NULL || key == NULL || callback == NULL || ttl < 0
+            || size == 0 || size > tbl->data->valuesize) {
+        errno = EINVAL;
+        return false;
+    }
+
+    qhasharr_data_t *data = tbl->data;
+    uint32_t expire = (ttl > 0) ? (uint32_t) (time(NULL) + ttl) : 0;
+
+    _write_lock(tbl);
+    int idx = _get_idx(tbl, key, _hash(tbl, key));
+    if (idx >= 0 && _expired(tbl, idx) == false
+            && _SLOT(tbl, idx)->size == size && _SLOT(tbl, idx)->link == -1) {
+        callback(userdata, _SLOT_VALUE(tbl, idx), false);
+        _SLOT(tbl, idx)->expire = expire;
+        if (data->options & QHASHARR_EVICT)
+            _SLOT(tbl, idx)->ref = 1;
+        _write_unlock(tbl);
+        Q_STATS_INC(tbl->puthits);
+        return true;
+    }
+
+    unsigned char value[size];
+    memset(value, 0, size);
+    callback(userdata, value, true);
+    bool replaced = false;
+    bool ret = _put(tbl, key, value, size, expire, &replaced);
+    while (ret == false && errno == ENOBUFS
+            && _evict(tbl, !(data->options & QHASHARR_EVICT)) == true) {
+        ret = _put(tbl, key, value, size, expire, &replaced);
+    }
+    _write_unlock(tbl);
+
+    if (ret == true && replaced == true)
+        Q_STATS_INC(tbl->puthits);
+    else if (ret == true)
+        Q_STATS_INC(tbl->putmisses);
+    return ret;
+}
+
+/**
+ * qhasharr->remove(): Remove an object from this table.
+ *
+ * @param tbl       qhasharr_t container pointer.
+ * @param key       key string
+ *
+ * @return true if successful, otherwise(not found) returns false
+ * @retval errno will be set in error condition.
+ *  - ENOENT    : No such key found.
+ *  - EINVAL    : Invald argument.
+ *  - EFAULT        : Unexpected error. Data structure is not constant.
+ */
+static bool remove_(qhasharr_t *tbl, const char *key) {
+    if (tbl == NULL || key == NULL) {
+        errno = EINVAL;
+        return false;
+    }
+
+    _write_lock(tbl);
+    bool ret = _remove(tbl, key);
+    _write_unlock(tbl);
+
+    return ret;
+}
+
+/**
+ * qhasharr->size(): Returns the number of objects in this table.
+ *
+ * @param tbl       qhasharr_t container pointer.
+ *
+ * @return a number of elements stored.
+ */
+static int size(qhasharr_t *tbl, int *maxslots, int *usedslots) {
+    if (tbl == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    qhasharr_data_t *data = tbl->data;
 
     if (maxslots != NULL)
         *maxslots = data->maxslots;
@@ -716,15 +1174,17 @@ static void clear(qhasharr_t *tbl) {
 
     qhasharr_data_t *data = tbl->data;
 
-    if (data->usedslots == 0)
-        return;
-
-    data->usedslots = 0;
-    data->num = 0;
+    _write_lock(tbl);
+    if (data->usedslots > 0) {
+        data->usedslots = 0;
+        data->num = 0;
 
-    // clear memory
-    memset((void *) data->slots, '\0',
-           (data->maxslots * sizeof(qhasharr_slot_t)));
+        // clear memory
+        memset((void *) tbl->slots, '\0',
+               (data->maxslots * data->slotsize));
+        _freemap_reset(tbl);
+    }
+    _write_unlock(tbl);
 }
 
 /**
@@ -753,47 +1213,47 @@ static bool debug(qhasharr_t *tbl, FILE *out) {
     int idx = 0;
     qnobj_t obj;
     while (tbl->getnext(tbl, &obj, &idx) == true) {
-        uint16_t keylen = data->slots[idx - 1].data.pair.keylen;
+        uint16_t keylen = _SLOT(tbl, idx - 1)->keylen;
         fprintf(out, "%s%s(%d)=", obj.name,
-                (keylen > _Q_HASHARR_KEYSIZE) ? "..." : "", keylen);
+                (keylen > data->keysize) ? "..." : "", keylen);
         _q_humanOut(out, obj.data, obj.size, MAX_HUMANOUT);
         fprintf(out, " (%zu)\n", obj.size);
 
-        free(obj.name);
-        free(obj.data);
+        qlibc_free(obj.name);
+        qlibc_free(obj.data);
     }
 
 #ifdef BUILD_DEBUG
     fprintf(out, "%d elements (slot %d used/%d total)\n",
             data->num, data->usedslots, data->maxslots);
     for (idx = 0; idx < data->maxslots; idx++) {
-        if (data->slots[idx].count == 0) continue;
+        if (_SLOT(tbl, idx)->count == 0) continue;
 
         fprintf(out, "slot=%d,type=", idx);
-        if (data->slots[idx].count == -2) {
+        if (_SLOT(tbl, idx)->count == -2) {
             fprintf(out, "EXTEND,prev=%d,next=%d,data=",
-                    data->slots[idx].hash, data->slots[idx].link);
+                    _SLOT(tbl, idx)->hash, _SLOT(tbl, idx)->link);
             _q_humanOut(out,
-                    data->slots[idx].data.ext.value,
-                    data->slots[idx].size,
+                    _SLOT_VALUE(tbl, idx),
+                    _SLOT(tbl, idx)->size,
                     MAX_HUMANOUT);
-            fprintf(out, ",size=%d", data->slots[idx].size);
+            fprintf(out, ",size=%d", _SLOT(tbl, idx)->size);
         } else {
-            fprintf(out, "%s", (data->slots[idx].count == -1)?"COLISN":"NORMAL");
+            fprintf(out, "%s", (_SLOT(tbl, idx)->count == -1)?"COLISN":"NORMAL");
             fprintf(out, ",count=%d,hash=%u,key=",
-                    data->slots[idx].count, data->slots[idx].hash);
+                    _SLOT(tbl, idx)->count, _SLOT(tbl, idx)->hash);
             _q_humanOut(out,
-                    data->slots[idx].data.pair.key,
-                    (data->slots[idx].data.pair.keylen>_Q_HASHARR_KEYSIZE)
-                    ? _Q_HASHARR_KEYSIZE
-                    : data->slots[idx].data.pair.keylen,
+                    _SLOT_KEY(tbl, idx),
+                    (_SLOT(tbl, idx)->keylen > data->keysize)
+                    ? data->keysize
+                    : _SLOT(tbl, idx)->keylen,
                     MAX_HUMANOUT);
-            fprintf(out, ",keylen=%d,data=", data->slots[idx].data.pair.keylen);
+            fprintf(out, ",keylen=%d,data=", _SLOT(tbl, idx)->keylen);
             _q_humanOut(out,
-                    data->slots[idx].data.pair.value,
-                    data->slots[idx].size,
+                    _SLOT_VALUE(tbl, idx),
+                    _SLOT(tbl, idx)->size,
                     MAX_HUMANOUT);
-            fprintf(out, ",size=%d", data->slots[idx].size);
+            fprintf(out, ",size=%d", _SLOT(tbl, idx)->size);
         }
         fprintf(out, "\n");
     }
@@ -802,6 +1262,171 @@ static bool debug(qhasharr_t *tbl, FILE *out) {
     return true;
 }
 
+/**
+ * qhasharr->stats(): Get statistics of this table.
+ *
+ * @param tbl       qhasharr_t container pointer.
+ * @param stats     statistics will be stored here.
+ *
+ * @return true if successful, otherwise returns false.
+ * @retval errno will be set in error condition.
+ *  - EINVAL    : Invalid argument.
+ *
+ * @note
+ *  The load factor is the ratio of used slots, since a table fills up by
+ *  slots rather than by objects. maxchain is the longest distance from the
+ *  home slot of a key to the slot it's stored in, and collisions is the
+ *  number of keys not stored in their home slot. Bytes of truncated keys
+ *  are counted as stored. overhead covers slot headers, unused value and
+ *  key areas and empty slots, so it tells whether keysize and valuesize
+ *  fit the data. Lock wait time and hit/miss counters are kept in this
+ *  handle, not in the shared memory, so they cover this process only.
+ */
+static bool stats(qhasharr_t *tbl, qstats_t *stats) {
+    if (tbl == NULL || stats == NULL) {
+        errno = EINVAL;
+        return false;
+    }
+    memset((void *) stats, 0, sizeof(qstats_t));
+
+    qhasharr_data_t *data = tbl->data;
+
+    _write_lock(tbl);
+    int idx;
+    for (idx = 0; idx < data->maxslots; idx++) {
+        qhasharr_slot_t *slot = _SLOT(tbl, idx);
+        if (slot->count == 0)
+            continue;
+        stats->valuebytes += slot->size;
+        if (slot->count == -2)
+            continue;
+
+        size_t dist = (idx >= slot->hash) ? idx - slot->hash
+                : idx + data->maxslots - slot->hash;
+        if (dist > 0)
+            stats->collisions++;
+        if (dist + 1 > stats->maxchain)
+            stats->maxchain = dist + 1;
+        stats->keybytes += (slot->keylen > data->keysize) ? data->keysize
+                : slot->keylen;
+    }
+    stats->num = data->num;
+    stats->slots = data->maxslots;
+    stats->usedslots = data->usedslots;
+    stats->loadfactor = (double) data->usedslots / data->maxslots;
+    stats->overhead = qhasharr_calculate_memsize_opt(data->maxslots,
+                                                     data->keysize,
+                                                     data->valuesize)
+            - stats->keybytes - stats->valuebytes;
+    _write_unlock(tbl);
+
+    stats->lockwaitns = __atomic_load_n(&tbl->lockwaitns, __ATOMIC_RELAXED);
+    stats->gethits = Q_STATS_LOAD(tbl->gethits);
+    stats->getmisses = Q_STATS_LOAD(tbl->getmisses);
+    stats->puthits = Q_STATS_LOAD(tbl->puthits);
+    stats->putmisses = Q_STATS_LOAD(tbl->putmisses);
+    return true;
+}
+
+/**
+ * qhasharr->sync(): Checkpoint a table made by qhasharr_mmap().
+ *
+ * @param tbl   qhasharr_t container pointer.
+ *
+ * @return true if successful, otherwise returns false.
+ * @retval errno will be set in error condition.
+ *  - ENOTSUP : The table is not made by qhasharr_mmap().
+ *  - and errors of msync().
+ *
+ * @note
+ *  The checksum of the table is stored in the file header and the mapping
+ *  is flushed to the file. The table in the file will be used as it is on
+ *  next qhasharr_mmap() only if it hasn't been modified since the last
+ *  checkpoint.
+ */
+static bool sync_(qhasharr_t *tbl) {
+    if (tbl->map == NULL) {
+        errno = ENOTSUP;
+        return false;
+    }
+
+    _write_lock(tbl);
+    ((struct qhasharr_filehdr_s *) tbl->map)->checksum = _checksum(tbl);
+    bool ret = (msync(tbl->map, tbl->mapsize, MS_SYNC) == 0);
+    _write_unlock(tbl);
+
+    return ret;
+}
+
+/**
+ * qhasharr->compact(): Move displaced slots back near where they belong.
+ *
+ * @param tbl       qhasharr_t container pointer.
+ * @param maxscan   number of slots to inspect in this call,
+ *                  0 for the whole table.
+ *
+ * @return number of slots moved, otherwise returns -1.
+ * @retval errno will be set in error condition.
+ *  - EINVAL : Invalid argument.
+ *  - EFAULT : Unexpected error. Data structure is not constant.
+ *
+ * @code
+ *  // spend a little time on each tick.
+ *  tbl->compact(tbl, 1000);
+ * @endcode
+ *
+ * @note
+ *  A collided key is moved to the first empty slot after its home slot if
+ *  that's closer than where it is, so lookups of the key probe fewer slots.
+ *  An extended data block of a long value is moved the same way toward the
+ *  previous block of the value. Inspection resumes where the last call
+ *  stopped, the position is kept in the table memory and shared with other
+ *  processes. The write lock is held during a call, so maxscan bounds how
+ *  long readers and writers can be kept waiting.
+ */
+static int compact(qhasharr_t *tbl, int maxscan) {
+    if (tbl == NULL || maxscan < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    qhasharr_data_t *data = tbl->data;
+    if (maxscan == 0 || maxscan > data->maxslots)
+        maxscan = data->maxslots;
+
+    _write_lock(tbl);
+    int moved = 0;
+    int scanned;
+    for (scanned = 0; scanned < maxscan; scanned++) {
+        int idx = data->compacthand;
+        data->compacthand = (idx + 1 < data->maxslots) ? idx + 1 : 0;
+
+        // hash of collision slot is home slot and hash of extended data
+        // block is previous block.
+        qhasharr_slot_t *slot = _SLOT(tbl, idx);
+        if (slot->count >= 0)
+            continue;
+
+        int home = slot->hash;
+        int newidx = _find_empty(tbl, home + 1);
+        if (newidx < 0)
+            break;
+        if (_distance(tbl, home, newidx) >= _distance(tbl, home, idx))
+            continue;
+
+        if (_move_slot(tbl, newidx, idx) == false) {
+            moved = -1;
+            break;
+        }
+        DEBUG("hasharr: compact (idx=%d,newidx=%d,home=%d)", idx, newidx,
+              home);
+        moved++;
+    }
+    _write_unlock(tbl);
+
+    return moved;
+}
+
 /**
  * qhasharr->free(): De-allocate table reference object.
  *
@@ -810,30 +1435,204 @@ static bool debug(qhasharr_t *tbl, FILE *out) {
  * @note
  *  This does not de-allocate memory but only function reference object.
  *  Data memory such as shared memory must be de-allocated separately.
+ *  A table made by qhasharr_mmap() is checkpointed by sync() and unmapped.
  */
 void free_(qhasharr_t *tbl) {
-    free(tbl);
+    if (tbl->map != NULL) {
+        sync_(tbl);
+        munmap(tbl->map, tbl->mapsize);
+    }
+    qlibc_free(tbl);
 }
 
 #ifndef _DOXYGEN_SKIP
 
+// get aligned slot size for the geometry.
+static size_t _slot_size(int keysize, int valuesize) {
+    if (keysize <= 0)
+        keysize = _Q_HASHARR_KEYSIZE;
+    if (valuesize <= 0)
+        valuesize = _Q_HASHARR_VALUESIZE;
+
+    size_t size = sizeof(qhasharr_slot_t) + keysize + valuesize;
+    size_t align = sizeof(uint64_t);
+    return (size + align - 1) & ~(align - 1);
+}
+
+// acquire writer spinlock in shared memory.
+static void _spin_lock(qhasharr_t *tbl) {
+    qhasharr_data_t *data = tbl->data;
+    int spins = 0;
+    int64_t waitstart = 0;
+    while (__sync_lock_test_and_set(&data->lock, 1)) {
+        if (waitstart == 0)
+            waitstart = qtime_monotonic_ns();
+        while (data->lock) {
+            if (++spins >= SPIN_YIELD_COUNT) {
+                sched_yield();
+                spins = 0;
+            }
+        }
+    }
+    _add_wait(tbl, waitstart);
+}
+
+// acquire writer spinlock and start modification sequence.
+static void _write_lock(qhasharr_t *tbl) {
+    qhasharr_data_t *data = tbl->data;
+    if (!(data->options & QHASHARR_CONCURRENT))
+        return;
+
+    _spin_lock(tbl);
+    __sync_fetch_and_add(&data->seq, 1);
+}
+
+// end modification sequence and release writer spinlock.
+static void _write_unlock(qhasharr_t *tbl) {
+    qhasharr_data_t *data = tbl->data;
+    if (!(data->options & QHASHARR_CONCURRENT))
+        return;
+
+    __sync_fetch_and_add(&data->seq, 1);
+    __sync_lock_release(&data->lock);
+}
+
+// start lock-free reading. wait while a writer is in progress.
+static uint32_t _read_begin(qhasharr_t *tbl) {
+    qhasharr_data_t *data = tbl->data;
+    if (!(data->options & QHASHARR_CONCURRENT))
+        return 0;
+
+    uint32_t seq;
+    int spins = 0;
+    int64_t waitstart = 0;
+    while ((seq = data->seq) & 1) {
+        if (waitstart == 0)
+            waitstart = qtime_monotonic_ns();
+        if (++spins >= SPIN_YIELD_COUNT) {
+            sched_yield();
+            spins = 0;
+        }
+    }
+    _add_wait(tbl, waitstart);
+    __sync_synchronize();
+    return seq;
+}
+
+// add the time waited for a writer. handles are shared by threads.
+static void _add_wait(qhasharr_t *tbl, int64_t waitstart) {
+    if (waitstart == 0)
+        return;
+    __atomic_fetch_add(&tbl->lockwaitns,
+                       (uint64_t) (qtime_monotonic_ns() - waitstart),
+                       __ATOMIC_RELAXED);
+}
+
+// returns true if the table was modified since _read_begin().
+static bool _read_retry(qhasharr_t *tbl, uint32_t seq) {
+    qhasharr_data_t *data = tbl->data;
+    if (!(data->options & QHASHARR_CONCURRENT))
+        return false;
+
+    __sync_synchronize();
+    return (data->seq != seq);
+}
+
+// reclaim one object. returns false if there's nothing to reclaim.
+static bool _evict(qhasharr_t *tbl, bool expiredonly) {
+    qhasharr_data_t *data = tbl->data;
+
+    // second round is needed when every reference bit was set.
+    int maxscan = (expiredonly) ? data->maxslots : data->maxslots * 2;
+    int scanned;
+    for (scanned = 0; scanned < maxscan; scanned++) {
+        int idx = data->clockhand;
+        data->clockhand = (idx + 1 < data->maxslots) ? idx + 1 : 0;
+
+        qhasharr_slot_t *slot = _SLOT(tbl, idx);
+        if (slot->count == 0 || slot->count == -2)
+            continue;
+
+        if (_expired(tbl, idx) == false) {
+            if (expiredonly)
+                continue;
+            if (slot->ref) {
+                slot->ref = 0;  // give a second chance
+                continue;
+            }
+        }
+
+        DEBUG("hasharr: evict (idx=%d)", idx);
+        return _remove_idx(tbl, idx);
+    }
+
+    return false;
+}
+
+// check if the object of the key slot has expired.
+static bool _expired(qhasharr_t *tbl, int idx) {
+    uint32_t expire = _SLOT(tbl, idx)->expire;
+    return (expire != 0 && expire <= (uint32_t) time(NULL));
+}
+
+// get the number of slots needed for the value size.
+static int _slots_needed(qhasharr_t *tbl, size_t size) {
+    qhasharr_data_t *data = tbl->data;
+    if (size <= data->valuesize)
+        return 1;
+
+    size_t extsize = data->keysize + data->valuesize;
+    size_t nslots = 1 + (size - data->valuesize + extsize - 1) / extsize;
+    return (nslots > INT32_MAX) ? INT32_MAX : (int) nslots;
+}
+
+// get slot index of the key.
+static unsigned int _hash(qhasharr_t *tbl, const char *key) {
+    qhasharr_data_t *data = tbl->data;
+    size_t keylen = strlen(key);
+
+    uint32_t hash;
+    if (data->options & QHASHARR_FASTHASH) {
+        hash = qhashxx32(key, keylen);
+    } else {
+        hash = qhashmurmur3_32(key, keylen);
+    }
+
+    return hash % data->maxslots;
+}
+
+// get 16 bytes key fingerprint stored for truncated keys.
+static void _fingerprint(qhasharr_t *tbl, const char *key, size_t keylen,
+                         unsigned char *retbuf) {
+    if (tbl->data->options & QHASHARR_FINGERPRINT) {
+        qhashmurmur3_128(key, keylen, retbuf);
+    } else {
+        qhashmd5(key, keylen, retbuf);
+    }
+}
+
 // find empty slot : return empty slow number, otherwise returns -1.
+// the first empty slot from startidx, wrapping around, is found in the free
+// map. bits past maxslots are never set, so the last word needs no care.
 static int _find_empty(qhasharr_t *tbl, int startidx) {
     qhasharr_data_t *data = tbl->data;
 
     if (startidx >= data->maxslots)
         startidx = 0;
 
-    int idx = startidx;
-    while (true) {
-        if (data->slots[idx].count == 0)
-            return idx;
+    size_t nwords = _FREEMAP_WORDS(data->maxslots);
+    size_t word = startidx / 64;
+    uint64_t bits = tbl->freemap[word] & (~0ULL << (startidx % 64));
 
-        idx++;
-        if (idx >= data->maxslots)
-            idx = 0;
-        if (idx == startidx)
-            break;
+    // the start word is visited again at last for slots before startidx.
+    size_t n;
+    for (n = 0; n <= nwords; n++) {
+        if (bits != 0)
+            return (int) (word * 64 + __builtin_ctzll(bits));
+
+        if (++word >= nwords)
+            word = 0;
+        bits = tbl->freemap[word];
     }
 
     return -1;
@@ -842,34 +1641,38 @@ static int _find_empty(qhasharr_t *tbl, int startidx) {
 static int _get_idx(qhasharr_t *tbl, const char *key, unsigned int hash) {
     qhasharr_data_t *data = tbl->data;
 
-    if (data->slots[hash].count > 0) {
+    if (_SLOT(tbl, hash)->count > 0) {
+        size_t keylen = strlen(key);
+        unsigned char keyfp[16];
+        bool fpdone = false;
+
         int count, idx;
-        for (count = 0, idx = hash; count < data->slots[hash].count;) {
-            if (data->slots[idx].hash == hash
-                    && (data->slots[idx].count > 0
-                            || data->slots[idx].count == -1)) {
+        for (count = 0, idx = hash; count < _SLOT(tbl, hash)->count;) {
+            if (_SLOT(tbl, idx)->hash == hash
+                    && (_SLOT(tbl, idx)->count > 0
+                            || _SLOT(tbl, idx)->count == -1)) {
                 // same hash
                 count++;
 
                 // is same key?
-                size_t keylen = strlen(key);
                 // first check key length
-                if (keylen == data->slots[idx].data.pair.keylen) {
-                    if (keylen <= _Q_HASHARR_KEYSIZE) {
+                if (keylen == _SLOT(tbl, idx)->keylen) {
+                    if (keylen <= data->keysize) {
                         // original key is stored
-                        if (!memcmp(key, data->slots[idx].data.pair.key,
+                        if (!memcmp(key, _SLOT_KEY(tbl, idx),
                                     keylen)) {
                             return idx;
                         }
-                    } else {
-                        // key is truncated, compare MD5 also.
-                        unsigned char keymd5[16];
-                        qhashmd5(key, keylen, keymd5);
-                        if (!memcmp(key, data->slots[idx].data.pair.key,
-                        _Q_HASHARR_KEYSIZE)
-                                && !memcmp(keymd5,
-                                           data->slots[idx].data.pair.keymd5,
-                                           16)) {
+                    } else if (!memcmp(key, _SLOT_KEY(tbl, idx),
+                                       data->keysize)) {
+                        // key is truncated, compare fingerprint also.
+                        // it's computed only once per lookup.
+                        if (fpdone == false) {
+                            _fingerprint(tbl, key, keylen, keyfp);
+                            fpdone = true;
+                        }
+                        if (!memcmp(keyfp, _SLOT(tbl, idx)->keymd5,
+                                    16)) {
                             return idx;
                         }
                     }
@@ -898,67 +1701,100 @@ static void *_get_data(qhasharr_t *tbl, int idx, size_t *size) {
         return NULL;
     }
 
-    qhasharr_data_t *data = tbl->data;
-
-    int newidx;
-    size_t valsize;
-    for (newidx = idx, valsize = 0;; newidx = data->slots[newidx].link) {
-        valsize += data->slots[newidx].size;
-        if (data->slots[newidx].link == -1)
-            break;
-    }
+    size_t valsize = _data_size(tbl, idx);
+    if (valsize == (size_t) -1)
+        return NULL;
 
-    void *value, *vp;
-    value = malloc(valsize);
+    void *value = qlibc_malloc(valsize);
     if (value == NULL) {
         errno = ENOMEM;
         return NULL;
     }
+    _copy_data(tbl, idx, value, valsize);
 
-    for (newidx = idx, vp = value;; newidx = data->slots[newidx].link) {
-        if (data->slots[newidx].count == -2) {
-            // extended data block
-            memcpy(vp, (void *) data->slots[newidx].data.ext.value,
-                   data->slots[newidx].size);
-        } else {
-            // key/value pair data block
-            memcpy(vp, (void *) data->slots[newidx].data.pair.value,
-                   data->slots[newidx].size);
-        }
+    if (size != NULL)
+        *size = valsize;
+    return value;
+}
+
+// sum up the value size of a chain. returns (size_t) -1 on a broken link.
+static size_t _data_size(qhasharr_t *tbl, int idx) {
+    qhasharr_data_t *data = tbl->data;
 
-        vp += data->slots[newidx].size;
-        if (data->slots[newidx].link == -1)
+    // links are verified because a concurrent writer can change them
+    // while we're following the chain.
+    int newidx, nslots;
+    size_t valsize;
+    for (newidx = idx, valsize = 0, nslots = 0;;
+            newidx = _SLOT(tbl, newidx)->link) {
+        valsize += _SLOT(tbl, newidx)->size;
+        if (_SLOT(tbl, newidx)->link == -1)
             break;
+        if (_SLOT(tbl, newidx)->link < 0
+                || _SLOT(tbl, newidx)->link >= data->maxslots
+                || ++nslots >= data->maxslots) {
+            errno = EFAULT;
+            return (size_t) -1;
+        }
     }
+    return valsize;
+}
 
-    if (size != NULL)
-        *size = valsize;
-    return value;
+// copy the value of a chain into the buffer of valsize bytes.
+static void _copy_data(qhasharr_t *tbl, int idx, void *value, size_t valsize) {
+    qhasharr_data_t *data = tbl->data;
+
+    int newidx;
+    void *vp;
+    size_t remain;
+    for (newidx = idx, vp = value, remain = valsize;;
+            newidx = _SLOT(tbl, newidx)->link) {
+        size_t copysize = _SLOT(tbl, newidx)->size;
+        if (copysize > remain)
+            copysize = remain;
+
+        // value area is at the same place in both key/value pair block
+        // and extended data block.
+        memcpy(vp, (void *) _SLOT_VALUE(tbl, newidx), copysize);
+
+        vp += copysize;
+        remain -= copysize;
+        int link = _SLOT(tbl, newidx)->link;
+        if (link < 0 || link >= data->maxslots || remain == 0)
+            break;
+    }
 }
 
 static bool _put_data(qhasharr_t *tbl, int idx, unsigned int hash,
                       const char *key, const void *value, size_t size,
-                      int count) {
+                      int count, uint32_t expire) {
     qhasharr_data_t *data = tbl->data;
 
     // check if used
-    if (data->slots[idx].count != 0) {
+    if (_SLOT(tbl, idx)->count != 0) {
         DEBUG("hasharr: BUG found.");
         errno = EFAULT;
         return false;
     }
 
     size_t keylen = strlen(key);
-    unsigned char keymd5[16];
-    qhashmd5(key, keylen, keymd5);
+    unsigned char keyfp[16];
+    if (keylen > data->keysize) {
+        _fingerprint(tbl, key, keylen, keyfp);
+    } else {
+        memset((void *) keyfp, 0, sizeof(keyfp));
+    }
 
     // store key
-    data->slots[idx].count = count;
-    data->slots[idx].hash = hash;
-    strncpy(data->slots[idx].data.pair.key, key, _Q_HASHARR_KEYSIZE);
-    memcpy((char *) data->slots[idx].data.pair.keymd5, (char *) keymd5, 16);
-    data->slots[idx].data.pair.keylen = keylen;
-    data->slots[idx].link = -1;
+    _SLOT(tbl, idx)->count = count;
+    _FREEMAP_CLR(tbl, idx);
+    _SLOT(tbl, idx)->hash = hash;
+    strncpy(_SLOT_KEY(tbl, idx), key, data->keysize);
+    memcpy((char *) _SLOT(tbl, idx)->keymd5, (char *) keyfp, 16);
+    _SLOT(tbl, idx)->keylen = keylen;
+    _SLOT(tbl, idx)->link = -1;
+    _SLOT(tbl, idx)->ref = 0;
+    _SLOT(tbl, idx)->expire = expire;
 
     // store value
     int newidx;
@@ -974,15 +1810,16 @@ static bool _put_data(qhasharr_t *tbl, int idx, unsigned int hash,
             }
 
             // clear & set
-            memset((void *) (&data->slots[tmpidx]), '\0',
-                   sizeof(qhasharr_slot_t));
+            memset((void *) _SLOT(tbl, tmpidx), '\0',
+                   data->slotsize);
 
-            data->slots[tmpidx].count = -2;      // extended data block
-            data->slots[tmpidx].hash = newidx;   // prev link
-            data->slots[tmpidx].link = -1;       // end block mark
-            data->slots[tmpidx].size = 0;
+            _SLOT(tbl, tmpidx)->count = -2;      // extended data block
+            _FREEMAP_CLR(tbl, tmpidx);
+            _SLOT(tbl, tmpidx)->hash = newidx;   // prev link
+            _SLOT(tbl, tmpidx)->link = -1;       // end block mark
+            _SLOT(tbl, tmpidx)->size = 0;
 
-            data->slots[newidx].link = tmpidx;   // link chain
+            _SLOT(tbl, newidx)->link = tmpidx;   // link chain
 
             DEBUG("hasharr: slot %d is linked to slot %d for key %s.",
                     tmpidx, newidx, key);
@@ -992,25 +1829,25 @@ static bool _put_data(qhasharr_t *tbl, int idx, unsigned int hash,
         // copy data
         size_t copysize = size - savesize;
 
-        if (data->slots[newidx].count == -2) {
+        if (_SLOT(tbl, newidx)->count == -2) {
             // extended value
-            if (copysize > sizeof(struct _Q_HASHARR_SLOT_EXT)) {
-                copysize = sizeof(struct _Q_HASHARR_SLOT_EXT);
+            if (copysize > (data->keysize + data->valuesize)) {
+                copysize = (data->keysize + data->valuesize);
             }
-            memcpy(data->slots[newidx].data.ext.value, value + savesize,
+            memcpy(_SLOT_VALUE(tbl, newidx), value + savesize,
                    copysize);
         } else {
             // first slot
-            if (copysize > _Q_HASHARR_VALUESIZE) {
-                copysize = _Q_HASHARR_VALUESIZE;
+            if (copysize > data->valuesize) {
+                copysize = data->valuesize;
             }
-            memcpy(data->slots[newidx].data.pair.value, value + savesize,
+            memcpy(_SLOT_VALUE(tbl, newidx), value + savesize,
                    copysize);
 
             // increase stored key counter
             data->num++;
         }
-        data->slots[newidx].size = copysize;
+        _SLOT(tbl, newidx)->size = copysize;
         savesize += copysize;
 
         // increase used slot counter
@@ -1023,14 +1860,15 @@ static bool _put_data(qhasharr_t *tbl, int idx, unsigned int hash,
 static bool _copy_slot(qhasharr_t *tbl, int idx1, int idx2) {
     qhasharr_data_t *data = tbl->data;
 
-    if (data->slots[idx1].count != 0 || data->slots[idx2].count == 0) {
+    if (_SLOT(tbl, idx1)->count != 0 || _SLOT(tbl, idx2)->count == 0) {
         DEBUG("hasharr: BUG found.");
         errno = EFAULT;
         return false;
     }
 
-    memcpy((void *) (&data->slots[idx1]), (void *) (&data->slots[idx2]),
-           sizeof(qhasharr_slot_t));
+    memcpy((void *) _SLOT(tbl, idx1), (void *) _SLOT(tbl, idx2),
+           data->slotsize);
+    _FREEMAP_CLR(tbl, idx1);
 
     // increase used slot counter
     data->usedslots++;
@@ -1038,16 +1876,40 @@ static bool _copy_slot(qhasharr_t *tbl, int idx1, int idx2) {
     return true;
 }
 
+// move a collision slot or an extended data block from idx2 to empty idx1,
+// fixing links pointing to it.
+static bool _move_slot(qhasharr_t *tbl, int idx1, int idx2) {
+    if (_SLOT(tbl, idx2)->count >= 0) {
+        DEBUG("hasharr: BUG found.");
+        errno = EFAULT;
+        return false;
+    }
+
+    if (_copy_slot(tbl, idx1, idx2) == false)
+        return false;
+    _remove_slot(tbl, idx2);
+
+    // in case of -2, adjust link of mother
+    qhasharr_slot_t *slot = _SLOT(tbl, idx1);
+    if (slot->count == -2)
+        _SLOT(tbl, slot->hash)->link = idx1;
+    if (slot->link != -1)
+        _SLOT(tbl, slot->link)->hash = idx1;
+
+    return true;
+}
+
 static bool _remove_slot(qhasharr_t *tbl, int idx) {
     qhasharr_data_t *data = tbl->data;
 
-    if (data->slots[idx].count == 0) {
+    if (_SLOT(tbl, idx)->count == 0) {
         DEBUG("hasharr: BUG found.");
         errno = EFAULT;
         return false;
     }
 
-    data->slots[idx].count = 0;
+    _SLOT(tbl, idx)->count = 0;
+    _FREEMAP_SET(tbl, idx);
 
     // decrease used slot counter
     data->usedslots--;
@@ -1058,14 +1920,14 @@ static bool _remove_slot(qhasharr_t *tbl, int idx) {
 static bool _remove_data(qhasharr_t *tbl, int idx) {
     qhasharr_data_t *data = tbl->data;
 
-    if (data->slots[idx].count == 0) {
+    if (_SLOT(tbl, idx)->count == 0) {
         DEBUG("hasharr: BUG found.");
         errno = EFAULT;
         return false;
     }
 
     while (true) {
-        int link = data->slots[idx].link;
+        int link = _SLOT(tbl, idx)->link;
         _remove_slot(tbl, idx);
 
         if (link == -1)
@@ -1080,4 +1942,187 @@ static bool _remove_data(qhasharr_t *tbl, int idx) {
     return true;
 }
 
+// put an object. replaced is set when an object with the same key has been
+// removed for it. the write lock must be held by caller.
+static bool _put(qhasharr_t *tbl, const char *key, const void *value,
+                 size_t size, uint32_t expire, bool *replaced) {
+    qhasharr_data_t *data = tbl->data;
+
+    // check full
+    if (data->usedslots >= data->maxslots) {
+        DEBUG("hasharr: put %s - FULL", key);
+        errno = ENOBUFS;
+        return false;
+    }
+
+    // get hash integer
+    unsigned int hash = _hash(tbl, key);
+
+    // check, is slot empty
+    if (_SLOT(tbl, hash)->count == 0) {  // empty slot
+        // put data
+        if (_put_data(tbl, hash, hash, key, value, size, 1, expire) == false) {
+            DEBUG("hasharr: FAILED put(new) %s", key);
+            return false;
+        } DEBUG("hasharr: put(new) %s (idx=%d,hash=%u,tot=%d)",
+                key, hash, hash, data->usedslots);
+    } else if (_SLOT(tbl, hash)->count > 0) {  // same key or hash collision
+        // check same key;
+        int idx = _get_idx(tbl, key, hash);
+        if (idx >= 0) {  // same key
+            // remove and recall
+            _remove(tbl, key);
+            *replaced = true;
+            return _put(tbl, key, value, size, expire, replaced);
+        } else {  // no same key, just hash collision
+            // find empty slot
+            int idx = _find_empty(tbl, hash);
+            if (idx < 0) {
+                errno = ENOBUFS;
+                return false;
+            }
+
+            // put data. -1 is used for collision resolution (idx != hash);
+            if (_put_data(tbl, idx, hash, key, value, size, -1, expire) == false) {
+                DEBUG("hasharr: FAILED put(col) %s", key);
+                return false;
+            }
+
+            // increase counter from leading slot
+            _SLOT(tbl, hash)->count++;
+
+            DEBUG("hasharr: put(col) %s (idx=%d,hash=%u,tot=%d)",
+                    key, idx, hash, data->usedslots);
+        }
+    } else {
+        // in case of -1 or -2, move it. -1 used for collision resolution,
+        // -2 used for oversized value data.
+
+        // find empty slot
+        int idx = _find_empty(tbl, hash + 1);
+        if (idx < 0) {
+            errno = ENOBUFS;
+            return false;
+        }
+
+        // move dup slot to empty
+        _move_slot(tbl, idx, hash);
+
+        // store data
+        if (_put_data(tbl, hash, hash, key, value, size, 1, expire) == false) {
+            DEBUG("hasharr: FAILED put(swp) %s", key);
+            return false;
+        }
+
+        DEBUG("hasharr: put(swp) %s (idx=%u,hash=%u,tot=%d)",
+                key, hash, hash, data->usedslots);
+    }
+
+    return true;
+}
+
+// remove an object. the write lock must be held by caller.
+static bool _remove(qhasharr_t *tbl, const char *key) {
+    // get hash integer
+    unsigned int hash = _hash(tbl, key);
+
+    int idx = _get_idx(tbl, key, hash);
+    if (idx < 0) {
+        DEBUG("not found %s", key);
+        errno = ENOENT;
+        return false;
+    }
+
+    // expired object is reclaimed but treated as not found.
+    if (_expired(tbl, idx)) {
+        _remove_idx(tbl, idx);
+        errno = ENOENT;
+        return false;
+    }
+
+    return _remove_idx(tbl, idx);
+}
+
+// remove an object stored at the key slot.
+static bool _remove_idx(qhasharr_t *tbl, int idx) {
+    qhasharr_data_t *data = tbl->data;
+    unsigned int hash = _SLOT(tbl, idx)->hash;
+    if (_SLOT(tbl, idx)->count == 1) {
+        // just remove
+        _remove_data(tbl, idx);
+        DEBUG("hasharr: rem (idx=%d,tot=%d)", idx, data->usedslots);
+    } else if (_SLOT(tbl, idx)->count > 1) {  // leading slot and has dup
+        // find dup
+        int idx2;
+        for (idx2 = idx + 1;; idx2++) {
+            if (idx2 >= data->maxslots)
+                idx2 = 0;
+            if (idx2 == idx) {
+                DEBUG("hasharr: [BUG] failed to remove dup key (idx=%d).", idx);
+                errno = EFAULT;
+                return false;
+            }
+            if (_SLOT(tbl, idx2)->count == -1
+                    && _SLOT(tbl, idx2)->hash == hash) {
+                break;
+            }
+        }
+
+        // move to leading slot
+        int backupcount = _SLOT(tbl, idx)->count;
+        _remove_data(tbl, idx);  // remove leading data
+        _copy_slot(tbl, idx, idx2);  // copy slot
+        _remove_slot(tbl, idx2);  // remove moved slot
+
+        _SLOT(tbl, idx)->count = backupcount - 1;  // adjust collision counter
+        if (_SLOT(tbl, idx)->link != -1) {
+            _SLOT(tbl, _SLOT(tbl, idx)->link)->hash = idx;
+        }
+
+        DEBUG("hasharr: rem(lead) (idx=%d,tot=%d)", idx, data->usedslots);
+    } else {  // in case of -1. used for collision resolution
+        // decrease counter from leading slot
+        if (_SLOT(tbl, _SLOT(tbl, idx)->hash)->count <= 1) {
+            DEBUG("hasharr: [BUG] failed to remove (idx=%d). "
+                    "counter of leading slot mismatch.", idx);
+            errno = EFAULT;
+            return false;
+        }
+        _SLOT(tbl, _SLOT(tbl, idx)->hash)->count--;
+
+        // remove data
+        _remove_data(tbl, idx);
+        DEBUG("hasharr: rem(dup) (idx=%d,tot=%d)", idx, data->usedslots);
+    }
+
+    return true;
+}
+// mark all slots empty in the free map.
+static void _freemap_reset(qhasharr_t *tbl) {
+    int maxslots = tbl->data->maxslots;
+    size_t nwords = _FREEMAP_WORDS(maxslots);
+
+    memset((void *) tbl->freemap, 0xff, nwords * sizeof(uint64_t));
+    if (maxslots % 64)
+        tbl->freemap[nwords - 1] = (1ULL << (maxslots % 64)) - 1;
+}
+
+// distance from slot idx1 forward to idx2, wrapping around.
+static int _distance(qhasharr_t *tbl, int idx1, int idx2) {
+    return (idx2 >= idx1) ? idx2 - idx1 : idx2 + tbl->data->maxslots - idx1;
+}
+
+// checksum of table memory, excluding lock and sequence counter.
+static uint64_t _checksum(qhasharr_t *tbl) {
+    qhasharr_data_t data;
+    memcpy((void *) &data, (void *) tbl->data, sizeof(data));
+    data.lock = 0;
+    data.seq = 0;
+    uint64_t sum = qhashxx64(&data, sizeof(data));
+    return sum ^ qhashxx64(tbl->slots, tbl->data->slotsize
+                                       * (size_t) tbl->data->maxslots
+                           + _FREEMAP_WORDS(tbl->data->maxslots)
+                                       * sizeof(uint64_t));
+}
+
 #endif /* _DOXYGEN_SKIP */
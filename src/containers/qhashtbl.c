@@ -39,6 +39,26 @@
  * hash collisions and consequently it increases the time cost to look up an
  * element.
  *
+ * With QHASHTBL_OPENADDR option, the table uses an open-addressing engine
+ * instead of the linked slots. Each key is placed in a flat probe array of
+ * fixed-size entries which keep the hash value, the key length and a short
+ * prefix of the key, using Robin Hood probing. The key and value bytes are
+ * stored together in a contiguous arena, so an insertion doesn't allocate
+ * memory per element and a lookup rarely touches more than one cache line
+ * before comparing the key itself. The probe array grows automatically.
+ *
+ * QHASHTBL_CONCURRENT option makes the table thread-safe without a table-wide
+ * lock. The slots are divided into stripes and each stripe is protected by
+ * its own reader/writer lock, so readers never block each other and writers
+ * only block the operations which fall into the same stripe.
+ *
+ * When QHASHTBL_RESIZABLE option is given, the table doubles its range when
+ * the number of elements exceeds the range and halves it when the table
+ * becomes sparse. The migration to the new slots is not done at once but
+ * spread over the following put(), get() and remove() calls, a few slots at
+ * a time, so no single call pays for moving the whole table. Since each
+ * element keeps its hash value, keys are never rehashed during migration.
+ *
  * @code
  *  [Internal Structure Example for 10-slot hash table]
  *
@@ -96,9 +116,47 @@
 #include <errno.h>
 #include "qinternal.h"
 #include "utilities/qhash.h"
+#include "utilities/qtime.h"
 #include "containers/qhashtbl.h"
 
 #define DEFAULT_INDEX_RANGE (1000)  /*!< default value of hash-index range */
+#define RESIZE_GROW_LOAD    (1)     /*!< grow when num > range * this */
+#define RESIZE_SHRINK_LOAD  (8)     /*!< shrink when num < range / this */
+#define REHASH_STEP_SLOTS   (8)     /*!< old slots migrated per operation */
+#define CONCURRENT_STRIPES  (64)    /*!< number of locks in concurrent mode */
+#define BATCH_SIZE          (16)    /*!< keys hashed and prefetched at once */
+#define INLINE_MAX          (48)    /*!< name and data kept in the object */
+
+#define INLINE_ALIGN(n)     (((n) + 7) & ~((size_t)7))
+#define INLINE_LEN(namelen, size)   (INLINE_ALIGN((namelen) + 1) + (size))
+#define INLINE_NAME(obj)    ((char *)((obj) + 1))
+#define IS_INLINE(obj)      ((obj)->name == INLINE_NAME(obj))
+
+#define FLAT_MIN_RANGE      (16)    /*!< minimum size of probe array */
+#define FLAT_MAX_LOAD_PCT   (85)    /*!< grow when probe array is 85% full */
+#define FLAT_PREFIX_LEN     (4)     /*!< key prefix bytes kept in a slot */
+#define FLAT_ALIGN(n)       (((n) + 7) & ~((size_t)7))
+
+/**
+ * Probe array entry of open-addressing engine.
+ *
+ * The arena record at the offset is laid out as
+ * [size_t data size][key][NUL][padding][data][padding].
+ */
+struct qhashtbl_flatslot_s {
+    uint32_t hash;      /*!< 32bit-hash value of key */
+    uint32_t dist;      /*!< probe distance + 1, 0 means empty slot */
+    uint32_t keylen;    /*!< key length */
+    char prefix[FLAT_PREFIX_LEN];   /*!< first bytes of key, zero padded */
+    size_t offset;      /*!< offset of record in arena */
+};
+
+#define FLAT_REC_SIZE(tbl, s)   (*(size_t *)((tbl)->arena + (s)->offset))
+#define FLAT_REC_NAME(tbl, s)   ((tbl)->arena + (s)->offset + sizeof(size_t))
+#define FLAT_REC_DATA(tbl, s)   ((tbl)->arena + (s)->offset \
+                                 + FLAT_ALIGN(sizeof(size_t) + (s)->keylen + 1))
+#define FLAT_REC_LEN(keylen, size)  (FLAT_ALIGN(sizeof(size_t) + (keylen) + 1) \
+                                     + FLAT_ALIGN(size))
 
 #ifndef _DOXYGEN_SKIP
 
@@ -108,24 +166,99 @@ static bool put(qhashtbl_t *tbl, const char *name, const void *data,
 static bool putstr(qhashtbl_t *tbl, const char *name, const char *str);
 static bool putstrf(qhashtbl_t *tbl, const char *name, const char *format, ...);
 static bool putint(qhashtbl_t *tbl, const char *name, int64_t num);
+static bool putref(qhashtbl_t *tbl, const char *name, void *data, size_t size);
+static bool puthashed(qhashtbl_t *tbl, const char *name, size_t namelen,
+                      uint32_t hash, const void *data, size_t size);
+static size_t putbatch(qhashtbl_t *tbl, const qnobj_t *objs, size_t num);
 
 static void *get(qhashtbl_t *tbl, const char *name, size_t *size, bool newmem);
 static char *getstr(qhashtbl_t *tbl, const char *name, bool newmem);
 static int64_t getint(qhashtbl_t *tbl, const char *name);
+static void *gethashed(qhashtbl_t *tbl, const char *name, size_t namelen,
+                       uint32_t hash, size_t *size, bool newmem);
+static size_t getbatch(qhashtbl_t *tbl, qnobj_t *objs, size_t num,
+                       bool newmem);
 
 static bool getnext(qhashtbl_t *tbl, qhnobj_t *obj, bool newmem);
+static void iterbegin(qhashtbl_t *tbl, qiter_t *it);
+static bool iternext(qhashtbl_t *tbl, qiter_t *it);
+static void iterend(qhashtbl_t *tbl, qiter_t *it);
 
 static bool remove_(qhashtbl_t *tbl, const char *name);
+static bool removehashed(qhashtbl_t *tbl, const char *name, size_t namelen,
+                         uint32_t hash);
+
+static uint32_t hash_(qhashtbl_t *tbl, const char *name, size_t namelen);
+static uint32_t hashfast(qhashtbl_t *tbl, const char *name, size_t namelen);
 
 static size_t size(qhashtbl_t *tbl);
 static void clear(qhashtbl_t *tbl);
 static bool debug(qhashtbl_t *tbl, FILE *out);
+static bool stats(qhashtbl_t *tbl, qstats_t *stats);
+static bool snapshot(qhashtbl_t *tbl, const char *filepath);
+static ssize_t restore(qhashtbl_t *tbl, const char *filepath);
+static qfrozentbl_t *freeze(qhashtbl_t *tbl);
 
 static void lock(qhashtbl_t *tbl);
 static void unlock(qhashtbl_t *tbl);
 
 static void free_(qhashtbl_t *tbl);
 
+// internal functions
+static bool _put(qhashtbl_t *tbl, const char *name, size_t namelen,
+                 uint32_t hash, const void *data, size_t size, bool isref);
+static qhnobj_t *_find_obj(qhashtbl_t *tbl, const char *name, size_t namelen,
+                           uint32_t hash, qhnobj_t ***link);
+static size_t _hash_batch(qhashtbl_t *tbl, const qnobj_t *objs, size_t num,
+                          size_t *namelens, uint32_t *hashes);
+static bool _resize(qhashtbl_t *tbl, size_t newrange);
+static void _check_resize(qhashtbl_t *tbl);
+static void _rehash_step(qhashtbl_t *tbl, size_t nslots);
+
+// lock striping
+static bool _striped_getnext(qhashtbl_t *tbl, qhnobj_t *obj, bool newmem);
+static int _striped_cmp(uint32_t hash1, const void *obj1, uint32_t hash2,
+                        const void *obj2);
+static qhnobj_t *_striped_after(qhnobj_t *chain, uint32_t hash,
+                                const void *last);
+static void _lock_shared(qhashtbl_t *tbl);
+static void _stripe_lock(qhashtbl_t *tbl, size_t idx, bool write);
+static void _stripe_unlock(qhashtbl_t *tbl, size_t idx);
+static void _add_num(qhashtbl_t *tbl, int delta);
+static qhnobj_t *_new_obj(qhashtbl_t *tbl, size_t inlsize);
+static void _release_obj(qhnobj_t *obj);
+static void _free_obj(qhashtbl_t *tbl, qhnobj_t *obj);
+static void _chain_stats(qhnobj_t **slots, size_t range, qstats_t *stats);
+static void _counter_stats(qhashtbl_t *tbl, qstats_t *stats);
+static bool _chain_snapshot(qhnobj_t **slots, size_t range, qsnap_t *snap);
+static bool _chain_collect(qhnobj_t **slots, size_t range, qnobj_t **objs,
+                           size_t *num, size_t *max);
+static bool _collect(qnobj_t **objs, size_t *num, size_t *max, char *name,
+                     void *data, size_t size);
+
+// open-addressing engine
+static bool _flat_puthashed(qhashtbl_t *tbl, const char *name, size_t namelen,
+                            uint32_t hash, const void *data, size_t size);
+static void *_flat_gethashed(qhashtbl_t *tbl, const char *name,
+                             size_t namelen, uint32_t hash, size_t *size,
+                             bool newmem);
+static bool _flat_getnext(qhashtbl_t *tbl, qhnobj_t *obj, bool newmem);
+static bool _flat_iternext(qhashtbl_t *tbl, qiter_t *it);
+static bool _flat_removehashed(qhashtbl_t *tbl, const char *name,
+                               size_t namelen, uint32_t hash);
+static void _flat_clear(qhashtbl_t *tbl);
+static void _flat_free(qhashtbl_t *tbl);
+static bool _flat_stats(qhashtbl_t *tbl, qstats_t *stats);
+static qhashtbl_flatslot_t *_flat_find(qhashtbl_t *tbl, const char *name,
+                                       size_t keylen, uint32_t hash);
+static void _flat_place(qhashtbl_flatslot_t *slots, size_t range,
+                        qhashtbl_flatslot_t slot);
+static qhashtbl_flatslot_t *_flat_after(qhashtbl_t *tbl, size_t home,
+                                        bool resume, uint32_t hash,
+                                        size_t offset);
+static bool _flat_grow(qhashtbl_t *tbl);
+static bool _flat_reserve(qhashtbl_t *tbl, size_t reclen);
+
 #endif
 
 /**
@@ -136,6 +269,7 @@ static void free_(qhashtbl_t *tbl);
  *
  * @return a pointer of malloced qhashtbl_t, otherwise returns false
  * @retval errno will be set in error condition.
+ *  - EINVAL : Invalid combination of options.
  *  - ENOMEM : Memory allocation failure.
  *
  * @code
@@ -144,60 +278,155 @@ static void free_(qhashtbl_t *tbl);
  *
  *  // create a large hash-table for millions of keys with thread-safe option.
  *  qhashtbl_t *small_hashtbl = qHashtbl(1000000, QHASHTBL_THREADSAFE);
+ *
+ *  // create a hash-table which grows as keys are added.
+ *  qhashtbl_t *growing_hashtbl = qHashtbl(0, QHASHTBL_RESIZABLE);
+ *
+ *  // create an open-addressing hash-table for many small objects.
+ *  qhashtbl_t *flat_hashtbl = qHashtbl(0, QHASHTBL_OPENADDR);
+ *
+ *  // create a hash-table shared by many threads.
+ *  qhashtbl_t *shared_hashtbl = qHashtbl(100000, QHASHTBL_CONCURRENT);
  * @endcode
  *
  * @note
  *   Setting the right range is a magic.
  *   In practice, pick a value between (total keys / 3) ~ (total keys * 2).
+ *   If the number of keys is unknown, use QHASHTBL_RESIZABLE option then
+ *   the given range will be used as the initial and minimum range.
  *   Available options:
- *   - QHASHTBL_THREADSAFE - make it thread-safe.
+ *   - QHASHTBL_THREADSAFE - make it thread-safe. Lookups of a non-resizable
+ *     table share a reader/writer lock.
+ *   - QHASHTBL_RESIZABLE - resize the table automatically by load factor.
+ *   - QHASHTBL_OPENADDR - use open-addressing engine. The range will be
+ *     rounded up to a power of 2 and the table always grows as needed.
+ *     Pointers returned with newmem=false are valid only until the next
+ *     modification of the table. putref() is not supported. Keys can be
+ *     removed during getnext(), but not added.
+ *   - QHASHTBL_CONCURRENT - make it thread-safe with lock-striped rwlocks.
+ *     It can't be used with QHASHTBL_RESIZABLE or QHASHTBL_OPENADDR.
+ *     lock() and unlock() do nothing in this mode, and get() and getnext()
+ *     should be called with newmem=true.
+ *   - QHASHTBL_FASTHASH - hash keys with qhashxx32() instead of
+ *     qhashmurmur3_32(). Recommended for long keys.
+ *   - QHASHTBL_NODEPOOL - allocate objects from a pool instead of calling
+ *     malloc() for each key. Ignored with QHASHTBL_OPENADDR.
+ *
+ *   Short names and data, up to 48 bytes together, are stored inline right
+ *   after the object, so such a put() makes one allocation instead of three.
  */
 qhashtbl_t *qhashtbl(size_t range, int options) {
     if (range == 0) {
         range = DEFAULT_INDEX_RANGE;
     }
+    if ((options & QHASHTBL_CONCURRENT)
+            && (options & (QHASHTBL_RESIZABLE | QHASHTBL_OPENADDR))) {
+        errno = EINVAL;
+        return NULL;
+    }
 
-    qhashtbl_t *tbl = (qhashtbl_t *) calloc(1, sizeof(qhashtbl_t));
+    qhashtbl_t *tbl = (qhashtbl_t *) qlibc_calloc(1, sizeof(qhashtbl_t));
     if (tbl == NULL)
         goto malloc_failure;
 
     // allocate table space
-    tbl->slots = (qhnobj_t **) calloc(range, sizeof(qhnobj_t *));
-    if (tbl->slots == NULL)
-        goto malloc_failure;
+    if (options & QHASHTBL_OPENADDR) {
+        size_t flatrange = FLAT_MIN_RANGE;
+        while (flatrange < range)
+            flatrange *= 2;
+        range = flatrange;
+        tbl->flatslots = (qhashtbl_flatslot_t *) qlibc_calloc(
+                range, sizeof(qhashtbl_flatslot_t));
+        if (tbl->flatslots == NULL)
+            goto malloc_failure;
+    } else {
+        tbl->slots = (qhnobj_t **) qlibc_calloc(range, sizeof(qhnobj_t *));
+        if (tbl->slots == NULL)
+            goto malloc_failure;
+    }
 
     // handle options.
-    if (options & QHASHTBL_THREADSAFE) {
-        Q_MUTEX_NEW(tbl->qmutex, true);
+    if (options & QHASHTBL_CONCURRENT) {
+        tbl->nstripes = (range < CONCURRENT_STRIPES) ? range : CONCURRENT_STRIPES;
+        tbl->stripes = (pthread_rwlock_t *) qlibc_malloc(
+                tbl->nstripes * sizeof(pthread_rwlock_t));
+        if (tbl->stripes == NULL)
+            goto malloc_failure;
+        size_t i;
+        for (i = 0; i < tbl->nstripes; i++) {
+            pthread_rwlock_init(&tbl->stripes[i], NULL);
+        }
+    } else if (options & QHASHTBL_THREADSAFE) {
+        Q_RWLOCK_NEW(tbl->qmutex);
         if (tbl->qmutex == NULL)
             goto malloc_failure;
     }
+    if (options & QHASHTBL_RESIZABLE) {
+        tbl->resizable = true;
+    }
+    if ((options & QHASHTBL_NODEPOOL) && tbl->slots != NULL) {
+        // stripe locks don't protect the pool, so it needs its own.
+        tbl->pool = qpool(sizeof(qhnobj_t) + INLINE_MAX,
+                          (tbl->stripes != NULL) ? QPOOL_THREADSAFE : 0);
+        if (tbl->pool == NULL)
+            goto malloc_failure;
+    }
 
     // assign methods
     tbl->put = put;
     tbl->putstr = putstr;
     tbl->putstrf = putstrf;
     tbl->putint = putint;
+    tbl->putref = putref;
+    tbl->puthashed = puthashed;
+    tbl->putbatch = putbatch;
 
     tbl->get = get;
     tbl->getstr = getstr;
     tbl->getint = getint;
+    tbl->gethashed = gethashed;
+    tbl->getbatch = getbatch;
 
     tbl->getnext = getnext;
+    tbl->iterbegin = iterbegin;
+    tbl->iternext = iternext;
+    tbl->iterend = iterend;
 
     tbl->remove = remove_;
+    tbl->removehashed = removehashed;
+
+    tbl->hash = (options & QHASHTBL_FASTHASH) ? hashfast : hash_;
 
     tbl->size = size;
     tbl->clear = clear;
     tbl->debug = debug;
+    tbl->stats = stats;
+    tbl->snapshot = snapshot;
+    tbl->restore = restore;
+    tbl->freeze = freeze;
 
     tbl->lock = lock;
     tbl->unlock = unlock;
 
     tbl->free = free_;
 
+    if (tbl->stripes != NULL) {
+        tbl->getnext = _striped_getnext;
+    }
+    if (tbl->flatslots != NULL) {
+        tbl->puthashed = _flat_puthashed;
+        tbl->gethashed = _flat_gethashed;
+        tbl->getnext = _flat_getnext;
+        tbl->iternext = _flat_iternext;
+        tbl->removehashed = _flat_removehashed;
+        tbl->clear = _flat_clear;
+        tbl->free = _flat_free;
+        tbl->stats = _flat_stats;
+    }
+
     // set table range.
     tbl->range = range;
+    tbl->minrange = range;
 
     return tbl;
 
@@ -205,9 +434,13 @@ qhashtbl_t *qhashtbl(size_t range, int options) {
     errno = ENOMEM;
     if (tbl) {
         if (tbl->slots)
-            free(tbl->slots);
-        assert(tbl->qmutex == NULL);
-        free_(tbl);
+            qlibc_free(tbl->slots);
+        if (tbl->flatslots)
+            qlibc_free(tbl->flatslots);
+        if (tbl->stripes)
+            qlibc_free(tbl->stripes);
+        Q_MUTEX_DESTROY(tbl->qmutex);
+        qlibc_free(tbl);
     }
     return NULL;
 }
@@ -227,73 +460,14 @@ qhashtbl_t *qhashtbl(size_t range, int options) {
  */
 static bool put(qhashtbl_t *tbl, const char *name, const void *data,
                 size_t size) {
-    if (name == NULL || data == NULL) {
+    if (name == NULL) {
         errno = EINVAL;
         return false;
     }
 
-    // get hash integer
-    uint32_t hash = qhashmurmur3_32(name, strlen(name));
-    int idx = hash % tbl->range;
-
-    lock(tbl);
-
-    // find existence key
-    qhnobj_t *obj;
-    for (obj = tbl->slots[idx]; obj != NULL; obj = obj->next) {
-        if (obj->hash == hash && !strcmp(obj->name, name)) {
-            break;
-        }
-    }
-
-    // duplicate object
-    char *dupname = strdup(name);
-    void *dupdata = malloc(size);
-    if (dupname == NULL || dupdata == NULL) {
-        if (dupname != NULL)
-            free(dupname);
-        if (dupdata != NULL)
-            free(dupdata);
-        unlock(tbl);
-        errno = ENOMEM;
-        return false;
-    }
-    memcpy(dupdata, data, size);
-
-    // put into table
-    if (obj == NULL) {
-        // insert
-        obj = (qhnobj_t *) calloc(1, sizeof(qhnobj_t));
-        if (obj == NULL) {
-            free(dupname);
-            free(dupdata);
-            unlock(tbl);
-            errno = ENOMEM;
-            return false;
-        }
-
-        if (tbl->slots[idx] != NULL) {
-            // insert at the beginning
-            obj->next = tbl->slots[idx];
-        }
-        tbl->slots[idx] = obj;
-
-        // increase counter
-        tbl->num++;
-    } else {
-        // replace
-        free(obj->name);
-        free(obj->data);
-    }
-
-    // set data
-    obj->hash = hash;
-    obj->name = dupname;
-    obj->data = dupdata;
-    obj->size = size;
-
-    unlock(tbl);
-    return true;
+    size_t namelen = strlen(name);
+    return tbl->puthashed(tbl, name, namelen, tbl->hash(tbl, name, namelen), data,
+                          size);
 }
 
 /**
@@ -310,7 +484,7 @@ static bool put(qhashtbl_t *tbl, const char *name, const void *data,
  */
 static bool putstr(qhashtbl_t *tbl, const char *name, const char *str) {
     size_t size = (str != NULL) ? (strlen(str) + 1) : 0;
-    return put(tbl, name, str, size);
+    return tbl->put(tbl, name, str, size);
 }
 
 /**
@@ -334,7 +508,7 @@ static bool putstrf(qhashtbl_t *tbl, const char *name, const char *format, ...)
     }
 
     bool ret = putstr(tbl, name, str);
-    free(str);
+    qlibc_free(str);
     return ret;
 }
 
@@ -359,6 +533,136 @@ static bool putint(qhashtbl_t *tbl, const char *name, const int64_t num) {
     return putstr(tbl, name, str);
 }
 
+/**
+ * qhashtbl->putref(): Put a object into this table by reference.
+ *
+ * @param tbl       qhashtbl_t container pointer.
+ * @param name      key name
+ * @param data      data object
+ * @param size      size of data object
+ *
+ * @return true if successful, otherwise returns false
+ * @retval errno will be set in error condition.
+ *  - EINVAL : Invalid argument.
+ *  - ENOMEM : Memory allocation failure.
+ *  - ENOTSUP : Not supported in QHASHTBL_OPENADDR mode.
+ *
+ * @note
+ *  Unlike put(), the name and data are not copied. The table keeps the given
+ *  pointers and never frees them, so they should remain valid until the key
+ *  is removed or replaced, or the table is freed. get() with newmem=false
+ *  returns the data pointer as it was given.
+ *
+ * @code
+ *  struct session *sess = session_new(sessid);
+ *  tbl->putref(tbl, sess->id, sess, sizeof(struct session));
+ * @endcode
+ */
+static bool putref(qhashtbl_t *tbl, const char *name, void *data, size_t size) {
+    if (name == NULL || data == NULL) {
+        errno = EINVAL;
+        return false;
+    }
+    if (tbl->flatslots != NULL) {
+        errno = ENOTSUP;
+        return false;
+    }
+
+    size_t namelen = strlen(name);
+    return _put(tbl, name, namelen, tbl->hash(tbl, name, namelen), data, size,
+                true);
+}
+
+/**
+ * qhashtbl->puthashed(): Put a object into this table with precomputed
+ * hash value.
+ *
+ * @param tbl       qhashtbl_t container pointer.
+ * @param name      key name. doesn't need to be NULL terminated.
+ * @param namelen   length of key name.
+ * @param hash      hash value of the key computed by qhashtbl->hash().
+ * @param data      data object
+ * @param size      size of data object
+ *
+ * @return true if successful, otherwise returns false
+ * @retval errno will be set in error condition.
+ *  - EINVAL : Invalid argument.
+ *  - ENOMEM : Memory allocation failure.
+ *
+ * @code
+ *  // compute hash once and use it many times.
+ *  uint32_t hash = tbl->hash(tbl, "key", 3);
+ *  tbl->puthashed(tbl, "key", 3, hash, "value", 6);
+ *  char *value = tbl->gethashed(tbl, "key", 3, hash, NULL, false);
+ *  tbl->removehashed(tbl, "key", 3, hash);
+ * @endcode
+ *
+ * @note
+ *  The hash value must be computed by qhashtbl->hash() with same name and
+ *  namelen, otherwise the object will not be found later.
+ */
+static bool puthashed(qhashtbl_t *tbl, const char *name, size_t namelen,
+                      uint32_t hash, const void *data, size_t size) {
+    return _put(tbl, name, namelen, hash, data, size, false);
+}
+
+/**
+ * qhashtbl->putbatch(): Put multiple objects into this table at once.
+ *
+ * @param tbl       qhashtbl_t container pointer.
+ * @param objs      array of objects to put. name, data and size are used.
+ * @param num       number of objects in the array.
+ *
+ * @return the number of objects successfully stored.
+ * @retval errno will be set in error condition.
+ *  - EINVAL : Invalid argument.
+ *  - ENOMEM : Memory allocation failure.
+ *
+ * @code
+ *  qnobj_t objs[2] = {
+ *      { "key1", "value1", 7 },
+ *      { "key2", "value2", 7 }
+ *  };
+ *  size_t stored = tbl->putbatch(tbl, objs, 2);
+ * @endcode
+ *
+ * @note
+ *  The lock is taken once for the whole batch. Keys are hashed in groups and
+ *  the slots of a group are prefetched before the objects are stored, so the
+ *  memory latency of one lookup overlaps with the others.
+ */
+static size_t putbatch(qhashtbl_t *tbl, const qnobj_t *objs, size_t num) {
+    if (objs == NULL) {
+        errno = EINVAL;
+        return 0;
+    }
+
+    size_t numput = 0;
+    size_t namelens[BATCH_SIZE];
+    uint32_t hashes[BATCH_SIZE];
+
+    lock(tbl);
+    size_t i;
+    for (i = 0; i < num; i += BATCH_SIZE) {
+        size_t n = _hash_batch(tbl, &objs[i], num - i, namelens, hashes);
+        size_t j;
+        for (j = 0; j < n; j++) {
+            const qnobj_t *obj = &objs[i + j];
+            if (obj->name == NULL) {
+                errno = EINVAL;
+                continue;
+            }
+            if (tbl->puthashed(tbl, obj->name, namelens[j], hashes[j],
+                               obj->data, obj->size) == true) {
+                numput++;
+            }
+        }
+    }
+    unlock(tbl);
+
+    return numput;
+}
+
 /**
  * qhashtbl->get(): Get a object from this table.
  *
@@ -399,40 +703,9 @@ static void *get(qhashtbl_t *tbl, const char *name, size_t *size, bool newmem) {
         return NULL;
     }
 
-    uint32_t hash = qhashmurmur3_32(name, strlen(name));
-    int idx = hash % tbl->range;
-
-    lock(tbl);
-
-    // find key
-    qhnobj_t *obj;
-    for (obj = tbl->slots[idx]; obj != NULL; obj = obj->next) {
-        if (obj->hash == hash && !strcmp(obj->name, name)) {
-            break;
-        }
-    }
-
-    void *data = NULL;
-    if (obj != NULL) {
-        if (newmem == false) {
-            data = obj->data;
-        } else {
-            data = malloc(obj->size);
-            if (data == NULL) {
-                errno = ENOMEM;
-                return NULL;
-            }
-            memcpy(data, obj->data, obj->size);
-        }
-        if (size != NULL && data != NULL)
-            *size = obj->size;
-    }
-
-    unlock(tbl);
-
-    if (data == NULL)
-        errno = ENOENT;
-    return data;
+    size_t namelen = strlen(name);
+    return tbl->gethashed(tbl, name, namelen, tbl->hash(tbl, name, namelen), size,
+                          newmem);
 }
 
 /**
@@ -454,7 +727,7 @@ static void *get(qhashtbl_t *tbl, const char *name, size_t *size, bool newmem) {
  *  deallocated by user.
  */
 static char *getstr(qhashtbl_t *tbl, const char *name, const bool newmem) {
-    return get(tbl, name, NULL, newmem);
+    return tbl->get(tbl, name, NULL, newmem);
 }
 
 /**
@@ -475,12 +748,143 @@ static int64_t getint(qhashtbl_t *tbl, const char *name) {
     char *str = getstr(tbl, name, true);
     if (str != NULL) {
         num = atoll(str);
-        free(str);
+        qlibc_free(str);
     }
 
     return num;
 }
 
+/**
+ * qhashtbl->gethashed(): Get a object from this table with precomputed
+ * hash value.
+ *
+ * @param tbl       qhashtbl_t container pointer.
+ * @param name      key name. doesn't need to be NULL terminated.
+ * @param namelen   length of key name.
+ * @param hash      hash value of the key computed by qhashtbl->hash().
+ * @param size      if not NULL, oject size will be stored.
+ * @param newmem    whether or not to allocate memory for the data.
+ *
+ * @return a pointer of data if the key is found, otherwise returns NULL.
+ * @retval errno will be set in error condition.
+ *  - ENOENT : No such key found.
+ *  - EINVAL : Invalid argument.
+ *  - ENOMEM : Memory allocation failure.
+ *
+ * @note
+ *  Since the name doesn't need to be NULL terminated, a part of larger
+ *  buffer can be used as a key directly without making a copy.
+ */
+static void *gethashed(qhashtbl_t *tbl, const char *name, size_t namelen,
+                       uint32_t hash, size_t *size, bool newmem) {
+    if (name == NULL) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    _lock_shared(tbl);
+    _rehash_step(tbl, REHASH_STEP_SLOTS);
+    size_t idx = hash % tbl->range;
+    _stripe_lock(tbl, idx, false);
+
+    // find key
+    qhnobj_t *obj = _find_obj(tbl, name, namelen, hash, NULL);
+    if (obj != NULL)
+        Q_STATS_INC(tbl->gethits);
+    else
+        Q_STATS_INC(tbl->getmisses);
+
+    void *data = NULL;
+    if (obj != NULL) {
+        if (newmem == false) {
+            data = obj->data;
+        } else {
+            data = qlibc_malloc(obj->size);
+            if (data == NULL) {
+                _stripe_unlock(tbl, idx);
+                unlock(tbl);
+                errno = ENOMEM;
+                return NULL;
+            }
+            memcpy(data, obj->data, obj->size);
+        }
+        if (size != NULL && data != NULL)
+            *size = obj->size;
+    }
+
+    _stripe_unlock(tbl, idx);
+    unlock(tbl);
+
+    if (data == NULL)
+        errno = ENOENT;
+    return data;
+}
+
+/**
+ * qhashtbl->getbatch(): Get multiple objects from this table at once.
+ *
+ * @param tbl       qhashtbl_t container pointer.
+ * @param objs      array of objects. name should be set by user, then data
+ *                  and size will be stored. data will be set to NULL if the
+ *                  key is not found.
+ * @param num       number of objects in the array.
+ * @param newmem    whether or not to allocate memory for the data.
+ *
+ * @return the number of keys found.
+ * @retval errno will be set in error condition.
+ *  - ENOENT : Some of keys are not found.
+ *  - EINVAL : Invalid argument.
+ *  - ENOMEM : Memory allocation failure.
+ *
+ * @code
+ *  qnobj_t objs[2];
+ *  memset((void *)objs, 0, sizeof(objs));
+ *  objs[0].name = "key1";
+ *  objs[1].name = "key2";
+ *  if (tbl->getbatch(tbl, objs, 2, false) == 2) {
+ *      printf("%s, %s\n", (char *)objs[0].data, (char *)objs[1].data);
+ *  }
+ * @endcode
+ *
+ * @note
+ *  The lock is taken once for the whole batch, like putbatch(). If newmem
+ *  flag is set, each data found should be deallocated by user.
+ */
+static size_t getbatch(qhashtbl_t *tbl, qnobj_t *objs, size_t num,
+                       bool newmem) {
+    if (objs == NULL) {
+        errno = EINVAL;
+        return 0;
+    }
+
+    size_t numfound = 0;
+    size_t namelens[BATCH_SIZE];
+    uint32_t hashes[BATCH_SIZE];
+
+    _lock_shared(tbl);
+    size_t i;
+    for (i = 0; i < num; i += BATCH_SIZE) {
+        size_t n = _hash_batch(tbl, &objs[i], num - i, namelens, hashes);
+        size_t j;
+        for (j = 0; j < n; j++) {
+            qnobj_t *obj = &objs[i + j];
+            obj->data = NULL;
+            obj->size = 0;
+            if (obj->name == NULL)
+                continue;
+            obj->data = tbl->gethashed(tbl, obj->name, namelens[j], hashes[j],
+                                       &obj->size, newmem);
+            if (obj->data != NULL)
+                numfound++;
+        }
+    }
+    unlock(tbl);
+
+    if (numfound < num)
+        errno = ENOENT;
+    return numfound;
+}
+
 /**
  * qhashtbl->getnext(): Get next element.
  *
@@ -525,6 +929,13 @@ static int64_t getint(qhashtbl_t *tbl, const char *name) {
  *  obj should be initialized with 0 by using memset() before first call.
  *  If newmem flag is true, user should de-allocate obj.name and obj.data
  *  resources.
+ *
+ * @note
+ *  In QHASHTBL_RESIZABLE mode, the first call of traversal finishes any
+ *  pending migration so the traversal sees a single slot array, and
+ *  remove() doesn't shrink the table until the traversal reaches the end.
+ *  Removing the last returned key is safe, but the table should not be
+ *  modified otherwise until the traversal is over.
  */
 static bool getnext(qhashtbl_t *tbl, qhnobj_t *obj, const bool newmem) {
     if (obj == NULL) {
@@ -537,8 +948,12 @@ static bool getnext(qhashtbl_t *tbl, qhnobj_t *obj, const bool newmem) {
     bool found = false;
 
     qhnobj_t *cursor = NULL;
-    int idx = 0;
-    if (obj->name != NULL) {
+    size_t idx = 0;
+    if (obj->name == NULL) {
+        // finish pending migration before starting traversal
+        _rehash_step(tbl, tbl->oldrange);
+        tbl->traversing = tbl->resizable;
+    } else {
         idx = (obj->hash % tbl->range) + 1;
         cursor = obj->next;
     }
@@ -559,14 +974,14 @@ static bool getnext(qhashtbl_t *tbl, qhnobj_t *obj, const bool newmem) {
 
     if (cursor != NULL) {
         if (newmem == true) {
-            obj->name = strdup(cursor->name);
-            obj->data = malloc(cursor->size);
+            obj->name = qlibc_strdup(cursor->name);
+            obj->data = qlibc_malloc(cursor->size);
             if (obj->name == NULL || obj->data == NULL) {
                 DEBUG("getnext(): Unable to allocate memory.");
                 if (obj->name != NULL)
-                    free(obj->name);
+                    qlibc_free(obj->name);
                 if (obj->data != NULL)
-                    free(obj->data);
+                    qlibc_free(obj->data);
                 unlock(tbl);
                 errno = ENOMEM;
                 return false;
@@ -581,6 +996,10 @@ static bool getnext(qhashtbl_t *tbl, qhnobj_t *obj, const bool newmem) {
         obj->size = cursor->size;
         obj->next = cursor->next;
 
+    } else if (tbl->traversing == true) {
+        // shrink if remove() has deferred it.
+        tbl->traversing = false;
+        _check_resize(tbl);
     }
 
     unlock(tbl);
@@ -592,52 +1011,158 @@ static bool getnext(qhashtbl_t *tbl, qhnobj_t *obj, const bool newmem) {
 }
 
 /**
- * qhashtbl->remove(): Remove an object from this table.
+ * qhashtbl->iterbegin(): Start traversal without copying elements.
  *
  * @param tbl   qhashtbl_t container pointer.
- * @param name  key name
+ * @param it    iterator to initialize.
  *
- * @return true if successful, otherwise(not found) returns false
- * @retval errno will be set in error condition.
- *  - ENOENT : No next element.
- *  - EINVAL : Invalid argument.
+ * @code
+ *  qiter_t it;
+ *  tbl->iterbegin(tbl, &it);
+ *  while (tbl->iternext(tbl, &it) == true) {
+ *    printf("NAME=%.*s, SIZE=%zu\n", (int) it.namelen, it.name, it.size);
+ *  }
+ *  tbl->iterend(tbl, &it);
+ * @endcode
+ *
+ * @note
+ *  The table is locked for reading until iterend(), so other threads can
+ *  still look up keys but writers wait. In QHASHTBL_CONCURRENT mode, all
+ *  slot locks are held. The table must not be modified by the iterating
+ *  thread and iterend() must always be called.
  */
-static bool remove_(qhashtbl_t *tbl, const char *name) {
-    if (name == NULL) {
-        errno = EINVAL;
-        return false;
+static void iterbegin(qhashtbl_t *tbl, qiter_t *it) {
+    memset((void *) it, 0, sizeof(qiter_t));
+
+    // writers take a single slot lock, so taking them in order can't
+    // deadlock. the lock of a resizable table is exclusive, so pending
+    // migration can be finished here.
+    _lock_shared(tbl);
+    if (tbl->oldslots != NULL)
+        _rehash_step(tbl, tbl->oldrange);
+    size_t idx;
+    for (idx = 0; idx < tbl->nstripes; idx++) {
+        _stripe_lock(tbl, idx, false);
     }
+}
 
-    lock(tbl);
+/**
+ * qhashtbl->iternext(): Get next element between iterbegin() and iterend().
+ *
+ * @param tbl   qhashtbl_t container pointer.
+ * @param it    iterator started by iterbegin().
+ *
+ * @return true if found otherwise returns false
+ * @retval errno will be set in error condition.
+ *  - ENOENT : No next element.
+ *
+ * @note
+ *  it.name, it.namelen, it.data and it.size point into the table, nothing
+ *  is allocated.
+ */
+static bool iternext(qhashtbl_t *tbl, qiter_t *it) {
+    qhnobj_t *obj = (it->cursor != NULL) ? ((qhnobj_t *) it->cursor)->next
+                                         : NULL;
+    while (obj == NULL && it->idx < tbl->range) {
+        obj = tbl->slots[it->idx++];
+    }
+    if (obj == NULL) {
+        errno = ENOENT;
+        return false;
+    }
+
+    it->cursor = obj;
+    it->name = obj->name;
+    it->namelen = strlen(obj->name);
+    it->data = obj->data;
+    it->size = obj->size;
+    return true;
+}
+
+/**
+ * qhashtbl->iterend(): Finish traversal started by iterbegin().
+ *
+ * @param tbl   qhashtbl_t container pointer.
+ * @param it    iterator started by iterbegin().
+ */
+static void iterend(qhashtbl_t *tbl, qiter_t *it) {
+    size_t idx;
+    for (idx = 0; idx < tbl->nstripes; idx++) {
+        _stripe_unlock(tbl, idx);
+    }
+    unlock(tbl);
+    it->cursor = NULL;
+}
+
+/**
+ * qhashtbl->remove(): Remove an object from this table.
+ *
+ * @param tbl   qhashtbl_t container pointer.
+ * @param name  key name
+ *
+ * @return true if successful, otherwise(not found) returns false
+ * @retval errno will be set in error condition.
+ *  - ENOENT : No next element.
+ *  - EINVAL : Invalid argument.
+ */
+static bool remove_(qhashtbl_t *tbl, const char *name) {
+    if (name == NULL) {
+        errno = EINVAL;
+        return false;
+    }
+
+    size_t namelen = strlen(name);
+    return tbl->removehashed(tbl, name, namelen, tbl->hash(tbl, name, namelen));
+}
+
+/**
+ * qhashtbl->removehashed(): Remove an object from this table with
+ * precomputed hash value.
+ *
+ * @param tbl       qhashtbl_t container pointer.
+ * @param name      key name. doesn't need to be NULL terminated.
+ * @param namelen   length of key name.
+ * @param hash      hash value of the key computed by qhashtbl->hash().
+ *
+ * @return true if successful, otherwise(not found) returns false
+ * @retval errno will be set in error condition.
+ *  - ENOENT : No next element.
+ *  - EINVAL : Invalid argument.
+ */
+static bool removehashed(qhashtbl_t *tbl, const char *name, size_t namelen,
+                         uint32_t hash) {
+    if (name == NULL) {
+        errno = EINVAL;
+        return false;
+    }
 
-    uint32_t hash = qhashmurmur3_32(name, strlen(name));
-    int idx = hash % tbl->range;
+    lock(tbl);
+    // getnext() finds the next key by its slot index, which a migration
+    // would move.
+    if (tbl->traversing == false)
+        _rehash_step(tbl, REHASH_STEP_SLOTS);
+    size_t idx = hash % tbl->range;
+    _stripe_lock(tbl, idx, true);
 
     // find key
     bool found = false;
-    qhnobj_t *prev = NULL;
-    qhnobj_t *obj;
-    for (obj = tbl->slots[idx]; obj != NULL; obj = obj->next) {
-        if (obj->hash == hash && !strcmp(obj->name, name)) {
-            // adjust link
-            if (prev == NULL)
-                tbl->slots[idx] = obj->next;
-            else
-                prev->next = obj->next;
-
-            // remove
-            free(obj->name);
-            free(obj->data);
-            free(obj);
-
-            found = true;
-            tbl->num--;
-            break;
-        }
+    qhnobj_t **link;
+    qhnobj_t *obj = _find_obj(tbl, name, namelen, hash, &link);
+    if (obj != NULL) {
+        // adjust link
+        *link = obj->next;
+
+        // remove
+        _release_obj(obj);
+        _free_obj(tbl, obj);
 
-        prev = obj;
+        found = true;
+        _add_num(tbl, -1);
+        if (tbl->traversing == false)
+            _check_resize(tbl);
     }
 
+    _stripe_unlock(tbl, idx);
     unlock(tbl);
 
     if (found == false)
@@ -646,6 +1171,33 @@ static bool remove_(qhashtbl_t *tbl, const char *name) {
     return found;
 }
 
+/**
+ * qhashtbl->hash(): Compute the hash value of a key for puthashed(),
+ * gethashed() and removehashed().
+ *
+ * @param tbl       qhashtbl_t container pointer.
+ * @param name      key name. doesn't need to be NULL terminated.
+ * @param namelen   length of key name.
+ *
+ * @return 32-bit hash value.
+ */
+static uint32_t hash_(qhashtbl_t *tbl, const char *name, size_t namelen) {
+    return qhashmurmur3_32(name, namelen);
+}
+
+/**
+ * qhashtbl->hash(): Hash function used with QHASHTBL_FASTHASH option.
+ *
+ * @param tbl       qhashtbl_t container pointer.
+ * @param name      key name. doesn't need to be NULL terminated.
+ * @param namelen   length of key name.
+ *
+ * @return 32-bit hash value.
+ */
+static uint32_t hashfast(qhashtbl_t *tbl, const char *name, size_t namelen) {
+    return qhashxx32(name, namelen);
+}
+
 /**
  * qhashtbl->size(): Returns the number of keys in this hashtable.
  *
@@ -664,20 +1216,23 @@ static size_t size(qhashtbl_t *tbl) {
  */
 void clear(qhashtbl_t *tbl) {
     lock(tbl);
-    int idx;
+    // finish pending migration then clear a single slot array
+    _rehash_step(tbl, tbl->oldrange);
+    size_t idx;
     for (idx = 0; idx < tbl->range && tbl->num > 0; idx++) {
         if (tbl->slots[idx] == NULL)
             continue;
+        _stripe_lock(tbl, idx, true);
         qhnobj_t *obj = tbl->slots[idx];
         tbl->slots[idx] = NULL;
+        _stripe_unlock(tbl, idx);
         while (obj != NULL) {
             qhnobj_t *next = obj->next;
-            free(obj->name);
-            free(obj->data);
-            free(obj);
+            _release_obj(obj);
+            _free_obj(tbl, obj);
             obj = next;
 
-            tbl->num--;
+            _add_num(tbl, -1);
         }
     }
 
@@ -713,6 +1268,250 @@ bool debug(qhashtbl_t *tbl, FILE *out) {
     return true;
 }
 
+/**
+ * qhashtbl->stats(): Get statistics of this table.
+ *
+ * @param tbl   qhashtbl_t container pointer.
+ * @param stats statistics will be stored here.
+ *
+ * @return true if successful, otherwise returns false.
+ * @retval errno will be set in error condition.
+ *  - EINVAL : Invalid argument.
+ *
+ * @code
+ *  qstats_t stats;
+ *  tbl->stats(tbl, &stats);
+ *  printf("load=%.2f, maxchain=%zu, collisions=%zu\n",
+ *         stats.loadfactor, stats.maxchain, stats.collisions);
+ * @endcode
+ *
+ * @note
+ *  Every slot is visited, so the cost is proportional to the range. In
+ *  QHASHTBL_OPENADDR mode, maxchain is the longest probe distance and
+ *  overhead includes the unused and garbage bytes of the arena. Lock wait
+ *  time includes the slot locks in QHASHTBL_CONCURRENT mode.
+ */
+static bool stats(qhashtbl_t *tbl, qstats_t *stats) {
+    if (stats == NULL) {
+        errno = EINVAL;
+        return false;
+    }
+    memset((void *) stats, 0, sizeof(qstats_t));
+
+    lock(tbl);
+    if (tbl->stripes != NULL) {
+        size_t idx;
+        for (idx = 0; idx < tbl->range; idx++) {
+            _stripe_lock(tbl, idx, false);
+            _chain_stats(&tbl->slots[idx], 1, stats);
+            _stripe_unlock(tbl, idx);
+        }
+    } else {
+        _chain_stats(tbl->slots, tbl->range, stats);
+        if (tbl->oldslots != NULL)
+            _chain_stats(tbl->oldslots, tbl->oldrange, stats);
+    }
+    stats->num = __atomic_load_n(&tbl->num, __ATOMIC_RELAXED);
+    stats->slots = tbl->range;
+    stats->loadfactor = (double) stats->num / tbl->range;
+    stats->overhead = sizeof(qhashtbl_t)
+            + (tbl->range + tbl->oldrange) * sizeof(qhnobj_t *)
+            + stats->num * sizeof(qhnobj_t)
+            + tbl->nstripes * sizeof(pthread_rwlock_t);
+    unlock(tbl);
+
+    _counter_stats(tbl, stats);
+    return true;
+}
+
+/**
+ * qhashtbl->snapshot(): Save this table to a binary snapshot file.
+ *
+ * Each key is saved with its hash value, so restore() puts the keys back
+ * without hashing them again. The snapshot is written to a temporary file
+ * and renamed to filepath, so an existing snapshot is replaced at once.
+ *
+ * @param tbl       qhashtbl_t container pointer.
+ * @param filepath  snapshot file path.
+ *
+ * @return true if successful, otherwise returns false.
+ * @retval errno will be set in error condition.
+ *  - EINVAL : Invalid argument.
+ *  - ENOMEM : Memory allocation failure.
+ *  - Others : errors from open() and write().
+ *
+ * @code
+ *  tbl->snapshot(tbl, "/tmp/table.snap");
+ *
+ *  // later, possibly in another process.
+ *  qhashtbl_t *tbl2 = qhashtbl(0, QHASHTBL_RESIZABLE);
+ *  ssize_t num = tbl2->restore(tbl2, "/tmp/table.snap");
+ * @endcode
+ *
+ * @note
+ *  The table is locked while it's being written. The file is in host byte
+ *  order and not meant to be moved between machines.
+ */
+static bool snapshot(qhashtbl_t *tbl, const char *filepath) {
+    qsnap_t *snap = _q_snap_create(filepath, Q_SNAP_QHASHTBL,
+            (tbl->hash == hashfast) ? QHASHTBL_FASTHASH : 0);
+    if (snap == NULL)
+        return false;
+
+    bool ok = true;
+    if (tbl->flatslots != NULL) {
+        _lock_shared(tbl);
+        size_t idx;
+        for (idx = 0; ok == true && idx < tbl->range; idx++) {
+            qhashtbl_flatslot_t *slot = &tbl->flatslots[idx];
+            if (slot->dist == 0)
+                continue;
+            ok = _q_snap_write(snap, slot->hash, FLAT_REC_NAME(tbl, slot),
+                               slot->keylen, FLAT_REC_DATA(tbl, slot),
+                               FLAT_REC_SIZE(tbl, slot));
+        }
+        unlock(tbl);
+    } else {
+        lock(tbl);
+        if (tbl->stripes != NULL) {
+            size_t idx;
+            for (idx = 0; ok == true && idx < tbl->range; idx++) {
+                _stripe_lock(tbl, idx, false);
+                ok = _chain_snapshot(&tbl->slots[idx], 1, snap);
+                _stripe_unlock(tbl, idx);
+            }
+        } else {
+            ok = _chain_snapshot(tbl->slots, tbl->range, snap);
+            if (ok == true && tbl->oldslots != NULL)
+                ok = _chain_snapshot(tbl->oldslots, tbl->oldrange, snap);
+        }
+        unlock(tbl);
+    }
+
+    if (ok == false) {
+        _q_snap_abort(snap);
+        return false;
+    }
+    return _q_snap_commit(snap);
+}
+
+/**
+ * qhashtbl->restore(): Load keys from a snapshot file made by snapshot().
+ *
+ * The file is mapped and the keys are put in a single pass using the saved
+ * hash values. Keys already in this table are replaced. An empty resizable
+ * table is resized once up front instead of growing step by step.
+ *
+ * @param tbl       qhashtbl_t container pointer.
+ * @param filepath  snapshot file path.
+ *
+ * @return the number of loaded keys, otherwise returns -1.
+ * @retval errno will be set in error condition.
+ *  - EINVAL  : Invalid argument.
+ *  - EBADMSG : Not a qhashtbl snapshot or checksum mismatch.
+ *  - ENOMEM  : Memory allocation failure.
+ *
+ * @note
+ *  Keys are hashed again only when the snapshot was taken from a table
+ *  with a different QHASHTBL_FASTHASH setting. If an error occurs in the
+ *  middle, the keys loaded so far are left in the table.
+ */
+static ssize_t restore(qhashtbl_t *tbl, const char *filepath) {
+    uint32_t flags = 0;
+    size_t num = 0;
+    qsnap_t *snap = _q_snap_open(filepath, Q_SNAP_QHASHTBL, &flags, &num);
+    if (snap == NULL)
+        return -1;
+    bool rehash = (((flags & QHASHTBL_FASTHASH) != 0)
+            != (tbl->hash == hashfast));
+
+    lock(tbl);
+    if (tbl->resizable == true && tbl->slots != NULL && tbl->num == 0
+            && num > tbl->range) {
+        _resize(tbl, num);
+    }
+
+    ssize_t cnt = 0;
+    qsnap_rec_t rec;
+    while (_q_snap_read(snap, &rec) == true) {
+        uint32_t hash = (rehash == true)
+                ? tbl->hash(tbl, rec.name, rec.namelen) : rec.hash;
+        if (tbl->puthashed(tbl, rec.name, rec.namelen, hash, rec.data,
+                           rec.size) == false) {
+            break;
+        }
+        cnt++;
+    }
+    unlock(tbl);
+    _q_snap_close(snap);
+
+    return (cnt == (ssize_t) num) ? cnt : -1;
+}
+
+/**
+ * qhashtbl->freeze(): Make an immutable perfect-hash copy of this table.
+ *
+ * The copy is a qfrozentbl in a single allocation. Lookups on it compare
+ * a single slot and it's usually a few times smaller than this table.
+ *
+ * @param tbl       qhashtbl_t container pointer.
+ *
+ * @return a pointer of malloced qfrozentbl_t in case of successful,
+ *         otherwise returns NULL.
+ * @retval errno will be set in error condition.
+ *  - ENOMEM  : Memory allocation failure.
+ *  - EDEADLK : No perfect hash function found, practically never.
+ *
+ * @code
+ *  qfrozentbl_t *frozen = tbl->freeze(tbl);
+ *  tbl->free(tbl);
+ *  char *value = frozen->getstr(frozen, "key", false);
+ * @endcode
+ *
+ * @note
+ *  The table is locked while it's being copied and isn't changed.
+ */
+static qfrozentbl_t *freeze(qhashtbl_t *tbl) {
+    qnobj_t *objs = NULL;
+    size_t num = 0, max = 0;
+    bool ok = true;
+    if (tbl->flatslots != NULL) {
+        _lock_shared(tbl);
+        size_t idx;
+        for (idx = 0; ok == true && idx < tbl->range; idx++) {
+            qhashtbl_flatslot_t *slot = &tbl->flatslots[idx];
+            if (slot->dist == 0)
+                continue;
+            ok = _collect(&objs, &num, &max, FLAT_REC_NAME(tbl, slot),
+                          FLAT_REC_DATA(tbl, slot), FLAT_REC_SIZE(tbl, slot));
+        }
+    } else {
+        // hold all slot locks until the records are copied. writers take
+        // a single slot lock, so taking them in order can't deadlock.
+        lock(tbl);
+        size_t idx;
+        for (idx = 0; idx < tbl->nstripes; idx++) {
+            _stripe_lock(tbl, idx, false);
+        }
+        ok = _chain_collect(tbl->slots, tbl->range, &objs, &num, &max);
+        if (ok == true && tbl->oldslots != NULL)
+            ok = _chain_collect(tbl->oldslots, tbl->oldrange, &objs, &num,
+                                &max);
+    }
+
+    qfrozentbl_t *frozen = NULL;
+    if (ok == true)
+        frozen = qfrozentbl(objs, num, 0);
+    size_t idx;
+    for (idx = 0; idx < tbl->nstripes; idx++) {
+        _stripe_unlock(tbl, idx);
+    }
+    unlock(tbl);
+    qlibc_free(objs);
+
+    return frozen;
+}
+
 /**
  * qhashtbl->lock(): Enter critical section.
  *
@@ -752,8 +1551,984 @@ void free_(qhashtbl_t *tbl) {
     lock(tbl);
     clear(tbl);
     if (tbl->slots != NULL)
-        free(tbl->slots);
+        qlibc_free(tbl->slots);
+    if (tbl->oldslots != NULL)
+        qlibc_free(tbl->oldslots);
     unlock(tbl);
+    if (tbl->stripes != NULL) {
+        size_t i;
+        for (i = 0; i < tbl->nstripes; i++) {
+            pthread_rwlock_destroy(&tbl->stripes[i]);
+        }
+        qlibc_free(tbl->stripes);
+    }
+    if (tbl->pool != NULL)
+        tbl->pool->free(tbl->pool);
     Q_MUTEX_DESTROY(tbl->qmutex);
-    free(tbl);
+    qlibc_free(tbl);
+}
+
+#ifndef _DOXYGEN_SKIP
+
+static bool _put(qhashtbl_t *tbl, const char *name, size_t namelen,
+                 uint32_t hash, const void *data, size_t size, bool isref) {
+    if (name == NULL || data == NULL) {
+        errno = EINVAL;
+        return false;
+    }
+
+    // duplicate object unless it fits in the object itself
+    char *dupname = (char *) name;
+    void *dupdata = (void *) data;
+    size_t inlsize = 0;
+    if (isref == false && INLINE_LEN(namelen, size) <= INLINE_MAX) {
+        inlsize = INLINE_LEN(namelen, size);
+    } else if (isref == false) {
+        dupname = (char *) qlibc_malloc(namelen + 1);
+        dupdata = qlibc_malloc(size);
+        if (dupname == NULL || dupdata == NULL) {
+            if (dupname != NULL)
+                qlibc_free(dupname);
+            if (dupdata != NULL)
+                qlibc_free(dupdata);
+            errno = ENOMEM;
+            return false;
+        }
+        memcpy(dupname, name, namelen);
+        dupname[namelen] = '\0';
+        memcpy(dupdata, data, size);
+    }
+
+    lock(tbl);
+    _rehash_step(tbl, REHASH_STEP_SLOTS);
+    size_t idx = hash % tbl->range;
+    _stripe_lock(tbl, idx, true);
+
+    // find existence key
+    qhnobj_t **link;
+    qhnobj_t *obj = _find_obj(tbl, name, namelen, hash, &link);
+    qhnobj_t *oldobj = NULL;
+    bool inserted = false;
+
+    // put into table
+    if (obj != NULL && obj->inlsize >= inlsize) {
+        // replace in place
+        Q_STATS_INC(tbl->puthits);
+        _release_obj(obj);
+    } else {
+        qhnobj_t *newobj = _new_obj(tbl, inlsize);
+        if (newobj == NULL) {
+            if (inlsize == 0 && isref == false) {
+                qlibc_free(dupname);
+                qlibc_free(dupdata);
+            }
+            _stripe_unlock(tbl, idx);
+            unlock(tbl);
+            errno = ENOMEM;
+            return false;
+        }
+
+        if (obj != NULL) {
+            // replace with a bigger object
+            Q_STATS_INC(tbl->puthits);
+            newobj->next = obj->next;
+            *link = newobj;
+            oldobj = obj;
+        } else {
+            // insert at the beginning
+            Q_STATS_INC(tbl->putmisses);
+            newobj->next = tbl->slots[idx];
+            tbl->slots[idx] = newobj;
+            inserted = true;
+        }
+        obj = newobj;
+    }
+
+    // set data, name and data may point into the object being replaced
+    if (inlsize > 0) {
+        dupname = INLINE_NAME(obj);
+        dupdata = dupname + INLINE_ALIGN(namelen + 1);
+        memmove(dupname, name, namelen);
+        dupname[namelen] = '\0';
+        memmove(dupdata, data, size);
+    }
+    obj->hash = hash;
+    obj->name = dupname;
+    obj->data = dupdata;
+    obj->size = size;
+    obj->isref = isref;
+
+    if (oldobj != NULL) {
+        _release_obj(oldobj);
+        _free_obj(tbl, oldobj);
+    } else if (inserted == true) {
+        // increase counter. a traversal can't go on after adding keys, so
+        // one left unfinished stops deferring the shrink.
+        _add_num(tbl, 1);
+        if (tbl->traversing == true)
+            tbl->traversing = false;
+        _check_resize(tbl);
+    }
+
+    _stripe_unlock(tbl, idx);
+    unlock(tbl);
+    return true;
+}
+
+/**
+ * Hash up to BATCH_SIZE keys and prefetch the slots they fall into.
+ * Returns the number of keys hashed. Lock must be obtained from caller.
+ */
+static size_t _hash_batch(qhashtbl_t *tbl, const qnobj_t *objs, size_t num,
+                          size_t *namelens, uint32_t *hashes) {
+    size_t n = (num < BATCH_SIZE) ? num : BATCH_SIZE;
+    size_t i;
+    for (i = 0; i < n; i++) {
+        if (objs[i].name == NULL)
+            continue;
+        namelens[i] = strlen(objs[i].name);
+        hashes[i] = tbl->hash(tbl, objs[i].name, namelens[i]);
+        if (tbl->flatslots != NULL) {
+            Q_PREFETCH(&tbl->flatslots[hashes[i] & (tbl->range - 1)]);
+        } else {
+            Q_PREFETCH(&tbl->slots[hashes[i] % tbl->range]);
+        }
+    }
+
+    // second pass, the slot pointers are likely in cache by now.
+    if (tbl->slots != NULL && tbl->stripes == NULL) {
+        for (i = 0; i < n; i++) {
+            if (objs[i].name != NULL)
+                Q_PREFETCH(tbl->slots[hashes[i] % tbl->range]);
+        }
+    }
+
+    return n;
+}
+
+/**
+ * Find an object by name. If link is not NULL, the address of the pointer
+ * which points the object will be stored for unlinking.
+ */
+static qhnobj_t *_find_obj(qhashtbl_t *tbl, const char *name, size_t namelen,
+                           uint32_t hash, qhnobj_t ***link) {
+    qhnobj_t **slots = tbl->slots;
+    size_t range = tbl->range;
+    int pass;
+    for (pass = 0; pass < 2; pass++) {
+        qhnobj_t **prevp = &slots[hash % range];
+        qhnobj_t *obj;
+        for (obj = *prevp; obj != NULL; prevp = &obj->next, obj = obj->next) {
+            if (obj->hash == hash && !strncmp(obj->name, name, namelen)
+                    && obj->name[namelen] == '\0') {
+                if (link != NULL)
+                    *link = prevp;
+                return obj;
+            }
+        }
+
+        // not yet migrated objects are still in the old slots.
+        if (tbl->oldslots == NULL)
+            break;
+        slots = tbl->oldslots;
+        range = tbl->oldrange;
+    }
+
+    return NULL;
 }
+
+/**
+ * Allocate new slots and start migration. Objects will be moved to the new
+ * slots gradually by _rehash_step().
+ */
+static bool _resize(qhashtbl_t *tbl, size_t newrange) {
+    if (tbl->oldslots != NULL || newrange == tbl->range)
+        return false;
+
+    qhnobj_t **newslots = (qhnobj_t **) qlibc_calloc(newrange, sizeof(qhnobj_t *));
+    if (newslots == NULL)
+        return false;
+
+    DEBUG("resize hash range from %zu to %zu", tbl->range, newrange);
+    tbl->oldslots = tbl->slots;
+    tbl->oldrange = tbl->range;
+    tbl->rehashidx = 0;
+    tbl->slots = newslots;
+    tbl->range = newrange;
+
+    // empty table doesn't need gradual migration.
+    if (tbl->num == 0)
+        _rehash_step(tbl, tbl->oldrange);
+
+    return true;
+}
+
+/**
+ * Start resizing if the load factor is out of the range.
+ */
+static void _check_resize(qhashtbl_t *tbl) {
+    if (tbl->resizable == false || tbl->oldslots != NULL)
+        return;
+
+    if (tbl->num > tbl->range * RESIZE_GROW_LOAD) {
+        _resize(tbl, tbl->range * 2);
+    } else if (tbl->range > tbl->minrange
+            && tbl->num < tbl->range / RESIZE_SHRINK_LOAD) {
+        size_t newrange = tbl->range / 2;
+        if (newrange < tbl->minrange)
+            newrange = tbl->minrange;
+        _resize(tbl, newrange);
+    }
+}
+
+/**
+ * Migrate objects in next nslots old slots into the current slots.
+ * Migration ends when all the old slots become empty.
+ */
+static void _rehash_step(qhashtbl_t *tbl, size_t nslots) {
+    if (tbl->oldslots == NULL)
+        return;
+
+    for (; nslots > 0 && tbl->rehashidx < tbl->oldrange;
+            nslots--, tbl->rehashidx++) {
+        qhnobj_t *obj = tbl->oldslots[tbl->rehashidx];
+        tbl->oldslots[tbl->rehashidx] = NULL;
+        while (obj != NULL) {
+            qhnobj_t *next = obj->next;
+            size_t idx = obj->hash % tbl->range;
+            obj->next = tbl->slots[idx];
+            tbl->slots[idx] = obj;
+            obj = next;
+        }
+    }
+
+    if (tbl->rehashidx >= tbl->oldrange) {
+        qlibc_free(tbl->oldslots);
+        tbl->oldslots = NULL;
+        tbl->oldrange = 0;
+        tbl->rehashidx = 0;
+    }
+}
+
+/**
+ * Compare two objects of a slot in the order _striped_getnext() returns
+ * them, by hash and then by address.
+ */
+static int _striped_cmp(uint32_t hash1, const void *obj1, uint32_t hash2,
+                        const void *obj2) {
+    if (hash1 != hash2)
+        return (hash1 < hash2) ? -1 : 1;
+    if (obj1 != obj2)
+        return ((uintptr_t) obj1 < (uintptr_t) obj2) ? -1 : 1;
+    return 0;
+}
+
+/**
+ * Find the first object of a chain after the position (hash, last) in
+ * _striped_cmp() order, or the first one of all if last is NULL.
+ */
+static qhnobj_t *_striped_after(qhnobj_t *chain, uint32_t hash,
+                                const void *last) {
+    qhnobj_t *found = NULL;
+    for (; chain != NULL; chain = chain->next) {
+        if (last != NULL && _striped_cmp(chain->hash, chain, hash, last) <= 0)
+            continue;
+        if (found == NULL
+                || _striped_cmp(chain->hash, chain, found->hash, found) < 0)
+            found = chain;
+    }
+    return found;
+}
+
+/**
+ * getnext() of QHASHTBL_CONCURRENT mode. Only the slot being read is locked,
+ * so the traversal can run alongside writes to other slots. Objects of a
+ * slot are returned in the order of hash and address, and the traversal
+ * resumes from the saved position (obj->hash, obj->next) in that order.
+ * obj->next is only compared, never dereferenced, and obj->name isn't used
+ * since it may be freed by then. So removing the last returned object,
+ * by the caller or by another thread, doesn't skip the rest of the slot.
+ * Objects added or removed during the traversal may or may not be returned.
+ */
+static bool _striped_getnext(qhashtbl_t *tbl, qhnobj_t *obj, bool newmem) {
+    if (obj == NULL) {
+        errno = EINVAL;
+        return false;
+    }
+
+    qhnobj_t *cursor = NULL;
+    size_t idx = 0;
+    if (obj->name != NULL) {
+        idx = obj->hash % tbl->range;
+        _stripe_lock(tbl, idx, false);
+        cursor = _striped_after(tbl->slots[idx], obj->hash, obj->next);
+        if (cursor == NULL)
+            _stripe_unlock(tbl, idx++);
+    }
+
+    // search from next index
+    for (; cursor == NULL && idx < tbl->range; idx++) {
+        _stripe_lock(tbl, idx, false);
+        cursor = _striped_after(tbl->slots[idx], 0, NULL);
+        if (cursor != NULL)
+            break;
+        _stripe_unlock(tbl, idx);
+    }
+
+    if (cursor == NULL) {
+        errno = ENOENT;
+        return false;
+    }
+
+    if (newmem == true) {
+        obj->name = qlibc_strdup(cursor->name);
+        obj->data = qlibc_malloc(cursor->size);
+        if (obj->name == NULL || obj->data == NULL) {
+            DEBUG("getnext(): Unable to allocate memory.");
+            if (obj->name != NULL)
+                qlibc_free(obj->name);
+            if (obj->data != NULL)
+                qlibc_free(obj->data);
+            _stripe_unlock(tbl, idx);
+            errno = ENOMEM;
+            return false;
+        }
+        memcpy(obj->data, cursor->data, cursor->size);
+    } else {
+        obj->name = cursor->name;
+        obj->data = cursor->data;
+    }
+    obj->hash = cursor->hash;
+    obj->size = cursor->size;
+    obj->next = cursor;
+
+    _stripe_unlock(tbl, idx);
+    return true;
+}
+
+/**
+ * Take the table lock for lookups. Lookups of a resizable table migrate
+ * slots, so they need the exclusive lock.
+ */
+static void _lock_shared(qhashtbl_t *tbl) {
+    if (tbl->resizable == true)
+        Q_MUTEX_ENTER(tbl->qmutex);
+    else
+        Q_MUTEX_ENTER_SHARED(tbl->qmutex);
+}
+
+/**
+ * Take a slot lock. Time is measured only when the lock is not free at the
+ * first try.
+ */
+static void _stripe_lock(qhashtbl_t *tbl, size_t idx, bool write) {
+    if (tbl->stripes == NULL)
+        return;
+    pthread_rwlock_t *stripe = &tbl->stripes[idx % tbl->nstripes];
+    if (((write == true) ? pthread_rwlock_trywrlock(stripe)
+                         : pthread_rwlock_tryrdlock(stripe)) == 0)
+        return;
+
+    int64_t waitstart = qtime_monotonic_ns();
+    if (write == true)
+        pthread_rwlock_wrlock(stripe);
+    else
+        pthread_rwlock_rdlock(stripe);
+    __atomic_fetch_add(&tbl->stripewaitns,
+                       (uint64_t) (qtime_monotonic_ns() - waitstart),
+                       __ATOMIC_RELAXED);
+}
+
+static void _stripe_unlock(qhashtbl_t *tbl, size_t idx) {
+    if (tbl->stripes == NULL)
+        return;
+    pthread_rwlock_unlock(&tbl->stripes[idx % tbl->nstripes]);
+}
+
+static void _add_num(qhashtbl_t *tbl, int delta) {
+    if (tbl->stripes != NULL)
+        __sync_add_and_fetch(&tbl->num, delta);
+    else
+        tbl->num += delta;
+}
+
+static qhnobj_t *_new_obj(qhashtbl_t *tbl, size_t inlsize) {
+    if (tbl->pool == NULL) {
+        qhnobj_t *obj = (qhnobj_t *) qlibc_calloc(1, sizeof(qhnobj_t) + inlsize);
+        if (obj != NULL)
+            obj->inlsize = inlsize;
+        return obj;
+    }
+
+    qhnobj_t *obj = (qhnobj_t *) tbl->pool->alloc(tbl->pool);
+    if (obj != NULL) {
+        memset((void *) obj, 0, sizeof(qhnobj_t));
+        obj->inlsize = INLINE_MAX;
+    }
+    return obj;
+}
+
+static void _release_obj(qhnobj_t *obj) {
+    if (obj->isref == false && IS_INLINE(obj) == false) {
+        qlibc_free(obj->name);
+        qlibc_free(obj->data);
+    }
+}
+
+static void _free_obj(qhashtbl_t *tbl, qhnobj_t *obj) {
+    if (tbl->pool != NULL)
+        tbl->pool->release(tbl->pool, obj);
+    else
+        qlibc_free(obj);
+}
+
+/**
+ * Add up chain lengths and object sizes of the slots into stats.
+ */
+static void _chain_stats(qhnobj_t **slots, size_t range, qstats_t *stats) {
+    size_t idx;
+    for (idx = 0; idx < range; idx++) {
+        size_t chain = 0;
+        qhnobj_t *obj;
+        for (obj = slots[idx]; obj != NULL; obj = obj->next) {
+            chain++;
+            stats->keybytes += strlen(obj->name) + 1;
+            stats->valuebytes += obj->size;
+        }
+        if (chain == 0)
+            continue;
+        stats->usedslots++;
+        stats->collisions += chain - 1;
+        if (chain > stats->maxchain)
+            stats->maxchain = chain;
+    }
+}
+
+static void _counter_stats(qhashtbl_t *tbl, qstats_t *stats) {
+    if (tbl->qmutex != NULL)
+        stats->overhead += sizeof(qmutex_t);
+    stats->lockwaitns = _q_mutex_waitns(tbl->qmutex)
+            + __atomic_load_n(&tbl->stripewaitns, __ATOMIC_RELAXED);
+    stats->gethits = Q_STATS_LOAD(tbl->gethits);
+    stats->getmisses = Q_STATS_LOAD(tbl->getmisses);
+    stats->puthits = Q_STATS_LOAD(tbl->puthits);
+    stats->putmisses = Q_STATS_LOAD(tbl->putmisses);
+}
+
+/**
+ * Write the objects in the slots into a snapshot.
+ */
+static bool _chain_snapshot(qhnobj_t **slots, size_t range, qsnap_t *snap) {
+    size_t idx;
+    for (idx = 0; idx < range; idx++) {
+        qhnobj_t *obj;
+        for (obj = slots[idx]; obj != NULL; obj = obj->next) {
+            if (_q_snap_write(snap, obj->hash, obj->name, strlen(obj->name),
+                              obj->data, obj->size) == false) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static bool _chain_collect(qhnobj_t **slots, size_t range, qnobj_t **objs,
+                           size_t *num, size_t *max) {
+    size_t idx;
+    for (idx = 0; idx < range; idx++) {
+        qhnobj_t *obj;
+        for (obj = slots[idx]; obj != NULL; obj = obj->next) {
+            if (_collect(objs, num, max, obj->name, obj->data, obj->size)
+                    == false) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static bool _collect(qnobj_t **objs, size_t *num, size_t *max, char *name,
+                     void *data, size_t size) {
+    if (*num == *max) {
+        size_t newmax = (*max > 0) ? *max * 2 : 64;
+        qnobj_t *newobjs = (qnobj_t *) qlibc_realloc(*objs,
+                                               sizeof(qnobj_t) * newmax);
+        if (newobjs == NULL) {
+            errno = ENOMEM;
+            return false;
+        }
+        *objs = newobjs;
+        *max = newmax;
+    }
+    (*objs)[*num].name = name;
+    (*objs)[*num].data = data;
+    (*objs)[*num].size = size;
+    (*num)++;
+    return true;
+}
+
+static bool _flat_puthashed(qhashtbl_t *tbl, const char *name, size_t keylen,
+                            uint32_t hash, const void *data, size_t size) {
+    if (name == NULL || data == NULL) {
+        errno = EINVAL;
+        return false;
+    }
+
+    size_t reclen = FLAT_REC_LEN(keylen, size);
+
+    lock(tbl);
+
+    // name and data may point the arena which can be moved by
+    // _flat_reserve(), for example when they've been taken from getnext().
+    char *dupname = NULL;
+    void *dupdata = NULL;
+    if (tbl->arena != NULL) {
+        const char *arenaend = tbl->arena + tbl->arenaused;
+        if (name >= tbl->arena && name < arenaend) {
+            dupname = (char *) qlibc_malloc(keylen);
+            if (dupname != NULL)
+                memcpy(dupname, name, keylen);
+            name = dupname;
+        }
+        if ((const char *) data >= tbl->arena
+                && (const char *) data < arenaend) {
+            dupdata = qlibc_malloc(size);
+            if (dupdata != NULL)
+                memcpy(dupdata, data, size);
+            data = dupdata;
+        }
+        if (name == NULL || data == NULL) {
+            unlock(tbl);
+            if (dupname != NULL)
+                qlibc_free(dupname);
+            if (dupdata != NULL)
+                qlibc_free(dupdata);
+            errno = ENOMEM;
+            return false;
+        }
+    }
+
+    qhashtbl_flatslot_t *slot = _flat_find(tbl, name, keylen, hash);
+    if (slot != NULL)
+        Q_STATS_INC(tbl->puthits);
+    else
+        Q_STATS_INC(tbl->putmisses);
+    if (slot != NULL && FLAT_ALIGN(FLAT_REC_SIZE(tbl, slot)) >= FLAT_ALIGN(size)) {
+        // replace in place
+        memcpy(FLAT_REC_DATA(tbl, slot), data, size);
+        FLAT_REC_SIZE(tbl, slot) = size;
+        unlock(tbl);
+        if (dupname != NULL)
+            qlibc_free(dupname);
+        if (dupdata != NULL)
+            qlibc_free(dupdata);
+        return true;
+    }
+
+    if ((slot == NULL && _flat_grow(tbl) == false)
+            || _flat_reserve(tbl, reclen) == false) {
+        unlock(tbl);
+        if (dupname != NULL)
+            qlibc_free(dupname);
+        if (dupdata != NULL)
+            qlibc_free(dupdata);
+        errno = ENOMEM;
+        return false;
+    }
+
+    // write a new record
+    qhashtbl_flatslot_t newslot;
+    memset((void *) &newslot, 0, sizeof(newslot));
+    newslot.hash = hash;
+    newslot.dist = 1;
+    newslot.keylen = keylen;
+    memcpy(newslot.prefix, name,
+           (keylen < FLAT_PREFIX_LEN) ? keylen : FLAT_PREFIX_LEN);
+    newslot.offset = tbl->arenaused;
+    tbl->arenaused += reclen;
+
+    FLAT_REC_SIZE(tbl, &newslot) = size;
+    memcpy(FLAT_REC_NAME(tbl, &newslot), name, keylen);
+    FLAT_REC_NAME(tbl, &newslot)[keylen] = '\0';
+    memcpy(FLAT_REC_DATA(tbl, &newslot), data, size);
+
+    if (slot != NULL) {
+        // replace with the new record. slot is still valid since the probe
+        // array hasn't been modified.
+        tbl->arenagarbage += FLAT_REC_LEN(slot->keylen,
+                                          FLAT_REC_SIZE(tbl, slot));
+        slot->offset = newslot.offset;
+    } else {
+        _flat_place(tbl->flatslots, tbl->range, newslot);
+        tbl->num++;
+    }
+
+    unlock(tbl);
+    if (dupname != NULL)
+        qlibc_free(dupname);
+    if (dupdata != NULL)
+        qlibc_free(dupdata);
+    return true;
+}
+
+static void *_flat_gethashed(qhashtbl_t *tbl, const char *name,
+                             size_t keylen, uint32_t hash, size_t *size,
+                             bool newmem) {
+    if (name == NULL) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    _lock_shared(tbl);
+
+    void *data = NULL;
+    qhashtbl_flatslot_t *slot = _flat_find(tbl, name, keylen, hash);
+    if (slot != NULL)
+        Q_STATS_INC(tbl->gethits);
+    else
+        Q_STATS_INC(tbl->getmisses);
+    if (slot != NULL) {
+        size_t datasize = FLAT_REC_SIZE(tbl, slot);
+        if (newmem == false) {
+            data = FLAT_REC_DATA(tbl, slot);
+        } else {
+            data = qlibc_malloc(datasize);
+            if (data == NULL) {
+                unlock(tbl);
+                errno = ENOMEM;
+                return NULL;
+            }
+            memcpy(data, FLAT_REC_DATA(tbl, slot), datasize);
+        }
+        if (size != NULL)
+            *size = datasize;
+    }
+
+    unlock(tbl);
+
+    if (data == NULL)
+        errno = ENOENT;
+    return data;
+}
+
+/**
+ * getnext() of QHASHTBL_OPENADDR mode. Entries are returned by home slot,
+ * and by hash and record offset among the entries of the same home. The
+ * backward shift of remove() moves entries but never changes these, so
+ * removing the last returned key, or any other, during the traversal
+ * doesn't skip or repeat the rest. obj->next keeps the record offset of
+ * the last returned entry, which is only compared.
+ */
+static bool _flat_getnext(qhashtbl_t *tbl, qhnobj_t *obj, bool newmem) {
+    if (obj == NULL) {
+        errno = EINVAL;
+        return false;
+    }
+
+    lock(tbl);
+
+    size_t home = 0;
+    bool resume = false;
+    if (obj->name != NULL) {
+        home = obj->hash & (tbl->range - 1);
+        resume = true;
+    }
+
+    qhashtbl_flatslot_t *slot = NULL;
+    for (; home < tbl->range; home++, resume = false) {
+        slot = _flat_after(tbl, home, resume, obj->hash,
+                           (size_t) (uintptr_t) obj->next);
+        if (slot != NULL)
+            break;
+    }
+    if (slot == NULL) {
+        unlock(tbl);
+        errno = ENOENT;
+        return false;
+    }
+
+    size_t datasize = FLAT_REC_SIZE(tbl, slot);
+    if (newmem == true) {
+        obj->name = qlibc_strdup(FLAT_REC_NAME(tbl, slot));
+        obj->data = qlibc_malloc(datasize);
+        if (obj->name == NULL || obj->data == NULL) {
+            DEBUG("getnext(): Unable to allocate memory.");
+            if (obj->name != NULL)
+                qlibc_free(obj->name);
+            if (obj->data != NULL)
+                qlibc_free(obj->data);
+            unlock(tbl);
+            errno = ENOMEM;
+            return false;
+        }
+        memcpy(obj->data, FLAT_REC_DATA(tbl, slot), datasize);
+    } else {
+        obj->name = FLAT_REC_NAME(tbl, slot);
+        obj->data = FLAT_REC_DATA(tbl, slot);
+    }
+    obj->hash = slot->hash;
+    obj->size = datasize;
+    obj->next = (qhnobj_t *) (uintptr_t) slot->offset;
+
+    unlock(tbl);
+    return true;
+}
+
+static bool _flat_iternext(qhashtbl_t *tbl, qiter_t *it) {
+    for (; it->idx < tbl->range; it->idx++) {
+        qhashtbl_flatslot_t *slot = &tbl->flatslots[it->idx];
+        if (slot->dist == 0)
+            continue;
+        it->name = FLAT_REC_NAME(tbl, slot);
+        it->namelen = slot->keylen;
+        it->data = FLAT_REC_DATA(tbl, slot);
+        it->size = FLAT_REC_SIZE(tbl, slot);
+        it->idx++;
+        return true;
+    }
+
+    errno = ENOENT;
+    return false;
+}
+
+static bool _flat_removehashed(qhashtbl_t *tbl, const char *name,
+                               size_t keylen, uint32_t hash) {
+    if (name == NULL) {
+        errno = EINVAL;
+        return false;
+    }
+
+    lock(tbl);
+
+    qhashtbl_flatslot_t *slot = _flat_find(tbl, name, keylen, hash);
+    if (slot == NULL) {
+        unlock(tbl);
+        errno = ENOENT;
+        return false;
+    }
+
+    tbl->arenagarbage += FLAT_REC_LEN(slot->keylen, FLAT_REC_SIZE(tbl, slot));
+    tbl->num--;
+
+    // backward shift deletion, no tombstones are left.
+    size_t mask = tbl->range - 1;
+    size_t idx = slot - tbl->flatslots;
+    while (true) {
+        size_t next = (idx + 1) & mask;
+        if (tbl->flatslots[next].dist <= 1) {
+            memset((void *) &tbl->flatslots[idx], 0,
+                   sizeof(qhashtbl_flatslot_t));
+            break;
+        }
+        tbl->flatslots[idx] = tbl->flatslots[next];
+        tbl->flatslots[idx].dist--;
+        idx = next;
+    }
+
+    if (tbl->num == 0) {
+        tbl->arenaused = 0;
+        tbl->arenagarbage = 0;
+    }
+
+    unlock(tbl);
+    return true;
+}
+
+static void _flat_clear(qhashtbl_t *tbl) {
+    lock(tbl);
+    memset((void *) tbl->flatslots, 0,
+           tbl->range * sizeof(qhashtbl_flatslot_t));
+    tbl->num = 0;
+    tbl->arenaused = 0;
+    tbl->arenagarbage = 0;
+    unlock(tbl);
+}
+
+static void _flat_free(qhashtbl_t *tbl) {
+    lock(tbl);
+    qlibc_free(tbl->flatslots);
+    if (tbl->arena != NULL)
+        qlibc_free(tbl->arena);
+    unlock(tbl);
+    Q_MUTEX_DESTROY(tbl->qmutex);
+    qlibc_free(tbl);
+}
+
+static bool _flat_stats(qhashtbl_t *tbl, qstats_t *stats) {
+    if (stats == NULL) {
+        errno = EINVAL;
+        return false;
+    }
+    memset((void *) stats, 0, sizeof(qstats_t));
+
+    _lock_shared(tbl);
+    size_t idx;
+    for (idx = 0; idx < tbl->range; idx++) {
+        qhashtbl_flatslot_t *slot = &tbl->flatslots[idx];
+        if (slot->dist == 0)
+            continue;
+        stats->usedslots++;
+        if (slot->dist > 1)
+            stats->collisions++;
+        if (slot->dist > stats->maxchain)
+            stats->maxchain = slot->dist;
+        stats->keybytes += slot->keylen + 1;
+        stats->valuebytes += FLAT_REC_SIZE(tbl, slot);
+    }
+    stats->num = tbl->num;
+    stats->slots = tbl->range;
+    stats->loadfactor = (double) tbl->num / tbl->range;
+    stats->overhead = sizeof(qhashtbl_t)
+            + tbl->range * sizeof(qhashtbl_flatslot_t)
+            + tbl->arenasize - stats->keybytes - stats->valuebytes;
+    unlock(tbl);
+
+    _counter_stats(tbl, stats);
+    return true;
+}
+
+static qhashtbl_flatslot_t *_flat_find(qhashtbl_t *tbl, const char *name,
+                                       size_t keylen, uint32_t hash) {
+    char prefix[FLAT_PREFIX_LEN] = { 0 };
+    memcpy(prefix, name, (keylen < FLAT_PREFIX_LEN) ? keylen : FLAT_PREFIX_LEN);
+
+    size_t mask = tbl->range - 1;
+    size_t idx = hash & mask;
+    uint32_t dist;
+    for (dist = 1;; dist++, idx = (idx + 1) & mask) {
+        qhashtbl_flatslot_t *slot = &tbl->flatslots[idx];
+        // robin hood invariant, the key can't be further than this.
+        if (slot->dist < dist)
+            return NULL;
+        if (slot->hash == hash && slot->keylen == keylen
+                && !memcmp(slot->prefix, prefix, FLAT_PREFIX_LEN)
+                && !memcmp(FLAT_REC_NAME(tbl, slot), name, keylen)) {
+            return slot;
+        }
+    }
+}
+
+static void _flat_place(qhashtbl_flatslot_t *slots, size_t range,
+                        qhashtbl_flatslot_t slot) {
+    size_t mask = range - 1;
+    size_t idx = slot.hash & mask;
+    slot.dist = 1;
+    for (;; slot.dist++, idx = (idx + 1) & mask) {
+        if (slots[idx].dist == 0) {
+            slots[idx] = slot;
+            return;
+        }
+        // take the place of richer entry and carry it forward.
+        if (slots[idx].dist < slot.dist) {
+            qhashtbl_flatslot_t tmp = slots[idx];
+            slots[idx] = slot;
+            slot = tmp;
+        }
+    }
+}
+
+/**
+ * Find the first entry of home slot 'home' in _flat_getnext() order, or
+ * the first one after (hash, offset) if resume is true. Robin Hood keeps
+ * the entries of a cluster sorted by home, so the entries of one home are
+ * in a row starting at or after the home slot.
+ */
+static qhashtbl_flatslot_t *_flat_after(qhashtbl_t *tbl, size_t home,
+                                        bool resume, uint32_t hash,
+                                        size_t offset) {
+    size_t mask = tbl->range - 1;
+    qhashtbl_flatslot_t *found = NULL;
+    size_t d, idx;
+    for (d = 0, idx = home; d < tbl->range; d++, idx = (idx + 1) & mask) {
+        qhashtbl_flatslot_t *slot = &tbl->flatslots[idx];
+        if (slot->dist == 0 || slot->dist - 1 < d)
+            break;  // end of cluster or the row of a later home
+        if (slot->dist - 1 > d)
+            continue;  // an entry of an earlier home
+        if (resume == true && (slot->hash < hash || (slot->hash == hash
+                && slot->offset <= offset)))
+            continue;
+        if (found == NULL || slot->hash < found->hash
+                || (slot->hash == found->hash && slot->offset < found->offset))
+            found = slot;
+    }
+    return found;
+}
+
+/**
+ * Double the probe array if one more key would exceed the maximum load.
+ */
+static bool _flat_grow(qhashtbl_t *tbl) {
+    if ((tbl->num + 1) * 100 <= tbl->range * FLAT_MAX_LOAD_PCT)
+        return true;
+
+    size_t newrange = tbl->range * 2;
+    qhashtbl_flatslot_t *newslots = (qhashtbl_flatslot_t *) qlibc_calloc(
+            newrange, sizeof(qhashtbl_flatslot_t));
+    if (newslots == NULL)
+        return false;
+
+    DEBUG("grow probe array from %zu to %zu", tbl->range, newrange);
+    size_t idx;
+    for (idx = 0; idx < tbl->range; idx++) {
+        if (tbl->flatslots[idx].dist != 0)
+            _flat_place(newslots, newrange, tbl->flatslots[idx]);
+    }
+    qlibc_free(tbl->flatslots);
+    tbl->flatslots = newslots;
+    tbl->range = newrange;
+
+    return true;
+}
+
+/**
+ * Make room for a record of reclen bytes at the end of the arena.
+ * The arena is compacted instead of being expanded when more than a half
+ * of it is occupied by removed records.
+ */
+static bool _flat_reserve(qhashtbl_t *tbl, size_t reclen) {
+    if (tbl->arenaused + reclen <= tbl->arenasize)
+        return true;
+
+    size_t live = tbl->arenaused - tbl->arenagarbage;
+    size_t newsize = (tbl->arenasize > 0) ? tbl->arenasize : 4096;
+    while (newsize < (live + reclen) * 2)
+        newsize *= 2;
+
+    if (tbl->arenagarbage * 2 < tbl->arenaused) {
+        // expand
+        char *newarena = (char *) qlibc_realloc(tbl->arena, newsize);
+        if (newarena == NULL)
+            return false;
+        tbl->arena = newarena;
+        tbl->arenasize = newsize;
+        return true;
+    }
+
+    // compact into a new arena
+    char *newarena = (char *) qlibc_malloc(newsize);
+    if (newarena == NULL)
+        return false;
+
+    DEBUG("compact arena %zu/%zu bytes", live, tbl->arenaused);
+    size_t used = 0;
+    size_t idx;
+    for (idx = 0; idx < tbl->range; idx++) {
+        qhashtbl_flatslot_t *slot = &tbl->flatslots[idx];
+        if (slot->dist == 0)
+            continue;
+        size_t len = FLAT_REC_LEN(slot->keylen, FLAT_REC_SIZE(tbl, slot));
+        memcpy(newarena + used, tbl->arena + slot->offset, len);
+        slot->offset = used;
+        used += len;
+    }
+    qlibc_free(tbl->arena);
+    tbl->arena = newarena;
+    tbl->arenasize = newsize;
+    tbl->arenaused = used;
+    tbl->arenagarbage = 0;
+
+    return true;
+}
+
+#endif /* _DOXYGEN_SKIP */
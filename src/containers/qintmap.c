@@ -0,0 +1,758 @@
+/******************************************************************************
+ * qLibc
+ *
+ * Copyright (c) 2010-2014 Seungyoung Kim.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *****************************************************************************/
+
+/**
+ * @file qintmap.c Integer-key hash map implementation.
+ *
+ * qintmap is a hash map keyed by 64-bit unsigned integers such as object
+ * IDs. Unlike qhashtbl->putint() which stores integer values under string
+ * keys, keys are kept as they are. Nothing is allocated for a key, there's
+ * no string hashing or comparison, and values up to 16 bytes, pointers for
+ * example, are stored right in the slot.
+ *
+ * Keys are placed in a single probe array with robin hood linear probing.
+ * The home slot of a key is found with Fibonacci hashing, multiplying the
+ * key by 2^64 / golden ratio and taking the top bits, so sequential IDs
+ * are spread over the array. The array is doubled at 85% load and removed
+ * keys are backward-shifted, so no tombstones are left.
+ *
+ * @code
+ *  [Conceptional Data Structure Diagram]
+ *
+ *  key -> (key * 0x9E3779B97F4A7C15) >> shift -> home slot
+ *
+ *  slots [ key|dist|size|data(16) ][ key|dist|size|ptr ][ empty ]...
+ *                                             |
+ *                                             +-> [ data > 16 bytes ]
+ * @endcode
+ *
+ * @code
+ *  // create a map.
+ *  qintmap_t *map = qintmap(0, 0);
+ *
+ *  // map IDs to objects.
+ *  map->putptr(map, user->id, user);
+ *  struct user *u = map->getptr(map, 1234);
+ *
+ *  // store a copy of data.
+ *  map->put(map, 1, "value", 6);
+ *  char *value = map->get(map, 1, NULL, false);
+ *
+ *  // iterate.
+ *  int idx = 0;
+ *  qintmap_obj_t obj;
+ *  while (map->getnext(map, &obj, &idx, false) == true) {
+ *    printf("KEY=%" PRIu64 ", SIZE=%zu\n", obj.key, obj.size);
+ *  }
+ *
+ *  // release.
+ *  map->free(map);
+ * @endcode
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <errno.h>
+#include "qinternal.h"
+#include "containers/qintmap.h"
+
+#ifndef _DOXYGEN_SKIP
+
+#define DEFAULT_RANGE       (16)    /*!< default and minimum number of slots */
+#define MAX_LOAD_PCT        (85)    /*!< grow when slots are 85% full */
+#define INLINE_SIZE         (16)    /*!< data bytes kept in a slot */
+#define FIBONACCI_MULT      (0x9E3779B97F4A7C15ULL)  /*!< 2^64 / phi */
+
+/**
+ * Probe array entry.
+ */
+struct qintmap_slot_s {
+    uint64_t key;       /*!< key */
+    uint32_t dist;      /*!< probe distance + 1, 0 means empty slot */
+    uint32_t size;      /*!< data size */
+    union {
+        void *ptr;                  /*!< data bigger than INLINE_SIZE */
+        char buf[INLINE_SIZE];      /*!< data up to INLINE_SIZE bytes */
+    } data;
+};
+
+#define SLOT_DATA(s)        (((s)->size > INLINE_SIZE) ? (s)->data.ptr \
+                                                       : (void *) (s)->data.buf)
+#define SLOT_HOME(map, key) ((size_t) (((key) * FIBONACCI_MULT) >> (map)->shift))
+
+static bool put(qintmap_t *map, uint64_t key, const void *data, size_t size);
+static bool putint(qintmap_t *map, uint64_t key, int64_t num);
+static bool putptr(qintmap_t *map, uint64_t key, const void *ptr);
+static void *get(qintmap_t *map, uint64_t key, size_t *size, bool newmem);
+static int64_t getint(qintmap_t *map, uint64_t key);
+static void *getptr(qintmap_t *map, uint64_t key);
+static bool getnext(qintmap_t *map, qintmap_obj_t *obj, int *idx,
+                    bool newmem);
+static bool remove_(qintmap_t *map, uint64_t key);
+static size_t size(qintmap_t *map);
+static void clear(qintmap_t *map);
+static bool debug(qintmap_t *map, FILE *out);
+static bool stats(qintmap_t *map, qstats_t *stats);
+static void lock(qintmap_t *map);
+static void unlock(qintmap_t *map);
+static void free_(qintmap_t *map);
+
+static int _shift(size_t range);
+static qintmap_slot_t *_find(qintmap_t *map, uint64_t key);
+static void _place(qintmap_slot_t *slots, size_t range, int shift,
+                   qintmap_slot_t slot);
+static bool _grow(qintmap_t *map);
+
+#endif
+
+/**
+ * Create an integer-key hash map.
+ *
+ * @param range     initial number of slots. Value of 0 will use default
+ *                  value, 16. It's rounded up to a power of 2.
+ * @param options   combination of initialization options.
+ *
+ * @return a pointer of malloced qintmap_t, otherwise returns NULL.
+ * @retval errno will be set in error condition.
+ *  - ENOMEM : Memory allocation failure.
+ *
+ * @code
+ *  qintmap_t *map = qintmap(0, 0);
+ *  qintmap_t *sized_map = qintmap(1000000, QINTMAP_THREADSAFE);
+ * @endcode
+ *
+ * @note
+ *   The map always grows as needed, so the range only saves resizing when
+ *   the number of keys is known in advance.
+ *   Available options:
+ *   - QINTMAP_THREADSAFE - make it thread-safe. Lookups share a
+ *     reader/writer lock.
+ */
+qintmap_t *qintmap(size_t range, int options) {
+    size_t slots = DEFAULT_RANGE;
+    while (slots < range && slots < ((size_t) 1 << 62))
+        slots *= 2;
+
+    qintmap_t *map = (qintmap_t *) qlibc_calloc(1, sizeof(qintmap_t));
+    if (map == NULL)
+        goto malloc_failure;
+
+    map->slots = (qintmap_slot_t *) qlibc_calloc(slots, sizeof(qintmap_slot_t));
+    if (map->slots == NULL)
+        goto malloc_failure;
+    map->range = slots;
+    map->shift = _shift(slots);
+
+    if (options & QINTMAP_THREADSAFE) {
+        Q_RWLOCK_NEW(map->qmutex);
+        if (map->qmutex == NULL)
+            goto malloc_failure;
+    }
+
+    // assign methods
+    map->put = put;
+    map->putint = putint;
+    map->putptr = putptr;
+
+    map->get = get;
+    map->getint = getint;
+    map->getptr = getptr;
+    map->getnext = getnext;
+
+    map->remove = remove_;
+
+    map->size = size;
+    map->clear = clear;
+    map->debug = debug;
+    map->stats = stats;
+
+    map->lock = lock;
+    map->unlock = unlock;
+
+    map->free = free_;
+
+    return map;
+
+  malloc_failure:
+    errno = ENOMEM;
+    if (map != NULL) {
+        if (map->slots != NULL)
+            qlibc_free(map->slots);
+        qlibc_free(map);
+    }
+    return NULL;
+}
+
+/**
+ * qintmap->put(): Put an object into this map.
+ *
+ * @param map       qintmap_t container pointer.
+ * @param key       key
+ * @param data      data object
+ * @param size      size of data object
+ *
+ * @return true if successful, otherwise returns false
+ * @retval errno will be set in error condition.
+ *  - EINVAL : Invalid argument.
+ *  - ENOMEM : Memory allocation failure.
+ *
+ * @note
+ *  Data up to 16 bytes is stored in the slot, larger data is copied into
+ *  a separate allocation. Data must be smaller than 4GB.
+ */
+static bool put(qintmap_t *map, uint64_t key, const void *data, size_t size) {
+    if ((data == NULL && size > 0) || size > UINT32_MAX) {
+        errno = EINVAL;
+        return false;
+    }
+
+    // copy data first, it may be in a slot which is about to move.
+    qintmap_slot_t newslot;
+    memset((void *) &newslot, 0, sizeof(newslot));
+    newslot.key = key;
+    newslot.size = size;
+    if (size > INLINE_SIZE) {
+        newslot.data.ptr = qlibc_malloc(size);
+        if (newslot.data.ptr == NULL) {
+            errno = ENOMEM;
+            return false;
+        }
+        memcpy(newslot.data.ptr, data, size);
+    } else if (size > 0) {
+        memcpy(newslot.data.buf, data, size);
+    }
+
+    lock(map);
+
+    qintmap_slot_t *slot = _find(map, key);
+    if (slot != NULL) {
+        // replace
+        Q_STATS_INC(map->puthits);
+        if (slot->size > INLINE_SIZE) {
+            qlibc_free(slot->data.ptr);
+            map->heapbytes -= slot->size;
+        }
+        newslot.dist = slot->dist;
+        *slot = newslot;
+    } else {
+        // insert
+        Q_STATS_INC(map->putmisses);
+        if (_grow(map) == false) {
+            unlock(map);
+            if (size > INLINE_SIZE)
+                qlibc_free(newslot.data.ptr);
+            errno = ENOMEM;
+            return false;
+        }
+        _place(map->slots, map->range, map->shift, newslot);
+        map->num++;
+    }
+    if (size > INLINE_SIZE)
+        map->heapbytes += size;
+
+    unlock(map);
+    return true;
+}
+
+/**
+ * qintmap->putint(): Put an integer into this map.
+ *
+ * @param map       qintmap_t container pointer.
+ * @param key       key
+ * @param num       number to store
+ *
+ * @return true if successful, otherwise returns false
+ * @retval errno will be set in error condition.
+ *  - ENOMEM : Memory allocation failure.
+ *
+ * @note
+ *  The number is stored as a binary int64_t, not as a string.
+ */
+static bool putint(qintmap_t *map, uint64_t key, int64_t num) {
+    return put(map, key, &num, sizeof(num));
+}
+
+/**
+ * qintmap->putptr(): Put a pointer into this map.
+ *
+ * @param map       qintmap_t container pointer.
+ * @param key       key
+ * @param ptr       pointer to store. The memory it points isn't copied.
+ *
+ * @return true if successful, otherwise returns false
+ * @retval errno will be set in error condition.
+ *  - ENOMEM : Memory allocation failure.
+ */
+static bool putptr(qintmap_t *map, uint64_t key, const void *ptr) {
+    return put(map, key, &ptr, sizeof(ptr));
+}
+
+/**
+ * qintmap->get(): Get an object from this map.
+ *
+ * @param map       qintmap_t container pointer.
+ * @param key       key
+ * @param size      if not NULL, oject size will be stored
+ * @param newmem    whether or not to allocate memory for the data.
+ *
+ * @return a pointer of data if the key is found, otherwise returns NULL.
+ * @retval errno will be set in error condition.
+ *  - ENOENT : No such key found.
+ *  - ENOMEM : Memory allocation failure.
+ *
+ * @note
+ *  Without newmem, the returned pointer may point into the probe array and
+ *  is valid only until the next modification of the map. Don't use it
+ *  with QINTMAP_THREADSAFE unless the map is locked with lock().
+ */
+static void *get(qintmap_t *map, uint64_t key, size_t *size, bool newmem) {
+    Q_MUTEX_ENTER_SHARED(map->qmutex);
+
+    void *data = NULL;
+    qintmap_slot_t *slot = _find(map, key);
+    if (slot != NULL) {
+        Q_STATS_INC(map->gethits);
+        if (newmem == false) {
+            data = SLOT_DATA(slot);
+        } else {
+            data = qlibc_malloc((slot->size > 0) ? slot->size : 1);
+            if (data == NULL) {
+                unlock(map);
+                errno = ENOMEM;
+                return NULL;
+            }
+            memcpy(data, SLOT_DATA(slot), slot->size);
+        }
+        if (size != NULL)
+            *size = slot->size;
+    } else {
+        Q_STATS_INC(map->getmisses);
+    }
+
+    unlock(map);
+
+    if (data == NULL)
+        errno = ENOENT;
+    return data;
+}
+
+/**
+ * qintmap->getint(): Get an integer stored by putint().
+ *
+ * @param map       qintmap_t container pointer.
+ * @param key       key
+ *
+ * @return value integer if successful, otherwise(not found) returns 0
+ * @retval errno will be set in error condition.
+ *  - ENOENT : No such key found.
+ *  - EINVAL : The value isn't an integer.
+ */
+static int64_t getint(qintmap_t *map, uint64_t key) {
+    int64_t num = 0;
+    Q_MUTEX_ENTER_SHARED(map->qmutex);
+    qintmap_slot_t *slot = _find(map, key);
+    if (slot == NULL) {
+        Q_STATS_INC(map->getmisses);
+        errno = ENOENT;
+    } else if (slot->size != sizeof(int64_t)) {
+        Q_STATS_INC(map->gethits);
+        errno = EINVAL;
+    } else {
+        Q_STATS_INC(map->gethits);
+        memcpy(&num, slot->data.buf, sizeof(num));
+    }
+    unlock(map);
+    return num;
+}
+
+/**
+ * qintmap->getptr(): Get a pointer stored by putptr().
+ *
+ * @param map       qintmap_t container pointer.
+ * @param key       key
+ *
+ * @return the stored pointer if found, otherwise returns NULL.
+ * @retval errno will be set in error condition.
+ *  - ENOENT : No such key found.
+ *  - EINVAL : The value isn't a pointer.
+ */
+static void *getptr(qintmap_t *map, uint64_t key) {
+    void *ptr = NULL;
+    Q_MUTEX_ENTER_SHARED(map->qmutex);
+    qintmap_slot_t *slot = _find(map, key);
+    if (slot == NULL) {
+        Q_STATS_INC(map->getmisses);
+        errno = ENOENT;
+    } else if (slot->size != sizeof(void *)) {
+        Q_STATS_INC(map->gethits);
+        errno = EINVAL;
+    } else {
+        Q_STATS_INC(map->gethits);
+        memcpy(&ptr, slot->data.buf, sizeof(ptr));
+    }
+    unlock(map);
+    return ptr;
+}
+
+/**
+ * qintmap->getnext(): Get next element.
+ *
+ * @param map       qintmap_t container pointer.
+ * @param obj       found data will be stored in this object
+ * @param idx       index pointer, must be 0 for the first call.
+ * @param newmem    whether or not to allocate memory for the data.
+ *
+ * @return true if found otherwise returns false
+ * @retval errno will be set in error condition.
+ *  - ENOENT : No next element.
+ *  - ENOMEM : Memory allocation failure.
+ *
+ * @code
+ *  int idx = 0;
+ *  qintmap_obj_t obj;
+ *  while (map->getnext(map, &obj, &idx, false) == true) {
+ *    printf("KEY=%" PRIu64 ", SIZE=%zu\n", obj.key, obj.size);
+ *  }
+ * @endcode
+ *
+ * @note
+ *  Keys are returned in slot order. With newmem, obj.data should be freed
+ *  by the caller. Removing the returned key while iterating may make the
+ *  next key skipped since the following keys shift back.
+ */
+static bool getnext(qintmap_t *map, qintmap_obj_t *obj, int *idx,
+                    bool newmem) {
+    if (obj == NULL || idx == NULL) {
+        errno = EINVAL;
+        return false;
+    }
+
+    Q_MUTEX_ENTER_SHARED(map->qmutex);
+    for (; *idx >= 0 && (size_t) *idx < map->range; (*idx)++) {
+        qintmap_slot_t *slot = &map->slots[*idx];
+        if (slot->dist == 0)
+            continue;
+
+        obj->key = slot->key;
+        obj->size = slot->size;
+        if (newmem == false) {
+            obj->data = SLOT_DATA(slot);
+        } else {
+            obj->data = qlibc_malloc((slot->size > 0) ? slot->size : 1);
+            if (obj->data == NULL) {
+                unlock(map);
+                errno = ENOMEM;
+                return false;
+            }
+            memcpy(obj->data, SLOT_DATA(slot), slot->size);
+        }
+        (*idx)++;
+        unlock(map);
+        return true;
+    }
+    unlock(map);
+
+    errno = ENOENT;
+    return false;
+}
+
+/**
+ * qintmap->remove(): Remove an object from this map.
+ *
+ * @param map       qintmap_t container pointer.
+ * @param key       key
+ *
+ * @return true if successful, otherwise(not found) returns false
+ * @retval errno will be set in error condition.
+ *  - ENOENT : No such key found.
+ */
+static bool remove_(qintmap_t *map, uint64_t key) {
+    lock(map);
+
+    qintmap_slot_t *slot = _find(map, key);
+    if (slot == NULL) {
+        unlock(map);
+        errno = ENOENT;
+        return false;
+    }
+
+    if (slot->size > INLINE_SIZE) {
+        qlibc_free(slot->data.ptr);
+        map->heapbytes -= slot->size;
+    }
+    map->num--;
+
+    // backward shift deletion, no tombstones are left.
+    size_t mask = map->range - 1;
+    size_t idx = slot - map->slots;
+    while (true) {
+        size_t next = (idx + 1) & mask;
+        if (map->slots[next].dist <= 1) {
+            memset((void *) &map->slots[idx], 0, sizeof(qintmap_slot_t));
+            break;
+        }
+        map->slots[idx] = map->slots[next];
+        map->slots[idx].dist--;
+        idx = next;
+    }
+
+    unlock(map);
+    return true;
+}
+
+/**
+ * qintmap->size(): Returns the number of keys in this map.
+ *
+ * @param map       qintmap_t container pointer.
+ *
+ * @return number of elements stored
+ */
+static size_t size(qintmap_t *map) {
+    return map->num;
+}
+
+/**
+ * qintmap->clear(): Clears this map so that it contains no keys.
+ *
+ * @param map       qintmap_t container pointer.
+ *
+ * @note
+ *  The probe array keeps its size.
+ */
+static void clear(qintmap_t *map) {
+    lock(map);
+    size_t idx;
+    for (idx = 0; idx < map->range && map->num > 0; idx++) {
+        qintmap_slot_t *slot = &map->slots[idx];
+        if (slot->dist == 0)
+            continue;
+        if (slot->size > INLINE_SIZE)
+            qlibc_free(slot->data.ptr);
+        map->num--;
+    }
+    memset((void *) map->slots, 0, map->range * sizeof(qintmap_slot_t));
+    map->num = 0;
+    map->heapbytes = 0;
+    unlock(map);
+}
+
+/**
+ * qintmap->debug(): Print map contents for debugging purpose.
+ *
+ * @param map       qintmap_t container pointer.
+ * @param out       output stream
+ *
+ * @return true if successful, otherwise returns false.
+ * @retval errno will be set in error condition.
+ *  - EIO : Invalid output stream.
+ */
+static bool debug(qintmap_t *map, FILE *out) {
+    if (out == NULL) {
+        errno = EIO;
+        return false;
+    }
+
+    Q_MUTEX_ENTER_SHARED(map->qmutex);
+    size_t idx;
+    for (idx = 0; idx < map->range; idx++) {
+        qintmap_slot_t *slot = &map->slots[idx];
+        if (slot->dist == 0)
+            continue;
+        fprintf(out, "%" PRIu64 "=", slot->key);
+        _q_humanOut(out, SLOT_DATA(slot), slot->size, MAX_HUMANOUT);
+        fprintf(out, " (%" PRIu32 ", slot=%zu, dist=%" PRIu32 ")\n",
+                slot->size, idx, slot->dist);
+    }
+    unlock(map);
+
+    return true;
+}
+
+/**
+ * qintmap->stats(): Get statistics of this map.
+ *
+ * @param map       qintmap_t container pointer.
+ * @param stats     statistics will be stored here.
+ *
+ * @return true if successful, otherwise returns false.
+ * @retval errno will be set in error condition.
+ *  - EINVAL : Invalid argument.
+ *
+ * @note
+ *  maxchain is the longest probe length and collisions is the number of
+ *  keys not stored in their home slot. Keys are counted as 8 bytes each.
+ */
+static bool stats(qintmap_t *map, qstats_t *stats) {
+    if (stats == NULL) {
+        errno = EINVAL;
+        return false;
+    }
+    memset((void *) stats, 0, sizeof(qstats_t));
+
+    Q_MUTEX_ENTER_SHARED(map->qmutex);
+    size_t idx;
+    for (idx = 0; idx < map->range; idx++) {
+        qintmap_slot_t *slot = &map->slots[idx];
+        if (slot->dist == 0)
+            continue;
+        if (slot->dist > 1)
+            stats->collisions++;
+        if (slot->dist > stats->maxchain)
+            stats->maxchain = slot->dist;
+        stats->valuebytes += slot->size;
+    }
+    stats->num = map->num;
+    stats->slots = map->range;
+    stats->usedslots = map->num;
+    stats->loadfactor = (double) map->num / map->range;
+    stats->keybytes = map->num * sizeof(uint64_t);
+    stats->overhead = sizeof(qintmap_t)
+            + map->range * sizeof(qintmap_slot_t) + map->heapbytes
+            - stats->keybytes - stats->valuebytes;
+    unlock(map);
+
+    if (map->qmutex != NULL)
+        stats->overhead += sizeof(qmutex_t);
+    stats->lockwaitns = _q_mutex_waitns(map->qmutex);
+    stats->gethits = Q_STATS_LOAD(map->gethits);
+    stats->getmisses = Q_STATS_LOAD(map->getmisses);
+    stats->puthits = Q_STATS_LOAD(map->puthits);
+    stats->putmisses = Q_STATS_LOAD(map->putmisses);
+    return true;
+}
+
+/**
+ * qintmap->lock(): Enter critical section.
+ *
+ * @param map       qintmap_t container pointer.
+ *
+ * @note
+ *  From user side, normally locking operation is only needed when
+ *  get() is used with newmem=false or getnext() is used to traverse the
+ *  whole map.
+ */
+static void lock(qintmap_t *map) {
+    Q_MUTEX_ENTER(map->qmutex);
+}
+
+/**
+ * qintmap->unlock(): Leave critical section.
+ *
+ * @param map       qintmap_t container pointer.
+ */
+static void unlock(qintmap_t *map) {
+    Q_MUTEX_LEAVE(map->qmutex);
+}
+
+/**
+ * qintmap->free(): De-allocate map
+ *
+ * @param map       qintmap_t container pointer.
+ */
+static void free_(qintmap_t *map) {
+    clear(map);
+    qlibc_free(map->slots);
+    Q_MUTEX_DESTROY(map->qmutex);
+    qlibc_free(map);
+}
+
+#ifndef _DOXYGEN_SKIP
+
+static int _shift(size_t range) {
+    int bits = 0;
+    while (((size_t) 1 << bits) < range)
+        bits++;
+    return 64 - bits;
+}
+
+static qintmap_slot_t *_find(qintmap_t *map, uint64_t key) {
+    size_t mask = map->range - 1;
+    size_t idx = SLOT_HOME(map, key);
+    uint32_t dist;
+    for (dist = 1;; dist++, idx = (idx + 1) & mask) {
+        qintmap_slot_t *slot = &map->slots[idx];
+        // robin hood invariant, the key can't be further than this.
+        if (slot->dist < dist)
+            return NULL;
+        if (slot->key == key)
+            return slot;
+    }
+}
+
+static void _place(qintmap_slot_t *slots, size_t range, int shift,
+                   qintmap_slot_t slot) {
+    size_t mask = range - 1;
+    size_t idx = (size_t) ((slot.key * FIBONACCI_MULT) >> shift);
+    slot.dist = 1;
+    for (;; slot.dist++, idx = (idx + 1) & mask) {
+        if (slots[idx].dist == 0) {
+            slots[idx] = slot;
+            return;
+        }
+        // take the place of richer entry and carry it forward.
+        if (slots[idx].dist < slot.dist) {
+            qintmap_slot_t tmp = slots[idx];
+            slots[idx] = slot;
+            slot = tmp;
+        }
+    }
+}
+
+/**
+ * Double the probe array if one more key would exceed the maximum load.
+ */
+static bool _grow(qintmap_t *map) {
+    if ((map->num + 1) * 100 <= map->range * MAX_LOAD_PCT)
+        return true;
+
+    size_t newrange = map->range * 2;
+    qintmap_slot_t *newslots = (qintmap_slot_t *) qlibc_calloc(
+            newrange, sizeof(qintmap_slot_t));
+    if (newslots == NULL)
+        return false;
+
+    DEBUG("grow probe array from %zu to %zu", map->range, newrange);
+    int newshift = _shift(newrange);
+    size_t idx;
+    for (idx = 0; idx < map->range; idx++) {
+        if (map->slots[idx].dist != 0)
+            _place(newslots, newrange, newshift, map->slots[idx]);
+    }
+    qlibc_free(map->slots);
+    map->slots = newslots;
+    map->range = newrange;
+    map->shift = newshift;
+
+    return true;
+}
+
+#endif /* _DOXYGEN_SKIP */
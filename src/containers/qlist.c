@@ -86,6 +86,11 @@
  *  // free object
  *  list->free(list);
  * @endcode
+ *
+ * With QLIST_NODEPOOL option, nodes are carved out of a private qpool and
+ * small elements are stored right after their node, so adding and removing
+ * small elements doesn't call malloc() and free() each time and clear()
+ * returns the memory to the system in one shot.
  */
 
 #include <stdio.h>
@@ -96,10 +101,14 @@
 #include "qinternal.h"
 #include "containers/qlist.h"
 
+#ifndef _DOXYGEN_SKIP
+
+// maximum size of an element stored inline with its pooled node.
+#define NODEPOOL_INLINE_SIZE (48)
+
 /*
  * Member method protos
  */
-#ifndef _DOXYGEN_SKIP
 static size_t setsize(qlist_t *list, size_t max);
 
 static bool addfirst(qlist_t *list, const void *data, size_t size);
@@ -110,6 +119,9 @@ static void *getfirst(qlist_t *list, size_t *size, bool newmem);
 static void *getlast(qlist_t *list, size_t *size, bool newmem);
 static void *getat(qlist_t *list, int index, size_t *size, bool newmem);
 static bool getnext(qlist_t *list, qdlobj_t *obj, bool newmem);
+static void iterbegin(qlist_t *list, qiter_t *it);
+static bool iternext(qlist_t *list, qiter_t *it);
+static void iterend(qlist_t *list, qiter_t *it);
 
 static void *popfirst(qlist_t *list, size_t *size);
 static void *poplast(qlist_t *list, size_t *size);
@@ -122,11 +134,16 @@ static bool removeat(qlist_t *list, int index);
 static size_t size(qlist_t *list);
 static size_t datasize(qlist_t *list);
 static void reverse(qlist_t *list);
+static void sort_(qlist_t *list,
+                  int (*cmp)(const qdlobj_t *obj1, const qdlobj_t *obj2));
 static void clear(qlist_t *list);
 
 static void *toarray(qlist_t *list, size_t *size);
 static char *tostring(qlist_t *list);
 static bool debug(qlist_t *list, FILE *out);
+static bool stats(qlist_t *list, qstats_t *stats);
+static bool snapshot(qlist_t *list, const char *filepath);
+static ssize_t restore(qlist_t *list, const char *filepath);
 
 static void lock(qlist_t *list);
 static void unlock(qlist_t *list);
@@ -138,6 +155,8 @@ static void *_get_at(qlist_t *list, int index, size_t *size, bool newmem,
                      bool remove);
 static qdlobj_t *_get_obj(qlist_t *list, int index);
 static bool _remove_obj(qlist_t *list, qdlobj_t *obj);
+static qdlobj_t *_new_obj(qlist_t *list, const void *data, size_t size);
+static void _free_obj(qlist_t *list, qdlobj_t *obj);
 #endif
 
 /**
@@ -156,9 +175,11 @@ static bool _remove_obj(qlist_t *list, qdlobj_t *obj);
  * @note
  *   Available options:
  *   - QLIST_THREADSAFE - make it thread-safe.
+ *   - QLIST_NODEPOOL - allocate nodes from a pool and store small elements
+ *                      together with their nodes.
  */
 qlist_t *qlist(int options) {
-    qlist_t *list = (qlist_t *) calloc(1, sizeof(qlist_t));
+    qlist_t *list = (qlist_t *) qlibc_calloc(1, sizeof(qlist_t));
     if (list == NULL) {
         errno = ENOMEM;
         return NULL;
@@ -169,7 +190,16 @@ qlist_t *qlist(int options) {
         Q_MUTEX_NEW(list->qmutex, true);
         if (list->qmutex == NULL) {
             errno = ENOMEM;
-            free(list);
+            qlibc_free(list);
+            return NULL;
+        }
+    }
+    if (options & QLIST_NODEPOOL) {
+        list->pool = qpool(sizeof(qdlobj_t) + NODEPOOL_INLINE_SIZE, 0);
+        if (list->pool == NULL) {
+            Q_MUTEX_DESTROY(list->qmutex);
+            qlibc_free(list);
+            errno = ENOMEM;
             return NULL;
         }
     }
@@ -185,6 +215,9 @@ qlist_t *qlist(int options) {
     list->getlast = getlast;
     list->getat = getat;
     list->getnext = getnext;
+    list->iterbegin = iterbegin;
+    list->iternext = iternext;
+    list->iterend = iterend;
 
     list->popfirst = popfirst;
     list->poplast = poplast;
@@ -195,6 +228,7 @@ qlist_t *qlist(int options) {
     list->removeat = removeat;
 
     list->reverse = reverse;
+    list->sort = sort_;
     list->clear = clear;
 
     list->size = size;
@@ -203,6 +237,9 @@ qlist_t *qlist(int options) {
     list->toarray = toarray;
     list->tostring = tostring;
     list->debug = debug;
+    list->stats = stats;
+    list->snapshot = snapshot;
+    list->restore = restore;
 
     list->lock = lock;
     list->unlock = unlock;
@@ -335,27 +372,13 @@ static bool addat(qlist_t *list, int index, const void *data, size_t size) {
         return false;
     }
 
-    // duplicate object
-    void *dup_data = malloc(size);
-    if (dup_data == NULL) {
-        unlock(list);
-        errno = ENOMEM;
-        return false;
-    }
-    memcpy(dup_data, data, size);
-
-    // make new object list
-    qdlobj_t *obj = (qdlobj_t *) malloc(sizeof(qdlobj_t));
+    // make new object
+    qdlobj_t *obj = _new_obj(list, data, size);
     if (obj == NULL) {
-        free(dup_data);
         unlock(list);
         errno = ENOMEM;
         return false;
     }
-    obj->data = dup_data;
-    obj->size = size;
-    obj->prev = NULL;
-    obj->next = NULL;
 
     // make link
     if (index == 0) {
@@ -379,8 +402,7 @@ static bool addat(qlist_t *list, int index, const void *data, size_t size) {
         qdlobj_t *tgt = _get_obj(list, index);
         if (tgt == NULL) {
             // should not be happened.
-            free(dup_data);
-            free(obj);
+            _free_obj(list, obj);
             unlock(list);
             errno = EAGAIN;
             return false;
@@ -393,8 +415,13 @@ static bool addat(qlist_t *list, int index, const void *data, size_t size) {
         tgt->prev = obj;
     }
 
+    // elements after the index were shifted.
+    if (list->finger != NULL && index <= list->fingeridx)
+        list->fingeridx++;
+
     list->datasum += size;
     list->num++;
+    Q_STATS_INC(list->putmisses);
 
     unlock(list);
 
@@ -468,6 +495,8 @@ static void *getlast(qlist_t *list, size_t *size, bool newmem) {
  *  Negative index can be used for addressing a element from the end in this
  *  stack. For example, index -1 is same as getlast() and index 0 is same as
  *  getfirst();
+ *  The list remembers the last element accessed by index, so sequential or
+ *  nearby indexed access doesn't walk from the ends of the list.
  */
 static void *getat(qlist_t *list, int index, size_t *size, bool newmem) {
     return _get_at(list, index, size, newmem, false);
@@ -524,7 +553,7 @@ static bool getnext(qlist_t *list, qdlobj_t *obj, bool newmem) {
     bool ret = false;
     while (cont != NULL) {
         if (newmem == true) {
-            obj->data = malloc(cont->size);
+            obj->data = qlibc_malloc(cont->size);
             if (obj->data == NULL)
                 break;
 
@@ -544,6 +573,69 @@ static bool getnext(qlist_t *list, qdlobj_t *obj, bool newmem) {
     return ret;
 }
 
+/**
+ * qlist->iterbegin(): Start traversal without copying elements.
+ *
+ * @param list  qlist_t container pointer.
+ * @param it    iterator to initialize.
+ *
+ * @code
+ *  qiter_t it;
+ *  list->iterbegin(list, &it);
+ *  while (list->iternext(list, &it) == true) {
+ *    printf("DATA=%s, SIZE=%zu\n", (char *) it.data, it.size);
+ *  }
+ *  list->iterend(list, &it);
+ * @endcode
+ *
+ * @note
+ *  The list is locked until iterend(), which must always be called.
+ *  it.name is always NULL.
+ */
+static void iterbegin(qlist_t *list, qiter_t *it) {
+    memset((void *) it, 0, sizeof(qiter_t));
+    lock(list);
+}
+
+/**
+ * qlist->iternext(): Get next element between iterbegin() and iterend().
+ *
+ * @param list  qlist_t container pointer.
+ * @param it    iterator started by iterbegin().
+ *
+ * @return true if found otherwise returns false
+ * @retval errno will be set in error condition.
+ *  - ENOENT : No next element.
+ */
+static bool iternext(qlist_t *list, qiter_t *it) {
+    qdlobj_t *obj = (qdlobj_t *) it->cursor;
+    if (obj == NULL && it->idx == 0)
+        obj = list->first;
+    else if (obj != NULL)
+        obj = obj->next;
+    it->idx++;
+    it->cursor = obj;
+    if (obj == NULL) {
+        errno = ENOENT;
+        return false;
+    }
+
+    it->data = obj->data;
+    it->size = obj->size;
+    return true;
+}
+
+/**
+ * qlist->iterend(): Finish traversal started by iterbegin().
+ *
+ * @param list  qlist_t container pointer.
+ * @param it    iterator started by iterbegin().
+ */
+static void iterend(qlist_t *list, qiter_t *it) {
+    it->cursor = NULL;
+    unlock(list);
+}
+
 /**
  * qlist->popfirst(): Returns and remove the first element in this list.
  *
@@ -698,6 +790,82 @@ static void reverse(qlist_t *list) {
     list->first = list->last;
     list->last = obj;
 
+    if (list->finger != NULL)
+        list->fingeridx = list->num - 1 - list->fingeridx;
+
+    unlock(list);
+}
+
+/**
+ * qlist->sort(): Sort elements with a comparator.
+ *
+ * @param list  qlist_t container pointer.
+ * @param cmp   comparator returning negative, zero or positive value like
+ *              memcmp().
+ *
+ * @note
+ *  It's a stable merge sort running in O(n log n). Elements comparing equal
+ *  keep their order in the list.
+ *
+ * @code
+ *  static int cmpint(const qdlobj_t *obj1, const qdlobj_t *obj2) {
+ *    int a = *(int *)obj1->data, b = *(int *)obj2->data;
+ *    return (a > b) - (a < b);
+ *  }
+ *
+ *  list->sort(list, cmpint);
+ * @endcode
+ */
+static void sort_(qlist_t *list,
+                  int (*cmp)(const qdlobj_t *obj1, const qdlobj_t *obj2)) {
+    if (cmp == NULL)
+        return;
+
+    // run bottom-up merge sort on the links
+    lock(list);
+    qdlobj_t *head = list->first;
+    size_t width;
+    for (width = 1; head != NULL; width *= 2) {
+        qdlobj_t *p = head, *q, *tail = NULL;
+        size_t nmerges = 0;
+        head = NULL;
+        while (p != NULL) {
+            nmerges++;
+            // q starts after the run of p
+            size_t psize, qsize = width;
+            for (psize = 0, q = p; psize < width && q != NULL; psize++) {
+                q = q->next;
+            }
+
+            // merge two runs, taking from p on ties to keep it stable.
+            while (psize > 0 || (qsize > 0 && q != NULL)) {
+                qdlobj_t *e;
+                if (psize == 0) {
+                    e = q, q = q->next, qsize--;
+                } else if (qsize == 0 || q == NULL || cmp(p, q) <= 0) {
+                    e = p, p = p->next, psize--;
+                } else {
+                    e = q, q = q->next, qsize--;
+                }
+
+                if (tail != NULL)
+                    tail->next = e;
+                else
+                    head = e;
+                e->prev = tail;
+                tail = e;
+            }
+            p = q;
+        }
+        tail->next = NULL;
+
+        if (nmerges <= 1) {  // sorted
+            list->first = head;
+            list->last = tail;
+            break;
+        }
+    }
+    list->finger = NULL;
     unlock(list);
 }
 
@@ -711,15 +879,23 @@ static void clear(qlist_t *list) {
     qdlobj_t *obj;
     for (obj = list->first; obj;) {
         qdlobj_t *next = obj->next;
-        free(obj->data);
-        free(obj);
+        if (list->pool != NULL) {
+            // nodes are released all together below.
+            if (obj->data != (void *) (obj + 1))
+                qlibc_free(obj->data);
+        } else {
+            _free_obj(list, obj);
+        }
         obj = next;
     }
+    if (list->pool != NULL)
+        list->pool->clear(list->pool);
 
     list->num = 0;
     list->datasum = 0;
     list->first = NULL;
     list->last = NULL;
+    list->finger = NULL;
     unlock(list);
 }
 
@@ -746,7 +922,7 @@ static void *toarray(qlist_t *list, size_t *size) {
 
     lock(list);
 
-    void *chunk = malloc(list->datasum);
+    void *chunk = qlibc_malloc(list->datasum);
     if (chunk == NULL) {
         unlock(list);
         errno = ENOMEM;
@@ -789,7 +965,7 @@ static char *tostring(qlist_t *list) {
 
     lock(list);
 
-    void *chunk = malloc(list->datasum + 1);
+    void *chunk = qlibc_malloc(list->datasum + 1);
     if (chunk == NULL) {
         unlock(list);
         errno = ENOMEM;
@@ -841,6 +1017,133 @@ static bool debug(qlist_t *list, FILE *out) {
     return true;
 }
 
+/**
+ * qlist->stats(): Get statistics of this list.
+ *
+ * @param list  qlist_t container pointer.
+ * @param stats statistics will be stored here.
+ *
+ * @return true if successful, otherwise returns false.
+ * @retval errno will be set in error condition.
+ *  -EINVAL : Invalid argument.
+ *
+ * @note
+ *  A list has no keys nor slots, so only the number of elements, the
+ *  memory figures and lock wait time are filled. Every element added
+ *  counts as a put miss since nothing is replaced, and gets are accesses
+ *  by position including pops, which miss when the index is out of range.
+ */
+static bool stats(qlist_t *list, qstats_t *stats) {
+    if (stats == NULL) {
+        errno = EINVAL;
+        return false;
+    }
+    memset((void *) stats, 0, sizeof(qstats_t));
+
+    lock(list);
+    stats->num = list->num;
+    stats->valuebytes = list->datasum;
+    stats->overhead = sizeof(qlist_t);
+    if (list->qmutex != NULL)
+        stats->overhead += sizeof(qmutex_t);
+    if (list->pool != NULL) {
+        // small elements live in the unused tail of their nodes.
+        size_t nodesize = sizeof(qdlobj_t) + NODEPOOL_INLINE_SIZE;
+        qdlobj_t *obj;
+        for (obj = list->first; obj != NULL; obj = obj->next) {
+            stats->overhead += nodesize;
+            if (obj->data == (void *) (obj + 1))
+                stats->overhead -= obj->size;
+        }
+    } else {
+        stats->overhead += list->num * sizeof(qdlobj_t);
+    }
+    unlock(list);
+
+    stats->lockwaitns = _q_mutex_waitns(list->qmutex);
+    stats->gethits = Q_STATS_LOAD(list->gethits);
+    stats->getmisses = Q_STATS_LOAD(list->getmisses);
+    stats->putmisses = Q_STATS_LOAD(list->putmisses);
+    return true;
+}
+
+/**
+ * qlist->snapshot(): Save this list to a binary snapshot file.
+ *
+ * Elements are saved from the first to the last. The snapshot is written to
+ * a temporary file and renamed to filepath, so an existing snapshot is
+ * replaced at once.
+ *
+ * @param list      qlist_t container pointer.
+ * @param filepath  snapshot file path.
+ *
+ * @return true if successful, otherwise returns false.
+ * @retval errno will be set in error condition.
+ *  - EINVAL : Invalid argument.
+ *  - ENOMEM : Memory allocation failure.
+ *  - Others : errors from open() and write().
+ *
+ * @note
+ *  The file is in host byte order and not meant to be moved between
+ *  machines.
+ */
+static bool snapshot(qlist_t *list, const char *filepath) {
+    qsnap_t *snap = _q_snap_create(filepath, Q_SNAP_QLIST, 0);
+    if (snap == NULL)
+        return false;
+
+    bool ok = true;
+    lock(list);
+    qdlobj_t *obj;
+    for (obj = list->first; ok == true && obj != NULL; obj = obj->next) {
+        ok = _q_snap_write(snap, 0, NULL, 0, obj->data, obj->size);
+    }
+    unlock(list);
+
+    if (ok == false) {
+        _q_snap_abort(snap);
+        return false;
+    }
+    return _q_snap_commit(snap);
+}
+
+/**
+ * qlist->restore(): Append elements from a snapshot file made by
+ * snapshot() at the end of this list.
+ *
+ * @param list      qlist_t container pointer.
+ * @param filepath  snapshot file path.
+ *
+ * @return the number of loaded elements, otherwise returns -1.
+ * @retval errno will be set in error condition.
+ *  - EINVAL  : Invalid argument.
+ *  - EBADMSG : Not a qlist snapshot or checksum mismatch.
+ *  - ENOBUFS : List full.
+ *  - ENOMEM  : Memory allocation failure.
+ *
+ * @note
+ *  Elements loaded before an error are left in the list.
+ */
+static ssize_t restore(qlist_t *list, const char *filepath) {
+    size_t num = 0;
+    qsnap_t *snap = _q_snap_open(filepath, Q_SNAP_QLIST, NULL, &num);
+    if (snap == NULL)
+        return -1;
+
+    ssize_t cnt = 0;
+    qsnap_rec_t rec;
+    lock(list);
+    while (_q_snap_read(snap, &rec) == true) {
+        if (addat(list, -1, rec.data, rec.size) == false)
+            break;
+        cnt++;
+    }
+    unlock(list);
+    _q_snap_close(snap);
+
+    return (cnt == (ssize_t) num) ? cnt : -1;
+}
+
 /**
  * qlist->lock(): Enters critical section.
  *
@@ -870,9 +1173,11 @@ static void unlock(qlist_t *list) {
  */
 static void free_(qlist_t *list) {
     clear(list);
+    if (list->pool != NULL)
+        list->pool->free(list->pool);
     Q_MUTEX_DESTROY(list->qmutex);
 
-    free(list);
+    qlibc_free(list);
 }
 
 #ifndef _DOXYGEN_SKIP
@@ -884,14 +1189,16 @@ static void *_get_at(qlist_t *list, int index, size_t *size, bool newmem,
     // get object pointer
     qdlobj_t *obj = _get_obj(list, index);
     if (obj == NULL) {
+        Q_STATS_INC(list->getmisses);
         unlock(list);
         return false;
     }
+    Q_STATS_INC(list->gethits);
 
     // copy data
     void *data;
     if (newmem == true) {
-        data = malloc(obj->size);
+        data = qlibc_malloc(obj->size);
         if (data == NULL) {
             unlock(list);
             errno = ENOMEM;
@@ -908,7 +1215,7 @@ static void *_get_at(qlist_t *list, int index, size_t *size, bool newmem,
     if (remove == true) {
         if (_remove_obj(list, obj) == false) {
             if (newmem == true)
-                free(data);
+                qlibc_free(data);
             data = NULL;
         }
     }
@@ -922,48 +1229,72 @@ static qdlobj_t *_get_obj(qlist_t *list, int index) {
     // index adjustment
     if (index < 0)
         index = list->num + index;
-    if (index >= list->num) {
+    if (index < 0 || index >= list->num) {
         errno = ERANGE;
         return NULL;
     }
 
-    // detect faster scan direction
-    bool backward;
+    // start from the nearest one among first, last and finger.
     qdlobj_t *obj;
-    int listidx;
+    int listidx, dist;
     if (index < list->num / 2) {
-        backward = false;
         obj = list->first;
         listidx = 0;
+        dist = index;
     } else {
-        backward = true;
         obj = list->last;
         listidx = list->num - 1;
+        dist = listidx - index;
+    }
+    if (list->finger != NULL) {
+        int fingerdist = (int) list->fingeridx - index;
+        if (fingerdist < 0)
+            fingerdist = -fingerdist;
+        if (fingerdist < dist) {
+            obj = list->finger;
+            listidx = list->fingeridx;
+        }
     }
 
     // find object
-    while (obj != NULL) {
-        if (listidx == index)
-            return obj;
-
-        if (backward == false) {
-            obj = obj->next;
-            listidx++;
-        } else {
-            obj = obj->prev;
-            listidx--;
-        }
+    while (listidx < index && obj != NULL) {
+        obj = obj->next;
+        listidx++;
+    }
+    while (listidx > index && obj != NULL) {
+        obj = obj->prev;
+        listidx--;
+    }
+    if (obj == NULL) {
+        // never reach here
+        errno = ENOENT;
+        return NULL;
     }
 
-    // never reach here
-    errno = ENOENT;
-    return NULL;
+    // remember it for nearby access next time.
+    list->finger = obj;
+    list->fingeridx = index;
+
+    return obj;
 }
 
 static bool _remove_obj(qlist_t *list, qdlobj_t *obj) {
     if (obj == NULL)
         return false;
 
+    // keep finger on the same position if possible.
+    if (obj == list->finger) {
+        if (obj->next != NULL) {
+            list->finger = obj->next;
+        } else {
+            list->finger = obj->prev;
+            if (list->fingeridx > 0)
+                list->fingeridx--;
+        }
+    } else {
+        list->finger = NULL;
+    }
+
     // chain prev and next elements
     if (obj->prev == NULL)
         list->first = obj->next;
@@ -979,10 +1310,52 @@ static bool _remove_obj(qlist_t *list, qdlobj_t *obj) {
     list->num--;
 
     // release obj
-    free(obj->data);
-    free(obj);
+    _free_obj(list, obj);
 
     return true;
 }
 
+static qdlobj_t *_new_obj(qlist_t *list, const void *data, size_t size) {
+    qdlobj_t *obj;
+    if (list->pool != NULL) {
+        obj = (qdlobj_t *) list->pool->alloc(list->pool);
+        if (obj == NULL)
+            return NULL;
+        if (size <= NODEPOOL_INLINE_SIZE)
+            obj->data = (void *) (obj + 1);
+        else
+            obj->data = qlibc_malloc(size);
+    } else {
+        obj = (qdlobj_t *) qlibc_malloc(sizeof(qdlobj_t));
+        if (obj == NULL)
+            return NULL;
+        obj->data = qlibc_malloc(size);
+    }
+    if (obj->data == NULL) {
+        if (list->pool != NULL)
+            list->pool->release(list->pool, obj);
+        else
+            qlibc_free(obj);
+        return NULL;
+    }
+
+    memcpy(obj->data, data, size);
+    obj->size = size;
+    obj->prev = NULL;
+    obj->next = NULL;
+
+    return obj;
+}
+
+static void _free_obj(qlist_t *list, qdlobj_t *obj) {
+    if (list->pool != NULL) {
+        if (obj->data != (void *) (obj + 1))
+            qlibc_free(obj->data);
+        list->pool->release(list->pool, obj);
+    } else {
+        qlibc_free(obj->data);
+        qlibc_free(obj);
+    }
+}
+
 #endif /* _DOXYGEN_SKIP */
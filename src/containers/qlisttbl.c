@@ -90,6 +90,12 @@
  *  // free object
  *  tbl->free(tbl);
  * @endcode
+ *
+ * @note
+ *  Lookups scan the list by default. With QLISTTBL_HASHINDEX option, a side
+ *  hash index chains objects of the same hash slot in table order, so get(),
+ *  getmulti() and remove() visit only the objects in the slot while the table
+ *  order stays the same.
  */
 
 #include <stdio.h>
@@ -99,6 +105,7 @@
 #include <inttypes.h>
 #include <string.h>
 #include <stdarg.h>
+#include <ctype.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/stat.h>
@@ -117,29 +124,58 @@
  */
 #ifndef _DOXYGEN_SKIP
 
+#define IDX_DEFAULT_RANGE (16)
+#define INLINE_MAX        (48)  // name and data kept in the object
+
+#define INLINE_ALIGN(n)   (((n) + 7) & ~((size_t)7))
+#define INLINE_LEN(namelen, size) (INLINE_ALIGN((namelen) + 1) + (size))
+#define OBJ_SIZE(tbl)     (((tbl)->idxslots != NULL) ? sizeof(qlisttbl_idxobj_t) \
+                                                     : sizeof(qdlnobj_t))
+
+// object with index links in QLISTTBL_HASHINDEX mode.
+typedef struct qlisttbl_idxobj_s qlisttbl_idxobj_t;
+struct qlisttbl_idxobj_s {
+    qdlnobj_t obj;      // must be the first member
+    uint32_t idxhash;   // case folded hash in case insensitive mode
+    qdlnobj_t *hprev;   // previous object in the same index slot
+    qdlnobj_t *hnext;   // next object in the same index slot
+};
+#define IDXOBJ(o) ((qlisttbl_idxobj_t *)(o))
+
 static bool put(qlisttbl_t *tbl, const char *name, const void *data, size_t size);
 static bool putstr(qlisttbl_t *tbl, const char *name, const char *str);
 static bool putstrf(qlisttbl_t *tbl, const char *name, const char *format, ...);
 static bool putint(qlisttbl_t *tbl, const char *name, int64_t num);
+static size_t putbatch(qlisttbl_t *tbl, const qnobj_t *objs, size_t num);
 
 static void *get(qlisttbl_t *tbl, const char *name, size_t *size, bool newmem);
 static char *getstr(qlisttbl_t *tbl, const char *name, bool newmem);
 static int64_t getint(qlisttbl_t *tbl, const char *name);
+static size_t getbatch(qlisttbl_t *tbl, qnobj_t *objs, size_t num, bool newmem);
 
 static qobj_t *getmulti(qlisttbl_t *tbl, const char *name, bool newmem, size_t *numobjs);
 static void freemulti(qobj_t *objs);
 static bool getnext(qlisttbl_t *tbl, qdlnobj_t *obj, const char *name, bool newmem);
+static void iterbegin(qlisttbl_t *tbl, qiter_t *it);
+static bool iternext(qlisttbl_t *tbl, qiter_t *it);
+static void iterend(qlisttbl_t *tbl, qiter_t *it);
 
 static size_t remove_(qlisttbl_t *tbl, const char *name);
 static bool removeobj(qlisttbl_t *tbl, const qdlnobj_t *obj);
 
 static size_t size(qlisttbl_t *tbl);
 static void sort_(qlisttbl_t *tbl);
+static void sortby(qlisttbl_t *tbl,
+                   int (*cmp)(const qdlnobj_t *obj1, const qdlnobj_t *obj2));
 static void clear(qlisttbl_t *tbl);
 
 static bool save(qlisttbl_t *tbl, const char *filepath, char sepchar, bool encode);
 static ssize_t load(qlisttbl_t *tbl, const char *filepath, char sepchar, bool decode);
 static bool debug(qlisttbl_t *tbl, FILE *out);
+static bool stats(qlisttbl_t *tbl, qstats_t *stats);
+static bool snapshot(qlisttbl_t *tbl, const char *filepath);
+static ssize_t restore(qlisttbl_t *tbl, const char *filepath);
+static qfrozentbl_t *freeze(qlisttbl_t *tbl);
 
 static void lock(qlisttbl_t *tbl);
 static void unlock(qlisttbl_t *tbl);
@@ -147,7 +183,15 @@ static void unlock(qlisttbl_t *tbl);
 static void free_(qlisttbl_t *tbl);
 
 /* internal functions */
-static qdlnobj_t *_createobj(const char *name, const void *data, size_t size);
+static qdlnobj_t *_createobj(qlisttbl_t *tbl, const char *name,
+                             const void *data, size_t size);
+static void _freeobj(qlisttbl_t *tbl, qdlnobj_t *obj);
+static void _removeobj(qlisttbl_t *tbl, qdlnobj_t *obj);
+static uint32_t _idxhash(qlisttbl_t *tbl, const char *name, uint32_t hash);
+static void _idxadd(qlisttbl_t *tbl, qdlnobj_t *obj);
+static void _idxremove(qlisttbl_t *tbl, qdlnobj_t *obj);
+static bool _idxrebuild(qlisttbl_t *tbl, size_t range);
+static qdlnobj_t *_idxlastobj(qlisttbl_t *tbl, const qdlnobj_t *obj);
 static bool _insertobj(qlisttbl_t *tbl, qdlnobj_t *obj);
 static qdlnobj_t *_findobj(qlisttbl_t *tbl, const char *name, qdlnobj_t *retobj);
 
@@ -177,10 +221,19 @@ static bool _namecasematch(qdlnobj_t *obj, const char *name, uint32_t hash);
  *   - QLISTTBL_CASEINSENSITIVE  - key is case insensitive
  *   - QLISTTBL_INSERTTOP        - insert new key at the top
  *   - QLISTTBL_LOOKUPFORWARD    - find key from the top
+ *   - QLISTTBL_NODEPOOL         - allocate objects from a pool
+ *   - QLISTTBL_HASHINDEX        - keep a hash index of keys for fast lookups
+ *   - QLISTTBL_REFERENCE        - store names and data by reference without
+ *                                 copy. The caller keeps the memory valid
+ *                                 while it's in the table. putstrf(), putint()
+ *                                 and load() aren't available in this mode.
+ *
+ *   Short names and data, up to 48 bytes together, are stored inline right
+ *   after the object, so such a put() makes one allocation instead of three.
  */
 qlisttbl_t *qlisttbl(int options)
 {
-    qlisttbl_t *tbl = (qlisttbl_t *)calloc(1, sizeof(qlisttbl_t));
+    qlisttbl_t *tbl = (qlisttbl_t *)qlibc_calloc(1, sizeof(qlisttbl_t));
     if (tbl == NULL) {
         errno = ENOMEM;
         return NULL;
@@ -191,15 +244,20 @@ qlisttbl_t *qlisttbl(int options)
     tbl->putstr     = putstr;
     tbl->putstrf    = putstrf;
     tbl->putint     = putint;
+    tbl->putbatch   = putbatch;
 
     tbl->get        = get;
     tbl->getstr     = getstr;
     tbl->getint     = getint;
+    tbl->getbatch   = getbatch;
 
     tbl->getmulti   = getmulti;
     tbl->freemulti  = freemulti;
 
     tbl->getnext    = getnext;
+    tbl->iterbegin  = iterbegin;
+    tbl->iternext   = iternext;
+    tbl->iterend    = iterend;
 
     tbl->remove     = remove_;
     tbl->removeobj  = removeobj;
@@ -207,11 +265,16 @@ qlisttbl_t *qlisttbl(int options)
 
     tbl->size       = size;
     tbl->sort       = sort_;
+    tbl->sortby     = sortby;
     tbl->clear      = clear;
 
     tbl->save       = save;
     tbl->load       = load;
     tbl->debug      = debug;
+    tbl->stats      = stats;
+    tbl->snapshot   = snapshot;
+    tbl->restore    = restore;
+    tbl->freeze     = freeze;
 
     tbl->lock       = lock;
     tbl->unlock     = unlock;
@@ -227,7 +290,7 @@ qlisttbl_t *qlisttbl(int options)
         Q_MUTEX_NEW(tbl->qmutex, true);
         if (tbl->qmutex == NULL) {
             errno = ENOMEM;
-            free(tbl);
+            qlibc_free(tbl);
             return NULL;
         }
     }
@@ -237,6 +300,7 @@ qlisttbl_t *qlisttbl(int options)
     if (options & QLISTTBL_CASEINSENSITIVE) {
         tbl->namematch = _namecasematch;
         tbl->namecmp = strcasecmp;
+        tbl->caseinsensitive = true;
     }
     if (options & QLISTTBL_INSERTTOP) {
       tbl->inserttop = true;
@@ -244,6 +308,29 @@ qlisttbl_t *qlisttbl(int options)
     if (options & QLISTTBL_LOOKUPFORWARD) {
       tbl->lookupforward = true;
     }
+    if (options & QLISTTBL_REFERENCE) {
+        tbl->reference = true;
+    }
+    if (options & QLISTTBL_HASHINDEX) {
+        if (_idxrebuild(tbl, IDX_DEFAULT_RANGE) == false) {
+            errno = ENOMEM;
+            Q_MUTEX_DESTROY(tbl->qmutex);
+            qlibc_free(tbl);
+            return NULL;
+        }
+    }
+    if (options & QLISTTBL_NODEPOOL) {
+        // objects are made and freed outside of the table lock.
+        tbl->pool = qpool(OBJ_SIZE(tbl) + INLINE_MAX,
+                          (tbl->qmutex != NULL) ? QPOOL_THREADSAFE : 0);
+        if (tbl->pool == NULL) {
+            qlibc_free(tbl->idxslots);
+            errno = ENOMEM;
+            Q_MUTEX_DESTROY(tbl->qmutex);
+            qlibc_free(tbl);
+            return NULL;
+        }
+    }
 
     return tbl;
 }
@@ -281,7 +368,7 @@ qlisttbl_t *qlisttbl(int options)
 static bool put(qlisttbl_t *tbl, const char *name, const void *data, size_t size)
 {
     // make new object table
-    qdlnobj_t *obj = _createobj(name, data, size);
+    qdlnobj_t *obj = _createobj(tbl, name, data, size);
     if (obj == NULL) {
         return false;
     }
@@ -290,7 +377,8 @@ static bool put(qlisttbl_t *tbl, const char *name, const void *data, size_t size
     lock(tbl);
 
     // if unique flag is set, remove same key
-    if (tbl->unique == true) remove_(tbl, name);
+    if (tbl->unique == true && remove_(tbl, name) > 0) Q_STATS_INC(tbl->puthits);
+    else Q_STATS_INC(tbl->putmisses);
 
     // insert into table
     if (tbl->num == 0) {
@@ -342,9 +430,15 @@ static bool putstr(qlisttbl_t *tbl, const char *name, const char *str)
  * @retval errno will be set in error condition.
  *  - ENOMEM : Memory allocation failure.
  *  - EINVAL : Invalid argument.
+ *  - ENOTSUP : Not available with QLISTTBL_REFERENCE.
  */
 static bool putstrf(qlisttbl_t *tbl, const char *name, const char *format, ...)
 {
+    if (tbl->reference == true) {
+        errno = ENOTSUP;
+        return false;
+    }
+
     char *str;
     DYNAMIC_VSPRINTF(str, format);
     if (str == NULL) {
@@ -353,7 +447,7 @@ static bool putstrf(qlisttbl_t *tbl, const char *name, const char *format, ...)
     }
 
     bool ret = putstr(tbl, name, str);
-    free(str);
+    qlibc_free(str);
 
     return ret;
 }
@@ -369,6 +463,7 @@ static bool putstrf(qlisttbl_t *tbl, const char *name, const char *format, ...)
  * @retval errno will be set in error condition.
  *  - ENOMEM : Memory allocation failure.
  *  - EINVAL : Invalid argument.
+ *  - ENOTSUP : Not available with QLISTTBL_REFERENCE.
  *
  * @note
  *  The integer will be converted to a string object and stored as a string
@@ -376,11 +471,93 @@ static bool putstrf(qlisttbl_t *tbl, const char *name, const char *format, ...)
  */
 static bool putint(qlisttbl_t *tbl, const char *name, int64_t num)
 {
+    if (tbl->reference == true) {
+        errno = ENOTSUP;
+        return false;
+    }
+
     char str[20+1];
     snprintf(str, sizeof(str), "%"PRId64, num);
     return putstr(tbl, name, str);
 }
 
+/**
+ * qlisttbl->putbatch(): Put multiple elements into this table at once.
+ *
+ * @param tbl       qlisttbl container pointer.
+ * @param objs      array of elements to put. name, data and size are used.
+ * @param num       number of elements in the array.
+ *
+ * @return the number of elements successfully stored.
+ * @retval errno will be set in error condition.
+ *  - ENOMEM : Memory allocation failure.
+ *  - EINVAL : Invalid argument.
+ *
+ * @code
+ *  qnobj_t headers[2] = {
+ *      { "Host", "www.qdecoder.org", 17 },
+ *      { "Accept", "text/html", 10 }
+ *  };
+ *  tbl->putbatch(tbl, headers, 2);
+ * @endcode
+ *
+ * @note
+ *  Elements are stored in the order of the array and the lock is obtained
+ *  only once for the whole batch. All the copies are made before entering
+ *  the critical section.
+ */
+static size_t putbatch(qlisttbl_t *tbl, const qnobj_t *objs, size_t num)
+{
+    if (objs == NULL) {
+        errno = EINVAL;
+        return 0;
+    }
+
+    // make objects outside of the lock.
+    qdlnobj_t **newobjs = (qdlnobj_t **)qlibc_malloc(sizeof(qdlnobj_t *) * num);
+    if (newobjs == NULL) {
+        errno = ENOMEM;
+        return 0;
+    }
+    size_t i;
+    for (i = 0; i < num; i++) {
+        newobjs[i] = _createobj(tbl, objs[i].name, objs[i].data,
+                                objs[i].size);
+        if (newobjs[i] != NULL) {
+            newobjs[i]->hash = qhashmurmur3_32(objs[i].name, strlen(objs[i].name));
+        }
+    }
+
+    size_t numput = 0;
+    lock(tbl);
+    for (i = 0; i < num; i++) {
+        qdlnobj_t *obj = newobjs[i];
+        if (obj == NULL) continue;
+
+        if (tbl->unique == true && remove_(tbl, obj->name) > 0) {
+            Q_STATS_INC(tbl->puthits);
+        } else {
+            Q_STATS_INC(tbl->putmisses);
+        }
+        if (tbl->num == 0) {
+            obj->prev = NULL;
+            obj->next = NULL;
+        } else if (tbl->inserttop == false) {
+            obj->prev = tbl->last;
+            obj->next = NULL;
+        } else {
+            obj->prev = NULL;
+            obj->next = tbl->first;
+        }
+        _insertobj(tbl, obj);
+        numput++;
+    }
+    unlock(tbl);
+
+    qlibc_free(newobjs);
+    return numput;
+}
+
 /**
  * qlisttbl->get(): Finds an object with given name.
  * If there are duplicate keys in the table, this will return the first matched
@@ -430,10 +607,12 @@ static void *get(qlisttbl_t *tbl, const char *name, size_t *size, bool newmem)
     lock(tbl);
     void *data = NULL;
     qdlnobj_t *obj = _findobj(tbl, name, NULL);
+    if (obj != NULL) Q_STATS_INC(tbl->gethits);
+    else Q_STATS_INC(tbl->getmisses);
     if (obj != NULL) {
         // get data
         if (newmem == true) {
-            data = malloc(obj->size);
+            data = qlibc_malloc(obj->size);
             if (data == NULL) {
                 errno = ENOMEM;
                 unlock(tbl);
@@ -494,11 +673,52 @@ static int64_t getint(qlisttbl_t *tbl, const char *name)
     char *str = getstr(tbl, name, true);
     if (str != NULL) {
         num = atoll(str);
-        free(str);
+        qlibc_free(str);
     }
     return num;
 }
 
+/**
+ * qlisttbl->getbatch(): Finds multiple objects at once.
+ *
+ * @param tbl       qlisttbl container pointer.
+ * @param objs      array of objects. name should be set by user, then data
+ *                  and size will be stored. data will be set to NULL if the
+ *                  name is not found.
+ * @param num       number of objects in the array.
+ * @param newmem    whether or not to allocate memory for the data.
+ *
+ * @return the number of names found.
+ * @retval errno will be set in error condition.
+ *  - ENOENT : Some of names are not found.
+ *  - EINVAL : Invalid argument.
+ *  - ENOMEM : Memory allocation failure.
+ *
+ * @note
+ *  Each name is looked up the same way as get() does, but the lock is
+ *  obtained only once for the whole batch.
+ */
+static size_t getbatch(qlisttbl_t *tbl, qnobj_t *objs, size_t num, bool newmem)
+{
+    if (objs == NULL) {
+        errno = EINVAL;
+        return 0;
+    }
+
+    size_t numfound = 0;
+    size_t i;
+    lock(tbl);
+    for (i = 0; i < num; i++) {
+        objs[i].size = 0;
+        objs[i].data = get(tbl, objs[i].name, &objs[i].size, newmem);
+        if (objs[i].data != NULL) numfound++;
+    }
+    unlock(tbl);
+
+    if (numfound < num) errno = ENOENT;
+    return numfound;
+}
+
 /**
  * qlisttbl->getmulti(): Finds all objects with given name and return a array
  * of objects. If there are duplicate keys in the table, this will return all
@@ -547,7 +767,7 @@ static qobj_t *getmulti(qlisttbl_t *tbl, const char *name, bool newmem,
         if (numfound >= allocobjs) {
             if (allocobjs == 0) allocobjs = 10;  // start from 10
             else allocobjs *= 2;  // double size
-            objs = (qobj_t *)realloc(objs, sizeof(qobj_t) * allocobjs);
+            objs = (qobj_t *)qlibc_realloc(objs, sizeof(qobj_t) * allocobjs);
             if (objs == NULL) {
                 DEBUG("qlisttbl->getmulti(): Memory reallocation failure.");
                 errno = ENOMEM;
@@ -563,7 +783,7 @@ static qobj_t *getmulti(qlisttbl_t *tbl, const char *name, bool newmem,
 
         // release resource
         if (newmem == true) {
-            if (obj.name != NULL) free(obj.name);
+            if (obj.name != NULL) qlibc_free(obj.name);
         }
 
         // clear next block
@@ -605,10 +825,10 @@ static void freemulti(qobj_t *objs)
 
     qobj_t *obj;
     for (obj = &objs[0]; obj->type == 2; obj++) {
-        if (obj->data != NULL) free(obj->data);
+        if (obj->data != NULL) qlibc_free(obj->data);
     }
 
-    free(objs);
+    qlibc_free(objs);
 }
 
 /**
@@ -665,14 +885,25 @@ static bool getnext(qlisttbl_t *tbl, qdlnobj_t *obj, const char *name,
     lock(tbl);
 
     qdlnobj_t *cont = NULL;
+    bool indexed = false;  // follow the index chain
     if (obj->size == 0) {  // first time call
         if (name == NULL) {  // full scan
             cont = (tbl->lookupforward) ? tbl->first : tbl->last;
         } else {  // name search
             cont = _findobj(tbl, name, NULL);
+            indexed = (tbl->idxslots != NULL);
         }
     } else {  // next call
         cont = (tbl->lookupforward) ? obj->next : obj->prev;
+        if (name != NULL && tbl->idxslots != NULL) {
+            // continue on the index chain unless the last one was removed.
+            qdlnobj_t *lastobj = _idxlastobj(tbl, obj);
+            if (lastobj != NULL) {
+                cont = (tbl->lookupforward) ? IDXOBJ(lastobj)->hnext
+                                            : IDXOBJ(lastobj)->hprev;
+                indexed = true;
+            }
+        }
     }
 
     if (cont == NULL) {
@@ -687,11 +918,11 @@ static bool getnext(qlisttbl_t *tbl, qdlnobj_t *obj, const char *name,
     while (cont != NULL) {
         if (name == NULL || tbl->namematch(cont, name, hash) == true) {
             if (newmem == true) {
-                obj->name = strdup(cont->name);
-                obj->data = malloc(cont->size);
+                obj->name = qlibc_strdup(cont->name);
+                obj->data = qlibc_malloc(cont->size);
                 if (obj->name == NULL || obj->data == NULL) {
-                    if (obj->name != NULL) free(obj->name);
-                    if (obj->data != NULL) free(obj->data);
+                    if (obj->name != NULL) qlibc_free(obj->name);
+                    if (obj->data != NULL) qlibc_free(obj->data);
                     obj->name = NULL;
                     obj->data = NULL;
                     errno = ENOMEM;
@@ -711,7 +942,12 @@ static bool getnext(qlisttbl_t *tbl, qdlnobj_t *obj, const char *name,
             break;
         }
 
-        cont = (tbl->lookupforward) ? cont->next : cont->prev;
+        if (indexed == true) {
+            cont = (tbl->lookupforward) ? IDXOBJ(cont)->hnext
+                                        : IDXOBJ(cont)->hprev;
+        } else {
+            cont = (tbl->lookupforward) ? cont->next : cont->prev;
+        }
     }
     unlock(tbl);
 
@@ -722,6 +958,79 @@ static bool getnext(qlisttbl_t *tbl, qdlnobj_t *obj, const char *name,
     return ret;
 }
 
+/**
+ * qlisttbl->iterbegin(): Start traversal without copying elements.
+ *
+ * @param tbl   qlisttbl container pointer.
+ * @param it    iterator to initialize.
+ *
+ * @code
+ *  qiter_t it;
+ *  tbl->iterbegin(tbl, &it);
+ *  while (tbl->iternext(tbl, &it) == true) {
+ *    printf("NAME=%s, SIZE=%zu\n", it.name, it.size);
+ *  }
+ *  tbl->iterend(tbl, &it);
+ * @endcode
+ *
+ * @note
+ *  Elements are visited in the same direction as getnext(). The table is
+ *  locked until iterend(), which must always be called.
+ */
+static void iterbegin(qlisttbl_t *tbl, qiter_t *it)
+{
+    memset((void *)it, 0, sizeof(qiter_t));
+    lock(tbl);
+}
+
+/**
+ * qlisttbl->iternext(): Get next element between iterbegin() and iterend().
+ *
+ * @param tbl   qlisttbl container pointer.
+ * @param it    iterator started by iterbegin().
+ *
+ * @return true if found otherwise returns false
+ * @retval errno will be set in error condition.
+ *  - ENOENT : No next element.
+ *
+ * @note
+ *  it.name, it.namelen, it.data and it.size point into the table, nothing
+ *  is allocated.
+ */
+static bool iternext(qlisttbl_t *tbl, qiter_t *it)
+{
+    qdlnobj_t *obj = (qdlnobj_t *)it->cursor;
+    if (obj == NULL && it->idx == 0) {
+        obj = (tbl->lookupforward) ? tbl->first : tbl->last;
+    } else if (obj != NULL) {
+        obj = (tbl->lookupforward) ? obj->next : obj->prev;
+    }
+    it->idx++;
+    it->cursor = obj;
+    if (obj == NULL) {
+        errno = ENOENT;
+        return false;
+    }
+
+    it->name = obj->name;
+    it->namelen = strlen(obj->name);
+    it->data = obj->data;
+    it->size = obj->size;
+    return true;
+}
+
+/**
+ * qlisttbl->iterend(): Finish traversal started by iterbegin().
+ *
+ * @param tbl   qlisttbl container pointer.
+ * @param it    iterator started by iterbegin().
+ */
+static void iterend(qlisttbl_t *tbl, qiter_t *it)
+{
+    it->cursor = NULL;
+    unlock(tbl);
+}
+
 /**
  * qlisttbl->remove(): Remove matched objects with given name.
  *
@@ -736,6 +1045,24 @@ static size_t remove_(qlisttbl_t *tbl, const char *name)
 
     size_t numremoved = 0;
 
+    if (tbl->idxslots != NULL) {
+        lock(tbl);
+        uint32_t hash = qhashmurmur3_32(name, strlen(name));
+        uint32_t idxhash = _idxhash(tbl, name, hash);
+        qdlnobj_t *obj = tbl->idxslots[idxhash & (tbl->idxrange - 1)].head;
+        while (obj != NULL) {
+            qdlnobj_t *next = IDXOBJ(obj)->hnext;
+            if (IDXOBJ(obj)->idxhash == idxhash
+                && tbl->namematch(obj, name, hash) == true) {
+                _removeobj(tbl, obj);
+                numremoved++;
+            }
+            obj = next;
+        }
+        unlock(tbl);
+        return numremoved;
+    }
+
     qdlnobj_t obj;
     memset((void*)&obj, 0, sizeof(obj)); // must be cleared before call
     lock(tbl);
@@ -797,23 +1124,10 @@ static bool removeobj(qlisttbl_t *tbl, const qdlnobj_t *obj)
         return false;
     }
 
-    // adjust chain links
-    if (prev == NULL) tbl->first = next; // if the object is first one
-    else prev->next = next;  // not the first one
-
-    if (next == NULL) tbl->last = prev; // if the object is last one
-    else next->prev = prev;  // not the first one
-
-    // adjust counter
-    tbl->num--;
+    _removeobj(tbl, this);
 
     unlock(tbl);
 
-    // free object
-    free(this->name);
-    free(this->data);
-    free(this);
-
     return true;
 }
 
@@ -837,6 +1151,9 @@ static size_t size(qlisttbl_t *tbl)
  * @note
  *  It will sort the table in ascending manner, if you need descending order somehow,
  *  lookup-backword option will do the job without changing the order in the table.
+ *  Keys are compared by strcmp(), or strcasecmp() in case of
+ *  QLISTTBL_CASEINSENSITIVE option. It's a stable merge sort running in
+ *  O(n log n). Use sortby() to give a custom comparator.
  *
  * @code
  *  The appearence order of duplicated keys will be preserved in a sored table.
@@ -853,32 +1170,77 @@ static size_t size(qlisttbl_t *tbl)
  */
 static void sort_(qlisttbl_t *tbl)
 {
-    // run bubble sort
+    sortby(tbl, NULL);
+}
+
+/**
+ * qlisttbl->sortby(): Sort objects in this table with a comparator.
+ *
+ * @param tbl   qlisttbl container pointer.
+ * @param cmp   comparator returning negative, zero or positive value like
+ *              strcmp(). if it's NULL, objects are sorted by key like sort().
+ *
+ * @note
+ *  Objects comparing equal keep their order in the table.
+ *
+ * @code
+ *  static int cmpsize(const qdlnobj_t *obj1, const qdlnobj_t *obj2) {
+ *    return (obj1->size > obj2->size) - (obj1->size < obj2->size);
+ *  }
+ *
+ *  tbl->sortby(tbl, cmpsize);
+ * @endcode
+ */
+static void sortby(qlisttbl_t *tbl,
+                   int (*cmp)(const qdlnobj_t *obj1, const qdlnobj_t *obj2))
+{
+    // run bottom-up merge sort on the links
     lock(tbl);
-    qdlnobj_t *obj1, *obj2;
-    qdlnobj_t tmpobj;
-    int n, n2, i;
-    for (n = tbl->num; n > 0;) {
-        n2 = 0;
-        for (i = 0, obj1 = tbl->first; i < (n - 1); i++, obj1 = obj1->next) {
-            obj2 = obj1->next;  // this can't be null.
-            if (tbl->namecmp(obj1->name, obj2->name) > 0) {
-                // swapping contents is faster than adjusting links.
-                tmpobj = *obj1;
-                obj1->hash = obj2->hash;
-                obj1->name = obj2->name;
-                obj1->data = obj2->data;
-                obj1->size = obj2->size;
-                obj2->hash = tmpobj.hash;
-                obj2->name = tmpobj.name;
-                obj2->data = tmpobj.data;
-                obj2->size = tmpobj.size;
-
-                n2 = i + 1;
+    qdlnobj_t *list = tbl->first;
+    size_t width;
+    for (width = 1; list != NULL; width *= 2) {
+        qdlnobj_t *p = list, *q, *tail = NULL;
+        size_t nmerges = 0;
+        list = NULL;
+        while (p != NULL) {
+            nmerges++;
+            // q starts after the run of p
+            size_t psize, qsize = width;
+            for (psize = 0, q = p; psize < width && q != NULL; psize++) {
+                q = q->next;
+            }
+
+            // merge two runs, taking from p on ties to keep it stable.
+            while (psize > 0 || (qsize > 0 && q != NULL)) {
+                qdlnobj_t *e;
+                if (psize == 0) {
+                    e = q, q = q->next, qsize--;
+                } else if (qsize == 0 || q == NULL
+                           || ((cmp != NULL) ? cmp(p, q)
+                               : tbl->namecmp(p->name, q->name)) <= 0) {
+                    e = p, p = p->next, psize--;
+                } else {
+                    e = q, q = q->next, qsize--;
+                }
+
+                if (tail != NULL) tail->next = e;
+                else list = e;
+                e->prev = tail;
+                tail = e;
             }
+            p = q;
+        }
+        tail->next = NULL;
+
+        if (nmerges <= 1) {  // sorted
+            tbl->first = list;
+            tbl->last = tail;
+            break;
         }
-        n = n2;  // skip sorted tailing elements
     }
+
+    // objects have moved, so index them again.
+    if (tbl->idxslots != NULL) _idxrebuild(tbl, tbl->idxrange);
     unlock(tbl);
 }
 
@@ -893,15 +1255,17 @@ static void clear(qlisttbl_t *tbl)
     qdlnobj_t *obj;
     for (obj = tbl->first; obj != NULL;) {
         qdlnobj_t *next = obj->next;
-        free(obj->name);
-        free(obj->data);
-        free(obj);
+        _freeobj(tbl, obj);
         obj = next;
     }
 
     tbl->num = 0;
     tbl->first = NULL;
     tbl->last = NULL;
+    if (tbl->idxslots != NULL) {
+        memset((void *)tbl->idxslots, 0,
+               sizeof(qlisttbl_idxslot_t) * tbl->idxrange);
+    }
     unlock(tbl);
 }
 
@@ -936,7 +1300,7 @@ static bool save(qlisttbl_t *tbl, const char *filepath, char sepchar,
 
     char *gmtstr = qtime_gmt_str(0);
     qio_printf(fd, -1, "# %s %s\n", filepath, gmtstr);
-    free(gmtstr);
+    qlibc_free(gmtstr);
 
     lock(tbl);
     qdlnobj_t *obj;
@@ -945,7 +1309,7 @@ static bool save(qlisttbl_t *tbl, const char *filepath, char sepchar,
         if (encode == true) encval = qurl_encode(obj->data, obj->size);
         else encval = obj->data;
         qio_printf(fd, -1, "%s%c%s\n", obj->name, sepchar, encval);
-        if (encode == true) free(encval);
+        if (encode == true) qlibc_free(encval);
     }
     unlock(tbl);
 
@@ -965,10 +1329,17 @@ static bool save(qlisttbl_t *tbl, const char *filepath, char sepchar,
  * @param decode    flag for decoding data
  *
  * @return the number of loaded entries, otherwise returns -1.
+ * @retval errno will be set in error condition.
+ *  - ENOTSUP : Not available with QLISTTBL_REFERENCE.
  */
 static ssize_t load(qlisttbl_t *tbl, const char *filepath, char sepchar,
                     bool decode)
 {
+    if (tbl->reference == true) {
+        errno = ENOTSUP;
+        return -1;
+    }
+
     // load file
     char *str = qfile_load(filepath, NULL);
     if (str == NULL) return -1;
@@ -989,21 +1360,23 @@ static ssize_t load(qlisttbl_t *tbl, const char *filepath, char sepchar,
         // skip blank or comment line
         if ((buf[0] == '#') || (buf[0] == '\0')) continue;
 
-        // parse
-        char *data = strdup(buf);
-        char *name  = _q_makeword(data, sepchar);
+        // split in place, put() makes its own copies.
+        char *name = buf;
+        char *data = strchr(buf, sepchar);
+        if (data != NULL) {
+            *data++ = '\0';
+        } else {
+            data = buf + strlen(buf);
+        }
         qstrtrim(data);
         qstrtrim(name);
         if (decode == true) qurl_decode(data);
 
         // add to the table.
-        put(tbl, name, data, strlen(data) + 1);
-
-        free(name);
-        free(data);
+        if (put(tbl, name, data, strlen(data) + 1) == true) cnt++;
     }
     unlock(tbl);
-    free(str);
+    qlibc_free(str);
 
     return cnt;
 }
@@ -1037,6 +1410,235 @@ static bool debug(qlisttbl_t *tbl, FILE *out)
     return true;
 }
 
+/**
+ * qlisttbl->stats(): Get statistics of this table.
+ *
+ * @param tbl qlisttbl container pointer.
+ * @param stats statistics will be stored here.
+ *
+ * @return true if successful, otherwise returns false.
+ * @retval errno will be set in error condition.
+ *  - EINVAL : Invalid argument.
+ *
+ * @note
+ *  Without QLISTTBL_HASHINDEX, a lookup may walk the whole table, so
+ *  maxchain is the number of objects and there are no slots. With the
+ *  index, slot figures are of the index. Duplicate keys of a non-unique
+ *  table are counted as collisions since they share a slot.
+ */
+static bool stats(qlisttbl_t *tbl, qstats_t *stats)
+{
+    if (stats == NULL) {
+        errno = EINVAL;
+        return false;
+    }
+    memset((void *)stats, 0, sizeof(qstats_t));
+
+    lock(tbl);
+    qdlnobj_t *obj;
+    for (obj = tbl->first; obj; obj = obj->next) {
+        stats->keybytes += strlen(obj->name) + 1;
+        stats->valuebytes += obj->size;
+    }
+    stats->num = tbl->num;
+    stats->overhead = sizeof(qlisttbl_t) + tbl->num
+                      * OBJ_SIZE(tbl);
+    if (tbl->qmutex != NULL) stats->overhead += sizeof(qmutex_t);
+
+    if (tbl->idxslots != NULL) {
+        size_t idx;
+        for (idx = 0; idx < tbl->idxrange; idx++) {
+            size_t chain = 0;
+            for (obj = tbl->idxslots[idx].head; obj; obj = IDXOBJ(obj)->hnext) {
+                chain++;
+            }
+            if (chain == 0) continue;
+            stats->usedslots++;
+            stats->collisions += chain - 1;
+            if (chain > stats->maxchain) stats->maxchain = chain;
+        }
+        stats->slots = tbl->idxrange;
+        stats->loadfactor = (double)tbl->num / tbl->idxrange;
+        stats->overhead += tbl->idxrange * sizeof(qlisttbl_idxslot_t);
+    } else {
+        stats->maxchain = tbl->num;
+    }
+    unlock(tbl);
+
+    stats->lockwaitns = _q_mutex_waitns(tbl->qmutex);
+    stats->gethits = Q_STATS_LOAD(tbl->gethits);
+    stats->getmisses = Q_STATS_LOAD(tbl->getmisses);
+    stats->puthits = Q_STATS_LOAD(tbl->puthits);
+    stats->putmisses = Q_STATS_LOAD(tbl->putmisses);
+    return true;
+}
+
+/**
+ * qlisttbl->snapshot(): Save qlisttbl to a binary snapshot file.
+ * Unlike save(), names and data are stored as they are without encoding,
+ * together with the hash of each name, in the order from the top to the
+ * bottom. The snapshot is written to a temporary file and renamed to
+ * filepath, so an existing snapshot is replaced at once.
+ *
+ * @param tbl       qlisttbl container pointer.
+ * @param filepath  snapshot file path
+ *
+ * @return true if successful, otherwise returns false.
+ * @retval errno will be set in error condition.
+ *  - EINVAL : Invalid argument.
+ *  - ENOMEM : Memory allocation failure.
+ *  - Others : errors from open() and write().
+ *
+ * @note
+ *  The file is in host byte order and not meant to be moved between
+ *  machines.
+ */
+static bool snapshot(qlisttbl_t *tbl, const char *filepath)
+{
+    qsnap_t *snap = _q_snap_create(filepath, Q_SNAP_QLISTTBL,
+                                   (tbl->unique == true) ? QLISTTBL_UNIQUE : 0);
+    if (snap == NULL) return false;
+
+    bool ok = true;
+    lock(tbl);
+    qdlnobj_t *obj;
+    for (obj = tbl->first; ok == true && obj; obj = obj->next) {
+        ok = _q_snap_write(snap, obj->hash, obj->name, strlen(obj->name),
+                           obj->data, obj->size);
+    }
+    unlock(tbl);
+
+    if (ok == false) {
+        _q_snap_abort(snap);
+        return false;
+    }
+    return _q_snap_commit(snap);
+}
+
+/**
+ * qlisttbl->restore(): Load and append entries from a snapshot file made by
+ * snapshot(). Entries are appended at the bottom of the table to preserve
+ * the order as it was.
+ *
+ * The file is mapped and the entries are added in a single pass using the
+ * saved hash values. The key index of QLISTTBL_HASHINDEX table is sized for
+ * the final number of entries up front.
+ *
+ * @param tbl       qlisttbl container pointer.
+ * @param filepath  snapshot file path
+ *
+ * @return the number of loaded entries, otherwise returns -1.
+ * @retval errno will be set in error condition.
+ *  - ENOTSUP : Not available with QLISTTBL_REFERENCE.
+ *  - EINVAL  : Invalid argument.
+ *  - EBADMSG : Not a qlisttbl snapshot or checksum mismatch.
+ *  - ENOMEM  : Memory allocation failure.
+ *
+ * @note
+ *  With QLISTTBL_UNIQUE option, existing entries with the same names are
+ *  removed as put() does. Entries loaded before an error are left in the
+ *  table.
+ */
+static ssize_t restore(qlisttbl_t *tbl, const char *filepath)
+{
+    if (tbl->reference == true) {
+        errno = ENOTSUP;
+        return -1;
+    }
+
+    uint32_t flags = 0;
+    size_t num = 0;
+    qsnap_t *snap = _q_snap_open(filepath, Q_SNAP_QLISTTBL, &flags, &num);
+    if (snap == NULL) return -1;
+
+    lock(tbl);
+
+    // names in a snapshot of a unique table don't collide with each other.
+    bool dedup = (tbl->unique == true
+                  && (tbl->num > 0 || (flags & QLISTTBL_UNIQUE) == 0));
+
+    if (tbl->idxslots != NULL) {
+        size_t range = tbl->idxrange;
+        while (tbl->num + num > range * 2) range *= 2;
+        if (range > tbl->idxrange) _idxrebuild(tbl, range);
+    }
+
+    ssize_t cnt = 0;
+    qsnap_rec_t rec;
+    while (_q_snap_read(snap, &rec) == true) {
+        qdlnobj_t *obj = _createobj(tbl, rec.name, rec.data, rec.size);
+        if (obj == NULL) break;
+        obj->hash = rec.hash;
+
+        if (dedup == true) remove_(tbl, obj->name);
+        obj->prev = tbl->last;
+        obj->next = NULL;
+        _insertobj(tbl, obj);
+        cnt++;
+    }
+    unlock(tbl);
+    _q_snap_close(snap);
+
+    return (cnt == (ssize_t) num) ? cnt : -1;
+}
+
+/**
+ * qlisttbl->freeze(): Make an immutable perfect-hash copy of qlisttbl.
+ * The copy is a qfrozentbl in a single allocation, which finds a key by
+ * comparing a single slot instead of walking the list.
+ *
+ * @param tbl       qlisttbl container pointer.
+ *
+ * @return a pointer of malloced qfrozentbl_t in case of successful,
+ *         otherwise returns NULL.
+ * @retval errno will be set in error condition.
+ *  - ENOMEM  : Memory allocation failure.
+ *  - EDEADLK : No perfect hash function found, practically never.
+ *
+ * @code
+ *  qlisttbl_t *conf = qconfig_parse_file(NULL, "app.conf", '=');
+ *  qfrozentbl_t *frozen = conf->freeze(conf);
+ *  conf->free(conf);
+ * @endcode
+ *
+ * @note
+ *  When a key appears more than once, only the value get() would return is
+ *  kept. QLISTTBL_CASEINSENSITIVE is carried over.
+ */
+static qfrozentbl_t *freeze(qlisttbl_t *tbl)
+{
+    lock(tbl);
+    qnobj_t *objs = NULL;
+    if (tbl->num > 0) {
+        objs = (qnobj_t *)qlibc_malloc(sizeof(qnobj_t) * tbl->num);
+        if (objs == NULL) {
+            unlock(tbl);
+            errno = ENOMEM;
+            return NULL;
+        }
+    }
+
+    // qfrozentbl keeps the first of duplicated keys, so put them in the
+    // order get() looks them up.
+    size_t num = 0;
+    qdlnobj_t *obj;
+    for (obj = (tbl->lookupforward == true) ? tbl->first : tbl->last;
+         obj != NULL;
+         obj = (tbl->lookupforward == true) ? obj->next : obj->prev) {
+        objs[num].name = obj->name;
+        objs[num].data = obj->data;
+        objs[num].size = obj->size;
+        num++;
+    }
+
+    qfrozentbl_t *frozen = qfrozentbl(objs, num,
+            (tbl->caseinsensitive == true) ? QFROZENTBL_CASEINSENSITIVE : 0);
+    unlock(tbl);
+    qlibc_free(objs);
+
+    return frozen;
+}
+
 /**
  * qlisttbl->lock(): Enter critical section.
  *
@@ -1069,14 +1671,17 @@ static void unlock(qlisttbl_t *tbl)
 static void free_(qlisttbl_t *tbl)
 {
     clear(tbl);
+    if (tbl->pool != NULL) tbl->pool->free(tbl->pool);
+    if (tbl->idxslots != NULL) qlibc_free(tbl->idxslots);
     Q_MUTEX_DESTROY(tbl->qmutex);
-    free(tbl);
+    qlibc_free(tbl);
 }
 
 #ifndef _DOXYGEN_SKIP
 
 // lock must be obtained from caller
-static qdlnobj_t *_createobj(const char *name, const void *data, size_t size)
+static qdlnobj_t *_createobj(qlisttbl_t *tbl, const char *name,
+                             const void *data, size_t size)
 {
     if (name == NULL || data == NULL || size <= 0) {
         errno = EINVAL;
@@ -1084,13 +1689,56 @@ static qdlnobj_t *_createobj(const char *name, const void *data, size_t size)
     }
 
     // make a new object
-    char *dup_name = strdup(name);
-    void *dup_data = malloc(size);
-    qdlnobj_t *obj = (qdlnobj_t *)malloc(sizeof(qdlnobj_t));
+    qdlnobj_t *obj;
+    if (tbl->reference == true) {
+        obj = (tbl->pool != NULL)
+              ? (qdlnobj_t *)tbl->pool->alloc(tbl->pool)
+              : (qdlnobj_t *)qlibc_malloc(OBJ_SIZE(tbl));
+        if (obj == NULL) {
+            errno = ENOMEM;
+            return NULL;
+        }
+        memset((void *)obj, '\0', sizeof(qdlnobj_t));
+        obj->name = (char *)name;
+        obj->data = (void *)data;
+        obj->size = size;
+        return obj;
+    }
+
+    // short name and data go right after the object
+    size_t namelen = strlen(name);
+    size_t inlsize = INLINE_LEN(namelen, size);
+    if (inlsize <= INLINE_MAX) {
+        obj = (tbl->pool != NULL)
+              ? (qdlnobj_t *)tbl->pool->alloc(tbl->pool)
+              : (qdlnobj_t *)qlibc_malloc(OBJ_SIZE(tbl) + inlsize);
+        if (obj == NULL) {
+            errno = ENOMEM;
+            return NULL;
+        }
+        memset((void *)obj, '\0', sizeof(qdlnobj_t));
+        obj->inlsize = inlsize;
+        obj->name = (char *)obj + OBJ_SIZE(tbl);
+        obj->data = obj->name + INLINE_ALIGN(namelen + 1);
+        memcpy(obj->name, name, namelen + 1);
+        memcpy(obj->data, data, size);
+        obj->size = size;
+        return obj;
+    }
+
+    char *dup_name = qlibc_strdup(name);
+    void *dup_data = qlibc_malloc(size);
+    obj = (tbl->pool != NULL)
+                     ? (qdlnobj_t *)tbl->pool->alloc(tbl->pool)
+                     : (qdlnobj_t *)qlibc_malloc(OBJ_SIZE(tbl));
     if (dup_name == NULL || dup_data == NULL || obj == NULL) {
-        if (dup_name != NULL) free(dup_name);
-        if (dup_data != NULL) free(dup_data);
-        if (obj != NULL) free(obj);
+        if (dup_name != NULL) qlibc_free(dup_name);
+        if (dup_data != NULL) qlibc_free(dup_data);
+        if (obj != NULL) {
+            obj->name = obj->data = NULL;
+            obj->inlsize = 0;
+            _freeobj(tbl, obj);
+        }
         errno = ENOMEM;
         return NULL;
     }
@@ -1105,11 +1753,40 @@ static qdlnobj_t *_createobj(const char *name, const void *data, size_t size)
     return obj;
 }
 
+// unlink and free the object. lock must be obtained from caller
+static void _removeobj(qlisttbl_t *tbl, qdlnobj_t *obj)
+{
+    // adjust chain links
+    if (obj->prev == NULL) tbl->first = obj->next; // if the object is first one
+    else obj->prev->next = obj->next;  // not the first one
+
+    if (obj->next == NULL) tbl->last = obj->prev; // if the object is last one
+    else obj->next->prev = obj->prev;  // not the first one
+
+    if (tbl->idxslots != NULL) _idxremove(tbl, obj);
+
+    // adjust counter
+    tbl->num--;
+
+    // free object
+    _freeobj(tbl, obj);
+}
+
+static void _freeobj(qlisttbl_t *tbl, qdlnobj_t *obj)
+{
+    if (tbl->reference == false && obj->inlsize == 0) {
+        qlibc_free(obj->name);
+        qlibc_free(obj->data);
+    }
+    if (tbl->pool != NULL) tbl->pool->release(tbl->pool, obj);
+    else qlibc_free(obj);
+}
+
 // lock must be obtained from caller
 static bool _insertobj(qlisttbl_t *tbl, qdlnobj_t *obj)
 {
-    // update hash
-    obj->hash = qhashmurmur3_32(obj->name, strlen(obj->name));
+    // update hash unless it's computed already
+    if (obj->hash == 0) obj->hash = qhashmurmur3_32(obj->name, strlen(obj->name));
 
     qdlnobj_t *prev = obj->prev;
     qdlnobj_t *next = obj->next;
@@ -1123,6 +1800,11 @@ static bool _insertobj(qlisttbl_t *tbl, qdlnobj_t *obj)
      // increase counter
     tbl->num++;
 
+    if (tbl->idxslots != NULL) {
+        _idxadd(tbl, obj);
+        if (tbl->num > tbl->idxrange * 2) _idxrebuild(tbl, tbl->idxrange * 2);
+    }
+
     return true;
 }
 
@@ -1139,16 +1821,34 @@ static qdlnobj_t *_findobj(qlisttbl_t *tbl, const char *name, qdlnobj_t *retobj)
     }
 
     uint32_t hash = qhashmurmur3_32(name, strlen(name));
-    qdlnobj_t *obj = (tbl->lookupforward) ? tbl->first : tbl->last;
-    while (obj != NULL) {
-        // name string will be compared only if the hash matches.
-        if (tbl->namematch(obj, name, hash) == true) {
-           if (retobj != NULL) {
-                *retobj = *obj;
+    if (tbl->idxslots != NULL) {
+        uint32_t idxhash = _idxhash(tbl, name, hash);
+        qlisttbl_idxslot_t *slot;
+        slot = &tbl->idxslots[idxhash & (tbl->idxrange - 1)];
+        qdlnobj_t *obj = (tbl->lookupforward) ? slot->head : slot->tail;
+        while (obj != NULL) {
+            if (IDXOBJ(obj)->idxhash == idxhash
+                && tbl->namematch(obj, name, hash) == true) {
+                if (retobj != NULL) {
+                    *retobj = *obj;
+                }
+                return obj;
+            }
+            obj = (tbl->lookupforward) ? IDXOBJ(obj)->hnext
+                                       : IDXOBJ(obj)->hprev;
+        }
+    } else {
+        qdlnobj_t *obj = (tbl->lookupforward) ? tbl->first : tbl->last;
+        while (obj != NULL) {
+            // name string will be compared only if the hash matches.
+            if (tbl->namematch(obj, name, hash) == true) {
+               if (retobj != NULL) {
+                    *retobj = *obj;
+                }
+                return obj;
             }
-            return obj;
+            obj = (tbl->lookupforward)? obj->next : obj->prev;
         }
-        obj = (tbl->lookupforward)? obj->next : obj->prev;
     }
 
     // not found, set prev and next chain.
@@ -1183,4 +1883,92 @@ static bool _namecasematch(qdlnobj_t *obj, const char *name, uint32_t hash)
     return false;
 }
 
+// hash for the index. keys are case folded in case insensitive mode.
+static uint32_t _idxhash(qlisttbl_t *tbl, const char *name, uint32_t hash)
+{
+    if (tbl->caseinsensitive == false) return hash;
+
+    // FNV-1a over lowered characters
+    uint32_t h = 2166136261U;
+    for (; *name != '\0'; name++) {
+        h ^= (uint32_t)tolower((unsigned char)*name);
+        h *= 16777619U;
+    }
+    return h;
+}
+
+// add an object which is just linked at the top or bottom of the table.
+static void _idxadd(qlisttbl_t *tbl, qdlnobj_t *obj)
+{
+    qlisttbl_idxobj_t *iobj = IDXOBJ(obj);
+    iobj->idxhash = _idxhash(tbl, obj->name, obj->hash);
+    qlisttbl_idxslot_t *slot;
+    slot = &tbl->idxslots[iobj->idxhash & (tbl->idxrange - 1)];
+
+    if (obj->next == NULL) {  // at the bottom
+        iobj->hprev = slot->tail;
+        iobj->hnext = NULL;
+        if (slot->tail != NULL) IDXOBJ(slot->tail)->hnext = obj;
+        else slot->head = obj;
+        slot->tail = obj;
+    } else {  // at the top
+        iobj->hprev = NULL;
+        iobj->hnext = slot->head;
+        if (slot->head != NULL) IDXOBJ(slot->head)->hprev = obj;
+        else slot->tail = obj;
+        slot->head = obj;
+    }
+}
+
+static void _idxremove(qlisttbl_t *tbl, qdlnobj_t *obj)
+{
+    qlisttbl_idxobj_t *iobj = IDXOBJ(obj);
+    qlisttbl_idxslot_t *slot;
+    slot = &tbl->idxslots[iobj->idxhash & (tbl->idxrange - 1)];
+
+    if (iobj->hprev == NULL) slot->head = iobj->hnext;
+    else IDXOBJ(iobj->hprev)->hnext = iobj->hnext;
+
+    if (iobj->hnext == NULL) slot->tail = iobj->hprev;
+    else IDXOBJ(iobj->hnext)->hprev = iobj->hprev;
+}
+
+// (re)build the index with given range by walking the table in order.
+static bool _idxrebuild(qlisttbl_t *tbl, size_t range)
+{
+    qlisttbl_idxslot_t *slots;
+    slots = (qlisttbl_idxslot_t *)qlibc_calloc(range, sizeof(qlisttbl_idxslot_t));
+    if (slots == NULL) return false;  // keep the current index
+
+    if (tbl->idxslots != NULL) qlibc_free(tbl->idxslots);
+    tbl->idxslots = slots;
+    tbl->idxrange = range;
+
+    qdlnobj_t *obj;
+    for (obj = tbl->first; obj != NULL; obj = obj->next) {
+        qdlnobj_t *next = obj->next;
+        obj->next = NULL;  // let _idxadd() append it
+        _idxadd(tbl, obj);
+        obj->next = next;
+    }
+    return true;
+}
+
+/*
+ * Find the object returned by the last getnext() call from its copy.
+ * Returns NULL if the object has been removed since.
+ */
+static qdlnobj_t *_idxlastobj(qlisttbl_t *tbl, const qdlnobj_t *obj)
+{
+    qdlnobj_t *lastobj;
+    if (tbl->lookupforward) {
+        lastobj = (obj->next != NULL) ? obj->next->prev : tbl->last;
+        if (lastobj == obj->prev) return NULL;
+    } else {
+        lastobj = (obj->prev != NULL) ? obj->prev->next : tbl->first;
+        if (lastobj == obj->next) return NULL;
+    }
+    return lastobj;
+}
+
 #endif /* _DOXYGEN_SKIP */
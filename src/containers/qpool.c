@@ -0,0 +1,292 @@
+/******************************************************************************
+ * qLibc
+ *
+ * Copyright (c) 2010-2014 Seungyoung Kim.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *****************************************************************************/
+
+/**
+ * @file qpool.c Fixed-size object pool implementation.
+ *
+ * qpool container is a slab allocator for objects of the same size. Objects
+ * are carved out of large chunks, and released objects are kept in a free
+ * list to be handed out again, so churning small objects costs neither a
+ * malloc() nor a free() call per object. Chunks grow geometrically and are
+ * returned to the system all at once by clear() or free().
+ *
+ * Containers use qpool internally for their nodes when the NODEPOOL option
+ * is given, but it can be used for any fixed-size object.
+ *
+ * @code
+ *  // create a pool of 64 bytes objects.
+ *  qpool_t *pool = qpool(64, 0);
+ *
+ *  // get and return objects.
+ *  void *obj1 = pool->alloc(pool);
+ *  void *obj2 = pool->alloc(pool);
+ *  pool->release(pool, obj1);
+ *
+ *  // release all the objects at once.
+ *  pool->clear(pool);
+ *
+ *  // free the pool.
+ *  pool->free(pool);
+ * @endcode
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include "qinternal.h"
+#include "containers/qpool.h"
+
+#ifndef _DOXYGEN_SKIP
+
+#define QPOOL_ALIGN (16)
+#define DEFAULT_CHUNK_OBJS (64)
+#define MAX_CHUNK_OBJS (4096)
+
+// chunk header, objects follow it.
+#define CHUNK_HDRSIZE (QPOOL_ALIGN)
+
+static void *alloc_(qpool_t *pool);
+static void release(qpool_t *pool, void *obj);
+
+static size_t size(qpool_t *pool);
+static void clear(qpool_t *pool);
+
+static void lock(qpool_t *pool);
+static void unlock(qpool_t *pool);
+
+static void free_(qpool_t *pool);
+
+/* internal functions */
+static bool _grow(qpool_t *pool);
+
+#endif
+
+/**
+ * Create new qpool_t object pool.
+ *
+ * @param objsize   size of an object.
+ * @param options   combination of initialization options.
+ *
+ * @return a pointer of malloced qpool_t container, otherwise returns NULL.
+ * @retval errno will be set in error condition.
+ *  - EINVAL : Invalid argument.
+ *  - ENOMEM : Memory allocation failure.
+ *
+ * @code
+ *  qpool_t *pool = qpool(sizeof(struct my_node), 0);
+ * @endcode
+ *
+ * @note
+ *   Available options:
+ *   - QPOOL_THREADSAFE - make it thread-safe.
+ */
+qpool_t *qpool(size_t objsize, int options) {
+    if (objsize == 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    qpool_t *pool = (qpool_t *) qlibc_calloc(1, sizeof(qpool_t));
+    if (pool == NULL) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    // handle options.
+    if (options & QPOOL_THREADSAFE) {
+        Q_MUTEX_NEW(pool->qmutex, true);
+        if (pool->qmutex == NULL) {
+            errno = ENOMEM;
+            qlibc_free(pool);
+            return NULL;
+        }
+    }
+
+    // released objects hold the free list link.
+    if (objsize < sizeof(void *))
+        objsize = sizeof(void *);
+    pool->objsize = (objsize + QPOOL_ALIGN - 1) & ~((size_t) QPOOL_ALIGN - 1);
+    pool->chunkobjs = DEFAULT_CHUNK_OBJS;
+
+    // member methods
+    pool->alloc = alloc_;
+    pool->release = release;
+
+    pool->size = size;
+    pool->clear = clear;
+
+    pool->lock = lock;
+    pool->unlock = unlock;
+
+    pool->free = free_;
+
+    return pool;
+}
+
+/**
+ * qpool->alloc(): Get an object from the pool.
+ *
+ * @param pool  qpool_t container pointer.
+ *
+ * @return a pointer of the object, otherwise returns NULL.
+ * @retval errno will be set in error condition.
+ *  - ENOMEM : Memory allocation failure.
+ *
+ * @note
+ *  The contents of the object are not initialized. The object must be
+ *  returned by qpool->release(), not by free().
+ */
+static void *alloc_(qpool_t *pool) {
+    lock(pool);
+
+    void *obj = pool->freelist;
+    if (obj != NULL) {
+        pool->freelist = *(void **) obj;
+    } else {
+        if (pool->avail == pool->availend && _grow(pool) == false) {
+            unlock(pool);
+            errno = ENOMEM;
+            return NULL;
+        }
+        obj = pool->avail;
+        pool->avail += pool->objsize;
+    }
+    pool->num++;
+
+    unlock(pool);
+    return obj;
+}
+
+/**
+ * qpool->release(): Return an object to the pool.
+ *
+ * @param pool  qpool_t container pointer.
+ * @param obj   object pointer returned by qpool->alloc().
+ */
+static void release(qpool_t *pool, void *obj) {
+    if (obj == NULL)
+        return;
+
+    lock(pool);
+    *(void **) obj = pool->freelist;
+    pool->freelist = obj;
+    pool->num--;
+    unlock(pool);
+}
+
+/**
+ * qpool->size(): Returns the number of objects in use.
+ *
+ * @param pool  qpool_t container pointer.
+ *
+ * @return the number of objects handed out and not released yet.
+ */
+static size_t size(qpool_t *pool) {
+    return pool->num;
+}
+
+/**
+ * qpool->clear(): Releases all the objects at once.
+ *
+ * @param pool  qpool_t container pointer.
+ *
+ * @note
+ *  The memory chunks are returned to the system, so every object acquired
+ *  from this pool becomes invalid.
+ */
+static void clear(qpool_t *pool) {
+    lock(pool);
+    void *chunk = pool->chunks;
+    while (chunk != NULL) {
+        void *next = *(void **) chunk;
+        qlibc_free(chunk);
+        chunk = next;
+    }
+
+    pool->num = 0;
+    pool->chunks = NULL;
+    pool->chunkobjs = DEFAULT_CHUNK_OBJS;
+    pool->freelist = NULL;
+    pool->avail = NULL;
+    pool->availend = NULL;
+    unlock(pool);
+}
+
+/**
+ * qpool->lock(): Enters critical section.
+ *
+ * @param pool  qpool_t container pointer.
+ */
+static void lock(qpool_t *pool) {
+    Q_MUTEX_ENTER(pool->qmutex);
+}
+
+/**
+ * qpool->unlock(): Leaves critical section.
+ *
+ * @param pool  qpool_t container pointer.
+ */
+static void unlock(qpool_t *pool) {
+    Q_MUTEX_LEAVE(pool->qmutex);
+}
+
+/**
+ * qpool->free(): Free qpool_t and all the objects in it.
+ *
+ * @param pool  qpool_t container pointer.
+ */
+static void free_(qpool_t *pool) {
+    clear(pool);
+    Q_MUTEX_DESTROY(pool->qmutex);
+
+    qlibc_free(pool);
+}
+
+#ifndef _DOXYGEN_SKIP
+
+// allocate a new chunk, doubling its size up to MAX_CHUNK_OBJS objects.
+static bool _grow(qpool_t *pool) {
+    char *chunk = (char *) qlibc_malloc(CHUNK_HDRSIZE
+                                  + (pool->objsize * pool->chunkobjs));
+    if (chunk == NULL)
+        return false;
+
+    *(void **) chunk = pool->chunks;
+    pool->chunks = chunk;
+    pool->avail = chunk + CHUNK_HDRSIZE;
+    pool->availend = pool->avail + (pool->objsize * pool->chunkobjs);
+
+    if (pool->chunkobjs < MAX_CHUNK_OBJS)
+        pool->chunkobjs *= 2;
+
+    return true;
+}
+
+#endif /* _DOXYGEN_SKIP */
@@ -30,8 +30,9 @@
  * @file qqueue.c Queue implementation.
  *
  * qqueue container is a queue implementation. It represents a
- * first-in-first-out(FIFO). It extends qlist container that allow a
- * linked-list to be treated as a queue.
+ * first-in-first-out(FIFO). Elements are kept in a growable ring buffer, and
+ * small elements are stored inline in the buffer slots, so pushing and popping
+ * them doesn't allocate memory once the buffer has grown to its working size.
  *
  * @code
  *  [Conceptional Data Structure Diagram]
@@ -106,6 +107,7 @@
 #include <stdbool.h>
 #include <string.h>
 #include <errno.h>
+#include <time.h>
 #include "qinternal.h"
 #include "containers/qqueue.h"
 
@@ -124,6 +126,7 @@ static void *pop(qqueue_t *queue, size_t *size);
 static char *popstr(qqueue_t *queue);
 static int64_t popint(qqueue_t *queue);
 static void *popat(qqueue_t *queue, int index, size_t *size);
+static void *popwait(qqueue_t *queue, size_t *size, int timeoutms);
 
 static void *get(qqueue_t *queue, size_t *size, bool newmem);
 static char *getstr(qqueue_t *queue);
@@ -135,6 +138,12 @@ static void clear(qqueue_t *queue);
 static bool debug(qqueue_t *queue, FILE *out);
 static void free_(qqueue_t *queue);
 
+/* internal functions */
+static qqueue_t *_qqueue(qring_t *ring, qlfring_t *lfring);
+static bool _push(qqueue_t *queue, const void *data, size_t size);
+static void *_pop(qqueue_t *queue, size_t *size);
+static void _notify(qqueue_t *queue);
+
 #endif
 
 /**
@@ -153,20 +162,72 @@ static void free_(qqueue_t *queue);
  * @note
  *   Available options:
  *   - QQUEUE_THREADSAFE - make it thread-safe.
+ *   See qqueue_lockfree() for the lock-free variant.
  */
 qqueue_t *qqueue(int options) {
-    qqueue_t *queue = (qqueue_t *) malloc(sizeof(qqueue_t));
+    qring_t *ring = _q_ring((options & QQUEUE_THREADSAFE) ? true : false);
+    if (ring == NULL)
+        return NULL;
+
+    qqueue_t *queue = _qqueue(ring, NULL);
+    if (queue == NULL)
+        _q_ring_free(ring);
+    return queue;
+}
+
+/**
+ * Create new bounded lock-free queue container
+ *
+ * @param capacity  maximum number of elements. It's rounded up to a power
+ *                  of 2.
+ * @param options   combination of initialization options.
+ *
+ * @return a pointer of malloced qqueue container, otherwise returns NULL.
+ * @retval errno will be set in error condition.
+ *  - EINVAL    : Invalid argument.
+ *  - ENOMEM    : Memory allocation failure.
+ *
+ * @code
+ *   qqueue_t *queue = qqueue_lockfree(1024, 0);
+ * @endcode
+ *
+ * @note
+ *   The queue can be used by many threads at the same time without locking.
+ *   It supports push, pop, size and clear operations. Peeking operations such
+ *   as get() and getat(), and popat() fail with ENOTSUP since an element can
+ *   be taken by other threads at any moment. size() is a snapshot.
+ *   Pushing into a full queue fails with ENOBUFS, and setsize() has no effect.
+ *   Available options:
+ *   - QQUEUE_SPSC - only one thread pushes and only one thread pops, which
+ *                   allows a cheaper algorithm. The default is multiple
+ *                   producers and multiple consumers.
+ */
+qqueue_t *qqueue_lockfree(size_t capacity, int options) {
+    qlfring_t *lfring = _q_lfring(capacity,
+                                  (options & QQUEUE_SPSC) ? true : false);
+    if (lfring == NULL)
+        return NULL;
+
+    qqueue_t *queue = _qqueue(NULL, lfring);
+    if (queue == NULL)
+        _q_lfring_free(lfring);
+    return queue;
+}
+
+#ifndef _DOXYGEN_SKIP
+
+static qqueue_t *_qqueue(qring_t *ring, qlfring_t *lfring) {
+    qqueue_t *queue = (qqueue_t *) qlibc_malloc(sizeof(qqueue_t));
     if (queue == NULL) {
         errno = ENOMEM;
         return NULL;
     }
 
     memset((void *) queue, 0, sizeof(qqueue_t));
-    queue->list = qlist(options);
-    if (queue->list == NULL) {
-        free(queue);
-        return NULL;
-    }
+    queue->ring = ring;
+    queue->lfring = lfring;
+    pthread_mutex_init(&queue->waitlock, NULL);
+    pthread_cond_init(&queue->waitcond, NULL);
 
     // methods
     queue->setsize = setsize;
@@ -179,6 +240,7 @@ qqueue_t *qqueue(int options) {
     queue->popstr = popstr;
     queue->popint = popint;
     queue->popat = popat;
+    queue->popwait = popwait;
 
     queue->get = get;
     queue->getstr = getstr;
@@ -193,6 +255,8 @@ qqueue_t *qqueue(int options) {
     return queue;
 }
 
+#endif /* _DOXYGEN_SKIP */
+
 /**
  * qqueue->setsize(): Sets maximum number of elements allowed in this
  * queue.
@@ -201,9 +265,14 @@ qqueue_t *qqueue(int options) {
  * @param max   maximum number of elements. 0 means no limit.
  *
  * @return previous maximum number.
+ *
+ * @note
+ *  On lock-free queues, this does nothing and returns the capacity.
  */
 static size_t setsize(qqueue_t *queue, size_t max) {
-    return queue->list->setsize(queue->list, max);
+    if (queue->lfring != NULL)
+        return _q_lfring_capacity(queue->lfring);
+    return _q_ring_setsize(queue->ring, max);
 }
 
 /**
@@ -221,7 +290,7 @@ static size_t setsize(qqueue_t *queue, size_t max) {
  *  - ENOMEM    : Memory allocation failure.
  */
 static bool push(qqueue_t *queue, const void *data, size_t size) {
-    return queue->list->addlast(queue->list, data, size);
+    return _push(queue, data, size);
 }
 
 /**
@@ -243,7 +312,7 @@ static bool pushstr(qqueue_t *queue, const char *str) {
         errno = EINVAL;
         return false;
     }
-    return queue->list->addlast(queue->list, str, strlen(str) + 1);
+    return _push(queue, str, strlen(str) + 1);
 }
 
 /**
@@ -259,7 +328,7 @@ static bool pushstr(qqueue_t *queue, const char *str) {
  *  - ENOMEM    : Memory allocation failure.
  */
 static bool pushint(qqueue_t *queue, int64_t num) {
-    return queue->list->addlast(queue->list, &num, sizeof(num));
+    return _push(queue, &num, sizeof(num));
 }
 
 /**
@@ -275,7 +344,7 @@ static bool pushint(qqueue_t *queue, int64_t num) {
  *  - ENOMEM    : Memory allocation failure.
  */
 static void *pop(qqueue_t *queue, size_t *size) {
-    return queue->list->popfirst(queue->list, size);
+    return _pop(queue, size);
 }
 
 /**
@@ -294,7 +363,7 @@ static void *pop(qqueue_t *queue, size_t *size) {
  */
 static char *popstr(qqueue_t *queue) {
     size_t strsize;
-    char *str = queue->list->popfirst(queue->list, &strsize);
+    char *str = _pop(queue, &strsize);
     if (str != NULL) {
         str[strsize - 1] = '\0';  // just to make sure
     }
@@ -311,18 +380,16 @@ static char *popstr(qqueue_t *queue) {
  * @return an integer value, otherwise returns 0.
  * @retval errno will be set in error condition.
  *  - ENOENT    : Queue is empty.
- *  - ENOMEM    : Memory allocation failure.
  *
  * @note
  * The integer element should be pushed through pushint().
  */
 static int64_t popint(qqueue_t *queue) {
     int64_t num = 0;
-    int64_t *pnum = queue->list->popfirst(queue->list, NULL);
-    if (pnum != NULL) {
-        num = *pnum;
-        free(pnum);
-    }
+    if (queue->lfring != NULL)
+        _q_lfring_read(queue->lfring, &num, sizeof(num));
+    else
+        _q_ring_read(queue->ring, 0, &num, sizeof(num), true);
 
     return num;
 }
@@ -346,7 +413,68 @@ static int64_t popint(qqueue_t *queue) {
  *  very last time.
  */
 static void *popat(qqueue_t *queue, int index, size_t *size) {
-    return queue->list->popat(queue->list, index, size);
+    if (queue->lfring != NULL) {
+        errno = ENOTSUP;
+        return NULL;
+    }
+    return _q_ring_get(queue->ring, index, size, true, true);
+}
+
+/**
+ * qqueue->popwait(): Removes a element at the top of this queue and returns
+ * that element. If the queue is empty, waits until an element is pushed.
+ *
+ * @param queue     qqueue container pointer.
+ * @param size      if size is not NULL, element size will be stored.
+ * @param timeoutms timeout in milliseconds. 0 for no wait, -1 for waiting
+ *                  forever.
+ *
+ * @return a pointer of malloced element, otherwise returns NULL.
+ * @retval errno will be set in error condition.
+ *  - ETIMEDOUT : Queue stayed empty until the timeout.
+ *  - ENOENT    : Queue is empty and timeoutms is 0.
+ *  - ENOMEM    : Memory allocation failure.
+ *
+ * @note
+ *  Waiting consumers sleep on a condition variable instead of spinning, and
+ *  pushers only touch it when somebody is waiting.
+ */
+static void *popwait(qqueue_t *queue, size_t *size, int timeoutms) {
+    void *data = _pop(queue, size);
+    if (data != NULL || errno != ENOENT || timeoutms == 0)
+        return data;
+
+    struct timespec deadline;
+    if (timeoutms > 0) {
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += timeoutms / 1000;
+        deadline.tv_nsec += (timeoutms % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+    }
+
+    pthread_mutex_lock(&queue->waitlock);
+    __sync_add_and_fetch(&queue->waiters, 1);
+    while ((data = _pop(queue, size)) == NULL && errno == ENOENT) {
+        int ret;
+        if (timeoutms < 0)
+            ret = pthread_cond_wait(&queue->waitcond, &queue->waitlock);
+        else
+            ret = pthread_cond_timedwait(&queue->waitcond, &queue->waitlock,
+                                         &deadline);
+        if (ret == ETIMEDOUT) {
+            data = _pop(queue, size);
+            if (data == NULL && errno == ENOENT)
+                errno = ETIMEDOUT;
+            break;
+        }
+    }
+    __sync_sub_and_fetch(&queue->waiters, 1);
+    pthread_mutex_unlock(&queue->waitlock);
+
+    return data;
 }
 
 /**
@@ -361,9 +489,14 @@ static void *popat(qqueue_t *queue, int index, size_t *size) {
  * @retval errno will be set in error condition.
  *  - ENOENT    : Queue is empty.
  *  - ENOMEM    : Memory allocation failure.
+ *  - ENOTSUP   : Not supported on lock-free queues.
  */
 static void *get(qqueue_t *queue, size_t *size, bool newmem) {
-    return queue->list->getfirst(queue->list, size, newmem);
+    if (queue->lfring != NULL) {
+        errno = ENOTSUP;
+        return NULL;
+    }
+    return _q_ring_get(queue->ring, 0, size, newmem, false);
 }
 
 /**
@@ -382,7 +515,7 @@ static void *get(qqueue_t *queue, size_t *size, bool newmem) {
  */
 static char *getstr(qqueue_t *queue) {
     size_t strsize;
-    char *str = queue->list->getfirst(queue->list, &strsize, true);
+    char *str = get(queue, &strsize, true);
     if (str != NULL) {
         str[strsize - 1] = '\0';  // just to make sure
     }
@@ -399,18 +532,16 @@ static char *getstr(qqueue_t *queue) {
  * @return an integer value, otherwise returns 0.
  * @retval errno will be set in error condition.
  *  - ENOENT    : Queue is empty.
- *  - ENOMEM    : Memory allocation failure.
  *
  * @note
  *  The integer element should be pushed through pushint().
  */
 static int64_t getint(qqueue_t *queue) {
     int64_t num = 0;
-    int64_t *pnum = queue->list->getfirst(queue->list, NULL, true);
-    if (pnum != NULL) {
-        num = *pnum;
-        free(pnum);
-    }
+    if (queue->lfring != NULL)
+        errno = ENOTSUP;
+    else
+        _q_ring_read(queue->ring, 0, &num, sizeof(num), false);
 
     return num;
 }
@@ -435,7 +566,11 @@ static int64_t getint(qqueue_t *queue) {
  *  very last time.
  */
 static void *getat(qqueue_t *queue, int index, size_t *size, bool newmem) {
-    return queue->list->getat(queue->list, index, size, newmem);
+    if (queue->lfring != NULL) {
+        errno = ENOTSUP;
+        return NULL;
+    }
+    return _q_ring_get(queue->ring, index, size, newmem, false);
 }
 
 /**
@@ -446,7 +581,9 @@ static void *getat(qqueue_t *queue, int index, size_t *size, bool newmem) {
  * @return the number of elements in this queue.
  */
 static size_t size(qqueue_t *queue) {
-    return queue->list->size(queue->list);
+    if (queue->lfring != NULL)
+        return _q_lfring_size(queue->lfring);
+    return _q_ring_size(queue->ring);
 }
 
 /**
@@ -455,7 +592,10 @@ static size_t size(qqueue_t *queue) {
  * @param queue qqueue container pointer.
  */
 static void clear(qqueue_t *queue) {
-    queue->list->clear(queue->list);
+    if (queue->lfring != NULL)
+        _q_lfring_clear(queue->lfring);
+    else
+        _q_ring_clear(queue->ring);
 }
 
 /**
@@ -465,9 +605,22 @@ static void clear(qqueue_t *queue) {
  * @param out       output stream FILE descriptor such like stdout, stderr.
  *
  * @return true if successful, otherwise returns false.
+ *
+ * @note
+ *  Elements of lock-free queues are not printed, only the counters.
  */
 static bool debug(qqueue_t *queue, FILE *out) {
-    return queue->list->debug(queue->list, out);
+    if (queue->lfring != NULL) {
+        if (out == NULL) {
+            errno = EIO;
+            return false;
+        }
+        fprintf(out, "lock-free queue: %zu/%zu elements\n",
+                _q_lfring_size(queue->lfring),
+                _q_lfring_capacity(queue->lfring));
+        return true;
+    }
+    return _q_ring_debug(queue->ring, out);
 }
 
 /**
@@ -478,6 +631,43 @@ static bool debug(qqueue_t *queue, FILE *out) {
  * @return always returns true.
  */
 static void free_(qqueue_t *queue) {
-    queue->list->free(queue->list);
-    free(queue);
+    if (queue->lfring != NULL)
+        _q_lfring_free(queue->lfring);
+    else
+        _q_ring_free(queue->ring);
+    pthread_cond_destroy(&queue->waitcond);
+    pthread_mutex_destroy(&queue->waitlock);
+    qlibc_free(queue);
+}
+
+#ifndef _DOXYGEN_SKIP
+
+static bool _push(qqueue_t *queue, const void *data, size_t size) {
+    bool ret;
+    if (queue->lfring != NULL)
+        ret = _q_lfring_push(queue->lfring, data, size);
+    else
+        ret = _q_ring_add(queue->ring, false, data, size);
+    if (ret == true)
+        _notify(queue);
+    return ret;
+}
+
+static void *_pop(qqueue_t *queue, size_t *size) {
+    if (queue->lfring != NULL)
+        return _q_lfring_pop(queue->lfring, size);
+    return _q_ring_get(queue->ring, 0, size, true, true);
 }
+
+// wake up a consumer sleeping in popwait().
+static void _notify(qqueue_t *queue) {
+    // pairs with the waiters increment before the consumer's last try.
+    __sync_synchronize();
+    if (__atomic_load_n(&queue->waiters, __ATOMIC_RELAXED) > 0) {
+        pthread_mutex_lock(&queue->waitlock);
+        pthread_cond_signal(&queue->waitcond);
+        pthread_mutex_unlock(&queue->waitlock);
+    }
+}
+
+#endif /* _DOXYGEN_SKIP */
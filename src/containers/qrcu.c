@@ -0,0 +1,290 @@
+/******************************************************************************
+ * qLibc
+ *
+ * Copyright (c) 2010-2014 Seungyoung Kim.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *****************************************************************************/
+
+/**
+ * @file qrcu.c Read-copy-update container implementation.
+ *
+ * qrcu holds a pointer to an object which is never modified once published,
+ * such as a table parsed from a configuration file. Readers take a reference
+ * to the current object without locking and writers replace it with a new
+ * object built aside. The old object is freed once all readers which could
+ * have seen it have released it.
+ *
+ * Readers are counted in sharded counters of two phases. A reader adds
+ * itself to a counter of the current phase and checks the phase again
+ * before loading the object, retrying if it was flipped in between.
+ * publish() swaps the object, flips the phase and waits for the counters of
+ * the previous phase to drain, so the old object can't be referenced by
+ * anyone when it's freed. Readers never wait and don't write to a shared
+ * cache line unless they run on threads sharing a counter shard.
+ *
+ * @code
+ *  static void freetbl(void *obj) {
+ *      qlisttbl_t *tbl = (qlisttbl_t *) obj;
+ *      tbl->free(tbl);
+ *  }
+ *
+ *  // publish the first version
+ *  qrcu_t *rcu = qrcu(qconfig_parse_file(NULL, "app.conf", '='), freetbl);
+ *
+ *  // readers, on any thread
+ *  int token;
+ *  qlisttbl_t *conf = (qlisttbl_t *) rcu->acquire(rcu, &token);
+ *  const char *value = conf->getstr(conf, "key", false);
+ *  ...
+ *  rcu->release(rcu, token);
+ *
+ *  // writer, on reload. the old table is freed when readers are done.
+ *  rcu->publish(rcu, qconfig_parse_file(NULL, "app.conf", '='));
+ *
+ *  // free the object and the container
+ *  rcu->free(rcu);
+ * @endcode
+ *
+ * @note
+ *  The tables published don't need QLISTTBL_THREADSAFE or
+ *  QHASHTBL_THREADSAFE because readers only read them.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sched.h>
+#include <errno.h>
+#include <pthread.h>
+#include "qinternal.h"
+#include "containers/qrcu.h"
+
+#ifndef _DOXYGEN_SKIP
+
+#define DRAIN_SPINS     (1000)  /*!< yields before sleeping in publish() */
+
+static void *acquire(qrcu_t *rcu, int *token);
+static void release(qrcu_t *rcu, int token);
+static bool publish(qrcu_t *rcu, void *obj);
+static uint64_t version(qrcu_t *rcu);
+static void free_(qrcu_t *rcu);
+
+static int _shard_index(void);
+static bool _drained(qrcu_t *rcu, int phase);
+static void _stall(void);
+
+#endif
+
+/**
+ * Create a qrcu container.
+ *
+ * @param obj       object to publish first. It can be NULL.
+ * @param freeobj   function freeing retired objects. NULL to leave them to
+ *                  the caller.
+ *
+ * @return a pointer of malloced qrcu_t structure in case of successful,
+ *         otherwise returns NULL.
+ * @retval errno will be set in error condition.
+ *  - ENOMEM    : Memory allocation failure.
+ *
+ * @code
+ *   qrcu_t *rcu = qrcu(tbl, freetbl);
+ * @endcode
+ */
+qrcu_t *qrcu(void *obj, void (*freeobj)(void *obj)) {
+    qrcu_t *rcu = (qrcu_t *) qlibc_calloc(1, sizeof(qrcu_t));
+    if (rcu == NULL) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    rcu->obj = obj;
+    rcu->freeobj = freeobj;
+    pthread_mutex_init(&rcu->wlock, NULL);
+
+    // member methods
+    rcu->acquire = acquire;
+    rcu->release = release;
+    rcu->publish = publish;
+    rcu->version = version;
+    rcu->free = free_;
+
+    return rcu;
+}
+
+/**
+ * qrcu->acquire(): Take a reference to the current object.
+ *
+ * @param rcu       qrcu container pointer.
+ * @param token     pointer of an integer to pass to release().
+ *
+ * @return the current object, which stays valid until release().
+ *
+ * @note
+ *  It never blocks. The object must not be modified, and a thread holding
+ *  a reference must not call publish().
+ */
+static void *acquire(qrcu_t *rcu, int *token) {
+    int shard = _shard_index();
+    int phase = __atomic_load_n(&rcu->phase, __ATOMIC_SEQ_CST);
+    while (true) {
+        _stall();
+        __atomic_add_fetch(&rcu->counters[phase][shard].readers, 1,
+                           __ATOMIC_SEQ_CST);
+        // publish() may have flipped the phase and drained this counter
+        // before it was incremented, and won't wait on it next time.
+        int now = __atomic_load_n(&rcu->phase, __ATOMIC_SEQ_CST);
+        if (now == phase)
+            break;
+        __atomic_sub_fetch(&rcu->counters[phase][shard].readers, 1,
+                           __ATOMIC_RELEASE);
+        phase = now;
+    }
+    *token = (phase * QRCU_SHARDS) + shard;
+    return __atomic_load_n(&rcu->obj, __ATOMIC_SEQ_CST);
+}
+
+/**
+ * qrcu->release(): Drop a reference taken by acquire().
+ *
+ * @param rcu       qrcu container pointer.
+ * @param token     token given by acquire().
+ */
+static void release(qrcu_t *rcu, int token) {
+    __atomic_sub_fetch(
+            &rcu->counters[token / QRCU_SHARDS][token % QRCU_SHARDS].readers,
+            1, __ATOMIC_RELEASE);
+}
+
+/**
+ * qrcu->publish(): Replace the current object.
+ *
+ * New readers see the new object right away. It returns after all readers
+ * of the old object have released it, and the old object is freed by the
+ * destructor given to qrcu().
+ *
+ * @param rcu       qrcu container pointer.
+ * @param obj       new object. It can be NULL.
+ *
+ * @return true if the old object has been retired.
+ *
+ * @note
+ *  Concurrent publish() calls are serialized. Without a destructor, the old
+ *  object can be freed by the caller when it returns.
+ */
+static bool publish(qrcu_t *rcu, void *obj) {
+    pthread_mutex_lock(&rcu->wlock);
+    void *old = __atomic_exchange_n(&rcu->obj, obj, __ATOMIC_SEQ_CST);
+    int phase = rcu->phase;
+    __atomic_store_n(&rcu->phase, phase ^ 1, __ATOMIC_SEQ_CST);
+
+    // a reader holding the old object counted itself in the old phase
+    // before loading it, so the old object is unreachable once it drains.
+    int spins;
+    for (spins = 0; _drained(rcu, phase) == false; spins++) {
+        if (spins < DRAIN_SPINS) {
+            sched_yield();
+        } else {
+            usleep(100);
+        }
+    }
+    rcu->nversions++;
+    pthread_mutex_unlock(&rcu->wlock);
+
+    if (old != NULL && old != obj && rcu->freeobj != NULL)
+        rcu->freeobj(old);
+    return true;
+}
+
+/**
+ * qrcu->version(): Get the number of objects published after creation.
+ *
+ * @param rcu       qrcu container pointer.
+ *
+ * @return the number of completed publish() calls.
+ */
+static uint64_t version(qrcu_t *rcu) {
+    return __atomic_load_n(&rcu->nversions, __ATOMIC_RELAXED);
+}
+
+/**
+ * qrcu->free(): Free the current object and the container.
+ *
+ * @param rcu       qrcu container pointer.
+ *
+ * @note
+ *  No reader may hold a reference.
+ */
+static void free_(qrcu_t *rcu) {
+    if (rcu->obj != NULL && rcu->freeobj != NULL)
+        rcu->freeobj(rcu->obj);
+    pthread_mutex_destroy(&rcu->wlock);
+    qlibc_free(rcu);
+}
+
+#ifndef _DOXYGEN_SKIP
+
+// threads are spread over the shards in the order they first read.
+static int _shard_index(void) {
+    static unsigned int next = 0;
+    static __thread int idx = -1;
+    if (idx < 0) {
+        idx = (int) (__atomic_fetch_add(&next, 1, __ATOMIC_RELAXED)
+                     % QRCU_SHARDS);
+    }
+    return idx;
+}
+
+static bool _drained(qrcu_t *rcu, int phase) {
+    int i;
+    for (i = 0; i < QRCU_SHARDS; i++) {
+        if (__atomic_load_n(&rcu->counters[phase][i].readers,
+                            __ATOMIC_SEQ_CST) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void (*_stallfn)(void) = NULL;
+
+/*
+ * Call the given function in acquire() between reading the phase and
+ * counting the reader, NULL to stop. This is for testing readers preempted
+ * right there, which is rare without it.
+ */
+void _q_rcu_stall(void (*stall)(void)) {
+    __atomic_store_n(&_stallfn, stall, __ATOMIC_RELAXED);
+}
+
+static void _stall(void) {
+    void (*stall)(void) = __atomic_load_n(&_stallfn, __ATOMIC_RELAXED);
+    if (stall != NULL)
+        stall();
+}
+
+#endif /* _DOXYGEN_SKIP */
@@ -0,0 +1,765 @@
+/******************************************************************************
+ * qLibc
+ *
+ * Copyright (c) 2010-2014 Seungyoung Kim.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *****************************************************************************/
+
+/**
+ * @file qskiplist.c Skip List implementation.
+ *
+ * qskiplist container is a key/value table keeping its keys in sorted order.
+ * Objects are linked in ascending order of their keys and randomly chosen
+ * objects are additionally linked on upper levels, so lookups, insertions and
+ * removals take O(log n) on average. Unlike hash tables, objects can be
+ * traversed in key order, and range or prefix scans start at the first
+ * matching key instead of visiting the whole table.
+ *
+ * Keys are strings compared by strcmp(), so numbers used as keys should be
+ * zero-padded to get them in numeric order.
+ *
+ * @code
+ *  // create a table.
+ *  qskiplist_t *tbl = qskiplist(QSKIPLIST_THREADSAFE);
+ *
+ *  // add elements
+ *  tbl->putstr(tbl, "/api/v1/users", "users");
+ *  tbl->putstr(tbl, "/api/v1/items", "items");
+ *  tbl->putstr(tbl, "/static/app.js", "static");
+ *
+ *  // get
+ *  char *e1 = tbl->getstr(tbl, "/api/v1/users", false);
+ *
+ *  // prefix scan
+ *  qskiplist_obj_t obj;
+ *  memset((void*)&obj, 0, sizeof(obj)); // must be cleared before call
+ *  tbl->lock(tbl);
+ *  while(tbl->getprefix(tbl, &obj, "/api/", false) == true) {
+ *    printf("NAME=%s, DATA=%s\n", obj.name, (char*)obj.data);
+ *  }
+ *  tbl->unlock(tbl);
+ *
+ *  // free table
+ *  tbl->free(tbl);
+ * @endcode
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include "qinternal.h"
+#include "containers/qskiplist.h"
+
+#ifndef _DOXYGEN_SKIP
+
+#define MAX_LEVEL (32)
+
+static bool put(qskiplist_t *tbl, const char *name, const void *data,
+                size_t size);
+static bool putstr(qskiplist_t *tbl, const char *name, const char *str);
+static bool putstrf(qskiplist_t *tbl, const char *name, const char *format,
+                    ...);
+static bool putint(qskiplist_t *tbl, const char *name, int64_t num);
+
+static void *get(qskiplist_t *tbl, const char *name, size_t *size,
+                 bool newmem);
+static char *getstr(qskiplist_t *tbl, const char *name, bool newmem);
+static int64_t getint(qskiplist_t *tbl, const char *name);
+
+static bool getnext(qskiplist_t *tbl, qskiplist_obj_t *obj, bool newmem);
+static bool getrange(qskiplist_t *tbl, qskiplist_obj_t *obj,
+                     const char *min, const char *max, bool newmem);
+static bool getprefix(qskiplist_t *tbl, qskiplist_obj_t *obj,
+                      const char *prefix, bool newmem);
+
+static bool remove_(qskiplist_t *tbl, const char *name);
+
+static size_t size(qskiplist_t *tbl);
+static void clear(qskiplist_t *tbl);
+static bool debug(qskiplist_t *tbl, FILE *out);
+
+static void lock(qskiplist_t *tbl);
+static void unlock(qskiplist_t *tbl);
+
+static void free_(qskiplist_t *tbl);
+
+// internal functions
+static qskiplist_obj_t *_find_obj(qskiplist_t *tbl, const char *name,
+                                  qskiplist_obj_t ***update);
+static int _random_level(qskiplist_t *tbl);
+static bool _getnext(qskiplist_t *tbl, qskiplist_obj_t *obj,
+                     const char *min, const char *max, const char *prefix,
+                     bool newmem);
+
+#endif
+
+/**
+ * Initialize a skip list.
+ *
+ * @param options   combination of initialization options.
+ *
+ * @return a pointer of malloced qskiplist_t, otherwise returns NULL.
+ * @retval errno will be set in error condition.
+ *  - ENOMEM : Memory allocation failure.
+ *
+ * @code
+ *  qskiplist_t *tbl = qskiplist(0);
+ * @endcode
+ *
+ * @note
+ *   Available options:
+ *   - QSKIPLIST_THREADSAFE - make it thread-safe. Lookups share a
+ *     reader/writer lock.
+ */
+qskiplist_t *qskiplist(int options) {
+    qskiplist_t *tbl = (qskiplist_t *) qlibc_calloc(1, sizeof(qskiplist_t));
+    if (tbl == NULL)
+        goto malloc_failure;
+
+    tbl->head = (qskiplist_obj_t **) qlibc_calloc(MAX_LEVEL,
+                                            sizeof(qskiplist_obj_t *));
+    if (tbl->head == NULL)
+        goto malloc_failure;
+
+    // handle options.
+    if (options & QSKIPLIST_THREADSAFE) {
+        Q_RWLOCK_NEW(tbl->qmutex);
+        if (tbl->qmutex == NULL)
+            goto malloc_failure;
+    }
+
+    // assign methods
+    tbl->put = put;
+    tbl->putstr = putstr;
+    tbl->putstrf = putstrf;
+    tbl->putint = putint;
+
+    tbl->get = get;
+    tbl->getstr = getstr;
+    tbl->getint = getint;
+
+    tbl->getnext = getnext;
+    tbl->getrange = getrange;
+    tbl->getprefix = getprefix;
+
+    tbl->remove = remove_;
+
+    tbl->size = size;
+    tbl->clear = clear;
+    tbl->debug = debug;
+
+    tbl->lock = lock;
+    tbl->unlock = unlock;
+
+    tbl->free = free_;
+
+    tbl->level = 1;
+    tbl->seed = (uint32_t) time(NULL) ^ (uint32_t) (uintptr_t) tbl;
+    if (tbl->seed == 0)
+        tbl->seed = 1;
+
+    return tbl;
+
+    malloc_failure:
+    errno = ENOMEM;
+    if (tbl != NULL) {
+        if (tbl->head != NULL)
+            qlibc_free(tbl->head);
+        qlibc_free(tbl);
+    }
+    return NULL;
+}
+
+/**
+ * qskiplist->put(): Put an object into this table. Existing object with the
+ * same key will be replaced.
+ *
+ * @param tbl       qskiplist_t container pointer.
+ * @param name      key name
+ * @param data      data object
+ * @param size      size of data object
+ *
+ * @return true if successful, otherwise returns false
+ * @retval errno will be set in error condition.
+ *  - EINVAL : Invalid argument.
+ *  - ENOMEM : Memory allocation failure.
+ */
+static bool put(qskiplist_t *tbl, const char *name, const void *data,
+                size_t size) {
+    if (name == NULL || data == NULL) {
+        errno = EINVAL;
+        return false;
+    }
+
+    void *dup = qlibc_malloc(size);
+    if (dup == NULL) {
+        errno = ENOMEM;
+        return false;
+    }
+    memcpy(dup, data, size);
+
+    lock(tbl);
+    qskiplist_obj_t **update[MAX_LEVEL];
+    qskiplist_obj_t *obj = _find_obj(tbl, name, update);
+    if (obj != NULL && !strcmp(obj->name, name)) {
+        // replace the data
+        qlibc_free(obj->data);
+        obj->data = dup;
+        obj->size = size;
+        unlock(tbl);
+        return true;
+    }
+
+    // make a new object with its forward links.
+    int level = _random_level(tbl);
+    obj = (qskiplist_obj_t *) qlibc_malloc(sizeof(qskiplist_obj_t)
+                                     + sizeof(qskiplist_obj_t *) * level);
+    char *dupname = qlibc_strdup(name);
+    if (obj == NULL || dupname == NULL) {
+        if (obj != NULL)
+            qlibc_free(obj);
+        if (dupname != NULL)
+            qlibc_free(dupname);
+        qlibc_free(dup);
+        unlock(tbl);
+        errno = ENOMEM;
+        return false;
+    }
+    obj->name = dupname;
+    obj->data = dup;
+    obj->size = size;
+    obj->level = level;
+    obj->next = (qskiplist_obj_t **) (obj + 1);
+
+    for (; tbl->level < level; tbl->level++) {
+        update[tbl->level] = tbl->head;
+    }
+    int i;
+    for (i = 0; i < level; i++) {
+        obj->next[i] = update[i][i];
+        update[i][i] = obj;
+    }
+    tbl->num++;
+
+    unlock(tbl);
+    return true;
+}
+
+/**
+ * qskiplist->putstr(): Put a string into this table.
+ *
+ * @param tbl       qskiplist_t container pointer.
+ * @param name      key name.
+ * @param str       string data.
+ *
+ * @return true if successful, otherwise returns false.
+ * @retval errno will be set in error condition.
+ *  - EINVAL : Invalid argument.
+ *  - ENOMEM : Memory allocation failure.
+ */
+static bool putstr(qskiplist_t *tbl, const char *name, const char *str) {
+    size_t size = (str != NULL) ? (strlen(str) + 1) : 0;
+    return put(tbl, name, str, size);
+}
+
+/**
+ * qskiplist->putstrf(): Put a formatted string into this table.
+ *
+ * @param tbl       qskiplist_t container pointer.
+ * @param name      key name.
+ * @param format    formatted string data.
+ *
+ * @return true if successful, otherwise returns false.
+ * @retval errno will be set in error condition.
+ *  - EINVAL : Invalid argument.
+ *  - ENOMEM : Memory allocation failure.
+ */
+static bool putstrf(qskiplist_t *tbl, const char *name, const char *format,
+                    ...) {
+    char *str;
+    DYNAMIC_VSPRINTF(str, format);
+    if (str == NULL) {
+        errno = ENOMEM;
+        return false;
+    }
+
+    bool ret = putstr(tbl, name, str);
+    qlibc_free(str);
+    return ret;
+}
+
+/**
+ * qskiplist->putint(): Put an integer into this table as string type.
+ *
+ * @param tbl       qskiplist_t container pointer.
+ * @param name      key name.
+ * @param num       integer data.
+ *
+ * @return true if successful, otherwise returns false.
+ * @retval errno will be set in error condition.
+ *  - EINVAL : Invalid argument.
+ *  - ENOMEM : Memory allocation failure.
+ *
+ * @note
+ *  The integer will be converted to a string object and stored as string
+ *  object.
+ */
+static bool putint(qskiplist_t *tbl, const char *name, int64_t num) {
+    char str[20 + 1];
+    snprintf(str, sizeof(str), "%"PRId64, num);
+    return putstr(tbl, name, str);
+}
+
+/**
+ * qskiplist->get(): Get an object from this table.
+ *
+ * @param tbl       qskiplist_t container pointer.
+ * @param name      key name.
+ * @param size      if not NULL, object size will be stored.
+ * @param newmem    whether or not to allocate memory for the data.
+ *
+ * @return a pointer of data if the key is found, otherwise returns NULL.
+ * @retval errno will be set in error condition.
+ *  - ENOENT : No such key found.
+ *  - EINVAL : Invalid argument.
+ *  - ENOMEM : Memory allocation failure.
+ *
+ * @note
+ *  If newmem flag is set, returned data will be malloced and should be
+ *  deallocated by user. Otherwise returned pointer will point internal buffer
+ *  directly and should not be de-allocated by user. In thread-safe mode,
+ *  newmem flag must be set to true always.
+ */
+static void *get(qskiplist_t *tbl, const char *name, size_t *size,
+                 bool newmem) {
+    if (name == NULL) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    Q_MUTEX_ENTER_SHARED(tbl->qmutex);
+    void *data = NULL;
+    qskiplist_obj_t *obj = _find_obj(tbl, name, NULL);
+    if (obj != NULL && !strcmp(obj->name, name)) {
+        if (newmem == true) {
+            data = qlibc_malloc(obj->size);
+            if (data == NULL) {
+                errno = ENOMEM;
+                unlock(tbl);
+                return NULL;
+            }
+            memcpy(data, obj->data, obj->size);
+        } else {
+            data = obj->data;
+        }
+        if (size != NULL)
+            *size = obj->size;
+    }
+    unlock(tbl);
+
+    if (data == NULL)
+        errno = ENOENT;
+
+    return data;
+}
+
+/**
+ * qskiplist->getstr(): Finds an object and returns as string type.
+ *
+ * @param tbl       qskiplist_t container pointer.
+ * @param name      key name
+ * @param newmem    whether or not to allocate memory for the data.
+ *
+ * @return a pointer of data if the key is found, otherwise returns NULL.
+ * @retval errno will be set in error condition.
+ *  - ENOENT : No such key found.
+ *  - EINVAL : Invalid argument.
+ *  - ENOMEM : Memory allocation failure.
+ *
+ * @note
+ *  If newmem flag is set, returned data will be malloced and should be
+ *  deallocated by user.
+ */
+static char *getstr(qskiplist_t *tbl, const char *name, bool newmem) {
+    return (char *) get(tbl, name, NULL, newmem);
+}
+
+/**
+ * qskiplist->getint(): Finds an object with given name and returns as
+ * integer type.
+ *
+ * @param tbl   qskiplist_t container pointer.
+ * @param name  key name
+ *
+ * @return value integer if successful, otherwise(not found) returns 0
+ * @retval errno will be set in error condition.
+ *  - ENOENT : No such key found.
+ *  - EINVAL : Invalid argument.
+ *  - ENOMEM : Memory allocation failure.
+ */
+static int64_t getint(qskiplist_t *tbl, const char *name) {
+    int64_t num = 0;
+    char *str = getstr(tbl, name, true);
+    if (str != NULL) {
+        num = atoll(str);
+        qlibc_free(str);
+    }
+
+    return num;
+}
+
+/**
+ * qskiplist->getnext(): Get next element in key order.
+ *
+ * @param tbl       qskiplist_t container pointer.
+ * @param obj       found data will be stored in this object
+ * @param newmem    whether or not to allocate memory for the data.
+ *
+ * @return true if found otherwise returns false
+ * @retval errno will be set in error condition.
+ *  - ENOENT : No next element.
+ *  - EINVAL : Invalid argument.
+ *  - ENOMEM : Memory allocation failure.
+ *
+ * @code
+ *  qskiplist_obj_t obj;
+ *  memset((void*)&obj, 0, sizeof(obj)); // must be cleared before call
+ *  tbl->lock(tbl);
+ *  while(tbl->getnext(tbl, &obj, false) == true) {
+ *     printf("NAME=%s, DATA=%s, SIZE=%zu\n",
+ *     obj.name, (char*)obj.data, obj.size);
+ *  }
+ *  tbl->unlock(tbl);
+ * @endcode
+ *
+ * @note
+ *  obj should be initialized with 0 by using memset() before first call.
+ *  If newmem flag is true, user should de-allocate obj.name and obj.data
+ *  resources. Each call continues from the links in obj, so the table
+ *  should not be modified until the traversal is over.
+ */
+static bool getnext(qskiplist_t *tbl, qskiplist_obj_t *obj, bool newmem) {
+    return _getnext(tbl, obj, NULL, NULL, NULL, newmem);
+}
+
+/**
+ * qskiplist->getrange(): Get next element in a key range.
+ *
+ * @param tbl       qskiplist_t container pointer.
+ * @param obj       found data will be stored in this object
+ * @param min       lower bound of keys, inclusive. NULL for no lower bound.
+ * @param max       upper bound of keys, exclusive. NULL for no upper bound.
+ * @param newmem    whether or not to allocate memory for the data.
+ *
+ * @return true if found otherwise returns false
+ * @retval errno will be set in error condition.
+ *  - ENOENT : No next element.
+ *  - EINVAL : Invalid argument.
+ *  - ENOMEM : Memory allocation failure.
+ *
+ * @code
+ *  // objects of 2014-06, assuming keys are like "2014-06-11 12:30:00"
+ *  qskiplist_obj_t obj;
+ *  memset((void*)&obj, 0, sizeof(obj)); // must be cleared before call
+ *  tbl->lock(tbl);
+ *  while(tbl->getrange(tbl, &obj, "2014-06", "2014-07", false) == true) {
+ *     printf("NAME=%s, DATA=%s\n", obj.name, (char*)obj.data);
+ *  }
+ *  tbl->unlock(tbl);
+ * @endcode
+ *
+ * @note
+ *  The first call seeks the lower bound in O(log n) and the next calls
+ *  follow the links like getnext().
+ */
+static bool getrange(qskiplist_t *tbl, qskiplist_obj_t *obj,
+                     const char *min, const char *max, bool newmem) {
+    return _getnext(tbl, obj, min, max, NULL, newmem);
+}
+
+/**
+ * qskiplist->getprefix(): Get next element with a key prefix.
+ *
+ * @param tbl       qskiplist_t container pointer.
+ * @param obj       found data will be stored in this object
+ * @param prefix    key prefix
+ * @param newmem    whether or not to allocate memory for the data.
+ *
+ * @return true if found otherwise returns false
+ * @retval errno will be set in error condition.
+ *  - ENOENT : No next element.
+ *  - EINVAL : Invalid argument.
+ *  - ENOMEM : Memory allocation failure.
+ *
+ * @note
+ *  Same as getrange() except the scan ends at the first key not starting
+ *  with prefix.
+ */
+static bool getprefix(qskiplist_t *tbl, qskiplist_obj_t *obj,
+                      const char *prefix, bool newmem) {
+    if (prefix == NULL) {
+        errno = EINVAL;
+        return false;
+    }
+    return _getnext(tbl, obj, prefix, NULL, prefix, newmem);
+}
+
+/**
+ * qskiplist->remove(): Remove an object from this table.
+ *
+ * @param tbl   qskiplist_t container pointer.
+ * @param name  key name
+ *
+ * @return true if successful, otherwise(not found) returns false
+ * @retval errno will be set in error condition.
+ *  - ENOENT : No next element.
+ *  - EINVAL : Invalid argument.
+ */
+static bool remove_(qskiplist_t *tbl, const char *name) {
+    if (name == NULL) {
+        errno = EINVAL;
+        return false;
+    }
+
+    lock(tbl);
+    qskiplist_obj_t **update[MAX_LEVEL];
+    qskiplist_obj_t *obj = _find_obj(tbl, name, update);
+    if (obj == NULL || strcmp(obj->name, name)) {
+        unlock(tbl);
+        errno = ENOENT;
+        return false;
+    }
+
+    int i;
+    for (i = 0; i < obj->level; i++) {
+        update[i][i] = obj->next[i];
+    }
+    while (tbl->level > 1 && tbl->head[tbl->level - 1] == NULL) {
+        tbl->level--;
+    }
+    tbl->num--;
+    unlock(tbl);
+
+    qlibc_free(obj->name);
+    qlibc_free(obj->data);
+    qlibc_free(obj);
+
+    return true;
+}
+
+/**
+ * qskiplist->size(): Returns the number of keys in this table.
+ *
+ * @param tbl   qskiplist_t container pointer.
+ *
+ * @return number of elements stored
+ */
+static size_t size(qskiplist_t *tbl) {
+    return tbl->num;
+}
+
+/**
+ * qskiplist->clear(): Clears this table so that it will contain no keys.
+ *
+ * @param tbl   qskiplist_t container pointer.
+ */
+static void clear(qskiplist_t *tbl) {
+    lock(tbl);
+    qskiplist_obj_t *obj = tbl->head[0];
+    while (obj != NULL) {
+        qskiplist_obj_t *next = obj->next[0];
+        qlibc_free(obj->name);
+        qlibc_free(obj->data);
+        qlibc_free(obj);
+        obj = next;
+    }
+    memset((void *) tbl->head, 0, sizeof(qskiplist_obj_t *) * MAX_LEVEL);
+    tbl->level = 1;
+    tbl->num = 0;
+    unlock(tbl);
+}
+
+/**
+ * qskiplist->debug(): Print the table for debugging purpose
+ *
+ * @param tbl   qskiplist_t container pointer.
+ * @param out   output stream
+ *
+ * @return true if successful, otherwise returns false.
+ * @retval errno will be set in error condition.
+ *  - EIO : Invalid output stream.
+ */
+static bool debug(qskiplist_t *tbl, FILE *out) {
+    if (out == NULL) {
+        errno = EIO;
+        return false;
+    }
+
+    qskiplist_obj_t obj;
+    memset((void *) &obj, 0, sizeof(obj));  // must be cleared before call
+    lock(tbl);
+    while (tbl->getnext(tbl, &obj, false) == true) {
+        fprintf(out, "%s=", obj.name);
+        _q_humanOut(out, obj.data, obj.size, MAX_HUMANOUT);
+        fprintf(out, " (%zu, level=%d)\n", obj.size, obj.level);
+    }
+    unlock(tbl);
+
+    return true;
+}
+
+/**
+ * qskiplist->lock(): Enter critical section.
+ *
+ * @param tbl   qskiplist_t container pointer.
+ *
+ * @note
+ *  From user side, normally locking operation is only needed when traverse
+ *  elements using getnext(), getrange() or getprefix().
+ */
+static void lock(qskiplist_t *tbl) {
+    Q_MUTEX_ENTER(tbl->qmutex);
+}
+
+/**
+ * qskiplist->unlock(): Leave critical section.
+ *
+ * @param tbl   qskiplist_t container pointer.
+ */
+static void unlock(qskiplist_t *tbl) {
+    Q_MUTEX_LEAVE(tbl->qmutex);
+}
+
+/**
+ * qskiplist->free(): De-allocate the table
+ *
+ * @param tbl   qskiplist_t container pointer.
+ */
+static void free_(qskiplist_t *tbl) {
+    clear(tbl);
+    Q_MUTEX_DESTROY(tbl->qmutex);
+    qlibc_free(tbl->head);
+    qlibc_free(tbl);
+}
+
+#ifndef _DOXYGEN_SKIP
+
+/*
+ * Find the first object whose key is not less than the name. When update is
+ * not NULL, the links pointing to the found position are stored per level.
+ * lock must be obtained from caller.
+ */
+static qskiplist_obj_t *_find_obj(qskiplist_t *tbl, const char *name,
+                                  qskiplist_obj_t ***update) {
+    qskiplist_obj_t **links = tbl->head;
+    int i;
+    for (i = tbl->level - 1; i >= 0; i--) {
+        while (links[i] != NULL && strcmp(links[i]->name, name) < 0) {
+            links = links[i]->next;
+        }
+        if (update != NULL)
+            update[i] = links;
+    }
+    return links[0];
+}
+
+// level of a new object, a quarter of objects go up one more level.
+static int _random_level(qskiplist_t *tbl) {
+    int level = 1;
+    while (level < MAX_LEVEL) {
+        // xorshift32
+        tbl->seed ^= tbl->seed << 13;
+        tbl->seed ^= tbl->seed >> 17;
+        tbl->seed ^= tbl->seed << 5;
+        if ((tbl->seed & 0x03) != 0)
+            break;
+        level++;
+    }
+    return level;
+}
+
+static bool _getnext(qskiplist_t *tbl, qskiplist_obj_t *obj,
+                     const char *min, const char *max, const char *prefix,
+                     bool newmem) {
+    if (obj == NULL) {
+        errno = EINVAL;
+        return false;
+    }
+
+    Q_MUTEX_ENTER_SHARED(tbl->qmutex);
+
+    qskiplist_obj_t *cursor;
+    if (obj->name == NULL) {  // first time call
+        cursor = (min != NULL) ? _find_obj(tbl, min, NULL) : tbl->head[0];
+    } else {
+        cursor = (obj->next != NULL) ? obj->next[0] : NULL;
+    }
+
+    if (cursor != NULL) {
+        if ((max != NULL && strcmp(cursor->name, max) >= 0)
+            || (prefix != NULL
+                && strncmp(cursor->name, prefix, strlen(prefix)))) {
+            cursor = NULL;  // out of range
+        }
+    }
+
+    if (cursor == NULL) {
+        unlock(tbl);
+        errno = ENOENT;
+        return false;
+    }
+
+    if (newmem == true) {
+        obj->name = qlibc_strdup(cursor->name);
+        obj->data = qlibc_malloc(cursor->size);
+        if (obj->name == NULL || obj->data == NULL) {
+            DEBUG("getnext(): Unable to allocate memory.");
+            if (obj->name != NULL)
+                qlibc_free(obj->name);
+            if (obj->data != NULL)
+                qlibc_free(obj->data);
+            unlock(tbl);
+            errno = ENOMEM;
+            return false;
+        }
+        memcpy(obj->data, cursor->data, cursor->size);
+    } else {
+        obj->name = cursor->name;
+        obj->data = cursor->data;
+    }
+    obj->size = cursor->size;
+    obj->level = cursor->level;
+    obj->next = cursor->next;
+
+    unlock(tbl);
+    return true;
+}
+
+#endif /* _DOXYGEN_SKIP */
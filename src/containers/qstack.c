@@ -30,8 +30,9 @@
  * @file qstack.c Stack implementation.
  *
  * qstack container is a stack implementation. It represents a
- * last-in-first-out(LIFO). It extends qlist container that allow a linked-list
- * to be treated as a stack.
+ * last-in-first-out(LIFO). Elements are kept in a growable ring buffer, and
+ * small elements are stored inline in the buffer slots, so pushing and popping
+ * them doesn't allocate memory once the buffer has grown to its working size.
  *
  * @code
  *  [Conceptional Data Structure Diagram]
@@ -155,16 +156,16 @@ static void free_(qstack_t *stack);
  *   - QSTACK_THREADSAFE - make it thread-safe.
  */
 qstack_t *qstack(int options) {
-    qstack_t *stack = (qstack_t *) malloc(sizeof(qstack_t));
+    qstack_t *stack = (qstack_t *) qlibc_malloc(sizeof(qstack_t));
     if (stack == NULL) {
         errno = ENOMEM;
         return NULL;
     }
 
     memset((void *) stack, 0, sizeof(qstack_t));
-    stack->list = qlist(options);
-    if (stack->list == NULL) {
-        free(stack);
+    stack->ring = _q_ring((options & QSTACK_THREADSAFE) ? true : false);
+    if (stack->ring == NULL) {
+        qlibc_free(stack);
         return NULL;
     }
 
@@ -203,7 +204,7 @@ qstack_t *qstack(int options) {
  * @return previous maximum number.
  */
 static size_t setsize(qstack_t *stack, size_t max) {
-    return stack->list->setsize(stack->list, max);
+    return _q_ring_setsize(stack->ring, max);
 }
 
 /**
@@ -221,7 +222,7 @@ static size_t setsize(qstack_t *stack, size_t max) {
  *  - ENOMEM    : Memory allocation failure.
  */
 static bool push(qstack_t *stack, const void *data, size_t size) {
-    return stack->list->addfirst(stack->list, data, size);
+    return _q_ring_add(stack->ring, true, data, size);
 }
 
 /**
@@ -243,7 +244,7 @@ static bool pushstr(qstack_t *stack, const char *str) {
         errno = EINVAL;
         return false;
     }
-    return stack->list->addfirst(stack->list, str, strlen(str) + 1);
+    return _q_ring_add(stack->ring, true, str, strlen(str) + 1);
 }
 
 /**
@@ -259,7 +260,7 @@ static bool pushstr(qstack_t *stack, const char *str) {
  *  - ENOMEM    : Memory allocation failure.
  */
 static bool pushint(qstack_t *stack, int64_t num) {
-    return stack->list->addfirst(stack->list, &num, sizeof(int));
+    return _q_ring_add(stack->ring, true, &num, sizeof(num));
 }
 
 /**
@@ -275,7 +276,7 @@ static bool pushint(qstack_t *stack, int64_t num) {
  *  - ENOMEM    : Memory allocation failure.
  */
 static void *pop(qstack_t *stack, size_t *size) {
-    return stack->list->popfirst(stack->list, size);
+    return _q_ring_get(stack->ring, 0, size, true, true);
 }
 
 /**
@@ -294,7 +295,7 @@ static void *pop(qstack_t *stack, size_t *size) {
  */
 static char *popstr(qstack_t *stack) {
     size_t strsize;
-    char *str = stack->list->popfirst(stack->list, &strsize);
+    char *str = _q_ring_get(stack->ring, 0, &strsize, true, true);
     if (str != NULL) {
         str[strsize - 1] = '\0';  // just to make sure
     }
@@ -311,18 +312,13 @@ static char *popstr(qstack_t *stack) {
  * @return an integer value, otherwise returns 0.
  * @retval errno will be set in error condition.
  *  - ENOENT    : Stack is empty.
- *  - ENOMEM    : Memory allocation failure.
  *
  * @note
  * The integer element should be pushed through pushint().
  */
 static int64_t popint(qstack_t *stack) {
     int64_t num = 0;
-    int64_t *pnum = stack->list->popfirst(stack->list, NULL);
-    if (pnum != NULL) {
-        num = *pnum;
-        free(pnum);
-    }
+    _q_ring_read(stack->ring, 0, &num, sizeof(num), true);
 
     return num;
 }
@@ -346,7 +342,7 @@ static int64_t popint(qstack_t *stack) {
  *  at very first time.
  */
 static void *popat(qstack_t *stack, int index, size_t *size) {
-    return stack->list->popat(stack->list, index, size);
+    return _q_ring_get(stack->ring, index, size, true, true);
 }
 
 /**
@@ -363,7 +359,7 @@ static void *popat(qstack_t *stack, int index, size_t *size) {
  * @return a pointer of malloced element, otherwise returns NULL.
  */
 static void *get(qstack_t *stack, size_t *size, bool newmem) {
-    return stack->list->getfirst(stack->list, size, newmem);
+    return _q_ring_get(stack->ring, 0, size, newmem, false);
 }
 
 /**
@@ -382,7 +378,7 @@ static void *get(qstack_t *stack, size_t *size, bool newmem) {
  */
 static char *getstr(qstack_t *stack) {
     size_t strsize;
-    char *str = stack->list->getfirst(stack->list, &strsize, true);
+    char *str = _q_ring_get(stack->ring, 0, &strsize, true, false);
     if (str != NULL) {
         str[strsize - 1] = '\0';  // just to make sure
     }
@@ -399,18 +395,13 @@ static char *getstr(qstack_t *stack) {
  * @return an integer value, otherwise returns 0.
  * @retval errno will be set in error condition.
  *  - ENOENT    : Stack is empty.
- *  - ENOMEM    : Memory allocation failure.
  *
  * @note
  * The integer element should be pushed through pushint().
  */
 static int64_t getint(qstack_t *stack) {
     int64_t num = 0;
-    int64_t *pnum = stack->list->getfirst(stack->list, NULL, true);
-    if (pnum != NULL) {
-        num = *pnum;
-        free(pnum);
-    }
+    _q_ring_read(stack->ring, 0, &num, sizeof(num), false);
 
     return num;
 }
@@ -435,7 +426,7 @@ static int64_t getint(qstack_t *stack) {
  * very first time.
  */
 static void *getat(qstack_t *stack, int index, size_t *size, bool newmem) {
-    return stack->list->getat(stack->list, index, size, newmem);
+    return _q_ring_get(stack->ring, index, size, newmem, false);
 }
 
 /**
@@ -446,7 +437,7 @@ static void *getat(qstack_t *stack, int index, size_t *size, bool newmem) {
  * @return the number of elements in this stack.
  */
 static size_t size(qstack_t *stack) {
-    return stack->list->size(stack->list);
+    return _q_ring_size(stack->ring);
 }
 
 /**
@@ -455,7 +446,7 @@ static size_t size(qstack_t *stack) {
  * @param stack qstack container pointer.
  */
 static void clear(qstack_t *stack) {
-    stack->list->clear(stack->list);
+    _q_ring_clear(stack->ring);
 }
 
 /**
@@ -467,7 +458,7 @@ static void clear(qstack_t *stack) {
  * @return true if successful, otherwise returns false.
  */
 static bool debug(qstack_t *stack, FILE *out) {
-    return stack->list->debug(stack->list, out);
+    return _q_ring_debug(stack->ring, out);
 }
 
 /**
@@ -478,6 +469,6 @@ static bool debug(qstack_t *stack, FILE *out) {
  * @return always returns true.
  */
 static void free_(qstack_t *stack) {
-    stack->list->free(stack->list);
-    free(stack);
+    _q_ring_free(stack->ring);
+    qlibc_free(stack);
 }
@@ -0,0 +1,412 @@
+/******************************************************************************
+ * qLibc
+ *
+ * Copyright (c) 2010-2014 Seungyoung Kim.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *****************************************************************************/
+
+/**
+ * @file qstrbuf.c Growable string buffer implementation.
+ *
+ * qstrbuf builds a string piece by piece in one buffer which grows
+ * geometrically, so appending is amortized O(1) instead of copying the whole
+ * string on every append like qstrcatf() or qvector->addstrf() followed by
+ * tostring() do. The buffer is always terminated by '\0' and can contain
+ * binary data when it's appended by append_n().
+ *
+ * When building is done, steal() hands the buffer itself over to the caller
+ * without copy and the qstrbuf becomes empty, ready to build another string.
+ *
+ * @code
+ *  qstrbuf_t *sb = qstrbuf(0);
+ *
+ *  sb->append(sb, "GET / HTTP/1.1\r\n");
+ *  sb->appendf(sb, "Host: %s:%d\r\n", "localhost", 80);
+ *  sb->append_n(sb, "\r\n", 2);
+ *
+ *  size_t len;
+ *  char *req = sb->steal(sb, &len);
+ *  sb->free(sb);
+ *
+ *  (...use req...)
+ *  free(req);
+ * @endcode
+ *
+ * @note
+ *  qstrbuf is not thread-safe. It's meant to be owned by one builder.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include "qinternal.h"
+#include "containers/qstrbuf.h"
+
+#ifndef _DOXYGEN_SKIP
+
+#define DEFAULT_INITSIZE    (64)
+
+/*
+ * Member method protos
+ */
+static bool append(qstrbuf_t *sb, const char *str);
+static bool append_n(qstrbuf_t *sb, const void *data, size_t size);
+static bool appendf(qstrbuf_t *sb, const char *format, ...);
+static bool vappendf(qstrbuf_t *sb, const char *format, va_list arg);
+static bool reserve(qstrbuf_t *sb, size_t size);
+static bool truncate_(qstrbuf_t *sb, size_t len);
+static char *getstr(qstrbuf_t *sb, bool newmem);
+static char *steal(qstrbuf_t *sb, size_t *len);
+static size_t length(qstrbuf_t *sb);
+static void clear(qstrbuf_t *sb);
+static void free_(qstrbuf_t *sb);
+
+#endif
+
+/**
+ * Create a string buffer.
+ *
+ * @param initsize  initial buffer size. 0 for default size.
+ *
+ * @return qstrbuf_t container pointer.
+ * @retval errno will be set in error condition.
+ *  - ENOMEM    : Memory allocation failure.
+ *
+ * @code
+ *  // allocate memory
+ *  qstrbuf_t *sb = qstrbuf(0);
+ *  sb->free(sb);
+ * @endcode
+ */
+qstrbuf_t *qstrbuf(size_t initsize) {
+    qstrbuf_t *sb = (qstrbuf_t *) qlibc_calloc(1, sizeof(qstrbuf_t));
+    if (sb == NULL) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    sb->initsize = (initsize > 0) ? initsize : DEFAULT_INITSIZE;
+    if (reserve(sb, sb->initsize - 1) == false) {
+        qlibc_free(sb);
+        return NULL;
+    }
+
+    // methods
+    sb->append = append;
+    sb->append_n = append_n;
+    sb->appendf = appendf;
+    sb->vappendf = vappendf;
+
+    sb->reserve = reserve;
+    sb->truncate = truncate_;
+
+    sb->getstr = getstr;
+    sb->steal = steal;
+    sb->length = length;
+
+    sb->clear = clear;
+    sb->free = free_;
+
+    return sb;
+}
+
+/**
+ * qstrbuf->append(): Append a string.
+ *
+ * @param sb        qstrbuf_t container pointer.
+ * @param str       string to append.
+ *
+ * @return true if successful, otherwise returns false
+ * @retval errno will be set in error condition.
+ *  - EINVAL    : Invalid argument.
+ *  - ENOMEM    : Memory allocation failure.
+ */
+static bool append(qstrbuf_t *sb, const char *str) {
+    if (str == NULL) {
+        errno = EINVAL;
+        return false;
+    }
+    return append_n(sb, str, strlen(str));
+}
+
+/**
+ * qstrbuf->append_n(): Append data of given size.
+ *
+ * @param sb        qstrbuf_t container pointer.
+ * @param data      data to append. can be binary.
+ * @param size      size of data.
+ *
+ * @return true if successful, otherwise returns false
+ * @retval errno will be set in error condition.
+ *  - EINVAL    : Invalid argument.
+ *  - ENOMEM    : Memory allocation failure.
+ *
+ * @note
+ *  Data can be read straight into the room made by reserve() and then
+ *  appended from there, at getstr(sb, false) + length(sb).
+ */
+static bool append_n(qstrbuf_t *sb, const void *data, size_t size) {
+    if (data == NULL && size > 0) {
+        errno = EINVAL;
+        return false;
+    }
+    if (reserve(sb, size) == false) {
+        return false;
+    }
+
+    memmove(sb->buf + sb->len, data, size);
+    sb->len += size;
+    sb->buf[sb->len] = '\0';
+    return true;
+}
+
+/**
+ * qstrbuf->appendf(): Append a formatted string.
+ *
+ * @param sb        qstrbuf_t container pointer.
+ * @param format    string format.
+ *
+ * @return true if successful, otherwise returns false
+ * @retval errno will be set in error condition.
+ *  - EINVAL    : Invalid argument.
+ *  - ENOMEM    : Memory allocation failure.
+ *
+ * @note
+ *  The string is printed directly into the buffer. It's printed a second
+ *  time only when it didn't fit in the room left.
+ */
+static bool appendf(qstrbuf_t *sb, const char *format, ...) {
+    va_list arg;
+    va_start(arg, format);
+    bool ret = vappendf(sb, format, arg);
+    va_end(arg);
+    return ret;
+}
+
+/**
+ * qstrbuf->vappendf(): Append a formatted string with va_list.
+ *
+ * @param sb        qstrbuf_t container pointer.
+ * @param format    string format.
+ * @param arg       variable argument list.
+ *
+ * @return true if successful, otherwise returns false
+ * @retval errno will be set in error condition.
+ *  - EINVAL    : Invalid argument.
+ *  - ENOMEM    : Memory allocation failure.
+ */
+static bool vappendf(qstrbuf_t *sb, const char *format, va_list arg) {
+    if (format == NULL) {
+        errno = EINVAL;
+        return false;
+    }
+    if (sb->buf == NULL && reserve(sb, 0) == false) {
+        return false;
+    }
+
+    va_list arg2;
+    va_copy(arg2, arg);
+    size_t room = sb->cap - sb->len;
+    int n = vsnprintf(sb->buf + sb->len, room, format, arg2);
+    va_end(arg2);
+    if (n < 0) {
+        sb->buf[sb->len] = '\0';
+        errno = EINVAL;
+        return false;
+    }
+
+    if ((size_t) n >= room) {
+        if (reserve(sb, n) == false) {
+            sb->buf[sb->len] = '\0';
+            return false;
+        }
+        va_copy(arg2, arg);
+        vsnprintf(sb->buf + sb->len, sb->cap - sb->len, format, arg2);
+        va_end(arg2);
+    }
+    sb->len += n;
+    return true;
+}
+
+/**
+ * qstrbuf->reserve(): Make sure the buffer has room for given size of more
+ * data, so the following appends up to that size don't reallocate.
+ *
+ * @param sb        qstrbuf_t container pointer.
+ * @param size      size of data to be appended.
+ *
+ * @return true if successful, otherwise returns false
+ * @retval errno will be set in error condition.
+ *  - ENOMEM    : Memory allocation failure.
+ */
+static bool reserve(qstrbuf_t *sb, size_t size) {
+    size_t need = sb->len + size + 1;
+    if (need <= sb->len) {
+        errno = ENOMEM;
+        return false;
+    }
+    if (need <= sb->cap && sb->buf != NULL) {
+        return true;
+    }
+
+    size_t newcap = (sb->cap > 0) ? sb->cap : sb->initsize;
+    while (newcap < need) {
+        if (newcap > ((size_t) -1) / 2) {
+            newcap = need;
+            break;
+        }
+        newcap *= 2;
+    }
+
+    char *buf = (char *) qlibc_realloc(sb->buf, newcap);
+    if (buf == NULL) {
+        errno = ENOMEM;
+        return false;
+    }
+    if (sb->buf == NULL) {
+        buf[0] = '\0';
+    }
+    // take the slack of the allocator's size class too.
+    size_t usable = qlibc_usable_size(buf);
+    sb->buf = buf;
+    sb->cap = (usable > newcap) ? usable : newcap;
+    return true;
+}
+
+/**
+ * qstrbuf->truncate(): Cut the string down to given length.
+ *
+ * @param sb        qstrbuf_t container pointer.
+ * @param len       new length, which can't be greater than current length.
+ *
+ * @return true if successful, otherwise returns false
+ * @retval errno will be set in error condition.
+ *  - ERANGE    : len is greater than current length.
+ */
+static bool truncate_(qstrbuf_t *sb, size_t len) {
+    if (len > sb->len) {
+        errno = ERANGE;
+        return false;
+    }
+    if (sb->buf != NULL) {
+        sb->len = len;
+        sb->buf[len] = '\0';
+    }
+    return true;
+}
+
+/**
+ * qstrbuf->getstr(): Get the string built so far.
+ *
+ * @param sb        qstrbuf_t container pointer.
+ * @param newmem    whether or not to allocate memory for the string.
+ *
+ * @return a pointer of the string, otherwise returns NULL
+ * @retval errno will be set in error condition.
+ *  - ENOMEM    : Memory allocation failure.
+ *
+ * @note
+ *  When newmem is false, the returned pointer is valid until the next call
+ *  modifying the buffer.
+ */
+static char *getstr(qstrbuf_t *sb, bool newmem) {
+    if (sb->buf == NULL && reserve(sb, 0) == false) {
+        return NULL;
+    }
+    if (newmem == false) {
+        return sb->buf;
+    }
+
+    char *str = (char *) qlibc_malloc(sb->len + 1);
+    if (str == NULL) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    memcpy(str, sb->buf, sb->len + 1);
+    return str;
+}
+
+/**
+ * qstrbuf->steal(): Take the buffer over without copy. The qstrbuf becomes
+ * empty and can be used to build another string.
+ *
+ * @param sb        qstrbuf_t container pointer.
+ * @param len       if len is not NULL, length of the string will be stored.
+ *
+ * @return a pointer of malloced string, otherwise returns NULL
+ * @retval errno will be set in error condition.
+ *  - ENOMEM    : Memory allocation failure.
+ *
+ * @note
+ *  The returned string is always terminated by '\0' and must be
+ *  de-allocated by the caller.
+ */
+static char *steal(qstrbuf_t *sb, size_t *len) {
+    if (sb->buf == NULL && reserve(sb, 0) == false) {
+        return NULL;
+    }
+
+    char *str = sb->buf;
+    if (len != NULL)
+        *len = sb->len;
+    sb->buf = NULL;
+    sb->len = 0;
+    sb->cap = 0;
+    return str;
+}
+
+/**
+ * qstrbuf->length(): Get the length of the string.
+ *
+ * @param sb        qstrbuf_t container pointer.
+ *
+ * @return the length of the string
+ */
+static size_t length(qstrbuf_t *sb) {
+    return sb->len;
+}
+
+/**
+ * qstrbuf->clear(): Empty the string. Allocated buffer is kept for reuse.
+ *
+ * @param sb        qstrbuf_t container pointer.
+ */
+static void clear(qstrbuf_t *sb) {
+    sb->len = 0;
+    if (sb->buf != NULL)
+        sb->buf[0] = '\0';
+}
+
+/**
+ * qstrbuf->free(): De-allocate the buffer and the object.
+ *
+ * @param sb        qstrbuf_t container pointer.
+ */
+static void free_(qstrbuf_t *sb) {
+    qlibc_free_sized(sb->buf, sb->cap);
+    qlibc_free_sized(sb, sizeof(qstrbuf_t));
+}
@@ -30,8 +30,13 @@
  * @file qvector.c Vector implementation.
  *
  * qvector container is a vector implementation. It implements a growable array
- * of objects and it extends qlist container that allow a linked-list to be
- * treated as a vector.
+ * of objects. Elements are stored back to back in one contiguous buffer which
+ * grows geometrically, so indexed access by getat() and setat() is O(1) and
+ * toarray() is a single copy.
+ *
+ * While all elements have same size, the position of an element is computed
+ * from its index. Once an element of different size is stored, the vector
+ * keeps an offset table to locate elements instead.
  *
  * @code
  *  [Code sample - Object]
@@ -111,21 +116,40 @@
 #include <errno.h>
 #include "qinternal.h"
 #include "containers/qvector.h"
+#include "containers/qstrbuf.h"
+
+#ifndef _DOXYGEN_SKIP
+
+#define DEFAULT_DATA_CAP    (64)
+#define DEFAULT_OFFSET_CAP  (16)
 
 /*
  * Member method protos
  */
-#ifndef _DOXYGEN_SKIP
 static bool add(qvector_t *vector, const void *object, size_t size);
 static bool addstr(qvector_t *vector, const char *str);
 static bool addstrf(qvector_t *vector, const char *format, ...);
+static void *getat(qvector_t *vector, int index, size_t *size, bool newmem);
+static bool setat(qvector_t *vector, int index, const void *data, size_t size);
+static bool removeat(qvector_t *vector, int index);
 static void *toarray(qvector_t *vector, size_t *size);
 static char *tostring(qvector_t *vector);
 static size_t size(qvector_t *vector);
 static size_t datasize(qvector_t *vector);
 static void clear(qvector_t *vector);
 static bool debug(qvector_t *vector, FILE *out);
+static bool snapshot(qvector_t *vector, const char *filepath);
+static ssize_t restore(qvector_t *vector, const char *filepath);
+static void lock(qvector_t *vector);
+static void unlock(qvector_t *vector);
 static void free_(qvector_t *vector);
+
+/* internal functions */
+static bool _index(qvector_t *vector, int *index);
+static size_t _offset(qvector_t *vector, size_t index);
+static size_t _objsize(qvector_t *vector, size_t index);
+static bool _reserve_data(qvector_t *vector, size_t needsize);
+static bool _make_variable(qvector_t *vector);
 #endif
 
 /**
@@ -148,17 +172,20 @@ static void free_(qvector_t *vector);
  *   - QVECTOR_THREADSAFE - make it thread-safe.
  */
 qvector_t *qvector(int options) {
-    qvector_t *vector = (qvector_t *) calloc(1, sizeof(qvector_t));
+    qvector_t *vector = (qvector_t *) qlibc_calloc(1, sizeof(qvector_t));
     if (vector == NULL) {
         errno = ENOMEM;
         return NULL;
     }
 
-    vector->list = qlist(options);
-    if (vector->list == NULL) {
-        free(vector);
-        errno = ENOMEM;
-        return NULL;
+    // handle options.
+    if (options & QVECTOR_THREADSAFE) {
+        Q_MUTEX_NEW(vector->qmutex, true);
+        if (vector->qmutex == NULL) {
+            qlibc_free(vector);
+            errno = ENOMEM;
+            return NULL;
+        }
     }
 
     // methods
@@ -166,6 +193,10 @@ qvector_t *qvector(int options) {
     vector->addstr = addstr;
     vector->addstrf = addstrf;
 
+    vector->getat = getat;
+    vector->setat = setat;
+    vector->removeat = removeat;
+
     vector->toarray = toarray;
     vector->tostring = tostring;
 
@@ -173,6 +204,12 @@ qvector_t *qvector(int options) {
     vector->datasize = datasize;
     vector->clear = clear;
     vector->debug = debug;
+    vector->snapshot = snapshot;
+    vector->restore = restore;
+
+    vector->lock = lock;
+    vector->unlock = unlock;
+
     vector->free = free_;
 
     return vector;
@@ -191,7 +228,52 @@ qvector_t *qvector(int options) {
  *  - ENOMEM    : Memory allocation failure.
  */
 static bool add(qvector_t *vector, const void *data, size_t size) {
-    return vector->list->addlast(vector->list, data, size);
+    if (data == NULL || size <= 0) {
+        errno = EINVAL;
+        return false;
+    }
+
+    lock(vector);
+
+    // switch to variable size mode if the size differs.
+    if (vector->num > 0 && vector->objsize != 0 && vector->objsize != size) {
+        if (_make_variable(vector) == false) {
+            unlock(vector);
+            return false;
+        }
+    }
+
+    // make room for the offset of next element.
+    if (vector->objsize == 0 && vector->num > 0
+            && vector->num + 2 > vector->offcap) {
+        size_t newcap = vector->offcap * 2;
+        size_t *offsets = (size_t *) qlibc_realloc(vector->offsets,
+                                             newcap * sizeof(size_t));
+        if (offsets == NULL) {
+            unlock(vector);
+            errno = ENOMEM;
+            return false;
+        }
+        vector->offsets = offsets;
+        vector->offcap = newcap;
+    }
+
+    if (_reserve_data(vector, vector->datasum + size) == false) {
+        unlock(vector);
+        return false;
+    }
+
+    memcpy(vector->data + vector->datasum, data, size);
+    vector->datasum += size;
+    if (vector->num == 0) {
+        vector->objsize = size;
+    } else if (vector->objsize == 0) {
+        vector->offsets[vector->num + 1] = vector->datasum;
+    }
+    vector->num++;
+
+    unlock(vector);
+    return true;
 }
 
 /**
@@ -206,7 +288,11 @@ static bool add(qvector_t *vector, const void *data, size_t size) {
  *  - ENOMEM    : Memory allocation failure.
  */
 static bool addstr(qvector_t *vector, const char *str) {
-    return vector->list->addlast(vector->list, str, strlen(str));
+    if (str == NULL) {
+        errno = EINVAL;
+        return false;
+    }
+    return add(vector, str, strlen(str));
 }
 
 /**
@@ -229,11 +315,167 @@ static bool addstrf(qvector_t *vector, const char *format, ...) {
     }
 
     bool ret = addstr(vector, str);
-    free(str);
+    qlibc_free(str);
 
     return ret;
 }
 
+/**
+ * qvector->getat(): Returns the element at the specified position in this
+ * vector.
+ *
+ * @param vector    qvector_t container pointer.
+ * @param index     index of the element. negative index counts from the end.
+ * @param size      if size is not NULL, element size will be stored.
+ * @param newmem    whether or not to allocate memory for the element.
+ *
+ * @return a pointer of element, otherwise returns NULL.
+ * @retval errno will be set in error condition.
+ *  - ERANGE    : Index out of range.
+ *  - ENOMEM    : Memory allocation failure.
+ *
+ * @code
+ *  size_t size;
+ *  struct sampleobj *obj = vector->getat(vector, 1, &size, false);
+ * @endcode
+ *
+ * @note
+ *  If newmem flag is false, returned pointer points the internal buffer and
+ *  it becomes invalid once the vector is modified. In thread-safe mode,
+ *  hold lock() while using it.
+ */
+static void *getat(qvector_t *vector, int index, size_t *size, bool newmem) {
+    lock(vector);
+    if (_index(vector, &index) == false) {
+        unlock(vector);
+        errno = ERANGE;
+        return NULL;
+    }
+
+    size_t objsize = _objsize(vector, index);
+    void *data = vector->data + _offset(vector, index);
+    if (newmem == true) {
+        void *dup = qlibc_malloc(objsize);
+        if (dup == NULL) {
+            unlock(vector);
+            errno = ENOMEM;
+            return NULL;
+        }
+        memcpy(dup, data, objsize);
+        data = dup;
+    }
+    unlock(vector);
+
+    if (size != NULL)
+        *size = objsize;
+    return data;
+}
+
+/**
+ * qvector->setat(): Replaces the element at the specified position in this
+ * vector.
+ *
+ * @param vector    qvector_t container pointer.
+ * @param index     index of the element. negative index counts from the end.
+ * @param data      a pointer of new element data
+ * @param size      size of new element
+ *
+ * @return true if successful, otherwise returns false
+ * @retval errno will be set in error condition.
+ *  - ERANGE    : Index out of range.
+ *  - EINVAL    : Invalid argument.
+ *  - ENOMEM    : Memory allocation failure.
+ *
+ * @note
+ *  Replacing with same size of data is O(1). Otherwise following elements
+ *  are moved.
+ */
+static bool setat(qvector_t *vector, int index, const void *data, size_t size) {
+    if (data == NULL || size <= 0) {
+        errno = EINVAL;
+        return false;
+    }
+
+    lock(vector);
+    if (_index(vector, &index) == false) {
+        unlock(vector);
+        errno = ERANGE;
+        return false;
+    }
+
+    size_t oldsize = _objsize(vector, index);
+    if (oldsize != size) {
+        if (vector->num == 1) {
+            vector->objsize = size;
+        } else if (vector->objsize != 0 && _make_variable(vector) == false) {
+            unlock(vector);
+            return false;
+        }
+        if (size > oldsize
+                && _reserve_data(vector, vector->datasum - oldsize + size)
+                        == false) {
+            unlock(vector);
+            return false;
+        }
+
+        // move following elements.
+        size_t offset = _offset(vector, index);
+        memmove(vector->data + offset + size, vector->data + offset + oldsize,
+                vector->datasum - (offset + oldsize));
+        vector->datasum = vector->datasum - oldsize + size;
+        if (vector->objsize == 0) {
+            size_t i;
+            for (i = index + 1; i <= vector->num; i++) {
+                vector->offsets[i] = vector->offsets[i] - oldsize + size;
+            }
+        }
+    }
+    memcpy(vector->data + _offset(vector, index), data, size);
+
+    unlock(vector);
+    return true;
+}
+
+/**
+ * qvector->removeat(): Removes the element at the specified position in this
+ * vector.
+ *
+ * @param vector    qvector_t container pointer.
+ * @param index     index of the element. negative index counts from the end.
+ *
+ * @return true if successful, otherwise returns false.
+ * @retval errno will be set in error condition.
+ *  - ERANGE    : Index out of range.
+ */
+static bool removeat(qvector_t *vector, int index) {
+    lock(vector);
+    if (_index(vector, &index) == false) {
+        unlock(vector);
+        errno = ERANGE;
+        return false;
+    }
+
+    size_t offset = _offset(vector, index);
+    size_t objsize = _objsize(vector, index);
+    memmove(vector->data + offset, vector->data + offset + objsize,
+            vector->datasum - (offset + objsize));
+    vector->datasum -= objsize;
+    if (vector->objsize == 0) {
+        size_t i;
+        for (i = index; i < vector->num; i++) {
+            vector->offsets[i] = vector->offsets[i + 1] - objsize;
+        }
+    }
+    vector->num--;
+    if (vector->num == 0) {
+        vector->objsize = 0;
+        vector->datasum = 0;
+    }
+
+    unlock(vector);
+    return true;
+}
+
 /**
  * qvector->toarray(): Returns the serialized chunk containing all the
  * elements in this vector.
@@ -248,7 +490,26 @@ static bool addstrf(qvector_t *vector, const char *format, ...) {
  *  - ENOMEM    : Memory allocation failure.
  */
 static void *toarray(qvector_t *vector, size_t *size) {
-    return vector->list->toarray(vector->list, size);
+    if (vector->num <= 0) {
+        if (size != NULL)
+            *size = 0;
+        errno = ENOENT;
+        return NULL;
+    }
+
+    lock(vector);
+    void *chunk = qlibc_malloc(vector->datasum);
+    if (chunk == NULL) {
+        unlock(vector);
+        errno = ENOMEM;
+        return NULL;
+    }
+    memcpy(chunk, vector->data, vector->datasum);
+    if (size != NULL)
+        *size = vector->datasum;
+    unlock(vector);
+
+    return chunk;
 }
 
 /**
@@ -266,7 +527,32 @@ static void *toarray(qvector_t *vector, size_t *size) {
  * Return string is always terminated by '\0'.
  */
 static char *tostring(qvector_t *vector) {
-    return vector->list->tostring(vector->list);
+    if (vector->num <= 0) {
+        errno = ENOENT;
+        return NULL;
+    }
+
+    lock(vector);
+    qstrbuf_t *sb = qstrbuf(vector->datasum + 1);
+    if (sb == NULL) {
+        unlock(vector);
+        return NULL;
+    }
+
+    size_t i;
+    for (i = 0; i < vector->num; i++) {
+        char *data = (char *) vector->data + _offset(vector, i);
+        size_t size = _objsize(vector, i);
+        // do not copy tailing '\0'
+        if (data[size - 1] == '\0')
+            size -= 1;
+        sb->append_n(sb, data, size);
+    }
+    unlock(vector);
+
+    char *chunk = sb->steal(sb, NULL);
+    sb->free(sb);
+    return chunk;
 }
 
 /**
@@ -277,7 +563,7 @@ static char *tostring(qvector_t *vector) {
  * @return the number of elements in this vector.
  */
 static size_t size(qvector_t *vector) {
-    return vector->list->size(vector->list);
+    return vector->num;
 }
 
 /**
@@ -289,16 +575,23 @@ static size_t size(qvector_t *vector) {
  * @return the sum of total element size in this vector.
  */
 static size_t datasize(qvector_t *vector) {
-    return vector->list->datasize(vector->list);
+    return vector->datasum;
 }
 
 /**
  * qvector->clear(): Removes all of the elements from this vector.
  *
  * @param vector    qvector_t container pointer.
+ *
+ * @note
+ *  Allocated buffer is kept for reuse. Use free() to release it.
  */
 static void clear(qvector_t *vector) {
-    vector->list->clear(vector->list);
+    lock(vector);
+    vector->num = 0;
+    vector->datasum = 0;
+    vector->objsize = 0;
+    unlock(vector);
 }
 
 /**
@@ -312,7 +605,128 @@ static void clear(qvector_t *vector) {
  *  - EIO   : Invalid output stream.
  */
 static bool debug(qvector_t *vector, FILE *out) {
-    return vector->list->debug(vector->list, out);
+    if (out == NULL) {
+        errno = EIO;
+        return false;
+    }
+
+    lock(vector);
+    size_t i;
+    for (i = 0; i < vector->num; i++) {
+        size_t size = _objsize(vector, i);
+        fprintf(out, "%zu=", i);
+        _q_humanOut(out, vector->data + _offset(vector, i), size,
+                    MAX_HUMANOUT);
+        fprintf(out, " (%zu)\n", size);
+    }
+    unlock(vector);
+
+    return true;
+}
+
+/**
+ * qvector->snapshot(): Save this vector to a binary snapshot file.
+ *
+ * The snapshot is written to a temporary file and renamed to filepath, so
+ * an existing snapshot is replaced at once.
+ *
+ * @param vector    qvector_t container pointer.
+ * @param filepath  snapshot file path.
+ *
+ * @return true if successful, otherwise returns false.
+ * @retval errno will be set in error condition.
+ *  - EINVAL : Invalid argument.
+ *  - ENOMEM : Memory allocation failure.
+ *  - Others : errors from open() and write().
+ *
+ * @note
+ *  The file is in host byte order and not meant to be moved between
+ *  machines.
+ */
+static bool snapshot(qvector_t *vector, const char *filepath) {
+    qsnap_t *snap = _q_snap_create(filepath, Q_SNAP_QVECTOR, 0);
+    if (snap == NULL)
+        return false;
+
+    bool ok = true;
+    lock(vector);
+    size_t i;
+    for (i = 0; ok == true && i < vector->num; i++) {
+        ok = _q_snap_write(snap, 0, NULL, 0,
+                           vector->data + _offset(vector, i),
+                           _objsize(vector, i));
+    }
+    unlock(vector);
+
+    if (ok == false) {
+        _q_snap_abort(snap);
+        return false;
+    }
+    return _q_snap_commit(snap);
+}
+
+/**
+ * qvector->restore(): Append elements from a snapshot file made by
+ * snapshot() at the end of this vector.
+ *
+ * @param vector    qvector_t container pointer.
+ * @param filepath  snapshot file path.
+ *
+ * @return the number of loaded elements, otherwise returns -1.
+ * @retval errno will be set in error condition.
+ *  - EINVAL  : Invalid argument.
+ *  - EBADMSG : Not a qvector snapshot or checksum mismatch.
+ *  - ENOMEM  : Memory allocation failure.
+ *
+ * @note
+ *  Elements loaded before an error are left in the vector.
+ */
+static ssize_t restore(qvector_t *vector, const char *filepath) {
+    size_t num = 0;
+    qsnap_t *snap = _q_snap_open(filepath, Q_SNAP_QVECTOR, NULL, &num);
+    if (snap == NULL)
+        return -1;
+
+    ssize_t cnt = 0;
+    qsnap_rec_t rec;
+    lock(vector);
+    while (_q_snap_read(snap, &rec) == true) {
+        if (add(vector, rec.data, rec.size) == false)
+            break;
+        cnt++;
+    }
+    unlock(vector);
+    _q_snap_close(snap);
+
+    return (cnt == (ssize_t) num) ? cnt : -1;
+}
+
+/**
+ * qvector->lock(): Enters critical section.
+ *
+ * @param vector    qvector_t container pointer.
+ *
+ * @note
+ *  Normally locking is only needed when a pointer returned by getat() with
+ *  newmem false is used.
+ *  This operation will do nothing if QVECTOR_THREADSAFE option was not
+ *  given at the initialization time.
+ */
+static void lock(qvector_t *vector) {
+    Q_MUTEX_ENTER(vector->qmutex);
+}
+
+/**
+ * qvector->unlock(): Leaves critical section.
+ *
+ * @param vector    qvector_t container pointer.
+ *
+ * @note
+ *  This operation will do nothing if QVECTOR_THREADSAFE option was not
+ *  given at the initialization time.
+ */
+static void unlock(qvector_t *vector) {
+    Q_MUTEX_LEAVE(vector->qmutex);
 }
 
 /**
@@ -321,6 +735,75 @@ static bool debug(qvector_t *vector, FILE *out) {
  * @param vector    qvector_t container pointer.
  */
 static void free_(qvector_t *vector) {
-    vector->list->free(vector->list);
-    free(vector);
+    qlibc_free(vector->data);
+    qlibc_free(vector->offsets);
+    Q_MUTEX_DESTROY(vector->qmutex);
+    qlibc_free(vector);
 }
+
+#ifndef _DOXYGEN_SKIP
+
+// convert negative index and check range.
+static bool _index(qvector_t *vector, int *index) {
+    if (*index < 0)
+        *index += vector->num;
+    return (*index >= 0 && *index < vector->num);
+}
+
+static size_t _offset(qvector_t *vector, size_t index) {
+    if (vector->objsize != 0)
+        return index * vector->objsize;
+    return vector->offsets[index];
+}
+
+static size_t _objsize(qvector_t *vector, size_t index) {
+    if (vector->objsize != 0)
+        return vector->objsize;
+    return vector->offsets[index + 1] - vector->offsets[index];
+}
+
+// grow data buffer geometrically to hold needsize bytes.
+static bool _reserve_data(qvector_t *vector, size_t needsize) {
+    if (needsize <= vector->datacap)
+        return true;
+
+    size_t newcap = (vector->datacap > 0) ? vector->datacap : DEFAULT_DATA_CAP;
+    while (newcap < needsize)
+        newcap *= 2;
+
+    void *data = qlibc_realloc(vector->data, newcap);
+    if (data == NULL) {
+        errno = ENOMEM;
+        return false;
+    }
+    vector->data = data;
+    vector->datacap = newcap;
+    return true;
+}
+
+// build offset table from fixed element size.
+static bool _make_variable(qvector_t *vector) {
+    size_t newcap = DEFAULT_OFFSET_CAP;
+    while (newcap < vector->num + 2)
+        newcap *= 2;
+
+    if (newcap > vector->offcap) {
+        size_t *offsets = (size_t *) qlibc_realloc(vector->offsets,
+                                             newcap * sizeof(size_t));
+        if (offsets == NULL) {
+            errno = ENOMEM;
+            return false;
+        }
+        vector->offsets = offsets;
+        vector->offcap = newcap;
+    }
+
+    size_t i;
+    for (i = 0; i <= vector->num; i++) {
+        vector->offsets[i] = i * vector->objsize;
+    }
+    vector->objsize = 0;
+    return true;
+}
+
+#endif /* _DOXYGEN_SKIP */
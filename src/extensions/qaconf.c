@@ -201,6 +201,7 @@
 #include <string.h>
 #include <assert.h>
 #include <errno.h>
+#include <fcntl.h>
 #include "qinternal.h"
 #include "utilities/qstring.h"
 #include "extensions/qaconf.h"
@@ -240,7 +241,7 @@ static int _is_str_bool(const char *s);
  */
 qaconf_t *qaconf(void) {
     // Malloc qaconf_t structure
-    qaconf_t *qaconf = (qaconf_t *) malloc(sizeof(qaconf_t));
+    qaconf_t *qaconf = (qaconf_t *) qlibc_malloc(sizeof(qaconf_t));
     if (qaconf == NULL)
         return NULL;
 
@@ -446,7 +447,7 @@ static int addoptions(qaconf_t *qaconf, const qaconf_option_t *options) {
 
     // Realloc
     size_t newsize = sizeof(qaconf_option_t) * (qaconf->numoptions + numopts);
-    qaconf->options = (qaconf_option_t *) realloc(qaconf->options, newsize);
+    qaconf->options = (qaconf_option_t *) qlibc_realloc(qaconf->options, newsize);
     memcpy(&qaconf->options[qaconf->numoptions], options,
            sizeof(qaconf_option_t) * numopts);
     qaconf->numoptions += numopts;
@@ -534,11 +535,14 @@ static int parse(qaconf_t *qaconf, const char *filepath, uint8_t flags) {
         _seterrmsg(qaconf, "Failed to open file '%s'.", filepath);
         return -1;
     }
+#ifdef POSIX_FADV_SEQUENTIAL
+    posix_fadvise(fileno(fp), 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
 
     // Set info
     if (qaconf->filepath != NULL)
-        free(qaconf->filepath);
-    qaconf->filepath = strdup(filepath);
+        qlibc_free(qaconf->filepath);
+    qaconf->filepath = qlibc_strdup(filepath);
     qaconf->lineno = 0;
 
     // Parse
@@ -584,7 +588,7 @@ static const char *errmsg(qaconf_t *qaconf) {
  */
 static void reseterror(qaconf_t *qaconf) {
     if (qaconf->errstr != NULL) {
-        free(qaconf->errstr);
+        qlibc_free(qaconf->errstr);
         qaconf->errstr = NULL;
     }
 }
@@ -600,12 +604,12 @@ static void reseterror(qaconf_t *qaconf) {
  */
 static void free_(qaconf_t *qaconf) {
     if (qaconf->filepath != NULL)
-        free(qaconf->filepath);
+        qlibc_free(qaconf->filepath);
     if (qaconf->errstr != NULL)
-        free(qaconf->errstr);
+        qlibc_free(qaconf->errstr);
     if (qaconf->options != NULL)
-        free(qaconf->options);
-    free(qaconf);
+        qlibc_free(qaconf->options);
+    qlibc_free(qaconf);
 }
 
 #ifndef _DOXYGEN_SKIP
@@ -658,7 +662,7 @@ static int _parse_inline(qaconf_t *qaconf, FILE *fp, uint8_t flags,
         DEBUG("%s (line=%d)", buf, qaconf->lineno);
 
         // Create a callback data
-        qaconf_cbdata_t *cbdata = (qaconf_cbdata_t*) malloc(
+        qaconf_cbdata_t *cbdata = (qaconf_cbdata_t*) qlibc_malloc(
                 sizeof(qaconf_cbdata_t));
         ASSERT(cbdata != NULL);
         memset(cbdata, '\0', sizeof(qaconf_cbdata_t));
@@ -697,7 +701,7 @@ static int _parse_inline(qaconf_t *qaconf, FILE *fp, uint8_t flags,
 
         // Brackets has removed at this point
         // Copy data into cbdata buffer.
-        cbdata->data = strdup(sp);
+        cbdata->data = qlibc_strdup(sp);
         ASSERT(cbdata->data != NULL);
 
         // Parse and tokenize.
@@ -708,7 +712,7 @@ static int _parse_inline(qaconf_t *qaconf, FILE *fp, uint8_t flags,
             // Allocate/Realloc argv array
             if (argvsize == cbdata->argc) {
                 argvsize += (argvsize == 0) ? ARGV_INIT_SIZE : ARGV_INCR_STEP;
-                cbdata->argv = (char**) realloc((void *) cbdata->argv,
+                cbdata->argv = (char**) qlibc_realloc((void *) cbdata->argv,
                                                 sizeof(char*) * argvsize);
                 ASSERT(cbdata->argv != NULL);
             }
@@ -743,7 +747,8 @@ static int _parse_inline(qaconf_t *qaconf, FILE *fp, uint8_t flags,
                         break;
                     }
                 } else if (*wp2 == '\\') {
-                    if (qtmark > 0) {
+                    // a backslash at the end has nothing to escape.
+                    if (qtmark > 0 && wp2[1] != '\0') {
                         size_t wordlen = wp2 - wp1;
                         if (wordlen > 0)
                             memmove(wp1 + 1, wp1, wordlen);
@@ -769,7 +774,7 @@ static int _parse_inline(qaconf_t *qaconf, FILE *fp, uint8_t flags,
             DEBUG("  argv[%d]=%s", cbdata->argc - 1, wp1);
 
             // For quoted string, this case can be happened.
-            if (*wp2 == '\0') {
+            if (doneparsing == false && *wp2 == '\0') {
                 doneparsing = true;
             }
         }
@@ -929,6 +934,7 @@ static int _parse_inline(qaconf_t *qaconf, FILE *fp, uint8_t flags,
         exitloop:
         // Release resources
         if (freethis != NULL) {
+            // error message made by the user callback with malloc().
             free(freethis);
         }
 
@@ -953,16 +959,16 @@ static int _parse_inline(qaconf_t *qaconf, FILE *fp, uint8_t flags,
 
 static void _seterrmsg(qaconf_t *qaconf, const char *format, ...) {
     if (qaconf->errstr != NULL)
-        free(qaconf->errstr);
+        qlibc_free(qaconf->errstr);
     DYNAMIC_VSPRINTF(qaconf->errstr, format);
 }
 
 static void _free_cbdata(qaconf_cbdata_t *cbdata) {
     if (cbdata->argv != NULL)
-        free(cbdata->argv);
+        qlibc_free(cbdata->argv);
     if (cbdata->data != NULL)
-        free(cbdata->data);
-    free(cbdata);
+        qlibc_free(cbdata->data);
+    qlibc_free(cbdata);
 }
 
 // return 2 for floating point .
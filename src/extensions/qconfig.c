@@ -38,8 +38,16 @@
 #include <string.h>
 #include <limits.h>
 #include <errno.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
 #include "qinternal.h"
+#include "containers/qlist.h"
 #include "utilities/qfile.h"
+#include "utilities/qhash.h"
+#include "utilities/qio.h"
 #include "utilities/qstring.h"
 #include "utilities/qsystem.h"
 #include "extensions/qconfig.h"
@@ -52,9 +60,45 @@
 #define _VAR_CLOSE  '}'
 #define _VAR_CMD    '!'
 #define _VAR_ENV    '%'
+#define _VAR_MAXEXPAND  (1000)  // stops a value which refers to itself
+
+#define _SNAP_MAGIC "QCFGSNP1"
+#define _SNAP_ALIGN(n)  (((n) + 7) & ~((size_t) 7))
+
+/* a source file the parsed result depends on */
+struct _snap_source_s {
+    int64_t mtime;      /*!< modification time when it was read */
+    int64_t size;       /*!< file size */
+    uint32_t hash;      /*!< murmur3 hash of the contents */
+    uint32_t pathlen;   /*!< length of path including the NULL */
+    char path[];
+};
+
+struct _snap_header_s {
+    char magic[8];
+    uint32_t sepchar;
+    uint32_t nsources;
+    uint32_t nentries;
+    uint32_t reserved;
+};
+
+struct _snap_entry_s {
+    uint32_t namelen;   /*!< length of name including the NULL */
+    uint32_t size;      /*!< data size */
+    char name[];        /*!< name followed by data */
+};
 
 /* internal functions */
+static qlisttbl_t *_parse_file(qlisttbl_t *tbl, const char *filepath,
+                               char sepchar, qlist_t *sources, bool *dynamic);
+static bool _add_source(qlist_t *sources, const char *filepath,
+                        const char *data, size_t size);
+static qlisttbl_t *_snap_load(qlisttbl_t *tbl, const char *snappath,
+                              const char *filepath, char sepchar);
+static bool _snap_save(const char *snappath, char sepchar, qlist_t *sources,
+                       qlisttbl_t *parsed);
 static char *_parsestr(qlisttbl_t *tbl, const char *str);
+static void _freestr(char *str, char *map, size_t mapsize);
 #endif
 
 /**
@@ -125,74 +169,76 @@ static char *_parsestr(qlisttbl_t *tbl, const char *str);
  */
 qlisttbl_t *qconfig_parse_file(qlisttbl_t *tbl, const char *filepath,
                                char sepchar) {
-    char *str = qfile_load(filepath, NULL);
-    if (str == NULL)
-        return NULL;
-
-    // process include directive
-    char *strp = str;
-
-    while ((strp = strstr(strp, _INCLUDE_DIRECTIVE)) != NULL) {
-        if (strp == str || strp[-1] == '\n') {
-            char buf[PATH_MAX];
-
-            // parse filename
-            char *tmpp;
-            for (tmpp = strp + CONST_STRLEN(_INCLUDE_DIRECTIVE);
-                    *tmpp != '\n' && *tmpp != '\0'; tmpp++)
-                ;
-            int len = tmpp - (strp + CONST_STRLEN(_INCLUDE_DIRECTIVE));
-            if (len >= sizeof(buf)) {
-                DEBUG("Can't process %s directive.", _INCLUDE_DIRECTIVE);
-                free(str);
-                return NULL;
-            }
-
-            strncpy(buf, strp + CONST_STRLEN(_INCLUDE_DIRECTIVE), len);
-            buf[len] = '\0';
-            qstrtrim(buf);
-
-            // get full file path
-            if (!(buf[0] == '/' || buf[0] == '\\')) {
-                char tmp[PATH_MAX];
-                char *dir = qfile_get_dir(filepath);
-                if (strlen(dir) + 1 + strlen(buf) >= sizeof(buf)) {
-                    DEBUG("Can't process %s directive.", _INCLUDE_DIRECTIVE);
-                    free(dir);
-                    free(str);
-                    return NULL;
-                }
-                snprintf(tmp, sizeof(tmp), "%s/%s", dir, buf);
-                free(dir);
+    return _parse_file(tbl, filepath, sepchar, NULL, NULL);
+}
 
-                strcpy(buf, tmp);
-            }
+/**
+ * Load configuration file through a binary snapshot of the parsed result.
+ *
+ * The snapshot records every file read, including the @INCLUDE files,
+ * with its modification time, size and hash. When none of them has
+ * changed, the entries are loaded from the mapped snapshot without
+ * parsing. Otherwise the file is parsed and the snapshot is rewritten.
+ * A file whose contents only differ in modification time still counts as
+ * unchanged.
+ *
+ * @param tbl       a pointer of qlisttbl_t. NULL will generate a new table.
+ * @param filepath  configuration file path
+ * @param sepchar   separater used in configuration file to divice key and value
+ * @param snappath  snapshot file path
+ *
+ * @return a pointer of qlisttbl_t in case of successful,
+ *  otherwise(file not found) returns NULL
+ *
+ * @code
+ *   qlisttbl_t *tbl = qconfig_parse_cached(NULL, "config.conf", '=',
+ *                                          "/var/tmp/config.snap");
+ * @endcode
+ *
+ * @note
+ *  The file is parsed on its own, so ${key} in the file doesn't see the
+ *  entries already in tbl. A file using ${!command} or ${%ENV} isn't
+ *  snapshotted, since those values can change without the files changing.
+ *  The snapshot is in host byte order and not meant to be shared between
+ *  different machines.
+ */
+qlisttbl_t *qconfig_parse_cached(qlisttbl_t *tbl, const char *filepath,
+                                 char sepchar, const char *snappath) {
+    if (filepath == NULL || snappath == NULL) {
+        errno = EINVAL;
+        return NULL;
+    }
 
-            // read file
-            char *incdata;
-            if (strlen(buf) == 0 || (incdata = qfile_load(buf, NULL)) == NULL) {
-                DEBUG("Can't process '%s%s' directive.", _INCLUDE_DIRECTIVE,
-                        buf);
-                free(str);
-                return NULL;
-            }
+    qlisttbl_t *loaded = _snap_load(tbl, snappath, filepath, sepchar);
+    if (loaded != NULL)
+        return loaded;
 
-            // replace
-            strncpy(buf, strp, CONST_STRLEN(_INCLUDE_DIRECTIVE) + len);
-            buf[CONST_STRLEN(_INCLUDE_DIRECTIVE) + len] = '\0';
-            strp = qstrreplace("sn", str, buf, incdata);
-            free(incdata);
-            free(str);
-            str = strp;
-        } else {
-            strp += CONST_STRLEN(_INCLUDE_DIRECTIVE);
-        }
+    qlist_t *sources = qlist(0);
+    if (sources == NULL)
+        return NULL;
+    bool dynamic = false;
+    qlisttbl_t *parsed = _parse_file(NULL, filepath, sepchar, sources,
+                                     &dynamic);
+    if (parsed == NULL) {
+        sources->free(sources);
+        return NULL;
     }
+    if (dynamic == false) {
+        _snap_save(snappath, sepchar, sources, parsed);
+    } else {
+        unlink(snappath);
+    }
+    sources->free(sources);
 
-    // parse
-    tbl = qconfig_parse_str(tbl, str, sepchar);
-    free(str);
+    if (tbl == NULL)
+        return parsed;
 
+    qdlnobj_t obj;
+    memset((void *) &obj, 0, sizeof(obj));
+    while (parsed->getnext(parsed, &obj, NULL, false) == true) {
+        tbl->put(tbl, obj.name, obj.data, obj.size);
+    }
+    parsed->free(parsed);
     return tbl;
 }
 
@@ -225,7 +271,7 @@ qlisttbl_t *qconfig_parse_str(qlisttbl_t *tbl, const char *str, char sepchar) {
 
     char *section = NULL;
     char *org, *buf, *offset;
-    for (org = buf = offset = strdup(str); *offset != '\0';) {
+    for (org = buf = offset = qlibc_strdup(str); *offset != '\0';) {
         // get one line into buf
         for (buf = offset; *offset != '\n' && *offset != '\0'; offset++)
             ;
@@ -243,14 +289,14 @@ qlisttbl_t *qconfig_parse_str(qlisttbl_t *tbl, const char *str, char sepchar) {
         if ((buf[0] == '[') && (buf[strlen(buf) - 1] == ']')) {
             // extract section name
             if (section != NULL)
-                free(section);
-            section = strdup(buf + 1);
+                qlibc_free(section);
+            section = qlibc_strdup(buf + 1);
             section[strlen(section) - 1] = '\0';
             qstrtrim(section);
 
             // remove section if section name is empty. ex) []
             if (section[0] == '\0') {
-                free(section);
+                qlibc_free(section);
                 section = NULL;
                 continue;
             }
@@ -260,7 +306,7 @@ qlisttbl_t *qconfig_parse_str(qlisttbl_t *tbl, const char *str, char sepchar) {
         }
 
         // parse & store
-        char *value = strdup(buf);
+        char *value = qlibc_strdup(buf);
         char *name = _q_makeword(value, sepchar);
         qstrtrim(value);
         qstrtrim(name);
@@ -268,7 +314,7 @@ qlisttbl_t *qconfig_parse_str(qlisttbl_t *tbl, const char *str, char sepchar) {
         // put section name as a prefix
         if (section != NULL) {
             char *newname = qstrdupf("%s.%s", section, name);
-            free(name);
+            qlibc_free(name);
             name = newname;
         }
 
@@ -276,15 +322,15 @@ qlisttbl_t *qconfig_parse_str(qlisttbl_t *tbl, const char *str, char sepchar) {
         char *newvalue = _parsestr(tbl, value);
         if (newvalue != NULL) {
             tbl->putstr(tbl, name, newvalue);
-            free(newvalue);
+            qlibc_free(newvalue);
         }
 
-        free(name);
-        free(value);
+        qlibc_free(name);
+        qlibc_free(value);
     }
-    free(org);
+    qlibc_free(org);
     if (section != NULL)
-        free(section);
+        qlibc_free(section);
 
     return tbl;
 }
@@ -330,7 +376,8 @@ static char *_parsestr(qlisttbl_t *tbl, const char *str) {
     }
 
     bool loop;
-    char *value = strdup(str);
+    int expansions = 0;
+    char *value = qlibc_strdup(str);
     do {
         loop = false;
 
@@ -365,7 +412,7 @@ static char *_parsestr(qlisttbl_t *tbl, const char *str) {
 
             // pick string between ${, }
             int varlen = e - s - 2;  // length between ${ , }
-            char *varstr = (char *) malloc(varlen + 3 + 1);
+            char *varstr = (char *) qlibc_malloc(varlen + 3 + 1);
             if (varstr == NULL)
                 continue;
             strncpy(varstr, s + 2, varlen);
@@ -376,16 +423,17 @@ static char *_parsestr(qlisttbl_t *tbl, const char *str) {
             switch (varstr[0]) {
                 case _VAR_CMD: {
                     if ((newstr = qstrtrim(qsyscmd(varstr + 1))) == NULL) {
-                        newstr = strdup("");
+                        newstr = qlibc_strdup("");
                     }
                     break;
                 }
                 case _VAR_ENV: {
-                    newstr = strdup(qgetenv(varstr + 1, ""));
+                    newstr = qlibc_strdup(qgetenv(varstr + 1, ""));
                     break;
                 }
                 default: {
                     if ((newstr = tbl->getstr(tbl, varstr, true)) == NULL) {
+                        qlibc_free(varstr);
                         s = e;  // not found
                         continue;
                     }
@@ -397,20 +445,313 @@ static char *_parsestr(qlisttbl_t *tbl, const char *str) {
             strncpy(varstr, s, varlen + 3);  // ${str}
             varstr[varlen + 3] = '\0';
 
+            // a value having the variable itself would never end.
+            if (strstr(newstr, varstr) != NULL) {
+                qlibc_free(newstr);
+                qlibc_free(varstr);
+                s = e;
+                continue;
+            }
+
             s = qstrreplace("sn", value, varstr, newstr);
-            free(newstr);
-            free(varstr);
-            free(value);
+            qlibc_free(newstr);
+            qlibc_free(varstr);
+            qlibc_free(value);
             value = s;
 
             loop = true;
             break;
         }
-    } while (loop == true);
+    } while (loop == true && ++expansions < _VAR_MAXEXPAND);
 
     return value;
 }
 
+// load a file with its includes merged, then parse it. files read are
+// recorded in sources when it's not NULL.
+static qlisttbl_t *_parse_file(qlisttbl_t *tbl, const char *filepath,
+                               char sepchar, qlist_t *sources, bool *dynamic) {
+    // the file is mapped, and copied only when an include is merged.
+    size_t mapsize = 0;
+    char *map = qfile_map(filepath, &mapsize);
+    if (map == NULL)
+        return NULL;
+    char *str = map;
+    if (sources != NULL
+            && _add_source(sources, filepath, map, mapsize) == false) {
+        qfile_unmap(map, mapsize);
+        return NULL;
+    }
+
+    // process include directive
+    char *strp = str;
+
+    while ((strp = strstr(strp, _INCLUDE_DIRECTIVE)) != NULL) {
+        if (strp == str || strp[-1] == '\n') {
+            char buf[PATH_MAX];
+
+            // parse filename
+            char *tmpp;
+            for (tmpp = strp + CONST_STRLEN(_INCLUDE_DIRECTIVE);
+                    *tmpp != '\n' && *tmpp != '\0'; tmpp++)
+                ;
+            int len = tmpp - (strp + CONST_STRLEN(_INCLUDE_DIRECTIVE));
+            if (len >= sizeof(buf)) {
+                DEBUG("Can't process %s directive.", _INCLUDE_DIRECTIVE);
+                _freestr(str, map, mapsize);
+                return NULL;
+            }
+
+            strncpy(buf, strp + CONST_STRLEN(_INCLUDE_DIRECTIVE), len);
+            buf[len] = '\0';
+            qstrtrim(buf);
+
+            // get full file path
+            if (!(buf[0] == '/' || buf[0] == '\\')) {
+                char tmp[PATH_MAX];
+                char *dir = qfile_get_dir(filepath);
+                if (strlen(dir) + 1 + strlen(buf) >= sizeof(buf)) {
+                    DEBUG("Can't process %s directive.", _INCLUDE_DIRECTIVE);
+                    qlibc_free(dir);
+                    _freestr(str, map, mapsize);
+                    return NULL;
+                }
+                snprintf(tmp, sizeof(tmp), "%s/%s", dir, buf);
+                qlibc_free(dir);
+
+                strcpy(buf, tmp);
+            }
+
+            // read file
+            size_t incsize = 0;
+            char *incdata;
+            if (strlen(buf) == 0 || (incdata = qfile_map(buf, &incsize)) == NULL) {
+                DEBUG("Can't process '%s%s' directive.", _INCLUDE_DIRECTIVE,
+                        buf);
+                _freestr(str, map, mapsize);
+                return NULL;
+            }
+            if (sources != NULL
+                    && _add_source(sources, buf, incdata, incsize) == false) {
+                qfile_unmap(incdata, incsize);
+                _freestr(str, map, mapsize);
+                return NULL;
+            }
+
+            // replace
+            strncpy(buf, strp, CONST_STRLEN(_INCLUDE_DIRECTIVE) + len);
+            buf[CONST_STRLEN(_INCLUDE_DIRECTIVE) + len] = '\0';
+            strp = qstrreplace("sn", str, buf, incdata);
+            qfile_unmap(incdata, incsize);
+            _freestr(str, map, mapsize);
+            map = NULL;
+            str = strp;
+            if (str == NULL)
+                return NULL;
+        } else {
+            strp += CONST_STRLEN(_INCLUDE_DIRECTIVE);
+        }
+    }
+
+    // values from commands and environment can change at any time.
+    if (dynamic != NULL) {
+        *dynamic = (strstr(str, "${!") != NULL || strstr(str, "${%") != NULL);
+    }
+
+    // parse
+    tbl = qconfig_parse_str(tbl, str, sepchar);
+    _freestr(str, map, mapsize);
+
+    return tbl;
+}
+
+static bool _add_source(qlist_t *sources, const char *filepath,
+                        const char *data, size_t size) {
+    struct stat st;
+    if (stat(filepath, &st) != 0)
+        return false;
+
+    size_t pathlen = strlen(filepath) + 1;
+    size_t recsize = _SNAP_ALIGN(sizeof(struct _snap_source_s) + pathlen);
+    struct _snap_source_s *src = (struct _snap_source_s *) qlibc_calloc(1, recsize);
+    if (src == NULL)
+        return false;
+    // a file modified in the last second can change again without its
+    // mtime changing, or may have changed since it was read, so it's
+    // checked by the hash next time.
+    src->mtime = (st.st_mtime < time(NULL) - 1) ? (int64_t) st.st_mtime : -1;
+    src->size = (int64_t) size;
+    src->hash = qhashmurmur3_32(data, size);
+    src->pathlen = (uint32_t) pathlen;
+    memcpy(src->path, filepath, pathlen);
+
+    bool ret = sources->addlast(sources, src, recsize);
+    qlibc_free(src);
+    return ret;
+}
+
+// unchanged if the size and mtime are the same, or the contents hash the same.
+static bool _source_unchanged(const struct _snap_source_s *src) {
+    struct stat st;
+    if (stat(src->path, &st) != 0 || (int64_t) st.st_size != src->size)
+        return false;
+    if ((int64_t) st.st_mtime == src->mtime)
+        return true;
+
+    size_t size = 0;
+    char *data = qfile_map(src->path, &size);
+    if (data == NULL)
+        return false;
+    bool same = ((int64_t) size == src->size
+            && qhashmurmur3_32(data, size) == src->hash);
+    qfile_unmap(data, size);
+    return same;
+}
+
+static qlisttbl_t *_snap_load(qlisttbl_t *tbl, const char *snappath,
+                              const char *filepath, char sepchar) {
+    size_t mapsize = 0;
+    char *map = qfile_map(snappath, &mapsize);
+    if (map == NULL)
+        return NULL;
+
+    const struct _snap_header_s *hdr = (const struct _snap_header_s *) map;
+    if (mapsize < sizeof(*hdr) || memcmp(hdr->magic, _SNAP_MAGIC, 8)
+            || hdr->sepchar != (uint32_t) (unsigned char) sepchar
+            || hdr->nsources == 0) {
+        qfile_unmap(map, mapsize);
+        return NULL;
+    }
+
+    // check all the sources first, the first one must be filepath.
+    size_t off = sizeof(*hdr);
+    uint32_t i;
+    for (i = 0; i < hdr->nsources; i++) {
+        const struct _snap_source_s *src =
+                (const struct _snap_source_s *) (map + off);
+        if (off + sizeof(*src) > mapsize
+                || src->pathlen > mapsize - off - sizeof(*src)
+                || src->pathlen == 0 || src->path[src->pathlen - 1] != '\0'
+                || (i == 0 && strcmp(src->path, filepath))
+                || _source_unchanged(src) == false) {
+            qfile_unmap(map, mapsize);
+            return NULL;
+        }
+        off += _SNAP_ALIGN(sizeof(*src) + src->pathlen);
+    }
+
+    // then the entries.
+    size_t entoff = off;
+    for (i = 0; i < hdr->nentries; i++) {
+        const struct _snap_entry_s *ent =
+                (const struct _snap_entry_s *) (map + off);
+        if (off + sizeof(*ent) > mapsize
+                || ent->namelen == 0
+                || (size_t) ent->namelen + ent->size
+                        > mapsize - off - sizeof(*ent)
+                || ent->name[ent->namelen - 1] != '\0') {
+            qfile_unmap(map, mapsize);
+            return NULL;
+        }
+        off += _SNAP_ALIGN(sizeof(*ent) + ent->namelen + ent->size);
+    }
+
+    qlisttbl_t *newtbl = NULL;
+    if (tbl == NULL) {
+        newtbl = tbl = qlisttbl(0);
+        if (tbl == NULL) {
+            qfile_unmap(map, mapsize);
+            return NULL;
+        }
+    }
+    for (i = 0, off = entoff; i < hdr->nentries; i++) {
+        const struct _snap_entry_s *ent =
+                (const struct _snap_entry_s *) (map + off);
+        if (tbl->put(tbl, ent->name, ent->name + ent->namelen,
+                     ent->size) == false) {
+            if (newtbl != NULL)
+                newtbl->free(newtbl);
+            qfile_unmap(map, mapsize);
+            return NULL;
+        }
+        off += _SNAP_ALIGN(sizeof(*ent) + ent->namelen + ent->size);
+    }
+    qfile_unmap(map, mapsize);
+
+    return tbl;
+}
+
+static bool _snap_save(const char *snappath, char sepchar, qlist_t *sources,
+                       qlisttbl_t *parsed) {
+    // build it in memory, then replace the old one at once.
+    size_t size = sizeof(struct _snap_header_s);
+    qdlobj_t sobj;
+    memset((void *) &sobj, 0, sizeof(sobj));
+    while (sources->getnext(sources, &sobj, false) == true) {
+        size += sobj.size;
+    }
+    qdlnobj_t eobj;
+    memset((void *) &eobj, 0, sizeof(eobj));
+    while (parsed->getnext(parsed, &eobj, NULL, false) == true) {
+        size += _SNAP_ALIGN(sizeof(struct _snap_entry_s)
+                            + strlen(eobj.name) + 1 + eobj.size);
+    }
+
+    char *buf = (char *) qlibc_calloc(1, size);
+    if (buf == NULL)
+        return false;
+    struct _snap_header_s *hdr = (struct _snap_header_s *) buf;
+    memcpy(hdr->magic, _SNAP_MAGIC, 8);
+    hdr->sepchar = (uint32_t) (unsigned char) sepchar;
+    hdr->nsources = (uint32_t) sources->size(sources);
+    hdr->nentries = (uint32_t) parsed->size(parsed);
+
+    size_t off = sizeof(*hdr);
+    memset((void *) &sobj, 0, sizeof(sobj));
+    while (sources->getnext(sources, &sobj, false) == true) {
+        memcpy(buf + off, sobj.data, sobj.size);
+        off += sobj.size;
+    }
+    memset((void *) &eobj, 0, sizeof(eobj));
+    while (parsed->getnext(parsed, &eobj, NULL, false) == true) {
+        struct _snap_entry_s *ent = (struct _snap_entry_s *) (buf + off);
+        ent->namelen = (uint32_t) strlen(eobj.name) + 1;
+        ent->size = (uint32_t) eobj.size;
+        memcpy(ent->name, eobj.name, ent->namelen);
+        memcpy(ent->name + ent->namelen, eobj.data, eobj.size);
+        off += _SNAP_ALIGN(sizeof(*ent) + ent->namelen + ent->size);
+    }
+
+    // threads of a process can save at the same time.
+    static int seq = 0;
+    char *tmppath = qstrdupf("%s.%d.%d", snappath, (int) getpid(),
+                             __atomic_fetch_add(&seq, 1, __ATOMIC_RELAXED));
+    bool ok = false;
+    int fd = open(tmppath, O_CREAT | O_EXCL | O_WRONLY,
+                  (S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH));
+    if (fd >= 0) {
+        ok = (qio_write(fd, buf, size, -1) == (ssize_t) size);
+        close(fd);
+        if (ok == true)
+            ok = (rename(tmppath, snappath) == 0);
+        if (ok == false)
+            unlink(tmppath);
+    }
+    qlibc_free(tmppath);
+    qlibc_free(buf);
+
+    return ok;
+}
+
+
+// release the config string, which is either the file mapping or a copy.
+static void _freestr(char *str, char *map, size_t mapsize) {
+    if (str == map)
+        qfile_unmap(map, mapsize);
+    else
+        qlibc_free(str);
+}
+
 #endif /* _DOXYGEN_SKIP */
 
 #endif /* DISABLE_QCONFIG */
@@ -59,14 +59,28 @@
  *   if (result != NULL) {
  *     printf("COLS : %d , ROWS : %d\n",
  *            result->get_cols(result), result->get_rows(result));
- *     while (result->get_next(result) == true) {
- *       char *pszName = result->get_str(result, "name");
- *       int   nPopulation = result->get_int(result, "population");
+ *     while (result->getnext(result) == true) {
+ *       const char *pszName = result->getstr(result, "name");
+ *       int   nPopulation = result->getint(result, "population");
  *       printf("Country : %s , Population : %d\n", pszName, nPopulation);
  *     }
  *     result->free(result);
  *   }
  *
+ *   // prepared statements are parsed once and cached per connection
+ *   qdbstmt_t *stmt = db->prepare(db, "SELECT name FROM City WHERE id = ?");
+ *   if (stmt != NULL) {
+ *     stmt->bind_int(stmt, 1, 1234);
+ *     result = stmt->execute_query(stmt);
+ *     if (result != NULL) {
+ *       while (result->getnext(result) == true) {
+ *         printf("City : %s\n", result->getstr(result, "name"));
+ *       }
+ *       result->free(result);
+ *     }
+ *     stmt->free(stmt);  // returned to the cache
+ *   }
+ *
  *   // close connection
  *   db->close(db);
  *
@@ -86,14 +100,27 @@
 #define _Q_MYSQL_OPT_CONNECT_TIMEOUT        (10)
 #define _Q_MYSQL_OPT_READ_TIMEOUT       (30)
 #define _Q_MYSQL_OPT_WRITE_TIMEOUT      (30)
+/* initial column buffer size of statement results in fetch-from-db mode */
+#define _Q_MYSQL_STMT_COLSIZE           (256)
 #endif
 
+/* maximum number of prepared statements cached per connection */
+#define _Q_STMT_CACHE_MAX               (256)
+/* maximum length of column names indexed by qdbresult->get_colidx() */
+#define _Q_COLNAME_MAX                  (256)
+/* multi-row statements of qdb->execute_batch() are split around this size */
+#define _Q_BATCH_MAXBYTES               (1024 * 1024)
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
 #include <stdarg.h>
 #include <string.h>
+#include <ctype.h>
+#include <errno.h>
 #include "qinternal.h"
+#include "utilities/qtime.h"
+#include "containers/qstrbuf.h"
 #include "extensions/qdatabase.h"
 
 /*
@@ -108,6 +135,10 @@ static int execute_update(qdb_t *db, const char *query);
 static int execute_updatef(qdb_t *db, const char *format, ...);
 static qdbresult_t *execute_query(qdb_t *db, const char *query);
 static qdbresult_t *execute_queryf(qdb_t *db, const char *format, ...);
+static int execute_batch(qdb_t *db, const char *prefix, const char **values,
+                         int cols, int rows);
+
+static qdbstmt_t *prepare(qdb_t *db, const char *query);
 
 static bool begin_tran(qdb_t *db);
 static bool commit(qdb_t *db);
@@ -125,6 +156,11 @@ static const char *_resultGetStrAt(qdbresult_t *result, int idx);
 static int _resultGetInt(qdbresult_t *result, const char *field);
 static int _resultGetIntAt(qdbresult_t *result, int idx);
 static bool _resultGetNext(qdbresult_t *result);
+static int _resultGetBatch(qdbresult_t *result, const char **values,
+                           size_t *lengths, int maxrows);
+static int _resultGetColIdx(qdbresult_t *result, const char *field);
+static bool _resultFetchStmt(qdbresult_t *result);
+static void _resultFreeCache(qdbresult_t *result);
 
 static int result_get_cols(qdbresult_t *result);
 static int result_get_rows(qdbresult_t *result);
@@ -132,6 +168,53 @@ static int result_get_row(qdbresult_t *result);
 
 static void result_free(qdbresult_t *result);
 
+// qdbstmt_t object
+static bool stmt_bind_int(qdbstmt_t *stmt, int idx, int64_t num);
+static bool stmt_bind_double(qdbstmt_t *stmt, int idx, double num);
+static bool stmt_bind_str(qdbstmt_t *stmt, int idx, const char *str);
+static bool stmt_bind_blob(qdbstmt_t *stmt, int idx, const void *data,
+                           size_t size);
+static bool stmt_bind_null(qdbstmt_t *stmt, int idx);
+
+static int stmt_execute_update(qdbstmt_t *stmt);
+static qdbresult_t *stmt_execute_query(qdbstmt_t *stmt);
+
+static int stmt_get_params(qdbstmt_t *stmt);
+static void stmt_free(qdbstmt_t *stmt);
+
+// qdbpool_t object
+static qdb_t *pool_get(qdbpool_t *pool, int timeoutms);
+static void pool_release(qdbpool_t *pool, qdb_t *db);
+static int pool_ping(qdbpool_t *pool);
+static size_t pool_size(qdbpool_t *pool);
+static void pool_clear(qdbpool_t *pool);
+static void pool_free(qdbpool_t *pool);
+
+// internal usages
+static char *_buildquery(const char *format, va_list arg);
+static bool _lowername(char *buf, const char *name);
+static bool _batchrow(qdb_t *db, qstrbuf_t *sb, const char **values, int cols);
+static qdbresult_t *_newresult(bool fetchtype);
+static qdbstmt_t *_stmt_new(qdb_t *db, const char *query);
+static void _stmt_destroy(qdbstmt_t *stmt);
+static void _stmt_clearbinds(qdbstmt_t *stmt);
+static void _stmt_uncache(qdb_t *db);
+static bool _stmt_bindcheck(qdbstmt_t *stmt, int idx);
+static bool _stmt_execute(qdbstmt_t *stmt);
+static void _pool_drop(qdbpool_t *pool, qdb_t *db);
+
+/* storage of a bound parameter */
+struct _qdbparam_s {
+    union {
+        long long i;
+        double d;
+    } num;
+    unsigned long length;
+#ifdef _Q_ENABLE_MYSQL
+    my_bool isnull;
+#endif
+};
+
 #endif
 
 /**
@@ -178,17 +261,17 @@ qdb_t *qdb(const char *dbtype, const char *addr, int port, const char *username,
 
     // initialize
     qdb_t *db;
-    if ((db = (qdb_t *)malloc(sizeof(qdb_t))) == NULL) return NULL;
+    if ((db = (qdb_t *)qlibc_malloc(sizeof(qdb_t))) == NULL) return NULL;
     memset((void *)db, 0, sizeof(qdb_t));
     db->connected = false;
 
     // set common structure
-    db->info.dbtype = strdup(dbtype);
-    db->info.addr = strdup(addr);
+    db->info.dbtype = qlibc_strdup(dbtype);
+    db->info.addr = qlibc_strdup(addr);
     db->info.port = port;
-    db->info.username = strdup(username);
-    db->info.password = strdup(password);
-    db->info.database = strdup(database);
+    db->info.username = qlibc_strdup(username);
+    db->info.password = qlibc_strdup(password);
+    db->info.database = qlibc_strdup(database);
     db->info.autocommit = autocommit;
     db->info.fetchtype = false;// store mode
 
@@ -205,6 +288,9 @@ qdb_t *qdb(const char *dbtype, const char *addr, int port, const char *username,
     db->execute_updatef = execute_updatef;
     db->execute_query = execute_query;
     db->execute_queryf = execute_queryf;
+    db->execute_batch = execute_batch;
+
+    db->prepare = prepare;
 
     db->begin_tran = begin_tran;
     db->commit = commit;
@@ -327,6 +413,9 @@ static bool close_(qdb_t *db)
 #ifdef _Q_ENABLE_MYSQL
     Q_MUTEX_ENTER(db->qmutex);
 
+    // statements are bound to the connection
+    _stmt_uncache(db);
+
     if (db->mysql != NULL) {
         mysql_close(db->mysql);
         db->mysql = NULL;
@@ -382,12 +471,14 @@ static int execute_update(qdb_t *db, const char *query)
  */
 static int execute_updatef(qdb_t *db, const char *format, ...)
 {
-    char *query;
-    DYNAMIC_VSPRINTF(query, format);
+    va_list arg;
+    va_start(arg, format);
+    char *query = _buildquery(format, arg);
+    va_end(arg);
     if (query == NULL) return -1;
 
     int affected = execute_update(db, query);
-    free(query);
+    qlibc_free(query);
 
     return affected;
 }
@@ -410,38 +501,21 @@ static qdbresult_t *execute_query(qdb_t *db, const char *query)
     if (mysql_query(db->mysql, query)) return NULL;
 
     // store
-    qdbresult_t *result = (qdbresult_t *)malloc(sizeof(qdbresult_t));
+    qdbresult_t *result = _newresult(db->info.fetchtype);
     if (result == NULL) return NULL;
 
-    result->fetchtype = db->info.fetchtype;
     if (result->fetchtype == false) {
         result->rs = mysql_store_result(db->mysql);
     } else {
         result->rs = mysql_use_result(db->mysql);
     }
     if (result->rs == NULL) {
-        free(result);
+        qlibc_free(result);
         return NULL;
     }
 
     /* get meta data */
-    result->fields = NULL;
-    result->row = NULL;
     result->cols = mysql_num_fields(result->rs);
-    result->cursor = 0;
-
-    /* assign methods */
-    result->get_str = _resultGetStr;
-    result->get_str_at = _resultGetStrAt;
-    result->get_int = _resultGetInt;
-    result->get_int_at = _resultGetIntAt;
-    result->get_next = _resultGetNext;
-
-    result->get_cols = result_get_cols;
-    result->get_rows = result_get_rows;
-    result->get_row = result_get_row;
-
-    result->free = result_free;
 
     return result;
 #else
@@ -459,15 +533,180 @@ static qdbresult_t *execute_query(qdb_t *db, const char *query)
  */
 static qdbresult_t *execute_queryf(qdb_t *db, const char *format, ...)
 {
-    char *query;
-    DYNAMIC_VSPRINTF(query, format);
+    va_list arg;
+    va_start(arg, format);
+    char *query = _buildquery(format, arg);
+    va_end(arg);
     if (query == NULL) return NULL;
 
     qdbresult_t *ret = db->execute_query(db, query);
-    free(query);
+    qlibc_free(query);
     return ret;
 }
 
+/**
+ * qdb->execute_batch(): Inserts many rows with multi-row statements
+ *
+ * @param db        a pointer of qdb_t object
+ * @param prefix    statement up to the VALUES keyword,
+ *                  like "INSERT INTO t (a, b)"
+ * @param values    array of rows * cols strings, values of row r, column c
+ *                  at r * cols + c. NULL is inserted as SQL NULL.
+ * @param cols      number of columns per row
+ * @param rows      number of rows
+ *
+ * @return a number of affected rows, otherwise returns -1
+ * @retval errno will be set in error condition.
+ *  - EINVAL    : Invalid argument or not connected.
+ *  - ENOMEM    : Memory allocation failure.
+ *  - EIO       : A statement failed. See qdb->get_error().
+ *
+ * @code
+ *   const char *values[] = { "1", "Seoul", "2", "Busan", "3", NULL };
+ *   db->execute_batch(db, "INSERT INTO City (id, name)", values, 2, 3);
+ * @endcode
+ *
+ * @note
+ *  Values are escaped and sent as "prefix VALUES (...),(...),..." statements
+ *  of about 1MB each instead of a round-trip per row, which is the same
+ *  layout qdbresult->getbatch() fills. When a statement fails the rows of
+ *  the previous statements stay inserted unless a transaction is used.
+ */
+static int execute_batch(qdb_t *db, const char *prefix, const char **values,
+                         int cols, int rows)
+{
+    if (db == NULL || db->connected == false || prefix == NULL
+            || values == NULL || cols <= 0 || rows < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+#ifdef _Q_ENABLE_MYSQL
+    qstrbuf_t *sb = qstrbuf(0);
+    if (sb == NULL) {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    Q_MUTEX_ENTER(db->qmutex);
+
+    int affected = 0, r = 0;
+    while (r < rows && affected >= 0) {
+        sb->clear(sb);
+        sb->append(sb, prefix);
+        sb->append(sb, " VALUES ");
+        size_t head = sb->length(sb);
+
+        bool ok = true;
+        for (; r < rows && sb->length(sb) < _Q_BATCH_MAXBYTES; r++) {
+            if ((sb->length(sb) > head && sb->append_n(sb, ",", 1) == false)
+                    || _batchrow(db, sb, &values[(size_t)r * cols],
+                                 cols) == false) {
+                ok = false;
+                break;
+            }
+        }
+        if (ok == false) {
+            errno = ENOMEM;
+            affected = -1;
+            break;
+        }
+
+        DEBUG("batch: %zu bytes", sb->length(sb));
+        if (mysql_query(db->mysql, sb->getstr(sb, false)) != 0) {
+            errno = EIO;
+            affected = -1;
+            break;
+        }
+        int num = mysql_affected_rows(db->mysql);
+        if (num > 0) affected += num;
+    }
+
+    Q_MUTEX_LEAVE(db->qmutex);
+    sb->free(sb);
+    return affected;
+#else
+    return -1;
+#endif
+}
+
+/**
+ * qdb->prepare(): Prepares a statement for repeated execution
+ *
+ * @param db        a pointer of qdb_t object
+ * @param query     query string with '?' parameter markers
+ *
+ * @return a pointer of qdbstmt_t if successful, otherwise returns NULL
+ * @retval errno will be set in error condition.
+ *  - EINVAL    : Invalid argument or not connected.
+ *  - ENOMEM    : Memory allocation failure.
+ *  - EIO       : Server rejected the statement. See qdb->get_error().
+ *
+ * @code
+ *   qdbstmt_t *stmt = db->prepare(db, "INSERT INTO t (id, name) VALUES (?, ?)");
+ *   int i;
+ *   for (i = 0; i < 100; i++) {
+ *     stmt->bind_int(stmt, 1, i);
+ *     stmt->bind_str(stmt, 2, names[i]);
+ *     stmt->execute_update(stmt);
+ *   }
+ *   stmt->free(stmt);
+ * @endcode
+ *
+ * @note
+ *  Statements are cached per connection keyed by the SQL text, so preparing
+ *  the same query again after qdbstmt->free() reuses the server-side
+ *  statement without parsing it again. If the cached statement is still in
+ *  use, a new uncached one is prepared. Statements become invalid when the
+ *  connection is closed or re-opened, and must be freed before qdb->free().
+ */
+static qdbstmt_t *prepare(qdb_t *db, const char *query)
+{
+    if (db == NULL || query == NULL || db->connected == false) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+#ifdef _Q_ENABLE_MYSQL
+    Q_MUTEX_ENTER(db->qmutex);
+
+    if (db->stmts == NULL && (db->stmts = qhashtbl(0, 0)) == NULL) {
+        Q_MUTEX_LEAVE(db->qmutex);
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    // look up the cache
+    qdbstmt_t **cached = db->stmts->get(db->stmts, query, NULL, false);
+    if (cached != NULL && (*cached)->inuse == false) {
+        qdbstmt_t *stmt = *cached;
+        stmt->inuse = true;
+        Q_MUTEX_LEAVE(db->qmutex);
+        return stmt;
+    }
+
+    DEBUG("prepare: %s", query);
+    qdbstmt_t *stmt = _stmt_new(db, query);
+    if (stmt == NULL) {
+        Q_MUTEX_LEAVE(db->qmutex);
+        return NULL;
+    }
+    stmt->inuse = true;
+
+    if (cached == NULL && db->stmts->size(db->stmts) < _Q_STMT_CACHE_MAX) {
+        if (db->stmts->put(db->stmts, query, &stmt, sizeof(stmt)) == true) {
+            stmt->cached = true;
+        }
+    }
+
+    Q_MUTEX_LEAVE(db->qmutex);
+    return stmt;
+#else
+    errno = ENOTSUP;
+    return NULL;
+#endif
+}
+
 /**
  * qdb->begin_tran(): Start transaction
  *
@@ -487,7 +726,7 @@ static bool begin_tran(qdb_t *db)
 
 #ifdef _Q_ENABLE_MYSQL
     Q_MUTEX_ENTER(db->qmutex);
-    if (db->qmutex.count != 1) {
+    if (db->qmutex->count != 1) {
         Q_MUTEX_LEAVE(db->qmutex);
         return false;
     }
@@ -522,7 +761,7 @@ static bool commit(qdb_t *db)
         ret = true;
     }
 
-    if (db->qmutex.count > 0) {
+    if (db->qmutex->count > 0) {
         Q_MUTEX_LEAVE(db->qmutex);
     }
     return ret;
@@ -548,7 +787,7 @@ static bool rollback(qdb_t *db)
         ret = true;
     }
 
-    if (db->qmutex.count > 0) {
+    if (db->qmutex->count > 0) {
         Q_MUTEX_LEAVE(db->qmutex);
     }
     return ret;
@@ -569,7 +808,7 @@ static bool rollback(qdb_t *db)
  * @note
  *  If qdb->set_fetchtype(db, true) is called, the results does not
  *  actually read into the client. Instead, each row must be retrieved
- *  individually by making calls to qdbresult->get_next().
+ *  individually by making calls to qdbresult->getnext().
  *  This reads the result of a query directly from the server without storing
  *  it in local buffer, which is somewhat faster and uses much less memory than
  *  default behavior qdb->set_fetchtype(db, false).
@@ -670,22 +909,25 @@ static void free_(qdb_t *db)
     Q_MUTEX_ENTER(db->qmutex);
 
     close_(db);
+    if (db->stmts != NULL) {
+        db->stmts->free(db->stmts);
+    }
 
-    free(db->info.dbtype);
-    free(db->info.addr);
-    free(db->info.username);
-    free(db->info.password);
-    free(db->info.database);
-    free(db);
+    qlibc_free(db->info.dbtype);
+    qlibc_free(db->info.addr);
+    qlibc_free(db->info.username);
+    qlibc_free(db->info.password);
+    qlibc_free(db->info.database);
 
     Q_MUTEX_LEAVE(db->qmutex);
     Q_MUTEX_DESTROY(db->qmutex);
+    qlibc_free(db);
 
     return;
 }
 
 /**
- * qdbresult->get_str(): Get the result as string by field name
+ * qdbresult->getstr(): Get the result as string by field name
  *
  * @param result    a pointer of qdbresult_t
  * @param field     column name
@@ -696,22 +938,66 @@ static void free_(qdb_t *db)
  * Do not free returned string.
  */
 static const char *_resultGetStr(qdbresult_t *result, const char *field)
+{
+    int idx = _resultGetColIdx(result, field);
+    if (idx <= 0) return NULL;
+    return result->get_str_at(result, idx);
+}
+
+/**
+ * qdbresult->get_colidx(): Get the column number of a field name
+ *
+ * @param result    a pointer of qdbresult_t
+ * @param field     column name, case-insensitive
+ *
+ * @return column number (first column is 1) if found, otherwise returns 0.
+ *
+ * @note
+ *  Column names are indexed on the first call, so looking up fields by name
+ *  costs a hash lookup per call instead of comparing all the column names.
+ *  Resolving the numbers once and using get_str_at() is still the fastest
+ *  way to read many rows.
+ */
+static int _resultGetColIdx(qdbresult_t *result, const char *field)
 {
 #ifdef _Q_ENABLE_MYSQL
-    if (result == NULL || result->rs == NULL || result->cols <= 0) return NULL;
+    if (result == NULL || result->rs == NULL || result->cols <= 0
+            || field == NULL) {
+        return 0;
+    }
 
     if (result->fields == NULL) result->fields = mysql_fetch_fields(result->rs);
 
-    int i;
-    for (i = 0; i < result->cols; i++) {
-        if (!strcasecmp(result->fields[i].name, field)) {
-            return result->get_str_at(result, i + 1);
+    char name[_Q_COLNAME_MAX + 1];
+    if (result->colidx == NULL && result->nocolidx == false) {
+        result->colidx = qhashtbl(result->cols * 2, 0);
+        int i;
+        for (i = 0; result->colidx != NULL && i < result->cols; i++) {
+            if (_lowername(name, result->fields[i].name) == false) {
+                result->colidx->free(result->colidx);
+                result->colidx = NULL;
+                break;
+            }
+            // the first one wins on duplicated names like a linear scan.
+            if (result->colidx->get(result->colidx, name, NULL, false) == NULL) {
+                result->colidx->putint(result->colidx, name, i + 1);
+            }
         }
+        if (result->colidx == NULL) result->nocolidx = true;
     }
 
-    return NULL;
+    if (result->colidx != NULL) {
+        if (_lowername(name, field) == false) return 0;
+        return result->colidx->getint(result->colidx, name);
+    }
+
+    int i;
+    for (i = 0; i < result->cols; i++) {
+        if (!strcasecmp(result->fields[i].name, field)) return i + 1;
+    }
+    return 0;
 #else
-    return NULL;
+    return 0;
 #endif
 }
 
@@ -733,6 +1019,10 @@ static const char *_resultGetStrAt(qdbresult_t *result, int idx)
             || idx > result->cols ) {
         return NULL;
     }
+    if (result->stmt != NULL) {
+        if (result->isnulls[idx-1]) return NULL;
+        return result->bufs[idx-1];
+    }
     return result->row[idx-1];
 #else
     return NULL;
@@ -740,7 +1030,7 @@ static const char *_resultGetStrAt(qdbresult_t *result, int idx)
 }
 
 /**
- * qdbresult->get_int(): Get the result as integer by field name
+ * qdbresult->getint(): Get the result as integer by field name
  *
  * @param result    a pointer of qdbresult_t
  * @param field     column name
@@ -749,7 +1039,7 @@ static const char *_resultGetStrAt(qdbresult_t *result, int idx)
  */
 static int _resultGetInt(qdbresult_t *result, const char *field)
 {
-    const char *val = result->get_str(result, field);
+    const char *val = result->getstr(result, field);
     if (val == NULL) return 0;
     return atoi(val);
 }
@@ -770,7 +1060,7 @@ static int _resultGetIntAt(qdbresult_t *result, int idx)
 }
 
 /**
- * qdbresult->get_next(): Retrieves the next row of a result set
+ * qdbresult->getnext(): Retrieves the next row of a result set
  *
  * @param result    a pointer of qdbresult_t
  *
@@ -781,6 +1071,11 @@ static bool _resultGetNext(qdbresult_t *result)
 #ifdef _Q_ENABLE_MYSQL
     if (result == NULL || result->rs == NULL) return false;
 
+    if (result->stmt != NULL) {
+        if (result->stmt->mstmt == NULL) return false;
+        return _resultFetchStmt(result);
+    }
+
     if ((result->row = mysql_fetch_row(result->rs)) == NULL) return false;
     result->cursor++;
 
@@ -790,6 +1085,108 @@ static bool _resultGetNext(qdbresult_t *result)
 #endif
 }
 
+/**
+ * qdbresult->getbatch(): Retrieves the next rows of a result set at once
+ *
+ * @param result    a pointer of qdbresult_t
+ * @param values    array of at least maxrows * get_cols() string pointers.
+ *                  values of row r, column c are stored at r * cols + c and
+ *                  SQL NULL is stored as NULL.
+ * @param lengths   if not NULL, lengths of the values are stored in the same
+ *                  layout
+ * @param maxrows   maximum number of rows to fetch
+ *
+ * @return the number of fetched rows, 0 if no more rows are left
+ *
+ * @code
+ *   const char *values[100 * 2];
+ *   int rows, i;
+ *   while ((rows = result->getbatch(result, values, NULL, 100)) > 0) {
+ *     for (i = 0; i < rows; i++) {
+ *       printf("%s = %s\n", values[i * 2], values[i * 2 + 1]);
+ *     }
+ *   }
+ * @endcode
+ *
+ * @note
+ *  The values stay valid until the next getbatch(), getnext() or free()
+ *  call. Results which are stored in the client point to the row data
+ *  directly. Results fetched from the server and statement results reuse
+ *  their row buffers, so the values are copied into an arena owned by the
+ *  result, which is recycled per call.
+ */
+static int _resultGetBatch(qdbresult_t *result, const char **values,
+                           size_t *lengths, int maxrows)
+{
+#ifdef _Q_ENABLE_MYSQL
+    if (result == NULL || result->rs == NULL || values == NULL
+            || maxrows <= 0) {
+        return 0;
+    }
+
+    int cols = result->cols;
+    bool copy = (result->stmt != NULL || result->fetchtype == true);
+    qstrbuf_t *arena = NULL;
+    if (copy == true) {
+        size_t num = (size_t)maxrows * cols;
+        if (result->maxoffsets < num) {
+            size_t *offsets = (size_t *)qlibc_realloc(result->offsets,
+                                                sizeof(size_t) * num);
+            if (offsets == NULL) return 0;
+            result->offsets = offsets;
+            result->maxoffsets = num;
+        }
+        if (result->arena == NULL && (result->arena = qstrbuf(0)) == NULL) {
+            return 0;
+        }
+        arena = (qstrbuf_t *)result->arena;
+        arena->clear(arena);
+    }
+
+    int rows;
+    for (rows = 0; rows < maxrows; rows++) {
+        if (_resultGetNext(result) == false) break;
+
+        unsigned long *lens = result->lengths;
+        if (result->stmt == NULL) lens = mysql_fetch_lengths(result->rs);
+
+        int i;
+        for (i = 0; i < cols; i++) {
+            size_t n = (size_t)rows * cols + i;
+            const char *val = _resultGetStrAt(result, i + 1);
+            size_t len = (val != NULL) ? lens[i] : 0;
+            if (lengths != NULL) lengths[n] = len;
+
+            if (copy == false || val == NULL) {
+                values[n] = val;
+                if (copy == true) result->offsets[n] = (size_t)-1;
+                continue;
+            }
+            result->offsets[n] = arena->length(arena);
+            if (arena->append_n(arena, val, len) == false
+                    || arena->append_n(arena, "", 1) == false) {
+                return 0;
+            }
+        }
+    }
+
+    // the arena doesn't move anymore.
+    if (copy == true) {
+        char *base = arena->getstr(arena, false);
+        size_t n;
+        for (n = 0; n < (size_t)rows * cols; n++) {
+            if (result->offsets[n] != (size_t)-1) {
+                values[n] = base + result->offsets[n];
+            }
+        }
+    }
+
+    return rows;
+#else
+    return 0;
+#endif
+}
+
 /**
  * qdbresult->get_cols(): Get the number of columns in the result set
  *
@@ -818,6 +1215,10 @@ static int result_get_rows(qdbresult_t *result)
 {
 #ifdef _Q_ENABLE_MYSQL
     if (result == NULL || result->rs == NULL) return 0;
+    if (result->stmt != NULL) {
+        if (result->stmt->mstmt == NULL) return 0;
+        return mysql_stmt_num_rows(result->stmt->mstmt);
+    }
     return mysql_num_rows(result->rs);
 #else
     return 0;
@@ -853,6 +1254,23 @@ static void result_free(qdbresult_t *result)
 {
 #ifdef _Q_ENABLE_MYSQL
     if (result == NULL) return;
+    if (result->stmt != NULL) {
+        if (result->stmt->mstmt != NULL) {
+            mysql_stmt_free_result(result->stmt->mstmt);
+        }
+        int i;
+        for (i = 0; result->bufs != NULL && i < result->cols; i++) {
+            qlibc_free(result->bufs[i]);
+        }
+        qlibc_free(result->bufs);
+        qlibc_free(result->binds);
+        qlibc_free(result->lengths);
+        qlibc_free(result->isnulls);
+        if (result->rs != NULL) mysql_free_result(result->rs);
+        _resultFreeCache(result);
+        qlibc_free(result);
+        return;
+    }
     if (result->rs != NULL) {
         if (result->fetchtype == true) {
             while (mysql_fetch_row(result->rs) != NULL);
@@ -860,13 +1278,960 @@ static void result_free(qdbresult_t *result)
         mysql_free_result(result->rs);
         result->rs = NULL;
     }
-    free(result);
+    _resultFreeCache(result);
+    qlibc_free(result);
     return;
 #else
     return;
 #endif
 }
 
+/**
+ * qdbstmt->bind_int(): Binds an integer to a parameter
+ *
+ * @param stmt      a pointer of qdbstmt_t object
+ * @param idx       parameter number (first '?' is 1)
+ * @param num       integer value
+ *
+ * @return true if successful, otherwise returns false
+ * @retval errno will be set in error condition.
+ *  - EINVAL    : Invalid argument.
+ *  - ERANGE    : Parameter number out of range.
+ */
+static bool stmt_bind_int(qdbstmt_t *stmt, int idx, int64_t num)
+{
+#ifdef _Q_ENABLE_MYSQL
+    if (_stmt_bindcheck(stmt, idx) == false) return false;
+
+    struct _qdbparam_s *value = &((struct _qdbparam_s *)stmt->values)[idx-1];
+    MYSQL_BIND *param = &stmt->params[idx-1];
+    value->num.i = num;
+    value->isnull = false;
+    param->buffer_type = MYSQL_TYPE_LONGLONG;
+    param->buffer = &value->num.i;
+    param->buffer_length = sizeof(value->num.i);
+    return true;
+#else
+    errno = ENOTSUP;
+    return false;
+#endif
+}
+
+/**
+ * qdbstmt->bind_double(): Binds a floating point number to a parameter
+ *
+ * @param stmt      a pointer of qdbstmt_t object
+ * @param idx       parameter number (first '?' is 1)
+ * @param num       floating point value
+ *
+ * @return true if successful, otherwise returns false
+ * @retval errno will be set in error condition.
+ *  - EINVAL    : Invalid argument.
+ *  - ERANGE    : Parameter number out of range.
+ */
+static bool stmt_bind_double(qdbstmt_t *stmt, int idx, double num)
+{
+#ifdef _Q_ENABLE_MYSQL
+    if (_stmt_bindcheck(stmt, idx) == false) return false;
+
+    struct _qdbparam_s *value = &((struct _qdbparam_s *)stmt->values)[idx-1];
+    MYSQL_BIND *param = &stmt->params[idx-1];
+    value->num.d = num;
+    value->isnull = false;
+    param->buffer_type = MYSQL_TYPE_DOUBLE;
+    param->buffer = &value->num.d;
+    param->buffer_length = sizeof(value->num.d);
+    return true;
+#else
+    errno = ENOTSUP;
+    return false;
+#endif
+}
+
+/**
+ * qdbstmt->bind_str(): Binds a string to a parameter
+ *
+ * @param stmt      a pointer of qdbstmt_t object
+ * @param idx       parameter number (first '?' is 1)
+ * @param str       string value. NULL binds SQL NULL.
+ *
+ * @return true if successful, otherwise returns false
+ * @retval errno will be set in error condition.
+ *  - EINVAL    : Invalid argument.
+ *  - ERANGE    : Parameter number out of range.
+ *
+ * @note
+ *  The string is not copied. It must stay valid until the statement has
+ *  been executed.
+ */
+static bool stmt_bind_str(qdbstmt_t *stmt, int idx, const char *str)
+{
+    if (str == NULL) return stmt_bind_null(stmt, idx);
+    return stmt_bind_blob(stmt, idx, str, strlen(str));
+}
+
+/**
+ * qdbstmt->bind_blob(): Binds binary data to a parameter
+ *
+ * @param stmt      a pointer of qdbstmt_t object
+ * @param idx       parameter number (first '?' is 1)
+ * @param data      data pointer
+ * @param size      size of data
+ *
+ * @return true if successful, otherwise returns false
+ * @retval errno will be set in error condition.
+ *  - EINVAL    : Invalid argument.
+ *  - ERANGE    : Parameter number out of range.
+ *
+ * @note
+ *  The data is not copied. It must stay valid until the statement has been
+ *  executed.
+ */
+static bool stmt_bind_blob(qdbstmt_t *stmt, int idx, const void *data,
+                           size_t size)
+{
+#ifdef _Q_ENABLE_MYSQL
+    if (data == NULL && size > 0) {
+        errno = EINVAL;
+        return false;
+    }
+    if (_stmt_bindcheck(stmt, idx) == false) return false;
+
+    struct _qdbparam_s *value = &((struct _qdbparam_s *)stmt->values)[idx-1];
+    MYSQL_BIND *param = &stmt->params[idx-1];
+    value->length = size;
+    value->isnull = false;
+    param->buffer_type = MYSQL_TYPE_BLOB;
+    param->buffer = (void *)data;
+    param->buffer_length = size;
+    return true;
+#else
+    errno = ENOTSUP;
+    return false;
+#endif
+}
+
+/**
+ * qdbstmt->bind_null(): Binds SQL NULL to a parameter
+ *
+ * @param stmt      a pointer of qdbstmt_t object
+ * @param idx       parameter number (first '?' is 1)
+ *
+ * @return true if successful, otherwise returns false
+ * @retval errno will be set in error condition.
+ *  - EINVAL    : Invalid argument.
+ *  - ERANGE    : Parameter number out of range.
+ *
+ * @note
+ *  Parameters which are never bound are sent as NULL.
+ */
+static bool stmt_bind_null(qdbstmt_t *stmt, int idx)
+{
+#ifdef _Q_ENABLE_MYSQL
+    if (_stmt_bindcheck(stmt, idx) == false) return false;
+
+    struct _qdbparam_s *value = &((struct _qdbparam_s *)stmt->values)[idx-1];
+    MYSQL_BIND *param = &stmt->params[idx-1];
+    value->isnull = true;
+    param->buffer_type = MYSQL_TYPE_NULL;
+    param->buffer = NULL;
+    param->buffer_length = 0;
+    return true;
+#else
+    errno = ENOTSUP;
+    return false;
+#endif
+}
+
+/**
+ * qdbstmt->execute_update(): Executes the prepared update DML
+ *
+ * @param stmt      a pointer of qdbstmt_t object
+ *
+ * @return a number of affected rows, otherwise returns -1
+ * @retval errno will be set in error condition.
+ *  - EINVAL    : Invalid argument.
+ *  - ENOTCONN  : Connection has been closed.
+ *  - EIO       : Execution failed. See qdb->get_error().
+ */
+static int stmt_execute_update(qdbstmt_t *stmt)
+{
+#ifdef _Q_ENABLE_MYSQL
+    if (_stmt_execute(stmt) == false) return -1;
+
+    int affected = mysql_stmt_affected_rows(stmt->mstmt);
+    if (affected < 0) affected = -1;
+
+    Q_MUTEX_LEAVE(stmt->db->qmutex);
+    return affected;
+#else
+    errno = ENOTSUP;
+    return -1;
+#endif
+}
+
+/**
+ * qdbstmt->execute_query(): Executes the prepared query
+ *
+ * @param stmt      a pointer of qdbstmt_t object
+ *
+ * @return a pointer of qdbresult_t if successful, otherwise returns NULL
+ * @retval errno will be set in error condition.
+ *  - EINVAL    : Invalid argument.
+ *  - ENOTCONN  : Connection has been closed.
+ *  - ENOMEM    : Memory allocation failure.
+ *  - EIO       : Execution failed. See qdb->get_error().
+ *
+ * @note
+ *  The result refers to the statement and must be freed before the
+ *  statement is freed or executed again. Columns are returned as strings
+ *  like the results of qdb->execute_query().
+ */
+static qdbresult_t *stmt_execute_query(qdbstmt_t *stmt)
+{
+#ifdef _Q_ENABLE_MYSQL
+    if (stmt == NULL || stmt->mstmt == NULL) {
+        errno = (stmt == NULL) ? EINVAL : ENOTCONN;
+        return NULL;
+    }
+
+    my_bool updatemax = (stmt->db->info.fetchtype == false);
+    mysql_stmt_attr_set(stmt->mstmt, STMT_ATTR_UPDATE_MAX_LENGTH, &updatemax);
+
+    if (_stmt_execute(stmt) == false) return NULL;
+
+    qdbresult_t *result = _newresult(stmt->db->info.fetchtype);
+    if (result == NULL) {
+        mysql_stmt_free_result(stmt->mstmt);
+        Q_MUTEX_LEAVE(stmt->db->qmutex);
+        errno = ENOMEM;
+        return NULL;
+    }
+    result->stmt = stmt;
+
+    // not a result returning statement when there's no meta data
+    if ((result->rs = mysql_stmt_result_metadata(stmt->mstmt)) == NULL
+            || (result->fetchtype == false
+                && mysql_stmt_store_result(stmt->mstmt) != 0)) {
+        result->free(result);
+        Q_MUTEX_LEAVE(stmt->db->qmutex);
+        errno = EIO;
+        return NULL;
+    }
+    result->cols = mysql_num_fields(result->rs);
+    result->fields = mysql_fetch_fields(result->rs);
+
+    // bind every column as a string into its own buffer
+    int cols = result->cols;
+    result->binds = (MYSQL_BIND *)qlibc_calloc(cols, sizeof(MYSQL_BIND));
+    result->bufs = (char **)qlibc_calloc(cols, sizeof(char *));
+    result->lengths = (unsigned long *)qlibc_calloc(cols, sizeof(unsigned long));
+    result->isnulls = (my_bool *)qlibc_calloc(cols, sizeof(my_bool));
+    bool ok = (result->binds != NULL && result->bufs != NULL
+               && result->lengths != NULL && result->isnulls != NULL);
+
+    int i;
+    for (i = 0; ok == true && i < cols; i++) {
+        size_t size = _Q_MYSQL_STMT_COLSIZE;
+        if (result->fetchtype == false) size = result->fields[i].max_length + 1;
+        if ((result->bufs[i] = (char *)qlibc_malloc(size)) == NULL) {
+            ok = false;
+            break;
+        }
+        result->binds[i].buffer_type = MYSQL_TYPE_STRING;
+        result->binds[i].buffer = result->bufs[i];
+        result->binds[i].buffer_length = size - 1;
+        result->binds[i].length = &result->lengths[i];
+        result->binds[i].is_null = &result->isnulls[i];
+    }
+    if (ok == false || mysql_stmt_bind_result(stmt->mstmt, result->binds)) {
+        result->free(result);
+        Q_MUTEX_LEAVE(stmt->db->qmutex);
+        errno = (ok == false) ? ENOMEM : EIO;
+        return NULL;
+    }
+
+    Q_MUTEX_LEAVE(stmt->db->qmutex);
+    return result;
+#else
+    errno = ENOTSUP;
+    return NULL;
+#endif
+}
+
+/**
+ * qdbstmt->get_params(): Get the number of parameters of the statement
+ *
+ * @param stmt      a pointer of qdbstmt_t object
+ *
+ * @return the number of '?' parameter markers
+ */
+static int stmt_get_params(qdbstmt_t *stmt)
+{
+#ifdef _Q_ENABLE_MYSQL
+    if (stmt == NULL) return 0;
+    return stmt->nparams;
+#else
+    return 0;
+#endif
+}
+
+/**
+ * qdbstmt->free(): Release the statement
+ *
+ * @param stmt      a pointer of qdbstmt_t object
+ *
+ * @note
+ *  A cached statement goes back to the statement cache of the connection
+ *  with its parameters cleared. Others are closed and de-allocated.
+ */
+static void stmt_free(qdbstmt_t *stmt)
+{
+#ifdef _Q_ENABLE_MYSQL
+    if (stmt == NULL) return;
+
+    qdb_t *db = stmt->db;
+    if (stmt->cached == false) {
+        // orphaned statements don't touch the connection
+        if (stmt->mstmt != NULL) {
+            Q_MUTEX_ENTER(db->qmutex);
+            _stmt_destroy(stmt);
+            Q_MUTEX_LEAVE(db->qmutex);
+        } else {
+            _stmt_destroy(stmt);
+        }
+        return;
+    }
+
+    Q_MUTEX_ENTER(db->qmutex);
+    mysql_stmt_free_result(stmt->mstmt);
+    mysql_stmt_reset(stmt->mstmt);
+    _stmt_clearbinds(stmt);
+    stmt->inuse = false;
+    Q_MUTEX_LEAVE(db->qmutex);
+#endif
+}
+
+/**
+ * Create a pool of database connections.
+ *
+ * @param dbtype    database server type. currently "MYSQL" is only supported
+ * @param addr      ip or fqdn address.
+ * @param port      port number
+ * @param username  database username
+ * @param password  database password
+ * @param database  database name
+ * @param autocommit sets autocommit mode of the connections
+ * @param maxconns  maximum number of connections. must be greater than 0.
+ * @param pingidlems idle connections older than this are pinged and
+ *                   reconnected if needed on checkout. 0 for no check.
+ *
+ * @return a pointer of qdbpool_t object if successful, otherwise returns NULL.
+ * @retval errno will be set in error condition.
+ *  - EINVAL    : Invalid argument or not supported database type.
+ *  - ENOMEM    : Memory allocation failure.
+ *
+ * @code
+ *   qdbpool_t *pool = qdbpool("MYSQL", "dbhost.qdecoder.org", 3306,
+ *                             "test", "secret", "sampledb", true, 8, 30000);
+ *
+ *   // in any thread
+ *   qdb_t *db = pool->get(pool, 1000);
+ *   if (db != NULL) {
+ *     db->execute_update(db, "UPDATE City SET visited = visited + 1");
+ *     pool->release(pool, db);
+ *   }
+ *
+ *   pool->free(pool);
+ * @endcode
+ *
+ * @note
+ *  Connections are opened on demand and a connection is checked out to one
+ *  caller at a time, so threads don't serialize on a shared qdb_t. Call
+ *  qdbpool->ping() periodically to keep idle connections healthy from a
+ *  maintenance thread.
+ */
+qdbpool_t *qdbpool(const char *dbtype, const char *addr, int port,
+                   const char *username, const char *password,
+                   const char *database, bool autocommit, int maxconns,
+                   int pingidlems)
+{
+    if (maxconns <= 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    qdbpool_t *pool = (qdbpool_t *)qlibc_calloc(1, sizeof(qdbpool_t));
+    if (pool == NULL) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    pool->idle = qlibc_calloc(maxconns, sizeof(*pool->idle));
+    if (pool->idle == NULL) {
+        qlibc_free(pool);
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    // keep the connection information in an unopened object.
+    pool->conf = qdb(dbtype, addr, port, username, password, database,
+                     autocommit);
+    if (pool->conf == NULL) {
+        qlibc_free(pool->idle);
+        qlibc_free(pool);
+        errno = EINVAL;
+        return NULL;
+    }
+
+    if (pthread_mutex_init(&pool->mutex, NULL) != 0) {
+        pool->conf->free(pool->conf);
+        qlibc_free(pool->idle);
+        qlibc_free(pool);
+        errno = ENOMEM;
+        return NULL;
+    }
+    if (pthread_cond_init(&pool->cond, NULL) != 0) {
+        pthread_mutex_destroy(&pool->mutex);
+        pool->conf->free(pool->conf);
+        qlibc_free(pool->idle);
+        qlibc_free(pool);
+        errno = ENOMEM;
+        return NULL;
+    }
+    pool->maxconns = maxconns;
+    pool->pingidlems = (pingidlems > 0) ? pingidlems : 0;
+
+    // member methods
+    pool->get = pool_get;
+    pool->release = pool_release;
+    pool->ping = pool_ping;
+    pool->size = pool_size;
+    pool->clear = pool_clear;
+    pool->free = pool_free;
+
+    return pool;
+}
+
+/**
+ * qdbpool->get(): Check out a connection.
+ *
+ * @param pool      a pointer of qdbpool_t object
+ * @param timeoutms wait timeout milliseconds when all connections are in
+ *                  use. 0 for no wait, -1 for infinite wait.
+ *
+ * @return a pointer of connected qdb_t object if successful, otherwise
+ *         returns NULL.
+ * @retval errno will be set in error condition.
+ *  - ETIMEDOUT     : All connections are in use.
+ *  - ENOMEM        : Memory allocation failure.
+ *  - ECONNREFUSED  : Can't connect to database.
+ *
+ * @note
+ *  The returned connection must be given back with qdbpool->release() and
+ *  not be freed.
+ */
+static qdb_t *pool_get(qdbpool_t *pool, int timeoutms)
+{
+    struct timespec deadline;
+    memset((void *)&deadline, 0, sizeof(deadline));
+    if (timeoutms > 0) {
+        long expire = qtime_monotonic_coarse_ms() + timeoutms;
+        deadline.tv_sec = expire / 1000;
+        deadline.tv_nsec = (expire % 1000) * 1000000;
+    }
+
+    while (true) {
+        qdb_t *db = NULL;
+        long since = 0;
+
+        pthread_mutex_lock(&pool->mutex);
+        if (pool->nidle > 0) {
+            // most recently used first, it's least likely to be dead.
+            pool->nidle--;
+            db = pool->idle[pool->nidle].db;
+            since = pool->idle[pool->nidle].since;
+        } else if (pool->num < pool->maxconns) {
+            pool->num++;
+        } else {
+            int ret = 0;
+            if (timeoutms < 0) {
+                ret = pthread_cond_wait(&pool->cond, &pool->mutex);
+            } else if (timeoutms == 0) {
+                ret = ETIMEDOUT;
+            } else {
+                ret = pthread_cond_timedwait(&pool->cond, &pool->mutex,
+                                             &deadline);
+            }
+            pthread_mutex_unlock(&pool->mutex);
+            if (ret == ETIMEDOUT) {
+                errno = ETIMEDOUT;
+                return NULL;
+            }
+            continue;
+        }
+        pthread_mutex_unlock(&pool->mutex);
+
+        // health-check an idle connection out of the lock.
+        if (db != NULL) {
+            if (pool->pingidlems == 0
+                    || qtime_monotonic_coarse_ms() - since < pool->pingidlems
+                    || db->ping(db) == true) {
+                return db;
+            }
+            DEBUG("drop dead connection to %s:%d", db->info.addr,
+                  db->info.port);
+            _pool_drop(pool, db);
+            continue;
+        }
+
+        // open a new one
+        qdb_t *conf = pool->conf;
+        int err = ENOMEM;
+        db = qdb(conf->info.dbtype, conf->info.addr, conf->info.port,
+                 conf->info.username, conf->info.password,
+                 conf->info.database, conf->info.autocommit);
+        if (db != NULL && db->open(db) == false) {
+            db->free(db);
+            db = NULL;
+            err = ECONNREFUSED;
+        }
+        if (db == NULL) {
+            _pool_drop(pool, NULL);
+            errno = err;
+        }
+        return db;
+    }
+}
+
+/**
+ * qdbpool->release(): Give back a connection checked out by get().
+ *
+ * @param pool      a pointer of qdbpool_t object
+ * @param db        a pointer of qdb_t object from get()
+ *
+ * @note
+ *  A transaction left open is rolled back. Disconnected connections are
+ *  closed instead of being kept idle.
+ */
+static void pool_release(qdbpool_t *pool, qdb_t *db)
+{
+    if (db == NULL) return;
+
+    if (db->qmutex != NULL && db->qmutex->count > 0) {
+        DEBUG("rollback unfinished transaction.");
+        db->rollback(db);
+    }
+    if (db->connected == false) {
+        _pool_drop(pool, db);
+        return;
+    }
+
+    pthread_mutex_lock(&pool->mutex);
+    pool->idle[pool->nidle].db = db;
+    pool->idle[pool->nidle].since = qtime_monotonic_coarse_ms();
+    pool->nidle++;
+    pthread_cond_broadcast(&pool->cond);
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+/**
+ * qdbpool->ping(): Check all the idle connections.
+ *
+ * @param pool      a pointer of qdbpool_t object
+ *
+ * @return the number of idle connections which are alive, or -1 on memory
+ *         allocation failure.
+ *
+ * @note
+ *  Dead connections are reconnected by qdb->ping() and dropped when it
+ *  fails. Connections checked out meanwhile are not affected.
+ */
+static int pool_ping(qdbpool_t *pool)
+{
+    // take the idle connections out, other callers will open new ones.
+    pthread_mutex_lock(&pool->mutex);
+    int num = pool->nidle;
+    qdb_t **dbs = NULL;
+    if (num > 0 && (dbs = (qdb_t **)qlibc_malloc(sizeof(qdb_t *) * num)) != NULL) {
+        int i;
+        for (i = 0; i < num; i++) {
+            dbs[i] = pool->idle[i].db;
+        }
+        pool->nidle = 0;
+    }
+    pthread_mutex_unlock(&pool->mutex);
+    if (dbs == NULL) return (num > 0) ? -1 : 0;
+
+    int alive = 0, i;
+    for (i = 0; i < num; i++) {
+        if (dbs[i]->ping(dbs[i]) == true) {
+            pool_release(pool, dbs[i]);
+            alive++;
+        } else {
+            _pool_drop(pool, dbs[i]);
+        }
+    }
+    qlibc_free(dbs);
+
+    return alive;
+}
+
+/**
+ * qdbpool->size(): Get the number of connections in the pool.
+ *
+ * @param pool      a pointer of qdbpool_t object
+ *
+ * @return the number of connections, both checked out and idle.
+ */
+static size_t pool_size(qdbpool_t *pool)
+{
+    pthread_mutex_lock(&pool->mutex);
+    size_t num = pool->num;
+    pthread_mutex_unlock(&pool->mutex);
+    return num;
+}
+
+/**
+ * qdbpool->clear(): Close all the idle connections.
+ *
+ * @param pool      a pointer of qdbpool_t object
+ */
+static void pool_clear(qdbpool_t *pool)
+{
+    pthread_mutex_lock(&pool->mutex);
+    while (pool->nidle > 0) {
+        pool->nidle--;
+        pool->idle[pool->nidle].db->free(pool->idle[pool->nidle].db);
+        pool->num--;
+    }
+    pthread_cond_broadcast(&pool->cond);
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+/**
+ * qdbpool->free(): Close idle connections and free the pool.
+ *
+ * @param pool      a pointer of qdbpool_t object
+ *
+ * @note
+ *  All the connections must have been released before.
+ */
+static void pool_free(qdbpool_t *pool)
+{
+    pool_clear(pool);
+    if (pool->num > 0) {
+        DEBUG("%d connections are not released.", pool->num);
+    }
+
+    pool->conf->free(pool->conf);
+    qlibc_free(pool->idle);
+    pthread_cond_destroy(&pool->cond);
+    pthread_mutex_destroy(&pool->mutex);
+    qlibc_free(pool);
+}
+
+// close a connection of the pool. NULL just gives back the reserved slot.
+static void _pool_drop(qdbpool_t *pool, qdb_t *db)
+{
+    if (db != NULL) db->free(db);
+
+    pthread_mutex_lock(&pool->mutex);
+    pool->num--;
+    pthread_cond_broadcast(&pool->cond);
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+// initialize a result object.
+static qdbresult_t *_newresult(bool fetchtype)
+{
+    qdbresult_t *result = (qdbresult_t *)qlibc_calloc(1, sizeof(qdbresult_t));
+    if (result == NULL) return NULL;
+
+#ifdef _Q_ENABLE_MYSQL
+    result->fetchtype = fetchtype;
+#endif
+
+    /* assign methods */
+    result->getstr = _resultGetStr;
+    result->get_str_at = _resultGetStrAt;
+    result->getint = _resultGetInt;
+    result->get_int_at = _resultGetIntAt;
+    result->getnext = _resultGetNext;
+    result->getbatch = _resultGetBatch;
+    result->get_colidx = _resultGetColIdx;
+
+    result->get_cols = result_get_cols;
+    result->get_rows = result_get_rows;
+    result->get_row = result_get_row;
+
+    result->free = result_free;
+
+    return result;
+}
+
+// fetch the next row of a statement result, growing truncated columns.
+static bool _resultFetchStmt(qdbresult_t *result)
+{
+#ifdef _Q_ENABLE_MYSQL
+    MYSQL_STMT *mstmt = result->stmt->mstmt;
+    int ret = mysql_stmt_fetch(mstmt);
+    if (ret == 1 || ret == MYSQL_NO_DATA) return false;
+
+    int i;
+    if (ret == MYSQL_DATA_TRUNCATED) {
+        for (i = 0; i < result->cols; i++) {
+            MYSQL_BIND *bind = &result->binds[i];
+            if (result->isnulls[i] || result->lengths[i] <= bind->buffer_length) {
+                continue;
+            }
+            char *buf = (char *)qlibc_realloc(result->bufs[i], result->lengths[i] + 1);
+            if (buf == NULL) return false;
+            result->bufs[i] = buf;
+            bind->buffer = buf;
+            bind->buffer_length = result->lengths[i];
+            if (mysql_stmt_fetch_column(mstmt, bind, i, 0) != 0) return false;
+        }
+        // buffers have moved
+        if (mysql_stmt_bind_result(mstmt, result->binds) != 0) return false;
+    }
+
+    for (i = 0; i < result->cols; i++) {
+        if (result->isnulls[i]) continue;
+        unsigned long len = result->lengths[i];
+        if (len > result->binds[i].buffer_length) {
+            len = result->binds[i].buffer_length;
+        }
+        result->bufs[i][len] = '\0';
+    }
+    result->cursor++;
+
+    return true;
+#else
+    return false;
+#endif
+}
+
+// prepare a new statement on the connection. db must be locked.
+static qdbstmt_t *_stmt_new(qdb_t *db, const char *query)
+{
+#ifdef _Q_ENABLE_MYSQL
+    qdbstmt_t *stmt = (qdbstmt_t *)qlibc_calloc(1, sizeof(qdbstmt_t));
+    if (stmt == NULL || (stmt->query = qlibc_strdup(query)) == NULL) {
+        qlibc_free(stmt);
+        errno = ENOMEM;
+        return NULL;
+    }
+    stmt->db = db;
+
+    if ((stmt->mstmt = mysql_stmt_init(db->mysql)) == NULL) {
+        _stmt_destroy(stmt);
+        errno = ENOMEM;
+        return NULL;
+    }
+    if (mysql_stmt_prepare(stmt->mstmt, query, strlen(query)) != 0) {
+        _stmt_destroy(stmt);
+        errno = EIO;
+        return NULL;
+    }
+
+    stmt->nparams = mysql_stmt_param_count(stmt->mstmt);
+    if (stmt->nparams > 0) {
+        stmt->params = (MYSQL_BIND *)qlibc_calloc(stmt->nparams, sizeof(MYSQL_BIND));
+        stmt->values = qlibc_calloc(stmt->nparams, sizeof(struct _qdbparam_s));
+        if (stmt->params == NULL || stmt->values == NULL) {
+            _stmt_destroy(stmt);
+            errno = ENOMEM;
+            return NULL;
+        }
+    }
+    _stmt_clearbinds(stmt);
+
+    /* assign methods */
+    stmt->bind_int = stmt_bind_int;
+    stmt->bind_double = stmt_bind_double;
+    stmt->bind_str = stmt_bind_str;
+    stmt->bind_blob = stmt_bind_blob;
+    stmt->bind_null = stmt_bind_null;
+
+    stmt->execute_update = stmt_execute_update;
+    stmt->execute_query = stmt_execute_query;
+
+    stmt->get_params = stmt_get_params;
+    stmt->free = stmt_free;
+
+    return stmt;
+#else
+    errno = ENOTSUP;
+    return NULL;
+#endif
+}
+
+// close and de-allocate a statement.
+static void _stmt_destroy(qdbstmt_t *stmt)
+{
+#ifdef _Q_ENABLE_MYSQL
+    if (stmt->mstmt != NULL) mysql_stmt_close(stmt->mstmt);
+    qlibc_free(stmt->params);
+    qlibc_free(stmt->values);
+#endif
+    qlibc_free(stmt->query);
+    qlibc_free(stmt);
+}
+
+// reset every parameter to NULL.
+static void _stmt_clearbinds(qdbstmt_t *stmt)
+{
+#ifdef _Q_ENABLE_MYSQL
+    int i;
+    for (i = 0; i < stmt->nparams; i++) {
+        struct _qdbparam_s *value = &((struct _qdbparam_s *)stmt->values)[i];
+        MYSQL_BIND *param = &stmt->params[i];
+        memset((void *)param, 0, sizeof(MYSQL_BIND));
+        memset((void *)value, 0, sizeof(struct _qdbparam_s));
+        value->isnull = true;
+        param->buffer_type = MYSQL_TYPE_NULL;
+        param->length = &value->length;
+        param->is_null = &value->isnull;
+    }
+#endif
+}
+
+// check the parameter index of bind_*() calls.
+static bool _stmt_bindcheck(qdbstmt_t *stmt, int idx)
+{
+#ifdef _Q_ENABLE_MYSQL
+    if (stmt == NULL) {
+        errno = EINVAL;
+        return false;
+    }
+    if (idx <= 0 || idx > stmt->nparams) {
+        errno = ERANGE;
+        return false;
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
+// send the bound parameters and execute. db is left locked on success.
+static bool _stmt_execute(qdbstmt_t *stmt)
+{
+#ifdef _Q_ENABLE_MYSQL
+    if (stmt == NULL) {
+        errno = EINVAL;
+        return false;
+    }
+    if (stmt->mstmt == NULL) {
+        errno = ENOTCONN;
+        return false;
+    }
+
+    Q_MUTEX_ENTER(stmt->db->qmutex);
+    DEBUG("execute: %s", stmt->query);
+    if ((stmt->nparams > 0 && mysql_stmt_bind_param(stmt->mstmt, stmt->params))
+            || mysql_stmt_execute(stmt->mstmt) != 0) {
+        Q_MUTEX_LEAVE(stmt->db->qmutex);
+        errno = EIO;
+        return false;
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
+// close cached statements. ones in use are orphaned and freed by the user.
+static void _stmt_uncache(qdb_t *db)
+{
+#ifdef _Q_ENABLE_MYSQL
+    if (db->stmts == NULL) return;
+
+    qhnobj_t obj;
+    memset((void *)&obj, 0, sizeof(obj));
+    while (db->stmts->getnext(db->stmts, &obj, false) == true) {
+        qdbstmt_t *stmt = *(qdbstmt_t **)obj.data;
+        if (stmt->inuse == true) {
+            mysql_stmt_close(stmt->mstmt);
+            stmt->mstmt = NULL;
+            stmt->cached = false;
+        } else {
+            _stmt_destroy(stmt);
+        }
+    }
+    db->stmts->clear(db->stmts);
+#endif
+}
+
+// append an escaped "(v1,v2,...)" row of execute_batch().
+static bool _batchrow(qdb_t *db, qstrbuf_t *sb, const char **values, int cols)
+{
+#ifdef _Q_ENABLE_MYSQL
+    if (sb->append_n(sb, "(", 1) == false) return false;
+
+    int c;
+    for (c = 0; c < cols; c++) {
+        if (c > 0 && sb->append_n(sb, ",", 1) == false) return false;
+        if (values[c] == NULL) {
+            if (sb->append_n(sb, "NULL", 4) == false) return false;
+            continue;
+        }
+
+        // escape straight into the buffer
+        size_t len = strlen(values[c]);
+        if (sb->reserve(sb, len * 2 + 2) == false) return false;
+        char *esc = sb->getstr(sb, false) + sb->length(sb);
+        esc[0] = '\'';
+        size_t esclen = mysql_real_escape_string(db->mysql, esc + 1, values[c],
+                                                 len);
+        esc[esclen + 1] = '\'';
+        sb->append_n(sb, esc, esclen + 2);
+    }
+
+    return sb->append_n(sb, ")", 1);
+#else
+    return false;
+#endif
+}
+
+// free the column index and the batch arena of a result.
+static void _resultFreeCache(qdbresult_t *result)
+{
+#ifdef _Q_ENABLE_MYSQL
+    if (result->colidx != NULL) result->colidx->free(result->colidx);
+    if (result->arena != NULL) {
+        ((qstrbuf_t *)result->arena)->free((qstrbuf_t *)result->arena);
+    }
+    qlibc_free(result->offsets);
+#endif
+}
+
+// lower-case a column name into buf of _Q_COLNAME_MAX + 1 bytes.
+static bool _lowername(char *buf, const char *name)
+{
+    size_t i;
+    for (i = 0; name[i] != '\0'; i++) {
+        if (i >= _Q_COLNAME_MAX) return false;
+        buf[i] = tolower((unsigned char)name[i]);
+    }
+    buf[i] = '\0';
+    return true;
+}
+
+// print a formatted query into a malloced string.
+static char *_buildquery(const char *format, va_list arg)
+{
+    qstrbuf_t *sb = qstrbuf(1024);
+    if (sb == NULL) return NULL;
+
+    char *query = NULL;
+    if (sb->vappendf(sb, format, arg) == true) {
+        query = sb->steal(sb, NULL);
+    }
+    sb->free(sb);
+    return query;
+}
+
 #endif
 
 #endif /* DISABLE_QDATABASE */
@@ -122,21 +122,34 @@
 #include <errno.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
 #include <arpa/inet.h>
+#include <poll.h>
+#ifdef __linux__
+#include <sys/epoll.h>
+#endif
 
 #ifdef  ENABLE_OPENSSL
 #include "openssl/ssl.h"
 #include "openssl/err.h"
 #endif
 
+#ifdef  ENABLE_ZLIB
+#include "zlib.h"
+#endif
+
 #include "qinternal.h"
 #include "utilities/qio.h"
 #include "utilities/qstring.h"
 #include "utilities/qsocket.h"
+#include "utilities/qtime.h"
+#include "containers/qlist.h"
+#include "containers/qhashtbl.h"
 #include "containers/qlisttbl.h"
 #include "containers/qvector.h"
+#include "containers/qstrbuf.h"
 #include "extensions/qhttpclient.h"
 
 #ifndef _DOXYGEN_SKIP
@@ -146,6 +159,7 @@ static bool setssl(qhttpclient_t *client);
 static void settimeout(qhttpclient_t *client, int timeoutms);
 static void setkeepalive(qhttpclient_t *client, bool keepalive);
 static void setuseragent(qhttpclient_t *client, const char *agentname);
+static void setsockopts(qhttpclient_t *client, const qsocket_opts_t *opts);
 
 static bool head(qhttpclient_t *client, const char *uri, int *rescode,
                  qlisttbl_t *reqheaders, qlisttbl_t *resheaders);
@@ -161,10 +175,30 @@ static void *cmd(qhttpclient_t *client, const char *method, const char *uri,
                  void *data, size_t size, int *rescode, size_t *contentslength,
                  qlisttbl_t *reqheaders, qlisttbl_t *resheaders);
 
+static bool pipeline(qhttpclient_t *client, const char *method,
+                     const char *uri, qlisttbl_t *reqheaders,
+                     void (*callback)(void *userdata, int rescode,
+                                      qlisttbl_t *resheaders, void *content,
+                                      size_t contentslength),
+                     void *userdata);
+static int flush(qhttpclient_t *client);
+static bool stream(qhttpclient_t *client, const char *method,
+                   const char *uri, const void *data, size_t size,
+                   int *rescode, qlisttbl_t *reqheaders,
+                   qlisttbl_t *resheaders,
+                   bool (*callback)(void *userdata, const void *data,
+                                    size_t size),
+                   void *userdata);
+
 static bool sendrequest(qhttpclient_t *client, const char *method,
                         const char *uri, qlisttbl_t *reqheaders);
 static int readresponse(qhttpclient_t *client, qlisttbl_t *resheaders,
                         off_t *contentlength);
+static off_t readbody(qhttpclient_t *client, qlisttbl_t *resheaders,
+                      off_t contentlength,
+                      bool (*callback)(void *userdata, const void *data,
+                                       size_t size),
+                      void *userdata);
 
 static ssize_t gets_(qhttpclient_t *client, char *buf, size_t bufsize);
 static ssize_t read_(qhttpclient_t *client, void *buf, size_t nbytes);
@@ -176,9 +210,175 @@ static bool _close(qhttpclient_t *client);
 static void _free(qhttpclient_t *client);
 
 // internal usages
-static bool _set_socket_option(int socket);
+static qstrbuf_t *_buildrequest(qhttpclient_t *client, const char *method,
+                                const char *uri, qlisttbl_t *reqheaders);
+static bool _sendrequest(qhttpclient_t *client, const char *method,
+                         const char *uri, qlisttbl_t *reqheaders,
+                         const void *body, size_t bodysize);
+static ssize_t _writev(qhttpclient_t *client, const struct iovec *iov,
+                       int iovcnt);
+static void *_readcontent(qhttpclient_t *client, qlisttbl_t *resheaders,
+                          off_t clength, bool nobody, size_t *size);
+static void _pipeline_fail(qhttpclient_t *client, int err);
+
+// body delivery of readbody()
+struct qhttpclient_sink_s {
+    bool (*callback)(void *userdata, const void *data, size_t size);
+    void *userdata;
+    off_t total;        /*< bytes given to callback */
+#ifdef ENABLE_ZLIB
+    bool inflating;     /*< content is being inflated */
+    bool deflate;       /*< deflate encoding, may be raw deflate */
+    bool finished;      /*< end of compressed stream */
+    off_t inbytes;      /*< compressed bytes fed */
+    z_stream z;
+    unsigned char *out;
+#endif
+};
+
+static bool _sink_init(struct qhttpclient_sink_s *sink, qlisttbl_t *resheaders,
+                       bool (*callback)(void *userdata, const void *data,
+                                        size_t size),
+                       void *userdata);
+static bool _sink_write(struct qhttpclient_sink_s *sink, const void *data,
+                        size_t size);
+static bool _sink_end(struct qhttpclient_sink_s *sink);
+static void _sink_free(struct qhttpclient_sink_s *sink);
+
+// a request queued by pipeline()
+struct qhttpclient_pipereq_s {
+    char *head;     /*< serialized request */
+    size_t headlen;
+    bool nobody;    /*< response has no body, for HEAD method */
+    void (*callback)(void *userdata, int rescode, qlisttbl_t *resheaders,
+                     void *content, size_t contentslength);
+    void *userdata;
+};
+
+static void _default_sockopts(qsocket_opts_t *opts);
+static int _parse_statusline(const char *line);
+static void _parse_header(char *line, qlisttbl_t *resheaders,
+                          off_t *contentlength, bool *connclose);
 static bool _parse_uri(const char *uri, bool *protocol, char *hostname,
                        size_t namesize, int *port);
+#ifdef ENABLE_OPENSSL
+static ssize_t _ssl_read(void *arg, void *buf, size_t nbytes, int timeoutms);
+#endif
+
+static qhttpclient_t *pool_get(qhttpclient_pool_t *pool, const char *hostname,
+                               int port, bool ssl, int timeoutms);
+static void pool_release(qhttpclient_pool_t *pool, qhttpclient_t *client);
+static size_t pool_size(qhttpclient_pool_t *pool);
+static void pool_clear(qhttpclient_pool_t *pool);
+static void pool_free(qhttpclient_pool_t *pool);
+
+// connections of a host:port in the pool
+struct qhttpclient_poolhost_s {
+    char *hostname;
+    int port;
+    bool ssl;
+    int num;    /*< connections of this host, both checked out and idle */
+    int nidle;  /*< number of idle connections */
+    int maxidle;  /*< allocated size of idle */
+    struct {
+        qhttpclient_t *client;
+        long since;  /*< released time in miliseconds */
+    } *idle;
+    struct qhttpclient_poolhost_s *next;
+};
+
+static struct qhttpclient_poolhost_s *_pool_host(qhttpclient_pool_t *pool,
+                                                 const char *hostname,
+                                                 int port, bool ssl,
+                                                 bool create);
+static bool _pool_isalive(qhttpclient_pool_t *pool, qhttpclient_t *client,
+                          long since);
+static void _pool_drop(qhttpclient_pool_t *pool, qhttpclient_t *client);
+
+static bool multi_add(qhttpclient_multi_t *multi, const char *hostname,
+                      int port, const char *method, const char *uri,
+                      qlisttbl_t *reqheaders, const void *data, size_t size,
+                      void (*callback)(void *userdata, int rescode,
+                                       qlisttbl_t *resheaders, void *content,
+                                       size_t contentslength),
+                      void *userdata);
+static int multi_run(qhttpclient_multi_t *multi, int timeoutms);
+static void multi_setsockopts(qhttpclient_multi_t *multi,
+                              const qsocket_opts_t *opts);
+static size_t multi_size(qhttpclient_multi_t *multi);
+static void multi_free(qhttpclient_multi_t *multi);
+
+// states of a request in qhttpclient_multi
+enum {
+    MULTI_CONNECT = 0,  /*< waiting connect() to complete */
+    MULTI_SEND,         /*< sending request */
+    MULTI_HEAD,         /*< reading response status line and headers */
+    MULTI_BODY,         /*< reading body of known length or until close */
+    MULTI_CHUNKSIZE,    /*< reading a chunk size line */
+    MULTI_CHUNKDATA,    /*< reading chunk data */
+    MULTI_CHUNKEND,     /*< reading CRLF after chunk data */
+    MULTI_TRAILER       /*< reading trailer headers after the last chunk */
+};
+
+// events
+#define MULTI_EVREAD    (0x01)
+#define MULTI_EVWRITE   (0x02)
+#define MULTI_EVERROR   (0x04)
+
+#define MAX_MULTI_EVENTS    (256)           /*< events handled per wait */
+#define MAX_MULTI_LINE      (8 * 1024)      /*< maximum response line */
+#define MULTI_RECV_SIZE     (16 * 1024)     /*< receive buffer growing size */
+
+// a request in flight
+struct qhttpclient_multireq_s {
+    int fd;
+    int state;
+    int events;     /*< watching events */
+
+    char *out;      /*< request to send */
+    size_t outlen;
+    size_t outoff;  /*< bytes sent */
+
+    char *in;       /*< received but not parsed data */
+    size_t inlen;
+    size_t insize;
+
+    int rescode;
+    qlisttbl_t *resheaders;
+    off_t clength;      /*< content length or -1 for chunked */
+    bool untilclose;    /*< body ends when the server closes connection */
+    bool connclose;
+    bool nobody;        /*< response has no body, for HEAD method */
+    off_t chunkleft;    /*< bytes left in the current chunk */
+
+    char *body;
+    size_t bodylen;
+    size_t bodysize;
+
+    long deadline;  /*< timeout time in miliseconds, 0 for no limit */
+    void (*callback)(void *userdata, int rescode, qlisttbl_t *resheaders,
+                     void *content, size_t contentslength);
+    void *userdata;
+
+    struct qhttpclient_multireq_s *prev;  /*< head's prev is the tail */
+    struct qhttpclient_multireq_s *next;
+};
+
+static char *_multi_buildrequest(qhttpclient_multi_t *multi,
+                                 const char *hostname, int port,
+                                 const char *method, const char *uri,
+                                 qlisttbl_t *reqheaders, const void *data,
+                                 size_t size, size_t *outlen);
+static bool _multi_watch(qhttpclient_multi_t *multi,
+                         struct qhttpclient_multireq_s *req, int events);
+static int _multi_wait(qhttpclient_multi_t *multi, int waitms);
+static void _multi_event(qhttpclient_multi_t *multi,
+                         struct qhttpclient_multireq_s *req, int events);
+static int _multi_recv(struct qhttpclient_multireq_s *req);
+static int _multi_parse(struct qhttpclient_multireq_s *req, bool eof);
+static void _multi_done(qhttpclient_multi_t *multi,
+                        struct qhttpclient_multireq_s *req, int err);
+static void _multi_freereq(struct qhttpclient_multireq_s *req);
 
 #endif
 
@@ -212,12 +412,25 @@ static bool _parse_uri(const char *uri, bool *protocol, char *hostname,
 #define SET_TCP_NODELAY         (1)    /*< 0 for disable */
 #define MAX_SHUTDOWN_WAIT       (100)  /*< maximum shutdown wait, unit is ms */
 #define MAX_ATOMIC_DATA_SIZE    (32 * 1024)  /*< maximum sending bytes */
+#define MAX_PIPELINE_DEPTH      (16)   /*< maximum requests sent at once */
 
 #ifdef  ENABLE_OPENSSL
 struct SslConn {
     SSL *ssl;
     SSL_CTX *ctx;
 };
+
+#define MAX_SSL_SESSIONS        (1024) /*< TLS sessions cached for resumption */
+
+static pthread_once_t _ssl_once = PTHREAD_ONCE_INIT;
+static SSL_CTX *_ssl_ctx = NULL;  /*< process-wide context */
+static qhashtbl_t *_ssl_sessions = NULL;  /*< host:port to SSL_SESSION */
+static pthread_mutex_t _ssl_sessions_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void _ssl_init(void);
+static int _ssl_newsession(SSL *ssl, SSL_SESSION *session);
+static void _ssl_getsession(qhttpclient_t *client, SSL *ssl);
+static void _ssl_putsession(qhttpclient_t *client, SSL_SESSION *session);
 #endif
 
 /**
@@ -245,7 +458,7 @@ struct SslConn {
 qhttpclient_t *qhttpclient(const char *destname, int port) {
     bool ishttps = false;
     char hostname[256];
-    if (port == 0 || strstr(hostname, "://") != NULL) {
+    if (port == 0 || strstr(destname, "://") != NULL) {
         if (_parse_uri(destname, &ishttps, hostname, sizeof(hostname), &port)
                 == false) {
             DEBUG("Can't parse URI %s", destname);
@@ -258,13 +471,13 @@ qhttpclient_t *qhttpclient(const char *destname, int port) {
     }
 
     // get remote address
-    struct sockaddr_in addr;
-    if (qsocket_get_addr(&addr, hostname, port) == false) {
+    struct sockaddr_storage addrs[QSOCKET_MAXADDRS];
+    if (qsocket_resolve(addrs, QSOCKET_MAXADDRS, hostname, port) <= 0) {
         return NULL;
     }
 
     // allocate  object
-    qhttpclient_t *client = (qhttpclient_t *) malloc(sizeof(qhttpclient_t));
+    qhttpclient_t *client = (qhttpclient_t *) qlibc_malloc(sizeof(qhttpclient_t));
     if (client == NULL)
         return NULL;
     memset((void *) client, 0, sizeof(qhttpclient_t));
@@ -272,8 +485,8 @@ qhttpclient_t *qhttpclient(const char *destname, int port) {
     // initialize object
     client->socket = -1;
 
-    memcpy((void *) &client->addr, (void *) &addr, sizeof(client->addr));
-    client->hostname = strdup(hostname);
+    qsocket_get_addr(&client->addr, hostname, port);  // IPv4 hosts only
+    client->hostname = qlibc_strdup(hostname);
     client->port = port;
 
     // member methods
@@ -281,6 +494,7 @@ qhttpclient_t *qhttpclient(const char *destname, int port) {
     client->settimeout = settimeout;
     client->setkeepalive = setkeepalive;
     client->setuseragent = setuseragent;
+    client->setsockopts = setsockopts;
 
     client->open = open_;
 
@@ -289,8 +503,13 @@ qhttpclient_t *qhttpclient(const char *destname, int port) {
     client->put = put;
     client->cmd = cmd;
 
+    client->pipeline = pipeline;
+    client->flush = flush;
+    client->stream = stream;
+
     client->sendrequest = sendrequest;
     client->readresponse = readresponse;
+    client->readbody = readbody;
 
     client->gets = gets_;
     client->read = read_;
@@ -303,6 +522,7 @@ qhttpclient_t *qhttpclient(const char *destname, int port) {
 
     // init client
     settimeout(client, 0);
+    _default_sockopts(&client->sockopts);
     setkeepalive(client, false);
     setuseragent(client, QHTTPCLIENT_NAME);
     if (ishttps == true)
@@ -316,29 +536,30 @@ qhttpclient_t *qhttpclient(const char *destname, int port) {
  *
  * @param client    qhttpclient object pointer
  *
+ * @note
+ *  All HTTPS connections share one SSL context, and the last TLS session
+ *  of each host:port is kept so that a new connection to the same server
+ *  resumes it with an abbreviated handshake.
+ *
  * @code
  *   httpclient->setssl(httpclient);
  * @endcode
  */
 static bool setssl(qhttpclient_t *client) {
 #ifdef  ENABLE_OPENSSL
-    static bool initialized = false;
-
     if (client->socket >= 0) {
         // must be set before making a connection.
         return false;
     }
-    
-    // init openssl
-    if (initialized == false) {
-      initialized = true;
-      SSL_load_error_strings();
-      SSL_library_init();
-    }
+
+    // init openssl and the shared context
+    pthread_once(&_ssl_once, _ssl_init);
+    if (_ssl_ctx == NULL)
+        return false;
 
     // allocate ssl structure
     if (client->ssl == NULL) {
-        client->ssl = malloc(sizeof(struct SslConn));
+        client->ssl = qlibc_malloc(sizeof(struct SslConn));
         if (client->ssl == NULL) return false;
         memset(client->ssl, 0, sizeof(struct SslConn));
     }
@@ -393,8 +614,33 @@ static void setkeepalive(qhttpclient_t *client, bool keepalive) {
  */
 static void setuseragent(qhttpclient_t *client, const char *useragent) {
     if (client->useragent != NULL)
-        free(client->useragent);
-    client->useragent = strdup(useragent);
+        qlibc_free(client->useragent);
+    client->useragent = qlibc_strdup(useragent);
+}
+
+/**
+ * qhttpclient->setsockopts(): Sets socket options of new connections.
+ *
+ * @param client    qhttpclient object pointer
+ * @param opts      socket tuning profile. NULL restores the default, which
+ *                  turns TCP_NODELAY on and lingers 15 seconds on close.
+ *
+ * @code
+ *   // cut handshake and small message delays of a chatty client.
+ *   qsocket_opts_t opts = { .nodelay = true, .quickack = true,
+ *                           .fastopen = true };
+ *   httpclient->setsockopts(httpclient, &opts);
+ * @endcode
+ *
+ * @note
+ *  Options are set before connecting, so a connection already open keeps
+ *  its options until it's reopened. See qsocket_set_opts() for the options.
+ */
+static void setsockopts(qhttpclient_t *client, const qsocket_opts_t *opts) {
+    if (opts != NULL)
+        client->sockopts = *opts;
+    else
+        _default_sockopts(&client->sockopts);
 }
 
 /**
@@ -422,53 +668,24 @@ static bool open_(qhttpclient_t *client) {
         _close(client);
     }
 
-    // create new socket
-    int sockfd = socket(AF_INET, SOCK_STREAM, 0);
+    // try to connect. the host is looked up in the cache of qsocket and
+    // all its addresses are tried.
+    int sockfd = qsocket_open_opts(client->hostname, client->port,
+                                   client->timeoutms, &client->sockopts);
     if (sockfd < 0) {
-        DEBUG("sockfd creation failed.");
-        return false;
-    }
-
-    // set to non-block socket if timeout is set
-    int sockflag = 0;
-    if (client->timeoutms > 0) {
-        sockflag = fcntl(sockfd, F_GETFL, 0);
-        fcntl(sockfd, F_SETFL, sockflag | O_NONBLOCK);
-    }
-
-    // try to connect
-    int status = connect(sockfd, (struct sockaddr *) &client->addr,
-                         sizeof(client->addr));
-    if (status < 0
-            && (errno != EINPROGRESS
-                    || qio_wait_writable(sockfd, client->timeoutms) <= 0)) {
-        DEBUG("connection failed. (%d)", errno);
-        close(sockfd);
+        DEBUG("connection failed. (%d, %d)", sockfd, errno);
         return false;
     }
 
-    // restore to block socket
-    if (client->timeoutms > 0) {
-        fcntl(sockfd, F_SETFL, sockflag);
-    }
-
     // store socket descriptor
     client->socket = sockfd;
 
-    // set socket option
-    _set_socket_option(sockfd);
-
 #ifdef ENABLE_OPENSSL
     // set SSL option
     if (client->ssl != NULL) {
-        // get ssl context using SSL 2 or 3
+        // all connections share a context.
         struct SslConn *ssl = client->ssl;
-        ssl->ctx = SSL_CTX_new(SSLv23_client_method());
-        if (ssl->ctx == NULL) {
-            DEBUG("OpenSSL: %s", ERR_reason_error_string(ERR_get_error()));
-            _close(client);
-            return false;
-        }
+        ssl->ctx = _ssl_ctx;
 
         // get ssl handle
         ssl->ssl = SSL_new(ssl->ctx);
@@ -486,18 +703,43 @@ static bool open_(qhttpclient_t *client) {
         }
 
         // set options
+        SSL_set_app_data(ssl->ssl, client);
         SSL_set_connect_state(ssl->ssl);
+        if (inet_addr(client->hostname) == INADDR_NONE) {
+            // server name indication, not for IP address
+            SSL_set_tlsext_host_name(ssl->ssl, client->hostname);
+        }
+
+        // resume the last session with the host for abbreviated handshake
+        _ssl_getsession(client, ssl->ssl);
 
         // handshake
         if (SSL_connect(ssl->ssl) != 1) {
             DEBUG("OpenSSL: %s", ERR_reason_error_string(ERR_get_error()));
+            _ssl_putsession(client, NULL);
             _close(client);
             return false;
         }
 
-        DEBUG("ssl initialized");
+        DEBUG("ssl initialized%s",
+              (SSL_session_reused(ssl->ssl)) ? " (resumed)" : "");
+    }
+#endif
+
+    // create a buffered reader of the connection
+#ifdef ENABLE_OPENSSL
+    if (client->ssl != NULL) {
+        client->reader = qio_reader_custom(_ssl_read, client->ssl, 0);
+    } else {
+        client->reader = qio_reader(client->socket, 0);
     }
+#else
+    client->reader = qio_reader(client->socket, 0);
 #endif
+    if (client->reader == NULL) {
+        _close(client);
+        return false;
+    }
 
     return true;
 }
@@ -583,12 +825,7 @@ static bool head(qhttpclient_t *client, const char *uri, int *rescode,
     if (rescode != NULL)
         *rescode = resno;
 
-    // throw out content
-    if (clength > 0) {
-        if (read_(client, NULL, clength) != clength) {
-            _close(client);
-        }
-    }
+    // a response to HEAD never has content, Content-Length is of GET's.
 
     // close connection if required
     if (client->keepalive == false || client->connclose == true) {
@@ -1110,7 +1347,9 @@ static void *cmd(qhttpclient_t *client, const char *method, const char *uri,
         freeReqHeaders = true;
     }
 
-    bool sendret = sendrequest(client, method, uri, reqheaders);
+    // request and data go out together
+    bool sendret = _sendrequest(client, method, uri, reqheaders, data,
+                                (data != NULL) ? size : 0);
     if (freeReqHeaders == true) {
         reqheaders->free(reqheaders);
         reqheaders = NULL;
@@ -1120,15 +1359,6 @@ static void *cmd(qhttpclient_t *client, const char *method, const char *uri,
         return NULL;
     }
 
-    // send data
-    if (data != NULL && size > 0) {
-        ssize_t written = write_(client, data, size);
-        if (written != size) {
-            _close(client);
-            return NULL;
-        }
-    }
-
     // read response
     off_t clength = 0;
     int resno = readresponse(client, resheaders, &clength);
@@ -1140,19 +1370,19 @@ static void *cmd(qhttpclient_t *client, const char *method, const char *uri,
     // malloc data
     void *content = NULL;
     if (clength > 0) {
-        content = malloc(clength + 1);
+        content = qlibc_malloc(clength + 1);
         if (content != NULL) {
             if (read_(client, content, clength) == clength) {
                 *(char *) (content + clength) = '\0';
             } else {
-                free(content);
+                qlibc_free(content);
                 content = NULL;
                 _close(client);
             }
         }
     } else {
         // succeed. to distinguish between ok and error
-        content = strdup("");
+        content = qlibc_strdup("");
     }
 
     // close connection
@@ -1164,95 +1394,336 @@ static void *cmd(qhttpclient_t *client, const char *method, const char *uri,
 }
 
 /**
- * qhttpclient->sendrequest(): Sends a HTTP request to the remote host.
+ * qhttpclient->pipeline(): Queues a request to be pipelined.
  *
- * @param client    qhttpclient object pointer
- * @param method    HTTP method name
- * @param uri       URI string for the method. ("/path" or "http://.../path")
+ * @param client        qhttpclient object pointer.
+ * @param method        HTTP method name. (GET, HEAD...)
+ * @param uri           URI string for the method. ("/path" or "http://.../path")
  * @param reqheaders    qlisttbl_t pointer which contains additional user
  *                      request headers. (can be NULL)
+ * @param callback      function called with the response in request order.
+ * @param userdata      data pointer passed to callback.
  *
  * @return true if successful, otherwise returns false
  *
- * @note
- *  Default headers(Host, User-Agent, Connection) will be used if reqheaders
- *  does not have those headers in it.
- *
  * @code
- *   qlisttbl_t *reqheaders = qlisttbl(QLISTTBL_UNIQUE | QLISTTBL_CASEINSENSITIVE);
- *   reqheaders->putstr(reqheaders,  "Date", qTimeGetGmtStaticStr(0), true);
+ *   void done(void *userdata, int rescode, qlisttbl_t *resheaders,
+ *             void *content, size_t contentslength) {
+ *     printf("%s: %d, %zu bytes\n", (char *)userdata, rescode,
+ *            contentslength);
+ *   }
  *
- *   httpclient->sendrequest(client,
- *                           "DELETE", "/img/qdecoder.png", reqheaders);
+ *   httpclient->setkeepalive(httpclient, true);
+ *   httpclient->pipeline(httpclient, "HEAD", "/a.html", NULL, done, "a");
+ *   httpclient->pipeline(httpclient, "GET", "/b.html", NULL, done, "b");
+ *   httpclient->pipeline(httpclient, "GET", "/c.html", NULL, done, "c");
+ *   httpclient->flush(httpclient);
  * @endcode
+ *
+ * @note
+ *  Requests are only sent by flush(). Pipelining is meant for requests
+ *  without body like GET and HEAD. Default headers are added into
+ *  reqheaders the same way as sendrequest() does.
  */
-static bool sendrequest(qhttpclient_t *client, const char *method,
-                        const char *uri, qlisttbl_t *reqheaders) {
-    if (open_(client) == false) {
+static bool pipeline(qhttpclient_t *client, const char *method,
+                     const char *uri, qlisttbl_t *reqheaders,
+                     void (*callback)(void *userdata, int rescode,
+                                      qlisttbl_t *resheaders, void *content,
+                                      size_t contentslength),
+                     void *userdata) {
+    if (method == NULL || uri == NULL || callback == NULL) {
+        errno = EINVAL;
+        return false;
+    }
+
+    if (client->queue == NULL) {
+        client->queue = qlist(0);
+        if (client->queue == NULL)
+            return false;
+    }
+
+    qstrbuf_t *outBuf = _buildrequest(client, method, uri, reqheaders);
+    if (outBuf == NULL)
+        return false;
+
+    struct qhttpclient_pipereq_s req;
+    memset((void *) &req, 0, sizeof(req));
+    req.head = outBuf->steal(outBuf, &req.headlen);
+    outBuf->free(outBuf);
+    if (req.head == NULL)
+        return false;
+    req.nobody = (strcasecmp(method, "HEAD") == 0);
+    req.callback = callback;
+    req.userdata = userdata;
+
+    qlist_t *queue = client->queue;
+    if (queue->addlast(queue, &req, sizeof(req)) == false) {
+        qlibc_free(req.head);
         return false;
     }
+    return true;
+}
+
+/**
+ * qhttpclient->flush(): Sends queued requests back-to-back and reads the
+ * responses.
+ *
+ * @param client        qhttpclient object pointer.
+ *
+ * @return the number of requests got response.
+ *
+ * @note
+ *  Up to MAX_PIPELINE_DEPTH requests are written at once on a keep-alive
+ *  connection, then the responses are read in order and given to the
+ *  callback of each request. When the server closes the connection in the
+ *  middle, requests not answered yet are sent again on a new connection.
+ *  A request which can't be answered on a fresh connection is given to its
+ *  callback with rescode 0 and errno set.
+ *
+ *  Without keep-alive, requests are sent one by one.
+ */
+static int flush(qhttpclient_t *client) {
+    qlist_t *queue = client->queue;
+    if (queue == NULL)
+        return 0;
+
+    int done = 0;
+    while (queue->size(queue) > 0) {
+        bool reused = (client->socket >= 0);
+        if (open_(client) == false) {
+            _pipeline_fail(client, (errno != 0) ? errno : ECONNREFUSED);
+            break;
+        }
+
+        // send a window of requests at once.
+        size_t depth = (client->keepalive == true) ? MAX_PIPELINE_DEPTH : 1;
+        size_t num = queue->size(queue);
+        if (num > depth)
+            num = depth;
+
+        struct iovec iov[MAX_PIPELINE_DEPTH];
+        size_t towrite = 0, i;
+        for (i = 0; i < num; i++) {
+            struct qhttpclient_pipereq_s *req = queue->getat(queue, i, NULL,
+                                                             false);
+            iov[i].iov_base = req->head;
+            iov[i].iov_len = req->headlen;
+            towrite += req->headlen;
+        }
+        ssize_t written = _writev(client, iov, num);
+
+        // read responses in order.
+        size_t answered = 0;
+        while (written == towrite && answered < num) {
+            struct qhttpclient_pipereq_s *req = queue->getfirst(queue, NULL,
+                                                                false);
+            qlisttbl_t *resheaders = qlisttbl(
+                    QLISTTBL_UNIQUE | QLISTTBL_CASEINSENSITIVE);
+            if (resheaders == NULL)
+                break;
+
+            off_t clength = 0;
+            int rescode;
+            while ((rescode = readresponse(client, resheaders, &clength))
+                    == HTTP_CODE_CONTINUE) {
+                resheaders->clear(resheaders);
+            }
+
+            size_t size = 0;
+            void *content = NULL;
+            if (rescode != HTTP_NO_RESPONSE) {
+                bool nobody = (req->nobody == true
+                        || rescode == HTTP_CODE_NO_CONTENT
+                        || rescode == HTTP_CODE_NOT_MODIFIED);
+                content = _readcontent(client, resheaders, clength, nobody,
+                                       &size);
+            }
+            if (content == NULL) {
+                resheaders->free(resheaders);
+                break;
+            }
+
+            struct qhttpclient_pipereq_s *popped = queue->popfirst(queue,
+                                                                   NULL);
+            popped->callback(popped->userdata, rescode, resheaders, content,
+                             size);
+            qlibc_free(content);
+            resheaders->free(resheaders);
+            qlibc_free(popped->head);
+            qlibc_free(popped);
+            answered++;
+            done++;
+
+            if (client->connclose == true)
+                break;
+        }
+
+        if (answered < num || client->connclose == true
+                || client->keepalive == false) {
+            _close(client);
+        }
+
+        // a fresh connection must answer at least one request.
+        if (answered == 0 && reused == false) {
+            struct qhttpclient_pipereq_s *req = queue->popfirst(queue, NULL);
+            errno = ECONNRESET;
+            req->callback(req->userdata, HTTP_NO_RESPONSE, NULL, NULL, 0);
+            qlibc_free(req->head);
+            qlibc_free(req);
+        }
+    }
+
+    return done;
+}
+
+/**
+ * qhttpclient->stream(): Sends a request and streams the response body to a
+ * callback as it arrives.
+ *
+ * @param client        qhttpclient object pointer.
+ * @param method        HTTP method name.
+ * @param uri           URI string for the method. ("/path" or "http://.../path")
+ * @param data          data to send. (can be NULL)
+ * @param size          data size.
+ * @param rescode       if not NULL, remote response code will be stored.
+ *                      (can be NULL)
+ * @param reqheaders    qlisttbl_t pointer which contains additional user
+ *                      request headers. (can be NULL)
+ * @param resheaders    qlisttbl_t pointer for storing response headers.
+ *                      (can be NULL)
+ * @param callback      function called with each piece of body. return false
+ *                      to stop.
+ * @param userdata      data pointer passed to callback.
+ *
+ * @return true if the whole response body is delivered, otherwise returns
+ *         false. Check rescode for the response code.
+ *
+ * @code
+ *   bool savefile(void *userdata, const void *data, size_t size) {
+ *     return (qio_write(*(int *)userdata, data, size, -1) == size);
+ *   }
+ *
+ *   int fd = open("/tmp/big.iso", O_CREAT | O_TRUNC | O_WRONLY, 0644);
+ *   int rescode = 0;
+ *   httpclient->stream(httpclient, "GET", "/big.iso", NULL, 0, &rescode,
+ *                      NULL, NULL, savefile, &fd);
+ * @endcode
+ *
+ * @note
+ *  Memory use doesn't grow with body size. Chunked transfer-encoding is
+ *  decoded and, when compiled with --with-zlib, gzip or deflate
+ *  content-encoding is inflated, so callback gets the original content. In
+ *  that case "Accept-Encoding: gzip, deflate" is sent if reqheaders has no
+ *  Accept-Encoding header.
+ */
+static bool stream(qhttpclient_t *client, const char *method,
+                   const char *uri, const void *data, size_t size,
+                   int *rescode, qlisttbl_t *reqheaders,
+                   qlisttbl_t *resheaders,
+                   bool (*callback)(void *userdata, const void *data,
+                                    size_t size),
+                   void *userdata) {
+    if (rescode != NULL)
+        *rescode = 0;
 
     // generate request headers if necessary
     bool freeReqHeaders = false;
     if (reqheaders == NULL) {
-        reqheaders = qlisttbl(
-                QLISTTBL_UNIQUE | QLISTTBL_CASEINSENSITIVE);
+        reqheaders = qlisttbl(QLISTTBL_UNIQUE | QLISTTBL_CASEINSENSITIVE);
         if (reqheaders == NULL)
             return false;
         freeReqHeaders = true;
     }
-
-    // append default headers
-    if (reqheaders->get(reqheaders, "Host", NULL, false) == NULL) {
-        reqheaders->putstrf(reqheaders, "Host", "%s:%d", client->hostname,
-                            client->port);
-    }
-    if (reqheaders->get(reqheaders, "User-Agent", NULL, false) == NULL) {
-        reqheaders->putstr(reqheaders, "User-Agent", client->useragent);
+#ifdef ENABLE_ZLIB
+    if (reqheaders->get(reqheaders, "Accept-Encoding", NULL, false) == NULL) {
+        reqheaders->putstr(reqheaders, "Accept-Encoding", "gzip, deflate");
     }
-    if (reqheaders->get(reqheaders, "Connection", NULL, false) == NULL) {
-        reqheaders->putstr(
-                reqheaders, "Connection",
-                (client->keepalive == true) ? "Keep-Alive" : "close");
+#endif
+    if (data != NULL && size > 0
+            && reqheaders->get(reqheaders, "Content-Length", NULL, false)
+                    == NULL) {
+        reqheaders->putstrf(reqheaders, "Content-Length", "%zu", size);
     }
 
-    // create stream buffer
-    qvector_t *outBuf = qvector(0);
-    if (outBuf == NULL)
+    // send request
+    bool sendret = _sendrequest(client, method, uri, reqheaders, data,
+                                (data != NULL) ? size : 0);
+    if (freeReqHeaders == true)
+        reqheaders->free(reqheaders);
+    if (sendret == false) {
+        _close(client);
         return false;
+    }
 
-    // buffer out command
-    outBuf->addstrf(outBuf, "%s %s %s\r\n", method, uri,
-    HTTP_PROTOCOL_11);
+    // response headers are needed to decode the body.
+    bool freeResHeaders = false;
+    if (resheaders == NULL) {
+        resheaders = qlisttbl(QLISTTBL_UNIQUE | QLISTTBL_CASEINSENSITIVE);
+        if (resheaders == NULL) {
+            _close(client);
+            return false;
+        }
+        freeResHeaders = true;
+    }
 
-    // buffer out headers
-    qdlnobj_t obj;
-    memset((void *) &obj, 0, sizeof(obj));  // must be cleared before call
-    reqheaders->lock(reqheaders);
-    while (reqheaders->getnext(reqheaders, &obj, NULL, false) == true) {
-        outBuf->addstrf(outBuf, "%s: %s\r\n", obj.name, (char *) obj.data);
+    // read response
+    off_t clength = 0;
+    int resno;
+    while ((resno = readresponse(client, resheaders, &clength))
+            == HTTP_CODE_CONTINUE) {
+        resheaders->clear(resheaders);
     }
-    reqheaders->unlock(reqheaders);
+    if (rescode != NULL)
+        *rescode = resno;
 
-    outBuf->addstrf(outBuf, "\r\n");
+    bool ret = false;
+    if (resno != HTTP_NO_RESPONSE) {
+        if (!strcasecmp(method, "HEAD") || resno == HTTP_CODE_NO_CONTENT
+                || resno == HTTP_CODE_NOT_MODIFIED) {
+            ret = true;
+        } else {
+            ret = (readbody(client, resheaders, clength, callback, userdata)
+                    >= 0);
+        }
+    }
+    if (freeResHeaders == true)
+        resheaders->free(resheaders);
 
-    // stream out
-    size_t towrite = 0;
-    char *final = outBuf->toarray(outBuf, &towrite);
-    ssize_t written = 0;
-    if (final != NULL) {
-        written = write_(client, final, towrite);
-        free(final);
+    // close connection if required
+    if (ret == false || client->keepalive == false
+            || client->connclose == true) {
+        _close(client);
     }
 
-    // de-allocate
-    outBuf->free(outBuf);
-    if (freeReqHeaders == true)
-        reqheaders->free(reqheaders);
+    return ret;
+}
 
-    if (written > 0 && written == towrite)
-        return true;
-    return false;
+/**
+ * qhttpclient->sendrequest(): Sends a HTTP request to the remote host.
+ *
+ * @param client    qhttpclient object pointer
+ * @param method    HTTP method name
+ * @param uri       URI string for the method. ("/path" or "http://.../path")
+ * @param reqheaders    qlisttbl_t pointer which contains additional user
+ *                      request headers. (can be NULL)
+ *
+ * @return true if successful, otherwise returns false
+ *
+ * @note
+ *  Default headers(Host, User-Agent, Connection) will be used if reqheaders
+ *  does not have those headers in it.
+ *
+ * @code
+ *   qlisttbl_t *reqheaders = qlisttbl(QLISTTBL_UNIQUE | QLISTTBL_CASEINSENSITIVE);
+ *   reqheaders->putstr(reqheaders,  "Date", qTimeGetGmtStaticStr(0), true);
+ *
+ *   httpclient->sendrequest(client,
+ *                           "DELETE", "/img/qdecoder.png", reqheaders);
+ * @endcode
+ */
+static bool sendrequest(qhttpclient_t *client, const char *method,
+                        const char *uri, qlisttbl_t *reqheaders) {
+    return _sendrequest(client, method, uri, reqheaders, NULL, 0);
 }
 
 /**
@@ -1297,56 +1768,132 @@ static int readresponse(qhttpclient_t *client, qlisttbl_t *resheaders,
         return HTTP_NO_RESPONSE;
 
     // parse response code
-    if (strncmp(buf, "HTTP/", CONST_STRLEN("HTTP/")))
-        return HTTP_NO_RESPONSE;
-    char *tmp = strstr(buf, " ");
-    if (tmp == NULL)
-        return HTTP_NO_RESPONSE;
-    int rescode = atoi(tmp + 1);
-    if (rescode == 0)
+    int rescode = _parse_statusline(buf);
+    if (rescode == HTTP_NO_RESPONSE)
         return HTTP_NO_RESPONSE;
 
     // read headers
     while (gets_(client, buf, sizeof(buf)) > 0) {
         if (buf[0] == '\0')
             break;
+        _parse_header(buf, resheaders, contentlength, &client->connclose);
+    }
 
-        // parse header
-        char *name = buf;
-        char *value = strstr(buf, ":");
-        if (value != NULL) {
-            *value = '\0';
-            value += 1;
-            qstrtrim(value);
-        } else {
-            // missing colon
-            value = "";
-        }
-
-        if (resheaders != NULL) {
-            resheaders->putstr(resheaders, name, value);
-        }
+    return rescode;
+}
 
-        // check Connection header
-        if (!strcasecmp(name, "Connection")) {
-            if (!strcasecmp(value, "close")) {
-                client->connclose = true;
-            }
-        }
-        // check Content-Length & Transfer-Encoding header
-        else if (contentlength != NULL && *contentlength == 0) {
-            if (!strcasecmp(name, "Content-Length")) {
-                *contentlength = atoll(value);
-            }
-            // check transfer-encoding header
-            else if (!strcasecmp(name, "Transfer-Encoding")
-                    && !strcasecmp(value, "chunked")) {
-                *contentlength = -1;
+/**
+ * qhttpclient->readbody(): Reads a response body and delivers it to a
+ * callback piece by piece.
+ *
+ * @param client        qhttpclient object pointer
+ * @param resheaders    response headers from readresponse(). it's used for
+ *                      content decoding. (can be NULL)
+ * @param contentlength content length from readresponse(). -1 for chunked
+ *                      transfer encoding.
+ * @param callback      function called with each piece of body. return false
+ *                      to stop.
+ * @param userdata      data pointer passed to callback.
+ *
+ * @return the number of bytes given to callback if the whole body is read,
+ *         otherwise returns -1 and the connection is closed.
+ *
+ * @code
+ *   off_t clength = 0;
+ *   qlisttbl_t *resheaders = qlisttbl(QLISTTBL_CASEINSENSITIVE);
+ *   int resno = client->readresponse(client, resheaders, &clength);
+ *   client->readbody(client, resheaders, clength, savefile, &fd);
+ * @endcode
+ *
+ * @note
+ *  A body without length is read until the server closes the connection
+ *  when the server said "Connection: close". When compiled with --with-zlib
+ *  and resheaders has "Content-Encoding: gzip" or "deflate", the body is
+ *  inflated on the fly.
+ */
+static off_t readbody(qhttpclient_t *client, qlisttbl_t *resheaders,
+                      off_t contentlength,
+                      bool (*callback)(void *userdata, const void *data,
+                                       size_t size),
+                      void *userdata) {
+    struct qhttpclient_sink_s sink;
+    if (callback == NULL
+            || _sink_init(&sink, resheaders, callback, userdata) == false) {
+        return -1;
+    }
+
+    unsigned char buf[MAX_ATOMIC_DATA_SIZE];
+    bool completed = false;
+    if (contentlength > 0) {
+        off_t recv = 0;
+        while (recv < contentlength) {
+            size_t toread = sizeof(buf);
+            if (contentlength - recv < toread)
+                toread = contentlength - recv;
+            ssize_t rsize = read_(client, buf, toread);
+            if (rsize <= 0 || _sink_write(&sink, buf, rsize) == false)
+                break;
+            recv += rsize;
+        }
+        completed = (recv == contentlength);
+    } else if (contentlength == -1) {  // chunked
+        char line[64];
+        while (gets_(client, line, sizeof(line)) > 0) {
+            // parse chunk size
+            char *end = NULL;
+            off_t left = strtol(line, &end, 16);
+            if (end == line || left < 0)
+                break;
+            if (left == 0) {
+                // skip trailer
+                while (gets_(client, line, sizeof(line)) > 0
+                        && line[0] != '\0');
+                completed = true;
+                break;
+            }
+
+            // deliver chunk
+            while (left > 0) {
+                size_t toread = sizeof(buf);
+                if (left < toread)
+                    toread = left;
+                ssize_t rsize = read_(client, buf, toread);
+                if (rsize <= 0 || _sink_write(&sink, buf, rsize) == false)
+                    break;
+                left -= rsize;
+            }
+
+            // read tailing CRLF
+            if (left > 0 || gets_(client, line, sizeof(line)) <= 0)
+                break;
+        }
+    } else if (client->connclose == true
+            && (resheaders == NULL
+                    || resheaders->get(resheaders, "Content-Length", NULL,
+                                       false) == NULL)) {
+        // until the server closes the connection
+        completed = true;
+        ssize_t rsize;
+        while ((rsize = read_(client, buf, sizeof(buf))) > 0) {
+            if (_sink_write(&sink, buf, rsize) == false) {
+                completed = false;
+                break;
             }
         }
+    } else {
+        completed = true;
     }
 
-    return rescode;
+    if (completed == true)
+        completed = _sink_end(&sink);
+    off_t total = sink.total;
+    _sink_free(&sink);
+
+    if (completed == false) {
+        _close(client);
+        return -1;
+    }
+    return total;
 }
 
 /**
@@ -1365,48 +1912,9 @@ static int readresponse(qhttpclient_t *client, qlisttbl_t *resheaders,
  *  characters will be counted, but not stored.
  */
 static ssize_t gets_(qhttpclient_t *client, char *buf, size_t bufsize) {
-#ifdef ENABLE_OPENSSL
-    if (client->ssl == NULL) {
-        return qio_gets(client->socket, buf, bufsize, client->timeoutms);
-    } else {
-        if (bufsize <= 1) return -1;
-
-        struct SslConn *ssl = client->ssl;
-        ssize_t readcnt = 0;
-        char *ptr;
-
-        for (ptr = buf; readcnt < (bufsize - 1); ptr++) {
-            // wait readable
-            //if (qio_wait_readable(client->socket, client->timeoutms) <= 0) {
-            //    break;
-            //}
-
-            int rsize = SSL_read(ssl->ssl, ptr, 1);
-            if (rsize != 1) {
-                unsigned long sslerr = ERR_get_error();
-                if (sslerr == SSL_ERROR_WANT_READ) {
-                    continue;
-                }
-
-                DEBUG("OpenSSL: %s (%d)",
-                        ERR_reason_error_string(sslerr), rsize);
-                break;
-            }
-
-            readcnt++;
-            if (*ptr == '\r') ptr--;
-            else if (*ptr == '\n') break;
-        }
-
-        *ptr = '\0';
-        DEBUG("SSL_read: %s (%zd)", buf, readcnt);
-
-        if (readcnt > 0) return readcnt;
+    if (client->reader == NULL)
         return -1;
-    }
-#else
-    return qio_gets(client->socket, buf, bufsize, client->timeoutms);
-#endif
+    return qio_reader_gets(client->reader, buf, bufsize, client->timeoutms);
 }
 
 /**
@@ -1429,48 +1937,9 @@ static ssize_t gets_(qhttpclient_t *client, char *buf, size_t bufsize) {
  * @endcode
  */
 static ssize_t read_(qhttpclient_t *client, void *buf, size_t nbytes) {
-#ifdef ENABLE_OPENSSL
-    if (client->ssl == NULL) {
-        return qio_read(client->socket, buf, nbytes, client->timeoutms);
-    } else {
-        if (nbytes == 0) return 0;
-
-        struct SslConn *ssl = client->ssl;
-        ssize_t total = 0;
-        while (total < nbytes) {
-            //if (qio_wait_readable(client->socket, client->timeoutms) <= 0) {
-            //    break;
-            //}
-
-            int rsize = 0;
-            if (buf != NULL) {
-                rsize = SSL_read(ssl->ssl, buf + total, nbytes - total);
-            } else {
-                char trash[1024];
-                int toread = nbytes - total;
-                if (toread > sizeof(trash)) toread = sizeof(trash);
-                rsize = SSL_read(ssl->ssl, trash, toread);
-            }
-            if (rsize <= 0) {
-                DEBUG("OpenSSL: %s (%d)",
-                        ERR_reason_error_string(ERR_get_error()), rsize);
-                unsigned long sslerr = ERR_get_error();
-                if (sslerr == SSL_ERROR_WANT_READ) {
-                    usleep(1);
-                    continue;
-                }
-                break;
-            }
-            total += rsize;
-        }
-
-        DEBUG("SSL_read: %zd", total);
-        if (total > 0) return total;
+    if (client->reader == NULL)
         return -1;
-    }
-#else
-    return qio_read(client->socket, buf, nbytes, client->timeoutms);
-#endif
+    return qio_reader_read(client->reader, buf, nbytes, client->timeoutms);
 }
 
 /**
@@ -1529,34 +1998,13 @@ static ssize_t write_(qhttpclient_t *client, const void *buf, size_t nbytes) {
 static off_t recvfile(qhttpclient_t *client, int fd, off_t nbytes) {
     if (nbytes == 0)
         return 0;
+    if (client->reader == NULL)
+        return -1;
 
-    unsigned char buf[MAX_ATOMIC_DATA_SIZE];
-
-    off_t total = 0;  // total size sent
-    while (total < nbytes) {
-        size_t chunksize;  // this time sending size
-        if (nbytes - total <= sizeof(buf))
-            chunksize = nbytes - total;
-        else
-            chunksize = sizeof(buf);
-
-        // read
-        ssize_t rsize = read_(client, buf, chunksize);
-        if (rsize <= 0)
-            break;
-
-        // write
-        ssize_t wsize = qio_write(fd, buf, rsize, -1);
-        DEBUG("FILE write: %zd", wsize);
-        if (wsize <= 0)
-            break;
-
-        total += wsize;
-        if (rsize != wsize) {
-            DEBUG("size mismatch. read:%zd, write:%zd", rsize, wsize);
-            break;
-        }
-    }
+    // buffered data first, then straight from the socket unless it's SSL.
+    off_t total = qio_reader_send(client->reader, fd, nbytes,
+                                  client->timeoutms);
+    DEBUG("FILE write: %jd", total);
 
     if (total > 0)
         return total;
@@ -1571,11 +2019,25 @@ static off_t recvfile(qhttpclient_t *client, int fd, off_t nbytes) {
  * @param   nbytes      the number of bytes to read and send.
  *
  * @return the number of bytes sent if successful, otherwise returns -1.
+ *
+ * @note
+ *  Plain HTTP connections send the data by qio_send(), which doesn't copy
+ *  it to user space where the kernel supports it.
  */
 static off_t sendfile_(qhttpclient_t *client, int fd, off_t nbytes) {
     if (nbytes == 0)
         return 0;
 
+#ifdef ENABLE_OPENSSL
+    if (client->ssl == NULL) {
+        off_t sent = qio_send(client->socket, fd, nbytes, -1);
+        return (sent > 0) ? sent : -1;
+    }
+#else
+    off_t sent = qio_send(client->socket, fd, nbytes, -1);
+    return (sent > 0) ? sent : -1;
+#endif
+
     unsigned char buf[MAX_ATOMIC_DATA_SIZE];
 
     off_t total = 0;  // total size sent
@@ -1635,10 +2097,8 @@ static bool _close(qhttpclient_t *client) {
             ssl->ssl = NULL;
         }
 
-        if (ssl->ctx != NULL) {
-            SSL_CTX_free(ssl->ctx);
-            ssl->ctx = NULL;
-        }
+        // the context is shared
+        ssl->ctx = NULL;
     }
 #endif
 
@@ -1649,6 +2109,12 @@ static bool _close(qhttpclient_t *client) {
         while (qio_read(client->socket, buf, sizeof(buf), MAX_SHUTDOWN_WAIT) > 0);
     }
 
+    // release reader
+    if (client->reader != NULL) {
+        qio_reader_free(client->reader);
+        client->reader = NULL;
+    }
+
     // close connection
     close(client->socket);
     client->socket = -1;
@@ -1664,7 +2130,8 @@ static bool _close(qhttpclient_t *client) {
  *
  * @note
  *  If the connection was not closed, it will close the connection first prior
- *  to de-allocate object.
+ *  to de-allocate object. Requests pipelined but not flushed are given to
+ *  their callbacks with ECANCELED.
  *
  * @code
  *   httpclient->free(httpclient);
@@ -1675,74 +2142,1583 @@ static void _free(qhttpclient_t *client) {
         client->close(client);
     }
 
+    if (client->queue != NULL) {
+        _pipeline_fail(client, ECANCELED);
+        qlist_t *queue = client->queue;
+        queue->free(queue);
+    }
+
     if (client->ssl != NULL)
-        free(client->ssl);
+        qlibc_free(client->ssl);
     if (client->hostname != NULL)
-        free(client->hostname);
+        qlibc_free(client->hostname);
     if (client->useragent != NULL)
-        free(client->useragent);
+        qlibc_free(client->useragent);
 
-    free(client);
+    qlibc_free(client);
 }
 
-#ifndef _DOXYGEN_SKIP
-static bool _set_socket_option(int socket) {
-    bool ret = true;
+/**
+ * Create a pool of keep-alive HTTP client connections.
+ *
+ * @param maxperhost    maximum number of connections per host:port, 0 for
+ *                      unlimited.
+ * @param idletimeoutms idle connections older than this are closed instead
+ *                      of reused. 0 for no limit.
+ *
+ * @return qhttpclient_pool_t object pointer if successful, otherwise returns
+ *         NULL.
+ * @retval errno will be set in error condition.
+ *  - ENOMEM : Memory allocation failure.
+ *
+ * @code
+ *   qhttpclient_pool_t *pool = qhttpclient_pool(8, 30000);
+ *
+ *   // in any thread
+ *   qhttpclient_t *client = pool->get(pool, "www.qdecoder.org", 443, true,
+ *                                     1000);
+ *   if (client != NULL) {
+ *     client->get(client, "/robots.txt", fd, NULL, &rescode, NULL, NULL,
+ *                 NULL, NULL);
+ *     pool->release(pool, client);
+ *   }
+ *
+ *   pool->free(pool);
+ * @endcode
+ *
+ * @note
+ *  A connection is checked out to one caller at a time so client objects
+ *  don't need to be locked. Connections on the same host:port are shared
+ *  between SSL and plain requests separately. An idle connection is checked
+ *  on checkout and dropped when it's expired, the remote closed it or it
+ *  has unexpected data pending.
+ */
+qhttpclient_pool_t *qhttpclient_pool(int maxperhost, int idletimeoutms) {
+    qhttpclient_pool_t *pool = (qhttpclient_pool_t *) qlibc_calloc(
+            1, sizeof(qhttpclient_pool_t));
+    if (pool == NULL) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    if (pthread_mutex_init(&pool->mutex, NULL) != 0) {
+        qlibc_free(pool);
+        errno = ENOMEM;
+        return NULL;
+    }
+    if (pthread_cond_init(&pool->cond, NULL) != 0) {
+        pthread_mutex_destroy(&pool->mutex);
+        qlibc_free(pool);
+        errno = ENOMEM;
+        return NULL;
+    }
+    pool->maxperhost = (maxperhost > 0) ? maxperhost : 0;
+    pool->idletimeoutms = (idletimeoutms > 0) ? idletimeoutms : 0;
+
+    // member methods
+    pool->get = pool_get;
+    pool->release = pool_release;
+    pool->size = pool_size;
+    pool->clear = pool_clear;
+    pool->free = pool_free;
+
+    return pool;
+}
+
+/**
+ * qhttpclient_pool->get(): Check out a connection to a host.
+ *
+ * @param pool      qhttpclient_pool_t object pointer.
+ * @param hostname  remote IP or FQDN domain name. (not URI)
+ * @param port      remote port number
+ * @param ssl       true for HTTPS connection.
+ * @param timeoutms wait timeout milliseconds when the host is at maximum
+ *                  connections. 0 for no wait, -1 for infinite wait.
+ *
+ * @return qhttpclient_t object with keep-alive turned on if successful,
+ *         otherwise returns NULL.
+ * @retval errno will be set in error condition.
+ *  - EINVAL    : Invalid argument.
+ *  - ETIMEDOUT : All connections of the host are in use.
+ *  - ENOMEM    : Memory allocation failure.
+ *  - ENOTSUP   : SSL is requested but not compiled in.
+ *
+ * @note
+ *  A reused connection is returned already connected. A new one connects on
+ *  its first request as usual. The returned client must be given back with
+ *  release() and not be freed.
+ */
+static qhttpclient_t *pool_get(qhttpclient_pool_t *pool, const char *hostname,
+                               int port, bool ssl, int timeoutms) {
+    if (hostname == NULL || port <= 0 || strstr(hostname, "://") != NULL) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    struct timespec deadline;
+    memset((void *) &deadline, 0, sizeof(deadline));
+    if (timeoutms > 0) {
+        long expire = qtime_monotonic_coarse_ms() + timeoutms;
+        deadline.tv_sec = expire / 1000;
+        deadline.tv_nsec = (expire % 1000) * 1000000;
+    }
+
+    while (true) {
+        qhttpclient_t *client = NULL;
+        long since = 0;
+
+        pthread_mutex_lock(&pool->mutex);
+        struct qhttpclient_poolhost_s *host = _pool_host(pool, hostname, port,
+                                                         ssl, true);
+        if (host == NULL) {
+            pthread_mutex_unlock(&pool->mutex);
+            errno = ENOMEM;
+            return NULL;
+        }
+        if (host->nidle > 0) {
+            // most recently used first, it's least likely to be expired.
+            host->nidle--;
+            client = host->idle[host->nidle].client;
+            since = host->idle[host->nidle].since;
+        } else if (pool->maxperhost == 0 || host->num < pool->maxperhost) {
+            host->num++;
+        } else {
+            int ret = 0;
+            if (timeoutms < 0) {
+                ret = pthread_cond_wait(&pool->cond, &pool->mutex);
+            } else if (timeoutms == 0) {
+                ret = ETIMEDOUT;
+            } else {
+                ret = pthread_cond_timedwait(&pool->cond, &pool->mutex,
+                                             &deadline);
+            }
+            pthread_mutex_unlock(&pool->mutex);
+            if (ret == ETIMEDOUT) {
+                errno = ETIMEDOUT;
+                return NULL;
+            }
+            continue;
+        }
+        pthread_mutex_unlock(&pool->mutex);
+
+        // health-check an idle connection out of the lock.
+        if (client != NULL) {
+            if (_pool_isalive(pool, client, since) == true)
+                return client;
+            DEBUG("drop idle connection to %s:%d", hostname, port);
+            _pool_drop(pool, client);
+            continue;
+        }
 
-    // linger option
-    if (SET_TCP_LINGER_TIMEOUT > 0) {
-        struct linger li;
-        li.l_onoff = 1;
-        li.l_linger = SET_TCP_LINGER_TIMEOUT;
-        if (setsockopt(socket, SOL_SOCKET, SO_LINGER, &li,
-                       sizeof(struct linger)) < 0) {
-            ret = false;
+        // create a new one
+        client = qhttpclient(hostname, port);
+        if (client != NULL) {
+            client->setkeepalive(client, true);
+            if (ssl == true && client->setssl(client) == false) {
+                client->free(client);
+                client = NULL;
+                errno = ENOTSUP;
+            }
+        }
+        if (client == NULL) {
+            int err = errno;
+            pthread_mutex_lock(&pool->mutex);
+            host->num--;
+            pthread_cond_broadcast(&pool->cond);
+            pthread_mutex_unlock(&pool->mutex);
+            errno = err;
         }
+        return client;
+    }
+}
+
+/**
+ * qhttpclient_pool->release(): Give back a connection checked out by get().
+ *
+ * @param pool      qhttpclient_pool_t object pointer.
+ * @param client    qhttpclient_t object from get().
+ *
+ * @note
+ *  The connection is kept idle for the next get() on the same host if it's
+ *  still reusable. It's closed when the server asked to close it or there's
+ *  unread response data left on it.
+ */
+static void pool_release(qhttpclient_pool_t *pool, qhttpclient_t *client) {
+    if (client == NULL)
+        return;
+
+    bool reusable = (client->socket >= 0 && client->keepalive == true
+            && client->connclose == false
+            && (client->reader == NULL
+                    || qio_reader_pending(client->reader) == 0));
+
+    pthread_mutex_lock(&pool->mutex);
+    struct qhttpclient_poolhost_s *host = _pool_host(pool, client->hostname,
+                                                     client->port,
+                                                     (client->ssl != NULL),
+                                                     false);
+    if (host != NULL && reusable == true) {
+        host->idle[host->nidle].client = client;
+        host->idle[host->nidle].since = qtime_monotonic_coarse_ms();
+        host->nidle++;
+        client = NULL;
+    }
+    pthread_cond_broadcast(&pool->cond);
+    pthread_mutex_unlock(&pool->mutex);
+
+    if (client != NULL)
+        _pool_drop(pool, client);
+}
+
+/**
+ * qhttpclient_pool->size(): Get the number of connections in the pool.
+ *
+ * @param pool      qhttpclient_pool_t object pointer.
+ *
+ * @return the number of connections, both checked out and idle.
+ */
+static size_t pool_size(qhttpclient_pool_t *pool) {
+    size_t num = 0;
+    pthread_mutex_lock(&pool->mutex);
+    struct qhttpclient_poolhost_s *host;
+    for (host = pool->hosts; host != NULL; host = host->next) {
+        num += host->num;
     }
+    pthread_mutex_unlock(&pool->mutex);
+    return num;
+}
 
-    // nodelay option
-    if (SET_TCP_NODELAY > 0) {
-        int so_tcpnodelay = 1;
-        if (setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, &so_tcpnodelay,
-                       sizeof(so_tcpnodelay)) < 0) {
-            ret = false;
+/**
+ * qhttpclient_pool->clear(): Close all the idle connections.
+ *
+ * @param pool      qhttpclient_pool_t object pointer.
+ */
+static void pool_clear(qhttpclient_pool_t *pool) {
+    pthread_mutex_lock(&pool->mutex);
+    struct qhttpclient_poolhost_s *host;
+    for (host = pool->hosts; host != NULL; host = host->next) {
+        while (host->nidle > 0) {
+            host->nidle--;
+            host->idle[host->nidle].client->free(host->idle[host->nidle].client);
+            host->num--;
         }
     }
+    pthread_cond_broadcast(&pool->cond);
+    pthread_mutex_unlock(&pool->mutex);
+}
 
-    return ret;
+/**
+ * qhttpclient_pool->free(): Close idle connections and free the pool.
+ *
+ * @param pool      qhttpclient_pool_t object pointer.
+ *
+ * @note
+ *  All the connections must have been released before.
+ */
+static void pool_free(qhttpclient_pool_t *pool) {
+    pool_clear(pool);
+
+    struct qhttpclient_poolhost_s *host, *next;
+    for (host = pool->hosts; host != NULL; host = next) {
+        next = host->next;
+        if (host->num > 0) {
+            DEBUG("%d connections to %s:%d are not released.", host->num,
+                  host->hostname, host->port);
+        }
+        qlibc_free(host->idle);
+        qlibc_free(host->hostname);
+        qlibc_free(host);
+    }
+
+    pthread_cond_destroy(&pool->cond);
+    pthread_mutex_destroy(&pool->mutex);
+    qlibc_free(pool);
 }
 
-static bool _parse_uri(const char *uri, bool *protocol, char *hostname,
-                       size_t namesize, int *port) {
+/**
+ * Create an event-driven HTTP client running many requests at once.
+ *
+ * @param timeoutms per request timeout milliseconds, 0 for no limit.
+ *
+ * @return qhttpclient_multi_t object pointer if successful, otherwise
+ *         returns NULL.
+ * @retval errno will be set in error condition.
+ *  - ENOMEM : Memory allocation failure.
+ *
+ * @code
+ *   void done(void *userdata, int rescode, qlisttbl_t *resheaders,
+ *             void *content, size_t contentslength) {
+ *     if (rescode == 0) {
+ *       printf("%s: failed (%s)\n", (char *)userdata, strerror(errno));
+ *       return;
+ *     }
+ *     printf("%s: %d, %zu bytes\n", (char *)userdata, rescode,
+ *            contentslength);
+ *   }
+ *
+ *   qhttpclient_multi_t *multi = qhttpclient_multi(3000);
+ *   multi->add(multi, "10.0.0.1", 80, "GET", "/status", NULL, NULL, 0,
+ *              done, "backend1");
+ *   multi->add(multi, "10.0.0.2", 80, "GET", "/status", NULL, NULL, 0,
+ *              done, "backend2");
+ *   multi->run(multi, -1);  // until all requests are done
+ *   multi->free(multi);
+ * @endcode
+ *
+ * @note
+ *  A single thread drives all the requests with epoll(7) on Linux or
+ *  poll(2) otherwise. Each request has its own non-blocking connection which
+ *  is closed when the response is complete. HTTPS is not supported by this
+ *  interface.
+ */
+qhttpclient_multi_t *qhttpclient_multi(int timeoutms) {
+    qhttpclient_multi_t *multi = (qhttpclient_multi_t *) qlibc_calloc(
+            1, sizeof(qhttpclient_multi_t));
+    if (multi == NULL) {
+        errno = ENOMEM;
+        return NULL;
+    }
 
-    if (!strncasecmp(uri, "http://", CONST_STRLEN("http://"))) {
-        *protocol = false;
-        *port = 80;
-    } else if (!strncasecmp(uri, "https://", CONST_STRLEN("https://"))) {
-        *protocol = true;
-        *port = 443;
-    } else {
-        return false;
+    multi->epfd = -1;
+#ifdef __linux__
+    multi->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (multi->epfd < 0) {
+        qlibc_free(multi);
+        return NULL;
+    }
+#endif
+    multi->timeoutms = (timeoutms > 0) ? timeoutms : 0;
+    _default_sockopts(&multi->sockopts);
+    multi->useragent = qlibc_strdup(QHTTPCLIENT_NAME);
+    if (multi->useragent == NULL) {
+        if (multi->epfd >= 0)
+            close(multi->epfd);
+        qlibc_free(multi);
+        errno = ENOMEM;
+        return NULL;
     }
 
-    char *t1 = strstr(uri, "://");
-    t1 += 3;
-    char *t2 = strstr(t1, "/");
-    if (t2 == NULL)
-        t2 = (char *) uri + strlen(uri);
+    // member methods
+    multi->add = multi_add;
+    multi->run = multi_run;
+    multi->setsockopts = multi_setsockopts;
+    multi->size = multi_size;
+    multi->free = multi_free;
 
-    if (t2 - t1 + 1 > namesize)
+    return multi;
+}
+
+/**
+ * qhttpclient_multi->add(): Start a request.
+ *
+ * @param multi         qhttpclient_multi_t object pointer.
+ * @param hostname      remote IP or FQDN domain name. (not URI)
+ * @param port          remote port number.
+ * @param method        HTTP method name.
+ * @param uri           URI string for the method. ("/path")
+ * @param reqheaders    qlisttbl_t pointer which contains additional user
+ *                      request headers. (can be NULL)
+ * @param data          data to send. (can be NULL)
+ * @param size          data size.
+ * @param callback      function called once when the request is done.
+ * @param userdata      data pointer passed to callback.
+ *
+ * @return true if the request is started, otherwise returns false.
+ * @retval errno will be set in error condition.
+ *  - EINVAL : Invalid argument.
+ *  - ENOMEM : Memory allocation failure.
+ *  - others : Errors of address lookup or connect(2).
+ *
+ * @note
+ *  Default headers(Host, User-Agent, Connection, Content-Length) will be
+ *  added if reqheaders does not have those headers in it. The request is
+ *  only sent and received in run().
+ *
+ *  The callback gets rescode 0 with errno set when the request failed.
+ *  resheaders and content are freed after the callback returns. content is
+ *  always null terminated. It is safe to add() new requests in it.
+ */
+static bool multi_add(qhttpclient_multi_t *multi, const char *hostname,
+                      int port, const char *method, const char *uri,
+                      qlisttbl_t *reqheaders, const void *data, size_t size,
+                      void (*callback)(void *userdata, int rescode,
+                                       qlisttbl_t *resheaders, void *content,
+                                       size_t contentslength),
+                      void *userdata) {
+    if (hostname == NULL || port <= 0 || method == NULL || uri == NULL
+            || callback == NULL) {
+        errno = EINVAL;
         return false;
-    qstrncpy(hostname, namesize, t1, t2 - t1);
+    }
 
-    t1 = strstr(hostname, ":");
-    if (t1 != NULL) {
-        *t1 = '\0';
-        *port = atoi(t1 + 1);
+    struct sockaddr_in addr;
+    if (qsocket_get_addr(&addr, hostname, port) == false) {
+        return false;
     }
 
-    return true;
-}
+    struct qhttpclient_multireq_s *req = qlibc_calloc(
+            1, sizeof(struct qhttpclient_multireq_s));
+    if (req == NULL) {
+        errno = ENOMEM;
+        return false;
+    }
+    req->fd = -1;
+    req->callback = callback;
+    req->userdata = userdata;
+    req->nobody = (strcasecmp(method, "HEAD") == 0);
+    req->resheaders = qlisttbl(QLISTTBL_UNIQUE | QLISTTBL_CASEINSENSITIVE);
+    req->out = _multi_buildrequest(multi, hostname, port, method, uri,
+                                   reqheaders, data, size, &req->outlen);
+    if (req->resheaders == NULL || req->out == NULL) {
+        _multi_freereq(req);
+        errno = ENOMEM;
+        return false;
+    }
+
+    // non-blocking connect
+    req->fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (req->fd < 0) {
+        _multi_freereq(req);
+        return false;
+    }
+    fcntl(req->fd, F_SETFL, fcntl(req->fd, F_GETFL, 0) | O_NONBLOCK);
+    qsocket_set_opts(req->fd, &multi->sockopts);
+    if (connect(req->fd, (struct sockaddr *) &addr, sizeof(addr)) == 0) {
+        req->state = MULTI_SEND;
+    } else if (errno == EINPROGRESS) {
+        req->state = MULTI_CONNECT;
+    } else {
+        int err = errno;
+        _multi_freereq(req);
+        errno = err;
+        return false;
+    }
+    if (_multi_watch(multi, req, MULTI_EVWRITE) == false) {
+        int err = errno;
+        _multi_freereq(req);
+        errno = err;
+        return false;
+    }
+
+    // link at the tail, so the list is in the order of deadline.
+    if (multi->timeoutms > 0)
+        req->deadline = qtime_monotonic_coarse_ms() + multi->timeoutms;
+    if (multi->reqs == NULL) {
+        multi->reqs = req;
+        req->prev = req;
+    } else {
+        struct qhttpclient_multireq_s *head = multi->reqs;
+        req->prev = head->prev;
+        head->prev->next = req;
+        head->prev = req;
+    }
+    multi->num++;
+
+    return true;
+}
+
+/**
+ * qhttpclient_multi->run(): Drive requests until all are done.
+ *
+ * @param multi     qhttpclient_multi_t object pointer.
+ * @param timeoutms maximum milliseconds to run. 0 for handling only the
+ *                  events already arrived, -1 for running until all the
+ *                  requests are done.
+ *
+ * @return the number of requests still in flight, -1 on error.
+ *
+ * @code
+ *   // integrating with an application loop
+ *   while (multi->run(multi, 10) > 0) {
+ *     (...do other work...)
+ *   }
+ * @endcode
+ */
+static int multi_run(qhttpclient_multi_t *multi, int timeoutms) {
+    long expire = (timeoutms > 0) ? qtime_monotonic_coarse_ms() + timeoutms : 0;
+
+    while (multi->num > 0) {
+        // time out expired requests.
+        long now = qtime_monotonic_coarse_ms();
+        while (multi->reqs != NULL) {
+            struct qhttpclient_multireq_s *req = multi->reqs;
+            if (req->deadline == 0 || req->deadline > now)
+                break;
+            _multi_done(multi, req, ETIMEDOUT);
+        }
+        if (multi->num == 0)
+            break;
+
+        // how long to wait
+        int waitms = -1;
+        if (timeoutms >= 0) {
+            waitms = (timeoutms == 0) ? 0 : (int) (expire - now);
+            if (waitms < 0)
+                waitms = 0;
+        }
+        struct qhttpclient_multireq_s *first = multi->reqs;
+        if (first->deadline > 0
+                && (waitms < 0 || first->deadline - now < waitms)) {
+            waitms = (int) (first->deadline - now);
+        }
+
+        if (_multi_wait(multi, waitms) < 0)
+            return -1;
+
+        if (timeoutms == 0
+                || (timeoutms > 0 && qtime_monotonic_coarse_ms() >= expire)) {
+            break;
+        }
+    }
+
+    return (int) multi->num;
+}
+
+/**
+ * qhttpclient_multi->setsockopts(): Sets socket options of new requests.
+ *
+ * @param multi     qhttpclient_multi_t object pointer.
+ * @param opts      socket tuning profile. NULL restores the default.
+ *
+ * @note
+ *  Requests already added keep the options they were connected with.
+ */
+static void multi_setsockopts(qhttpclient_multi_t *multi,
+                              const qsocket_opts_t *opts) {
+    if (opts != NULL)
+        multi->sockopts = *opts;
+    else
+        _default_sockopts(&multi->sockopts);
+}
+
+/**
+ * qhttpclient_multi->size():Get the number of requests in flight.
+ *
+ * @param multi     qhttpclient_multi_t object pointer.
+ *
+ * @return the number of requests not completed yet.
+ */
+static size_t multi_size(qhttpclient_multi_t *multi) {
+    return multi->num;
+}
+
+/**
+ * qhttpclient_multi->free(): Abort requests in flight and free object.
+ *
+ * @param multi     qhttpclient_multi_t object pointer.
+ *
+ * @note
+ *  Callbacks of the requests in flight are called with ECANCELED.
+ */
+static void multi_free(qhttpclient_multi_t *multi) {
+    while (multi->reqs != NULL) {
+        _multi_done(multi, multi->reqs, ECANCELED);
+    }
+    if (multi->epfd >= 0)
+        close(multi->epfd);
+    qlibc_free(multi->useragent);
+    qlibc_free(multi);
+}
+
+#ifndef _DOXYGEN_SKIP
+// serialize request line and headers into a buffer. default headers are
+// added into reqheaders.
+static qstrbuf_t *_buildrequest(qhttpclient_t *client, const char *method,
+                                const char *uri, qlisttbl_t *reqheaders) {
+    // generate request headers if necessary
+    bool freeReqHeaders = false;
+    if (reqheaders == NULL) {
+        reqheaders = qlisttbl(
+                QLISTTBL_UNIQUE | QLISTTBL_CASEINSENSITIVE);
+        if (reqheaders == NULL)
+            return NULL;
+        freeReqHeaders = true;
+    }
+
+    // append default headers
+    if (reqheaders->get(reqheaders, "Host", NULL, false) == NULL) {
+        reqheaders->putstrf(reqheaders, "Host", "%s:%d", client->hostname,
+                            client->port);
+    }
+    if (reqheaders->get(reqheaders, "User-Agent", NULL, false) == NULL) {
+        reqheaders->putstr(reqheaders, "User-Agent", client->useragent);
+    }
+    if (reqheaders->get(reqheaders, "Connection", NULL, false) == NULL) {
+        reqheaders->putstr(
+                reqheaders, "Connection",
+                (client->keepalive == true) ? "Keep-Alive" : "close");
+    }
+
+    // create stream buffer
+    qstrbuf_t *outBuf = qstrbuf(1024);
+    if (outBuf == NULL) {
+        if (freeReqHeaders == true)
+            reqheaders->free(reqheaders);
+        return NULL;
+    }
+
+    // buffer out command
+    outBuf->appendf(outBuf, "%s %s %s\r\n", method, uri,
+    HTTP_PROTOCOL_11);
+
+    // buffer out headers
+    qdlnobj_t obj;
+    memset((void *) &obj, 0, sizeof(obj));  // must be cleared before call
+    reqheaders->lock(reqheaders);
+    while (reqheaders->getnext(reqheaders, &obj, NULL, false) == true) {
+        outBuf->append(outBuf, obj.name);
+        outBuf->append_n(outBuf, ": ", 2);
+        outBuf->append(outBuf, (char *) obj.data);
+        outBuf->append_n(outBuf, "\r\n", 2);
+    }
+    reqheaders->unlock(reqheaders);
+
+    outBuf->append_n(outBuf, "\r\n", 2);
+
+    if (freeReqHeaders == true)
+        reqheaders->free(reqheaders);
+    return outBuf;
+}
+
+// sendrequest() which also sends a request body with the request head.
+static bool _sendrequest(qhttpclient_t *client, const char *method,
+                         const char *uri, qlisttbl_t *reqheaders,
+                         const void *body, size_t bodysize) {
+    if (open_(client) == false) {
+        return false;
+    }
+
+    // build request head
+    qstrbuf_t *outBuf = _buildrequest(client, method, uri, reqheaders);
+    if (outBuf == NULL)
+        return false;
+
+#ifdef ENABLE_OPENSSL
+    // SSL can't gather buffers, so a small body is joined to the head.
+    if (client->ssl != NULL && bodysize > 0
+            && bodysize <= MAX_ATOMIC_DATA_SIZE) {
+        outBuf->append_n(outBuf, body, bodysize);
+        body = NULL;
+        bodysize = 0;
+    }
+#endif
+
+    // stream out the head and the body with a single write
+    size_t towrite = 0;
+    char *final = outBuf->getstr(outBuf, false);
+    towrite = outBuf->length(outBuf);
+    ssize_t written = 0;
+    if (final != NULL) {
+        struct iovec iov[2];
+        iov[0].iov_base = final;
+        iov[0].iov_len = towrite;
+        iov[1].iov_base = (void *) body;
+        iov[1].iov_len = bodysize;
+        towrite += bodysize;
+        written = _writev(client, iov, 2);
+    }
+
+    // de-allocate
+    outBuf->free(outBuf);
+
+    if (written > 0 && written == towrite)
+        return true;
+    return false;
+}
+
+// read a response body into a malloced buffer. it's null terminated.
+static void *_readcontent(qhttpclient_t *client, qlisttbl_t *resheaders,
+                          off_t clength, bool nobody, size_t *size) {
+    *size = 0;
+    if (nobody == true || (clength == 0
+            && (client->connclose == false
+                    || resheaders->get(resheaders, "Content-Length", NULL,
+                                       false) != NULL))) {
+        return qlibc_strdup("");
+    }
+
+    if (clength > 0) {
+        char *content = qlibc_malloc(clength + 1);
+        if (content == NULL)
+            return NULL;
+        if (read_(client, content, clength) != clength) {
+            qlibc_free(content);
+            return NULL;
+        }
+        content[clength] = '\0';
+        *size = clength;
+        return content;
+    }
+
+    // chunked or until the server closes the connection
+    qstrbuf_t *body = qstrbuf(MAX_ATOMIC_DATA_SIZE);
+    if (body == NULL)
+        return NULL;
+    bool completed = false;
+    while (true) {
+        if (clength == -1) {
+            char line[64];
+            if (gets_(client, line, sizeof(line)) <= 0)
+                break;
+            char *end = NULL;
+            long chunksize = strtol(line, &end, 16);
+            if (end == line || chunksize < 0)
+                break;
+            if (chunksize == 0) {
+                // skip trailer
+                while (gets_(client, line, sizeof(line)) > 0
+                        && line[0] != '\0');
+                completed = true;
+                break;
+            }
+
+            // read the chunk straight into the buffer
+            if (body->reserve(body, chunksize) == false)
+                break;
+            char *chunk = body->getstr(body, false) + body->length(body);
+            if (read_(client, chunk, chunksize) != chunksize
+                    || gets_(client, line, sizeof(line)) <= 0) {
+                break;
+            }
+            body->append_n(body, chunk, chunksize);
+        } else {
+            if (body->reserve(body, MAX_ATOMIC_DATA_SIZE) == false)
+                break;
+            char *buf = body->getstr(body, false) + body->length(body);
+            ssize_t rsize = read_(client, buf, MAX_ATOMIC_DATA_SIZE);
+            if (rsize <= 0) {
+                completed = true;
+                break;
+            }
+            body->append_n(body, buf, rsize);
+        }
+    }
+
+    char *content = NULL;
+    if (completed == true) {
+        content = body->steal(body, size);
+    }
+    body->free(body);
+    return content;
+}
+
+// call back all pipelined requests with an error.
+static void _pipeline_fail(qhttpclient_t *client, int err) {
+    qlist_t *queue = client->queue;
+    struct qhttpclient_pipereq_s *req;
+    while (queue != NULL && (req = queue->popfirst(queue, NULL)) != NULL) {
+        errno = err;
+        req->callback(req->userdata, HTTP_NO_RESPONSE, NULL, NULL, 0);
+        qlibc_free(req->head);
+        qlibc_free(req);
+    }
+}
+
+// initialize a body sink. it inflates the body when it's encoded.
+static bool _sink_init(struct qhttpclient_sink_s *sink, qlisttbl_t *resheaders,
+                       bool (*callback)(void *userdata, const void *data,
+                                        size_t size),
+                       void *userdata) {
+    memset((void *) sink, 0, sizeof(struct qhttpclient_sink_s));
+    sink->callback = callback;
+    sink->userdata = userdata;
+
+#ifdef ENABLE_ZLIB
+    const char *encoding = NULL;
+    if (resheaders != NULL)
+        encoding = resheaders->getstr(resheaders, "Content-Encoding", false);
+    if (encoding == NULL)
+        return true;
+    if (!strcasecmp(encoding, "deflate")) {
+        sink->deflate = true;
+    } else if (strcasecmp(encoding, "gzip") && strcasecmp(encoding, "x-gzip")) {
+        return true;  // deliver as it is
+    }
+
+    // 32 with window bits accepts both gzip and zlib headers.
+    if (inflateInit2(&sink->z, 15 + 32) != Z_OK)
+        return false;
+    sink->out = qlibc_malloc(MAX_ATOMIC_DATA_SIZE);
+    if (sink->out == NULL) {
+        inflateEnd(&sink->z);
+        return false;
+    }
+    sink->inflating = true;
+#endif
+    return true;
+}
+
+// feed body data into a sink.
+static bool _sink_write(struct qhttpclient_sink_s *sink, const void *data,
+                        size_t size) {
+#ifdef ENABLE_ZLIB
+    if (sink->inflating == true) {
+        sink->z.next_in = (Bytef *) data;
+        sink->z.avail_in = size;
+        while (sink->z.avail_in > 0 && sink->finished == false) {
+            sink->z.next_out = sink->out;
+            sink->z.avail_out = MAX_ATOMIC_DATA_SIZE;
+            int ret = inflate(&sink->z, Z_NO_FLUSH);
+            if (ret == Z_DATA_ERROR && sink->deflate == true
+                    && sink->inbytes == 0 && sink->z.total_out == 0) {
+                // some servers send raw deflate data without zlib header.
+                inflateEnd(&sink->z);
+                if (inflateInit2(&sink->z, -15) != Z_OK)
+                    return false;
+                sink->deflate = false;
+                sink->z.next_in = (Bytef *) data;
+                sink->z.avail_in = size;
+                continue;
+            }
+            if (ret != Z_OK && ret != Z_STREAM_END) {
+                DEBUG("inflate failed. (%d)", ret);
+                return false;
+            }
+
+            size_t outsize = MAX_ATOMIC_DATA_SIZE - sink->z.avail_out;
+            if (outsize > 0) {
+                sink->total += outsize;
+                if (sink->callback(sink->userdata, sink->out, outsize)
+                        == false) {
+                    return false;
+                }
+            }
+            if (ret == Z_STREAM_END)
+                sink->finished = true;
+        }
+        sink->inbytes += size;
+        return true;
+    }
+#endif
+    sink->total += size;
+    return sink->callback(sink->userdata, data, size);
+}
+
+// check the body ended properly.
+static bool _sink_end(struct qhttpclient_sink_s *sink) {
+#ifdef ENABLE_ZLIB
+    if (sink->inflating == true)
+        return sink->finished;
+#endif
+    return true;
+}
+
+static void _sink_free(struct qhttpclient_sink_s *sink) {
+#ifdef ENABLE_ZLIB
+    if (sink->inflating == true) {
+        inflateEnd(&sink->z);
+        qlibc_free(sink->out);
+    }
+#endif
+}
+
+// gather write for plain connections, buffer by buffer for SSL.
+static ssize_t _writev(qhttpclient_t *client, const struct iovec *iov,
+                       int iovcnt) {
+#ifdef ENABLE_OPENSSL
+    if (client->ssl != NULL) {
+        ssize_t total = 0;
+        int i;
+        for (i = 0; i < iovcnt; i++) {
+            if (iov[i].iov_len == 0)
+                continue;
+            ssize_t wsize = write_(client, iov[i].iov_base, iov[i].iov_len);
+            if (wsize > 0)
+                total += wsize;
+            if (wsize != iov[i].iov_len)
+                break;
+        }
+        if (total > 0)
+            return total;
+        return -1;
+    }
+#endif
+    return qio_writev(client->socket, iov, iovcnt, -1);
+}
+
+// parse "HTTP/1.1 200 OK" line into a response code.
+static int _parse_statusline(const char *line) {
+    if (strncmp(line, "HTTP/", CONST_STRLEN("HTTP/")))
+        return HTTP_NO_RESPONSE;
+    char *tmp = strstr(line, " ");
+    if (tmp == NULL)
+        return HTTP_NO_RESPONSE;
+    return atoi(tmp + 1);
+}
+
+// parse a response header line. contentlength will be -1 for chunked
+// transfer encoding and connclose will be set to true on "Connection: close"
+static void _parse_header(char *line, qlisttbl_t *resheaders,
+                          off_t *contentlength, bool *connclose) {
+    char *name = line;
+    char *value = strstr(line, ":");
+    if (value != NULL) {
+        *value = '\0';
+        value += 1;
+        qstrtrim(value);
+    } else {
+        // missing colon
+        value = "";
+    }
+
+    if (resheaders != NULL) {
+        resheaders->putstr(resheaders, name, value);
+    }
+
+    // check Connection header
+    if (!strcasecmp(name, "Connection")) {
+        if (!strcasecmp(value, "close")) {
+            *connclose = true;
+        }
+    }
+    // check Content-Length & Transfer-Encoding header
+    else if (contentlength != NULL && *contentlength == 0) {
+        if (!strcasecmp(name, "Content-Length")) {
+            *contentlength = atoll(value);
+        }
+        // check transfer-encoding header
+        else if (!strcasecmp(name, "Transfer-Encoding")
+                && !strcasecmp(value, "chunked")) {
+            *contentlength = -1;
+        }
+    }
+}
+
+static void _default_sockopts(qsocket_opts_t *opts) {
+    memset((void *) opts, 0, sizeof(qsocket_opts_t));
+    opts->nodelay = (SET_TCP_NODELAY > 0);
+    opts->lingersec = SET_TCP_LINGER_TIMEOUT;
+}
+
+static bool _parse_uri(const char *uri, bool *protocol, char *hostname,
+                       size_t namesize, int *port) {
+
+    if (!strncasecmp(uri, "http://", CONST_STRLEN("http://"))) {
+        *protocol = false;
+        *port = 80;
+    } else if (!strncasecmp(uri, "https://", CONST_STRLEN("https://"))) {
+        *protocol = true;
+        *port = 443;
+    } else {
+        return false;
+    }
+
+    char *t1 = strstr(uri, "://");
+    t1 += 3;
+    char *t2 = strstr(t1, "/");
+    if (t2 == NULL)
+        t2 = (char *) uri + strlen(uri);
+
+    if (t2 - t1 + 1 > namesize)
+        return false;
+    qstrncpy(hostname, namesize, t1, t2 - t1);
+
+    t1 = strstr(hostname, ":");
+    if (t1 != NULL) {
+        *t1 = '\0';
+        *port = atoi(t1 + 1);
+    }
+
+    return true;
+}
+#ifdef ENABLE_OPENSSL
+// initialize openssl and the shared context. called once.
+static void _ssl_init(void) {
+    SSL_load_error_strings();
+    SSL_library_init();
+
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+    _ssl_ctx = SSL_CTX_new(TLS_client_method());
+#else
+    _ssl_ctx = SSL_CTX_new(SSLv23_client_method());
+#endif
+    if (_ssl_ctx == NULL) {
+        DEBUG("OpenSSL: %s", ERR_reason_error_string(ERR_get_error()));
+        return;
+    }
+
+    // new sessions, including TLS 1.3 tickets arriving after the handshake,
+    // are handed to _ssl_newsession() to be cached per host.
+    SSL_CTX_set_session_cache_mode(_ssl_ctx, SSL_SESS_CACHE_CLIENT
+                                   | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+    SSL_CTX_sess_set_new_cb(_ssl_ctx, _ssl_newsession);
+    _ssl_sessions = qhashtbl(0, 0);
+}
+
+static int _ssl_newsession(SSL *ssl, SSL_SESSION *session) {
+    qhttpclient_t *client = SSL_get_app_data(ssl);
+    if (client == NULL)
+        return 0;
+    _ssl_putsession(client, session);
+    return 1;  // we keep the reference
+}
+
+// set the cached session of the host to a connection.
+static void _ssl_getsession(qhttpclient_t *client, SSL *ssl) {
+    char key[256 + 16];
+    snprintf(key, sizeof(key), "%s:%d", client->hostname, client->port);
+
+    pthread_mutex_lock(&_ssl_sessions_lock);
+    SSL_SESSION **session = NULL;
+    if (_ssl_sessions != NULL)
+        session = _ssl_sessions->get(_ssl_sessions, key, NULL, false);
+    if (session != NULL)
+        SSL_set_session(ssl, *session);
+    pthread_mutex_unlock(&_ssl_sessions_lock);
+}
+
+// replace the cached session of the host. NULL for removing it.
+static void _ssl_putsession(qhttpclient_t *client, SSL_SESSION *session) {
+    char key[256 + 16];
+    snprintf(key, sizeof(key), "%s:%d", client->hostname, client->port);
+
+    pthread_mutex_lock(&_ssl_sessions_lock);
+    if (_ssl_sessions == NULL) {
+        pthread_mutex_unlock(&_ssl_sessions_lock);
+        if (session != NULL)
+            SSL_SESSION_free(session);
+        return;
+    }
+
+    SSL_SESSION **old = _ssl_sessions->get(_ssl_sessions, key, NULL, false);
+    if (old != NULL) {
+        SSL_SESSION_free(*old);
+        _ssl_sessions->remove(_ssl_sessions, key);
+    }
+    if (session != NULL) {
+        // start over when it's full
+        if (_ssl_sessions->size(_ssl_sessions) >= MAX_SSL_SESSIONS) {
+            qhnobj_t obj;
+            memset((void *) &obj, 0, sizeof(obj));
+            while (_ssl_sessions->getnext(_ssl_sessions, &obj, false)) {
+                SSL_SESSION_free(*(SSL_SESSION **) obj.data);
+            }
+            _ssl_sessions->clear(_ssl_sessions);
+        }
+        _ssl_sessions->put(_ssl_sessions, key, &session, sizeof(session));
+    }
+    pthread_mutex_unlock(&_ssl_sessions_lock);
+}
+
+// read function of the buffered reader for SSL connections.
+static ssize_t _ssl_read(void *arg, void *buf, size_t nbytes, int timeoutms) {
+    struct SslConn *ssl = (struct SslConn *) arg;
+    while (true) {
+        // data may be already decrypted and pending in the SSL buffer.
+        if (SSL_pending(ssl->ssl) <= 0 && timeoutms >= 0
+                && qio_wait_readable(SSL_get_fd(ssl->ssl), timeoutms) <= 0) {
+            return -1;
+        }
+
+        int rsize = SSL_read(ssl->ssl, buf, nbytes);
+        if (rsize > 0) {
+            DEBUG("SSL_read: %d", rsize);
+            return rsize;
+        }
+
+        int sslerr = SSL_get_error(ssl->ssl, rsize);
+        if (sslerr == SSL_ERROR_WANT_READ || sslerr == SSL_ERROR_WANT_WRITE) {
+            usleep(1);
+            continue;
+        }
+        if (sslerr == SSL_ERROR_ZERO_RETURN) {
+            errno = 0;
+            return 0;
+        }
+        DEBUG("OpenSSL: %s (%d)", ERR_reason_error_string(ERR_get_error()),
+              rsize);
+        return -1;
+    }
+}
+#endif
+
+// find a host entry. called with the pool locked.
+static struct qhttpclient_poolhost_s *_pool_host(qhttpclient_pool_t *pool,
+                                                 const char *hostname,
+                                                 int port, bool ssl,
+                                                 bool create) {
+    struct qhttpclient_poolhost_s *host;
+    for (host = pool->hosts; host != NULL; host = host->next) {
+        if (host->port == port && host->ssl == ssl
+                && !strcmp(host->hostname, hostname)) {
+            break;
+        }
+    }
+    if (host == NULL && create == true) {
+        host = (struct qhttpclient_poolhost_s *) qlibc_calloc(
+                1, sizeof(struct qhttpclient_poolhost_s));
+        if (host == NULL)
+            return NULL;
+        host->hostname = qlibc_strdup(hostname);
+        if (host->hostname == NULL) {
+            qlibc_free(host);
+            return NULL;
+        }
+        host->port = port;
+        host->ssl = ssl;
+        host->next = pool->hosts;
+        pool->hosts = host;
+    }
+
+    // make sure every connection has an idle slot to be released into.
+    if (host != NULL && host->num >= host->maxidle) {
+        int maxidle = (host->maxidle > 0) ? host->maxidle * 2 : 4;
+        void *idle = qlibc_realloc(host->idle, sizeof(*host->idle) * maxidle);
+        if (idle == NULL)
+            return (host->num > host->maxidle) ? NULL : host;
+        host->idle = idle;
+        host->maxidle = maxidle;
+    }
+    return host;
+}
+
+// check an idle connection before handing it out.
+static bool _pool_isalive(qhttpclient_pool_t *pool, qhttpclient_t *client,
+                          long since) {
+    if (pool->idletimeoutms > 0
+            && qtime_monotonic_coarse_ms() - since > pool->idletimeoutms) {
+        return false;
+    }
+    if (client->socket < 0)
+        return false;
+
+    // an idle socket becomes readable only when the remote closed it or
+    // sent something we didn't ask for.
+    if (qio_wait_readable(client->socket, 0) != 0)
+        return false;
+    return true;
+}
+
+// free a connection and its slot in the pool.
+static void _pool_drop(qhttpclient_pool_t *pool, qhttpclient_t *client) {
+    pthread_mutex_lock(&pool->mutex);
+    struct qhttpclient_poolhost_s *host = _pool_host(pool, client->hostname,
+                                                     client->port,
+                                                     (client->ssl != NULL),
+                                                     false);
+    if (host != NULL && host->num > 0)
+        host->num--;
+    pthread_cond_broadcast(&pool->cond);
+    pthread_mutex_unlock(&pool->mutex);
+
+    client->free(client);
+}
+
+// serialize a request into a malloced buffer.
+static char *_multi_buildrequest(qhttpclient_multi_t *multi,
+                                 const char *hostname, int port,
+                                 const char *method, const char *uri,
+                                 qlisttbl_t *reqheaders, const void *data,
+                                 size_t size, size_t *outlen) {
+    qstrbuf_t *outBuf = qstrbuf(1024 + ((data != NULL) ? size : 0));
+    if (outBuf == NULL)
+        return NULL;
+
+    outBuf->appendf(outBuf, "%s %s %s\r\n", method, uri, HTTP_PROTOCOL_11);
+    if (reqheaders != NULL) {
+        qdlnobj_t obj;
+        memset((void *) &obj, 0, sizeof(obj));  // must be cleared before call
+        reqheaders->lock(reqheaders);
+        while (reqheaders->getnext(reqheaders, &obj, NULL, false) == true) {
+            outBuf->appendf(outBuf, "%s: %s\r\n", obj.name, (char *) obj.data);
+        }
+        reqheaders->unlock(reqheaders);
+    }
+
+    // default headers
+    if (reqheaders == NULL
+            || reqheaders->get(reqheaders, "Host", NULL, false) == NULL) {
+        outBuf->appendf(outBuf, "Host: %s:%d\r\n", hostname, port);
+    }
+    if (reqheaders == NULL
+            || reqheaders->get(reqheaders, "User-Agent", NULL, false) == NULL) {
+        outBuf->appendf(outBuf, "User-Agent: %s\r\n", multi->useragent);
+    }
+    if (reqheaders == NULL
+            || reqheaders->get(reqheaders, "Connection", NULL, false) == NULL) {
+        outBuf->appendf(outBuf, "Connection: close\r\n");
+    }
+    if (data != NULL && size > 0
+            && (reqheaders == NULL
+                    || reqheaders->get(reqheaders, "Content-Length", NULL,
+                                       false) == NULL)) {
+        outBuf->appendf(outBuf, "Content-Length: %zu\r\n", size);
+    }
+    outBuf->appendf(outBuf, "\r\n");
+    if (data != NULL && size > 0)
+        outBuf->append_n(outBuf, data, size);
+
+    char *out = outBuf->steal(outBuf, outlen);
+    outBuf->free(outBuf);
+    return out;
+}
+
+// change watching events of a request.
+static bool _multi_watch(qhttpclient_multi_t *multi,
+                         struct qhttpclient_multireq_s *req, int events) {
+#ifdef __linux__
+    struct epoll_event ev;
+    memset((void *) &ev, 0, sizeof(ev));
+    ev.events = ((events & MULTI_EVREAD) ? EPOLLIN : 0)
+            | ((events & MULTI_EVWRITE) ? EPOLLOUT : 0);
+    ev.data.ptr = req;
+    if (epoll_ctl(multi->epfd, (req->events == 0) ? EPOLL_CTL_ADD
+                  : EPOLL_CTL_MOD, req->fd, &ev) != 0) {
+        return false;
+    }
+#endif
+    req->events = events;
+    return true;
+}
+
+// wait and dispatch events. returns the number of events handled.
+static int _multi_wait(qhttpclient_multi_t *multi, int waitms) {
+#ifdef __linux__
+    struct epoll_event evs[MAX_MULTI_EVENTS];
+    int n = epoll_wait(multi->epfd, evs, MAX_MULTI_EVENTS, waitms);
+    if (n < 0)
+        return (errno == EINTR) ? 0 : -1;
+
+    int i;
+    for (i = 0; i < n; i++) {
+        int events = ((evs[i].events & EPOLLIN) ? MULTI_EVREAD : 0)
+                | ((evs[i].events & EPOLLOUT) ? MULTI_EVWRITE : 0)
+                | ((evs[i].events & (EPOLLERR | EPOLLHUP)) ? MULTI_EVERROR : 0);
+        _multi_event(multi, evs[i].data.ptr, events);
+    }
+    return n;
+#else
+    size_t num = multi->num;
+    struct pollfd *fds = qlibc_malloc(sizeof(struct pollfd) * num);
+    struct qhttpclient_multireq_s **reqs = qlibc_malloc(sizeof(void *) * num);
+    if (fds == NULL || reqs == NULL) {
+        qlibc_free(fds);
+        qlibc_free(reqs);
+        errno = ENOMEM;
+        return -1;
+    }
+
+    // snapshot, callbacks may add new requests to the list.
+    size_t i = 0;
+    struct qhttpclient_multireq_s *req;
+    for (req = multi->reqs; req != NULL && i < num; req = req->next, i++) {
+        reqs[i] = req;
+        fds[i].fd = req->fd;
+        fds[i].events = ((req->events & MULTI_EVREAD) ? POLLIN : 0)
+                | ((req->events & MULTI_EVWRITE) ? POLLOUT : 0);
+        fds[i].revents = 0;
+    }
+
+    int n = poll(fds, num, waitms);
+    if (n > 0) {
+        for (i = 0; i < num; i++) {
+            if (fds[i].revents == 0)
+                continue;
+            int events = ((fds[i].revents & POLLIN) ? MULTI_EVREAD : 0)
+                    | ((fds[i].revents & POLLOUT) ? MULTI_EVWRITE : 0)
+                    | ((fds[i].revents & (POLLERR | POLLHUP | POLLNVAL))
+                            ? MULTI_EVERROR : 0);
+            _multi_event(multi, reqs[i], events);
+        }
+    }
+    qlibc_free(fds);
+    qlibc_free(reqs);
+    if (n < 0)
+        return (errno == EINTR) ? 0 : -1;
+    return n;
+#endif
+}
+
+// advance the state machine of a request on events.
+static void _multi_event(qhttpclient_multi_t *multi,
+                         struct qhttpclient_multireq_s *req, int events) {
+    if (req->state == MULTI_CONNECT) {
+        int err = 0;
+        socklen_t errlen = sizeof(err);
+        if (getsockopt(req->fd, SOL_SOCKET, SO_ERROR, &err, &errlen) != 0)
+            err = errno;
+        if (err != 0) {
+            _multi_done(multi, req, err);
+            return;
+        }
+        req->state = MULTI_SEND;
+    }
+
+    if (req->state == MULTI_SEND) {
+        while (req->outoff < req->outlen) {
+#ifdef MSG_NOSIGNAL
+            ssize_t wsize = send(req->fd, req->out + req->outoff,
+                                 req->outlen - req->outoff, MSG_NOSIGNAL);
+#else
+            ssize_t wsize = write(req->fd, req->out + req->outoff,
+                                  req->outlen - req->outoff);
+#endif
+            if (wsize < 0) {
+                if (errno == EAGAIN || errno == EINTR)
+                    return;
+                _multi_done(multi, req, errno);
+                return;
+            }
+            req->outoff += wsize;
+        }
+
+        // request is out. wait for the response.
+        qlibc_free(req->out);
+        req->out = NULL;
+        req->state = MULTI_HEAD;
+        if (_multi_watch(multi, req, MULTI_EVREAD) == false) {
+            _multi_done(multi, req, errno);
+        }
+        return;
+    }
+
+    if (events & (MULTI_EVREAD | MULTI_EVERROR)) {
+        int ret = _multi_recv(req);
+        if (ret > 0) {
+            _multi_done(multi, req, 0);
+        } else if (ret < 0) {
+            _multi_done(multi, req, errno);
+        }
+    }
+}
+
+// read what's available. returns 1 when response is complete, 0 for more
+// data to come or -1 on error.
+static int _multi_recv(struct qhttpclient_multireq_s *req) {
+    while (true) {
+        if (req->insize - req->inlen < MULTI_RECV_SIZE / 2) {
+            size_t insize = req->insize + MULTI_RECV_SIZE;
+            char *in = qlibc_realloc(req->in, insize);
+            if (in == NULL) {
+                errno = ENOMEM;
+                return -1;
+            }
+            req->in = in;
+            req->insize = insize;
+        }
+
+        ssize_t rsize = read(req->fd, req->in + req->inlen,
+                             req->insize - req->inlen);
+        if (rsize > 0) {
+            req->inlen += rsize;
+            int ret = _multi_parse(req, false);
+            if (ret != 0)
+                return ret;
+        } else if (rsize == 0) {
+            int ret = _multi_parse(req, true);
+            if (ret == 0) {
+                errno = ECONNRESET;
+                return -1;
+            }
+            return ret;
+        } else if (errno == EAGAIN || errno == EINTR) {
+            return 0;
+        } else {
+            return -1;
+        }
+    }
+}
+
+// get a line from the receive buffer.
+static int _multi_getline(struct qhttpclient_multireq_s *req, size_t *offset,
+                          char **line) {
+    char *start = req->in + *offset;
+    char *lf = memchr(start, '\n', req->inlen - *offset);
+    if (lf == NULL) {
+        if (req->inlen - *offset > MAX_MULTI_LINE) {
+            errno = EMSGSIZE;
+            return -1;
+        }
+        return 0;
+    }
+    *lf = '\0';
+    if (lf > start && *(lf - 1) == '\r')
+        *(lf - 1) = '\0';
+    *line = start;
+    *offset = (lf - req->in) + 1;
+    return 1;
+}
+
+// append data to the response body.
+static bool _multi_addbody(struct qhttpclient_multireq_s *req,
+                           const void *data, size_t size) {
+    if (req->bodylen + size + 1 > req->bodysize) {
+        size_t bodysize = (req->bodysize > 0) ? req->bodysize : 1024;
+        while (bodysize < req->bodylen + size + 1)
+            bodysize *= 2;
+        char *body = qlibc_realloc(req->body, bodysize);
+        if (body == NULL) {
+            errno = ENOMEM;
+            return false;
+        }
+        req->body = body;
+        req->bodysize = bodysize;
+    }
+    memcpy(req->body + req->bodylen, data, size);
+    req->bodylen += size;
+    return true;
+}
+
+// resumable response parser. returns 1 when response is complete, 0 for
+// more data or -1 on error.
+static int _multi_parse(struct qhttpclient_multireq_s *req, bool eof) {
+    size_t offset = 0;
+    int ret = 0;
+    while (ret == 0) {
+        char *line;
+        size_t avail = req->inlen - offset;
+
+        if (req->state == MULTI_HEAD) {
+            ret = _multi_getline(req, &offset, &line);
+            if (ret <= 0)
+                break;
+            ret = 0;
+
+            if (req->rescode == HTTP_NO_RESPONSE) {
+                req->rescode = _parse_statusline(line);
+                if (req->rescode == HTTP_NO_RESPONSE) {
+                    errno = EPROTO;
+                    ret = -1;
+                }
+            } else if (line[0] != '\0') {
+                _parse_header(line, req->resheaders, &req->clength,
+                              &req->connclose);
+            } else if (req->rescode / 100 == 1) {
+                // interim response like 100 Continue, wait for the real one.
+                req->rescode = HTTP_NO_RESPONSE;
+                req->clength = 0;
+                req->resheaders->clear(req->resheaders);
+            } else if (req->nobody == true
+                    || req->rescode == HTTP_CODE_NO_CONTENT
+                    || req->rescode == HTTP_CODE_NOT_MODIFIED) {
+                ret = 1;
+            } else if (req->clength == -1) {
+                req->state = MULTI_CHUNKSIZE;
+            } else if (req->clength > 0) {
+                req->state = MULTI_BODY;
+            } else if (req->resheaders->get(req->resheaders, "Content-Length",
+                                            NULL, false) != NULL) {
+                ret = 1;  // Content-Length: 0
+            } else {
+                req->untilclose = true;
+                req->state = MULTI_BODY;
+            }
+        } else if (req->state == MULTI_BODY) {
+            size_t n = avail;
+            if (req->untilclose == false && n > req->clength - req->bodylen)
+                n = req->clength - req->bodylen;
+            if (n > 0 && _multi_addbody(req, req->in + offset, n) == false) {
+                ret = -1;
+                break;
+            }
+            offset += n;
+            if (req->untilclose == false && req->bodylen == req->clength)
+                ret = 1;
+            else if (eof == true)
+                ret = (req->untilclose == true) ? 1 : -1;
+            else
+                break;
+            if (ret < 0)
+                errno = ECONNRESET;
+        } else if (req->state == MULTI_CHUNKSIZE) {
+            ret = _multi_getline(req, &offset, &line);
+            if (ret <= 0)
+                break;
+            ret = 0;
+
+            char *end = NULL;
+            req->chunkleft = strtol(line, &end, 16);
+            if (end == line || req->chunkleft < 0) {
+                errno = EPROTO;
+                ret = -1;
+            } else {
+                req->state = (req->chunkleft > 0) ? MULTI_CHUNKDATA
+                        : MULTI_TRAILER;
+            }
+        } else if (req->state == MULTI_CHUNKDATA) {
+            size_t n = avail;
+            if (n > req->chunkleft)
+                n = req->chunkleft;
+            if (n > 0 && _multi_addbody(req, req->in + offset, n) == false) {
+                ret = -1;
+                break;
+            }
+            offset += n;
+            req->chunkleft -= n;
+            if (req->chunkleft > 0)
+                break;
+            req->state = MULTI_CHUNKEND;
+        } else if (req->state == MULTI_CHUNKEND) {
+            ret = _multi_getline(req, &offset, &line);
+            if (ret <= 0)
+                break;
+            ret = 0;
+            req->state = MULTI_CHUNKSIZE;
+        } else if (req->state == MULTI_TRAILER) {
+            ret = _multi_getline(req, &offset, &line);
+            if (ret <= 0)
+                break;
+            ret = (line[0] == '\0') ? 1 : 0;
+        }
+    }
+
+    // keep unparsed data only.
+    if (ret == 0 && offset > 0) {
+        memmove(req->in, req->in + offset, req->inlen - offset);
+        req->inlen -= offset;
+    }
+    return ret;
+}
+
+// finish a request and call back. err is 0 for success.
+static void _multi_done(qhttpclient_multi_t *multi,
+                        struct qhttpclient_multireq_s *req, int err) {
+    // unlink
+    if (req == multi->reqs) {
+        multi->reqs = req->next;
+        if (req->next != NULL)
+            req->next->prev = req->prev;
+    } else {
+        req->prev->next = req->next;
+        if (req->next != NULL)
+            req->next->prev = req->prev;
+        else
+            ((struct qhttpclient_multireq_s *) multi->reqs)->prev = req->prev;
+    }
+    multi->num--;
+
+    // closing descriptor removes it from epoll set as well.
+    close(req->fd);
+    req->fd = -1;
+
+    if (err == 0) {
+        if (req->body == NULL)
+            _multi_addbody(req, "", 0);
+        if (req->body != NULL)
+            req->body[req->bodylen] = '\0';
+        req->callback(req->userdata, req->rescode, req->resheaders,
+                      req->body, req->bodylen);
+    } else {
+        DEBUG("request failed. (%d)", err);
+        errno = err;
+        req->callback(req->userdata, HTTP_NO_RESPONSE, req->resheaders, NULL,
+                      0);
+    }
+
+    _multi_freereq(req);
+}
+
+static void _multi_freereq(struct qhttpclient_multireq_s *req) {
+    if (req->fd >= 0)
+        close(req->fd);
+    if (req->resheaders != NULL)
+        req->resheaders->free(req->resheaders);
+    qlibc_free(req->out);
+    qlibc_free(req->in);
+    qlibc_free(req->body);
+    qlibc_free(req);
+}
+
 #endif /* _DOXYGEN_SKIP */
 
 #endif /* DISABLE_QHTTPCLIENT */
@@ -46,6 +46,13 @@
  *   // close and release resources.
  *   log->free(log);
  * @endcode
+ *
+ * With QLOG_OPT_ASYNC, callers only copy messages into a lock-free queue and
+ * a background thread writes them out in batches, so that disk latency stays
+ * off the callers' path. Messages reach the file when the batch gets full,
+ * at every QLOG_ASYNC_FLUSHMS milliseconds, or when qlog->flush() is called.
+ * When the queue is full, callers wait for the writer unless
+ * QLOG_OPT_ASYNC_DROP is given, in which case the message is discarded.
  */
 
 #ifndef DISABLE_QLOG
@@ -60,10 +67,43 @@
 #include <sys/stat.h>
 #include <errno.h>
 #include "qinternal.h"
+#include "utilities/qio.h"
 #include "utilities/qstring.h"
+#include "utilities/qtime.h"
 #include "extensions/qlog.h"
 
 #ifndef _DOXYGEN_SKIP
+
+#define QLOG_ASYNC_QUEUESIZE    (8192)  /*< messages queued in async mode */
+#define QLOG_ASYNC_BATCHSIZE    (64 * 1024)  /*< bytes written at once */
+#define QLOG_ASYNC_FLUSHMS      (1000)  /*< max delay of queued messages */
+#define QLOG_LINE_BUFSIZE       (4096)  /*< per-thread line buffer size */
+
+// lines are built in a per-thread buffer, so no allocation is needed unless
+// a line is longer than the buffer. the timestamp prefix is formatted once
+// per second per thread.
+static __thread char _linebuf[QLOG_LINE_BUFSIZE];
+static __thread time_t _tscache_time = 0;
+static __thread size_t _tscache_len = 0;
+static __thread char _tscache[32];
+
+struct qlog_async_s {
+    qlfring_t *ring;        /*!< messages waiting for the writer */
+    pthread_t thread;       /*!< writer thread */
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;  /*!< wakes up the writer */
+    pthread_cond_t notfull; /*!< wakes up callers waiting for room */
+    pthread_cond_t flushed; /*!< wakes up flush() callers */
+    bool block;             /*!< wait for room when the queue is full */
+    bool sleeping;          /*!< the writer is waiting on wakeup */
+    bool stop;              /*!< the writer must quit */
+    uint64_t flushreq;      /*!< flush requests made */
+    uint64_t flushdone;     /*!< flush requests completed */
+    size_t dropped;         /*!< messages discarded */
+    char *batch;            /*!< data to write at once */
+    size_t batchlen;        /*!< bytes in the batch */
+};
+
 static bool write_(qlog_t *log, const char *str);
 static bool writef(qlog_t *log, const char *format, ...);
 static bool duplicate(qlog_t *log, FILE *outfp, bool flush);
@@ -72,6 +112,16 @@ static void free_(qlog_t *log);
 
 // internal usages
 static bool _real_open(qlog_t *log);
+static bool _write_line(qlog_t *log, const char *line);
+static size_t _timestamp(char *buf);
+static bool _async_start(qlog_t *log, bool block);
+static bool _async_write(qlog_t *log, const char *str);
+static void _async_flush(qlog_t *log);
+static void _async_stop(qlog_t *log);
+static void *_async_writer(void *arg);
+static void _async_drain(qlog_t *log);
+static void _async_writebatch(qlog_t *log);
+static void _async_output(qlog_t *log, const void *buf, size_t size);
 #endif
 
 /**
@@ -96,6 +146,12 @@ static bool _real_open(qlog_t *log);
  *   Available options:
  *   - QLOG_OPT_THREADSAFE - make it thread-safe.
  *   - QLOG_OPT_FLUSH -  flush out buffer everytime.
+ *   - QLOG_OPT_ASYNC - write logs in a background thread. implies
+ *                      QLOG_OPT_THREADSAFE.
+ *   - QLOG_OPT_ASYNC_DROP - with QLOG_OPT_ASYNC, discard messages instead of
+ *                           waiting when the queue is full.
+ *   - QLOG_OPT_TIMESTAMP - prefix lines with local time like
+ *                          "2014-01-31 23:59:59 ".
  *
  * @code
  *   qlog_t *log = qlog("/tmp/qdecoder-%Y%m%d.err", 0644, 86400, QLOG_OPT_THREADSAFE);
@@ -107,7 +163,7 @@ qlog_t *qlog(const char *filepathfmt, mode_t mode, int rotateinterval,
     qlog_t *log;
 
     // malloc qlog_t structure
-    log = (qlog_t *) calloc(1, sizeof(qlog_t));
+    log = (qlog_t *) qlibc_calloc(1, sizeof(qlog_t));
     if (log == NULL) {
         errno = ENOMEM;
         return NULL;
@@ -120,25 +176,43 @@ qlog_t *qlog(const char *filepathfmt, mode_t mode, int rotateinterval,
         log->rotateinterval = rotateinterval;
 
     // handle options
+    if (options & QLOG_OPT_ASYNC) {
+        // the stream is shared with the writer thread.
+        options |= QLOG_OPT_THREADSAFE;
+    }
     if (options & QLOG_OPT_THREADSAFE) {
         Q_MUTEX_NEW(log->qmutex, true);
         if (log->qmutex == NULL) {
             errno = ENOMEM;
-            free(log);
+            qlibc_free(log);
             return NULL;
         }
     }
     if (options & QLOG_OPT_FLUSH) {
         log->logflush = true;
     }
+    if (options & QLOG_OPT_TIMESTAMP) {
+        log->timestamp = true;
+    }
 
     // try to open the log file.
     if (_real_open(log) == false) {
-        free(log);
         Q_MUTEX_DESTROY(log->qmutex);
+        qlibc_free(log);
         return NULL;
     }
 
+    // start the background writer.
+    if (options & QLOG_OPT_ASYNC) {
+        if (_async_start(log, (options & QLOG_OPT_ASYNC_DROP) ? false : true)
+            == false) {
+            fclose(log->fp);
+            Q_MUTEX_DESTROY(log->qmutex);
+            qlibc_free(log);
+            return NULL;
+        }
+    }
+
     // member methods
     log->write = write_;
     log->writef = writef;
@@ -156,35 +230,34 @@ qlog_t *qlog(const char *filepathfmt, mode_t mode, int rotateinterval,
  * @param str       message string
  *
  * @return true if successful, otherewise returns false
+ * @retval errno will be set in error condition.
+ *  - ENOBUFS : The queue is full in QLOG_OPT_ASYNC_DROP mode.
+ *
+ * @note
+ *  In async mode, true only means the message was queued.
  */
 static bool write_(qlog_t *log, const char *str) {
     if (log == NULL || log->fp == NULL)
         return false;
 
-    Q_MUTEX_ENTER(log->qmutex);
-
-    /* duplicate stream */
-    if (log->outfp != NULL) {
-        fprintf(log->outfp, "%s\n", str);
-        if (log->outflush == true)
-            fflush(log->outfp);
-    }
-
-    /* check if log rotation is needed */
-    if (log->nextrotate > 0 && time(NULL) >= log->nextrotate) {
-        _real_open(log);
-    }
+    if (log->timestamp == false)
+        return _write_line(log, str);
 
-    /* log to file */
-    bool ret = false;
-    if (fprintf(log->fp, "%s\n", str) >= 0) {
-        if (log->logflush == true)
-            fflush(log->fp);
-        ret = true;
+    size_t len = strlen(str);
+    char *line = _linebuf;
+    if (sizeof(_tscache) + len >= sizeof(_linebuf)) {
+        line = (char *) qlibc_malloc(sizeof(_tscache) + len + 1);
+        if (line == NULL) {
+            errno = ENOMEM;
+            return false;
+        }
     }
+    size_t off = _timestamp(line);
+    memcpy(line + off, str, len + 1);
 
-    Q_MUTEX_LEAVE(log->qmutex);
-
+    bool ret = _write_line(log, line);
+    if (line != _linebuf)
+        qlibc_free(line);
     return ret;
 }
 
@@ -200,14 +273,30 @@ static bool writef(qlog_t *log, const char *format, ...) {
     if (log == NULL || log->fp == NULL)
         return false;
 
-    char *str;
-    DYNAMIC_VSPRINTF(str, format);
-    if (str == NULL)
+    size_t off = (log->timestamp == true) ? _timestamp(_linebuf) : 0;
+
+    va_list arglist;
+    va_start(arglist, format);
+    int n = vsnprintf(_linebuf + off, sizeof(_linebuf) - off, format, arglist);
+    va_end(arglist);
+    if (n < 0)
         return false;
+    if (off + n < sizeof(_linebuf))
+        return _write_line(log, _linebuf);
 
-    bool ret = write_(log, str);
+    // too long for the line buffer
+    char *line = (char *) qlibc_malloc(off + n + 1);
+    if (line == NULL) {
+        errno = ENOMEM;
+        return false;
+    }
+    memcpy(line, _linebuf, off);
+    va_start(arglist, format);
+    vsnprintf(line + off, n + 1, format, arglist);
+    va_end(arglist);
 
-    free(str);
+    bool ret = _write_line(log, line);
+    qlibc_free(line);
     return ret;
 }
 
@@ -245,11 +334,18 @@ static bool duplicate(qlog_t *log, FILE *outfp, bool flush) {
  * @param log       a pointer of qlog_t
  *
  * @return true if successful, otherewise returns false
+ *
+ * @note
+ *  In async mode, this waits until the writer has written out every message
+ *  queued before the call.
  */
 static bool flush_(qlog_t *log) {
     if (log == NULL)
         return false;
 
+    if (log->async != NULL)
+        _async_flush(log);
+
     // only flush if flush flag is disabled
     Q_MUTEX_ENTER(log->qmutex);
     if (log->fp != NULL && log->logflush == false)
@@ -270,6 +366,8 @@ static void free_(qlog_t *log) {
     if (log == NULL)
         return;
 
+    if (log->async != NULL)
+        _async_stop(log);
     flush_(log);
     Q_MUTEX_ENTER(log->qmutex);
     if (log->fp != NULL) {
@@ -278,7 +376,7 @@ static void free_(qlog_t *log) {
     }
     Q_MUTEX_LEAVE(log->qmutex);
     Q_MUTEX_DESTROY(log->qmutex);
-    free(log);
+    qlibc_free(log);
     return;
 }
 
@@ -334,6 +432,267 @@ static bool _real_open(qlog_t *log) {
     return true;
 }
 
+// write a complete line.
+static bool _write_line(qlog_t *log, const char *str) {
+    if (log->async != NULL)
+        return _async_write(log, str);
+
+    Q_MUTEX_ENTER(log->qmutex);
+
+    /* duplicate stream */
+    if (log->outfp != NULL) {
+        fprintf(log->outfp, "%s\n", str);
+        if (log->outflush == true)
+            fflush(log->outfp);
+    }
+
+    /* check if log rotation is needed */
+    if (log->nextrotate > 0 && time(NULL) >= log->nextrotate) {
+        _real_open(log);
+    }
+
+    /* log to file */
+    bool ret = false;
+    if (fprintf(log->fp, "%s\n", str) >= 0) {
+        if (log->logflush == true)
+            fflush(log->fp);
+        ret = true;
+    }
+
+    Q_MUTEX_LEAVE(log->qmutex);
+
+    return ret;
+}
+
+// copy the local time prefix of this second into the buffer.
+static size_t _timestamp(char *buf) {
+    time_t now = qtime_cached_time();
+    if (now != _tscache_time) {
+        struct tm tm;
+        localtime_r(&now, &tm);
+        _tscache_len = strftime(_tscache, sizeof(_tscache),
+                                "%Y-%m-%d %H:%M:%S ", &tm);
+        _tscache_time = now;
+    }
+    memcpy(buf, _tscache, _tscache_len);
+    return _tscache_len;
+}
+
+static bool _async_start(qlog_t *log, bool block) {
+    struct qlog_async_s *as = (struct qlog_async_s *) qlibc_calloc(
+            1, sizeof(struct qlog_async_s));
+    if (as == NULL) {
+        errno = ENOMEM;
+        return false;
+    }
+    as->ring = _q_lfring(QLOG_ASYNC_QUEUESIZE, false);
+    as->batch = (char *) qlibc_malloc(QLOG_ASYNC_BATCHSIZE);
+    if (as->ring == NULL || as->batch == NULL) {
+        if (as->ring != NULL)
+            _q_lfring_free(as->ring);
+        qlibc_free(as->batch);
+        qlibc_free(as);
+        errno = ENOMEM;
+        return false;
+    }
+    as->block = block;
+    pthread_mutex_init(&as->lock, NULL);
+    pthread_cond_init(&as->wakeup, NULL);
+    pthread_cond_init(&as->notfull, NULL);
+    pthread_cond_init(&as->flushed, NULL);
+
+    log->async = as;
+    if (pthread_create(&as->thread, NULL, _async_writer, log) != 0) {
+        DEBUG("_async_start: Can't create writer thread.");
+        log->async = NULL;
+        pthread_cond_destroy(&as->flushed);
+        pthread_cond_destroy(&as->notfull);
+        pthread_cond_destroy(&as->wakeup);
+        pthread_mutex_destroy(&as->lock);
+        _q_lfring_free(as->ring);
+        qlibc_free(as->batch);
+        qlibc_free(as);
+        errno = EAGAIN;
+        return false;
+    }
+
+    return true;
+}
+
+static bool _async_write(qlog_t *log, const char *str) {
+    struct qlog_async_s *as = (struct qlog_async_s *) log->async;
+
+    // queued with the terminating null, which becomes a newline.
+    size_t size = strlen(str) + 1;
+    while (_q_lfring_push(as->ring, str, size) == false) {
+        if (errno != ENOBUFS)
+            return false;
+        if (as->block == false) {
+            __atomic_add_fetch(&as->dropped, 1, __ATOMIC_RELAXED);
+            errno = ENOBUFS;
+            return false;
+        }
+        pthread_mutex_lock(&as->lock);
+        pthread_cond_signal(&as->wakeup);
+        pthread_cond_wait(&as->notfull, &as->lock);
+        pthread_mutex_unlock(&as->lock);
+    }
+
+    // don't let the queue get full while the writer sleeps.
+    if (__atomic_load_n(&as->sleeping, __ATOMIC_ACQUIRE) == true
+        && _q_lfring_size(as->ring) > _q_lfring_capacity(as->ring) / 2) {
+        pthread_mutex_lock(&as->lock);
+        pthread_cond_signal(&as->wakeup);
+        pthread_mutex_unlock(&as->lock);
+    }
+
+    return true;
+}
+
+static void _async_flush(qlog_t *log) {
+    struct qlog_async_s *as = (struct qlog_async_s *) log->async;
+
+    pthread_mutex_lock(&as->lock);
+    uint64_t req = ++as->flushreq;
+    pthread_cond_signal(&as->wakeup);
+    while (as->flushdone < req) {
+        pthread_cond_wait(&as->flushed, &as->lock);
+    }
+    pthread_mutex_unlock(&as->lock);
+}
+
+static void _async_stop(qlog_t *log) {
+    struct qlog_async_s *as = (struct qlog_async_s *) log->async;
+
+    pthread_mutex_lock(&as->lock);
+    as->stop = true;
+    pthread_cond_signal(&as->wakeup);
+    pthread_mutex_unlock(&as->lock);
+    pthread_join(as->thread, NULL);
+
+    if (as->dropped > 0) {
+        DEBUG("_async_stop: %zu messages were dropped.", as->dropped);
+    }
+
+    log->async = NULL;
+    pthread_cond_destroy(&as->flushed);
+    pthread_cond_destroy(&as->notfull);
+    pthread_cond_destroy(&as->wakeup);
+    pthread_mutex_destroy(&as->lock);
+    _q_lfring_free(as->ring);
+    qlibc_free(as->batch);
+    qlibc_free(as);
+}
+
+static void *_async_writer(void *arg) {
+    qlog_t *log = (qlog_t *) arg;
+    struct qlog_async_s *as = (struct qlog_async_s *) log->async;
+    long lastwrite = qtime_monotonic_coarse_ms();
+
+    while (true) {
+        pthread_mutex_lock(&as->lock);
+        uint64_t flushreq = as->flushreq;
+        bool stop = as->stop;
+        pthread_mutex_unlock(&as->lock);
+
+        // everything queued before the requests were read goes out now.
+        _async_drain(log);
+        long now = qtime_monotonic_coarse_ms();
+        if (stop == true || flushreq != as->flushdone
+            || now - lastwrite >= QLOG_ASYNC_FLUSHMS) {
+            _async_writebatch(log);
+            lastwrite = now;
+        }
+
+        pthread_mutex_lock(&as->lock);
+        as->flushdone = flushreq;
+        pthread_cond_broadcast(&as->flushed);
+        pthread_cond_broadcast(&as->notfull);
+        if (stop == true) {
+            pthread_mutex_unlock(&as->lock);
+            break;
+        }
+
+        // sleep until the next flush time unless there's more to do.
+        __atomic_store_n(&as->sleeping, true, __ATOMIC_SEQ_CST);
+        if (_q_lfring_size(as->ring) == 0 && as->stop == false
+            && as->flushreq == flushreq) {
+            long until = lastwrite + QLOG_ASYNC_FLUSHMS;
+            struct timeval tv;
+            gettimeofday(&tv, NULL);
+            long waitms = until - now;
+            if (waitms < 1)
+                waitms = 1;
+            struct timespec ts;
+            long nsec = tv.tv_usec * 1000L + (waitms % 1000) * 1000000L;
+            ts.tv_sec = tv.tv_sec + waitms / 1000 + nsec / 1000000000L;
+            ts.tv_nsec = nsec % 1000000000L;
+            pthread_cond_timedwait(&as->wakeup, &as->lock, &ts);
+        }
+        __atomic_store_n(&as->sleeping, false, __ATOMIC_SEQ_CST);
+        pthread_mutex_unlock(&as->lock);
+    }
+
+    return NULL;
+}
+
+// move queued messages into the batch, writing it out whenever it's full.
+static void _async_drain(qlog_t *log) {
+    struct qlog_async_s *as = (struct qlog_async_s *) log->async;
+
+    while (true) {
+        size_t size;
+        char *msg = (char *) _q_lfring_pop(as->ring, &size);
+        if (msg == NULL) {
+            if (errno == ENOMEM)
+                continue;
+            break;
+        }
+        msg[size - 1] = '\n';
+
+        if (as->batchlen + size > QLOG_ASYNC_BATCHSIZE)
+            _async_writebatch(log);
+        if (size > QLOG_ASYNC_BATCHSIZE) {
+            _async_output(log, msg, size);
+        } else {
+            memcpy(as->batch + as->batchlen, msg, size);
+            as->batchlen += size;
+        }
+        qlibc_free(msg);
+    }
+}
+
+static void _async_writebatch(qlog_t *log) {
+    struct qlog_async_s *as = (struct qlog_async_s *) log->async;
+    if (as->batchlen == 0)
+        return;
+    _async_output(log, as->batch, as->batchlen);
+    as->batchlen = 0;
+}
+
+static void _async_output(qlog_t *log, const void *buf, size_t size) {
+    Q_MUTEX_ENTER(log->qmutex);
+
+    /* duplicate stream */
+    if (log->outfp != NULL) {
+        fwrite(buf, 1, size, log->outfp);
+        if (log->outflush == true)
+            fflush(log->outfp);
+    }
+
+    /* check if log rotation is needed */
+    if (log->nextrotate > 0 && time(NULL) >= log->nextrotate) {
+        _real_open(log);
+    }
+
+    /* the stream is never written through stdio in async mode */
+    if (qio_write(fileno(log->fp), buf, size, -1) != (ssize_t) size) {
+        DEBUG("_async_output: Can't write log file '%s'.", log->filepath);
+    }
+
+    Q_MUTEX_LEAVE(log->qmutex);
+}
+
 #endif
 
 #endif /* DISABLE_QLOG */
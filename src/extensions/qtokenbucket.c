@@ -29,7 +29,8 @@
 /**
  * @file qtokenbucket.c Token Bucket implementation.
  *
- * Current implementation is not thread-safe.
+ * qtokenbucket_t is not thread-safe. qtokenbucket_sharded_t is a lock-free
+ * variant for many threads or processes sharing one limit.
  *
  * More information about token-bucket:
  *   http://en.wikipedia.org/wiki/Token_bucket
@@ -47,20 +48,106 @@
  *     do_something();
  *   }
  * @endcode
+ *
+ * qtokenbucket_sharded_t splits the tokens into a central pool and per-CPU
+ * shards. A consumer takes tokens from the shard of the CPU it runs on with
+ * a single compare-and-swap, so threads on different CPUs don't bounce the
+ * same cache line. An empty shard takes a batch from the central pool, and
+ * when that is empty too, tokens are stolen from the other shards, so the
+ * limit is never under-used. The central pool is refilled at most once per
+ * millisecond by whichever consumer notices it first, using the coarse
+ * monotonic clock. The refiller also pulls excess tokens back from the
+ * shards so that idle CPUs don't hoard them.
+ *
+ * @code
+ *   // shared by all threads
+ *   qtokenbucket_sharded_t bucket;
+ *   qtokenbucket_sharded_init(&bucket, 500, 1000, 100000);
+ *
+ *   // or shared by multiple processes
+ *   int shmid = qshm_init(NULL, 0, sizeof(qtokenbucket_sharded_t), true);
+ *   qtokenbucket_sharded_t *bucket = qshm_get(shmid);
+ *   qtokenbucket_sharded_init(bucket, 500, 1000, 100000);
+ *
+ *   // each thread or process
+ *   if (qtokenbucket_sharded_consume(bucket, 1) == false) {
+ *     usleep(qtokenbucket_sharded_waittime(bucket, 1) * 1000);
+ *   }
+ * @endcode
+ *
+ * qtokenbucket_table_t keeps a bucket per key, such as a client address,
+ * in a qhasharr. Buckets are updated in place in their slots, so a request
+ * costs one hash lookup and no allocation. A bucket which stays idle for
+ * idle_sec expires and its slot is reused once the table is full. Use
+ * QHASHARR_EVICT for the table to also drop the least recently used
+ * buckets when it's full of active ones. With QHASHARR_CONCURRENT, the
+ * table can be shared by threads, or by processes through qshm.
+ *
+ * @code
+ *   // a million clients, 10 requests per second with bursts of 20.
+ *   size_t memsize = qhasharr_calculate_memsize(1000000);
+ *   int shmid = qshm_init("/some/file", 'r', memsize, true);
+ *   qhasharr_t *store = qhasharr_opt(qshm_get(shmid), memsize, 0, 0,
+ *                                    QHASHARR_CONCURRENT | QHASHARR_EVICT);
+ *   qtokenbucket_table_t *limiter = qtokenbucket_table(store, 20, 10, 60);
+ *
+ *   if (qtokenbucket_table_consume(limiter, client_ip, 1) == false) {
+ *     // reject the request
+ *   }
+ * @endcode
  */
 
 #include "extensions/qtokenbucket.h"
 
 #include <stdio.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
 #include <sys/time.h>
 #include "utilities/qtime.h"
 #include "qinternal.h"
 
 #ifndef _DOXYGEN_SKIP
+
+#define TOKEN_UNIT          (1000)      /* tokens are counted in 1/1000 */
+#define REFILL_INTERVAL_NS  (1000000)   /* refill central pool every 1ms */
+#define BATCH_DIVISOR       (4)         /* batch = max / (shards * this) */
+
+#define LOAD_RELAXED(p)     __atomic_load_n(p, __ATOMIC_RELAXED)
+#define CAS_WEAK(p, e, v)   __atomic_compare_exchange_n(p, e, v, true,       \
+                                                        __ATOMIC_ACQ_REL,   \
+                                                        __ATOMIC_RELAXED)
+#define FETCH_ADD(p, v)     __atomic_fetch_add(p, v, __ATOMIC_ACQ_REL)
+
+/* bucket kept in a qtokenbucket_table slot */
+struct qtokenbucket_entry_s {
+    int64_t tokens;     /* tokens in 1/1000 unit */
+    int64_t last_fill;  /* last refill time in milliseconds */
+};
+
+/* argument of _table_update() */
+struct qtokenbucket_update_s {
+    qtokenbucket_table_t *tbl;
+    int64_t now;        /* milliseconds */
+    int64_t need;       /* tokens to take in 1/1000 unit */
+    bool ok;            /* result */
+};
+
 /* internal functions */
 static void refill_tokens(qtokenbucket_t *bucket);
+static void _sharded_refill(qtokenbucket_sharded_t *bucket);
+static int64_t _sharded_available(qtokenbucket_sharded_t *bucket);
+static bool _take(int64_t *pool, int64_t need);
+static int64_t _take_upto(int64_t *pool, int64_t want);
+static int _shard_index(void);
+static long _clock_ms(void);
+static int64_t _clock_ns(void);
+static void _table_update(void *userdata, void *value, bool created);
+
 #endif
 
 /**
@@ -79,7 +166,7 @@ void qtokenbucket_init(qtokenbucket_t *bucket, int init_tokens, int max_tokens,
     bucket->tokens = init_tokens;
     bucket->max_tokens = max_tokens;
     bucket->tokens_per_sec = tokens_per_sec;
-    bucket->last_fill = qtime_current_milli();
+    bucket->last_fill = _clock_ms();
 }
 
 /**
@@ -117,12 +204,231 @@ long qtokenbucket_waittime(qtokenbucket_t *bucket, int tokens) {
     return estimate_milli;
 }
 
+/**
+ * Initialize the sharded token bucket.
+ *
+ * @param bucket
+ *      bucket to initialize. It can be in shared memory.
+ * @param init_tokens
+ *      the initial number of tokens.
+ * @param max_tokens
+ *      maximum number of tokens in the bucket.
+ * @param tokens_per_sec
+ *      number of tokens to fill per a second.
+ *
+ * @return true if successful, otherwise returns false
+ * @retval errno will be set in error condition.
+ *  - EINVAL : Invalid argument.
+ */
+bool qtokenbucket_sharded_init(qtokenbucket_sharded_t *bucket,
+                               int init_tokens, int max_tokens,
+                               int tokens_per_sec) {
+    if (bucket == NULL || max_tokens <= 0 || tokens_per_sec <= 0
+            || init_tokens < 0) {
+        errno = EINVAL;
+        return false;
+    }
+
+    memset(bucket, 0, sizeof(qtokenbucket_sharded_t));
+    bucket->max_tokens = (int64_t) max_tokens * TOKEN_UNIT;
+    bucket->tokens_per_sec = tokens_per_sec;
+    bucket->batch = bucket->max_tokens / (QTOKENBUCKET_SHARDS * BATCH_DIVISOR);
+    if (bucket->batch < TOKEN_UNIT)
+        bucket->batch = TOKEN_UNIT;
+    bucket->tokens = (int64_t) ((init_tokens < max_tokens) ?
+                                init_tokens : max_tokens) * TOKEN_UNIT;
+    bucket->last_fill = _clock_ns();
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    return true;
+}
+
+/**
+ * Consume tokens from the sharded bucket. It's safe to call concurrently.
+ *
+ * @param bucket sharded tokenbucket object.
+ * @param tokens number of tokens to request.
+ *
+ * @return return true if there are enough tokens, otherwise false.
+ */
+bool qtokenbucket_sharded_consume(qtokenbucket_sharded_t *bucket, int tokens) {
+    if (tokens <= 0)
+        return true;
+    int64_t need = (int64_t) tokens * TOKEN_UNIT;
+    int idx = _shard_index();
+
+    // fast path, tokens cached by this CPU's shard.
+    if (_take(&bucket->shards[idx].tokens, need) == true)
+        return true;
+
+    // take a batch from the central pool, keep the rest in the shard.
+    _sharded_refill(bucket);
+    int64_t got = _take_upto(&bucket->tokens, need + bucket->batch);
+    if (got >= need) {
+        if (got > need)
+            FETCH_ADD(&bucket->shards[idx].tokens, got - need);
+        return true;
+    }
+
+    // steal from the other shards.
+    int i;
+    for (i = 0; i < QTOKENBUCKET_SHARDS && got < need; i++) {
+        got += _take_upto(&bucket->shards[i].tokens, need - got);
+    }
+    if (got >= need)
+        return true;
+
+    if (got > 0)
+        FETCH_ADD(&bucket->tokens, got);
+    return false;
+}
+
+/**
+ * Get the estimate time until given number of token is ready.
+ *
+ * @param bucket sharded tokenbucket object.
+ * @param tokens number of tokens
+ *
+ * @return estimated milliseconds
+ */
+long qtokenbucket_sharded_waittime(qtokenbucket_sharded_t *bucket,
+                                   int tokens) {
+    _sharded_refill(bucket);
+    int64_t need = (int64_t) tokens * TOKEN_UNIT;
+    int64_t avail = _sharded_available(bucket);
+    if (avail >= need) {
+        return 0;
+    }
+    // 1/1000 tokens divided by tokens per second is milliseconds.
+    int64_t deficit = need - avail;
+    return (long) ((deficit + bucket->tokens_per_sec - 1)
+                   / bucket->tokens_per_sec);
+}
+
+/**
+ * Create a keyed token bucket table.
+ *
+ * @param store
+ *      qhasharr to keep buckets in. Its value size must be 16 bytes or
+ *      bigger, which the default is.
+ * @param max_tokens
+ *      maximum number of tokens of a bucket. A new bucket starts full.
+ * @param tokens_per_sec
+ *      number of tokens to fill per a second.
+ * @param idle_sec
+ *      seconds after which an unused bucket expires, 0 for never.
+ *
+ * @return qtokenbucket_table_t pointer if successful, otherwise NULL.
+ * @retval errno will be set in error condition.
+ *  - EINVAL : Invalid argument.
+ *  - ENOMEM : Memory allocation failure.
+ *
+ * @note
+ *  The store isn't freed by qtokenbucket_table_free(). Every process
+ *  sharing a store should use the same parameters.
+ */
+qtokenbucket_table_t *qtokenbucket_table(qhasharr_t *store, int max_tokens,
+                                         int tokens_per_sec, int idle_sec) {
+    if (store == NULL || max_tokens <= 0 || tokens_per_sec <= 0
+            || idle_sec < 0
+            || store->data->valuesize < sizeof(struct qtokenbucket_entry_s)) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    qtokenbucket_table_t *tbl = (qtokenbucket_table_t *) qlibc_calloc(
+            1, sizeof(qtokenbucket_table_t));
+    if (tbl == NULL) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    tbl->store = store;
+    tbl->max_tokens = max_tokens;
+    tbl->tokens_per_sec = tokens_per_sec;
+    tbl->idle_sec = idle_sec;
+
+    return tbl;
+}
+
+/**
+ * Consume tokens from the bucket of a key.
+ *
+ * @param tbl    qtokenbucket_table object.
+ * @param key    key of the bucket.
+ * @param tokens number of tokens to request.
+ *
+ * @return return true if there are enough tokens, otherwise false.
+ * @retval errno will be set when the bucket couldn't be stored.
+ *  - ENOBUFS : The table is full of active buckets.
+ *  - EINVAL  : Invalid argument.
+ */
+bool qtokenbucket_table_consume(qtokenbucket_table_t *tbl, const char *key,
+                                int tokens) {
+    if (tbl == NULL || key == NULL) {
+        errno = EINVAL;
+        return false;
+    }
+
+    struct qtokenbucket_update_s arg;
+    arg.tbl = tbl;
+    arg.now = _clock_ms();
+    arg.need = (int64_t) ((tokens > 0) ? tokens : 0) * TOKEN_UNIT;
+    arg.ok = false;
+    if (tbl->store->update(tbl->store, key, sizeof(struct qtokenbucket_entry_s),
+                           tbl->idle_sec, _table_update, &arg) == false) {
+        return false;
+    }
+    return arg.ok;
+}
+
+/**
+ * Get the estimate time until given number of token is ready for a key.
+ *
+ * @param tbl    qtokenbucket_table object.
+ * @param key    key of the bucket.
+ * @param tokens number of tokens
+ *
+ * @return estimated milliseconds
+ */
+long qtokenbucket_table_waittime(qtokenbucket_table_t *tbl, const char *key,
+                                 int tokens) {
+    if (tbl == NULL || key == NULL)
+        return 0;
+
+    size_t size;
+    struct qtokenbucket_entry_s *entry = tbl->store->get(tbl->store, key,
+                                                         &size);
+    if (entry == NULL)
+        return 0;  // new bucket starts full
+
+    int64_t avail = entry->tokens;
+    int64_t elapsed = _clock_ms() - entry->last_fill;
+    if (size == sizeof(struct qtokenbucket_entry_s) && elapsed > 0)
+        avail += elapsed * tbl->tokens_per_sec;
+    qlibc_free(entry);
+
+    int64_t need = (int64_t) tokens * TOKEN_UNIT;
+    if (avail >= need)
+        return 0;
+    return (long) ((need - avail + tbl->tokens_per_sec - 1)
+                   / tbl->tokens_per_sec);
+}
+
+/**
+ * Free the keyed token bucket table. The store is left as it is.
+ *
+ * @param tbl    qtokenbucket_table object.
+ */
+void qtokenbucket_table_free(qtokenbucket_table_t *tbl) {
+    qlibc_free(tbl);
+}
+
 #ifndef _DOXYGEN_SKIP
 /**
  * Refill tokens.
  */
 static void refill_tokens(qtokenbucket_t *bucket) {
-    long now = qtime_current_milli();
+    long now = _clock_ms();
     if (bucket->tokens < bucket->max_tokens) {
         double new_tokens = (now - bucket->last_fill) * 0.001
                 * bucket->tokens_per_sec;
@@ -132,4 +438,139 @@ static void refill_tokens(qtokenbucket_t *bucket) {
     }
     bucket->last_fill = now;
 }
+
+/**
+ * Refill the central pool of sharded bucket. Only one caller wins each
+ * interval, and it also returns excess tokens of the shards to the pool.
+ */
+static void _sharded_refill(qtokenbucket_sharded_t *bucket) {
+    int64_t now = _clock_ns();
+    int64_t last = LOAD_RELAXED(&bucket->last_fill);
+    int64_t elapsed = now - last;
+    if (elapsed < REFILL_INTERVAL_NS)
+        return;
+
+    // 1/1000 tokens per nanosecond is tokens_per_sec / 1000000.
+    int64_t fullns = bucket->max_tokens * 1000000 / bucket->tokens_per_sec + 1;
+    int64_t add, newlast;
+    if (elapsed >= fullns) {
+        add = bucket->max_tokens;
+        newlast = now;
+    } else {
+        add = elapsed * bucket->tokens_per_sec / 1000000;
+        newlast = last + add * 1000000 / bucket->tokens_per_sec;
+    }
+    if (add <= 0 || CAS_WEAK(&bucket->last_fill, &last, newlast) == false)
+        return;
+
+    int i;
+    for (i = 0; i < QTOKENBUCKET_SHARDS; i++) {
+        int64_t excess = LOAD_RELAXED(&bucket->shards[i].tokens)
+                - bucket->batch;
+        if (excess > 0) {
+            FETCH_ADD(&bucket->tokens,
+                      _take_upto(&bucket->shards[i].tokens, excess));
+        }
+    }
+
+    int64_t room = bucket->max_tokens - _sharded_available(bucket);
+    if (add > room)
+        add = room;
+    if (add > 0)
+        FETCH_ADD(&bucket->tokens, add);
+}
+
+static int64_t _sharded_available(qtokenbucket_sharded_t *bucket) {
+    int64_t avail = LOAD_RELAXED(&bucket->tokens);
+    int i;
+    for (i = 0; i < QTOKENBUCKET_SHARDS; i++) {
+        avail += LOAD_RELAXED(&bucket->shards[i].tokens);
+    }
+    return avail;
+}
+
+static bool _take(int64_t *pool, int64_t need) {
+    int64_t cur = LOAD_RELAXED(pool);
+    while (cur >= need) {
+        if (CAS_WEAK(pool, &cur, cur - need) == true)
+            return true;
+    }
+    return false;
+}
+
+static int64_t _take_upto(int64_t *pool, int64_t want) {
+    int64_t cur = LOAD_RELAXED(pool);
+    while (cur > 0) {
+        int64_t n = (cur < want) ? cur : want;
+        if (CAS_WEAK(pool, &cur, cur - n) == true)
+            return n;
+    }
+    return 0;
+}
+
+static int _shard_index(void) {
+#ifdef __linux__
+    int cpu = sched_getcpu();
+    if (cpu >= 0)
+        return cpu % QTOKENBUCKET_SHARDS;
+#endif
+    static __thread int idx = -1;
+    if (idx < 0) {
+        uint64_t h = (uint64_t) (uintptr_t) pthread_self();
+        idx = (int) ((h ^ (h >> 17)) % QTOKENBUCKET_SHARDS);
+    }
+    return idx;
+}
+
+static long _fixed_ms = 0;
+
+/*
+ * Stop the clock of token buckets at the given milliseconds, 0 to go back
+ * to the monotonic clock. This is for testing refills without sleeping.
+ */
+void _q_tokenbucket_clock(long ms) {
+    __atomic_store_n(&_fixed_ms, ms, __ATOMIC_RELAXED);
+}
+
+static long _clock_ms(void) {
+    long ms = __atomic_load_n(&_fixed_ms, __ATOMIC_RELAXED);
+    return (ms != 0) ? ms : qtime_monotonic_coarse_ms();
+}
+
+static int64_t _clock_ns(void) {
+    return (int64_t) _clock_ms() * 1000000;
+}
+
+/**
+ * Refill and consume a bucket in place. The value isn't aligned.
+ */
+static void _table_update(void *userdata, void *value, bool created) {
+    struct qtokenbucket_update_s *arg = (struct qtokenbucket_update_s *) userdata;
+    int64_t max = (int64_t) arg->tbl->max_tokens * TOKEN_UNIT;
+
+    struct qtokenbucket_entry_s entry;
+    if (created == true) {
+        entry.tokens = max;
+        entry.last_fill = arg->now;
+    } else {
+        memcpy(&entry, value, sizeof(entry));
+        // 1/1000 tokens per millisecond is tokens_per_sec.
+        int64_t elapsed = arg->now - entry.last_fill;
+        if (elapsed > 0 && entry.tokens < max) {
+            int64_t fillms = (max - entry.tokens) / arg->tbl->tokens_per_sec + 1;
+            entry.tokens = (elapsed >= fillms) ? max :
+                    entry.tokens + elapsed * arg->tbl->tokens_per_sec;
+            if (entry.tokens > max)
+                entry.tokens = max;
+        }
+        entry.last_fill = arg->now;
+    }
+
+    if (entry.tokens >= arg->need) {
+        entry.tokens -= arg->need;
+        arg->ok = true;
+    }
+    memcpy(value, &entry, sizeof(entry));
+}
+
 #endif // _DOXYGEN_SKIP
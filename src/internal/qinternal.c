@@ -52,7 +52,7 @@ char *_q_makeword(char *str, char stop) {
 
     for (len = 0; ((str[len] != stop) && (str[len])); len++)
         ;
-    word = (char *) malloc(sizeof(char) * (len + 1));
+    word = (char *) qlibc_malloc(sizeof(char) * (len + 1));
     if (word == NULL)
         return NULL;
 
@@ -29,6 +29,8 @@
 #ifndef _QINTERNAL_H
 #define _QINTERNAL_H
 
+#include "utilities/qsystem.h"
+
 /*
  * Macro Functions
  */
@@ -38,9 +40,9 @@
 #define ENDING_CHAR(s)      (*(s + strlen(s) - 1))
 
 #define DYNAMIC_VSPRINTF(s, f) do {                                     \
-        size_t _strsize;                                                \
-        for(_strsize = 1024; ; _strsize *= 2) {                         \
-            s = (char*)malloc(_strsize);                                \
+        size_t _strsize = 1024;                                         \
+        for(;;) {                                                       \
+            s = (char*)qlibc_malloc(_strsize);                          \
             if(s == NULL) {                                             \
                 DEBUG("DYNAMIC_VSPRINTF(): can't allocate memory.");    \
                 break;                                                  \
@@ -50,84 +52,62 @@
             int _n = vsnprintf(s, _strsize, f, _arglist);               \
             va_end(_arglist);                                           \
             if(_n >= 0 && _n < _strsize) break;                         \
-            free(s);                                                    \
+            qlibc_free_sized(s, _strsize);                              \
+            if(_n < 0 || _strsize > 1024) {                             \
+                s = NULL;                                               \
+                break;                                                  \
+            }                                                           \
+            _strsize = (size_t)_n + 1;  /* retry once in exact size */  \
         }                                                               \
     } while(0)
 
 /*
  * Q_MUTEX Macros
+ *
+ * Q_MUTEX_NEW() makes a mutex, recursive if r is true. Q_RWLOCK_NEW() makes
+ * a reader/writer lock which Q_MUTEX_ENTER() takes exclusively and
+ * Q_MUTEX_ENTER_SHARED() takes shared. Q_MUTEX_ENTER_SHARED() on a plain
+ * mutex is the same as Q_MUTEX_ENTER(). Compile with DISABLE_THREADSAFE to
+ * turn entering and leaving into no-ops for single-threaded builds, or with
+ * BUILD_LOCKSTATS to record acquire counts and wait/hold time histograms
+ * of every lock, labelled by the source file which made it.
  */
 #ifndef _MULTI_THREADED
 #define _MULTI_THREADED
 #endif
 
+#include <stdint.h>
 #include <unistd.h>
 #include <pthread.h>
 
-#define Q_MUTEX_NEW(x,r) do {                                           \
-        x = (qmutex_t *)calloc(1, sizeof(qmutex_t));                    \
-        if(x == NULL) break;                                            \
-        memset((void*)x, 0, sizeof(qmutex_t));                          \
-        pthread_mutexattr_t _mutexattr;                                 \
-        pthread_mutexattr_init(&_mutexattr);                            \
-        if(r == true) {                                                 \
-            pthread_mutexattr_settype(&_mutexattr, PTHREAD_MUTEX_RECURSIVE); \
-        }                                                               \
-        int _ret = pthread_mutex_init(&(x->mutex), &_mutexattr);        \
-        pthread_mutexattr_destroy(&_mutexattr);                         \
-        if(_ret != 0) {                                                 \
-            char _errmsg[64];                                           \
-            strerror_r(_ret, _errmsg, sizeof(_errmsg));                 \
-            DEBUG("Q_MUTEX: can't initialize mutex. [%d:%s]", _ret, _errmsg); \
-            free(x);                                                    \
-            x = NULL;                                                   \
-        }                                                               \
-    } while(0)
+#define Q_MUTEX_NEW(x,r)        x = _q_mutex(r, false, __FILE__)
+#define Q_RWLOCK_NEW(x)         x = _q_mutex(true, true, __FILE__)
+#define Q_MUTEX_DESTROY(x)      _q_mutex_free(x)
 
-#define Q_MUTEX_LEAVE(x) do {                                           \
-        if(x == NULL) break;                                            \
-        if(!pthread_equal(x->owner, pthread_self())) {                  \
-            DEBUG("Q_MUTEX: unlock - owner mismatch.");                 \
-        }                                                               \
-        if((x->count--) < 0) x->count = 0;                              \
-        pthread_mutex_unlock(&(x->mutex));                              \
-    } while(0)
-
-#define MAX_MUTEX_LOCK_WAIT (5000)
-#define Q_MUTEX_ENTER(x) do {                                           \
-        if(x == NULL) break;                                            \
-        while(true) {                                                   \
-            int _ret, i;                                                \
-            for(i = 0; (_ret = pthread_mutex_trylock(&(x->mutex))) != 0 \
-                        && i < MAX_MUTEX_LOCK_WAIT; i++) {              \
-                if(i == 0) {                                            \
-                    DEBUG("Q_MUTEX: mutex is already locked - retrying"); \
-                }                                                       \
-                usleep(1);                                              \
-            }                                                           \
-            if(_ret == 0) break;                                        \
-            char _errmsg[64];                                           \
-            strerror_r(_ret, _errmsg, sizeof(_errmsg));                 \
-            DEBUG("Q_MUTEX: can't get lock - force to unlock. [%d:%s]", \
-                  _ret, _errmsg);                                       \
-            Q_MUTEX_LEAVE(x);                                           \
-        }                                                               \
-        x->count++;                                                     \
-        x->owner = pthread_self();                                      \
-    } while(0)
+#ifndef DISABLE_THREADSAFE
+#define Q_MUTEX_ENTER(x)        _q_mutex_enter(x)
+#define Q_MUTEX_ENTER_SHARED(x) _q_mutex_enter_shared(x)
+#define Q_MUTEX_LEAVE(x)        _q_mutex_leave(x)
+#else
+#define Q_MUTEX_ENTER(x)        ((void) (x))
+#define Q_MUTEX_ENTER_SHARED(x) ((void) (x))
+#define Q_MUTEX_LEAVE(x)        ((void) (x))
+#endif
 
-#define Q_MUTEX_DESTROY(x) do {                                         \
-        if(x == NULL) break;                                            \
-        if(x->count != 0) DEBUG("Q_MUTEX: mutex counter is not 0.");    \
-        int _ret;                                                       \
-        while((_ret = pthread_mutex_destroy(&(x->mutex))) != 0) {       \
-            char _errmsg[64];                                           \
-            strerror_r(_ret, _errmsg, sizeof(_errmsg));                 \
-            DEBUG("Q_MUTEX: force to unlock mutex. [%d:%s]", _ret, _errmsg); \
-            Q_MUTEX_LEAVE(x);                                           \
-        }                                                               \
-        free(x);                                                        \
-    } while(0)
+/*
+ * Q_STATS Macros
+ *
+ * Get/put hit and miss counters reported by stats() of containers. They're
+ * counted only with BUILD_STATS (--enable-stats) since an atomic add on
+ * every lookup isn't free on a table shared by many threads.
+ */
+#ifdef BUILD_STATS
+#define Q_STATS_INC(c)          __atomic_fetch_add(&(c), 1, __ATOMIC_RELAXED)
+#define Q_STATS_LOAD(c)         __atomic_load_n(&(c), __ATOMIC_RELAXED)
+#else
+#define Q_STATS_INC(c)          ((void) 0)
+#define Q_STATS_LOAD(c)         ((uint64_t) 0)
+#endif
 
 /*
  * Debug Macros
@@ -168,6 +148,12 @@
  */
 #define MAX_HUMANOUT        (60)
 
+#if defined(__GNUC__)
+#define Q_PREFETCH(addr)    __builtin_prefetch(addr)
+#else
+#define Q_PREFETCH(addr)
+#endif
+
 /*
  * qInternal.c
  */
@@ -176,4 +162,98 @@ extern char _q_x2c(char hex_up, char hex_low);
 extern char *_q_makeword(char *str, char stop);
 extern void _q_humanOut(FILE *fp, void *data, size_t size, size_t max);
 
+/*
+ * qrcu.c
+ */
+extern void _q_rcu_stall(void (*stall)(void));
+
+/*
+ * qencode.c
+ */
+extern int _q_encode_simd(int max);
+
+/*
+ * qtokenbucket.c
+ */
+extern void _q_tokenbucket_clock(long ms);
+
+/*
+ * qmutex.c
+ */
+struct qmutex_s;
+
+extern struct qmutex_s *_q_mutex(bool recursive, bool shared,
+                                 const char *label);
+extern void _q_mutex_enter(struct qmutex_s *x);
+extern void _q_mutex_enter_shared(struct qmutex_s *x);
+extern void _q_mutex_leave(struct qmutex_s *x);
+extern uint64_t _q_mutex_waitns(struct qmutex_s *x);
+extern void _q_mutex_free(struct qmutex_s *x);
+extern bool _q_mutex_dump(FILE *out, bool json);
+extern void _q_mutex_reset(void);
+
+/*
+ * qring.c
+ */
+typedef struct qring_s qring_t;
+
+extern qring_t *_q_ring(bool threadsafe);
+extern size_t _q_ring_setsize(qring_t *ring, size_t max);
+extern bool _q_ring_add(qring_t *ring, bool front, const void *data,
+                        size_t size);
+extern void *_q_ring_get(qring_t *ring, int index, size_t *size, bool newmem,
+                         bool remove);
+extern size_t _q_ring_read(qring_t *ring, int index, void *buf,
+                          size_t bufsize, bool remove);
+extern size_t _q_ring_size(qring_t *ring);
+extern void _q_ring_clear(qring_t *ring);
+extern bool _q_ring_debug(qring_t *ring, FILE *out);
+extern void _q_ring_free(qring_t *ring);
+
+/*
+ * qlfring.c
+ */
+typedef struct qlfring_s qlfring_t;
+
+extern qlfring_t *_q_lfring(size_t capacity, bool spsc);
+extern size_t _q_lfring_capacity(qlfring_t *ring);
+extern bool _q_lfring_push(qlfring_t *ring, const void *data, size_t size);
+extern void *_q_lfring_pop(qlfring_t *ring, size_t *size);
+extern size_t _q_lfring_read(qlfring_t *ring, void *buf, size_t bufsize);
+extern size_t _q_lfring_size(qlfring_t *ring);
+extern void _q_lfring_clear(qlfring_t *ring);
+extern void _q_lfring_free(qlfring_t *ring);
+
+/*
+ * qsnap.c
+ */
+typedef struct qsnap_s qsnap_t;
+typedef struct qsnap_rec_s qsnap_rec_t;
+
+enum {
+    Q_SNAP_QHASHTBL = 1,
+    Q_SNAP_QLISTTBL,
+    Q_SNAP_QLIST,
+    Q_SNAP_QVECTOR
+};
+
+struct qsnap_rec_s {
+    uint32_t hash;      /*!< stored hash of the key */
+    const char *name;   /*!< NULL terminated key */
+    size_t namelen;     /*!< key length */
+    const void *data;   /*!< data */
+    size_t size;        /*!< data size */
+};
+
+extern qsnap_t *_q_snap_create(const char *filepath, uint32_t type,
+                               uint32_t flags);
+extern bool _q_snap_write(qsnap_t *snap, uint32_t hash, const char *name,
+                          size_t namelen, const void *data, size_t size);
+extern bool _q_snap_commit(qsnap_t *snap);
+extern void _q_snap_abort(qsnap_t *snap);
+extern qsnap_t *_q_snap_open(const char *filepath, uint32_t type,
+                             uint32_t *flags, size_t *num);
+extern bool _q_snap_read(qsnap_t *snap, qsnap_rec_t *rec);
+extern void _q_snap_close(qsnap_t *snap);
+
 #endif  /* _QINTERNAL_H */
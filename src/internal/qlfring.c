@@ -0,0 +1,291 @@
+/******************************************************************************
+ * qLibc
+ *
+ * Copyright (c) 2010-2014 Seungyoung Kim.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *****************************************************************************/
+
+/*
+ * Bounded lock-free ring buffer engine for qqueue.
+ *
+ * Two designs are provided. The single-producer single-consumer ring needs
+ * only a load-acquire and a store-release per operation. The multi-producer
+ * multi-consumer ring is Dmitry Vyukov's bounded queue, where every cell
+ * carries a sequence number telling whether it's ready to be written or
+ * read, so producers and consumers only contend on a compare-and-swap of
+ * their position counter.
+ *
+ * Like qring.c, elements up to LFRING_INLINE_SIZE bytes are stored in the
+ * cell itself and bigger ones are malloced before the cell is claimed.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include "qinternal.h"
+
+#define LFRING_INLINE_SIZE (24)
+#define CACHELINE_SIZE (64)
+
+#define LOAD_ACQUIRE(p)     __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define LOAD_RELAXED(p)     __atomic_load_n(p, __ATOMIC_RELAXED)
+#define STORE_RELEASE(p, v) __atomic_store_n(p, v, __ATOMIC_RELEASE)
+#define CAS_WEAK(p, e, v)   __atomic_compare_exchange_n(p, e, v, true,       \
+                                                        __ATOMIC_RELAXED,   \
+                                                        __ATOMIC_RELAXED)
+
+typedef struct qlfring_cell_s qlfring_cell_t;
+
+struct qlfring_cell_s {
+    size_t seq;         /*!< cell sequence, used by MPMC only */
+    size_t size;        /*!< data size */
+    union {
+        void *ptr;      /*!< malloced data if size > LFRING_INLINE_SIZE */
+        unsigned char data[LFRING_INLINE_SIZE];  /*!< inline data */
+    } u;
+};
+
+struct qlfring_s {
+    qlfring_cell_t *cells;  /*!< cell array */
+    size_t mask;        /*!< number of cells - 1 */
+    bool spsc;          /*!< single producer and single consumer */
+
+    // keep producer and consumer positions on different cache lines.
+    char pad0[CACHELINE_SIZE];
+    size_t tail;        /*!< producer position */
+    char pad1[CACHELINE_SIZE - sizeof(size_t)];
+    size_t head;        /*!< consumer position */
+    char pad2[CACHELINE_SIZE - sizeof(size_t)];
+};
+
+#define CELL_DATA(c) (((c)->size > LFRING_INLINE_SIZE) ? (c)->u.ptr : (c)->u.data)
+
+static qlfring_cell_t *_claim_push(qlfring_t *ring, size_t *pos);
+static qlfring_cell_t *_claim_pop(qlfring_t *ring, size_t *pos);
+static void _release_push(qlfring_t *ring, qlfring_cell_t *cell, size_t pos);
+static void _release_pop(qlfring_t *ring, qlfring_cell_t *cell, size_t pos);
+
+qlfring_t *_q_lfring(size_t capacity, bool spsc) {
+    if (capacity == 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+    size_t cap = 2;
+    while (cap < capacity)
+        cap *= 2;
+
+    qlfring_t *ring = (qlfring_t *) qlibc_calloc(1, sizeof(qlfring_t));
+    if (ring == NULL) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    ring->cells = (qlfring_cell_t *) qlibc_calloc(cap, sizeof(qlfring_cell_t));
+    if (ring->cells == NULL) {
+        qlibc_free(ring);
+        errno = ENOMEM;
+        return NULL;
+    }
+    size_t i;
+    for (i = 0; i < cap; i++) {
+        ring->cells[i].seq = i;
+    }
+    ring->mask = cap - 1;
+    ring->spsc = spsc;
+
+    return ring;
+}
+
+size_t _q_lfring_capacity(qlfring_t *ring) {
+    return ring->mask + 1;
+}
+
+bool _q_lfring_push(qlfring_t *ring, const void *data, size_t size) {
+    if (data == NULL || size == 0) {
+        errno = EINVAL;
+        return false;
+    }
+
+    // make a copy before claiming a cell, so failure needs no rollback.
+    void *dup = NULL;
+    if (size > LFRING_INLINE_SIZE) {
+        dup = qlibc_malloc(size);
+        if (dup == NULL) {
+            errno = ENOMEM;
+            return false;
+        }
+        memcpy(dup, data, size);
+    }
+
+    size_t pos;
+    qlfring_cell_t *cell = _claim_push(ring, &pos);
+    if (cell == NULL) {
+        qlibc_free(dup);
+        errno = ENOBUFS;
+        return false;
+    }
+
+    cell->size = size;
+    if (dup != NULL)
+        cell->u.ptr = dup;
+    else
+        memcpy(cell->u.data, data, size);
+
+    _release_push(ring, cell, pos);
+    return true;
+}
+
+// returns malloced element.
+void *_q_lfring_pop(qlfring_t *ring, size_t *size) {
+    size_t pos;
+    qlfring_cell_t *cell = _claim_pop(ring, &pos);
+    if (cell == NULL) {
+        errno = ENOENT;
+        return NULL;
+    }
+
+    void *data;
+    if (cell->size > LFRING_INLINE_SIZE) {
+        data = cell->u.ptr;
+    } else {
+        data = qlibc_malloc(cell->size);
+        if (data == NULL) {
+            // the element is lost but the ring must keep going.
+            _release_pop(ring, cell, pos);
+            errno = ENOMEM;
+            return NULL;
+        }
+        memcpy(data, cell->u.data, cell->size);
+    }
+    if (size != NULL)
+        *size = cell->size;
+
+    _release_pop(ring, cell, pos);
+    return data;
+}
+
+// copy an element into the buffer without memory allocation.
+size_t _q_lfring_read(qlfring_t *ring, void *buf, size_t bufsize) {
+    size_t pos;
+    qlfring_cell_t *cell = _claim_pop(ring, &pos);
+    if (cell == NULL) {
+        errno = ENOENT;
+        return 0;
+    }
+
+    size_t size = cell->size;
+    memcpy(buf, CELL_DATA(cell), (size < bufsize) ? size : bufsize);
+    if (size > LFRING_INLINE_SIZE)
+        qlibc_free(cell->u.ptr);
+
+    _release_pop(ring, cell, pos);
+    return size;
+}
+
+// number of elements, which is only a snapshot under concurrent access.
+size_t _q_lfring_size(qlfring_t *ring) {
+    size_t head = LOAD_ACQUIRE(&ring->head);
+    size_t tail = LOAD_ACQUIRE(&ring->tail);
+    return (tail > head) ? (tail - head) : 0;
+}
+
+void _q_lfring_clear(qlfring_t *ring) {
+    char buf[1];
+    while (_q_lfring_read(ring, buf, 0) > 0);
+}
+
+void _q_lfring_free(qlfring_t *ring) {
+    _q_lfring_clear(ring);
+    qlibc_free(ring->cells);
+    qlibc_free(ring);
+}
+
+static qlfring_cell_t *_claim_push(qlfring_t *ring, size_t *pos) {
+    if (ring->spsc == true) {
+        size_t tail = LOAD_RELAXED(&ring->tail);
+        if (tail - LOAD_ACQUIRE(&ring->head) > ring->mask)
+            return NULL;  // full
+        *pos = tail;
+        return &ring->cells[tail & ring->mask];
+    }
+
+    size_t tail = LOAD_RELAXED(&ring->tail);
+    while (true) {
+        qlfring_cell_t *cell = &ring->cells[tail & ring->mask];
+        intptr_t diff = (intptr_t) LOAD_ACQUIRE(&cell->seq) - (intptr_t) tail;
+        if (diff == 0) {
+            if (CAS_WEAK(&ring->tail, &tail, tail + 1)) {
+                *pos = tail;
+                return cell;
+            }
+        } else if (diff < 0) {
+            return NULL;  // full
+        } else {
+            tail = LOAD_RELAXED(&ring->tail);
+        }
+    }
+}
+
+static qlfring_cell_t *_claim_pop(qlfring_t *ring, size_t *pos) {
+    if (ring->spsc == true) {
+        size_t head = LOAD_RELAXED(&ring->head);
+        if (head == LOAD_ACQUIRE(&ring->tail))
+            return NULL;  // empty
+        *pos = head;
+        return &ring->cells[head & ring->mask];
+    }
+
+    size_t head = LOAD_RELAXED(&ring->head);
+    while (true) {
+        qlfring_cell_t *cell = &ring->cells[head & ring->mask];
+        intptr_t diff = (intptr_t) LOAD_ACQUIRE(&cell->seq)
+                        - (intptr_t) (head + 1);
+        if (diff == 0) {
+            if (CAS_WEAK(&ring->head, &head, head + 1)) {
+                *pos = head;
+                return cell;
+            }
+        } else if (diff < 0) {
+            return NULL;  // empty
+        } else {
+            head = LOAD_RELAXED(&ring->head);
+        }
+    }
+}
+
+static void _release_push(qlfring_t *ring, qlfring_cell_t *cell, size_t pos) {
+    if (ring->spsc == true)
+        STORE_RELEASE(&ring->tail, pos + 1);
+    else
+        STORE_RELEASE(&cell->seq, pos + 1);
+}
+
+static void _release_pop(qlfring_t *ring, qlfring_cell_t *cell, size_t pos) {
+    if (ring->spsc == true)
+        STORE_RELEASE(&ring->head, pos + 1);
+    else
+        STORE_RELEASE(&cell->seq, pos + ring->mask + 1);
+}
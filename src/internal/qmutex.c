@@ -0,0 +1,553 @@
+/******************************************************************************
+ * qLibc
+ *
+ * Copyright (c) 2010-2014 Seungyoung Kim.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *****************************************************************************/
+
+/*
+ * Lock layer behind the Q_MUTEX macros.
+ *
+ * A qmutex_t is either a recursive mutex or a reader/writer lock. Both
+ * spin for a short while with backoff before parking in the kernel, since
+ * container critical sections are short and a waiter which parks right
+ * away pays two context switches for a lock that would have been free in
+ * a few hundred cycles. The writer side of the reader/writer lock is
+ * recursive by owner tracking, and a shared entry by the writing thread
+ * nests into its write lock, so a thread which holds lock() can still call
+ * the getters of its own container.
+ *
+ * The time from the first failed attempt to the acquisition is added up in
+ * waitns, so stats() of a container can tell how long its callers have
+ * been blocked. An uncontended entry never reads the clock.
+ *
+ * With BUILD_LOCKSTATS, every lock also keeps acquire counts and log2
+ * histograms of contended wait time and exclusive hold time, and is linked
+ * into a registry which qlockstats_dump() prints. The hold time of shared
+ * entries isn't recorded since readers don't have a slot of their own in
+ * the lock. If <sys/sdt.h> is available, USDT probes qlibc:mutex__acquire,
+ * qlibc:mutex__wait and qlibc:mutex__release fire too, so a live process
+ * can be traced with bpftrace or DTrace without a rebuild.
+ *
+ * With DISABLE_THREADSAFE, locks are still allocated so that containers
+ * keep working unchanged, but entering and leaving compile to nothing.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <sched.h>
+#include <time.h>
+#include <pthread.h>
+#include "qinternal.h"
+#include "containers/qtype.h"
+
+#define MUTEX_SPIN_TRIES    (8)     /*!< trylock attempts before parking */
+#define MUTEX_SPIN_PAUSES   (64)    /*!< max pauses between attempts */
+
+#if defined(__x86_64__) || defined(__i386__)
+#define CPU_RELAX()     __asm__ __volatile__("pause" ::: "memory")
+#elif defined(__aarch64__)
+#define CPU_RELAX()     __asm__ __volatile__("yield" ::: "memory")
+#else
+#define CPU_RELAX()     __asm__ __volatile__("" ::: "memory")
+#endif
+
+#define LOAD_ACQUIRE(p)     __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define STORE_RELEASE(p, v) __atomic_store_n(p, v, __ATOMIC_RELEASE)
+#define FETCH_ADD(p, v)     __atomic_fetch_add(p, v, __ATOMIC_RELAXED)
+
+#ifdef BUILD_LOCKSTATS
+
+#define LOCKSTATS_BUCKETS   (20)    /*!< number of histogram buckets */
+#define LOCKSTATS_MINSHIFT  (7)     /*!< first bucket is under 2^7 ns */
+
+#if defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define MUTEX_PROBE(name, x, ns)    DTRACE_PROBE3(qlibc, name, (x)->label, \
+                                                  x, ns)
+#endif
+#endif
+
+/*
+ * Per-lock instrumentation. Bucket i of a histogram counts durations
+ * under 2^(i + LOCKSTATS_MINSHIFT) ns, and the last bucket counts the rest.
+ */
+struct qmutex_stats_s {
+    qmutex_t *x;            /* lock which owns this */
+    uint64_t acquires;      /* exclusive entries including nested ones */
+    uint64_t sharedacquires;  /* shared entries */
+    uint64_t contended;     /* entries which had to wait */
+    uint64_t waitmax;       /* longest wait in ns */
+    uint64_t holdmax;       /* longest exclusive hold in ns */
+    uint64_t waithist[LOCKSTATS_BUCKETS];
+    uint64_t holdhist[LOCKSTATS_BUCKETS];
+    uint64_t holdstart;     /* time of the outermost exclusive entry */
+
+    struct qmutex_stats_s *prev;
+    struct qmutex_stats_s *next;
+};
+
+static pthread_mutex_t _registry_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct qmutex_stats_s *_registry = NULL;
+
+static void _stats_register(qmutex_t *x);
+static void _stats_unregister(qmutex_t *x);
+static void _stats_enter(qmutex_t *x, bool shared, uint64_t waitstart);
+static void _stats_leave(qmutex_t *x);
+static void _stats_record(uint64_t *hist, uint64_t *max, uint64_t ns);
+static const char *_stats_label(const char *label, size_t *len);
+#endif
+
+#ifndef MUTEX_PROBE
+#define MUTEX_PROBE(name, x, ns)    ((void) 0)
+#endif
+
+static bool _owned(qmutex_t *x);
+static void _backoff(int try);
+static uint64_t _now_ns(void);
+static void _add_wait(qmutex_t *x, uint64_t waitstart);
+
+qmutex_t *_q_mutex(bool recursive, bool shared, const char *label) {
+    qmutex_t *x = (qmutex_t *) qlibc_calloc(1, sizeof(qmutex_t));
+    if (x == NULL)
+        return NULL;
+    x->shared = shared;
+    x->label = label;
+
+#ifndef DISABLE_THREADSAFE
+    int ret;
+    if (shared == true) {
+        ret = pthread_rwlock_init(&(x->rwlock), NULL);
+    } else {
+        pthread_mutexattr_t mutexattr;
+        pthread_mutexattr_init(&mutexattr);
+        if (recursive == true) {
+            pthread_mutexattr_settype(&mutexattr, PTHREAD_MUTEX_RECURSIVE);
+        }
+        ret = pthread_mutex_init(&(x->mutex), &mutexattr);
+        pthread_mutexattr_destroy(&mutexattr);
+    }
+    if (ret != 0) {
+        char errmsg[64];
+        strerror_r(ret, errmsg, sizeof(errmsg));
+        DEBUG("Q_MUTEX: can't initialize mutex. [%d:%s]", ret, errmsg);
+        qlibc_free(x);
+        return NULL;
+    }
+#endif
+
+#ifdef BUILD_LOCKSTATS
+    _stats_register(x);
+#endif
+    return x;
+}
+
+void _q_mutex_enter(qmutex_t *x) {
+    if (x == NULL)
+        return;
+
+    int try;
+    uint64_t waitstart = 0;
+    if (x->shared == false) {
+        for (try = 0; pthread_mutex_trylock(&(x->mutex)) != 0; try++) {
+            if (try == 0)
+                waitstart = _now_ns();
+            if (try == MUTEX_SPIN_TRIES) {
+                pthread_mutex_lock(&(x->mutex));
+                break;
+            }
+            _backoff(try);
+        }
+        _add_wait(x, waitstart);
+        x->count++;
+        x->owner = pthread_self();
+#ifdef BUILD_LOCKSTATS
+        _stats_enter(x, false, waitstart);
+#endif
+        return;
+    }
+
+    if (_owned(x) == true) {
+        x->count++;
+#ifdef BUILD_LOCKSTATS
+        _stats_enter(x, false, 0);
+#endif
+        return;
+    }
+    for (try = 0; pthread_rwlock_trywrlock(&(x->rwlock)) != 0; try++) {
+        if (try == 0)
+            waitstart = _now_ns();
+        if (try == MUTEX_SPIN_TRIES) {
+            pthread_rwlock_wrlock(&(x->rwlock));
+            break;
+        }
+        _backoff(try);
+    }
+    _add_wait(x, waitstart);
+    x->owner = pthread_self();
+    STORE_RELEASE(&(x->count), 1);
+#ifdef BUILD_LOCKSTATS
+    _stats_enter(x, false, waitstart);
+#endif
+}
+
+void _q_mutex_enter_shared(qmutex_t *x) {
+    if (x == NULL)
+        return;
+    if (x->shared == false || _owned(x) == true) {
+        _q_mutex_enter(x);
+        return;
+    }
+
+    int try;
+    uint64_t waitstart = 0;
+    for (try = 0; pthread_rwlock_tryrdlock(&(x->rwlock)) != 0; try++) {
+        if (try == 0)
+            waitstart = _now_ns();
+        if (try == MUTEX_SPIN_TRIES) {
+            pthread_rwlock_rdlock(&(x->rwlock));
+            break;
+        }
+        _backoff(try);
+    }
+    _add_wait(x, waitstart);
+#ifdef BUILD_LOCKSTATS
+    _stats_enter(x, true, waitstart);
+#endif
+}
+
+void _q_mutex_leave(qmutex_t *x) {
+    if (x == NULL)
+        return;
+
+    if (x->shared == false) {
+        if (!pthread_equal(x->owner, pthread_self())) {
+            DEBUG("Q_MUTEX: unlock - owner mismatch.");
+        }
+#ifdef BUILD_LOCKSTATS
+        if (x->count == 1)
+            _stats_leave(x);
+#endif
+        if ((--x->count) < 0)
+            x->count = 0;
+        pthread_mutex_unlock(&(x->mutex));
+        return;
+    }
+
+    if (_owned(x) == true) {
+        if (x->count > 1) {
+            x->count--;
+            return;
+        }
+#ifdef BUILD_LOCKSTATS
+        _stats_leave(x);
+#endif
+        STORE_RELEASE(&(x->count), 0);
+    }
+    pthread_rwlock_unlock(&(x->rwlock));
+}
+
+uint64_t _q_mutex_waitns(qmutex_t *x) {
+    if (x == NULL)
+        return 0;
+    return __atomic_load_n(&(x->waitns), __ATOMIC_RELAXED);
+}
+
+void _q_mutex_free(qmutex_t *x) {
+    if (x == NULL)
+        return;
+    if (x->count != 0)
+        DEBUG("Q_MUTEX: mutex counter is not 0.");
+
+#ifdef BUILD_LOCKSTATS
+    _stats_unregister(x);
+#endif
+
+#ifndef DISABLE_THREADSAFE
+    int ret;
+    if (x->shared == true) {
+        ret = pthread_rwlock_destroy(&(x->rwlock));
+    } else {
+        ret = pthread_mutex_destroy(&(x->mutex));
+    }
+    if (ret != 0) {
+        char errmsg[64];
+        strerror_r(ret, errmsg, sizeof(errmsg));
+        DEBUG("Q_MUTEX: can't destroy mutex. [%d:%s]", ret, errmsg);
+    }
+#endif
+    qlibc_free(x);
+}
+
+/*
+ * Print the instrumentation of all live locks. Counters are read without
+ * stopping the locks, so figures of a busy lock may be slightly skewed
+ * against each other.
+ */
+bool _q_mutex_dump(FILE *out, bool json) {
+#ifdef BUILD_LOCKSTATS
+    if (out == NULL) {
+        errno = EIO;
+        return false;
+    }
+
+    pthread_mutex_lock(&_registry_lock);
+    if (json == true)
+        fprintf(out, "[");
+    struct qmutex_stats_s *st;
+    for (st = _registry; st != NULL; st = st->next) {
+        size_t labellen;
+        const char *label = _stats_label(st->x->label, &labellen);
+        uint64_t waithist[LOCKSTATS_BUCKETS], holdhist[LOCKSTATS_BUCKETS];
+        int i;
+        for (i = 0; i < LOCKSTATS_BUCKETS; i++) {
+            waithist[i] = __atomic_load_n(&st->waithist[i], __ATOMIC_RELAXED);
+            holdhist[i] = __atomic_load_n(&st->holdhist[i], __ATOMIC_RELAXED);
+        }
+
+        if (json == true) {
+            fprintf(out, "%s\n{\"label\":\"%.*s\",\"lock\":\"%p\","
+                    "\"rwlock\":%s,\"acquires\":%"PRIu64","
+                    "\"shared_acquires\":%"PRIu64",\"contended\":%"PRIu64","
+                    "\"wait_ns\":%"PRIu64",\"wait_max_ns\":%"PRIu64","
+                    "\"hold_max_ns\":%"PRIu64",\"bucket_min_shift\":%d,",
+                    (st != _registry) ? "," : "", (int) labellen, label,
+                    (void *) st->x, (st->x->shared) ? "true" : "false",
+                    st->acquires, st->sharedacquires, st->contended,
+                    _q_mutex_waitns(st->x), st->waitmax, st->holdmax,
+                    LOCKSTATS_MINSHIFT);
+            fprintf(out, "\"wait_hist\":[");
+            for (i = 0; i < LOCKSTATS_BUCKETS; i++)
+                fprintf(out, "%s%"PRIu64, (i > 0) ? "," : "", waithist[i]);
+            fprintf(out, "],\"hold_hist\":[");
+            for (i = 0; i < LOCKSTATS_BUCKETS; i++)
+                fprintf(out, "%s%"PRIu64, (i > 0) ? "," : "", holdhist[i]);
+            fprintf(out, "]}");
+            continue;
+        }
+
+        fprintf(out, "%.*s %p %s acquires=%"PRIu64" shared=%"PRIu64
+                " contended=%"PRIu64" waitns=%"PRIu64" maxwaitns=%"PRIu64
+                " maxholdns=%"PRIu64"\n", (int) labellen, label,
+                (void *) st->x, (st->x->shared) ? "rwlock" : "mutex",
+                st->acquires, st->sharedacquires, st->contended,
+                _q_mutex_waitns(st->x), st->waitmax, st->holdmax);
+        int h;
+        for (h = 0; h < 2; h++) {
+            uint64_t *hist = (h == 0) ? waithist : holdhist;
+            for (i = 0; i < LOCKSTATS_BUCKETS && hist[i] == 0; i++);
+            if (i == LOCKSTATS_BUCKETS)
+                continue;
+            fprintf(out, "  %s", (h == 0) ? "wait" : "hold");
+            for (; i < LOCKSTATS_BUCKETS; i++) {
+                if (hist[i] == 0)
+                    continue;
+                if (i == LOCKSTATS_BUCKETS - 1)
+                    fprintf(out, " >=%" PRIu64 "ns:%"PRIu64,
+                            (uint64_t) 1 << (i - 1 + LOCKSTATS_MINSHIFT),
+                            hist[i]);
+                else
+                    fprintf(out, " <%" PRIu64 "ns:%"PRIu64,
+                            (uint64_t) 1 << (i + LOCKSTATS_MINSHIFT), hist[i]);
+            }
+            fprintf(out, "\n");
+        }
+    }
+    if (json == true)
+        fprintf(out, "\n]\n");
+    pthread_mutex_unlock(&_registry_lock);
+    return true;
+#else
+    errno = ENOTSUP;
+    return false;
+#endif
+}
+
+/*
+ * Zero the instrumentation of all live locks, for example at the start of
+ * a measurement window.
+ */
+void _q_mutex_reset(void) {
+#ifdef BUILD_LOCKSTATS
+    pthread_mutex_lock(&_registry_lock);
+    struct qmutex_stats_s *st;
+    for (st = _registry; st != NULL; st = st->next) {
+        st->acquires = st->sharedacquires = st->contended = 0;
+        st->waitmax = st->holdmax = 0;
+        memset((void *) st->waithist, 0, sizeof(st->waithist));
+        memset((void *) st->holdhist, 0, sizeof(st->holdhist));
+        __atomic_store_n(&(st->x->waitns), 0, __ATOMIC_RELAXED);
+    }
+    pthread_mutex_unlock(&_registry_lock);
+#endif
+}
+
+/*
+ * Whether the calling thread holds the write side. The count is published
+ * after the owner, so a thread which sees another writer's count also sees
+ * its owner and never mistakes it for itself.
+ */
+static bool _owned(qmutex_t *x) {
+    return (LOAD_ACQUIRE(&(x->count)) > 0
+            && pthread_equal(x->owner, pthread_self()));
+}
+
+static void _backoff(int try) {
+    if (try >= MUTEX_SPIN_TRIES - 1) {
+        sched_yield();
+        return;
+    }
+    int i, n = 4 << try;
+    if (n > MUTEX_SPIN_PAUSES)
+        n = MUTEX_SPIN_PAUSES;
+    for (i = 0; i < n; i++) {
+        CPU_RELAX();
+    }
+}
+
+static uint64_t _now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * Readers enter concurrently, so the sum is updated atomically.
+ */
+static void _add_wait(qmutex_t *x, uint64_t waitstart) {
+    if (waitstart == 0)
+        return;
+    FETCH_ADD(&(x->waitns), _now_ns() - waitstart);
+}
+
+#ifdef BUILD_LOCKSTATS
+
+static void _stats_register(qmutex_t *x) {
+    struct qmutex_stats_s *st = (struct qmutex_stats_s *) qlibc_calloc(
+            1, sizeof(struct qmutex_stats_s));
+    if (st == NULL)
+        return;  // the lock works, just isn't instrumented
+    st->x = x;
+    x->lockstats = st;
+
+    pthread_mutex_lock(&_registry_lock);
+    st->next = _registry;
+    if (_registry != NULL)
+        _registry->prev = st;
+    _registry = st;
+    pthread_mutex_unlock(&_registry_lock);
+}
+
+static void _stats_unregister(qmutex_t *x) {
+    struct qmutex_stats_s *st = (struct qmutex_stats_s *) x->lockstats;
+    if (st == NULL)
+        return;
+
+    pthread_mutex_lock(&_registry_lock);
+    if (st->prev != NULL)
+        st->prev->next = st->next;
+    else
+        _registry = st->next;
+    if (st->next != NULL)
+        st->next->prev = st->prev;
+    pthread_mutex_unlock(&_registry_lock);
+    qlibc_free(st);
+}
+
+/*
+ * Called right after the lock is taken. Exclusive entries are serialized
+ * by the lock itself but shared ones aren't, so counters are atomic.
+ */
+static void _stats_enter(qmutex_t *x, bool shared, uint64_t waitstart) {
+    struct qmutex_stats_s *st = (struct qmutex_stats_s *) x->lockstats;
+    if (st == NULL)
+        return;
+
+    bool outermost = (shared == false && x->count == 1);
+    uint64_t now = (waitstart != 0 || outermost == true) ? _now_ns() : 0;
+    FETCH_ADD((shared) ? &st->sharedacquires : &st->acquires, 1);
+    if (waitstart != 0) {
+        FETCH_ADD(&st->contended, 1);
+        _stats_record(st->waithist, &st->waitmax, now - waitstart);
+        MUTEX_PROBE(mutex__wait, x, now - waitstart);
+    }
+    if (outermost == true)
+        st->holdstart = now;
+    MUTEX_PROBE(mutex__acquire, x, shared);
+}
+
+/*
+ * Called right before the outermost exclusive entry is released.
+ */
+static void _stats_leave(qmutex_t *x) {
+    struct qmutex_stats_s *st = (struct qmutex_stats_s *) x->lockstats;
+    if (st == NULL || st->holdstart == 0)
+        return;
+
+    uint64_t holdns = _now_ns() - st->holdstart;
+    st->holdstart = 0;
+    _stats_record(st->holdhist, &st->holdmax, holdns);
+    MUTEX_PROBE(mutex__release, x, holdns);
+}
+
+static void _stats_record(uint64_t *hist, uint64_t *max, uint64_t ns) {
+    int bucket = 0;
+    uint64_t v = ns >> LOCKSTATS_MINSHIFT;
+    while (v > 0 && bucket < LOCKSTATS_BUCKETS - 1) {
+        v >>= 1;
+        bucket++;
+    }
+    FETCH_ADD(&hist[bucket], 1);
+
+    uint64_t cur = __atomic_load_n(max, __ATOMIC_RELAXED);
+    while (ns > cur
+            && !__atomic_compare_exchange_n(max, &cur, ns, true,
+                                            __ATOMIC_RELAXED,
+                                            __ATOMIC_RELAXED)) {
+    }
+}
+
+/*
+ * Container name from the source file path, "containers/qhashtbl.c"
+ * becomes "qhashtbl".
+ */
+static const char *_stats_label(const char *label, size_t *len) {
+    if (label == NULL) {
+        *len = 7;
+        return "unknown";
+    }
+    const char *base = strrchr(label, '/');
+    base = (base != NULL) ? base + 1 : label;
+    const char *dot = strrchr(base, '.');
+    *len = (dot != NULL) ? (size_t) (dot - base) : strlen(base);
+    return base;
+}
+
+#endif  /* BUILD_LOCKSTATS */
@@ -0,0 +1,324 @@
+/******************************************************************************
+ * qLibc
+ *
+ * Copyright (c) 2010-2014 Seungyoung Kim.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *****************************************************************************/
+
+/*
+ * Ring buffer engine for qqueue and qstack.
+ *
+ * Elements are kept in a contiguous array of fixed-size slots which wraps
+ * around and doubles in size when it's full. Elements up to RING_INLINE_SIZE
+ * bytes are stored in the slot itself, bigger ones are malloced and the slot
+ * keeps the pointer. So pushing and popping small elements needs no memory
+ * allocation once the array has grown to its working size.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include "qinternal.h"
+#include "containers/qtype.h"
+
+#define RING_INLINE_SIZE (24)
+#define RING_DEFAULT_CAP (16)
+
+typedef struct qring_slot_s qring_slot_t;
+
+struct qring_slot_s {
+    size_t size;        /*!< data size */
+    union {
+        void *ptr;      /*!< malloced data if size > RING_INLINE_SIZE */
+        unsigned char data[RING_INLINE_SIZE];   /*!< inline data */
+    } u;
+};
+
+struct qring_s {
+    qmutex_t *qmutex;   /*!< initialized when thread-safe */
+    qring_slot_t *slots;  /*!< slot array */
+    size_t cap;         /*!< number of slots, always power of 2 */
+    size_t head;        /*!< slot index of the first element */
+    size_t num;         /*!< number of elements */
+    size_t max;         /*!< maximum number of elements. 0 means no limit */
+    size_t datasum;     /*!< total sum of data size */
+};
+
+#define SLOT(r, i)  (&(r)->slots[((r)->head + (i)) & ((r)->cap - 1)])
+#define SLOT_DATA(s) (((s)->size > RING_INLINE_SIZE) ? (s)->u.ptr : (s)->u.data)
+
+static bool _grow(qring_t *ring);
+static void _remove(qring_t *ring, int index);
+static int _index(qring_t *ring, int index);
+
+qring_t *_q_ring(bool threadsafe) {
+    qring_t *ring = (qring_t *) qlibc_calloc(1, sizeof(qring_t));
+    if (ring == NULL) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    ring->slots = (qring_slot_t *) qlibc_malloc(sizeof(qring_slot_t)
+                                          * RING_DEFAULT_CAP);
+    if (ring->slots == NULL) {
+        qlibc_free(ring);
+        errno = ENOMEM;
+        return NULL;
+    }
+    ring->cap = RING_DEFAULT_CAP;
+
+    if (threadsafe == true) {
+        Q_MUTEX_NEW(ring->qmutex, true);
+        if (ring->qmutex == NULL) {
+            qlibc_free(ring->slots);
+            qlibc_free(ring);
+            errno = ENOMEM;
+            return NULL;
+        }
+    }
+
+    return ring;
+}
+
+size_t _q_ring_setsize(qring_t *ring, size_t max) {
+    Q_MUTEX_ENTER(ring->qmutex);
+    size_t old = ring->max;
+    ring->max = max;
+    Q_MUTEX_LEAVE(ring->qmutex);
+    return old;
+}
+
+// add an element at the front or at the back.
+bool _q_ring_add(qring_t *ring, bool front, const void *data, size_t size) {
+    if (data == NULL || size == 0) {
+        errno = EINVAL;
+        return false;
+    }
+
+    Q_MUTEX_ENTER(ring->qmutex);
+
+    if (ring->max > 0 && ring->num >= ring->max) {
+        Q_MUTEX_LEAVE(ring->qmutex);
+        errno = ENOBUFS;
+        return false;
+    }
+    if (ring->num == ring->cap && _grow(ring) == false) {
+        Q_MUTEX_LEAVE(ring->qmutex);
+        errno = ENOMEM;
+        return false;
+    }
+
+    qring_slot_t *slot;
+    if (front == true) {
+        ring->head = (ring->head - 1) & (ring->cap - 1);
+        slot = SLOT(ring, 0);
+    } else {
+        slot = SLOT(ring, ring->num);
+    }
+    if (size > RING_INLINE_SIZE) {
+        slot->u.ptr = qlibc_malloc(size);
+        if (slot->u.ptr == NULL) {
+            if (front == true)
+                ring->head = (ring->head + 1) & (ring->cap - 1);
+            Q_MUTEX_LEAVE(ring->qmutex);
+            errno = ENOMEM;
+            return false;
+        }
+    }
+    slot->size = size;
+    memcpy(SLOT_DATA(slot), data, size);
+    ring->num++;
+    ring->datasum += size;
+
+    Q_MUTEX_LEAVE(ring->qmutex);
+    return true;
+}
+
+/*
+ * Get an element at the index. The returned pointer is malloced when newmem
+ * or remove is true, otherwise it points the internal storage which is valid
+ * until the next modification.
+ */
+void *_q_ring_get(qring_t *ring, int index, size_t *size, bool newmem,
+                  bool remove) {
+    Q_MUTEX_ENTER(ring->qmutex);
+
+    int i = _index(ring, index);
+    if (i < 0) {
+        Q_MUTEX_LEAVE(ring->qmutex);
+        return NULL;
+    }
+
+    qring_slot_t *slot = SLOT(ring, i);
+    void *data;
+    if (remove == true && slot->size > RING_INLINE_SIZE) {
+        data = slot->u.ptr;  // hand over the malloced data.
+    } else if (remove == true || newmem == true) {
+        data = qlibc_malloc(slot->size);
+        if (data == NULL) {
+            Q_MUTEX_LEAVE(ring->qmutex);
+            errno = ENOMEM;
+            return NULL;
+        }
+        memcpy(data, SLOT_DATA(slot), slot->size);
+    } else {
+        data = SLOT_DATA(slot);
+    }
+    if (size != NULL)
+        *size = slot->size;
+
+    if (remove == true)
+        _remove(ring, i);
+
+    Q_MUTEX_LEAVE(ring->qmutex);
+    return data;
+}
+
+/*
+ * Copy an element at the index into the buffer without memory allocation.
+ * Returns the element size, 0 on error.
+ */
+size_t _q_ring_read(qring_t *ring, int index, void *buf, size_t bufsize,
+                    bool remove) {
+    Q_MUTEX_ENTER(ring->qmutex);
+
+    int i = _index(ring, index);
+    if (i < 0) {
+        Q_MUTEX_LEAVE(ring->qmutex);
+        return 0;
+    }
+
+    qring_slot_t *slot = SLOT(ring, i);
+    size_t size = slot->size;
+    memcpy(buf, SLOT_DATA(slot), (size < bufsize) ? size : bufsize);
+    if (remove == true) {
+        if (size > RING_INLINE_SIZE)
+            qlibc_free(slot->u.ptr);
+        _remove(ring, i);
+    }
+
+    Q_MUTEX_LEAVE(ring->qmutex);
+    return size;
+}
+
+size_t _q_ring_size(qring_t *ring) {
+    return ring->num;
+}
+
+void _q_ring_clear(qring_t *ring) {
+    Q_MUTEX_ENTER(ring->qmutex);
+    size_t i;
+    for (i = 0; i < ring->num; i++) {
+        qring_slot_t *slot = SLOT(ring, i);
+        if (slot->size > RING_INLINE_SIZE)
+            qlibc_free(slot->u.ptr);
+    }
+    ring->head = 0;
+    ring->num = 0;
+    ring->datasum = 0;
+    Q_MUTEX_LEAVE(ring->qmutex);
+}
+
+bool _q_ring_debug(qring_t *ring, FILE *out) {
+    if (out == NULL) {
+        errno = EIO;
+        return false;
+    }
+
+    Q_MUTEX_ENTER(ring->qmutex);
+    size_t i;
+    for (i = 0; i < ring->num; i++) {
+        qring_slot_t *slot = SLOT(ring, i);
+        fprintf(out, "%zu=", i);
+        _q_humanOut(out, SLOT_DATA(slot), slot->size, MAX_HUMANOUT);
+        fprintf(out, " (%zu)\n", slot->size);
+    }
+    Q_MUTEX_LEAVE(ring->qmutex);
+
+    return true;
+}
+
+void _q_ring_free(qring_t *ring) {
+    _q_ring_clear(ring);
+    Q_MUTEX_DESTROY(ring->qmutex);
+    qlibc_free(ring->slots);
+    qlibc_free(ring);
+}
+
+// double the slot array, unwrapping elements to the beginning.
+static bool _grow(qring_t *ring) {
+    qring_slot_t *slots = (qring_slot_t *) qlibc_malloc(sizeof(qring_slot_t)
+                                                  * ring->cap * 2);
+    if (slots == NULL)
+        return false;
+
+    size_t first = ring->cap - ring->head;
+    if (first > ring->num)
+        first = ring->num;
+    memcpy(slots, &ring->slots[ring->head], sizeof(qring_slot_t) * first);
+    memcpy(&slots[first], ring->slots, sizeof(qring_slot_t)
+                                       * (ring->num - first));
+    qlibc_free(ring->slots);
+
+    ring->slots = slots;
+    ring->cap *= 2;
+    ring->head = 0;
+    return true;
+}
+
+// drop the slot at the index. its malloced data must be taken care of.
+static void _remove(qring_t *ring, int index) {
+    ring->datasum -= SLOT(ring, index)->size;
+
+    // close the gap by moving the shorter side.
+    int j;
+    if (index < ring->num / 2) {
+        for (j = index; j > 0; j--)
+            *SLOT(ring, j) = *SLOT(ring, j - 1);
+        ring->head = (ring->head + 1) & (ring->cap - 1);
+    } else {
+        for (j = index; j < ring->num - 1; j++)
+            *SLOT(ring, j) = *SLOT(ring, j + 1);
+    }
+    ring->num--;
+    if (ring->num == 0)
+        ring->head = 0;
+}
+
+// convert negative index and check range.
+static int _index(qring_t *ring, int index) {
+    if (ring->num == 0) {
+        errno = ENOENT;
+        return -1;
+    }
+    if (index < 0)
+        index = ring->num + index;
+    if (index < 0 || index >= ring->num) {
+        errno = ERANGE;
+        return -1;
+    }
+    return index;
+}
@@ -0,0 +1,371 @@
+/******************************************************************************
+ * qLibc
+ *
+ * Copyright (c) 2010-2014 Seungyoung Kim.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *****************************************************************************/
+
+
+/*
+ * Binary snapshot files for qhashtbl, qlisttbl, qlist and qvector.
+ *
+ * A snapshot is a fixed header followed by one record per element. Each
+ * record keeps the stored hash of the key, the key with its NULL terminator
+ * and the data, padded to 8 bytes so the data in a mapped file is aligned.
+ * The body is checksummed in SNAP_BLOCK_SIZE blocks with qhashxx64(), which
+ * lets the writer stream through a single block buffer.
+ *
+ * Records are written to a temporary file which is renamed over the target
+ * on commit, so readers never see a half-written snapshot. Reading maps the
+ * file, verifies the checksum and then hands out pointers into the mapping,
+ * so a container is rebuilt in a single pass without intermediate copies.
+ * The format is in host byte order and not meant to be shared between
+ * machines.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "qinternal.h"
+#include "utilities/qfile.h"
+#include "utilities/qhash.h"
+#include "utilities/qio.h"
+#include "utilities/qstring.h"
+
+#define SNAP_MAGIC          "QSNAPBIN"
+#define SNAP_VERSION        (1)
+#define SNAP_BLOCK_SIZE     (64 * 1024)
+#define SNAP_ALIGN(n)       (((n) + 7) & ~((size_t) 7))
+#define SNAP_SUM_INIT       (0xcbf29ce484222325ULL)
+#define SNAP_SUM_PRIME      (0x100000001b3ULL)
+
+struct _snap_header_s {
+    char magic[8];
+    uint32_t version;   /*!< SNAP_VERSION */
+    uint32_t type;      /*!< Q_SNAP_* container type */
+    uint32_t flags;     /*!< container specific flags */
+    uint32_t reserved;
+    uint64_t num;       /*!< number of records */
+    uint64_t bodysize;  /*!< bytes following the header */
+    uint64_t checksum;  /*!< block-chained qhashxx64() of the body */
+};
+
+struct _snap_rec_s {
+    uint32_t hash;      /*!< stored hash of the key */
+    uint32_t namelen;   /*!< key length, not including the NULL */
+    uint64_t size;      /*!< data size */
+};
+
+struct qsnap_s {
+    /* writer */
+    char *filepath;     /*!< target path */
+    char *tmppath;      /*!< temporary file renamed on commit */
+    int fd;
+    char *buf;          /*!< block buffer */
+    size_t buflen;      /*!< bytes in the block buffer */
+
+    /* reader */
+    char *map;          /*!< mapped snapshot file */
+    size_t mapsize;
+    size_t off;         /*!< offset of next record */
+    size_t left;        /*!< records not read yet */
+
+    struct _snap_header_s hdr;
+};
+
+static uint64_t _sum(uint64_t sum, const void *data, size_t size);
+static bool _append(qsnap_t *snap, const void *data, size_t size);
+static bool _flush(qsnap_t *snap);
+static void _release(qsnap_t *snap);
+
+/*
+ * Start writing a snapshot. Nothing is visible at filepath until
+ * _q_snap_commit() is called.
+ */
+qsnap_t *_q_snap_create(const char *filepath, uint32_t type, uint32_t flags) {
+    if (filepath == NULL) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    qsnap_t *snap = (qsnap_t *) qlibc_calloc(1, sizeof(qsnap_t));
+    if (snap == NULL) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    snap->fd = -1;
+    snap->filepath = qlibc_strdup(filepath);
+    snap->tmppath = qstrdupf("%s.%d", filepath, (int) getpid());
+    snap->buf = (char *) qlibc_malloc(SNAP_BLOCK_SIZE);
+    if (snap->filepath == NULL || snap->tmppath == NULL || snap->buf == NULL) {
+        _release(snap);
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    snap->fd = open(snap->tmppath, O_CREAT | O_WRONLY | O_TRUNC,
+                    (S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH));
+    if (snap->fd < 0) {
+        DEBUG("_q_snap_create(): Can't open file %s", snap->tmppath);
+        _release(snap);
+        return NULL;
+    }
+
+    // the header is rewritten on commit.
+    memcpy(snap->hdr.magic, SNAP_MAGIC, 8);
+    snap->hdr.version = SNAP_VERSION;
+    snap->hdr.type = type;
+    snap->hdr.flags = flags;
+    snap->hdr.checksum = SNAP_SUM_INIT;
+    if (qio_write(snap->fd, &snap->hdr, sizeof(snap->hdr), -1)
+            != (ssize_t) sizeof(snap->hdr)) {
+        _q_snap_abort(snap);
+        return NULL;
+    }
+
+    return snap;
+}
+
+/*
+ * Append a record. name may be NULL for containers without keys.
+ */
+bool _q_snap_write(qsnap_t *snap, uint32_t hash, const char *name,
+                   size_t namelen, const void *data, size_t size) {
+    static const char zeros[8] = { 0 };
+
+    if (name == NULL)
+        namelen = 0;
+    if (namelen > UINT32_MAX) {
+        errno = EINVAL;
+        return false;
+    }
+
+    struct _snap_rec_s rec;
+    rec.hash = hash;
+    rec.namelen = (uint32_t) namelen;
+    rec.size = (uint64_t) size;
+
+    size_t keypad = SNAP_ALIGN(namelen + 1) - namelen;
+    if (_append(snap, &rec, sizeof(rec)) == false
+            || (namelen > 0 && _append(snap, name, namelen) == false)
+            || _append(snap, zeros, keypad) == false
+            || (size > 0 && _append(snap, data, size) == false)
+            || _append(snap, zeros, SNAP_ALIGN(size) - size) == false) {
+        return false;
+    }
+    snap->hdr.num++;
+    return true;
+}
+
+/*
+ * Finish the snapshot and move it to the target path. snap is released.
+ */
+bool _q_snap_commit(qsnap_t *snap) {
+    bool ok = (_flush(snap) == true
+            && pwrite(snap->fd, &snap->hdr, sizeof(snap->hdr), 0)
+                    == (ssize_t) sizeof(snap->hdr));
+    if (close(snap->fd) != 0)
+        ok = false;
+    snap->fd = -1;
+    if (ok == true)
+        ok = (rename(snap->tmppath, snap->filepath) == 0);
+    if (ok == false)
+        unlink(snap->tmppath);
+    _release(snap);
+    return ok;
+}
+
+/*
+ * Throw away an unfinished snapshot. snap is released.
+ */
+void _q_snap_abort(qsnap_t *snap) {
+    int errsv = errno;
+    if (snap->fd >= 0) {
+        close(snap->fd);
+        snap->fd = -1;
+        unlink(snap->tmppath);
+    }
+    _release(snap);
+    errno = errsv;
+}
+
+/*
+ * Map a snapshot and verify it. flags and num are taken from the header.
+ *
+ * errno is set to EBADMSG if the file is not a snapshot of the given type
+ * or doesn't pass the checksum.
+ */
+qsnap_t *_q_snap_open(const char *filepath, uint32_t type, uint32_t *flags,
+                      size_t *num) {
+    if (filepath == NULL) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    qsnap_t *snap = (qsnap_t *) qlibc_calloc(1, sizeof(qsnap_t));
+    if (snap == NULL) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    snap->fd = -1;
+    snap->map = (char *) qfile_map(filepath, &snap->mapsize);
+    if (snap->map == NULL) {
+        DEBUG("_q_snap_open(): Can't map file %s", filepath);
+        _release(snap);
+        return NULL;
+    }
+
+    bool valid = false;
+    if (snap->mapsize >= sizeof(snap->hdr)) {
+        memcpy(&snap->hdr, snap->map, sizeof(snap->hdr));
+        valid = (memcmp(snap->hdr.magic, SNAP_MAGIC, 8) == 0
+                && snap->hdr.version == SNAP_VERSION
+                && snap->hdr.type == type
+                && snap->hdr.bodysize == snap->mapsize - sizeof(snap->hdr));
+    }
+    if (valid == true) {
+        // checksum is chained over the blocks as they were written.
+        uint64_t sum = SNAP_SUM_INIT;
+        size_t off;
+        for (off = sizeof(snap->hdr); off < snap->mapsize;
+                off += SNAP_BLOCK_SIZE) {
+            size_t len = snap->mapsize - off;
+            if (len > SNAP_BLOCK_SIZE)
+                len = SNAP_BLOCK_SIZE;
+            sum = _sum(sum, snap->map + off, len);
+        }
+        valid = (sum == snap->hdr.checksum);
+    }
+    if (valid == false) {
+        DEBUG("_q_snap_open(): Invalid snapshot %s", filepath);
+        _release(snap);
+        errno = EBADMSG;
+        return NULL;
+    }
+
+    snap->off = sizeof(snap->hdr);
+    snap->left = snap->hdr.num;
+    if (flags != NULL)
+        *flags = snap->hdr.flags;
+    if (num != NULL)
+        *num = snap->hdr.num;
+    return snap;
+}
+
+/*
+ * Get the next record. The name and data point into the mapping and stay
+ * valid until _q_snap_close(). The name is always NULL terminated.
+ *
+ * Returns false with errno ENOENT at the end, or EBADMSG if a record runs
+ * over the end of the file.
+ */
+bool _q_snap_read(qsnap_t *snap, qsnap_rec_t *rec) {
+    if (snap->left == 0) {
+        errno = ENOENT;
+        return false;
+    }
+
+    const struct _snap_rec_s *r =
+            (const struct _snap_rec_s *) (snap->map + snap->off);
+    size_t avail = snap->mapsize - snap->off;
+    size_t keylen = 0;
+    if (avail < sizeof(*r)
+            || (keylen = SNAP_ALIGN((size_t) r->namelen + 1))
+                    > avail - sizeof(*r)
+            || r->size > avail - sizeof(*r) - keylen) {
+        errno = EBADMSG;
+        return false;
+    }
+
+    rec->hash = r->hash;
+    rec->name = (const char *) (r + 1);
+    rec->namelen = r->namelen;
+    rec->data = rec->name + keylen;
+    rec->size = (size_t) r->size;
+
+    size_t reclen = sizeof(*r) + keylen + SNAP_ALIGN(rec->size);
+    snap->off = (reclen < avail) ? snap->off + reclen : snap->mapsize;
+    snap->left--;
+    return true;
+}
+
+/*
+ * Unmap the snapshot.
+ */
+void _q_snap_close(qsnap_t *snap) {
+    int errsv = errno;
+    _release(snap);
+    errno = errsv;
+}
+
+static uint64_t _sum(uint64_t sum, const void *data, size_t size) {
+    return (sum ^ qhashxx64(data, size)) * SNAP_SUM_PRIME;
+}
+
+// copy into the block buffer, which is written out whenever it's full.
+static bool _append(qsnap_t *snap, const void *data, size_t size) {
+    const char *p = (const char *) data;
+    while (size > 0) {
+        size_t len = SNAP_BLOCK_SIZE - snap->buflen;
+        if (len > size)
+            len = size;
+        memcpy(snap->buf + snap->buflen, p, len);
+        snap->buflen += len;
+        p += len;
+        size -= len;
+        if (snap->buflen == SNAP_BLOCK_SIZE && _flush(snap) == false)
+            return false;
+    }
+    return true;
+}
+
+static bool _flush(qsnap_t *snap) {
+    if (snap->buflen == 0)
+        return true;
+    snap->hdr.checksum = _sum(snap->hdr.checksum, snap->buf, snap->buflen);
+    if (qio_write(snap->fd, snap->buf, snap->buflen, -1)
+            != (ssize_t) snap->buflen) {
+        return false;
+    }
+    snap->hdr.bodysize += snap->buflen;
+    snap->buflen = 0;
+    return true;
+}
+
+static void _release(qsnap_t *snap) {
+    if (snap->fd >= 0)
+        close(snap->fd);
+    if (snap->map != NULL)
+        qfile_unmap(snap->map, snap->mapsize);
+    qlibc_free(snap->filepath);
+    qlibc_free(snap->tmppath);
+    qlibc_free(snap->buf);
+    qlibc_free(snap);
+}
@@ -66,6 +66,30 @@
  *     return -1;
  *   }
  * @endcode
+ *
+ * @note
+ *  qshm_init_opt() and qshm_getid_opt() take backend and placement options.
+ *  QSHM_POSIX selects a shm_open() segment named after the IPC key instead
+ *  of a SysV one, or an anonymous memfd shared with forked children when
+ *  keyfile is NULL. These are plain mmap()ed files so the size isn't capped
+ *  by kernel.shmmax. QSHM_HUGEPAGE backs the segment by huge pages, which
+ *  cuts TLB misses on large segments. QSHM_POPULATE pre-faults every page
+ *  in qshm_get() and QSHM_INTERLEAVE or QSHM_LOCAL sets the NUMA policy of
+ *  the pages before they are faulted in.
+ * @code
+ *   int shmid = qshm_init_opt("/some/file", 's', 20UL << 30, true,
+ *                             QSHM_POSIX | QSHM_HUGEPAGE | QSHM_INTERLEAVE);
+ *   void *data = qshm_get(shmid);
+ *
+ *   [other program]
+ *   int shmid = qshm_getid_opt("/some/file", 's', QSHM_POSIX | QSHM_POPULATE);
+ *   void *data = qshm_get(shmid);
+ * @endcode
+ *
+ *  The options given are remembered for the returned identifier within the
+ *  calling process, so qshm_get() applies them to each attachment.
+ *  Placement options are hints and are silently skipped when the system
+ *  doesn't support them.
  */
 
 #ifndef DISABLE_IPC
@@ -74,10 +98,57 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
 #include <sys/shm.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
 #include "qinternal.h"
 #include "ipc/qshm.h"
 
+#ifndef _DOXYGEN_SKIP
+
+/* identifiers of POSIX segments carry this bit on top of the descriptor */
+#define QSHM_POSIX_ID       (0x40000000)
+#define QSHM_MAX_SEGMENTS   (64)
+#define QSHM_NAME_SIZE      (32)
+
+/* NUMA memory policies, in case <numaif.h> isn't installed */
+#define QSHM_MPOL_PREFERRED         (1)
+#define QSHM_MPOL_INTERLEAVE        (3)
+#define QSHM_MPOL_LOCAL             (4)
+#define QSHM_MPOL_F_MEMS_ALLOWED    (1 << 2)
+#define QSHM_MAX_NUMNODES           (1024)
+
+struct qshm_seg_s {
+    int shmid;      /*!< identifier returned to the user, -1 if unused */
+    int fd;         /*!< descriptor of POSIX segment, -1 for SysV */
+    int options;    /*!< options given at init/getid time */
+    char name[QSHM_NAME_SIZE];  /*!< shm_open() name, empty if anonymous */
+};
+
+static struct qshm_seg_s _segs[QSHM_MAX_SEGMENTS];
+static int _nsegs = 0;
+static pthread_mutex_t _seglock = PTHREAD_MUTEX_INITIALIZER;
+
+static bool _register(int shmid, int fd, int options, const char *name);
+static bool _lookup(int shmid, struct qshm_seg_s *seg);
+static void _unregister(int shmid);
+static bool _makename(const char *keyfile, int keyid, char *name);
+static int _posix_init(const char *keyfile, int keyid, size_t size,
+                       bool recreate, int options);
+static int _posix_getid(const char *keyfile, int keyid, int options);
+static size_t _hugepagesize(void);
+static void _placement(void *addr, size_t size, int options);
+static void _populate(void *addr, size_t size);
+
+#endif
+
 /**
  * Initialize shared-memory
  *
@@ -89,7 +160,41 @@
  * @return non-negative shared memory identifier if successful, otherwise returns -1
  */
 int qshm_init(const char *keyfile, int keyid, size_t size, bool recreate) {
+    return qshm_init_opt(keyfile, keyid, size, recreate, 0);
+}
+
+/**
+ * Initialize shared-memory with backend and placement options
+ *
+ * @param keyfile   seed for generating unique IPC key
+ * @param keyid     seed for generating unique IPC key
+ * @param size      size of shared memory
+ * @param recreate  set to true to re-create shared-memory if already exists
+ * @param options   combination of initialization options.
+ *
+ * @return non-negative shared memory identifier if successful, otherwise returns -1
+ *
+ * @note
+ *   Available options:
+ *   - QSHM_POSIX       Create a shm_open() segment instead of a SysV one.
+ *                      With NULL keyfile, an anonymous memfd is created
+ *                      which is shared by forked children.
+ *   - QSHM_HUGEPAGE    Back the segment by huge pages. The size is rounded
+ *                      up to the huge page size. A named POSIX segment
+ *                      can't use hugetlbfs, so transparent huge pages are
+ *                      requested for it instead.
+ *   - QSHM_POPULATE    Pre-fault all pages in qshm_get().
+ *   - QSHM_INTERLEAVE  Interleave pages over the allowed NUMA nodes.
+ *   - QSHM_LOCAL       Place pages on the NUMA node of the faulting CPU.
+ */
+int qshm_init_opt(const char *keyfile, int keyid, size_t size, bool recreate,
+                  int options) {
+    if (options & QSHM_POSIX) {
+        return _posix_init(keyfile, keyid, size, recreate, options);
+    }
+
     key_t semkey;
+    int shmflg = IPC_CREAT | IPC_EXCL | 0666;
     int shmid;
 
     /* generate unique key using ftok() */
@@ -101,18 +206,31 @@ int qshm_init(const char *keyfile, int keyid, size_t size, bool recreate) {
         semkey = IPC_PRIVATE;
     }
 
+#ifdef SHM_HUGETLB
+    if (options & QSHM_HUGEPAGE) {
+        size_t hpsize = _hugepagesize();
+        size = (size + hpsize - 1) / hpsize * hpsize;
+        shmflg |= SHM_HUGETLB;
+    }
+#endif
+
     /* create shared memory */
-    if ((shmid = shmget(semkey, size, IPC_CREAT | IPC_EXCL | 0666)) == -1) {
+    if ((shmid = shmget(semkey, size, shmflg)) == -1) {
         if (recreate == false)
             return -1;
 
         /* destroy & re-create */
         if ((shmid = qshm_getid(keyfile, keyid)) >= 0)
             qshm_free(shmid);
-        if ((shmid = shmget(semkey, size, IPC_CREAT | IPC_EXCL | 0666)) == -1)
+        if ((shmid = shmget(semkey, size, shmflg)) == -1)
             return -1;
     }
 
+    if (options != 0 && _register(shmid, -1, options, NULL) == false) {
+        shmctl(shmid, IPC_RMID, 0);
+        return -1;
+    }
+
     return shmid;
 }
 
@@ -125,6 +243,25 @@ int qshm_init(const char *keyfile, int keyid, size_t size, bool recreate) {
  * @return non-negative shared memory identifier if successful, otherwise returns -1
  */
 int qshm_getid(const char *keyfile, int keyid) {
+    return qshm_getid_opt(keyfile, keyid, 0);
+}
+
+/**
+ * Get shared memory identifier with options for existing shared memory
+ *
+ * @param keyfile   seed for generating unique IPC key
+ * @param keyid     seed for generating unique IPC key
+ * @param options   options used at qshm_init_opt(). QSHM_POSIX must match
+ *                  the creator's. QSHM_POPULATE, QSHM_INTERLEAVE and
+ *                  QSHM_LOCAL apply to this process's qshm_get().
+ *
+ * @return non-negative shared memory identifier if successful, otherwise returns -1
+ */
+int qshm_getid_opt(const char *keyfile, int keyid, int options) {
+    if (options & QSHM_POSIX) {
+        return _posix_getid(keyfile, keyid, options);
+    }
+
     int shmid;
 
     /* generate unique key using ftok() */
@@ -136,6 +273,9 @@ int qshm_getid(const char *keyfile, int keyid) {
     if ((shmid = shmget(semkey, 0, 0)) == -1)
         return -1;
 
+    if (options != 0 && _register(shmid, -1, options, NULL) == false)
+        return -1;
+
     return shmid;
 }
 
@@ -151,9 +291,55 @@ void *qshm_get(int shmid) {
 
     if (shmid < 0)
         return NULL;
-    pShm = shmat(shmid, 0, 0);
-    if (pShm == (void *) -1)
-        return NULL;
+
+    struct qshm_seg_s seg;
+    if (_lookup(shmid, &seg) == false) {
+        pShm = shmat(shmid, 0, 0);
+        if (pShm == (void *) -1)
+            return NULL;
+        return pShm;
+    }
+
+    size_t size;
+    if (seg.fd >= 0) {
+        struct stat st;
+        if (fstat(seg.fd, &st) != 0 || st.st_size <= 0)
+            return NULL;
+        size = (size_t) st.st_size;
+
+        int flags = MAP_SHARED;
+#ifdef MAP_POPULATE
+        /* placement must be set before pages are faulted in */
+        if ((seg.options & QSHM_POPULATE)
+                && !(seg.options & (QSHM_INTERLEAVE | QSHM_LOCAL))) {
+            flags |= MAP_POPULATE;
+            seg.options &= ~QSHM_POPULATE;
+        }
+#endif
+        pShm = mmap(NULL, size, PROT_READ | PROT_WRITE, flags, seg.fd, 0);
+        if (pShm == MAP_FAILED)
+            return NULL;
+#ifdef MADV_HUGEPAGE
+        if ((seg.options & QSHM_HUGEPAGE) && seg.name[0] != '\0') {
+            madvise(pShm, size, MADV_HUGEPAGE);
+        }
+#endif
+    } else {
+        struct shmid_ds ds;
+        if (shmctl(shmid, IPC_STAT, &ds) != 0)
+            return NULL;
+        size = ds.shm_segsz;
+
+        pShm = shmat(shmid, 0, 0);
+        if (pShm == (void *) -1)
+            return NULL;
+    }
+
+    _placement(pShm, size, seg.options);
+    if (seg.options & QSHM_POPULATE) {
+        _populate(pShm, size);
+    }
+
     return pShm;
 }
 
@@ -167,9 +353,221 @@ void *qshm_get(int shmid) {
 bool qshm_free(int shmid) {
     if (shmid < 0)
         return false;
+
+    struct qshm_seg_s seg;
+    if (_lookup(shmid, &seg) == true && seg.fd >= 0) {
+        if (seg.name[0] != '\0' && shm_unlink(seg.name) != 0)
+            return false;
+        close(seg.fd);
+        _unregister(shmid);
+        return true;
+    }
+
     if (shmctl(shmid, IPC_RMID, 0) != 0)
         return false;
+    _unregister(shmid);
+    return true;
+}
+
+#ifndef _DOXYGEN_SKIP
+
+static bool _register(int shmid, int fd, int options, const char *name) {
+    bool ret = false;
+
+    pthread_mutex_lock(&_seglock);
+    int i, slot = -1;
+    for (i = 0; i < _nsegs; i++) {
+        if (_segs[i].shmid == shmid) {
+            slot = i;
+            break;
+        }
+        if (slot < 0 && _segs[i].shmid < 0) {
+            slot = i;
+        }
+    }
+    if (slot < 0 && _nsegs < QSHM_MAX_SEGMENTS) {
+        slot = _nsegs++;
+    }
+    if (slot >= 0) {
+        _segs[slot].shmid = shmid;
+        _segs[slot].fd = fd;
+        _segs[slot].options = options;
+        snprintf(_segs[slot].name, sizeof(_segs[slot].name), "%s",
+                 (name != NULL) ? name : "");
+        ret = true;
+    } else {
+        errno = ENOSPC;
+    }
+    pthread_mutex_unlock(&_seglock);
+
+    return ret;
+}
+
+static bool _lookup(int shmid, struct qshm_seg_s *seg) {
+    bool found = false;
+
+    pthread_mutex_lock(&_seglock);
+    int i;
+    for (i = 0; i < _nsegs; i++) {
+        if (_segs[i].shmid == shmid) {
+            *seg = _segs[i];
+            found = true;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&_seglock);
+
+    return found;
+}
+
+static void _unregister(int shmid) {
+    pthread_mutex_lock(&_seglock);
+    int i;
+    for (i = 0; i < _nsegs; i++) {
+        if (_segs[i].shmid == shmid) {
+            _segs[i].shmid = -1;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&_seglock);
+}
+
+static bool _makename(const char *keyfile, int keyid, char *name) {
+    key_t key = ftok(keyfile, keyid);
+    if (key == -1)
+        return false;
+    snprintf(name, QSHM_NAME_SIZE, "/qshm.%08x", (unsigned int) key);
     return true;
 }
 
+static int _posix_init(const char *keyfile, int keyid, size_t size,
+                       bool recreate, int options) {
+    char name[QSHM_NAME_SIZE] = "";
+    int fd = -1;
+
+    if (options & QSHM_HUGEPAGE) {
+        size_t hpsize = _hugepagesize();
+        size = (size + hpsize - 1) / hpsize * hpsize;
+    }
+
+    if (keyfile != NULL) {
+        if (_makename(keyfile, keyid, name) == false)
+            return -1;
+        fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0666);
+        if (fd < 0 && errno == EEXIST && recreate == true) {
+            shm_unlink(name);
+            fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0666);
+        }
+    } else {
+#ifdef MFD_CLOEXEC
+        int mflags = MFD_CLOEXEC;
+#ifdef MFD_HUGETLB
+        if (options & QSHM_HUGEPAGE) {
+            mflags |= MFD_HUGETLB;
+        }
+#endif
+        fd = memfd_create("qshm", mflags);
+#else
+        /* no memfd, use a private name and unlink it right away */
+        snprintf(name, sizeof(name), "/qshm.%d.%p", (int) getpid(),
+                 (void *) &fd);
+        fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+        if (fd >= 0)
+            shm_unlink(name);
+        name[0] = '\0';
+#endif
+    }
+    if (fd < 0)
+        return -1;
+
+    int shmid = fd | QSHM_POSIX_ID;
+    if ((fd & QSHM_POSIX_ID) || ftruncate(fd, (off_t) size) != 0
+            || _register(shmid, fd, options, name) == false) {
+        if (name[0] != '\0')
+            shm_unlink(name);
+        close(fd);
+        return -1;
+    }
+
+    return shmid;
+}
+
+static int _posix_getid(const char *keyfile, int keyid, int options) {
+    char name[QSHM_NAME_SIZE];
+    if (keyfile == NULL || _makename(keyfile, keyid, name) == false)
+        return -1;
+
+    int fd = shm_open(name, O_RDWR, 0);
+    if (fd < 0)
+        return -1;
+
+    int shmid = fd | QSHM_POSIX_ID;
+    if ((fd & QSHM_POSIX_ID)
+            || _register(shmid, fd, options, name) == false) {
+        close(fd);
+        return -1;
+    }
+
+    return shmid;
+}
+
+static size_t _hugepagesize(void) {
+    static size_t hpsize = 0;
+    if (hpsize != 0)
+        return hpsize;
+
+    size_t size = 2 * 1024 * 1024;
+    FILE *fp = fopen("/proc/meminfo", "r");
+    if (fp != NULL) {
+        char line[128];
+        unsigned long kb;
+        while (fgets(line, sizeof(line), fp) != NULL) {
+            if (sscanf(line, "Hugepagesize: %lu kB", &kb) == 1) {
+                size = (size_t) kb * 1024;
+                break;
+            }
+        }
+        fclose(fp);
+    }
+    hpsize = size;
+    return hpsize;
+}
+
+static void _placement(void *addr, size_t size, int options) {
+#if defined(__linux__) && defined(SYS_mbind) && defined(SYS_get_mempolicy)
+    unsigned long mask[QSHM_MAX_NUMNODES / (8 * sizeof(unsigned long))];
+
+    if (options & QSHM_INTERLEAVE) {
+        memset(mask, 0, sizeof(mask));
+        if (syscall(SYS_get_mempolicy, NULL, mask, QSHM_MAX_NUMNODES + 1,
+                    NULL, QSHM_MPOL_F_MEMS_ALLOWED) != 0)
+            return;
+        syscall(SYS_mbind, addr, size, QSHM_MPOL_INTERLEAVE, mask,
+                QSHM_MAX_NUMNODES + 1, 0);
+    } else if (options & QSHM_LOCAL) {
+        if (syscall(SYS_mbind, addr, size, QSHM_MPOL_LOCAL, NULL, 0, 0) != 0) {
+            /* kernels before 3.8, an empty preferred set means local */
+            syscall(SYS_mbind, addr, size, QSHM_MPOL_PREFERRED, NULL, 0, 0);
+        }
+    }
+#endif
+}
+
+static void _populate(void *addr, size_t size) {
+#ifdef MADV_POPULATE_WRITE
+    if (madvise(addr, size, MADV_POPULATE_WRITE) == 0)
+        return;
+#endif
+    /* touch each page, adding zero keeps concurrent writers intact */
+    long pagesize = sysconf(_SC_PAGESIZE);
+    if (pagesize <= 0)
+        pagesize = 4096;
+    size_t off;
+    for (off = 0; off < size; off += (size_t) pagesize) {
+        __sync_fetch_and_add((char *) addr + off, 0);
+    }
+}
+
+#endif /* _DOXYGEN_SKIP */
+
 #endif /* DISABLE_IPC */
@@ -0,0 +1,310 @@
+/******************************************************************************
+ * qLibc
+ *
+ * Copyright (c) 2010-2014 Seungyoung Kim.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *****************************************************************************/
+
+/**
+ * @file qshmlock.c Process-shared lock APIs.
+ *
+ * A lock which lives in a shared memory segment. Unlike qsem_enter() which
+ * makes a semop() system call on every call, acquiring and releasing a free
+ * lock is done with atomic operations in user space and only contended
+ * callers sleep in the kernel. When the owner process dies while holding
+ * the lock, the next caller recovers it.
+ *
+ * @code
+ *   [your header file]
+ *   struct SharedData {
+ *     qshmlock_t lock;
+ *     (... structrue definitions ...)
+ *   }
+ *
+ *   [shared memory creater]
+ *   int shmid = qshm_init("/some/file/for/generating/unique/key", 's',
+ *                         sizeof(struct SharedData), true);
+ *   struct SharedData *sdata = (struct SharedData *)qshm_get(shmid);
+ *   qshmlock_init(&sdata->lock);
+ *
+ *   [forked child or other program]
+ *   bool recovered;
+ *   qshmlock_enter(&sdata->lock, &recovered);
+ *   if (recovered == true) {
+ *     (... previous owner died in the middle, check the data ...)
+ *   }
+ *   (... guaranteed as atomic procedure ...)
+ *   qshmlock_leave(&sdata->lock);
+ * @endcode
+ *
+ * @note
+ *  Owner death recovery needs robust mutexes, which are used on Linux.
+ *  On other systems the lock still works between processes but isn't
+ *  recovered.
+ */
+
+#ifndef DISABLE_IPC
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/time.h>
+#include <pthread.h>
+#include "qinternal.h"
+#include "ipc/qshmlock.h"
+
+#ifndef _DOXYGEN_SKIP
+static bool _lockresult(qshmlock_t *lock, int ret, bool *recovered);
+#endif
+
+/**
+ * Initialize a lock in shared memory
+ *
+ * @param lock      lock pointer located in shared memory
+ *
+ * @return true if successful, otherwise returns false
+ * @retval errno will be set in error condition.
+ *  - EINVAL    : Invalid argument.
+ *  - ENOMEM    : Memory allocation failure.
+ *
+ * @note
+ *  Initialize it once by the creator of the shared memory before other
+ *  processes use it.
+ */
+bool qshmlock_init(qshmlock_t *lock) {
+    if (lock == NULL) {
+        errno = EINVAL;
+        return false;
+    }
+
+    pthread_mutexattr_t attr;
+    int ret = pthread_mutexattr_init(&attr);
+    if (ret != 0) {
+        errno = ret;
+        return false;
+    }
+    ret = pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+#ifdef __linux__
+    if (ret == 0)
+        ret = pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+#endif
+    if (ret == 0) {
+        memset((void *) lock, 0, sizeof(qshmlock_t));
+        ret = pthread_mutex_init(&lock->mutex, &attr);
+    }
+    pthread_mutexattr_destroy(&attr);
+
+    if (ret != 0) {
+        errno = ret;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Acquire the lock then entering critical section
+ *
+ * @param lock      lock pointer
+ * @param recovered set to true when the lock was taken over from a dead
+ *                  owner. it can be NULL if you don't need this information.
+ *
+ * @return true if successful, otherwise returns false
+ * @retval errno will be set in error condition.
+ *  - EINVAL    : Invalid argument.
+ *  - EDEADLK   : The caller already holds the lock.
+ *
+ * @note If the lock is held by other, this will wait until released.
+ */
+bool qshmlock_enter(qshmlock_t *lock, bool *recovered) {
+    if (lock == NULL) {
+        errno = EINVAL;
+        return false;
+    }
+    return _lockresult(lock, pthread_mutex_lock(&lock->mutex), recovered);
+}
+
+/**
+ * Try to acquire the lock. If it is already held, do not wait.
+ *
+ * @param lock      lock pointer
+ * @param recovered set to true when the lock was taken over from a dead
+ *                  owner. it can be NULL.
+ *
+ * @return true if successful, otherwise returns false
+ * @retval errno will be set in error condition.
+ *  - EINVAL    : Invalid argument.
+ *  - EBUSY     : The lock is held by other.
+ */
+bool qshmlock_enter_nowait(qshmlock_t *lock, bool *recovered) {
+    if (lock == NULL) {
+        errno = EINVAL;
+        return false;
+    }
+    return _lockresult(lock, pthread_mutex_trylock(&lock->mutex), recovered);
+}
+
+/**
+ * Acquire the lock waiting at most maxwaitms.
+ *
+ * @param lock      lock pointer
+ * @param maxwaitms maximum waiting milliseconds to be released
+ * @param recovered set to true when the lock was taken over from a dead
+ *                  owner. it can be NULL.
+ *
+ * @return true if successful, otherwise returns false
+ * @retval errno will be set in error condition.
+ *  - EINVAL    : Invalid argument.
+ *  - ETIMEDOUT : The lock wasn't released in time.
+ *
+ * @note
+ *  Unlike qsem_enter_force() it is never unlocked by force. A lock left by
+ *  a dead owner is recovered as soon as it's detected.
+ */
+bool qshmlock_enter_timed(qshmlock_t *lock, int maxwaitms, bool *recovered) {
+    if (lock == NULL || maxwaitms < 0) {
+        errno = EINVAL;
+        return false;
+    }
+
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    long long usec = (long long) tv.tv_usec + (long long) maxwaitms * 1000;
+    struct timespec deadline;
+    deadline.tv_sec = tv.tv_sec + usec / 1000000;
+    deadline.tv_nsec = (usec % 1000000) * 1000;
+
+    return _lockresult(lock, pthread_mutex_timedlock(&lock->mutex, &deadline),
+                       recovered);
+}
+
+/**
+ * Release the lock then leaving critical section
+ *
+ * @param lock      lock pointer
+ *
+ * @return true if successful, otherwise returns false
+ * @retval errno will be set in error condition.
+ *  - EINVAL    : Invalid argument.
+ *  - EPERM     : The caller doesn't hold the lock.
+ */
+bool qshmlock_leave(qshmlock_t *lock) {
+    if (lock == NULL) {
+        errno = EINVAL;
+        return false;
+    }
+
+    int ret = pthread_mutex_unlock(&lock->mutex);
+    if (ret != 0) {
+        errno = ret;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Get the status of the lock
+ *
+ * @param lock      lock pointer
+ *
+ * @return true for being held by other, false for free
+ *
+ * @note
+ *  A lock left by a dead owner is recovered and reported free. The next
+ *  caller acquiring it still gets the recovered flag.
+ */
+bool qshmlock_check(qshmlock_t *lock) {
+    bool recovered = false;
+    if (qshmlock_enter_nowait(lock, &recovered) == false)
+        return (errno == EBUSY || errno == EDEADLK);
+
+    // let the next owner know about it.
+    if (recovered == true)
+        lock->ownerdied = true;
+    qshmlock_leave(lock);
+    return false;
+}
+
+/**
+ * Destroy the lock
+ *
+ * @param lock      lock pointer
+ *
+ * @return true if successful, otherwise returns false
+ * @retval errno will be set in error condition.
+ *  - EINVAL    : Invalid argument.
+ *  - EBUSY     : The lock is held.
+ *
+ * @note
+ *  Call it once when no process uses the lock anymore, before freeing the
+ *  shared memory.
+ */
+bool qshmlock_free(qshmlock_t *lock) {
+    if (lock == NULL) {
+        errno = EINVAL;
+        return false;
+    }
+
+    int ret = pthread_mutex_destroy(&lock->mutex);
+    if (ret != 0) {
+        errno = ret;
+        return false;
+    }
+    return true;
+}
+
+#ifndef _DOXYGEN_SKIP
+
+// turn the result of pthread locking calls into ours.
+static bool _lockresult(qshmlock_t *lock, int ret, bool *recovered) {
+    if (recovered != NULL)
+        *recovered = false;
+
+#ifdef __linux__
+    if (ret == EOWNERDEAD) {
+        DEBUG("recover the lock left by a dead owner.");
+        ret = pthread_mutex_consistent(&lock->mutex);
+        if (ret == 0 && recovered != NULL)
+            *recovered = true;
+    }
+#endif
+
+    if (ret != 0) {
+        errno = ret;
+        return false;
+    }
+
+    if (lock->ownerdied == true) {
+        lock->ownerdied = false;
+        if (recovered != NULL)
+            *recovered = true;
+    }
+    return true;
+}
+
+#endif /* _DOXYGEN_SKIP */
+
+#endif /* DISABLE_IPC */
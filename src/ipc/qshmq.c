@@ -0,0 +1,576 @@
+/******************************************************************************
+ * qLibc
+ *
+ * Copyright (c) 2010-2014 Seungyoung Kim.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *****************************************************************************/
+
+/**
+ * @file qshmq.c Shared-memory message queue APIs.
+ *
+ * A multi-producer single-consumer queue of variable-length messages
+ * which lives in a shared memory segment. Messages are framed in a byte
+ * ring and are written and read in place, so a message is never copied
+ * when qshmq_reserve()/qshmq_commit() and qshmq_peek()/qshmq_consume() are
+ * used. Producers only take a lock to claim ring space, and waiting
+ * producers and consumer sleep on futex words in the segment instead of
+ * making semaphore system calls on every message.
+ *
+ * @code
+ *   [aggregator process]
+ *   size_t memsize = qshmq_memsize(4 * 1024 * 1024);
+ *   int shmid = qshm_init("/some/file/for/generating/unique/key", 'q',
+ *                         memsize, true);
+ *   qshmq_t *q = qshmq_init(qshm_get(shmid), memsize);
+ *
+ *   size_t size;
+ *   void *msg;
+ *   while ((msg = qshmq_peek(q, &size, -1)) != NULL) {
+ *     (... process msg ...)
+ *     qshmq_consume(q);
+ *   }
+ *
+ *   [worker processes]
+ *   int shmid = qshm_getid("/some/file/for/generating/unique/key", 'q');
+ *   qshmq_t *q = qshmq_attach(qshm_get(shmid));
+ *
+ *   // copy a message in
+ *   qshmq_push(q, "hello", 5, -1);
+ *
+ *   // or build it in place
+ *   struct record *r = qshmq_reserve(q, sizeof(struct record), -1);
+ *   r->id = 1;
+ *   qshmq_commit(q, r);
+ * @endcode
+ *
+ * @note
+ *  Messages are delivered in the order their space was reserved, so one
+ *  reserved but uncommitted message holds back the ones behind it. The
+ *  largest message is half of the capacity minus 8 bytes. Sleeping on
+ *  futexes needs Linux. Elsewhere waiters poll every millisecond.
+ */
+
+#ifndef DISABLE_IPC
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#endif
+#include "qinternal.h"
+#include "ipc/qshmlock.h"
+#include "ipc/qshmq.h"
+
+#ifndef _DOXYGEN_SKIP
+
+#define QSHMQ_MAGIC         (0x71736d71)
+#define QSHMQ_MIN_CAPACITY  (64)
+#define QSHMQ_BUSY          (0x01)  /*!< reserved, not committed yet */
+#define QSHMQ_PAD           (0x02)  /*!< filler up to the end of ring */
+#define CACHELINE_SIZE      (64)
+
+#define LOAD_ACQUIRE(p)     __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define LOAD_SEQCST(p)      __atomic_load_n(p, __ATOMIC_SEQ_CST)
+#define STORE_RELEASE(p, v) __atomic_store_n(p, v, __ATOMIC_RELEASE)
+#define STORE_SEQCST(p, v)  __atomic_store_n(p, v, __ATOMIC_SEQ_CST)
+#define FETCH_ADD(p, v)     __atomic_fetch_add(p, v, __ATOMIC_SEQ_CST)
+
+typedef struct qshmq_hdr_s qshmq_hdr_t;
+
+struct qshmq_hdr_s {
+    uint32_t len;       /*!< message size */
+    uint32_t flags;     /*!< QSHMQ_BUSY, QSHMQ_PAD or 0 when ready */
+};
+
+#define HDR_SIZE            (sizeof(qshmq_hdr_t))
+#define FRAME_SIZE(len)     (HDR_SIZE + (((len) + 7) & ~((size_t) 7)))
+
+struct qshmq_s {
+    uint32_t magic;     /*!< set once initialized */
+    uint32_t reserved;
+    uint64_t capacity;  /*!< ring size in bytes, power of 2 */
+    uint64_t mask;      /*!< capacity - 1 */
+    qshmlock_t lock;    /*!< serializes producers claiming space */
+
+    // keep producer and consumer sides on different cache lines.
+    char pad0[CACHELINE_SIZE];
+    uint64_t tail;      /*!< producer position */
+    uint32_t dataseq;   /*!< futex word, bumped on every commit */
+    uint32_t rwaiting;  /*!< consumer is sleeping on dataseq */
+    char pad1[CACHELINE_SIZE - 16];
+    uint64_t head;      /*!< consumer position */
+    uint32_t spaceseq;  /*!< futex word, bumped when space is freed */
+    uint32_t wwaiting;  /*!< number of producers sleeping on spaceseq */
+    char pad2[CACHELINE_SIZE - 16];
+};
+
+#define DATA_OFFSET (((sizeof(qshmq_t) + CACHELINE_SIZE - 1)                 \
+                      / CACHELINE_SIZE) * CACHELINE_SIZE)
+#define DATA(q)     ((char *) (q) + DATA_OFFSET)
+
+static void _advance(qshmq_t *q, uint64_t head);
+static bool _deadline(int waitms, struct timespec *deadline);
+static bool _wait(uint32_t *addr, uint32_t val,
+                  const struct timespec *deadline);
+static void _wake(uint32_t *addr, int n);
+
+#endif
+
+/**
+ * Get the size of shared memory needed for a queue.
+ *
+ * @param capacity  ring size in bytes. It's rounded up to a power of 2.
+ *
+ * @return the number of bytes to give to qshm_init() and qshmq_init().
+ */
+size_t qshmq_memsize(size_t capacity) {
+    size_t cap = QSHMQ_MIN_CAPACITY;
+    while (cap < capacity)
+        cap *= 2;
+    return DATA_OFFSET + cap;
+}
+
+/**
+ * Initialize a queue in shared memory.
+ *
+ * @param mem       pointer of shared memory. 8 byte alignment is required.
+ * @param memsize   size of shared memory. The ring takes the biggest power
+ *                  of 2 which fits.
+ *
+ * @return a pointer of qshmq_t if successful, otherwise returns NULL.
+ * @retval errno will be set in error condition.
+ *  - EINVAL    : Invalid argument.
+ *
+ * @note
+ *  Initialize it once by the creator of the shared memory before other
+ *  processes attach it.
+ */
+qshmq_t *qshmq_init(void *mem, size_t memsize) {
+    if (mem == NULL || ((uintptr_t) mem & 7) != 0
+            || memsize < DATA_OFFSET + QSHMQ_MIN_CAPACITY) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    size_t cap = QSHMQ_MIN_CAPACITY;
+    while (cap * 2 > cap && cap * 2 <= memsize - DATA_OFFSET)
+        cap *= 2;
+
+    qshmq_t *q = (qshmq_t *) mem;
+    memset((void *) q, 0, sizeof(qshmq_t));
+    if (qshmlock_init(&q->lock) == false)
+        return NULL;
+    q->capacity = cap;
+    q->mask = cap - 1;
+    STORE_RELEASE(&q->magic, QSHMQ_MAGIC);
+
+    return q;
+}
+
+/**
+ * Attach a queue initialized by qshmq_init().
+ *
+ * @param mem       pointer of shared memory
+ *
+ * @return a pointer of qshmq_t if successful, otherwise returns NULL.
+ * @retval errno will be set in error condition.
+ *  - EINVAL    : Not an initialized queue.
+ */
+qshmq_t *qshmq_attach(void *mem) {
+    qshmq_t *q = (qshmq_t *) mem;
+    if (q == NULL || LOAD_ACQUIRE(&q->magic) != QSHMQ_MAGIC) {
+        errno = EINVAL;
+        return NULL;
+    }
+    return q;
+}
+
+/**
+ * Put a copy of message into the queue.
+ *
+ * @param q         qshmq_t pointer
+ * @param data      message
+ * @param size      message size
+ * @param waitms    maximum milliseconds to wait for free space. 0 for
+ *                  no waiting, -1 for waiting forever.
+ *
+ * @return true if successful, otherwise returns false.
+ * @retval errno will be set in error condition.
+ *  - EINVAL    : Invalid argument.
+ *  - EMSGSIZE  : Message is bigger than half of the capacity.
+ *  - EAGAIN    : Queue is full and waitms is 0.
+ *  - ETIMEDOUT : Queue is still full after waitms.
+ */
+bool qshmq_push(qshmq_t *q, const void *data, size_t size, int waitms) {
+    if (data == NULL && size > 0) {
+        errno = EINVAL;
+        return false;
+    }
+    void *ptr = qshmq_reserve(q, size, waitms);
+    if (ptr == NULL)
+        return false;
+    if (size > 0)
+        memcpy(ptr, data, size);
+    return qshmq_commit(q, ptr);
+}
+
+/**
+ * Reserve space for a message to be built in place.
+ *
+ * @param q         qshmq_t pointer
+ * @param size      message size
+ * @param waitms    maximum milliseconds to wait for free space. 0 for
+ *                  no waiting, -1 for waiting forever.
+ *
+ * @return a pointer to write size bytes of message into, otherwise NULL.
+ * @retval errno will be set in error condition.
+ *  - EINVAL    : Invalid argument.
+ *  - EMSGSIZE  : Message is bigger than half of the capacity.
+ *  - EAGAIN    : Queue is full and waitms is 0.
+ *  - ETIMEDOUT : Queue is still full after waitms.
+ *
+ * @note
+ *  The returned pointer is 8 byte aligned. The message is delivered once
+ *  qshmq_commit() is called. Commit it soon since the consumer can't
+ *  read past an uncommitted message.
+ */
+void *qshmq_reserve(qshmq_t *q, size_t size, int waitms) {
+    if (q == NULL) {
+        errno = EINVAL;
+        return NULL;
+    }
+    size_t need = FRAME_SIZE(size);
+    if (size > UINT32_MAX || need > q->capacity / 2) {
+        errno = EMSGSIZE;
+        return NULL;
+    }
+
+    struct timespec deadline;
+    bool timed = _deadline(waitms, &deadline);
+
+    while (true) {
+        uint32_t seq = LOAD_SEQCST(&q->spaceseq);
+
+        if (qshmlock_enter(&q->lock, NULL) == false)
+            return NULL;
+        uint64_t tail = q->tail;
+        size_t off = (size_t) (tail & q->mask);
+        size_t pad = (off + need > q->capacity) ? q->capacity - off : 0;
+        uint64_t head = LOAD_ACQUIRE(&q->head);
+        if (tail + pad + need - head <= q->capacity) {
+            qshmq_hdr_t *hdr;
+            if (pad > 0) {
+                hdr = (qshmq_hdr_t *) (DATA(q) + off);
+                hdr->len = (uint32_t) (pad - HDR_SIZE);
+                hdr->flags = QSHMQ_PAD;
+                off = 0;
+            }
+            hdr = (qshmq_hdr_t *) (DATA(q) + off);
+            hdr->len = (uint32_t) size;
+            hdr->flags = QSHMQ_BUSY;
+            STORE_RELEASE(&q->tail, tail + pad + need);
+            qshmlock_leave(&q->lock);
+            return (void *) (hdr + 1);
+        }
+        qshmlock_leave(&q->lock);
+
+        if (waitms == 0) {
+            errno = EAGAIN;
+            return NULL;
+        }
+        FETCH_ADD(&q->wwaiting, 1);
+        bool ok = _wait(&q->spaceseq, seq, timed ? &deadline : NULL);
+        FETCH_ADD(&q->wwaiting, -1);
+        if (ok == false) {
+            errno = ETIMEDOUT;
+            return NULL;
+        }
+    }
+}
+
+/**
+ * Deliver a message reserved by qshmq_reserve().
+ *
+ * @param q         qshmq_t pointer
+ * @param ptr       pointer returned by qshmq_reserve()
+ *
+ * @return true if successful, otherwise returns false.
+ * @retval errno will be set in error condition.
+ *  - EINVAL    : Invalid argument or already committed.
+ */
+bool qshmq_commit(qshmq_t *q, void *ptr) {
+    if (q == NULL || ptr == NULL) {
+        errno = EINVAL;
+        return false;
+    }
+    qshmq_hdr_t *hdr = (qshmq_hdr_t *) ptr - 1;
+    if (hdr->flags != QSHMQ_BUSY) {
+        errno = EINVAL;
+        return false;
+    }
+
+    STORE_RELEASE(&hdr->flags, 0);
+    FETCH_ADD(&q->dataseq, 1);
+    if (LOAD_SEQCST(&q->rwaiting) != 0) {
+        _wake(&q->dataseq, 1);
+    }
+    return true;
+}
+
+/**
+ * Get the oldest message in place without removing it.
+ *
+ * @param q         qshmq_t pointer
+ * @param size      if not NULL, the message size will be stored
+ * @param waitms    maximum milliseconds to wait for a message. 0 for
+ *                  no waiting, -1 for waiting forever.
+ *
+ * @return a pointer of message if successful, otherwise returns NULL.
+ * @retval errno will be set in error condition.
+ *  - EINVAL    : Invalid argument.
+ *  - EAGAIN    : No message and waitms is 0.
+ *  - ETIMEDOUT : No message after waitms.
+ *
+ * @note
+ *  Only a single consumer can call this. The message stays valid until
+ *  qshmq_consume() is called.
+ */
+void *qshmq_peek(qshmq_t *q, size_t *size, int waitms) {
+    if (q == NULL) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    struct timespec deadline;
+    bool timed = _deadline(waitms, &deadline);
+
+    while (true) {
+        uint32_t seq = LOAD_SEQCST(&q->dataseq);
+
+        uint64_t head = q->head;
+        while (head != LOAD_ACQUIRE(&q->tail)) {
+            qshmq_hdr_t *hdr = (qshmq_hdr_t *) (DATA(q) + (head & q->mask));
+            uint32_t flags = LOAD_ACQUIRE(&hdr->flags);
+            if (flags & QSHMQ_PAD) {
+                head += HDR_SIZE + hdr->len;
+                _advance(q, head);
+                continue;
+            }
+            if (flags & QSHMQ_BUSY)
+                break;
+            if (size != NULL)
+                *size = hdr->len;
+            return (void *) (hdr + 1);
+        }
+
+        if (waitms == 0) {
+            errno = EAGAIN;
+            return NULL;
+        }
+        STORE_SEQCST(&q->rwaiting, 1);
+        bool ok = _wait(&q->dataseq, seq, timed ? &deadline : NULL);
+        STORE_SEQCST(&q->rwaiting, 0);
+        if (ok == false) {
+            errno = ETIMEDOUT;
+            return NULL;
+        }
+    }
+}
+
+/**
+ * Remove the message returned by qshmq_peek().
+ *
+ * @param q         qshmq_t pointer
+ *
+ * @return true if successful, otherwise returns false.
+ * @retval errno will be set in error condition.
+ *  - EINVAL    : Invalid argument.
+ *  - ENOENT    : No committed message.
+ */
+bool qshmq_consume(qshmq_t *q) {
+    if (q == NULL) {
+        errno = EINVAL;
+        return false;
+    }
+    if (qshmq_peek(q, NULL, 0) == NULL) {
+        errno = ENOENT;
+        return false;
+    }
+
+    uint64_t head = q->head;
+    qshmq_hdr_t *hdr = (qshmq_hdr_t *) (DATA(q) + (head & q->mask));
+    _advance(q, head + FRAME_SIZE(hdr->len));
+    return true;
+}
+
+/**
+ * Get a copy of the oldest message and remove it.
+ *
+ * @param q         qshmq_t pointer
+ * @param buf       buffer to copy the message into
+ * @param bufsize   buffer size
+ * @param waitms    maximum milliseconds to wait for a message. 0 for
+ *                  no waiting, -1 for waiting forever.
+ *
+ * @return the message size if successful, otherwise returns -1.
+ * @retval errno will be set in error condition.
+ *  - EINVAL    : Invalid argument.
+ *  - EAGAIN    : No message and waitms is 0.
+ *  - ETIMEDOUT : No message after waitms.
+ *  - EMSGSIZE  : The message is bigger than bufsize. It stays in the queue.
+ */
+ssize_t qshmq_pop(qshmq_t *q, void *buf, size_t bufsize, int waitms) {
+    size_t size;
+    void *ptr = qshmq_peek(q, &size, waitms);
+    if (ptr == NULL)
+        return -1;
+    if (size > bufsize || (buf == NULL && size > 0)) {
+        errno = (buf == NULL) ? EINVAL : EMSGSIZE;
+        return -1;
+    }
+    if (size > 0)
+        memcpy(buf, ptr, size);
+    qshmq_consume(q);
+    return (ssize_t) size;
+}
+
+/**
+ * Get the ring size in bytes.
+ *
+ * @param q         qshmq_t pointer
+ *
+ * @return capacity of the ring
+ */
+size_t qshmq_capacity(qshmq_t *q) {
+    if (q == NULL)
+        return 0;
+    return (size_t) q->capacity;
+}
+
+/**
+ * Get the number of bytes in use, including frame headers.
+ *
+ * @param q         qshmq_t pointer
+ *
+ * @return bytes in use
+ */
+size_t qshmq_used(qshmq_t *q) {
+    if (q == NULL)
+        return 0;
+    uint64_t head = LOAD_ACQUIRE(&q->head);
+    return (size_t) (LOAD_ACQUIRE(&q->tail) - head);
+}
+
+/**
+ * Destroy the queue.
+ *
+ * @param q         qshmq_t pointer
+ *
+ * @return true if successful, otherwise returns false
+ *
+ * @note
+ *  The shared memory itself isn't released. Use qshm_free() for that.
+ */
+bool qshmq_free(qshmq_t *q) {
+    if (q == NULL) {
+        errno = EINVAL;
+        return false;
+    }
+    STORE_RELEASE(&q->magic, 0);
+    return qshmlock_free(&q->lock);
+}
+
+#ifndef _DOXYGEN_SKIP
+
+static void _advance(qshmq_t *q, uint64_t head) {
+    STORE_RELEASE(&q->head, head);
+    FETCH_ADD(&q->spaceseq, 1);
+    if (LOAD_SEQCST(&q->wwaiting) != 0) {
+        _wake(&q->spaceseq, INT_MAX);
+    }
+}
+
+static bool _deadline(int waitms, struct timespec *deadline) {
+    if (waitms <= 0)
+        return false;
+    clock_gettime(CLOCK_MONOTONIC, deadline);
+    deadline->tv_sec += waitms / 1000;
+    deadline->tv_nsec += (long) (waitms % 1000) * 1000000L;
+    if (deadline->tv_nsec >= 1000000000L) {
+        deadline->tv_sec++;
+        deadline->tv_nsec -= 1000000000L;
+    }
+    return true;
+}
+
+/* returns false only when the deadline has passed */
+static bool _wait(uint32_t *addr, uint32_t val,
+                  const struct timespec *deadline) {
+    struct timespec ts, *tsp = NULL;
+    if (deadline != NULL) {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        ts.tv_sec = deadline->tv_sec - now.tv_sec;
+        ts.tv_nsec = deadline->tv_nsec - now.tv_nsec;
+        if (ts.tv_nsec < 0) {
+            ts.tv_sec--;
+            ts.tv_nsec += 1000000000L;
+        }
+        if (ts.tv_sec < 0)
+            return false;
+        tsp = &ts;
+    }
+
+#ifdef __linux__
+    if (syscall(SYS_futex, addr, FUTEX_WAIT, val, tsp, NULL, 0) != 0
+            && errno == ETIMEDOUT)
+        return false;
+#else
+    if (LOAD_SEQCST(addr) == val) {
+        struct timespec tick = { 0, 1000000L };
+        if (tsp != NULL && tsp->tv_sec == 0 && tsp->tv_nsec < tick.tv_nsec)
+            tick = *tsp;
+        nanosleep(&tick, NULL);
+    }
+#endif
+    return true;
+}
+
+static void _wake(uint32_t *addr, int n) {
+#ifdef __linux__
+    syscall(SYS_futex, addr, FUTEX_WAKE, n, NULL, NULL, 0);
+#endif
+}
+
+#endif /* _DOXYGEN_SKIP */
+
+#endif /* DISABLE_IPC */
@@ -28,6 +28,29 @@
 
 /**
  * @file qcount.c Counter file handling APIs.
+ *
+ * qcount_read(), qcount_save() and qcount_update() work on the counter file
+ * directly, so every update costs a few system calls.
+ *
+ * For hot counters, qcount() keeps the values in memory and updates them
+ * with atomic operations. The files are written in the same format in the
+ * background, every given seconds and when the registry is freed. Giving
+ * shared memory from qshm makes a registry shared by processes.
+ *
+ * @code
+ *   // counters of this process, written every 5 seconds.
+ *   qcount_t *cnt = qcount(NULL, qcount_memsize(100), 5);
+ *   qcount_add(cnt, "hits.dat", 1);
+ *   qcount_free(cnt);
+ *
+ *   // shared by processes, only the creator writes the files.
+ *   size_t memsize = qcount_memsize(100);
+ *   int shmid = qshm_init("/some/file", 'c', memsize, true);
+ *   void *mem = qshm_get(shmid);
+ *   qcount_t *cnt = qcount(mem, memsize, 5);
+ *   // in other processes
+ *   qcount_t *cnt = qcount_attach(mem, -1);
+ * @endcode
  */
 
 #include <stdio.h>
@@ -40,10 +63,66 @@
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/time.h>
+#include <errno.h>
+#include <sched.h>
+#include <pthread.h>
 #include "qinternal.h"
 #include "utilities/qstring.h"
+#include "utilities/qhash.h"
 #include "utilities/qcount.h"
 
+#ifndef _DOXYGEN_SKIP
+
+#define QCOUNT_MAGIC        (0x71636e74)
+#define QCOUNT_PATHLEN      (232)
+#define QCOUNT_HDRSIZE      (64)
+
+#define SLOT_EMPTY          (0)
+#define SLOT_INIT           (1)     /*!< being claimed, loading the file */
+#define SLOT_READY          (2)
+
+#define LOAD_ACQUIRE(p)     __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define STORE_RELEASE(p, v) __atomic_store_n(p, v, __ATOMIC_RELEASE)
+#define CAS_STRONG(p, e, v) __atomic_compare_exchange_n(p, e, v, false,     \
+                                    __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)
+#define FETCH_ADD(p, v)     __atomic_fetch_add(p, v, __ATOMIC_RELAXED)
+
+struct qcount_slot_s {
+    uint32_t state;     /*!< SLOT_EMPTY, SLOT_INIT or SLOT_READY */
+    uint32_t hash;      /*!< hash of path */
+    int64_t value;      /*!< current value */
+    int64_t saved;      /*!< value last written to the file */
+    char path[QCOUNT_PATHLEN];
+};
+
+struct qcount_mem_s {
+    uint32_t magic;     /*!< set once initialized */
+    uint32_t max;       /*!< number of slots */
+    char pad[QCOUNT_HDRSIZE - 8];
+    struct qcount_slot_s slots[];
+};
+
+struct qcount_s {
+    struct qcount_mem_s *mem;
+    bool allocated;     /*!< mem is owned by this handle */
+    int syncsec;
+
+    pthread_t thread;
+    bool running;
+    bool stop;
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+};
+
+static qcount_t *_handle(struct qcount_mem_s *mem, bool allocated,
+                         int syncsec);
+static struct qcount_slot_s *_lookup(struct qcount_mem_s *mem,
+                                     const char *filepath, bool create);
+static void *_syncer(void *arg);
+
+#endif
+
 /**
  * Read counter(integer) from file with advisory file locking.
  *
@@ -101,6 +180,7 @@ bool qcount_save(const char *filepath, int64_t number) {
     char *str = qstrdupf("%"PRId64, number);
     ssize_t updated = write(fd, str, strlen(str));
     close(fd);
+    qlibc_free(str);
 
     if (updated > 0)
         return true;
@@ -129,3 +209,273 @@ int64_t qcount_update(const char *filepath, int64_t number) {
     }
     return 0;
 }
+
+/**
+ * Get the size of memory needed for a counter registry.
+ *
+ * @param max   maximum number of counters.
+ *
+ * @return the number of bytes to give to qcount().
+ */
+size_t qcount_memsize(int max) {
+    if (max < 1)
+        max = 1;
+    return sizeof(struct qcount_mem_s)
+            + sizeof(struct qcount_slot_s) * (size_t) max;
+}
+
+/**
+ * Create a counter registry.
+ *
+ * Counters are identified by their file path. The first qcount_add() of a
+ * path loads the value from the file, and after that the value lives in
+ * memory. Files are written only when the value has changed.
+ *
+ * @param mem       memory for the registry, 8 byte alignment is required.
+ *                  NULL to allocate it internally.
+ * @param memsize   size of memory. Use qcount_memsize() to get it.
+ * @param syncsec   interval in seconds to write changed counters to their
+ *                  files in the background. 0 for writing only at
+ *                  qcount_free(), -1 for writing only by qcount_sync().
+ *
+ * @return a pointer of qcount_t if successful, otherwise returns NULL.
+ * @retval errno will be set in error condition.
+ *  - EINVAL : Invalid argument.
+ *  - ENOMEM : Memory allocation failure.
+ *  - EAGAIN : Failed to create the thread.
+ *
+ * @note
+ *  To share counters by processes, give shared memory and initialize it
+ *  once by the creator before the other processes call qcount_attach().
+ */
+qcount_t *qcount(void *mem, size_t memsize, int syncsec) {
+    if (memsize < qcount_memsize(1) || ((uintptr_t) mem & 7) != 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    bool allocated = false;
+    if (mem == NULL) {
+        mem = qlibc_malloc(memsize);
+        if (mem == NULL) {
+            errno = ENOMEM;
+            return NULL;
+        }
+        allocated = true;
+    }
+
+    struct qcount_mem_s *cm = (struct qcount_mem_s *) mem;
+    memset(mem, 0, memsize);
+    cm->max = (memsize - sizeof(struct qcount_mem_s))
+            / sizeof(struct qcount_slot_s);
+    STORE_RELEASE(&cm->magic, QCOUNT_MAGIC);
+
+    qcount_t *cnt = _handle(cm, allocated, syncsec);
+    if (cnt == NULL && allocated == true)
+        qlibc_free(mem);
+    return cnt;
+}
+
+/**
+ * Attach a counter registry initialized by qcount() in shared memory.
+ *
+ * @param mem       pointer of shared memory
+ * @param syncsec   same as qcount(). Usually only one of the processes
+ *                  writes the files and the others give -1.
+ *
+ * @return a pointer of qcount_t if successful, otherwise returns NULL.
+ * @retval errno will be set in error condition.
+ *  - EINVAL : Not an initialized registry.
+ *  - ENOMEM : Memory allocation failure.
+ *  - EAGAIN : Failed to create the thread.
+ */
+qcount_t *qcount_attach(void *mem, int syncsec) {
+    struct qcount_mem_s *cm = (struct qcount_mem_s *) mem;
+    if (cm == NULL || LOAD_ACQUIRE(&cm->magic) != QCOUNT_MAGIC) {
+        errno = EINVAL;
+        return NULL;
+    }
+    return _handle(cm, false, syncsec);
+}
+
+/**
+ * Increases(or decrease) the counter value in memory.
+ *
+ * When the path is too long or the registry is full, it falls back to
+ * qcount_update() on the file.
+ *
+ * @param cnt       qcount_t pointer
+ * @param filepath  counter file path
+ * @param number    how much increase or decrease
+ *
+ * @return updated counter value.
+ *
+ * @code
+ *   qcount_add(cnt, "hits.dat", 1);
+ * @endcode
+ */
+int64_t qcount_add(qcount_t *cnt, const char *filepath, int64_t number) {
+    struct qcount_slot_s *slot = _lookup(cnt->mem, filepath, true);
+    if (slot == NULL)
+        return qcount_update(filepath, number);
+    return FETCH_ADD(&slot->value, number) + number;
+}
+
+/**
+ * Get the counter value. A counter not in the registry yet is read from
+ * its file.
+ *
+ * @param cnt       qcount_t pointer
+ * @param filepath  counter file path
+ *
+ * @return counter value.
+ */
+int64_t qcount_get(qcount_t *cnt, const char *filepath) {
+    struct qcount_slot_s *slot = _lookup(cnt->mem, filepath, false);
+    if (slot == NULL)
+        return qcount_read(filepath);
+    return __atomic_load_n(&slot->value, __ATOMIC_RELAXED);
+}
+
+/**
+ * Write the changed counters to their files now.
+ *
+ * @param cnt       qcount_t pointer
+ *
+ * @return true if all the changed counters are written, otherwise false.
+ */
+bool qcount_sync(qcount_t *cnt) {
+    struct qcount_mem_s *cm = cnt->mem;
+    bool ok = true;
+    uint32_t i;
+    for (i = 0; i < cm->max; i++) {
+        struct qcount_slot_s *slot = &cm->slots[i];
+        if (LOAD_ACQUIRE(&slot->state) != SLOT_READY)
+            continue;
+        int64_t value = __atomic_load_n(&slot->value, __ATOMIC_RELAXED);
+        if (value == __atomic_load_n(&slot->saved, __ATOMIC_RELAXED))
+            continue;
+        if (qcount_save(slot->path, value) == true) {
+            __atomic_store_n(&slot->saved, value, __ATOMIC_RELAXED);
+        } else {
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+/**
+ * Stop the background writer, write the changed counters unless syncsec
+ * was -1, and release the handle.
+ *
+ * @param cnt       qcount_t pointer
+ *
+ * @note
+ *  Shared memory itself isn't released. Use qshm_free() for that.
+ */
+void qcount_free(qcount_t *cnt) {
+    if (cnt == NULL)
+        return;
+
+    if (cnt->running == true) {
+        pthread_mutex_lock(&cnt->lock);
+        cnt->stop = true;
+        pthread_cond_signal(&cnt->wakeup);
+        pthread_mutex_unlock(&cnt->lock);
+        pthread_join(cnt->thread, NULL);
+    }
+    if (cnt->syncsec >= 0)
+        qcount_sync(cnt);
+
+    pthread_cond_destroy(&cnt->wakeup);
+    pthread_mutex_destroy(&cnt->lock);
+    if (cnt->allocated == true)
+        qlibc_free(cnt->mem);
+    qlibc_free(cnt);
+}
+
+#ifndef _DOXYGEN_SKIP
+
+static qcount_t *_handle(struct qcount_mem_s *mem, bool allocated,
+                         int syncsec) {
+    qcount_t *cnt = (qcount_t *) qlibc_calloc(1, sizeof(qcount_t));
+    if (cnt == NULL) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    cnt->mem = mem;
+    cnt->allocated = allocated;
+    cnt->syncsec = syncsec;
+    pthread_mutex_init(&cnt->lock, NULL);
+    pthread_cond_init(&cnt->wakeup, NULL);
+
+    if (syncsec > 0) {
+        if (pthread_create(&cnt->thread, NULL, _syncer, cnt) != 0) {
+            pthread_cond_destroy(&cnt->wakeup);
+            pthread_mutex_destroy(&cnt->lock);
+            qlibc_free(cnt);
+            errno = EAGAIN;
+            return NULL;
+        }
+        cnt->running = true;
+    }
+    return cnt;
+}
+
+// open addressing with linear probing. Slots are never removed, so a probe
+// can stop at the first empty one.
+static struct qcount_slot_s *_lookup(struct qcount_mem_s *mem,
+                                     const char *filepath, bool create) {
+    size_t len = strlen(filepath);
+    if (len >= QCOUNT_PATHLEN)
+        return NULL;
+    uint32_t hash = qhashmurmur3_32(filepath, len);
+
+    uint32_t i, idx = hash % mem->max;
+    for (i = 0; i < mem->max; i++, idx = (idx + 1) % mem->max) {
+        struct qcount_slot_s *slot = &mem->slots[idx];
+        uint32_t state = LOAD_ACQUIRE(&slot->state);
+        if (state == SLOT_EMPTY) {
+            if (create == false)
+                return NULL;
+            if (CAS_STRONG(&slot->state, &state, SLOT_INIT) == true) {
+                memcpy(slot->path, filepath, len + 1);
+                slot->hash = hash;
+                slot->value = slot->saved = qcount_read(filepath);
+                STORE_RELEASE(&slot->state, SLOT_READY);
+                return slot;
+            }
+        }
+        while (state == SLOT_INIT) {
+            sched_yield();
+            state = LOAD_ACQUIRE(&slot->state);
+        }
+        if (slot->hash == hash && !strcmp(slot->path, filepath))
+            return slot;
+    }
+    return NULL;
+}
+
+static void *_syncer(void *arg) {
+    qcount_t *cnt = (qcount_t *) arg;
+
+    pthread_mutex_lock(&cnt->lock);
+    while (cnt->stop == false) {
+        struct timeval tv;
+        gettimeofday(&tv, NULL);
+        struct timespec ts;
+        ts.tv_sec = tv.tv_sec + cnt->syncsec;
+        ts.tv_nsec = tv.tv_usec * 1000L;
+        pthread_cond_timedwait(&cnt->wakeup, &cnt->lock, &ts);
+        if (cnt->stop == true)
+            break;
+        pthread_mutex_unlock(&cnt->lock);
+        qcount_sync(cnt);
+        pthread_mutex_lock(&cnt->lock);
+    }
+    pthread_mutex_unlock(&cnt->lock);
+
+    return NULL;
+}
+
+#endif
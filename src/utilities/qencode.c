@@ -34,10 +34,138 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <string.h>
+#include <errno.h>
 #include "qinternal.h"
 #include "utilities/qstring.h"
 #include "utilities/qencode.h"
 
+#ifndef _DOXYGEN_SKIP
+
+struct qcodec_s {
+    int type;                   /*!< QCODEC_* */
+    int state;                  /*!< decoder state */
+    unsigned char carry[3];     /*!< input held back for the next update */
+    size_t carrylen;            /*!< bytes in carry */
+};
+
+static size_t _url_encode(const unsigned char *in, size_t size, char *out,
+                          size_t room, size_t *consumed);
+static size_t _url_decode(const char *in, size_t len, char *out, bool final,
+                          size_t *consumed);
+static size_t _b64_encode(const unsigned char *in, size_t size, char *out);
+static size_t _b64_decode(int *state, const unsigned char *in, size_t len,
+                          unsigned char *out);
+static size_t _hex_encode(const unsigned char *in, size_t size, char *out);
+static size_t _hex_decode(int *state, const unsigned char *in, size_t len,
+                          unsigned char *out);
+static char *_parse_query(char *query, char equalchar, char sepchar,
+                          qnobj_t *obj);
+
+/*
+ * The encoders and decoders have SSE2/SSSE3/AVX2 kernels on x86, picked at
+ * runtime by the CPU features. The kernels only take care of the bulk of
+ * the input and leave the rest, including anything unusual, to the scalar
+ * code, so the results are always the same.
+ */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define ENCODE_SIMD
+#include <immintrin.h>
+
+#define SIMD_NONE   (0)
+#define SIMD_SSE2   (1)
+#define SIMD_SSSE3  (2)
+#define SIMD_AVX2   (3)
+
+static int simdmax = SIMD_AVX2;  // see _q_encode_simd()
+
+static int _simd_level(void);
+static size_t _url_safelen_sse2(const unsigned char *in, size_t size,
+                                size_t room, char *out);
+static size_t _url_plainlen_sse2(const char *in, size_t len, char *out);
+static size_t _b64_encode_ssse3(const unsigned char *in, size_t size,
+                                char *out);
+static size_t _b64_encode_avx2(const unsigned char *in, size_t size,
+                               char *out);
+static size_t _b64_decode_ssse3(const unsigned char *in, size_t len,
+                                unsigned char *out);
+static size_t _b64_decode_avx2(const unsigned char *in, size_t len,
+                               unsigned char *out);
+static size_t _hex_encode_ssse3(const unsigned char *in, size_t size,
+                                char *out);
+static size_t _hex_decode_ssse3(const unsigned char *in, size_t len,
+                                unsigned char *out);
+#endif
+
+static const char URLCHARTBL[16*16] = {
+    00 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , // 00-0F
+    00 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , // 10-1F
+    00 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 ,'-','.','/', // 20-2F
+    '0','1','2','3','4','5','6','7','8','9',':', 0 , 0 , 0 , 0 , 0 , // 30-3F
+    '@','A','B','C','D','E','F','G','H','I','J','K','L','M','N','O', // 40-4F
+    'P','Q','R','S','T','U','V','W','X','Y','Z', 0 ,'\\',0 , 0 ,'_', // 50-5F
+    00 ,'a','b','c','d','e','f','g','h','i','j','k','l','m','n','o', // 60-6f
+    'p','q','r','s','t','u','v','w','x','y','z', 0 , 0 , 0 , 0 , 0 , // 70-7F
+    00 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , // 80-8F
+    00 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , // 90-9F
+    00 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , // A0-AF
+    00 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , // B0-BF
+    00 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , // C0-CF
+    00 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , // D0-DF
+    00 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , // E0-EF
+    00 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0   // F0-FF
+}; // 0 means must be encoded.
+
+static const char B64CHARTBL[64] = {
+    'A','B','C','D','E','F','G','H','I','J','K','L','M','N','O','P', // 00-0F
+    'Q','R','S','T','U','V','W','X','Y','Z','a','b','c','d','e','f', // 10-1F
+    'g','h','i','j','k','l','m','n','o','p','q','r','s','t','u','v', // 20-2F
+    'w','x','y','z','0','1','2','3','4','5','6','7','8','9','+','/'  // 30-3F
+};
+
+static const unsigned char B64MAPTBL[16 * 16] = {
+    64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,  // 00-0F
+    64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,  // 10-1F
+    64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 62, 64, 64, 64, 63,  // 20-2F
+    52, 53, 54, 55, 56, 57, 58, 59, 60, 61, 64, 64, 64, 64, 64, 64,  // 30-3F
+    64,  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14,  // 40-4F
+    15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 64, 64, 64, 64, 64,  // 50-5F
+    64, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40,  // 60-6F
+    41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51, 64, 64, 64, 64, 64,  // 70-7F
+    64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,  // 80-8F
+    64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,  // 90-9F
+    64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,  // A0-AF
+    64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,  // B0-BF
+    64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,  // C0-CF
+    64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,  // D0-DF
+    64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,  // E0-EF
+    64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64   // F0-FF
+};
+
+static const char HEXCHARTBL[16] = {
+    '0','1','2','3','4','5','6','7','8','9','a','b','c','d','e','f'
+};
+
+static const unsigned char HEXMAPTBL[16*16] = {
+    0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, // 00-0F
+    0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, // 10-1F
+    0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, // 20-2F
+    0,  1,  2,  3,  4,  5,  6,  7,  8,  9,  0,  0,  0,  0,  0,  0, // 30-3F
+    0, 10, 11, 12, 13, 14, 15,  0,  0,  0,  0,  0,  0,  0,  0,  0, // 40-4F
+    0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, // 50-5F
+    0, 10, 11, 12, 13, 14, 15,  0,  0,  0,  0,  0,  0,  0,  0,  0, // 60-6f
+    0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, // 70-7F
+    0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, // 80-8F
+    0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, // 90-9F
+    0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, // A0-AF
+    0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, // B0-BF
+    0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, // C0-CF
+    0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, // D0-DF
+    0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, // E0-EF
+    0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0  // F0-FF
+};
+
+#endif /* _DOXYGEN_SKIP */
+
 /**
  * Parse URL encoded query string
  *
@@ -58,6 +186,10 @@
  *  printf("sort = %s\n", tbl->get_str(tbl, "sort", false));
  *  tbl->free(tbl);
  * @endcode
+ *
+ * @note
+ *  Names and values are copied into the table, so tbl must not be created
+ *  with QLISTTBL_REFERENCE option. Use qparse_queries_inplace() for that.
  */
 qlisttbl_t *qparse_queries(qlisttbl_t *tbl, const char *query, char equalchar,
                            char sepchar, int *count) {
@@ -71,26 +203,74 @@ qlisttbl_t *qparse_queries(qlisttbl_t *tbl, const char *query, char equalchar,
     int cnt = 0;
 
     if (query != NULL)
-        newquery = strdup(query);
-    while (newquery && *newquery) {
-        char *value = _q_makeword(newquery, sepchar);
-        char *name = qstrtrim(_q_makeword(value, equalchar));
-        qurl_decode(name);
-        qurl_decode(value);
-
-        if (tbl->putstr(tbl, name, value) == true)
+        newquery = qlibc_strdup(query);
+    char *next = newquery;
+    while (next != NULL && *next != '\0') {
+        qnobj_t obj;
+        next = _parse_query(next, equalchar, sepchar, &obj);
+        if (tbl->put(tbl, obj.name, obj.data, obj.size) == true)
             cnt++;
-        free(name);
-        free(value);
     }
     if (newquery != NULL)
-        free(newquery);
+        qlibc_free(newquery);
     if (count != NULL)
         *count = cnt;
 
     return tbl;
 }
 
+/**
+ * Parse URL encoded query string in place, without any memory allocation.
+ *
+ * The query string is cut into pieces and decoded in its own memory, and the
+ * names and the values are returned as pointers into it.
+ *
+ * @param query     URL encoded string. It's modified by parsing.
+ * @param equalchar separater of key, value pair.
+ * @param sepchar   separater of line.
+ * @param objs      array to store parsed entries. name and data point into
+ *                  the query string and size is the length of the decoded
+ *                  value plus 1 for the terminating NULL character, which is
+ *                  how the tables store strings. can be NULL.
+ * @param maxobjs   number of entries objs can hold.
+ *
+ * @return the number of entries in the query string. if it's greater than
+ *         maxobjs, only the first maxobjs entries are stored in objs.
+ *
+ * @code
+ *  char query[] = "category=love&str=%C5%A5%B5%F0%C4%DA%B4%F5&sort=asc";
+ *  qnobj_t objs[32];
+ *  int num = qparse_queries_inplace(query, '=', '&', objs, 32);
+ *  int i;
+ *  for (i = 0; i < num && i < 32; i++) {
+ *      printf("%s = %s\n", objs[i].name, (char *)objs[i].data);
+ *  }
+ *
+ *  // the entries can be put into a table without copies.
+ *  qlisttbl_t *tbl = qlisttbl(QLISTTBL_REFERENCE | QLISTTBL_NODEPOOL);
+ *  tbl->putbatch(tbl, objs, (num < 32) ? num : 32);
+ *  (...query is reused by the table...)
+ *  tbl->free(tbl);
+ * @endcode
+ *
+ * @note
+ *  Names and values are NULL terminated in place, but a value may have
+ *  NULL characters in it when %00 is decoded. Use size to get the length.
+ */
+int qparse_queries_inplace(char *query, char equalchar, char sepchar,
+                           qnobj_t *objs, int maxobjs) {
+    int cnt = 0;
+    char *next = query;
+    while (next != NULL && *next != '\0') {
+        qnobj_t obj;
+        next = _parse_query(next, equalchar, sepchar, &obj);
+        if (objs != NULL && cnt < maxobjs)
+            objs[cnt] = obj;
+        cnt++;
+    }
+    return cnt;
+}
+
 /**
  * Encode data using URL encoding(Percent encoding) algorithm.
  *
@@ -121,58 +301,57 @@ qlisttbl_t *qparse_queries(qlisttbl_t *tbl, const char *query, char equalchar,
  * @endcode
  */
 char *qurl_encode(const void *bin, size_t size) {
-    const char URLCHARTBL[16*16] = {
-        00 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , // 00-0F
-        00 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , // 10-1F
-        00 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 ,'-','.','/', // 20-2F
-        '0','1','2','3','4','5','6','7','8','9',':', 0 , 0 , 0 , 0 , 0 , // 30-3F
-        '@','A','B','C','D','E','F','G','H','I','J','K','L','M','N','O', // 40-4F
-        'P','Q','R','S','T','U','V','W','X','Y','Z', 0 ,'\\',0 , 0 ,'_', // 50-5F
-        00 ,'a','b','c','d','e','f','g','h','i','j','k','l','m','n','o', // 60-6f
-        'p','q','r','s','t','u','v','w','x','y','z', 0 , 0 , 0 , 0 , 0 , // 70-7F
-        00 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , // 80-8F
-        00 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , // 90-9F
-        00 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , // A0-AF
-        00 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , // B0-BF
-        00 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , // C0-CF
-        00 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , // D0-DF
-        00 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , // E0-EF
-        00 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0   // F0-FF
-    }; // 0 means must be encoded.
-
     if (bin == NULL)
         return NULL;
-    if (size == 0)
-        return strdup("");
 
     // malloc buffer
-    char *pszEncStr = (char *) malloc((size * 3) + 1);
+    char *pszEncStr = (char *) qlibc_malloc((size * 3) + 1);
     if (pszEncStr == NULL)
         return NULL;
 
-    char *pszEncPt = pszEncStr;
-    char *pBinPt = (char *) bin;
-    const char *pBinEnd = (bin + size - 1);
-    for (; pBinPt <= pBinEnd; pBinPt++) {
-        unsigned char c = *pBinPt;
-        if (URLCHARTBL[c] != 0) {
-            *pszEncPt++ = *pBinPt;
-        } else {
-            unsigned char cUpper4 = (c >> 4);
-            unsigned char cLower4 = (c & 0x0F);
-
-            *pszEncPt++ = '%';
-            *pszEncPt++ =
-                    (cUpper4 < 0x0A) ?
-                            (cUpper4 + '0') : ((cUpper4 - 0x0A) + 'a');
-            *pszEncPt++ =
-                    (cLower4 < 0x0A) ?
-                            (cLower4 + '0') : ((cLower4 - 0x0A) + 'a');
-        }
+    qurl_encode_into(bin, size, pszEncStr, (size * 3) + 1);
+    return pszEncStr;
+}
+
+/**
+ * Encode data using URL encoding into a given buffer.
+ *
+ * @param bin       a pointer of input data.
+ * @param size      the length of input data.
+ * @param buf       output buffer.
+ * @param bufsize   size of the output buffer. (size * 3) + 1 is always
+ *                  enough.
+ *
+ * @return the length of encoded string stored in buf in case of successful,
+ *         otherwise returns -1.
+ * @retval errno will be set in error condition.
+ *  - EINVAL  : Invalid argument.
+ *  - ENOBUFS : buf is too small.
+ *
+ * @note
+ *  The encoded string is always terminated by NULL character.
+ */
+ssize_t qurl_encode_into(const void *bin, size_t size, char *buf,
+                         size_t bufsize) {
+    if ((bin == NULL && size > 0) || buf == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (bufsize == 0) {
+        errno = ENOBUFS;
+        return -1;
     }
-    *pszEncPt = '\0';
 
-    return pszEncStr;
+    // keep room for the terminator
+    size_t consumed;
+    size_t n = _url_encode(bin, size, buf, bufsize - 1, &consumed);
+    buf[n] = '\0';
+    if (consumed < size) {
+        errno = ENOBUFS;
+        return -1;
+    }
+
+    return n;
 }
 
 /**
@@ -192,27 +371,43 @@ size_t qurl_decode(char *str) {
         return 0;
     }
 
-    char *pEncPt, *pBinPt = str;
-    for (pEncPt = str; *pEncPt != '\0'; pEncPt++) {
-        switch (*pEncPt) {
-            case '+': {
-                *pBinPt++ = ' ';
-                break;
-            }
-            case '%': {
-                *pBinPt++ = _q_x2c(*(pEncPt + 1), *(pEncPt + 2));
-                pEncPt += 2;
-                break;
-            }
-            default: {
-                *pBinPt++ = *pEncPt;
-                break;
-            }
-        }
+    size_t len = strlen(str);
+    ssize_t n = qurl_decode_into(str, len, str, len + 1);
+    return (n > 0) ? n : 0;
+}
+
+/**
+ * Decode URL encoded string into a given buffer.
+ *
+ * @param str       URL encoded string. doesn't need to be NULL terminated.
+ * @param len       the length of str.
+ * @param buf       output buffer. can be same as str for decoding in place.
+ * @param bufsize   size of the output buffer. must be at least len + 1.
+ *
+ * @return the length of bytes stored in buf in case of successful,
+ *         otherwise returns -1.
+ * @retval errno will be set in error condition.
+ *  - EINVAL  : Invalid argument.
+ *  - ENOBUFS : buf is too small.
+ *
+ * @note
+ *  The decoded data is always terminated by NULL character.
+ */
+ssize_t qurl_decode_into(const char *str, size_t len, void *buf,
+                         size_t bufsize) {
+    if (str == NULL || buf == NULL) {
+        errno = EINVAL;
+        return -1;
     }
-    *pBinPt = '\0';
+    if (bufsize < len + 1) {
+        errno = ENOBUFS;
+        return -1;
+    }
+
+    size_t n = _url_decode(str, len, buf, true, NULL);
+    ((char *) buf)[n] = '\0';
 
-    return (pBinPt - str);
+    return n;
 }
 
 /**
@@ -245,50 +440,53 @@ size_t qurl_decode(char *str) {
  * @endcode
  */
 char *qbase64_encode(const void *bin, size_t size) {
-    const char B64CHARTBL[64] = {
-        'A','B','C','D','E','F','G','H','I','J','K','L','M','N','O','P', // 00-0F
-        'Q','R','S','T','U','V','W','X','Y','Z','a','b','c','d','e','f', // 10-1F
-        'g','h','i','j','k','l','m','n','o','p','q','r','s','t','u','v', // 20-2F
-        'w','x','y','z','0','1','2','3','4','5','6','7','8','9','+','/'  // 30-3F
-    };
-
-    if (size == 0) {
-        return strdup("");
-    }
-
     // malloc for encoded string
-    char *pszB64 = (char *) malloc(
-            4 * ((size / 3) + ((size % 3 == 0) ? 0 : 1)) + 1);
+    size_t bufsize = 4 * ((size / 3) + ((size % 3 == 0) ? 0 : 1)) + 1;
+    char *pszB64 = (char *) qlibc_malloc(bufsize);
     if (pszB64 == NULL) {
         return NULL;
     }
 
-    char *pszB64Pt = pszB64;
-    unsigned char *pBinPt, *pBinEnd = (unsigned char *) (bin + size - 1);
-    unsigned char szIn[3] = { 0, 0, 0 };
-    int nOffset;
-    for (pBinPt = (unsigned char *) bin, nOffset = 0; pBinPt <= pBinEnd;
-            pBinPt++, nOffset++) {
-        int nIdxOfThree = nOffset % 3;
-        szIn[nIdxOfThree] = *pBinPt;
-        if (nIdxOfThree < 2 && pBinPt < pBinEnd)
-            continue;
-
-        *pszB64Pt++ = B64CHARTBL[((szIn[0] & 0xFC) >> 2)];
-        *pszB64Pt++ = B64CHARTBL[(((szIn[0] & 0x03) << 4)
-                | ((szIn[1] & 0xF0) >> 4))];
-        *pszB64Pt++ =
-                (nIdxOfThree >= 1) ?
-                        B64CHARTBL[(((szIn[1] & 0x0F) << 2)
-                                | ((szIn[2] & 0xC0) >> 6))] :
-                        '=';
-        *pszB64Pt++ = (nIdxOfThree >= 2) ? B64CHARTBL[(szIn[2] & 0x3F)] : '=';
+    if (qbase64_encode_into(bin, size, pszB64, bufsize) < 0) {
+        qlibc_free(pszB64);
+        return NULL;
+    }
+    return pszB64;
+}
 
-        memset((void *) szIn, 0, sizeof(szIn));
+/**
+ * Encode data using BASE64 algorithm into a given buffer.
+ *
+ * @param bin       a pointer of input data.
+ * @param size      the length of input data.
+ * @param buf       output buffer.
+ * @param bufsize   size of the output buffer. must be at least
+ *                  4 * ((size + 2) / 3) + 1.
+ *
+ * @return the length of encoded string stored in buf in case of successful,
+ *         otherwise returns -1.
+ * @retval errno will be set in error condition.
+ *  - EINVAL  : Invalid argument.
+ *  - ENOBUFS : buf is too small.
+ *
+ * @note
+ *  The encoded string is always terminated by NULL character.
+ */
+ssize_t qbase64_encode_into(const void *bin, size_t size, char *buf,
+                            size_t bufsize) {
+    if ((bin == NULL && size > 0) || buf == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (bufsize < 4 * ((size + 2) / 3) + 1) {
+        errno = ENOBUFS;
+        return -1;
     }
-    *pszB64Pt = '\0';
 
-    return pszB64;
+    size_t n = _b64_encode(bin, size, buf);
+    buf[n] = '\0';
+
+    return n;
 }
 
 /**
@@ -304,57 +502,46 @@ char *qbase64_encode(const void *bin, size_t size) {
  *  character.
  */
 size_t qbase64_decode(char *str) {
-    const char B64MAPTBL[16 * 16] = {
-        64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,  // 00-0F
-        64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,  // 10-1F
-        64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 62, 64, 64, 64, 63,  // 20-2F
-        52, 53, 54, 55, 56, 57, 58, 59, 60, 61, 64, 64, 64, 64, 64, 64,  // 30-3F
-        64,  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14,  // 40-4F
-        15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 64, 64, 64, 64, 64,  // 50-5F
-        64, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40,  // 60-6F
-        41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51, 64, 64, 64, 64, 64,  // 70-7F
-        64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,  // 80-8F
-        64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,  // 90-9F
-        64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,  // A0-AF
-        64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,  // B0-BF
-        64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,  // C0-CF
-        64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,  // D0-DF
-        64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,  // E0-EF
-        64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64   // F0-FF
-    };
-
-    char *pEncPt, *pBinPt = str;
-    int nIdxOfFour = 0;
-    char cLastByte = 0;
-    for (pEncPt = str; *pEncPt != '\0'; pEncPt++) {
-        char cByte = B64MAPTBL[(unsigned char) (*pEncPt)];
-        if (cByte == 64)
-            continue;
-
-        if (nIdxOfFour == 0) {
-            nIdxOfFour++;
-        } else if (nIdxOfFour == 1) {
-            // 00876543 0021????
-            //*pBinPt++ = ( ((cLastByte << 2) & 0xFC) | ((cByte >> 4) & 0x03) );
-            *pBinPt++ = ((cLastByte << 2) | (cByte >> 4));
-            nIdxOfFour++;
-        } else if (nIdxOfFour == 2) {
-            // 00??8765 004321??
-            //*pBinPt++ = ( ((cLastByte << 4) & 0xF0) | ((cByte >> 2) & 0x0F) );
-            *pBinPt++ = ((cLastByte << 4) | (cByte >> 2));
-            nIdxOfFour++;
-        } else {
-            // 00????87 00654321
-            //*pBinPt++ = ( ((cLastByte << 6) & 0xC0) | (cByte & 0x3F) );
-            *pBinPt++ = ((cLastByte << 6) | cByte);
-            nIdxOfFour = 0;
-        }
+    size_t len = strlen(str);
+    ssize_t n = qbase64_decode_into(str, len, str, len + 1);
+    return (n > 0) ? n : 0;
+}
 
-        cLastByte = cByte;
+/**
+ * Decode BASE64 encoded string into a given buffer.
+ *
+ * @param str       Base64 encoded string. doesn't need to be NULL terminated.
+ * @param len       the length of str.
+ * @param buf       output buffer. can be same as str for decoding in place.
+ * @param bufsize   size of the output buffer. must be at least
+ *                  (len / 4) * 3 + (len % 4) + 1.
+ *
+ * @return the length of bytes stored in buf in case of successful,
+ *         otherwise returns -1.
+ * @retval errno will be set in error condition.
+ *  - EINVAL  : Invalid argument.
+ *  - ENOBUFS : buf is too small.
+ *
+ * @note
+ *  Characters out of the Base64 alphabet like line breaks are ignored.
+ *  The decoded data is always terminated by NULL character.
+ */
+ssize_t qbase64_decode_into(const char *str, size_t len, void *buf,
+                            size_t bufsize) {
+    if (str == NULL || buf == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (bufsize < (len / 4) * 3 + (len % 4) + 1) {
+        errno = ENOBUFS;
+        return -1;
     }
-    *pBinPt = '\0';
 
-    return (pBinPt - str);
+    int state = 0;
+    size_t n = _b64_decode(&state, (const unsigned char *) str, len, buf);
+    ((char *) buf)[n] = '\0';
+
+    return n;
 }
 
 /**
@@ -389,26 +576,52 @@ size_t qbase64_decode(char *str) {
  * @endcode
  */
 char *qhex_encode(const void *bin, size_t size) {
-    const char HEXCHARTBL[16] = {
-        '0','1','2','3','4','5','6','7','8','9','a','b','c','d','e','f'
-    };
-
-    char *pHexStr = (char *) malloc(sizeof(char) * ((size * 2) + 1));
+    char *pHexStr = (char *) qlibc_malloc(sizeof(char) * ((size * 2) + 1));
     if (pHexStr == NULL)
         return NULL;
 
-    unsigned char *pSrc = (unsigned char *) bin;
-    char *pHexPt = pHexStr;
-    int i;
-    for (i = 0; i < size; i++) {
-        *pHexPt++ = HEXCHARTBL[(pSrc[i] >> 4)];
-        *pHexPt++ = HEXCHARTBL[(pSrc[i] & 0x0F)];
+    if (qhex_encode_into(bin, size, pHexStr, (size * 2) + 1) < 0) {
+        qlibc_free(pHexStr);
+        return NULL;
     }
-    *pHexPt = '\0';
-
     return pHexStr;
 }
 
+/**
+ * Encode data to Hexadecimal digit format into a given buffer.
+ *
+ * @param bin       a pointer of input data.
+ * @param size      the length of input data.
+ * @param buf       output buffer.
+ * @param bufsize   size of the output buffer. must be at least
+ *                  (size * 2) + 1.
+ *
+ * @return the length of encoded string stored in buf in case of successful,
+ *         otherwise returns -1.
+ * @retval errno will be set in error condition.
+ *  - EINVAL  : Invalid argument.
+ *  - ENOBUFS : buf is too small.
+ *
+ * @note
+ *  The encoded string is always terminated by NULL character.
+ */
+ssize_t qhex_encode_into(const void *bin, size_t size, char *buf,
+                         size_t bufsize) {
+    if ((bin == NULL && size > 0) || buf == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (bufsize < (size * 2) + 1) {
+        errno = ENOBUFS;
+        return -1;
+    }
+
+    size_t n = _hex_encode(bin, size, buf);
+    buf[n] = '\0';
+
+    return n;
+}
+
 /**
  * Decode Hexadecimal encoded data.
  *
@@ -422,31 +635,901 @@ char *qhex_encode(const void *bin, size_t size) {
  *  character.
  */
 size_t qhex_decode(char *str) {
-    const char HEXMAPTBL[16*16] = {
-        0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, // 00-0F
-        0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, // 10-1F
-        0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, // 20-2F
-        0,  1,  2,  3,  4,  5,  6,  7,  8,  9,  0,  0,  0,  0,  0,  0, // 30-3F
-        0, 10, 11, 12, 13, 14, 15,  0,  0,  0,  0,  0,  0,  0,  0,  0, // 40-4F
-        0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, // 50-5F
-        0, 10, 11, 12, 13, 14, 15,  0,  0,  0,  0,  0,  0,  0,  0,  0, // 60-6f
-        0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, // 70-7F
-        0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, // 80-8F
-        0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, // 90-9F
-        0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, // A0-AF
-        0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, // B0-BF
-        0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, // C0-CF
-        0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, // D0-DF
-        0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, // E0-EF
-        0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0  // F0-FF
-    };
-
-    char *pEncPt, *pBinPt = str;
-    for (pEncPt = str; *pEncPt != '\0'; pEncPt += 2) {
-        *pBinPt++ = (HEXMAPTBL[(unsigned char) (*pEncPt)] << 4)
-                + HEXMAPTBL[(unsigned char) (*(pEncPt + 1))];
-    }
-    *pBinPt = '\0';
-
-    return (pBinPt - str);
+    size_t len = strlen(str);
+    ssize_t n = qhex_decode_into(str, len, str, len + 1);
+    return (n > 0) ? n : 0;
+}
+
+/**
+ * Decode Hexadecimal encoded data into a given buffer.
+ *
+ * @param str       Hexadecimal encoded string. doesn't need to be NULL
+ *                  terminated.
+ * @param len       the length of str.
+ * @param buf       output buffer. can be same as str for decoding in place.
+ * @param bufsize   size of the output buffer. must be at least
+ *                  ((len + 1) / 2) + 1.
+ *
+ * @return the length of bytes stored in buf in case of successful,
+ *         otherwise returns -1.
+ * @retval errno will be set in error condition.
+ *  - EINVAL  : Invalid argument.
+ *  - ENOBUFS : buf is too small.
+ *
+ * @note
+ *  The decoded data is always terminated by NULL character.
+ */
+ssize_t qhex_decode_into(const char *str, size_t len, void *buf,
+                         size_t bufsize) {
+    if (str == NULL || buf == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (bufsize < ((len + 1) / 2) + 1) {
+        errno = ENOBUFS;
+        return -1;
+    }
+
+    int state = 0;
+    unsigned char *out = (unsigned char *) buf;
+    size_t n = _hex_decode(&state, (const unsigned char *) str, len, out);
+    if (state != 0) {
+        // odd number of digits
+        out[n++] = (state & 0xFF);
+    }
+    out[n] = '\0';
+
+    return n;
+}
+
+/**
+ * Create a streaming encoder or decoder.
+ *
+ * @param type  one of QCODEC_BASE64_ENCODE, QCODEC_BASE64_DECODE,
+ *              QCODEC_HEX_ENCODE, QCODEC_HEX_DECODE, QCODEC_URL_ENCODE and
+ *              QCODEC_URL_DECODE.
+ *
+ * @return a pointer of qcodec_t object in case of successful,
+ *         otherwise returns NULL.
+ * @retval errno will be set in error condition.
+ *  - EINVAL  : Invalid argument.
+ *  - ENOMEM  : Memory allocation failure.
+ *
+ * @note
+ *  A codec converts data of any size in pieces with qcodec_update() and
+ *  qcodec_final(), holding no more than a few bytes between the calls. The
+ *  output is the same as the one-shot functions without the terminating
+ *  NULL character.
+ *
+ * @code
+ *   // encode a file to stdout in 64KB pieces.
+ *   qcodec_t *codec = qcodec(QCODEC_BASE64_ENCODE);
+ *   char in[64 * 1024], out[128 * 1024];
+ *   ssize_t n;
+ *   while ((n = qio_read(fd, in, sizeof(in), -1)) > 0) {
+ *     n = qcodec_update(codec, in, n, out, sizeof(out));
+ *     fwrite(out, 1, n, stdout);
+ *   }
+ *   n = qcodec_final(codec, out, sizeof(out));
+ *   fwrite(out, 1, n, stdout);
+ *   qcodec_free(codec);
+ *
+ *   // decode a HTTP response body as it arrives.
+ *   static bool ondata(void *userdata, const void *data, size_t size) {
+ *     qcodec_t *codec = (qcodec_t *) userdata;
+ *     char out[64 * 1024];
+ *     while (size > 0) {
+ *       size_t piece = (size < sizeof(out)) ? size : sizeof(out);
+ *       ssize_t n = qcodec_update(codec, data, piece, out, sizeof(out));
+ *       if (n < 0) return false;
+ *       // use out[0..n)
+ *       data = (const char *) data + piece;
+ *       size -= piece;
+ *     }
+ *     return true;
+ *   }
+ *   client->readbody(client, resheaders, clength, ondata, codec);
+ * @endcode
+ */
+qcodec_t *qcodec(int type) {
+    if (type < QCODEC_BASE64_ENCODE || type > QCODEC_URL_DECODE) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    qcodec_t *codec = (qcodec_t *) qlibc_calloc(1, sizeof(qcodec_t));
+    if (codec == NULL) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    codec->type = type;
+
+    return codec;
+}
+
+/**
+ * Get the maximum output size of qcodec_update().
+ *
+ * @param codec     qcodec_t object pointer.
+ * @param size      the length of input data.
+ *
+ * @return the number of bytes the output buffer of qcodec_update() needs
+ *         for the given input size.
+ *
+ * @note
+ *  qcodec_final() never needs more than 4 bytes.
+ */
+size_t qcodec_bound(qcodec_t *codec, size_t size) {
+    switch (codec->type) {
+        case QCODEC_BASE64_ENCODE:
+            return 4 * ((size + codec->carrylen) / 3);
+        case QCODEC_BASE64_DECODE:
+            return (size / 4) * 3 + 4;
+        case QCODEC_HEX_ENCODE:
+            return size * 2;
+        case QCODEC_HEX_DECODE:
+            return (size / 2) + 1;
+        case QCODEC_URL_ENCODE:
+            return size * 3;
+        case QCODEC_URL_DECODE:
+            return size + codec->carrylen;
+    }
+    return 0;
+}
+
+/**
+ * Convert a piece of data.
+ *
+ * @param codec     qcodec_t object pointer.
+ * @param in        input data.
+ * @param size      the length of input data.
+ * @param out       output buffer.
+ * @param outsize   size of the output buffer. must be at least
+ *                  qcodec_bound(codec, size).
+ *
+ * @return the number of bytes stored in out in case of successful,
+ *         otherwise returns -1.
+ * @retval errno will be set in error condition.
+ *  - EINVAL  : Invalid argument.
+ *  - ENOBUFS : out is too small.
+ *
+ * @note
+ *  The output is not terminated by NULL character.
+ */
+ssize_t qcodec_update(qcodec_t *codec, const void *in, size_t size,
+                      void *out, size_t outsize) {
+    if (codec == NULL || (in == NULL && size > 0) || out == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (outsize < qcodec_bound(codec, size)) {
+        errno = ENOBUFS;
+        return -1;
+    }
+
+    const unsigned char *p = (const unsigned char *) in;
+    unsigned char *o = (unsigned char *) out;
+    size_t n = 0, consumed;
+    switch (codec->type) {
+        case QCODEC_BASE64_ENCODE: {
+            // complete the 3-byte group held from the last call.
+            if (codec->carrylen > 0) {
+                while (codec->carrylen < 3 && size > 0) {
+                    codec->carry[codec->carrylen++] = *p++;
+                    size--;
+                }
+                if (codec->carrylen < 3)
+                    return 0;
+                n = _b64_encode(codec->carry, 3, (char *) o);
+                codec->carrylen = 0;
+            }
+            size_t whole = (size / 3) * 3;
+            n += _b64_encode(p, whole, (char *) o + n);
+            codec->carrylen = size - whole;
+            memcpy(codec->carry, p + whole, codec->carrylen);
+            break;
+        }
+        case QCODEC_BASE64_DECODE: {
+            n = _b64_decode(&codec->state, p, size, o);
+            break;
+        }
+        case QCODEC_HEX_ENCODE: {
+            n = _hex_encode(p, size, (char *) o);
+            break;
+        }
+        case QCODEC_HEX_DECODE: {
+            n = _hex_decode(&codec->state, p, size, o);
+            break;
+        }
+        case QCODEC_URL_ENCODE: {
+            n = _url_encode(p, size, (char *) o, outsize, &consumed);
+            break;
+        }
+        case QCODEC_URL_DECODE: {
+            // complete the escape sequence held from the last call.
+            if (codec->carrylen > 0) {
+                while (codec->carrylen < 3 && size > 0) {
+                    codec->carry[codec->carrylen++] = *p++;
+                    size--;
+                }
+                if (codec->carrylen < 3)
+                    return 0;
+                o[n++] = _q_x2c(codec->carry[1], codec->carry[2]);
+                codec->carrylen = 0;
+            }
+            n += _url_decode((const char *) p, size, (char *) o + n, false,
+                             &consumed);
+            codec->carrylen = size - consumed;
+            memcpy(codec->carry, p + consumed, codec->carrylen);
+            break;
+        }
+    }
+
+    return n;
+}
+
+/**
+ * Finish the conversion.
+ *
+ * @param codec     qcodec_t object pointer.
+ * @param out       output buffer.
+ * @param outsize   size of the output buffer. 4 bytes is always enough.
+ *
+ * @return the number of bytes stored in out in case of successful,
+ *         otherwise returns -1.
+ * @retval errno will be set in error condition.
+ *  - EINVAL  : Invalid argument.
+ *  - ENOBUFS : out is too small.
+ *
+ * @note
+ *  This flushes out what's held back, like the padding of Base64, and
+ *  resets the codec for reuse.
+ */
+ssize_t qcodec_final(qcodec_t *codec, void *out, size_t outsize) {
+    if (codec == NULL || out == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    unsigned char *o = (unsigned char *) out;
+    size_t n = 0;
+    switch (codec->type) {
+        case QCODEC_BASE64_ENCODE: {
+            if (codec->carrylen > 0) {
+                if (outsize < 4) {
+                    errno = ENOBUFS;
+                    return -1;
+                }
+                n = _b64_encode(codec->carry, codec->carrylen, (char *) o);
+            }
+            break;
+        }
+        case QCODEC_HEX_DECODE: {
+            if (codec->state != 0) {
+                // odd number of digits
+                if (outsize < 1) {
+                    errno = ENOBUFS;
+                    return -1;
+                }
+                o[n++] = (codec->state & 0xFF);
+            }
+            break;
+        }
+        case QCODEC_URL_DECODE: {
+            // incomplete escape sequence goes out as it is.
+            if (outsize < codec->carrylen) {
+                errno = ENOBUFS;
+                return -1;
+            }
+            n = _url_decode((const char *) codec->carry, codec->carrylen,
+                            (char *) o, true, NULL);
+            break;
+        }
+    }
+    qcodec_reset(codec);
+
+    return n;
+}
+
+/**
+ * Reset the codec, discarding anything held back.
+ *
+ * @param codec     qcodec_t object pointer.
+ */
+void qcodec_reset(qcodec_t *codec) {
+    if (codec == NULL)
+        return;
+    codec->state = 0;
+    codec->carrylen = 0;
+}
+
+/**
+ * Release the codec.
+ *
+ * @param codec     qcodec_t object pointer.
+ */
+void qcodec_free(qcodec_t *codec) {
+    qlibc_free(codec);
+}
+
+#ifndef _DOXYGEN_SKIP
+
+// cut one name/value pair off the query and decode it in place. returns
+// where the next pair begins.
+static char *_parse_query(char *query, char equalchar, char sepchar,
+                          qnobj_t *obj) {
+    size_t len = strcspn(query, (char[2]) { sepchar, '\0' });
+    char *next = query + len;
+    if (*next != '\0')
+        *next++ = '\0';
+
+    char *name = query;
+    char *value = memchr(query, equalchar, len);
+    size_t namelen = len, valuelen = 0;
+    if (value != NULL) {
+        *value++ = '\0';
+        namelen = value - query - 1;
+        valuelen = len - namelen - 1;
+    } else {
+        value = query + len;
+    }
+
+    // names are trimmed but values are kept as they are.
+    qstrtrim(name);
+    qurl_decode_into(name, strlen(name), name, namelen + 1);
+    ssize_t n = qurl_decode_into(value, valuelen, value, valuelen + 1);
+
+    obj->name = name;
+    obj->data = value;
+    obj->size = ((n > 0) ? n : 0) + 1;
+    return next;
+}
+
+// URL encode until the input ends or the output is full.
+static size_t _url_encode(const unsigned char *in, size_t size, char *out,
+                          size_t room, size_t *consumed) {
+    const unsigned char *p = in, *end = in + size;
+    char *o = out, *oend = out + room;
+#ifdef ENCODE_SIMD
+    bool sse2 = (_simd_level() >= SIMD_SSE2);
+#endif
+    while (p < end) {
+#ifdef ENCODE_SIMD
+        if (sse2 == true && end - p >= 16 && oend - o >= 16) {
+            // copy 16 bytes at once as long as nothing needs to be encoded.
+            size_t n = _url_safelen_sse2(p, end - p, oend - o, o);
+            p += n;
+            o += n;
+            if (p == end)
+                break;
+        }
+#endif
+        unsigned char c = *p;
+        if (URLCHARTBL[c] != 0) {
+            if (o >= oend)
+                break;
+            *o++ = c;
+        } else {
+            if (oend - o < 3)
+                break;
+            *o++ = '%';
+            *o++ = HEXCHARTBL[c >> 4];
+            *o++ = HEXCHARTBL[c & 0x0F];
+        }
+        p++;
+    }
+
+    *consumed = p - in;
+    return (o - out);
 }
+
+// URL decode. unless final, stops at an incomplete escape sequence.
+static size_t _url_decode(const char *in, size_t len, char *out, bool final,
+                          size_t *consumed) {
+    const char *p = in, *end = in + len;
+    char *o = out;
+#ifdef ENCODE_SIMD
+    bool sse2 = (_simd_level() >= SIMD_SSE2);
+#endif
+    while (p < end) {
+#ifdef ENCODE_SIMD
+        if (sse2 == true && end - p >= 16) {
+            // move plain characters up to the next '%' or '+'.
+            size_t n = _url_plainlen_sse2(p, end - p, o);
+            p += n;
+            o += n;
+            if (p == end)
+                break;
+        }
+#endif
+        if (*p == '+') {
+            *o++ = ' ';
+            p++;
+        } else if (*p == '%') {
+            if (end - p > 2) {
+                *o++ = _q_x2c(*(p + 1), *(p + 2));
+                p += 3;
+            } else if (final == true) {
+                *o++ = *p++;
+            } else {
+                break;
+            }
+        } else {
+            *o++ = *p++;
+        }
+    }
+
+    if (consumed != NULL)
+        *consumed = p - in;
+    return (o - out);
+}
+
+// Base64 encode, padding the last group.
+static size_t _b64_encode(const unsigned char *in, size_t size, char *out) {
+    char *o = out;
+#ifdef ENCODE_SIMD
+    int level = _simd_level();
+    size_t n = 0;
+    if (level >= SIMD_AVX2) {
+        n = _b64_encode_avx2(in, size, o);
+    } else if (level >= SIMD_SSSE3) {
+        n = _b64_encode_ssse3(in, size, o);
+    }
+    in += n;
+    size -= n;
+    o += (n / 3) * 4;
+#endif
+    for (; size >= 3; size -= 3, in += 3) {
+        *o++ = B64CHARTBL[in[0] >> 2];
+        *o++ = B64CHARTBL[((in[0] & 0x03) << 4) | (in[1] >> 4)];
+        *o++ = B64CHARTBL[((in[1] & 0x0F) << 2) | (in[2] >> 6)];
+        *o++ = B64CHARTBL[in[2] & 0x3F];
+    }
+    if (size > 0) {
+        unsigned char in1 = (size > 1) ? in[1] : 0;
+        *o++ = B64CHARTBL[in[0] >> 2];
+        *o++ = B64CHARTBL[((in[0] & 0x03) << 4) | (in1 >> 4)];
+        *o++ = (size > 1) ? B64CHARTBL[(in1 & 0x0F) << 2] : '=';
+        *o++ = '=';
+    }
+
+    return (o - out);
+}
+
+// Base64 decode. state keeps the position in a 4-character group and the
+// last sextet, 0 at the beginning.
+static size_t _b64_decode(int *state, const unsigned char *in, size_t len,
+                          unsigned char *out) {
+    const unsigned char *end = in + len;
+    unsigned char *o = out;
+    int nIdxOfFour = (*state >> 8);
+    unsigned char cLastByte = (*state & 0xFF);
+#ifdef ENCODE_SIMD
+    int level = _simd_level();
+    const unsigned char *scalaruntil = in;
+#endif
+    while (in < end) {
+#ifdef ENCODE_SIMD
+        // vectors need 4-character groups of the alphabet only.
+        if (nIdxOfFour == 0 && in >= scalaruntil && end - in >= 32
+            && level >= SIMD_SSSE3) {
+            size_t n = (level >= SIMD_AVX2) ?
+                    _b64_decode_avx2(in, end - in, o) :
+                    _b64_decode_ssse3(in, end - in, o);
+            in += n;
+            o += (n / 4) * 3;
+            if (n == 0)
+                scalaruntil = in + 32;  // don't retry on every character
+            continue;
+        }
+#endif
+        unsigned char cByte = B64MAPTBL[*in++];
+        if (cByte == 64)
+            continue;
+
+        if (nIdxOfFour == 0) {
+            nIdxOfFour++;
+        } else if (nIdxOfFour == 1) {
+            // 00876543 0021????
+            *o++ = ((cLastByte << 2) | (cByte >> 4));
+            nIdxOfFour++;
+        } else if (nIdxOfFour == 2) {
+            // 00??8765 004321??
+            *o++ = ((cLastByte << 4) | (cByte >> 2));
+            nIdxOfFour++;
+        } else {
+            // 00????87 00654321
+            *o++ = ((cLastByte << 6) | cByte);
+            nIdxOfFour = 0;
+        }
+
+        cLastByte = cByte;
+    }
+
+    *state = (nIdxOfFour << 8) | cLastByte;
+    return (o - out);
+}
+
+static size_t _hex_encode(const unsigned char *in, size_t size, char *out) {
+    char *o = out;
+    size_t i = 0;
+#ifdef ENCODE_SIMD
+    if (_simd_level() >= SIMD_SSSE3) {
+        i = _hex_encode_ssse3(in, size, o);
+        o += i * 2;
+    }
+#endif
+    for (; i < size; i++) {
+        *o++ = HEXCHARTBL[(in[i] >> 4)];
+        *o++ = HEXCHARTBL[(in[i] & 0x0F)];
+    }
+
+    return (o - out);
+}
+
+// hexadecimal decode. state keeps the high nibble of an odd digit with
+// 0x100 set, 0 if there's none.
+static size_t _hex_decode(int *state, const unsigned char *in, size_t len,
+                          unsigned char *out) {
+    const unsigned char *end = in + len;
+    unsigned char *o = out;
+    if (*state != 0 && in < end) {
+        *o++ = (*state & 0xFF) + HEXMAPTBL[*in++];
+        *state = 0;
+    }
+#ifdef ENCODE_SIMD
+    bool ssse3 = (_simd_level() >= SIMD_SSSE3);
+    const unsigned char *scalaruntil = in;
+#endif
+    while (end - in >= 2) {
+#ifdef ENCODE_SIMD
+        // vectors need hexadecimal digits only.
+        if (ssse3 == true && in >= scalaruntil && end - in >= 32) {
+            size_t n = _hex_decode_ssse3(in, end - in, o);
+            in += n;
+            o += n / 2;
+            if (n == 0)
+                scalaruntil = in + 32;  // don't retry on every digit
+            continue;
+        }
+#endif
+        *o++ = (HEXMAPTBL[*in] << 4) + HEXMAPTBL[*(in + 1)];
+        in += 2;
+    }
+    if (in < end) {
+        *state = 0x100 | (HEXMAPTBL[*in] << 4);
+    }
+
+    return (o - out);
+}
+
+/*
+ * Limit the SIMD kernels to the given level, 0 for the scalar code only.
+ * A negative level leaves it as it is. Returns the level in use. This is
+ * for testing the kernels against the scalar code.
+ */
+int _q_encode_simd(int max) {
+#ifdef ENCODE_SIMD
+    if (max >= 0)
+        __atomic_store_n(&simdmax, max, __ATOMIC_RELAXED);
+    return _simd_level();
+#else
+    return 0;
+#endif
+}
+
+#ifdef ENCODE_SIMD
+
+static int _simd_level(void) {
+    static int level = -1;
+    int l = __atomic_load_n(&level, __ATOMIC_RELAXED);
+    if (l < 0) {
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
+            l = SIMD_AVX2;
+        else if (__builtin_cpu_supports("ssse3"))
+            l = SIMD_SSSE3;
+        else if (__builtin_cpu_supports("sse2"))
+            l = SIMD_SSE2;
+        else
+            l = SIMD_NONE;
+        __atomic_store_n(&level, l, __ATOMIC_RELAXED);
+    }
+    int max = __atomic_load_n(&simdmax, __ATOMIC_RELAXED);
+    return (l < max) ? l : max;
+}
+
+// mask of bytes in between lo and hi, unsigned.
+#define SSE2_INRANGE(v, lo, hi)                                         \
+    _mm_cmpeq_epi8(_mm_min_epu8(_mm_sub_epi8(v, _mm_set1_epi8(lo)),     \
+                                _mm_set1_epi8((hi) - (lo))),            \
+                   _mm_sub_epi8(v, _mm_set1_epi8(lo)))
+
+// copy bytes which don't need to be encoded. returns the bytes copied.
+__attribute__((target("sse2")))
+static size_t _url_safelen_sse2(const unsigned char *in, size_t size,
+                                size_t room, char *out) {
+    size_t done = 0;
+    while (size - done >= 16 && room - done >= 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *) (in + done));
+        __m128i safe = _mm_or_si128(
+                _mm_or_si128(SSE2_INRANGE(v, '-', ':'),
+                             SSE2_INRANGE(v, '@', 'Z')),
+                _mm_or_si128(SSE2_INRANGE(v, 'a', 'z'),
+                             _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\\')),
+                                          _mm_cmpeq_epi8(v, _mm_set1_epi8('_')))));
+        _mm_storeu_si128((__m128i *) (out + done), v);
+        int mask = _mm_movemask_epi8(safe);
+        if (mask != 0xFFFF) {
+            done += __builtin_ctz(~mask);
+            break;
+        }
+        done += 16;
+    }
+    return done;
+}
+
+// move bytes up to the next '%' or '+'. out can overlap in from below.
+__attribute__((target("sse2")))
+static size_t _url_plainlen_sse2(const char *in, size_t len, char *out) {
+    size_t done = 0;
+    while (len - done >= 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *) (in + done));
+        int mask = _mm_movemask_epi8(
+                _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('%')),
+                             _mm_cmpeq_epi8(v, _mm_set1_epi8('+'))));
+        if (mask != 0) {
+            int n = __builtin_ctz(mask);
+            memmove(out + done, in + done, n);
+            done += n;
+            break;
+        }
+        _mm_storeu_si128((__m128i *) (out + done), v);
+        done += 16;
+    }
+    return done;
+}
+
+/*
+ * Base64 kernels follow Wojciech Mula's pshufb based algorithms. Encoding
+ * spreads 3 bytes into 4 sextets with multiplies and translates them with
+ * a small table of offsets. Decoding validates each character with two
+ * nibble tables, then packs the sextets back together with multiply-adds.
+ */
+__attribute__((target("ssse3")))
+static size_t _b64_encode_ssse3(const unsigned char *in, size_t size,
+                                char *out) {
+    const __m128i shuf = _mm_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4,
+                                       7, 6, 8, 7, 10, 9, 11, 10);
+    const __m128i shift = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52,
+                                        '0' - 52, '0' - 52, '0' - 52,
+                                        '0' - 52, '0' - 52, '0' - 52,
+                                        '0' - 52, '0' - 52, '+' - 62,
+                                        '/' - 63, 'A', 0, 0);
+    size_t done = 0;
+    while (size - done >= 16) {  // loads 16, uses 12
+        __m128i v = _mm_loadu_si128((const __m128i *) (in + done));
+        v = _mm_shuffle_epi8(v, shuf);
+        __m128i t0 = _mm_mulhi_epu16(
+                _mm_and_si128(v, _mm_set1_epi32(0x0fc0fc00)),
+                _mm_set1_epi32(0x04000040));
+        __m128i t1 = _mm_mullo_epi16(
+                _mm_and_si128(v, _mm_set1_epi32(0x003f03f0)),
+                _mm_set1_epi32(0x01000010));
+        __m128i idx = _mm_or_si128(t0, t1);
+
+        __m128i r = _mm_subs_epu8(idx, _mm_set1_epi8(51));
+        __m128i less = _mm_cmpgt_epi8(_mm_set1_epi8(26), idx);
+        r = _mm_or_si128(r, _mm_and_si128(less, _mm_set1_epi8(13)));
+        r = _mm_add_epi8(_mm_shuffle_epi8(shift, r), idx);
+
+        _mm_storeu_si128((__m128i *) out, r);
+        out += 16;
+        done += 12;
+    }
+    return done;
+}
+
+__attribute__((target("avx2")))
+static size_t _b64_encode_avx2(const unsigned char *in, size_t size,
+                               char *out) {
+    const __m256i shuf = _mm256_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4,
+                                          7, 6, 8, 7, 10, 9, 11, 10,
+                                          1, 0, 2, 1, 4, 3, 5, 4,
+                                          7, 6, 8, 7, 10, 9, 11, 10);
+    const __m256i shift = _mm256_setr_epi8('a' - 26, '0' - 52, '0' - 52,
+                                           '0' - 52, '0' - 52, '0' - 52,
+                                           '0' - 52, '0' - 52, '0' - 52,
+                                           '0' - 52, '0' - 52, '+' - 62,
+                                           '/' - 63, 'A', 0, 0,
+                                           'a' - 26, '0' - 52, '0' - 52,
+                                           '0' - 52, '0' - 52, '0' - 52,
+                                           '0' - 52, '0' - 52, '0' - 52,
+                                           '0' - 52, '0' - 52, '+' - 62,
+                                           '/' - 63, 'A', 0, 0);
+    size_t done = 0;
+    while (size - done >= 28) {  // loads 28, uses 24
+        __m128i lo = _mm_loadu_si128((const __m128i *) (in + done));
+        __m128i hi = _mm_loadu_si128((const __m128i *) (in + done + 12));
+        __m256i v = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+        v = _mm256_shuffle_epi8(v, shuf);
+        __m256i t0 = _mm256_mulhi_epu16(
+                _mm256_and_si256(v, _mm256_set1_epi32(0x0fc0fc00)),
+                _mm256_set1_epi32(0x04000040));
+        __m256i t1 = _mm256_mullo_epi16(
+                _mm256_and_si256(v, _mm256_set1_epi32(0x003f03f0)),
+                _mm256_set1_epi32(0x01000010));
+        __m256i idx = _mm256_or_si256(t0, t1);
+
+        __m256i r = _mm256_subs_epu8(idx, _mm256_set1_epi8(51));
+        __m256i less = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), idx);
+        r = _mm256_or_si256(r, _mm256_and_si256(less, _mm256_set1_epi8(13)));
+        r = _mm256_add_epi8(_mm256_shuffle_epi8(shift, r), idx);
+
+        _mm256_storeu_si256((__m256i *) out, r);
+        out += 32;
+        done += 24;
+    }
+    return done;
+}
+
+// decode 16 characters at a time until one out of the alphabet is met.
+__attribute__((target("ssse3")))
+static size_t _b64_decode_ssse3(const unsigned char *in, size_t len,
+                                unsigned char *out) {
+    const __m128i lut_lo = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                         0x11, 0x11, 0x11, 0x11, 0x13, 0x1A,
+                                         0x1B, 0x1B, 0x1B, 0x1A);
+    const __m128i lut_hi = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08,
+                                         0x04, 0x08, 0x10, 0x10, 0x10, 0x10,
+                                         0x10, 0x10, 0x10, 0x10);
+    const __m128i lut_roll = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71,
+                                           0, 0, 0, 0, 0, 0, 0, 0);
+    const __m128i pack = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8,
+                                       14, 13, 12, -1, -1, -1, -1);
+    const __m128i nibble = _mm_set1_epi8(0x0F);
+    size_t done = 0;
+    while (len - done >= 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *) (in + done));
+        __m128i hin = _mm_and_si128(_mm_srli_epi32(v, 4), nibble);
+        __m128i lo = _mm_shuffle_epi8(lut_lo, _mm_and_si128(v, nibble));
+        __m128i hi = _mm_shuffle_epi8(lut_hi, hin);
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(lo, hi),
+                                             _mm_setzero_si128())) != 0xFFFF)
+            break;
+
+        __m128i eq2f = _mm_cmpeq_epi8(v, _mm_set1_epi8('/'));
+        __m128i roll = _mm_shuffle_epi8(lut_roll, _mm_add_epi8(eq2f, hin));
+        v = _mm_add_epi8(v, roll);
+
+        v = _mm_maddubs_epi16(v, _mm_set1_epi32(0x01400140));
+        v = _mm_madd_epi16(v, _mm_set1_epi32(0x00011000));
+        v = _mm_shuffle_epi8(v, pack);
+
+        unsigned char tmp[16];
+        _mm_storeu_si128((__m128i *) tmp, v);
+        memcpy(out, tmp, 12);
+        out += 12;
+        done += 16;
+    }
+    return done;
+}
+
+__attribute__((target("avx2")))
+static size_t _b64_decode_avx2(const unsigned char *in, size_t len,
+                               unsigned char *out) {
+    const __m256i lut_lo = _mm256_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11,
+                                            0x11, 0x11, 0x11, 0x11, 0x11,
+                                            0x13, 0x1A, 0x1B, 0x1B, 0x1B,
+                                            0x1A,
+                                            0x15, 0x11, 0x11, 0x11, 0x11,
+                                            0x11, 0x11, 0x11, 0x11, 0x11,
+                                            0x13, 0x1A, 0x1B, 0x1B, 0x1B,
+                                            0x1A);
+    const __m256i lut_hi = _mm256_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04,
+                                            0x08, 0x04, 0x08, 0x10, 0x10,
+                                            0x10, 0x10, 0x10, 0x10, 0x10,
+                                            0x10,
+                                            0x10, 0x10, 0x01, 0x02, 0x04,
+                                            0x08, 0x04, 0x08, 0x10, 0x10,
+                                            0x10, 0x10, 0x10, 0x10, 0x10,
+                                            0x10);
+    const __m256i lut_roll = _mm256_setr_epi8(0, 16, 19, 4, -65, -65, -71,
+                                              -71, 0, 0, 0, 0, 0, 0, 0, 0,
+                                              0, 16, 19, 4, -65, -65, -71,
+                                              -71, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m256i pack = _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8,
+                                          14, 13, 12, -1, -1, -1, -1,
+                                          2, 1, 0, 6, 5, 4, 10, 9, 8,
+                                          14, 13, 12, -1, -1, -1, -1);
+    const __m256i nibble = _mm256_set1_epi8(0x0F);
+    size_t done = 0;
+    while (len - done >= 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *) (in + done));
+        __m256i hin = _mm256_and_si256(_mm256_srli_epi32(v, 4), nibble);
+        __m256i lo = _mm256_shuffle_epi8(lut_lo, _mm256_and_si256(v, nibble));
+        __m256i hi = _mm256_shuffle_epi8(lut_hi, hin);
+        if (_mm256_movemask_epi8(_mm256_cmpeq_epi8(
+                _mm256_and_si256(lo, hi), _mm256_setzero_si256())) != -1)
+            break;
+
+        __m256i eq2f = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('/'));
+        __m256i roll = _mm256_shuffle_epi8(lut_roll,
+                                           _mm256_add_epi8(eq2f, hin));
+        v = _mm256_add_epi8(v, roll);
+
+        v = _mm256_maddubs_epi16(v, _mm256_set1_epi32(0x01400140));
+        v = _mm256_madd_epi16(v, _mm256_set1_epi32(0x00011000));
+        v = _mm256_shuffle_epi8(v, pack);
+        v = _mm256_permutevar8x32_epi32(v, _mm256_setr_epi32(0, 1, 2, 4, 5,
+                                                             6, 6, 6));
+
+        unsigned char tmp[32];
+        _mm256_storeu_si256((__m256i *) tmp, v);
+        memcpy(out, tmp, 24);
+        out += 24;
+        done += 32;
+    }
+    return done;
+}
+
+__attribute__((target("ssse3")))
+static size_t _hex_encode_ssse3(const unsigned char *in, size_t size,
+                                char *out) {
+    const __m128i lut = _mm_setr_epi8('0', '1', '2', '3', '4', '5', '6', '7',
+                                      '8', '9', 'a', 'b', 'c', 'd', 'e', 'f');
+    const __m128i nibble = _mm_set1_epi8(0x0F);
+    size_t done = 0;
+    while (size - done >= 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *) (in + done));
+        __m128i hi = _mm_shuffle_epi8(lut, _mm_and_si128(_mm_srli_epi16(v, 4),
+                                                         nibble));
+        __m128i lo = _mm_shuffle_epi8(lut, _mm_and_si128(v, nibble));
+        _mm_storeu_si128((__m128i *) out, _mm_unpacklo_epi8(hi, lo));
+        _mm_storeu_si128((__m128i *) (out + 16), _mm_unpackhi_epi8(hi, lo));
+        out += 32;
+        done += 16;
+    }
+    return done;
+}
+
+// value of hexadecimal digits and the mask of valid ones.
+#define SSE2_HEXVAL(c, val, ok) do {                                    \
+        __m128i _d = _mm_sub_epi8(c, _mm_set1_epi8('0'));               \
+        __m128i _isd = _mm_cmpeq_epi8(_mm_min_epu8(_d, _mm_set1_epi8(9)), _d); \
+        __m128i _l = _mm_sub_epi8(_mm_or_si128(c, _mm_set1_epi8(0x20)), \
+                                  _mm_set1_epi8('a'));                  \
+        __m128i _isl = _mm_cmpeq_epi8(_mm_min_epu8(_l, _mm_set1_epi8(5)), _l); \
+        val = _mm_or_si128(_mm_and_si128(_d, _isd),                     \
+                           _mm_and_si128(_mm_add_epi8(_l, _mm_set1_epi8(10)), \
+                                         _isl));                        \
+        ok = _mm_or_si128(_isd, _isl);                                  \
+    } while (0)
+
+// decode 32 digits at a time until a non-hexadecimal character is met.
+__attribute__((target("ssse3")))
+static size_t _hex_decode_ssse3(const unsigned char *in, size_t len,
+                                unsigned char *out) {
+    size_t done = 0;
+    while (len - done >= 32) {
+        __m128i a = _mm_loadu_si128((const __m128i *) (in + done));
+        __m128i b = _mm_loadu_si128((const __m128i *) (in + done + 16));
+        __m128i va, vb, oka, okb;
+        SSE2_HEXVAL(a, va, oka);
+        SSE2_HEXVAL(b, vb, okb);
+        if (_mm_movemask_epi8(_mm_and_si128(oka, okb)) != 0xFFFF)
+            break;
+
+        // high nibble * 16 + low nibble
+        va = _mm_maddubs_epi16(va, _mm_set1_epi16(0x0110));
+        vb = _mm_maddubs_epi16(vb, _mm_set1_epi16(0x0110));
+        _mm_storeu_si128((__m128i *) out, _mm_packus_epi16(va, vb));
+        out += 16;
+        done += 32;
+    }
+    return done;
+}
+
+#endif /* ENCODE_SIMD */
+
+#endif /* _DOXYGEN_SKIP */
@@ -43,10 +43,19 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/file.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
 #include "qinternal.h"
 #include "utilities/qstring.h"
 #include "utilities/qfile.h"
 
+#ifndef _DOXYGEN_SKIP
+#ifndef _WIN32
+static size_t _mapsize(size_t nbytes);
+#endif
+#endif
+
 /**
  * Lock file
  *
@@ -171,7 +180,7 @@ void *qfile_load(const char *filepath, size_t *nbytes) {
     if (nbytes != NULL && *nbytes > 0 && *nbytes < fs.st_size)
         size = *nbytes;
 
-    void *buf = malloc(size + 1);
+    void *buf = qlibc_malloc(size + 1);
     if (buf == NULL) {
         close(fd);
         return NULL;
@@ -181,7 +190,7 @@ void *qfile_load(const char *filepath, size_t *nbytes) {
     close(fd);
 
     if (count != size) {
-        free(buf);
+        qlibc_free(buf);
         return NULL;
     }
 
@@ -192,6 +201,102 @@ void *qfile_load(const char *filepath, size_t *nbytes) {
     return buf;
 }
 
+/**
+ * Map file into memory for reading.
+ *
+ * Unlike qfile_load(), the file isn't copied into a buffer. The pages of the
+ * file in the page cache are mapped read-only and read in on demand, with a
+ * hint that they'll be accessed sequentially.
+ *
+ * @param filepath  file path
+ * @param nbytes    has two purpose, one is to set how many bytes to map,
+ *                  the other is to return the number of mapped bytes.
+ *                  nbytes must be point 0 or NULL to map entire file.
+ *
+ * @return a pointer of the read-only mapping if successful, otherwise
+ *         returns NULL.
+ *
+ * @code
+ *   size_t size = 0;
+ *   const char *text = (const char *)qfile_map("/tmp/text.txt", &size);
+ *   if (text != NULL) {
+ *     (...read text...)
+ *     qfile_unmap((void *)text, size);
+ *   }
+ * @endcode
+ *
+ * @note
+ *  Like qfile_load(), the data is always followed by a NULL character, so a
+ *  text file can be used as a string. The mapping must be released by
+ *  qfile_unmap() with the size returned at nbytes. Where mmap() isn't
+ *  available, the file is loaded by qfile_load().
+ */
+void *qfile_map(const char *filepath, size_t *nbytes) {
+#ifdef _WIN32
+    return qfile_load(filepath, nbytes);
+#else
+    int fd;
+    if ((fd = open(filepath, O_RDONLY, 0)) < 0)
+        return NULL;
+
+    struct stat fs;
+    if (fstat(fd, &fs) < 0) {
+        close(fd);
+        return NULL;
+    }
+
+    size_t size = fs.st_size;
+    if (nbytes != NULL && *nbytes > 0 && *nbytes < fs.st_size)
+        size = *nbytes;
+
+    // reserve zero-filled room for the data and the trailing NULL character,
+    // then map the file over it. the part of the last file page past the end
+    // of the file reads as zero too.
+    size_t mapsize = _mapsize(size);
+    char *map = mmap(NULL, mapsize, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1,
+                     0);
+    if (map == MAP_FAILED) {
+        close(fd);
+        return NULL;
+    }
+    if (size > 0) {
+        if (mmap(map, size, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0)
+                == MAP_FAILED) {
+            munmap(map, mapsize);
+            close(fd);
+            return NULL;
+        }
+        madvise(map, size, MADV_SEQUENTIAL);
+    }
+    close(fd);
+
+    if (nbytes != NULL)
+        *nbytes = size;
+    return map;
+#endif
+}
+
+/**
+ * Release a mapping made by qfile_map().
+ *
+ * @param map       a pointer returned by qfile_map().
+ * @param nbytes    the number of mapped bytes returned by qfile_map().
+ *
+ * @return true if successful, otherwise returns false.
+ */
+bool qfile_unmap(void *map, size_t nbytes) {
+    if (map == NULL) {
+        errno = EINVAL;
+        return false;
+    }
+#ifdef _WIN32
+    qlibc_free(map);
+    return true;
+#else
+    return (munmap(map, _mapsize(nbytes)) == 0);
+#endif
+}
+
 /**
  * Read data from a file stream.
  *
@@ -220,38 +325,41 @@ void *qfile_read(FILE *fp, size_t *nbytes) {
         size = *nbytes;
     }
 
-    int c;
-    size_t c_count;
-    char *data = NULL;
-    for (c_count = 0; (c = fgetc(fp)) != EOF;) {
-        if (size > 0 && c_count == size)
-            break;
-
-        if (c_count == 0) {
-            data = (char *) malloc(sizeof(char) * memsize);
-            if (data == NULL) {
-                DEBUG("Memory allocation failed.");
-                return NULL;
-            }
-        } else if (c_count == memsize - 1) {
-            memsize *= 2;
+    char *data = (char *) qlibc_malloc(memsize + 1);
+    if (data == NULL) {
+        DEBUG("Memory allocation failed.");
+        return NULL;
+    }
 
-            /* Here, we don't use realloc(). Sometimes it is unstable. */
-            char *datatmp = (char *) malloc(sizeof(char) * (memsize + 1));
+    // read in blocks, doubling the buffer as it fills up. the slack which
+    // the allocator rounded up is used before growing.
+    size_t c_count = 0;
+    while (size == 0 || c_count < size) {
+        if (c_count == memsize && size == 0) {
+            size_t usable = qlibc_usable_size(data);
+            if (usable > memsize + 1)
+                memsize = usable - 1;
+        }
+        if (c_count == memsize) {
+            char *datatmp = (char *) qlibc_realloc(data, (memsize * 2) + 1);
             if (datatmp == NULL) {
                 DEBUG("Memory allocation failed.");
-                free(data);
+                qlibc_free_sized(data, memsize + 1);
                 return NULL;
             }
-            memcpy(datatmp, data, c_count);
-            free(data);
             data = datatmp;
+            memsize *= 2;
         }
-        data[c_count++] = (char) c;
+        size_t nread = fread(data + c_count, 1, memsize - c_count, fp);
+        if (nread == 0)
+            break;
+        c_count += nread;
     }
 
-    if (c_count == 0 && c == EOF)
+    if (c_count == 0) {
+        qlibc_free_sized(data, memsize + 1);
         return NULL;
+    }
     data[c_count] = '\0';
 
     if (nbytes != NULL)
@@ -321,7 +429,7 @@ bool qfile_mkdir(const char *dirpath, mode_t mode, bool recursive) {
                 && mkdir(dirpath, mode) == 0) {
             ret = true;
         }
-        free(parentpath);
+        qlibc_free(parentpath);
     }
 
     return ret;
@@ -354,10 +462,10 @@ bool qfile_check_path(const char *path) {
  * @return malloced filename string
  */
 char *qfile_get_name(const char *filepath) {
-    char *path = strdup(filepath);
+    char *path = qlibc_strdup(filepath);
     char *bname = basename(path);
-    char *filename = strdup(bname);
-    free(path);
+    char *filename = qlibc_strdup(bname);
+    qlibc_free(path);
     return filename;
 }
 
@@ -369,10 +477,10 @@ char *qfile_get_name(const char *filepath) {
  * @return malloced filepath string
  */
 char *qfile_get_dir(const char *filepath) {
-    char *path = strdup(filepath);
+    char *path = qlibc_strdup(filepath);
     char *dname = dirname(path);
-    char *dir = strdup(dname);
-    free(path);
+    char *dir = qlibc_strdup(dname);
+    qlibc_free(path);
     return dir;
 }
 
@@ -390,13 +498,13 @@ char *qfile_get_ext(const char *filepath) {
     char *ext = NULL;
     if (p != NULL && strlen(p + 1) <= MAX_EXTENSION_LENGTH
             && qstrtest(isalnum, p + 1) == true) {
-        ext = strdup(p + 1);
+        ext = qlibc_strdup(p + 1);
         qstrlower(ext);
     } else {
-        ext = strdup("");
+        ext = qlibc_strdup("");
     }
 
-    free(filename);
+    qlibc_free(filename);
     return ext;
 }
 
@@ -461,7 +569,7 @@ char *qfile_correct_path(char *path) {
                 char *pszNewPrefix = qfile_get_dir(path);
                 strcpy(path, pszNewPrefix);
                 strcat(path, pszTmp + 3);
-                free(pszNewPrefix);
+                qlibc_free(pszNewPrefix);
             }
             continue;
         }
@@ -497,7 +605,7 @@ char *qfile_correct_path(char *path) {
                 path[nLen - 3] = '\0';
                 char *pszNewPath = qfile_get_dir(path);
                 strcpy(path, pszNewPath);
-                free(pszNewPath);
+                qlibc_free(pszNewPath);
                 continue;
             }
         }
@@ -543,3 +651,15 @@ char *qfile_abspath(char *buf, size_t bufsize, const char *path) {
 
     return buf;
 }
+
+#ifndef _DOXYGEN_SKIP
+#ifndef _WIN32
+
+// size of a qfile_map() mapping, including the trailing NULL character.
+static size_t _mapsize(size_t nbytes) {
+    size_t pagesize = (size_t) sysconf(_SC_PAGESIZE);
+    return ((nbytes / pagesize) + 1) * pagesize;
+}
+
+#endif
+#endif /* _DOXYGEN_SKIP */
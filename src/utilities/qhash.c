@@ -40,9 +40,48 @@
 #include <errno.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <pthread.h>
 #include "md5/md5.h"
 #include "qinternal.h"
 #include "utilities/qhash.h"
+#include "utilities/qthreadpool.h"
+
+#ifndef _DOXYGEN_SKIP
+
+#define MD5_MAP_WINDOW  (16 * 1024 * 1024)
+#define TREE_CHUNKSIZE  (4 * 1024 * 1024)
+
+struct _hashtree_s {
+    const unsigned char *data;  /*!< data to digest, or NULL for a file */
+    int fd;                     /*!< file to digest */
+    off_t offset;               /*!< file offset of the data */
+    size_t nbytes;              /*!< size of the data */
+    size_t chunksize;           /*!< size of a chunk */
+    size_t nchunks;             /*!< number of chunks */
+    unsigned char *digests;     /*!< 16-byte digest of each chunk */
+    size_t next;                /*!< next chunk to digest */
+    bool failed;                /*!< a chunk couldn't be read */
+};
+
+#define XXH64_P1    (0x9E3779B185EBCA87ULL)
+#define XXH64_P2    (0xC2B2AE3D27D4EB4FULL)
+#define XXH64_P3    (0x165667B19E3779F9ULL)
+#define XXH64_P4    (0x85EBCA77C2B2AE63ULL)
+#define XXH64_P5    (0x27D4EB2F165667C5ULL)
+#define ROTL64(x, r) (((x) << (r)) | ((x) >> (64 - (r))))
+
+static inline uint64_t _read64(const uint8_t *p);
+static inline uint32_t _read32(const uint8_t *p);
+static inline uint64_t _xxh64_round(uint64_t acc, uint64_t input);
+static inline uint64_t _xxh64_merge(uint64_t acc, uint64_t val);
+static bool _hashtree(struct _hashtree_s *ht, int nthreads, void *retbuf);
+static void _hashtree_threads(struct _hashtree_s *ht, int nthreads);
+static void *_hashtree_worker(void *arg);
+static void _hashtree_range(void *arg, size_t begin, size_t end);
+static bool _hashtree_chunk(struct _hashtree_s *ht, size_t idx);
+
+#endif
 
 /**
  * Calculate 128-bit(16-bytes) MD5 hash.
@@ -106,8 +145,10 @@ bool qhashmd5_file(const char *filepath, off_t offset, ssize_t nbytes,
         return false;
 
     struct stat st;
-    if (fstat(fd, &st) < 0)
+    if (fstat(fd, &st) < 0) {
+        close(fd);
         return false;
+    }
     size_t size = st.st_size;
 
     // check filesize
@@ -116,27 +157,46 @@ bool qhashmd5_file(const char *filepath, off_t offset, ssize_t nbytes,
         close(fd);
         return false;
     }
-
-    // seek
-    if (offset > 0) {
-        if (lseek(fd, offset, SEEK_SET) != offset) {
-            close(fd);
-            return false;
-        }
-    }
+    if (nbytes == 0)
+        nbytes = size - offset;
 
     MD5_CTX context;
     MD5Init(&context);
-    ssize_t toread, nread;
-    unsigned char buf[32 * 1024];
-    for (toread = nbytes; toread > 0; toread -= nread) {
-        if (toread > sizeof(buf))
-            nread = read(fd, buf, sizeof(buf));
-        else
-            nread = read(fd, buf, toread);
-        if (nread < 0)
+    ssize_t toread = nbytes;
+
+    // digest the page cache through mappings of the file, window by window.
+    off_t pagesize = (off_t) sysconf(_SC_PAGESIZE);
+    off_t mapoff = offset - (offset % pagesize);
+    size_t skip = offset - mapoff;
+    while (toread > 0) {
+        size_t maplen = skip + toread;
+        if (maplen > MD5_MAP_WINDOW)
+            maplen = MD5_MAP_WINDOW;
+        unsigned char *map = mmap(NULL, maplen, PROT_READ, MAP_PRIVATE, fd,
+                                  mapoff);
+        if (map == MAP_FAILED)
             break;
-        MD5Update(&context, buf, nread);
+        madvise(map, maplen, MADV_SEQUENTIAL);
+        MD5Update(&context, map + skip, maplen - skip);
+        munmap(map, maplen);
+        toread -= maplen - skip;
+        mapoff += maplen;
+        skip = 0;
+    }
+
+    // fall back to read(), for files which can't be mapped.
+    if (toread > 0 && lseek(fd, mapoff + skip, SEEK_SET) == mapoff + skip) {
+        ssize_t nread;
+        unsigned char buf[32 * 1024];
+        for (; toread > 0; toread -= nread) {
+            if (toread > sizeof(buf))
+                nread = read(fd, buf, sizeof(buf));
+            else
+                nread = read(fd, buf, toread);
+            if (nread <= 0)
+                break;
+            MD5Update(&context, buf, nread);
+        }
     }
     close(fd);
     if (toread != 0)
@@ -146,6 +206,110 @@ bool qhashmd5_file(const char *filepath, off_t offset, ssize_t nbytes,
     return true;
 }
 
+/**
+ * Get 128-bit tree hash of data.
+ *
+ * The data is cut into fixed size chunks and each chunk is digested by
+ * qhashmurmur3_128() in parallel. Then the concatenated chunk digests are
+ * digested again along with the data size and the chunk size. Unlike MD5,
+ * this scales with the number of cores.
+ *
+ * @param data      source data
+ * @param nbytes    size of data
+ * @param chunksize size of a chunk. 0 for default size, 4MB.
+ * @param nthreads  number of threads to use. 0 to share the workers of
+ *                  qthreadpool_shared().
+ * @param retbuf    user buffer. It must be at leat 16-bytes long.
+ *
+ * @return true if successful, otherwise false.
+ *
+ * @code
+ *   unsigned char hash[16];
+ *   qhashtree(data, datasize, 0, 0, hash);
+ * @endcode
+ *
+ * @note
+ *  The digest depends on the chunk size. The same chunk size must be used
+ *  to compare digests. qhashtree_file() gives the same digest for the same
+ *  contents.
+ */
+bool qhashtree(const void *data, size_t nbytes, size_t chunksize, int nthreads,
+               void *retbuf) {
+    if (data == NULL || retbuf == NULL) {
+        errno = EINVAL;
+        return false;
+    }
+
+    struct _hashtree_s ht;
+    memset((void *) &ht, 0, sizeof(ht));
+    ht.data = (const unsigned char *) data;
+    ht.fd = -1;
+    ht.nbytes = nbytes;
+    ht.chunksize = chunksize;
+    return _hashtree(&ht, nthreads, retbuf);
+}
+
+/**
+ * Get 128-bit tree hash of a file contents.
+ *
+ * Chunks of the file are mapped and digested by parallel threads. See
+ * qhashtree() for the algorithm.
+ *
+ * @param filepath  file path
+ * @param offset    start offset. Set to 0 to digest from beginning of file.
+ * @param nbytes    number of bytes to digest. Set to 0 to digest until end
+ *                  of file.
+ * @param chunksize size of a chunk. 0 for default size, 4MB.
+ * @param nthreads  number of threads to use. 0 to share the workers of
+ *                  qthreadpool_shared().
+ * @param retbuf    user buffer. It must be at leat 16-bytes long.
+ *
+ * @return true if successful, otherwise false.
+ *
+ * @code
+ *   unsigned char hash[16];
+ *   qhashtree_file("/tmp/test.dat", 0, 0, 0, 0, hash);
+ * @endcode
+ */
+bool qhashtree_file(const char *filepath, off_t offset, ssize_t nbytes,
+                    size_t chunksize, int nthreads, void *retbuf) {
+    if (filepath == NULL || offset < 0 || nbytes < 0 || retbuf == NULL) {
+        errno = EINVAL;
+        return false;
+    }
+
+    int fd = open(filepath, O_RDONLY, 0);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        return false;
+    }
+    size_t size = st.st_size;
+
+    // check filesize
+    if (size < offset + nbytes) {
+        errno = EINVAL;
+        close(fd);
+        return false;
+    }
+    if (nbytes == 0)
+        nbytes = size - offset;
+
+    struct _hashtree_s ht;
+    memset((void *) &ht, 0, sizeof(ht));
+    ht.fd = fd;
+    ht.offset = offset;
+    ht.nbytes = nbytes;
+    ht.chunksize = chunksize;
+    bool ret = _hashtree(&ht, nthreads, retbuf);
+    close(fd);
+
+    return ret;
+}
+
 /**
  * Get 32-bit FNV1 hash.
  *
@@ -438,3 +602,258 @@ bool qhashmurmur3_128(const void *data, size_t nbytes, void *retbuf) {
 
     return true;
 }
+
+/**
+ * Get 64-bit xxHash(XXH64) hash.
+ *
+ * @param data      source data
+ * @param nbytes    size of data
+ *
+ * @return 64-bit unsigned hash value.
+ *
+ * @code
+ *  uint64_t hashval = qhashxx64((void*)"hello", 5);
+ * @endcode
+ *
+ * @code
+ *  xxHash was created by Yann Collet and published under BSD license.
+ *    https://github.com/Cyan4973/xxHash
+ *  The input is consumed in 32-byte stripes by 4 independent lanes, so
+ *  long keys are hashed several times faster than byte-at-a-time hashes.
+ *  This implementation uses seed 0 and produces the reference XXH64 values
+ *  on little-endian hosts.
+ * @endcode
+ */
+uint64_t qhashxx64(const void *data, size_t nbytes) {
+    if (data == NULL)
+        return 0;
+
+    const uint8_t *p = (const uint8_t *) data;
+    const uint8_t *end = p + nbytes;
+    uint64_t h;
+
+    if (nbytes >= 32) {
+        const uint8_t *limit = end - 32;
+        uint64_t v1 = XXH64_P1 + XXH64_P2;
+        uint64_t v2 = XXH64_P2;
+        uint64_t v3 = 0;
+        uint64_t v4 = -XXH64_P1;
+
+        do {
+            v1 = _xxh64_round(v1, _read64(p));
+            v2 = _xxh64_round(v2, _read64(p + 8));
+            v3 = _xxh64_round(v3, _read64(p + 16));
+            v4 = _xxh64_round(v4, _read64(p + 24));
+            p += 32;
+        } while (p <= limit);
+
+        h = ROTL64(v1, 1) + ROTL64(v2, 7) + ROTL64(v3, 12) + ROTL64(v4, 18);
+        h = _xxh64_merge(h, v1);
+        h = _xxh64_merge(h, v2);
+        h = _xxh64_merge(h, v3);
+        h = _xxh64_merge(h, v4);
+    } else {
+        h = XXH64_P5;
+    }
+
+    h += (uint64_t) nbytes;
+
+    for (; p + 8 <= end; p += 8) {
+        h ^= _xxh64_round(0, _read64(p));
+        h = ROTL64(h, 27) * XXH64_P1 + XXH64_P4;
+    }
+    if (p + 4 <= end) {
+        h ^= (uint64_t) _read32(p) * XXH64_P1;
+        h = ROTL64(h, 23) * XXH64_P2 + XXH64_P3;
+        p += 4;
+    }
+    for (; p < end; p++) {
+        h ^= (*p) * XXH64_P5;
+        h = ROTL64(h, 11) * XXH64_P1;
+    }
+
+    h ^= h >> 33;
+    h *= XXH64_P2;
+    h ^= h >> 29;
+    h *= XXH64_P3;
+    h ^= h >> 32;
+
+    return h;
+}
+
+/**
+ * Get 32-bit hash folded from qhashxx64().
+ *
+ * @param data      source data
+ * @param nbytes    size of data
+ *
+ * @return 32-bit unsigned hash value.
+ *
+ * @note
+ *  This is meant for hash-table indexing where 32 bits are enough. It's
+ *  much faster than qhashmurmur3_32() for keys longer than 32 bytes and
+ *  comparable for short keys.
+ */
+uint32_t qhashxx32(const void *data, size_t nbytes) {
+    uint64_t h = qhashxx64(data, nbytes);
+    return (uint32_t) (h ^ (h >> 32));
+}
+
+#ifndef _DOXYGEN_SKIP
+
+static inline uint64_t _read64(const uint8_t *p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint32_t _read32(const uint8_t *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint64_t _xxh64_round(uint64_t acc, uint64_t input) {
+    acc += input * XXH64_P2;
+    acc = ROTL64(acc, 31);
+    acc *= XXH64_P1;
+    return acc;
+}
+
+static inline uint64_t _xxh64_merge(uint64_t acc, uint64_t val) {
+    acc ^= _xxh64_round(0, val);
+    acc = acc * XXH64_P1 + XXH64_P4;
+    return acc;
+}
+
+// digest all chunks with worker threads and then the chunk digests.
+static bool _hashtree(struct _hashtree_s *ht, int nthreads, void *retbuf) {
+    if (ht->chunksize == 0)
+        ht->chunksize = TREE_CHUNKSIZE;
+    ht->nchunks = (ht->nbytes + ht->chunksize - 1) / ht->chunksize;
+
+    // chunk digests, followed by the data size and the chunk size.
+    size_t tailsize = sizeof(uint64_t) * 2;
+    ht->digests = (unsigned char *) qlibc_malloc((ht->nchunks * 16) + tailsize);
+    if (ht->digests == NULL) {
+        errno = ENOMEM;
+        return false;
+    }
+
+    qthreadpool_t *pool = (nthreads <= 0) ? qthreadpool_shared() : NULL;
+    if (pool != NULL) {
+        pool->parallel_for(pool, 0, ht->nchunks, 1, _hashtree_range, ht);
+    } else {
+        _hashtree_threads(ht, nthreads);
+    }
+
+    if (ht->failed == true) {
+        qlibc_free(ht->digests);
+        return false;
+    }
+
+    // sizes in little-endian, so the digest is the same on any host.
+    unsigned char *tail = ht->digests + (ht->nchunks * 16);
+    int i;
+    for (i = 0; i < 8; i++) {
+        tail[i] = (unsigned char) (((uint64_t) ht->nbytes) >> (i * 8));
+        tail[8 + i] = (unsigned char) (((uint64_t) ht->chunksize) >> (i * 8));
+    }
+    qhashmurmur3_128(ht->digests, (ht->nchunks * 16) + tailsize, retbuf);
+    qlibc_free(ht->digests);
+
+    return true;
+}
+
+// digest chunks with dedicated threads.
+static void _hashtree_threads(struct _hashtree_s *ht, int nthreads) {
+    if (nthreads <= 0)
+        nthreads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    if (nthreads > ht->nchunks)
+        nthreads = ht->nchunks;
+
+    // the caller thread works too.
+    pthread_t *threads = NULL;
+    int nstarted = 0;
+    if (nthreads > 1) {
+        threads = (pthread_t *) qlibc_malloc(sizeof(pthread_t) * (nthreads - 1));
+        for (; threads != NULL && nstarted < nthreads - 1; nstarted++) {
+            if (pthread_create(&threads[nstarted], NULL, _hashtree_worker, ht)
+                    != 0) {
+                break;
+            }
+        }
+    }
+    _hashtree_worker(ht);
+    int i;
+    for (i = 0; i < nstarted; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    qlibc_free(threads);
+}
+
+static void *_hashtree_worker(void *arg) {
+    struct _hashtree_s *ht = (struct _hashtree_s *) arg;
+    while (__atomic_load_n(&ht->failed, __ATOMIC_RELAXED) == false) {
+        size_t idx = __atomic_fetch_add(&ht->next, 1, __ATOMIC_RELAXED);
+        if (idx >= ht->nchunks)
+            break;
+        if (_hashtree_chunk(ht, idx) == false)
+            __atomic_store_n(&ht->failed, true, __ATOMIC_RELAXED);
+    }
+    return NULL;
+}
+
+static void _hashtree_range(void *arg, size_t begin, size_t end) {
+    struct _hashtree_s *ht = (struct _hashtree_s *) arg;
+    size_t idx;
+    for (idx = begin; idx < end; idx++) {
+        if (__atomic_load_n(&ht->failed, __ATOMIC_RELAXED) == true)
+            break;
+        if (_hashtree_chunk(ht, idx) == false)
+            __atomic_store_n(&ht->failed, true, __ATOMIC_RELAXED);
+    }
+}
+
+static bool _hashtree_chunk(struct _hashtree_s *ht, size_t idx) {
+    size_t off = idx * ht->chunksize;
+    size_t len = ht->nbytes - off;
+    if (len > ht->chunksize)
+        len = ht->chunksize;
+    unsigned char *digest = ht->digests + (idx * 16);
+
+    if (ht->data != NULL) {
+        return qhashmurmur3_128(ht->data + off, len, digest);
+    }
+
+    // map the chunk from the page aligned offset.
+    off_t pagesize = (off_t) sysconf(_SC_PAGESIZE);
+    off_t fileoff = ht->offset + off;
+    off_t mapoff = fileoff - (fileoff % pagesize);
+    size_t skip = fileoff - mapoff;
+    unsigned char *map = mmap(NULL, skip + len, PROT_READ, MAP_PRIVATE,
+                              ht->fd, mapoff);
+    if (map != MAP_FAILED) {
+        madvise(map, skip + len, MADV_SEQUENTIAL);
+        bool ret = qhashmurmur3_128(map + skip, len, digest);
+        munmap(map, skip + len);
+        return ret;
+    }
+
+    // fall back to pread(), for files which can't be mapped.
+    unsigned char *buf = (unsigned char *) qlibc_malloc(len + 1);
+    if (buf == NULL)
+        return false;
+    size_t done = 0;
+    while (done < len) {
+        ssize_t nread = pread(ht->fd, buf + done, len - done, fileoff + done);
+        if (nread <= 0)
+            break;
+        done += nread;
+    }
+    bool ret = (done == len) && qhashmurmur3_128(buf, len, digest);
+    qlibc_free(buf);
+    return ret;
+}
+
+#endif /* _DOXYGEN_SKIP */
@@ -38,10 +38,41 @@
 #include <unistd.h>
 #include <poll.h>
 #include <errno.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/sendfile.h>
+#endif
 #include "qinternal.h"
 #include "utilities/qio.h"
 
 #define MAX_IOSEND_SIZE     (32 * 1024)
+#define MAX_KERNELSEND_SIZE (1024 * 1024)
+#define DEFAULT_READER_SIZE (8 * 1024)
+#ifndef IOV_MAX
+#define IOV_MAX             (16)
+#endif
+
+#ifndef _DOXYGEN_SKIP
+struct qio_reader_s {
+    int fd;             // descriptor, -1 for custom read function
+    ssize_t (*readfn)(void *arg, void *buf, size_t nbytes, int timeoutms);
+    void *arg;          // argument of readfn
+    unsigned char *buf; // read buffer
+    size_t bufsize;     // size of read buffer
+    size_t start;       // offset of first unconsumed byte
+    size_t end;         // offset next to last buffered byte
+};
+
+#ifdef __linux__
+static off_t _send_kernel(int outfd, int infd, off_t nbytes, int timeoutms,
+                          bool *fallback);
+#endif
+static ssize_t _reader_fill(qio_reader_t *reader, void *buf, size_t nbytes,
+                            int timeoutms);
+#endif
 
 /**
  * Test & wait until the file descriptor has readable data.
@@ -126,11 +157,13 @@ ssize_t qio_read(int fd, void *buf, size_t nbytes, int timeoutms) {
 
         ssize_t rsize = read(fd, buf + total, nbytes - total);
         if (rsize <= 0) {
-            if (errno == EAGAIN || errno == EINPROGRESS) {
+            if (rsize < 0 && (errno == EAGAIN || errno == EINPROGRESS)) {
                 // possible with non-block io
                 usleep(1);
                 continue;
             }
+            if (rsize == 0)
+                errno = 0;  // end of stream isn't a timeout
             break;
         }
         total += rsize;
@@ -183,6 +216,81 @@ ssize_t qio_write(int fd, const void *buf, size_t nbytes, int timeoutms) {
     return -1;
 }
 
+/**
+ * Write multiple buffers to a file descriptor with a single gather write.
+ *
+ * @param fd        file descriptor
+ * @param iov       array of buffers to write
+ * @param iovcnt    the number of buffers in iov
+ * @param timeoutms wait timeout milliseconds. 0 for no wait, -1 for infinite
+ *                  wait
+ *
+ * @return the number of bytes written if successful, 0 on timeout,
+ *         -1 for error.
+ *
+ * @code
+ *  struct iovec iov[2];
+ *  iov[0].iov_base = header;
+ *  iov[0].iov_len = headerlen;
+ *  iov[1].iov_base = body;
+ *  iov[1].iov_len = bodylen;
+ *  qio_writev(sockfd, iov, 2, 1000);
+ * @endcode
+ *
+ * @note
+ *  Partial writes are continued from where they stopped until all the
+ *  buffers are written. The given iov array is not modified.
+ */
+ssize_t qio_writev(int fd, const struct iovec *iov, int iovcnt,
+                   int timeoutms) {
+    int i = 0;          // current buffer
+    size_t offset = 0;  // bytes of the current buffer already written
+    while (i < iovcnt && iov[i].iov_len == 0)
+        i++;
+    if (i == iovcnt)
+        return 0;
+
+    ssize_t total = 0;
+    while (i < iovcnt) {
+        if (timeoutms >= 0 && qio_wait_writable(fd, timeoutms) <= 0)
+            break;
+
+        ssize_t wsize;
+        if (offset > 0) {
+            // finish the partially written buffer first.
+            wsize = write(fd, (char *) iov[i].iov_base + offset,
+                          iov[i].iov_len - offset);
+        } else {
+            int cnt = iovcnt - i;
+            if (cnt > IOV_MAX)
+                cnt = IOV_MAX;
+            wsize = writev(fd, iov + i, cnt);
+        }
+        if (wsize <= 0) {
+            if (errno == EAGAIN || errno == EINPROGRESS) {
+                // possible with non-block io
+                usleep(1);
+                continue;
+            }
+            break;
+        }
+        total += wsize;
+
+        // skip written buffers
+        offset += wsize;
+        while (i < iovcnt && offset >= iov[i].iov_len) {
+            offset -= iov[i].iov_len;
+            i++;
+        }
+    }
+
+    if (total > 0)
+        return total;
+    else if (errno == ETIMEDOUT)
+        return 0;
+    return -1;
+}
+
 /**
  * Transfer data between file descriptors
  *
@@ -195,14 +303,31 @@ ssize_t qio_write(int fd, const void *buf, size_t nbytes, int timeoutms) {
  *
  * @return the number of bytes transferred if successful, 0 on timeout,
  *         -1 for error.
+ *
+ * @note
+ *  On Linux, data is moved inside the kernel without being copied to user
+ *  space, by sendfile(2) when infd is a regular file or by splice(2)
+ *  through a pipe otherwise. When the kernel can't do it for the given
+ *  descriptors, it falls back to read() and write() through a buffer.
  */
 off_t qio_send(int outfd, int infd, off_t nbytes, int timeoutms) {
     if (nbytes == 0)
         return 0;
 
-    unsigned char buf[MAX_IOSEND_SIZE];
-
     off_t total = 0;  // total size sent
+#ifdef __linux__
+    bool fallback = false;
+    total = _send_kernel(outfd, infd, nbytes, timeoutms, &fallback);
+    if (fallback == false) {
+        if (total > 0)
+            return total;
+        else if (errno == ETIMEDOUT)
+            return 0;
+        return -1;
+    }
+#endif
+
+    unsigned char buf[MAX_IOSEND_SIZE];
     while (total < nbytes) {
         size_t chunksize;  // this time sending size
         if (nbytes - total <= sizeof(buf))
@@ -300,14 +425,14 @@ ssize_t qio_gets(int fd, char *buf, size_t bufsize, int timeoutms) {
  */
 ssize_t qio_puts(int fd, const char *str, int timeoutms) {
     size_t strsize = strlen(str);
-    char *newstr = (char *) malloc(strsize + 1 + 1);
+    char *newstr = (char *) qlibc_malloc(strsize + 1 + 1);
     if (newstr == NULL)
         return -1;
-    strncpy(newstr, str, strsize);
+    memcpy(newstr, str, strsize);
     newstr[strsize] = '\n';
     newstr[strsize + 1] = '\0';
     ssize_t ret = qio_write(fd, newstr, strsize + 1, timeoutms);
-    free(newstr);
+    qlibc_free(newstr);
     return ret;
 }
 
@@ -329,7 +454,434 @@ ssize_t qio_printf(int fd, int timeoutms, const char *format, ...) {
         return -1;
 
     ssize_t ret = qio_write(fd, buf, strlen(buf), timeoutms);
-    free(buf);
+    qlibc_free(buf);
 
     return ret;
 }
+
+/**
+ * Create a buffered reader of a file descriptor.
+ *
+ * @param fd        file descriptor
+ * @param bufsize   read buffer size, 0 for default size.
+ *
+ * @return a pointer of malloced reader, otherwise returns NULL.
+ * @retval errno will be set in error condition.
+ *  - ENOMEM : Memory allocation failure.
+ *
+ * @code
+ *  qio_reader_t *reader = qio_reader(sockfd, 0);
+ *  char line[1024];
+ *  while (qio_reader_gets(reader, line, sizeof(line), 1000) > 0) {
+ *      if (line[0] == '\0') break;
+ *      (...parse a header line...)
+ *  }
+ *  char *body = malloc(contentlength);
+ *  qio_reader_read(reader, body, contentlength, 1000);
+ *  qio_reader_free(reader);
+ * @endcode
+ *
+ * @note
+ *  A reader reads as much as available into its buffer with a single
+ *  read() call, then serves line and data reads from the buffer. Since the
+ *  reader may have consumed data which follows what's been read through it,
+ *  all the reads on the descriptor must go through the same reader.
+ */
+qio_reader_t *qio_reader(int fd, size_t bufsize) {
+    qio_reader_t *reader = qio_reader_custom(NULL, NULL, bufsize);
+    if (reader != NULL)
+        reader->fd = fd;
+    return reader;
+}
+
+/**
+ * Create a buffered reader of a custom source such as a TLS connection.
+ *
+ * @param readfn    read function returning the number of bytes read with a
+ *                  single read from the source, 0 on end of stream or -1 for
+ *                  error setting errno to ETIMEDOUT on timeout.
+ * @param arg       argument passed to readfn.
+ * @param bufsize   read buffer size, 0 for default size.
+ *
+ * @return a pointer of malloced reader, otherwise returns NULL.
+ * @retval errno will be set in error condition.
+ *  - ENOMEM : Memory allocation failure.
+ */
+qio_reader_t *qio_reader_custom(ssize_t (*readfn)(void *arg, void *buf,
+                                                  size_t nbytes,
+                                                  int timeoutms),
+                                void *arg, size_t bufsize) {
+    if (bufsize == 0)
+        bufsize = DEFAULT_READER_SIZE;
+
+    qio_reader_t *reader = (qio_reader_t *) qlibc_calloc(1, sizeof(qio_reader_t));
+    if (reader == NULL) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    reader->buf = (unsigned char *) qlibc_malloc(bufsize);
+    if (reader->buf == NULL) {
+        qlibc_free(reader);
+        errno = ENOMEM;
+        return NULL;
+    }
+    reader->fd = -1;
+    reader->readfn = readfn;
+    reader->arg = arg;
+    reader->bufsize = bufsize;
+
+    return reader;
+}
+
+/**
+ * Read a line through a reader. It works like qio_gets() but doesn't make a
+ * system call per byte.
+ *
+ * @param reader    qio_reader_t pointer
+ * @param buf       data buffer pointer
+ * @param bufsize   buffer size
+ * @param timeoutms wait timeout milliseconds. 0 for no wait, -1 for infinite
+ *                  wait
+ *
+ * @return the number of bytes read if successful, 0 on timeout, -1 for error.
+ *
+ * @note
+ *  New-line characters(CR, LF) will be counted in the return value, but not
+ *  be stored. A line longer than the buffer is returned in pieces.
+ */
+ssize_t qio_reader_gets(qio_reader_t *reader, char *buf, size_t bufsize,
+                        int timeoutms) {
+    if (bufsize <= 1)
+        return -1;
+
+    ssize_t readcnt = 0;
+    size_t len = 0;
+    bool eol = false;
+    while (eol == false && len < (bufsize - 1)) {
+        if (reader->start == reader->end) {
+            ssize_t rsize = _reader_fill(reader, reader->buf, reader->bufsize,
+                                         timeoutms);
+            if (rsize <= 0)
+                break;
+            reader->start = 0;
+            reader->end = rsize;
+        }
+
+        unsigned char *p = reader->buf + reader->start;
+        size_t avail = reader->end - reader->start;
+        unsigned char *lf = memchr(p, '\n', avail);
+        size_t n = (lf != NULL) ? (size_t) (lf - p) + 1 : avail;
+        if (n > (bufsize - 1) - len) {
+            n = (bufsize - 1) - len;
+            lf = NULL;
+        }
+
+        size_t i;
+        for (i = 0; i < n; i++) {
+            if (p[i] == '\r')
+                continue;
+            else if (p[i] == '\n')
+                eol = true;
+            else
+                buf[len++] = p[i];
+        }
+        reader->start += n;
+        readcnt += n;
+    }
+    buf[len] = '\0';
+
+    if (readcnt > 0)
+        return readcnt;
+    else if (errno == ETIMEDOUT)
+        return 0;
+    return -1;
+}
+
+/**
+ * Read data through a reader. It works like qio_read().
+ *
+ * @param reader    qio_reader_t pointer
+ * @param buf       data buffer pointer, NULL for skipping data.
+ * @param nbytes    the number of bytes to read
+ * @param timeoutms wait timeout milliseconds. 0 for no wait, -1 for infinite
+ *                  wait
+ *
+ * @return the number of bytes read if successful, 0 on timeout, -1 for error.
+ *
+ * @note
+ *  Buffered data is served first, and big reads bypass the buffer.
+ */
+ssize_t qio_reader_read(qio_reader_t *reader, void *buf, size_t nbytes,
+                        int timeoutms) {
+    if (nbytes == 0)
+        return 0;
+
+    ssize_t total = 0;
+    while (total < nbytes) {
+        size_t avail = reader->end - reader->start;
+        if (avail > 0) {
+            size_t n = (avail < nbytes - total) ? avail : nbytes - total;
+            if (buf != NULL)
+                memcpy((unsigned char *) buf + total,
+                       reader->buf + reader->start, n);
+            reader->start += n;
+            total += n;
+            continue;
+        }
+
+        if (buf != NULL && nbytes - total >= reader->bufsize) {
+            // read directly into the user buffer.
+            ssize_t rsize = _reader_fill(reader, (unsigned char *) buf + total,
+                                         nbytes - total, timeoutms);
+            if (rsize <= 0)
+                break;
+            total += rsize;
+        } else {
+            ssize_t rsize = _reader_fill(reader, reader->buf, reader->bufsize,
+                                         timeoutms);
+            if (rsize <= 0)
+                break;
+            reader->start = 0;
+            reader->end = rsize;
+        }
+    }
+
+    if (total > 0)
+        return total;
+    else if (errno == ETIMEDOUT)
+        return 0;
+    return -1;
+}
+
+/**
+ * Transfer data from a reader to a file descriptor. It works like
+ * qio_send().
+ *
+ * @param reader    qio_reader_t pointer
+ * @param outfd     output file descriptor
+ * @param nbytes    the number of bytes to transfer
+ * @param timeoutms wait timeout milliseconds. 0 for no wait, -1 for infinite
+ *                  wait
+ *
+ * @return the number of bytes transferred if successful, 0 on timeout,
+ *         -1 for error.
+ *
+ * @note
+ *  After buffered data is written, the rest of a descriptor reader is
+ *  transferred by qio_send().
+ */
+off_t qio_reader_send(qio_reader_t *reader, int outfd, off_t nbytes,
+                      int timeoutms) {
+    if (nbytes == 0)
+        return 0;
+
+    off_t total = 0;
+    while (total < nbytes) {
+        size_t avail = reader->end - reader->start;
+        if (avail == 0) {
+            if (reader->fd >= 0) {
+                off_t sent = qio_send(outfd, reader->fd, nbytes - total,
+                                      timeoutms);
+                if (sent > 0)
+                    total += sent;
+                break;
+            }
+
+            ssize_t rsize = _reader_fill(reader, reader->buf, reader->bufsize,
+                                         timeoutms);
+            if (rsize <= 0)
+                break;
+            reader->start = 0;
+            reader->end = avail = rsize;
+        }
+
+        size_t n = (avail < nbytes - total) ? avail : (size_t)(nbytes - total);
+        ssize_t wsize = qio_write(outfd, reader->buf + reader->start, n,
+                                  timeoutms);
+        if (wsize <= 0)
+            break;
+        reader->start += wsize;
+        total += wsize;
+        if (wsize != n)
+            break;
+    }
+
+    if (total > 0)
+        return total;
+    else if (errno == ETIMEDOUT)
+        return 0;
+    return -1;
+}
+
+/**
+ * Get the number of bytes buffered in a reader but not consumed yet.
+ *
+ * @param reader    qio_reader_t pointer
+ *
+ * @return the number of buffered bytes.
+ */
+size_t qio_reader_pending(qio_reader_t *reader) {
+    return reader->end - reader->start;
+}
+
+/**
+ * Drop buffered data of a reader.
+ *
+ * @param reader    qio_reader_t pointer
+ */
+void qio_reader_reset(qio_reader_t *reader) {
+    reader->start = reader->end = 0;
+}
+
+/**
+ * Free a reader. The file descriptor is not closed.
+ *
+ * @param reader    qio_reader_t pointer
+ */
+void qio_reader_free(qio_reader_t *reader) {
+    if (reader == NULL)
+        return;
+    qlibc_free(reader->buf);
+    qlibc_free(reader);
+}
+
+#ifndef _DOXYGEN_SKIP
+
+// a single read from the source of reader. 0 for end of stream.
+static ssize_t _reader_fill(qio_reader_t *reader, void *buf, size_t nbytes,
+                            int timeoutms) {
+    if (reader->readfn != NULL)
+        return reader->readfn(reader->arg, buf, nbytes, timeoutms);
+
+    while (true) {
+        if (timeoutms >= 0 && qio_wait_readable(reader->fd, timeoutms) <= 0)
+            return -1;
+
+        ssize_t rsize = read(reader->fd, buf, nbytes);
+        if (rsize < 0 && (errno == EAGAIN || errno == EINPROGRESS
+                          || errno == EINTR)) {
+            // possible with non-block io
+            usleep(1);
+            continue;
+        }
+        if (rsize == 0)
+            errno = 0;  // end of stream isn't a timeout
+        return rsize;
+    }
+}
+
+#ifdef __linux__
+
+// errors meaning the kernel can't transfer between the descriptors.
+#define _KERNEL_UNSUPPORTED(e)  ((e) == EINVAL || (e) == ENOSYS           \
+                                 || (e) == EOPNOTSUPP || (e) == EXDEV     \
+                                 || (e) == ESPIPE || (e) == EBADF)
+
+/*
+ * Transfer data by sendfile() or splice(). fallback is set to true if the
+ * kernel refused the descriptors, so the rest can be sent by copying.
+ */
+static off_t _send_kernel(int outfd, int infd, off_t nbytes, int timeoutms,
+                          bool *fallback) {
+    struct stat st;
+    if (fstat(infd, &st) != 0) {
+        *fallback = true;
+        return 0;
+    }
+
+    off_t total = 0;
+    if (S_ISREG(st.st_mode)) {
+        // file to anything. the file offset is moved like read().
+        while (total < nbytes) {
+            if (timeoutms >= 0 && qio_wait_writable(outfd, timeoutms) <= 0)
+                break;
+
+            size_t chunksize = (nbytes - total > MAX_KERNELSEND_SIZE)
+                    ? MAX_KERNELSEND_SIZE : (size_t) (nbytes - total);
+            ssize_t wsize = sendfile(outfd, infd, NULL, chunksize);
+            DEBUG("sendfile %zd", wsize);
+            if (wsize < 0) {
+                if (errno == EAGAIN || errno == EINTR) {
+                    usleep(1);
+                    continue;
+                }
+                if (total == 0 && _KERNEL_UNSUPPORTED(errno))
+                    *fallback = true;
+                break;
+            } else if (wsize == 0) {  // end of file
+                break;
+            }
+            total += wsize;
+        }
+        return total;
+    }
+
+    // anything to anything through a pipe.
+    int pipefd[2];
+    if (pipe(pipefd) != 0) {
+        *fallback = true;
+        return 0;
+    }
+    while (total < nbytes) {
+        if (timeoutms >= 0 && qio_wait_readable(infd, timeoutms) <= 0)
+            break;
+
+        size_t chunksize = (nbytes - total > MAX_IOSEND_SIZE)
+                ? MAX_IOSEND_SIZE : (size_t) (nbytes - total);
+        ssize_t rsize = splice(infd, NULL, pipefd[1], NULL, chunksize,
+                               SPLICE_F_MOVE | SPLICE_F_MORE);
+        DEBUG("splice in %zd", rsize);
+        if (rsize < 0) {
+            if (errno == EAGAIN || errno == EINTR) {
+                usleep(1);
+                continue;
+            }
+            if (total == 0 && _KERNEL_UNSUPPORTED(errno))
+                *fallback = true;
+            break;
+        } else if (rsize == 0) {  // end of input
+            break;
+        }
+
+        // drain the pipe
+        ssize_t pending = rsize;
+        while (pending > 0) {
+            if (timeoutms >= 0
+                    && qio_wait_writable(outfd, timeoutms) <= 0)
+                break;
+            ssize_t wsize = splice(pipefd[0], NULL, outfd, NULL, pending,
+                                   SPLICE_F_MOVE | SPLICE_F_MORE);
+            DEBUG("splice out %zd", wsize);
+            if (wsize < 0) {
+                if (errno == EAGAIN || errno == EINTR) {
+                    usleep(1);
+                    continue;
+                }
+                break;
+            }
+            pending -= wsize;
+            total += wsize;
+        }
+        if (pending > 0) {
+            if (total == 0 && _KERNEL_UNSUPPORTED(errno)) {
+                // nothing has been sent, so send what's in the pipe first.
+                char buf[MAX_IOSEND_SIZE];
+                ssize_t psize = read(pipefd[0], buf, pending);
+                if (psize > 0 && qio_write(outfd, buf, psize, timeoutms)
+                        == psize) {
+                    total = psize;
+                    *fallback = true;
+                }
+            }
+            break;
+        }
+    }
+    close(pipefd[0]);
+    close(pipefd[1]);
+
+    return total;
+}
+
+#endif /* __linux__ */
+
+#endif /* _DOXYGEN_SKIP */
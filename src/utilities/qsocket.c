@@ -28,6 +28,14 @@
 
 /**
  * @file qsocket.c Socket dandling APIs.
+ *
+ * Hostnames are resolved with getaddrinfo() and the results are kept in a
+ * process-wide cache for a while, so reconnecting to the same host doesn't
+ * wait for DNS again. qsocket_open() connects to IPv4 and IPv6 addresses of
+ * a host in the Happy Eyeballs manner (RFC 8305). It starts with the first
+ * address and, if that doesn't complete within a short delay, starts the
+ * next one in parallel alternating the address families. The first
+ * connection to complete wins and the others are closed.
  */
 
 #ifndef _WIN32
@@ -41,14 +49,46 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <errno.h>
+#include <poll.h>
+#include <pthread.h>
 #include <arpa/inet.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <sys/socket.h>
 #include "qinternal.h"
+#include "containers/qhashtbl.h"
 #include "utilities/qio.h"
 #include "utilities/qstring.h"
+#include "utilities/qtime.h"
 #include "utilities/qsocket.h"
 
+#ifndef _DOXYGEN_SKIP
+
+#define DNSCACHE_TTLMS      (60 * 1000)  /*!< default lifetime of results */
+#define DNSCACHE_MAXHOSTS   (256)        /*!< default number of hosts */
+#define CONNECT_DELAYMS     (250)        /*!< delay between connect attempts */
+
+/* cached result of a hostname lookup. ports are zero. */
+struct _dnsentry_s {
+    long expire;    /*!< qtime_monotonic_coarse_ms() when it expires */
+    int naddrs;
+    struct sockaddr_storage addrs[QSOCKET_MAXADDRS];
+};
+
+static pthread_mutex_t _dnslock = PTHREAD_MUTEX_INITIALIZER;
+static qhashtbl_t *_dnscache = NULL;
+static int _dnsttlms = DNSCACHE_TTLMS;
+static size_t _dnsmaxhosts = DNSCACHE_MAXHOSTS;
+
+static int _lookup(struct sockaddr_storage *addrs, int maxaddrs,
+                   const char *hostname);
+static void _set_port(struct sockaddr_storage *addr, int port);
+static int _connect(const struct sockaddr_storage *addrs, int naddrs,
+                    int timeoutms, const qsocket_opts_t *opts);
+static bool _setopt(int sockfd, int level, int name, int value);
+
+#endif
+
 /**
  * Create a TCP socket for the remote host and port.
  *
@@ -61,39 +101,51 @@
  *         -1 in case of invalid hostname,
  *         -2 in case of socket creation failure,
  *         -3 in case of connection failure.
+ *
+ * @note
+ *  All the addresses of the host, IPv4 and IPv6, are tried. When the first
+ *  one doesn't connect within 250ms, the next one is tried in parallel and
+ *  the first connection made is returned. The timeout covers all attempts.
+ *  The returned socket is in blocking mode.
  */
 int qsocket_open(const char *hostname, int port, int timeoutms) {
-    /* host conversion */
-    struct sockaddr_in addr;
-    if (qsocket_get_addr(&addr, hostname, port) == false) {
-        return -1; /* invalid hostname */
-    }
-
-    /* create new socket */
-    int sockfd;
-    if ((sockfd = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
-        return -2; /* sockfd creation fail */
-    }
-
-    /* set to non-block socket*/
-    int flags = fcntl(sockfd, F_GETFL, 0);
-    if (timeoutms >= 0)
-        fcntl(sockfd, F_SETFL, flags | O_NONBLOCK);
+    return qsocket_open_opts(hostname, port, timeoutms, NULL);
+}
 
-    /* try to connect */
-    int status = connect(sockfd, (struct sockaddr *) &addr, sizeof(addr));
-    if (status < 0
-            && (errno != EINPROGRESS
-                    || qio_wait_writable(sockfd, timeoutms) <= 0)) {
-        close(sockfd);
-        return -3; /* connection failed */
+/**
+ * Create a TCP socket for the remote host and port with socket options.
+ *
+ * @param hostname  remote hostname
+ * @param port      remote port
+ * @param timeoutms wait timeout milliseconds. if set to negative value,
+ *                  wait indefinitely.
+ * @param opts      socket options set before connecting, NULL for none.
+ *
+ * @return the new socket descriptor, or
+ *         -1 in case of invalid hostname,
+ *         -2 in case of socket creation failure,
+ *         -3 in case of connection failure.
+ *
+ * @code
+ *   qsocket_opts_t opts = { .nodelay = true, .quickack = true,
+ *                           .fastopen = true };
+ *   int sockfd = qsocket_open_opts("www.qdecoder.org", 80, 1000, &opts);
+ * @endcode
+ *
+ * @note
+ *  Options are set on each connection attempt before connect(), so buffer
+ *  sizes take effect on the TCP window and fastopen applies to the
+ *  handshake. A failure of setting options doesn't fail the connection.
+ */
+int qsocket_open_opts(const char *hostname, int port, int timeoutms,
+                      const qsocket_opts_t *opts) {
+    struct sockaddr_storage addrs[QSOCKET_MAXADDRS];
+    int naddrs = qsocket_resolve(addrs, QSOCKET_MAXADDRS, hostname, port);
+    if (naddrs <= 0) {
+        return -1; /* invalid hostname */
     }
 
-    /* restore to block socket */
-    if (timeoutms >= 0)
-        fcntl(sockfd, F_SETFL, flags);
-
-    return sockfd;
+    return _connect(addrs, naddrs, timeoutms, opts);
 }
 
 /**
@@ -122,6 +174,81 @@ bool qsocket_close(int sockfd, int timeoutms) {
     return false;
 }
 
+/**
+ * Apply a socket tuning profile.
+ *
+ * @param sockfd    socket descriptor
+ * @param opts      socket options. zero fields are left as they are.
+ *
+ * @return true if all the options given are set, otherwise returns false.
+ * @retval errno will be set in error condition.
+ *  - EINVAL  : Invalid argument.
+ *  - ENOTSUP : Option is not available on this platform.
+ *  - others  : Errors of setsockopt(2).
+ *
+ * @note
+ *  All the options are tried even if one fails. fastopen and reuseport
+ *  only work when set before connect() or bind(). Linux turns quickack
+ *  off again by itself, so latency-sensitive callers may set it again
+ *  after reads. busypollus usually needs CAP_NET_ADMIN to go above the
+ *  system setting.
+ */
+bool qsocket_set_opts(int sockfd, const qsocket_opts_t *opts) {
+    if (opts == NULL) {
+        errno = EINVAL;
+        return false;
+    }
+
+    bool ret = true;
+    if (opts->nodelay == true)
+        ret &= _setopt(sockfd, IPPROTO_TCP, TCP_NODELAY, 1);
+    if (opts->quickack == true) {
+#ifdef TCP_QUICKACK
+        ret &= _setopt(sockfd, IPPROTO_TCP, TCP_QUICKACK, 1);
+#else
+        ret = false;
+        errno = ENOTSUP;
+#endif
+    }
+    if (opts->fastopen == true) {
+#ifdef TCP_FASTOPEN_CONNECT
+        ret &= _setopt(sockfd, IPPROTO_TCP, TCP_FASTOPEN_CONNECT, 1);
+#else
+        ret = false;
+        errno = ENOTSUP;
+#endif
+    }
+    if (opts->reuseport == true) {
+#ifdef SO_REUSEPORT
+        ret &= _setopt(sockfd, SOL_SOCKET, SO_REUSEPORT, 1);
+#else
+        ret = false;
+        errno = ENOTSUP;
+#endif
+    }
+    if (opts->sndbuf > 0)
+        ret &= _setopt(sockfd, SOL_SOCKET, SO_SNDBUF, opts->sndbuf);
+    if (opts->rcvbuf > 0)
+        ret &= _setopt(sockfd, SOL_SOCKET, SO_RCVBUF, opts->rcvbuf);
+    if (opts->busypollus > 0) {
+#ifdef SO_BUSY_POLL
+        ret &= _setopt(sockfd, SOL_SOCKET, SO_BUSY_POLL, opts->busypollus);
+#else
+        ret = false;
+        errno = ENOTSUP;
+#endif
+    }
+    if (opts->lingersec > 0) {
+        struct linger li;
+        li.l_onoff = 1;
+        li.l_linger = opts->lingersec;
+        if (setsockopt(sockfd, SOL_SOCKET, SO_LINGER, &li, sizeof(li)) < 0)
+            ret = false;
+    }
+
+    return ret;
+}
+
 /**
  * Convert hostname to sockaddr_in structure.
  *
@@ -135,10 +262,13 @@ bool qsocket_get_addr(struct sockaddr_in *addr, const char *hostname, int port)
     /* here we assume that the hostname argument contains ip address */
     memset((void *) addr, 0, sizeof(struct sockaddr_in));
     if (!inet_aton(hostname, &addr->sin_addr)) { /* fail then try another way */
-        struct hostent *hp;
-        if ((hp = gethostbyname(hostname)) == 0)
+        struct sockaddr_storage addrs[QSOCKET_MAXADDRS];
+        int naddrs = qsocket_resolve(addrs, QSOCKET_MAXADDRS, hostname, port);
+        int i;
+        for (i = 0; i < naddrs && addrs[i].ss_family != AF_INET; i++);
+        if (i >= naddrs)
             return false;
-        memcpy(&addr->sin_addr, hp->h_addr, sizeof(struct in_addr));
+        memcpy(addr, &addrs[i], sizeof(struct sockaddr_in));
     }
     addr->sin_family = AF_INET;
     addr->sin_port = htons(port);
@@ -146,6 +276,115 @@ bool qsocket_get_addr(struct sockaddr_in *addr, const char *hostname, int port)
     return true;
 }
 
+/**
+ * Resolve hostname to IPv4 and IPv6 addresses.
+ *
+ * @param addrs     address array to store the results
+ * @param maxaddrs  number of entries in addrs
+ * @param hostname  IP string address or hostname
+ * @param port      port number
+ *
+ * @return the number of addresses stored, or -1 if the hostname can't be
+ *         resolved.
+ *
+ * @code
+ *   struct sockaddr_storage addrs[QSOCKET_MAXADDRS];
+ *   int naddrs = qsocket_resolve(addrs, QSOCKET_MAXADDRS, "localhost", 80);
+ * @endcode
+ *
+ * @note
+ *  Addresses are in the order of getaddrinfo(). The results of hostname
+ *  lookups are cached, see qsocket_set_dnscache(). This function is
+ *  thread-safe.
+ */
+int qsocket_resolve(struct sockaddr_storage *addrs, int maxaddrs,
+                    const char *hostname, int port) {
+    if (addrs == NULL || maxaddrs <= 0 || hostname == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    // numeric addresses don't need a lookup.
+    memset((void *) addrs, 0, sizeof(struct sockaddr_storage));
+    struct sockaddr_in *in4 = (struct sockaddr_in *) addrs;
+    struct sockaddr_in6 *in6 = (struct sockaddr_in6 *) addrs;
+    if (inet_pton(AF_INET, hostname, &in4->sin_addr) == 1) {
+        in4->sin_family = AF_INET;
+        in4->sin_port = htons(port);
+        return 1;
+    }
+    if (inet_pton(AF_INET6, hostname, &in6->sin6_addr) == 1) {
+        in6->sin6_family = AF_INET6;
+        in6->sin6_port = htons(port);
+        return 1;
+    }
+
+    int naddrs = -1;
+    pthread_mutex_lock(&_dnslock);
+    if (_dnscache != NULL) {
+        struct _dnsentry_s *entry = (struct _dnsentry_s *) _dnscache->get(
+                _dnscache, hostname, NULL, false);
+        if (entry != NULL && entry->expire - qtime_monotonic_coarse_ms() > 0) {
+            naddrs = (entry->naddrs < maxaddrs) ? entry->naddrs : maxaddrs;
+            memcpy(addrs, entry->addrs,
+                   naddrs * sizeof(struct sockaddr_storage));
+        }
+    }
+    pthread_mutex_unlock(&_dnslock);
+
+    if (naddrs < 0) {
+        struct _dnsentry_s entry;
+        entry.naddrs = _lookup(entry.addrs, QSOCKET_MAXADDRS, hostname);
+        if (entry.naddrs <= 0)
+            return -1;
+        entry.expire = qtime_monotonic_coarse_ms() + _dnsttlms;
+
+        pthread_mutex_lock(&_dnslock);
+        if (_dnsttlms > 0 && _dnscache == NULL)
+            _dnscache = qhashtbl(0, QHASHTBL_RESIZABLE);
+        if (_dnsttlms > 0 && _dnscache != NULL) {
+            // drop everything rather than tracking the oldest entry.
+            if (_dnscache->size(_dnscache) >= _dnsmaxhosts)
+                _dnscache->clear(_dnscache);
+            _dnscache->put(_dnscache, hostname, &entry, sizeof(entry));
+        }
+        pthread_mutex_unlock(&_dnslock);
+
+        naddrs = (entry.naddrs < maxaddrs) ? entry.naddrs : maxaddrs;
+        memcpy(addrs, entry.addrs, naddrs * sizeof(struct sockaddr_storage));
+    }
+
+    int i;
+    for (i = 0; i < naddrs; i++) {
+        _set_port(&addrs[i], port);
+    }
+    return naddrs;
+}
+
+/**
+ * Set the lifetime and the size of the hostname lookup cache.
+ *
+ * @param ttlms     how long results are reused in milliseconds. 0 disables
+ *                  the cache.
+ * @param maxhosts  maximum number of cached hostnames.
+ *
+ * @note
+ *  By default, results are kept for 60 seconds and up to 256 hostnames
+ *  are cached. getaddrinfo() doesn't tell the TTL of DNS records, so the
+ *  same lifetime applies to all hostnames. Calling this function drops
+ *  all the cached results.
+ */
+void qsocket_set_dnscache(int ttlms, size_t maxhosts) {
+    pthread_mutex_lock(&_dnslock);
+    _dnsttlms = (ttlms > 0) ? ttlms : 0;
+    _dnsmaxhosts = (maxhosts > 0) ? maxhosts : DNSCACHE_MAXHOSTS;
+    if (_dnscache != NULL) {
+        _dnscache->free(_dnscache);
+        _dnscache = NULL;
+    }
+    pthread_mutex_unlock(&_dnslock);
+}
+
 /**
  * Return local IP address.
  *
@@ -169,4 +408,175 @@ char *qsocket_get_localaddr(char *buf, size_t bufsize) {
     return buf;
 }
 
+#ifndef _DOXYGEN_SKIP
+
+/**
+ * Look up hostname, ordering addresses to alternate between address
+ * families as RFC 8305 suggests.
+ */
+static int _lookup(struct sockaddr_storage *addrs, int maxaddrs,
+                   const char *hostname) {
+    struct addrinfo hints, *res;
+    memset((void *) &hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_ADDRCONFIG;
+    if (getaddrinfo(hostname, NULL, &hints, &res) != 0) {
+        DEBUG("Can't resolve %s", hostname);
+        return -1;
+    }
+
+    // take addresses of the first family and the other family in turn.
+    struct addrinfo *fam[2][QSOCKET_MAXADDRS];
+    int nfam[2] = { 0, 0 };
+    struct addrinfo *ai;
+    for (ai = res; ai != NULL; ai = ai->ai_next) {
+        int f = (ai->ai_family != res->ai_family);
+        if (ai->ai_addrlen <= sizeof(struct sockaddr_storage)
+                && nfam[f] < maxaddrs)
+            fam[f][nfam[f]++] = ai;
+    }
+    int naddrs = 0;
+    int i, f;
+    for (i = 0; i < nfam[0] || i < nfam[1]; i++) {
+        for (f = 0; f < 2; f++) {
+            if (i >= nfam[f] || naddrs >= maxaddrs)
+                continue;
+            memset((void *) &addrs[naddrs], 0, sizeof(struct sockaddr_storage));
+            memcpy(&addrs[naddrs], fam[f][i]->ai_addr, fam[f][i]->ai_addrlen);
+            naddrs++;
+        }
+    }
+    freeaddrinfo(res);
+
+    return (naddrs > 0) ? naddrs : -1;
+}
+
+static void _set_port(struct sockaddr_storage *addr, int port) {
+    if (addr->ss_family == AF_INET6)
+        ((struct sockaddr_in6 *) addr)->sin6_port = htons(port);
+    else
+        ((struct sockaddr_in *) addr)->sin_port = htons(port);
+}
+
+/**
+ * Start a connection attempt. Returns the socket, or -1 if the attempt
+ * failed right away and -2 if a socket can't be created.
+ */
+static int _connect_start(const struct sockaddr_storage *addr,
+                          const qsocket_opts_t *opts, bool *connected) {
+    int sockfd = socket(addr->ss_family, SOCK_STREAM, 0);
+    if (sockfd < 0)
+        return -2;
+    fcntl(sockfd, F_SETFL, fcntl(sockfd, F_GETFL, 0) | O_NONBLOCK);
+    if (opts != NULL)
+        qsocket_set_opts(sockfd, opts);
+
+    socklen_t addrlen = (addr->ss_family == AF_INET6)
+            ? sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in);
+    if (connect(sockfd, (const struct sockaddr *) addr, addrlen) == 0) {
+        *connected = true;
+    } else if (errno == EINPROGRESS) {
+        *connected = false;
+    } else {
+        close(sockfd);
+        return -1;
+    }
+    return sockfd;
+}
+
+/**
+ * Connect to one of the addresses. A new attempt is started every
+ * CONNECT_DELAYMS, or right after an attempt fails, until one succeeds.
+ */
+static int _connect(const struct sockaddr_storage *addrs, int naddrs,
+                    int timeoutms, const qsocket_opts_t *opts) {
+    struct pollfd fds[QSOCKET_MAXADDRS];
+    int nfds = 0;
+    int next = 0;
+    bool created = false;
+    int winner = -1;
+    long now = qtime_monotonic_coarse_ms();
+    long deadline = now + timeoutms;
+    long nextstart = now;
+
+    while (winner < 0) {
+        // start the next attempt when it's time.
+        if (next < naddrs && nextstart - now <= 0) {
+            bool connected = false;
+            int sockfd = _connect_start(&addrs[next++], opts, &connected);
+            nextstart = now + CONNECT_DELAYMS;
+            if (sockfd != -2)
+                created = true;
+            if (sockfd >= 0 && connected == true) {
+                winner = sockfd;
+                break;
+            } else if (sockfd >= 0) {
+                fds[nfds].fd = sockfd;
+                fds[nfds].events = POLLOUT;
+                fds[nfds].revents = 0;
+                nfds++;
+            } else {
+                nextstart = now;
+                continue;
+            }
+        }
+        if (nfds == 0 && next >= naddrs)
+            break;
+
+        // wait for any attempt or the time to start the next one.
+        int waitms = -1;
+        if (next < naddrs)
+            waitms = (int) (nextstart - now);
+        if (timeoutms >= 0 && (waitms < 0 || deadline - now < waitms))
+            waitms = (deadline - now > 0) ? (int) (deadline - now) : 0;
+        int n = poll(fds, nfds, waitms);
+        if (n < 0 && errno != EINTR)
+            break;
+
+        int i;
+        for (i = 0; n > 0 && i < nfds; i++) {
+            if (fds[i].revents == 0)
+                continue;
+            int err = 0;
+            socklen_t errlen = sizeof(err);
+            if (getsockopt(fds[i].fd, SOL_SOCKET, SO_ERROR, &err, &errlen) == 0
+                    && err == 0) {
+                winner = fds[i].fd;
+                fds[i] = fds[--nfds];
+                break;
+            }
+            DEBUG("connect attempt failed. (%d)", err);
+            close(fds[i].fd);
+            fds[i--] = fds[--nfds];
+            nextstart = now;  // try the next one without waiting
+        }
+
+        now = qtime_monotonic_coarse_ms();
+        if (winner < 0 && timeoutms >= 0 && deadline - now <= 0)
+            break;
+    }
+
+    int i;
+    for (i = 0; i < nfds; i++) {
+        close(fds[i].fd);
+    }
+    if (winner < 0)
+        return (created == true) ? -3 : -2;
+
+    // restore to block socket
+    fcntl(winner, F_SETFL, fcntl(winner, F_GETFL, 0) & ~O_NONBLOCK);
+    return winner;
+}
+
+static bool _setopt(int sockfd, int level, int name, int value) {
+    if (setsockopt(sockfd, level, name, &value, sizeof(value)) < 0) {
+        DEBUG("setsockopt(%d, %d) failed. (%d)", level, name, errno);
+        return false;
+    }
+    return true;
+}
+
+#endif /* _DOXYGEN_SKIP */
+
 #endif /* _WIN32 */
@@ -35,6 +35,7 @@
 #include <stdbool.h>
 #include <string.h>
 #include <stdarg.h>
+#include <errno.h>
 #include <ctype.h>
 #include <time.h>
 #include <unistd.h>
@@ -43,6 +44,22 @@
 #include "utilities/qhash.h"
 #include "utilities/qstring.h"
 
+#ifndef _DOXYGEN_SKIP
+// a set of patterns for qstrreplace_multi().
+struct qstr_patterns_s {
+    const char **tokens;
+    const char **words;
+    size_t *toklens;
+    size_t *wordlens;
+    int *next;          /*!< next pattern with the same first byte */
+    int first[256];     /*!< longest pattern of each first byte, -1 if none */
+    char firsts[256];   /*!< first bytes of the patterns for strcspn() */
+};
+
+static size_t _replace_scan(const char *src, struct qstr_patterns_s *pat,
+                            char *out);
+#endif
+
 /**
  * Remove white spaces(including CR, LF) from head and tail of the string.
  *
@@ -218,11 +235,11 @@ char *qstrunchar(char *str, char head, char tail) {
  *   --[Result]--
  *   before tn : srcstr = Welcome to The qDecoder Project.
  *   after  tn : srcstr = Welcome to The qDecoder Project.
- *               retstr = W_lcom_ _o ___ qD_cod_r Proj_c_.
+ *               retstr = W_lcom_ to ___ qD_cod_r Proj_ct.
  *
  *   before tr : srcstr = Welcome to The qDecoder Project.
- *   after  tr : srcstr = W_lcom_ _o ___ qD_cod_r Proj_c_.
- *               retstr = W_lcom_ _o ___ qD_cod_r Proj_c_.
+ *   after  tr : srcstr = W_lcom_ to ___ qD_cod_r Proj_ct.
+ *               retstr = W_lcom_ to ___ qD_cod_r Proj_ct.
  *
  *   before sn : srcstr = Welcome to The qDecoder Project.
  *   after  sn : srcstr = Welcome to The qDecoder Project.
@@ -241,51 +258,44 @@ char *qstrreplace(const char *mode, char *srcstr, const char *tokstr,
         return NULL;
     }
 
-    char *newstr, *newp, *srcp, *tokenp, *retp;
-    newstr = newp = srcp = tokenp = retp = NULL;
+    char *newstr, *newp, *srcp, *retp;
+    newstr = newp = srcp = retp = NULL;
 
     char method = mode[0], memuse = mode[1];
-    int maxstrlen, tokstrlen;
+    size_t wordlen = strlen(word);
 
     /* Put replaced string into malloced 'newstr' */
     if (method == 't') { /* Token replace */
-        maxstrlen = strlen(srcstr) * ((strlen(word) > 0) ? strlen(word) : 1);
-        newstr = (char *) malloc(maxstrlen + 1);
-
-        for (srcp = (char *) srcstr, newp = newstr; *srcp; srcp++) {
-            for (tokenp = (char *) tokstr; *tokenp; tokenp++) {
-                if (*srcp == *tokenp) {
-                    char *wordp;
-                    for (wordp = (char *) word; *wordp; wordp++) {
-                        *newp++ = *wordp;
-                    }
-                    break;
-                }
-            }
-            if (!*tokenp)
-                *newp++ = *srcp;
-        }
-        *newp = '\0';
-    } else if (method == 's') { /* String replace */
-        if (strlen(word) > strlen(tokstr)) {
-            maxstrlen = ((strlen(srcstr) / strlen(tokstr)) * strlen(word))
-                    + (strlen(srcstr) % strlen(tokstr));
-        } else {
-            maxstrlen = strlen(srcstr);
+        // count the tokens first to allocate just enough.
+        size_t srclen = 0, cnt = 0;
+        for (srcp = srcstr; *srcp; srcp++, cnt++) {
+            size_t span = strcspn(srcp, tokstr);
+            srclen += span;
+            srcp += span;
+            if (*srcp == '\0')
+                break;
         }
-        newstr = (char *) malloc(maxstrlen + 1);
-        tokstrlen = strlen(tokstr);
-
-        for (srcp = srcstr, newp = newstr; *srcp; srcp++) {
-            if (!strncmp(srcp, tokstr, tokstrlen)) {
-                char *wordp;
-                for (wordp = (char *) word; *wordp; wordp++)
-                    *newp++ = *wordp;
-                srcp += tokstrlen - 1;
-            } else
-                *newp++ = *srcp;
+        newstr = (char *) qlibc_malloc(srclen + (cnt * wordlen) + 1);
+        if (newstr == NULL)
+            return NULL;
+
+        for (srcp = srcstr, newp = newstr; *srcp;) {
+            size_t span = strcspn(srcp, tokstr);
+            memcpy(newp, srcp, span);
+            newp += span;
+            srcp += span;
+            if (*srcp == '\0')
+                break;
+            memcpy(newp, word, wordlen);
+            newp += wordlen;
+            srcp++;
         }
         *newp = '\0';
+    } else if (method == 's') { /* String replace */
+        const char *tokens[1] = { tokstr }, *words[1] = { word };
+        newstr = qstrreplace_multi(srcstr, tokens, words, 1);
+        if (newstr == NULL)
+            return NULL;
     } else {
         DEBUG("Unknown mode \"%s\".", mode);
         return NULL;
@@ -296,17 +306,107 @@ char *qstrreplace(const char *mode, char *srcstr, const char *tokstr,
         retp = newstr;
     else if (memuse == 'r') {
         strcpy(srcstr, newstr);
-        free(newstr);
+        qlibc_free(newstr);
         retp = srcstr;
     } else {
         DEBUG("Unknown mode \"%s\".", mode);
-        free(newstr);
+        qlibc_free(newstr);
         return NULL;
     }
 
     return retp;
 }
 
+/**
+ * Replace multiple strings at once.
+ *
+ * @param srcstr    source string
+ * @param tokens    array of strings to find
+ * @param words     array of replacement strings, in the same order as tokens
+ * @param num       number of tokens
+ *
+ * @return a pointer of malloced string if successful, otherwise returns NULL
+ * @retval errno will be set in error condition.
+ *  - EINVAL  : Invalid argument.
+ *  - ENOMEM  : Memory allocation failure.
+ *
+ * @note
+ *  The source string is scanned once from the head. At each position, the
+ *  longest token matched is replaced and the scan goes on after it, so the
+ *  replaced words are never scanned again. Empty tokens are ignored.
+ *  Positions which can't start any token are skipped with strcspn(), and the
+ *  size of result is counted before allocating it once.
+ *
+ * @code
+ *   const char *tokens[] = { "{name}", "{id}" };
+ *   const char *words[] = { "qLibc", "1" };
+ *   char *str = qstrreplace_multi("{name}-{id}", tokens, words, 2);
+ *   printf("%s\n", str);  // qLibc-1
+ *   free(str);
+ * @endcode
+ */
+char *qstrreplace_multi(const char *srcstr, const char **tokens,
+                        const char **words, size_t num) {
+    if (srcstr == NULL || (num > 0 && (tokens == NULL || words == NULL))) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    struct qstr_patterns_s pat;
+    memset((void *) &pat, 0, sizeof(pat));
+    pat.tokens = tokens;
+    pat.words = words;
+    pat.toklens = (size_t *) qlibc_malloc(sizeof(size_t) * (num + 1));
+    pat.wordlens = (size_t *) qlibc_malloc(sizeof(size_t) * (num + 1));
+    pat.next = (int *) qlibc_malloc(sizeof(int) * (num + 1));
+    if (pat.toklens == NULL || pat.wordlens == NULL || pat.next == NULL) {
+        qlibc_free(pat.toklens);
+        qlibc_free(pat.wordlens);
+        qlibc_free(pat.next);
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    // chain the tokens by the first byte, longer ones first.
+    memset((void *) pat.first, -1, sizeof(pat.first));
+    size_t i, nfirsts = 0;
+    for (i = 0; i < num; i++) {
+        if (tokens[i] == NULL || words[i] == NULL) {
+            qlibc_free(pat.toklens);
+            qlibc_free(pat.wordlens);
+            qlibc_free(pat.next);
+            errno = EINVAL;
+            return NULL;
+        }
+        pat.toklens[i] = strlen(tokens[i]);
+        pat.wordlens[i] = strlen(words[i]);
+        pat.next[i] = -1;
+        if (pat.toklens[i] == 0)
+            continue;
+
+        unsigned char c = tokens[i][0];
+        if (pat.first[c] < 0)
+            pat.firsts[nfirsts++] = c;
+        int *link = &pat.first[c];
+        while (*link >= 0 && pat.toklens[*link] >= pat.toklens[i])
+            link = &pat.next[*link];
+        pat.next[i] = *link;
+        *link = i;
+    }
+
+    char *newstr = (char *) qlibc_malloc(_replace_scan(srcstr, &pat, NULL) + 1);
+    if (newstr != NULL) {
+        _replace_scan(srcstr, &pat, newstr);
+    } else {
+        errno = ENOMEM;
+    }
+
+    qlibc_free(pat.toklens);
+    qlibc_free(pat.wordlens);
+    qlibc_free(pat.next);
+    return newstr;
+}
+
 /**
  * Copy src string to dst. The dst string array will be always terminated by
  * NULL character. Also allows overlap between src and dst.
@@ -361,8 +461,8 @@ char *qstrdupf(const char *format, ...) {
     if (str == NULL)
         return NULL;
 
-    char *dup = strdup(str);
-    free(str);
+    char *dup = qlibc_strdup(str);
+    qlibc_free(str);
 
     return dup;
 }
@@ -388,7 +488,7 @@ char *qstrdup_between(const char *str, const char *start, const char *end) {
 
     int len = e - s;
 
-    char *buf = (char *) malloc(sizeof(char) * (len + 1));
+    char *buf = (char *) qlibc_malloc(sizeof(char) * (len + 1));
     strncpy(buf, s, len);
     buf[len] = '\0';
 
@@ -404,14 +504,12 @@ char *qstrdup_between(const char *str, const char *start, const char *end) {
  * @return a pointer of str if successful, otherwise returns NULL
  */
 char *qstrcatf(char *str, const char *format, ...) {
-    char *buf;
-    DYNAMIC_VSPRINTF(buf, format);
-    if (buf == NULL)
-        return NULL;
-
-    char *ret = strcat(str, buf);
-    free(buf);
-    return ret;
+    // str must have room like strcat(), so format right at the end of it.
+    va_list arglist;
+    va_start(arglist, format);
+    int n = vsprintf(str + strlen(str), format, arglist);
+    va_end(arglist);
+    return (n >= 0) ? str : NULL;
 }
 
 /**
@@ -554,20 +652,16 @@ char *qstrlower(char *str) {
 char *qstrtok(char *str, const char *delimiters, char *retstop, int *offset) {
     char *tokensp, *tokenep;
 
-    tokensp = tokenep = (char *) (str + *offset);
-    int numdel = strlen(delimiters);
-    for (; *tokenep; tokenep++) {
-        int j;
-        for (j = 0; j < numdel; j++) {
-            if (*tokenep == delimiters[j]) {
-                if (retstop != NULL)
-                    *retstop = delimiters[j];
-                *tokenep = '\0';
-                tokenep++;
-                *offset = tokenep - str;
-                return tokensp;
-            }
-        }
+    // strcspn() is usually vectorized by libc.
+    tokensp = (char *) (str + *offset);
+    tokenep = tokensp + strcspn(tokensp, delimiters);
+    if (*tokenep != '\0') {
+        if (retstop != NULL)
+            *retstop = *tokenep;
+        *tokenep = '\0';
+        tokenep++;
+        *offset = tokenep - str;
+        return tokensp;
     }
 
     if (retstop != NULL)
@@ -602,16 +696,17 @@ qlist_t *qstrtokenizer(const char *str, const char *delimiters) {
     if (list == NULL)
         return NULL;
 
-    int i;
-    char *dupstr = strdup(str);
+    char *dupstr = qlibc_strdup(str);
     char *token;
     int offset = 0;
-    for (i = 1, token = qstrtok(dupstr, delimiters, NULL, &offset);
-            token != NULL;
-            token = qstrtok(dupstr, delimiters, NULL, &offset), i++) {
-        list->addlast(list, token, strlen(token) + 1);
+    while ((token = qstrtok(dupstr, delimiters, NULL, &offset)) != NULL) {
+        // offset points right after the token and its delimiter.
+        size_t toklen = (dupstr + offset) - token;
+        if (token[toklen - 1] == '\0')
+            toklen--;
+        list->addlast(list, token, toklen + 1);
     }
-    free(dupstr);
+    qlibc_free(dupstr);
 
     return list;
 }
@@ -662,7 +757,7 @@ char *qstrunique(const char *seed) {
 char *qstr_comma_number(int number) {
     char *str, *strp;
 
-    str = strp = (char *) malloc(sizeof(char) * (14 + 1));
+    str = strp = (char *) qlibc_malloc(sizeof(char) * (14 + 1));
     if (str == NULL)
         return NULL;
 
@@ -794,7 +889,7 @@ bool qstr_is_email(const char *email) {
  * @endcode
  */
 bool qstr_is_ip4addr(const char *str) {
-    char *dupstr = strdup(str);
+    char *dupstr = qlibc_strdup(str);
 
     char *s1, *s2;
     int periodcnt;
@@ -804,12 +899,12 @@ bool qstr_is_ip4addr(const char *str) {
 
         int n;
         if (qstrtest(isdigit, s1) == false || (n = atoi(s1)) <= 0 || n >= 256) {
-            free(dupstr);
+            qlibc_free(dupstr);
             return false;
         }
     }
 
-    free(dupstr);
+    qlibc_free(dupstr);
     if (periodcnt != 3)
         return false;
     return true;
@@ -843,7 +938,7 @@ char *qstr_conv_encoding(const char *str, const char *fromcode,
     size_t fromsize = strlen(fromstr) + 1;
 
     size_t tosize = sizeof(char) * ((mag * (fromsize - 1)) + 1);
-    char *tostr = (char *)malloc(tosize);
+    char *tostr = (char *)qlibc_malloc(tosize);
     if (tostr == NULL) return NULL;
     char *tostr1 = tostr;
 
@@ -858,7 +953,7 @@ char *qstr_conv_encoding(const char *str, const char *fromcode,
 
     if (ret < 0) {
         DEBUG("iconv() failed.");
-        free(tostr1);
+        qlibc_free(tostr1);
         return NULL;
     }
 
@@ -867,3 +962,45 @@ char *qstr_conv_encoding(const char *str, const char *fromcode,
     return NULL;
 #endif
 }
+
+#ifndef _DOXYGEN_SKIP
+
+// replace patterns. when out is NULL, just returns the size of result.
+static size_t _replace_scan(const char *src, struct qstr_patterns_s *pat,
+                            char *out) {
+    const char *p = src;
+    size_t len = 0;
+    while (*p != '\0') {
+        // copy the run which can't start any token.
+        size_t span = strcspn(p, pat->firsts);
+        if (out != NULL)
+            memcpy(out + len, p, span);
+        len += span;
+        p += span;
+        if (*p == '\0')
+            break;
+
+        int i;
+        for (i = pat->first[(unsigned char) *p]; i >= 0; i = pat->next[i]) {
+            if (!strncmp(p, pat->tokens[i], pat->toklens[i]))
+                break;
+        }
+        if (i >= 0) {
+            if (out != NULL)
+                memcpy(out + len, pat->words[i], pat->wordlens[i]);
+            len += pat->wordlens[i];
+            p += pat->toklens[i];
+        } else {
+            if (out != NULL)
+                out[len] = *p;
+            len++;
+            p++;
+        }
+    }
+    if (out != NULL)
+        out[len] = '\0';
+
+    return len;
+}
+
+#endif /* _DOXYGEN_SKIP */
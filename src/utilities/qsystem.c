@@ -34,6 +34,7 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <string.h>
+#include <errno.h>
 #include <unistd.h>
 #include <netdb.h>
 #include <sys/socket.h>
@@ -43,6 +44,20 @@
 #include "utilities/qfile.h"
 #include "utilities/qsystem.h"
 
+#if defined(__GLIBC__)
+#include <malloc.h>
+#define _LIBC_USABLE_SIZE(p)    malloc_usable_size(p)
+#elif defined(__APPLE__)
+#include <malloc/malloc.h>
+#define _LIBC_USABLE_SIZE(p)    malloc_size(p)
+#else
+#define _LIBC_USABLE_SIZE(p)    ((size_t) 0)
+#endif
+
+/* allocator set by qlibc_set_allocator(), NULL for the libc one. */
+static qlibc_allocator_t _allocator_storage;
+static const qlibc_allocator_t *_allocator = NULL;
+
 /**
  * Get system environment variable
  *
@@ -76,7 +91,219 @@ char *qsyscmd(const char *cmd) {
     pclose(fp);
 
     if (str == NULL)
-        str = strdup("");
+        str = qlibc_strdup("");
     return str;
 }
 
+/**
+ * Print lock instrumentation of all thread-safe containers.
+ *
+ * @param out       output stream
+ * @param json      print a JSON array instead of text lines
+ *
+ * @return true if successful, otherwise returns false
+ * @retval errno will be set in error condition.
+ *  - ENOTSUP : The library is built without --enable-lockstats.
+ *  - EIO : Invalid output stream.
+ *
+ * @code
+ *  qlockstats_dump(stderr, false);
+ *
+ *  [Output]
+ *  qhashtbl 0x1a2b3c0 rwlock acquires=1000 shared=52310 contended=81 ...
+ *    wait <1024ns:12 <2048ns:40 <4096ns:29
+ *    hold <128ns:940 <256ns:60
+ * @endcode
+ *
+ * @note
+ *  Each lock is labelled by the container which owns it, and the lock
+ *  address is the qmutex member of the container. Counted are exclusive and
+ *  shared entries, entries which had to wait, and log2 histograms of wait
+ *  time for contended entries and of exclusive hold time. In JSON, bucket
+ *  i counts durations under 2^(i + bucket_min_shift) nanoseconds and the
+ *  last bucket counts the rest. Locks are forgotten when their container
+ *  is freed.
+ */
+bool qlockstats_dump(FILE *out, bool json) {
+    return _q_mutex_dump(out, json);
+}
+
+/**
+ * Zero lock instrumentation of all thread-safe containers.
+ *
+ * @note
+ *  Useful to start a measurement window after warm-up. It does nothing
+ *  if the library is built without --enable-lockstats.
+ */
+void qlockstats_reset(void) {
+    _q_mutex_reset();
+}
+
+/**
+ * Route memory allocation of qlibc to given allocator.
+ *
+ * @param allocator allocator functions, or NULL to go back to malloc() and
+ *                  free() of libc. It's copied, so it doesn't need to stay
+ *                  valid after the call.
+ *
+ * @return true if successful, otherwise returns false
+ * @retval errno will be set in error condition.
+ *  - EINVAL : malloc, realloc or free of the allocator is NULL.
+ *
+ * @code
+ *  static void *arena_malloc(void *arg, size_t size) {
+ *      return mallocx(size, MALLOCX_ARENA(*(unsigned *)arg));
+ *  }
+ *  (...realloc, free and usable_size the same way...)
+ *
+ *  qlibc_allocator_t allocator = {
+ *      arena_malloc, arena_realloc, arena_free, arena_usable_size, &arena
+ *  };
+ *  qlibc_set_allocator(&allocator);
+ * @endcode
+ *
+ * @note
+ *  Call it once at start-up, before any other qlibc call and before other
+ *  threads start. Memory must go back to the allocator which made it, so
+ *  once it's set, strings and buffers which qlibc returns to the caller,
+ *  like the ones from qstrdupf() or qfile_load(), must be released with
+ *  qlibc_free() instead of free(). free() of the allocator is given the
+ *  size of the memory when qlibc knows it, 0 otherwise, so a size class
+ *  allocator can skip the lookup. Error messages returned by qaconf
+ *  callbacks are still released with free().
+ */
+bool qlibc_set_allocator(const qlibc_allocator_t *allocator) {
+    if (allocator == NULL) {
+        __atomic_store_n(&_allocator, NULL, __ATOMIC_RELEASE);
+        return true;
+    }
+    if (allocator->malloc == NULL || allocator->realloc == NULL
+            || allocator->free == NULL) {
+        errno = EINVAL;
+        return false;
+    }
+
+    _allocator_storage = *allocator;
+    __atomic_store_n(&_allocator, &_allocator_storage, __ATOMIC_RELEASE);
+    return true;
+}
+
+/**
+ * Allocate memory with the qlibc allocator.
+ *
+ * @param size      size to allocate
+ *
+ * @return a pointer of allocated memory if successful, otherwise returns NULL
+ */
+void *qlibc_malloc(size_t size) {
+    const qlibc_allocator_t *a = __atomic_load_n(&_allocator, __ATOMIC_ACQUIRE);
+    if (a == NULL)
+        return malloc(size);
+    return a->malloc(a->arg, size);
+}
+
+/**
+ * Allocate zero-filled memory of nmemb * size bytes with the qlibc
+ * allocator.
+ *
+ * @param nmemb     number of elements
+ * @param size      size of an element
+ *
+ * @return a pointer of allocated memory if successful, otherwise returns NULL
+ * @retval errno will be set in error condition.
+ *  - ENOMEM : nmemb * size overflows.
+ */
+void *qlibc_calloc(size_t nmemb, size_t size) {
+    const qlibc_allocator_t *a = __atomic_load_n(&_allocator, __ATOMIC_ACQUIRE);
+    if (a == NULL)
+        return calloc(nmemb, size);
+
+    if (size > 0 && nmemb > ((size_t) -1) / size) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    void *ptr = a->malloc(a->arg, nmemb * size);
+    if (ptr != NULL)
+        memset(ptr, 0, nmemb * size);
+    return ptr;
+}
+
+/**
+ * Resize memory made by the qlibc allocator.
+ *
+ * @param ptr       memory to resize, or NULL to allocate new one
+ * @param size      new size
+ *
+ * @return a pointer of resized memory if successful, otherwise returns NULL
+ *         and ptr is left as it was.
+ */
+void *qlibc_realloc(void *ptr, size_t size) {
+    const qlibc_allocator_t *a = __atomic_load_n(&_allocator, __ATOMIC_ACQUIRE);
+    if (a == NULL)
+        return realloc(ptr, size);
+    return a->realloc(a->arg, ptr, size);
+}
+
+/**
+ * Duplicate a string with the qlibc allocator.
+ *
+ * @param str       string to copy
+ *
+ * @return a pointer of the copy if successful, otherwise returns NULL
+ */
+char *qlibc_strdup(const char *str) {
+    size_t size = strlen(str) + 1;
+    char *copy = (char *) qlibc_malloc(size);
+    if (copy != NULL)
+        memcpy(copy, str, size);
+    return copy;
+}
+
+/**
+ * Release memory made by the qlibc allocator.
+ *
+ * @param ptr       memory to release, NULL is ignored
+ */
+void qlibc_free(void *ptr) {
+    qlibc_free_sized(ptr, 0);
+}
+
+/**
+ * Release memory made by the qlibc allocator, telling its size.
+ *
+ * @param ptr       memory to release, NULL is ignored
+ * @param size      size which the memory was allocated or last resized
+ *                  with, or its usable size. 0 if it isn't known
+ */
+void qlibc_free_sized(void *ptr, size_t size) {
+    if (ptr == NULL)
+        return;
+    const qlibc_allocator_t *a = __atomic_load_n(&_allocator, __ATOMIC_ACQUIRE);
+    if (a == NULL) {
+        free(ptr);
+        return;
+    }
+    a->free(a->arg, ptr, size);
+}
+
+/**
+ * Get the real size of memory made by the qlibc allocator.
+ *
+ * Allocators round sizes up to a size class, so a growing buffer can use
+ * the slack before it reallocates.
+ *
+ * @param ptr       memory made by the qlibc allocator
+ *
+ * @return usable size of the memory, which is at least the requested size,
+ *         or 0 if the allocator can't tell it.
+ */
+size_t qlibc_usable_size(void *ptr) {
+    if (ptr == NULL)
+        return 0;
+    const qlibc_allocator_t *a = __atomic_load_n(&_allocator, __ATOMIC_ACQUIRE);
+    if (a == NULL)
+        return _LIBC_USABLE_SIZE(ptr);
+    if (a->usable_size == NULL)
+        return 0;
+    return a->usable_size(a->arg, ptr);
+}
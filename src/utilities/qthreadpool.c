@@ -0,0 +1,727 @@
+/******************************************************************************
+ * qLibc
+ *
+ * Copyright (c) 2010-2014 Seungyoung Kim.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *****************************************************************************/
+
+/**
+ * @file qthreadpool.c Thread pool with work stealing.
+ *
+ * Each worker thread has its own double-ended task queue. Tasks submitted by
+ * a worker go to the bottom of its own queue and the worker takes them back
+ * from the bottom, so nested tasks run hot in cache in LIFO order. Tasks
+ * submitted from outside are spread over the workers round-robin. A worker
+ * with an empty queue steals from the top of the others. Threads waiting
+ * for a future or a parallel_for() run queued tasks meanwhile instead of
+ * sleeping, so tasks can wait for other tasks without starving the pool.
+ *
+ * @code
+ *  [Conceptional Data Structure Diagram]
+ *
+ *              steal                         push/pop
+ *  worker 0  <====   [ T1 ][ T2 ][ T3 ]  <====> (own tasks)
+ *  worker 1  <====   [ T4 ]              <====>
+ *  worker 2  <====   (empty, steals T1)
+ * @endcode
+ *
+ * @code
+ *  static void *hash_file(void *arg) {
+ *      unsigned char *digest = malloc(16);
+ *      qhashtree_file((char *) arg, 0, 0, 0, 1, digest);
+ *      return digest;
+ *  }
+ *
+ *  // create a pool with a worker per CPU.
+ *  qthreadpool_t *pool = qthreadpool(0);
+ *
+ *  // run a task and get its result later.
+ *  qthreadpool_future_t *future = pool->async(pool, hash_file, "/tmp/a");
+ *  ...
+ *  unsigned char *digest = pool->get(pool, future);
+ *
+ *  // split a range over the workers.
+ *  pool->parallel_for(pool, 0, nitems, 0, process_items, items);
+ *
+ *  // wait for all tasks and free the pool.
+ *  pool->free(pool);
+ * @endcode
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include "qinternal.h"
+#include "utilities/qthreadpool.h"
+
+#ifndef _DOXYGEN_SKIP
+
+#define TASKQ_INITSIZE      (64)    /*!< initial slots of a task queue */
+#define PFOR_CHUNKS         (4)     /*!< parallel_for() chunks per worker */
+
+struct _task_s {
+    void *(*func)(void *arg);
+    void *arg;
+    qthreadpool_future_t *future;   /*!< NULL for submit() */
+};
+
+struct qthreadpool_worker_s {
+    qthreadpool_t *pool;
+    pthread_t thread;
+    pthread_mutex_t lock;   /*!< guards the task queue */
+    struct _task_s *tasks;  /*!< ring of tasks, power of 2 slots */
+    size_t slots;
+    size_t top;             /*!< stolen from here */
+    size_t bottom;          /*!< pushed and popped by the owner here */
+};
+
+struct qthreadpool_future_s {
+    bool done;
+    void *result;
+};
+
+struct _pfor_s {
+    size_t next;            /*!< begin of the next chunk */
+    size_t end;
+    size_t grain;
+    void (*func)(void *arg, size_t begin, size_t end);
+    void *arg;
+    size_t active;          /*!< helper tasks not returned yet */
+};
+
+/* the worker running on this thread, NULL on other threads. */
+static __thread struct qthreadpool_worker_s *_self = NULL;
+
+static pthread_once_t _shared_once = PTHREAD_ONCE_INIT;
+static qthreadpool_t *_shared = NULL;
+
+static bool submit(qthreadpool_t *pool, void *(*func)(void *arg), void *arg);
+static qthreadpool_future_t *async(qthreadpool_t *pool,
+                                   void *(*func)(void *arg), void *arg);
+static bool done(qthreadpool_t *pool, qthreadpool_future_t *future);
+static void *get(qthreadpool_t *pool, qthreadpool_future_t *future);
+static bool parallel_for(qthreadpool_t *pool, size_t begin, size_t end,
+                         size_t grain,
+                         void (*func)(void *arg, size_t begin, size_t end),
+                         void *arg);
+static bool wait_(qthreadpool_t *pool);
+static size_t size(qthreadpool_t *pool);
+static size_t pending(qthreadpool_t *pool);
+static void free_(qthreadpool_t *pool);
+
+static void _shared_init(void);
+static void *_worker_main(void *arg);
+static bool _enqueue(qthreadpool_t *pool, struct _task_s *task);
+static bool _push(struct qthreadpool_worker_s *w, struct _task_s *task);
+static bool _pop(struct qthreadpool_worker_s *w, struct _task_s *task);
+static bool _steal(struct qthreadpool_worker_s *w, struct _task_s *task);
+static bool _find(qthreadpool_t *pool, struct _task_s *task);
+static void _run(qthreadpool_t *pool, struct _task_s *task);
+static void _help_until(qthreadpool_t *pool, bool (*cond)(void *ctx),
+                        void *ctx);
+static bool _future_done(void *ctx);
+static bool _pfor_done(void *ctx);
+static bool _pool_idle(void *ctx);
+static void _pfor_loop(struct _pfor_s *pf);
+static void *_pfor_task(void *arg);
+static struct qthreadpool_worker_s *_current(qthreadpool_t *pool);
+static void _shutdown(qthreadpool_t *pool, int nstarted);
+
+#endif
+
+/**
+ * Create a thread pool.
+ *
+ * @param nthreads  number of worker threads. 0 for the number of CPUs.
+ *
+ * @return a pointer of malloced qthreadpool_t structure in case of
+ *         successful, otherwise returns NULL.
+ * @retval errno will be set in error condition.
+ *  - ENOMEM    : Memory allocation failure.
+ *  - EAGAIN    : Worker threads can't be created.
+ *
+ * @code
+ *   qthreadpool_t *pool = qthreadpool(0);
+ * @endcode
+ */
+qthreadpool_t *qthreadpool(int nthreads) {
+    if (nthreads <= 0)
+        nthreads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    if (nthreads <= 0)
+        nthreads = 1;
+
+    qthreadpool_t *pool = (qthreadpool_t *) qlibc_calloc(1, sizeof(qthreadpool_t));
+    if (pool == NULL) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    pool->workers = (struct qthreadpool_worker_s *) qlibc_calloc(
+            nthreads, sizeof(struct qthreadpool_worker_s));
+    if (pool->workers == NULL) {
+        qlibc_free(pool);
+        errno = ENOMEM;
+        return NULL;
+    }
+    pool->nworkers = nthreads;
+    pthread_mutex_init(&pool->sleeplock, NULL);
+    pthread_cond_init(&pool->sleepcond, NULL);
+    pthread_cond_init(&pool->donecond, NULL);
+
+    int i;
+    for (i = 0; i < nthreads; i++) {
+        struct qthreadpool_worker_s *w = &pool->workers[i];
+        w->pool = pool;
+        w->slots = TASKQ_INITSIZE;
+        w->tasks = (struct _task_s *) qlibc_malloc(
+                sizeof(struct _task_s) * w->slots);
+        pthread_mutex_init(&w->lock, NULL);
+        if (w->tasks == NULL) {
+            _shutdown(pool, 0);
+            errno = ENOMEM;
+            return NULL;
+        }
+    }
+
+    // all queues must exist before a worker starts to steal.
+    for (i = 0; i < nthreads; i++) {
+        if (pthread_create(&pool->workers[i].thread, NULL, _worker_main,
+                           &pool->workers[i]) != 0) {
+            _shutdown(pool, i);
+            errno = EAGAIN;
+            return NULL;
+        }
+    }
+
+    // member methods
+    pool->submit = submit;
+    pool->async = async;
+    pool->done = done;
+    pool->get = get;
+    pool->parallel_for = parallel_for;
+    pool->wait = wait_;
+    pool->size = size;
+    pool->pending = pending;
+    pool->free = free_;
+
+    return pool;
+}
+
+/**
+ * Get the process-wide shared thread pool.
+ *
+ * The pool has a worker per CPU and is created on the first call. Library
+ * functions running tasks in parallel use it, so an application sharing it
+ * too doesn't end up with a thread per CPU for every user.
+ *
+ * @return a pointer of the shared qthreadpool_t, or NULL if it can't be
+ *         created.
+ *
+ * @note
+ *  free() on the shared pool does nothing.
+ */
+qthreadpool_t *qthreadpool_shared(void) {
+    pthread_once(&_shared_once, _shared_init);
+    if (_shared == NULL)
+        errno = EAGAIN;
+    return _shared;
+}
+
+/**
+ * qthreadpool->submit(): Run a task without a result.
+ *
+ * @param pool      qthreadpool_t container pointer.
+ * @param func      task function. Its return value is ignored.
+ * @param arg       argument passed to the task function.
+ *
+ * @return true if successful, otherwise returns false.
+ * @retval errno will be set in error condition.
+ *  - EINVAL    : Invalid argument.
+ *  - ENOMEM    : Memory allocation failure.
+ *
+ * @note
+ *  A task submitted by a task of the same pool runs on the same worker
+ *  unless another idle worker steals it.
+ */
+static bool submit(qthreadpool_t *pool, void *(*func)(void *arg), void *arg) {
+    if (func == NULL) {
+        errno = EINVAL;
+        return false;
+    }
+
+    struct _task_s task = { func, arg, NULL };
+    return _enqueue(pool, &task);
+}
+
+/**
+ * qthreadpool->async(): Run a task and get a future of its result.
+ *
+ * @param pool      qthreadpool_t container pointer.
+ * @param func      task function.
+ * @param arg       argument passed to the task function.
+ *
+ * @return a future to pass to get(), otherwise returns NULL.
+ * @retval errno will be set in error condition.
+ *  - EINVAL    : Invalid argument.
+ *  - ENOMEM    : Memory allocation failure.
+ *
+ * @note
+ *  The future must be passed to get() once, which frees it.
+ */
+static qthreadpool_future_t *async(qthreadpool_t *pool,
+                                   void *(*func)(void *arg), void *arg) {
+    if (func == NULL) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    qthreadpool_future_t *future = (qthreadpool_future_t *) qlibc_calloc(
+            1, sizeof(qthreadpool_future_t));
+    if (future == NULL) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    struct _task_s task = { func, arg, future };
+    if (_enqueue(pool, &task) == false) {
+        qlibc_free(future);
+        return NULL;
+    }
+    return future;
+}
+
+/**
+ * qthreadpool->done(): Check whether the task of a future has completed.
+ *
+ * @param pool      qthreadpool_t container pointer.
+ * @param future    future returned by async().
+ *
+ * @return true if the result is ready, otherwise returns false.
+ */
+static bool done(qthreadpool_t *pool, qthreadpool_future_t *future) {
+    return __atomic_load_n(&future->done, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * qthreadpool->get(): Wait for the task of a future and get the result.
+ *
+ * @param pool      qthreadpool_t container pointer.
+ * @param future    future returned by async().
+ *
+ * @return the value returned by the task function.
+ *
+ * @note
+ *  The calling thread runs queued tasks while it waits, so it's safe to
+ *  call from a task of the same pool. The future is freed.
+ */
+static void *get(qthreadpool_t *pool, qthreadpool_future_t *future) {
+    _help_until(pool, _future_done, future);
+    void *result = future->result;
+    qlibc_free(future);
+    return result;
+}
+
+/**
+ * qthreadpool->parallel_for(): Run a function over a range in parallel.
+ *
+ * The range is split into chunks of grain items, and the calling thread and
+ * worker threads take chunks until none is left. It returns when all chunks
+ * have been processed.
+ *
+ * @param pool      qthreadpool_t container pointer.
+ * @param begin     first index of the range.
+ * @param end       index after the last of the range.
+ * @param grain     number of indexes in a chunk. 0 to split the range into
+ *                  a few chunks per worker.
+ * @param func      function called with arg and the range of a chunk.
+ * @param arg       argument passed to the function.
+ *
+ * @return true if successful, otherwise returns false.
+ * @retval errno will be set in error condition.
+ *  - EINVAL    : Invalid argument.
+ *
+ * @code
+ *   static void add(void *arg, size_t begin, size_t end) {
+ *       int *v = (int *) arg;
+ *       size_t i;
+ *       for (i = begin; i < end; i++) v[i] += 1;
+ *   }
+ *
+ *   pool->parallel_for(pool, 0, 1000000, 0, add, v);
+ * @endcode
+ *
+ * @note
+ *  When workers are busy, the calling thread processes all chunks by
+ *  itself, so nested parallel_for() calls can't deadlock.
+ */
+static bool parallel_for(qthreadpool_t *pool, size_t begin, size_t end,
+                         size_t grain,
+                         void (*func)(void *arg, size_t begin, size_t end),
+                         void *arg) {
+    if (func == NULL) {
+        errno = EINVAL;
+        return false;
+    }
+    if (begin >= end)
+        return true;
+
+    size_t range = end - begin;
+    if (grain == 0) {
+        size_t nchunks = (size_t) pool->nworkers * PFOR_CHUNKS;
+        grain = (range + nchunks - 1) / nchunks;
+    }
+    size_t nchunks = (range / grain) + ((range % grain) ? 1 : 0);
+
+    struct _pfor_s pf;
+    pf.next = begin;
+    pf.end = end;
+    pf.grain = grain;
+    pf.func = func;
+    pf.arg = arg;
+
+    // the calling thread takes chunks too.
+    size_t nhelpers = nchunks - 1;
+    if (nhelpers > (size_t) pool->nworkers)
+        nhelpers = (size_t) pool->nworkers;
+    pf.active = nhelpers;
+
+    size_t i;
+    for (i = 0; i < nhelpers; i++) {
+        struct _task_s task = { _pfor_task, &pf, NULL };
+        if (_enqueue(pool, &task) == false) {
+            __atomic_sub_fetch(&pf.active, nhelpers - i, __ATOMIC_SEQ_CST);
+            break;
+        }
+    }
+
+    _pfor_loop(&pf);
+    _help_until(pool, _pfor_done, &pf);
+
+    return true;
+}
+
+/**
+ * qthreadpool->wait(): Wait until all submitted tasks have completed.
+ *
+ * @param pool      qthreadpool_t container pointer.
+ *
+ * @return true if successful, otherwise returns false.
+ * @retval errno will be set in error condition.
+ *  - EDEADLK   : Called from a task of the pool.
+ */
+static bool wait_(qthreadpool_t *pool) {
+    if (_current(pool) != NULL) {
+        errno = EDEADLK;
+        return false;
+    }
+
+    _help_until(pool, _pool_idle, pool);
+    return true;
+}
+
+/**
+ * qthreadpool->size(): Get the number of worker threads.
+ *
+ * @param pool      qthreadpool_t container pointer.
+ *
+ * @return the number of worker threads.
+ */
+static size_t size(qthreadpool_t *pool) {
+    return pool->nworkers;
+}
+
+/**
+ * qthreadpool->pending(): Get the number of tasks not completed yet.
+ *
+ * @param pool      qthreadpool_t container pointer.
+ *
+ * @return the number of queued and running tasks.
+ */
+static size_t pending(qthreadpool_t *pool) {
+    return __atomic_load_n(&pool->unfinished, __ATOMIC_RELAXED);
+}
+
+/**
+ * qthreadpool->free(): Wait for all tasks and free the pool.
+ *
+ * @param pool      qthreadpool_t container pointer.
+ *
+ * @note
+ *  It must not be called from a task of the pool. Futures not passed to
+ *  get() are leaked.
+ */
+static void free_(qthreadpool_t *pool) {
+    if (pool->shared == true || wait_(pool) == false)
+        return;
+
+    _shutdown(pool, pool->nworkers);
+}
+
+#ifndef _DOXYGEN_SKIP
+
+static void _shared_init(void) {
+    _shared = qthreadpool(0);
+    if (_shared != NULL)
+        _shared->shared = true;
+}
+
+static void *_worker_main(void *arg) {
+    struct qthreadpool_worker_s *w = (struct qthreadpool_worker_s *) arg;
+    qthreadpool_t *pool = w->pool;
+    _self = w;
+
+    struct _task_s task;
+    while (true) {
+        if (_find(pool, &task) == true) {
+            _run(pool, &task);
+            continue;
+        }
+
+        // announce sleeping before checking the queues, so a submitter
+        // either sees a sleeper to signal or we see its task.
+        pthread_mutex_lock(&pool->sleeplock);
+        __atomic_add_fetch(&pool->sleepers, 1, __ATOMIC_SEQ_CST);
+        while (pool->stop == false
+               && __atomic_load_n(&pool->queued, __ATOMIC_SEQ_CST) == 0) {
+            pthread_cond_wait(&pool->sleepcond, &pool->sleeplock);
+        }
+        __atomic_sub_fetch(&pool->sleepers, 1, __ATOMIC_SEQ_CST);
+        bool stop = pool->stop;
+        pthread_mutex_unlock(&pool->sleeplock);
+        if (stop == true)
+            break;
+    }
+
+    return NULL;
+}
+
+static bool _enqueue(qthreadpool_t *pool, struct _task_s *task) {
+    struct qthreadpool_worker_s *w = _current(pool);
+    if (w == NULL) {
+        size_t idx = __atomic_fetch_add(&pool->next, 1, __ATOMIC_RELAXED);
+        w = &pool->workers[idx % pool->nworkers];
+    }
+
+    __atomic_add_fetch(&pool->unfinished, 1, __ATOMIC_SEQ_CST);
+    if (_push(w, task) == false) {
+        __atomic_sub_fetch(&pool->unfinished, 1, __ATOMIC_SEQ_CST);
+        errno = ENOMEM;
+        return false;
+    }
+    __atomic_add_fetch(&pool->queued, 1, __ATOMIC_SEQ_CST);
+
+    // wake up a sleeping worker and the threads helping in get().
+    if (__atomic_load_n(&pool->sleepers, __ATOMIC_SEQ_CST) > 0
+        || __atomic_load_n(&pool->waiters, __ATOMIC_SEQ_CST) > 0) {
+        pthread_mutex_lock(&pool->sleeplock);
+        pthread_cond_signal(&pool->sleepcond);
+        if (pool->waiters > 0)
+            pthread_cond_broadcast(&pool->donecond);
+        pthread_mutex_unlock(&pool->sleeplock);
+    }
+
+    return true;
+}
+
+static bool _push(struct qthreadpool_worker_s *w, struct _task_s *task) {
+    pthread_mutex_lock(&w->lock);
+    if (w->bottom - w->top == w->slots) {
+        struct _task_s *tasks = (struct _task_s *) qlibc_malloc(
+                sizeof(struct _task_s) * w->slots * 2);
+        if (tasks == NULL) {
+            pthread_mutex_unlock(&w->lock);
+            return false;
+        }
+        size_t i;
+        for (i = 0; i < w->slots; i++) {
+            tasks[i] = w->tasks[(w->top + i) & (w->slots - 1)];
+        }
+        qlibc_free(w->tasks);
+        w->tasks = tasks;
+        w->top = 0;
+        w->bottom = w->slots;
+        w->slots *= 2;
+    }
+    w->tasks[w->bottom & (w->slots - 1)] = *task;
+    w->bottom++;
+    pthread_mutex_unlock(&w->lock);
+    return true;
+}
+
+static bool _pop(struct qthreadpool_worker_s *w, struct _task_s *task) {
+    pthread_mutex_lock(&w->lock);
+    if (w->bottom == w->top) {
+        pthread_mutex_unlock(&w->lock);
+        return false;
+    }
+    w->bottom--;
+    *task = w->tasks[w->bottom & (w->slots - 1)];
+    pthread_mutex_unlock(&w->lock);
+    return true;
+}
+
+static bool _steal(struct qthreadpool_worker_s *w, struct _task_s *task) {
+    pthread_mutex_lock(&w->lock);
+    if (w->bottom == w->top) {
+        pthread_mutex_unlock(&w->lock);
+        return false;
+    }
+    *task = w->tasks[w->top & (w->slots - 1)];
+    w->top++;
+    pthread_mutex_unlock(&w->lock);
+    return true;
+}
+
+// take a task from the own queue, otherwise steal one from the others.
+static bool _find(qthreadpool_t *pool, struct _task_s *task) {
+    if (__atomic_load_n(&pool->queued, __ATOMIC_SEQ_CST) == 0)
+        return false;
+
+    struct qthreadpool_worker_s *self = _current(pool);
+    size_t start = 0;
+    if (self != NULL) {
+        if (_pop(self, task) == true)
+            goto found;
+        start = (size_t) (self - pool->workers) + 1;
+    }
+
+    int i;
+    for (i = 0; i < pool->nworkers; i++) {
+        struct qthreadpool_worker_s *w;
+        w = &pool->workers[(start + i) % pool->nworkers];
+        if (w != self && _steal(w, task) == true)
+            goto found;
+    }
+    return false;
+
+found:
+    __atomic_sub_fetch(&pool->queued, 1, __ATOMIC_SEQ_CST);
+    return true;
+}
+
+static void _run(qthreadpool_t *pool, struct _task_s *task) {
+    void *result = task->func(task->arg);
+    if (task->future != NULL) {
+        task->future->result = result;
+        __atomic_store_n(&task->future->done, true, __ATOMIC_SEQ_CST);
+    }
+    __atomic_sub_fetch(&pool->unfinished, 1, __ATOMIC_SEQ_CST);
+
+    if (__atomic_load_n(&pool->waiters, __ATOMIC_SEQ_CST) > 0) {
+        pthread_mutex_lock(&pool->sleeplock);
+        pthread_cond_broadcast(&pool->donecond);
+        pthread_mutex_unlock(&pool->sleeplock);
+    }
+}
+
+// run queued tasks until the condition is met, sleep if there's none.
+static void _help_until(qthreadpool_t *pool, bool (*cond)(void *ctx),
+                        void *ctx) {
+    struct _task_s task;
+    while (cond(ctx) == false) {
+        if (_find(pool, &task) == true) {
+            _run(pool, &task);
+            continue;
+        }
+
+        pthread_mutex_lock(&pool->sleeplock);
+        __atomic_add_fetch(&pool->waiters, 1, __ATOMIC_SEQ_CST);
+        while (cond(ctx) == false
+               && __atomic_load_n(&pool->queued, __ATOMIC_SEQ_CST) == 0) {
+            pthread_cond_wait(&pool->donecond, &pool->sleeplock);
+        }
+        __atomic_sub_fetch(&pool->waiters, 1, __ATOMIC_SEQ_CST);
+        pthread_mutex_unlock(&pool->sleeplock);
+    }
+}
+
+static bool _future_done(void *ctx) {
+    qthreadpool_future_t *future = (qthreadpool_future_t *) ctx;
+    return __atomic_load_n(&future->done, __ATOMIC_SEQ_CST);
+}
+
+static bool _pfor_done(void *ctx) {
+    struct _pfor_s *pf = (struct _pfor_s *) ctx;
+    return (__atomic_load_n(&pf->active, __ATOMIC_SEQ_CST) == 0);
+}
+
+static bool _pool_idle(void *ctx) {
+    qthreadpool_t *pool = (qthreadpool_t *) ctx;
+    return (__atomic_load_n(&pool->unfinished, __ATOMIC_SEQ_CST) == 0);
+}
+
+static void _pfor_loop(struct _pfor_s *pf) {
+    while (true) {
+        size_t begin = __atomic_fetch_add(&pf->next, pf->grain,
+                                          __ATOMIC_RELAXED);
+        if (begin >= pf->end)
+            break;
+        size_t end = begin + pf->grain;
+        if (end > pf->end || end < begin)
+            end = pf->end;
+        pf->func(pf->arg, begin, end);
+    }
+}
+
+// the caller waits on pf->active, so pf must not be touched after that.
+static void *_pfor_task(void *arg) {
+    struct _pfor_s *pf = (struct _pfor_s *) arg;
+    _pfor_loop(pf);
+    __atomic_sub_fetch(&pf->active, 1, __ATOMIC_SEQ_CST);
+    return NULL;
+}
+
+static struct qthreadpool_worker_s *_current(qthreadpool_t *pool) {
+    return (_self != NULL && _self->pool == pool) ? _self : NULL;
+}
+
+// stop and join started workers, and free everything.
+static void _shutdown(qthreadpool_t *pool, int nstarted) {
+    int i;
+    if (nstarted > 0) {
+        pthread_mutex_lock(&pool->sleeplock);
+        pool->stop = true;
+        pthread_cond_broadcast(&pool->sleepcond);
+        pthread_mutex_unlock(&pool->sleeplock);
+    }
+    for (i = 0; i < nstarted; i++) {
+        pthread_join(pool->workers[i].thread, NULL);
+    }
+    for (i = 0; i < pool->nworkers; i++) {
+        if (pool->workers[i].tasks == NULL)
+            continue;
+        qlibc_free(pool->workers[i].tasks);
+        pthread_mutex_destroy(&pool->workers[i].lock);
+    }
+    pthread_cond_destroy(&pool->donecond);
+    pthread_cond_destroy(&pool->sleepcond);
+    pthread_mutex_destroy(&pool->sleeplock);
+    qlibc_free(pool->workers);
+    qlibc_free(pool);
+}
+
+#endif /* _DOXYGEN_SKIP */
@@ -34,10 +34,17 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <string.h>
+#include <errno.h>
 #include <time.h>
+#include <pthread.h>
+#include <unistd.h>
 #include "qinternal.h"
 #include "utilities/qtime.h"
 
+#ifndef _DOXYGEN_SKIP
+static time_t _parse_httpstr(const char *s);
+#endif
+
 /**
  * Returns the current time in milliseconds.
  *
@@ -50,6 +57,151 @@ long qtime_current_milli(void) {
     return time;
 }
 
+/**
+ * Returns the monotonic time in nanoseconds.
+ *
+ * The monotonic clock isn't affected by changes of the system time, so it's
+ * the one to use for measuring intervals and timeouts. The starting point
+ * is unspecified, only the difference between two values is meaningful.
+ *
+ * @return monotonic time in nanoseconds.
+ */
+int64_t qtime_monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**
+ * Returns the coarse monotonic time in milliseconds.
+ *
+ * The coarse clock is read from the kernel's last tick without touching the
+ * clock source, so it's the cheapest clock but only as precise as the tick
+ * rate, typically 1 to 4 milliseconds. Where it's not available, it falls
+ * back to the regular monotonic clock.
+ *
+ * @return coarse monotonic time in milliseconds.
+ */
+long qtime_monotonic_coarse_ms(void) {
+    struct timespec ts;
+#ifdef CLOCK_MONOTONIC_COARSE
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+#else
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+#endif
+    return (ts.tv_sec * 1000) + (ts.tv_nsec / 1000000);
+}
+
+#ifndef _DOXYGEN_SKIP
+static pthread_mutex_t _cached_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t _cached_thread;
+static int _cached_refs = 0;
+static int _cached_interval = 0;
+static bool _cached_running = false;
+static long _cached_ms = 0;
+static time_t _cached_time = 0;
+
+static void *_cached_ticker(void *arg) {
+    while (__atomic_load_n(&_cached_running, __ATOMIC_ACQUIRE) == true) {
+        __atomic_store_n(&_cached_ms, qtime_monotonic_coarse_ms(),
+                         __ATOMIC_RELEASE);
+        __atomic_store_n(&_cached_time, time(NULL), __ATOMIC_RELEASE);
+        usleep(_cached_interval * 1000);
+    }
+    return NULL;
+}
+#endif
+
+/**
+ * Start the background clock which serves qtime_cached_ms() and
+ * qtime_cached_time().
+ *
+ * A thread updates the cached values every given interval, so reading the
+ * time costs a single memory load. Calls are reference counted, every
+ * qtime_cached_start() needs a matching qtime_cached_stop(). When it's
+ * already running, the interval of the first call is kept.
+ *
+ * @param intervalms    update interval in milliseconds.
+ *
+ * @return true if successful, otherwise false.
+ * @retval errno will be set in error condition.
+ *  - EINVAL : Invalid argument.
+ *  - EAGAIN : Failed to create the thread.
+ *
+ * @code
+ *   qtime_cached_start(1);
+ *   long now = qtime_cached_ms();
+ *   (...)
+ *   qtime_cached_stop();
+ * @endcode
+ */
+bool qtime_cached_start(int intervalms) {
+    if (intervalms <= 0) {
+        errno = EINVAL;
+        return false;
+    }
+
+    pthread_mutex_lock(&_cached_lock);
+    if (_cached_refs == 0) {
+        _cached_interval = intervalms;
+        _cached_ms = qtime_monotonic_coarse_ms();
+        _cached_time = time(NULL);
+        __atomic_store_n(&_cached_running, true, __ATOMIC_RELEASE);
+        if (pthread_create(&_cached_thread, NULL, _cached_ticker, NULL)) {
+            __atomic_store_n(&_cached_running, false, __ATOMIC_RELEASE);
+            pthread_mutex_unlock(&_cached_lock);
+            errno = EAGAIN;
+            return false;
+        }
+    }
+    _cached_refs++;
+    pthread_mutex_unlock(&_cached_lock);
+
+    return true;
+}
+
+/**
+ * Release the background clock. The thread stops when the last user
+ * releases it.
+ */
+void qtime_cached_stop(void) {
+    pthread_mutex_lock(&_cached_lock);
+    if (_cached_refs > 0 && --_cached_refs == 0) {
+        __atomic_store_n(&_cached_running, false, __ATOMIC_RELEASE);
+        pthread_join(_cached_thread, NULL);
+    }
+    pthread_mutex_unlock(&_cached_lock);
+}
+
+/**
+ * Returns the cached monotonic time in milliseconds.
+ *
+ * While the background clock is running, it's the last value stored by the
+ * thread, lagging behind at most the update interval. Otherwise it reads
+ * qtime_monotonic_coarse_ms(), so it can always be called.
+ *
+ * @return monotonic time in milliseconds.
+ */
+long qtime_cached_ms(void) {
+    if (__atomic_load_n(&_cached_running, __ATOMIC_ACQUIRE) == true)
+        return __atomic_load_n(&_cached_ms, __ATOMIC_ACQUIRE);
+    return qtime_monotonic_coarse_ms();
+}
+
+/**
+ * Returns the cached wall clock time in seconds, same as time(NULL).
+ *
+ * While the background clock is running, it's the last value stored by the
+ * thread. Otherwise it calls time().
+ *
+ * @return current time in seconds.
+ */
+time_t qtime_cached_time(void) {
+    if (__atomic_load_n(&_cached_running, __ATOMIC_ACQUIRE) == true)
+        return __atomic_load_n(&_cached_time, __ATOMIC_ACQUIRE);
+    return time(NULL);
+}
+
 /**
  * Get custom formmatted local time string.
  *
@@ -99,7 +251,7 @@ char *qtime_localtime_strf(char *buf, int size, time_t utctime,
  */
 char *qtime_localtime_str(time_t utctime) {
     int size = sizeof(char) * (CONST_STRLEN("00-Jan-0000 00:00:00 +0000") + 1);
-    char *timestr = (char *) malloc(size);
+    char *timestr = (char *) qlibc_malloc(size);
     qtime_localtime_strf(timestr, size, utctime, "%d-%b-%Y %H:%M:%S %z");
     return timestr;
 }
@@ -166,10 +318,10 @@ char *qtime_gmt_strf(char *buf, int size, time_t utctime, const char *format) {
  * @endcode
  */
 char *qtime_gmt_str(time_t utctime) {
-    int size = sizeof(char)
-            * (CONST_STRLEN("Mon, 00 Jan 0000 00:00:00 GMT") + 1);
-    char *timestr = (char *) malloc(size);
-    qtime_gmt_strf(timestr, size, utctime, "%a, %d %b %Y %H:%M:%S GMT");
+    char *timestr = (char *) qlibc_malloc(QTIME_HTTPSTR_SIZE);
+    if (timestr == NULL)
+        return NULL;
+    qtime_gmt_httpstr(timestr, utctime);
     return timestr;
 }
 
@@ -186,13 +338,111 @@ char *qtime_gmt_str(time_t utctime) {
  * @endcode
  */
 const char *qtime_gmt_staticstr(time_t utctime) {
-    static char timestr[sizeof(char)
-            * (CONST_STRLEN("Mon, 00-Jan-0000 00:00:00 GMT") + 1)];
-    qtime_gmt_strf(timestr, sizeof(timestr), utctime,
-                   "%a, %d %b %Y %H:%M:%S GMT");
+    static __thread char timestr[QTIME_HTTPSTR_SIZE];
+    qtime_gmt_httpstr(timestr, utctime);
     return timestr;
 }
 
+#ifndef _DOXYGEN_SKIP
+static const char *_wdays[] = { "Sun", "Mon", "Tue", "Wed", "Thu", "Fri",
+        "Sat" };
+static const char *_months[] = { "Jan", "Feb", "Mar", "Apr", "May", "Jun",
+        "Jul", "Aug", "Sep", "Oct", "Nov", "Dec" };
+
+static __thread time_t _httpstr_time = -1;
+static __thread char _httpstr[QTIME_HTTPSTR_SIZE];
+
+static void _put2(char *p, int v) {
+    p[0] = '0' + v / 10;
+    p[1] = '0' + v % 10;
+}
+
+// days since 1970-01-01 to year/month/day, proleptic Gregorian calendar.
+static void _civil_from_days(int64_t days, int *year, int *month, int *day) {
+    days += 719468;
+    int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+    int64_t doe = days - era * 146097;
+    int64_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    int64_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    int64_t mp = (5 * doy + 2) / 153;
+    *day = (int) (doy - (153 * mp + 2) / 5 + 1);
+    *month = (int) (mp < 10 ? mp + 3 : mp - 9);
+    *year = (int) (yoe + era * 400 + (*month <= 2));
+}
+
+// year/month/day to days since 1970-01-01.
+static int64_t _days_from_civil(int year, int month, int day) {
+    year -= (month <= 2);
+    int64_t era = (year >= 0 ? year : year - 399) / 400;
+    int64_t yoe = year - era * 400;
+    int64_t doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    int64_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
+#endif
+
+/**
+ * Write an RFC 1123 date string like 'Sun, 06 Nov 1994 08:49:37 GMT',
+ * the format of HTTP Date, Expires and Last-Modified headers.
+ *
+ * It's formatted without strftime() and the last result is cached per
+ * thread, so calling it repeatedly within the same second is a copy.
+ * It's thread-safe.
+ *
+ * @param buf       buffer of at least QTIME_HTTPSTR_SIZE bytes.
+ * @param utctime   0 for current time, universal time for specific time
+ *
+ * @return length of the string written, not including the terminating NULL.
+ *
+ * @code
+ *   char date[QTIME_HTTPSTR_SIZE];
+ *   qtime_gmt_httpstr(date, 0);
+ * @endcode
+ */
+size_t qtime_gmt_httpstr(char *buf, time_t utctime) {
+    if (utctime == 0)
+        utctime = qtime_cached_time();
+
+    if (utctime != _httpstr_time) {
+        int64_t days = utctime / 86400;
+        int64_t secs = utctime % 86400;
+        if (secs < 0) {
+            secs += 86400;
+            days--;
+        }
+        int year, month, day;
+        _civil_from_days(days, &year, &month, &day);
+        if (year < 0 || year > 9999) {
+            // out of the fixed format, let libc deal with it.
+            qtime_gmt_strf(buf, QTIME_HTTPSTR_SIZE, utctime,
+                           "%a, %d %b %Y %H:%M:%S GMT");
+            return strlen(buf);
+        }
+
+        char *p = _httpstr;
+        memcpy(p, _wdays[((days % 7) + 11) % 7], 3);  // 1970-01-01 is Thu
+        p[3] = ',';
+        p[4] = ' ';
+        _put2(p + 5, day);
+        p[7] = ' ';
+        memcpy(p + 8, _months[month - 1], 3);
+        p[11] = ' ';
+        _put2(p + 12, year / 100);
+        _put2(p + 14, year % 100);
+        p[16] = ' ';
+        _put2(p + 17, (int) (secs / 3600));
+        p[19] = ':';
+        _put2(p + 20, (int) (secs / 60 % 60));
+        p[22] = ':';
+        _put2(p + 23, (int) (secs % 60));
+        memcpy(p + 25, " GMT", 5);
+        _httpstr_time = utctime;
+    }
+
+    memcpy(buf, _httpstr, QTIME_HTTPSTR_SIZE);
+    return QTIME_HTTPSTR_SIZE - 1;
+}
+
 /**
  * This parses GMT/Timezone(+/-) formatted time sting like
  * 'Sun, 04 May 2008 18:50:39 GMT', 'Mon, 05 May 2008 03:50:39 +0900'
@@ -212,10 +462,14 @@ const char *qtime_gmt_staticstr(time_t utctime) {
  * @endcode
  */
 time_t qtime_parse_gmtstr(const char *gmtstr) {
+    time_t utc = _parse_httpstr(gmtstr);
+    if (utc != -2)
+        return utc;
+
     struct tm gmtm;
     if (strptime(gmtstr, "%a, %d %b %Y %H:%M:%S", &gmtm) == NULL)
         return 0;
-    time_t utc = timegm(&gmtm);
+    utc = timegm(&gmtm);
     if (utc < 0)
         return -1;
 
@@ -231,3 +485,60 @@ time_t qtime_parse_gmtstr(const char *gmtstr) {
 
     return utc;
 }
+
+#ifndef _DOXYGEN_SKIP
+static int _get2(const char *p) {
+    if (p[0] < '0' || p[0] > '9' || p[1] < '0' || p[1] > '9')
+        return -1;
+    return (p[0] - '0') * 10 + (p[1] - '0');
+}
+
+/**
+ * Fixed format parser for 'Sun, 06 Nov 1994 08:49:37 GMT' and the same
+ * with '+hhmm'/'-hhmm' in place of GMT. Returns -2 when the string isn't in
+ * that exact form so the caller can fall back to strptime().
+ */
+static time_t _parse_httpstr(const char *s) {
+    if (strlen(s) < 29 || s[3] != ',' || s[4] != ' ' || s[7] != ' '
+            || s[11] != ' ' || s[16] != ' ' || s[19] != ':' || s[22] != ':'
+            || s[25] != ' ')
+        return -2;
+
+    int day = _get2(s + 5);
+    int cent = _get2(s + 12), yy = _get2(s + 14);
+    int hour = _get2(s + 17), min = _get2(s + 20), sec = _get2(s + 23);
+    if (day < 1 || day > 31 || cent < 0 || yy < 0 || hour < 0 || hour > 23
+            || min < 0 || min > 59 || sec < 0 || sec > 60)
+        return -2;
+
+    int month;
+    for (month = 0; month < 12; month++) {
+        if (!memcmp(s + 8, _months[month], 3))
+            break;
+    }
+    if (month == 12)
+        return -2;
+
+    int tzhours = 0;
+    const char *tz = s + 26;
+    if (!strcmp(tz, "GMT") || !strcmp(tz, "UTC")) {
+        tzhours = 0;
+    } else if ((tz[0] == '+' || tz[0] == '-') && _get2(tz + 1) >= 0
+            && _get2(tz + 3) >= 0 && tz[5] == '\0') {
+        tzhours = _get2(tz + 1);
+        if (tz[0] == '-')
+            tzhours = -tzhours;
+    } else {
+        return -2;
+    }
+
+    int64_t days = _days_from_civil(cent * 100 + yy, month + 1, day);
+    time_t utc = (time_t) (days * 86400 + hour * 3600 + min * 60 + sec);
+    if (utc < 0)
+        return -1;
+    utc -= tzhours * 60 * 60;
+    if (utc < 0)
+        return -1;
+    return utc;
+}
+#endif
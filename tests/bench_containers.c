@@ -0,0 +1,543 @@
+/*
+ * Container micro-benchmarks.
+ *
+ * Runs insert, lookup hit/miss, iterate and delete on the keyed containers
+ * and push/get/iterate/pop on the sequences, at sizes from 1e2 up to -n,
+ * with string and binary keys, single- and multi-threaded. Each result is
+ * printed as one JSON object per line.
+ *
+ *   {"container":"qhashtbl","op":"insert","size":1000,"threads":1,
+ *    "key":"str","ns_per_op":85.2,"allocs_per_op":2.00,"peak_rss_kb":3412}
+ *
+ * Allocations are counted by replacing malloc() on glibc, elsewhere
+ * allocs_per_op is -1. Every size runs in its own child process, so
+ * peak_rss_kb is the peak of that run.
+ *
+ * usage: bench_containers [-n maxsize] [-t threads] [-c container]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include "qlibc.h"
+
+/*
+ * allocation counting
+ */
+static __thread uint64_t _allocs = 0;
+static uint64_t _allocs_total = 0;
+
+#ifdef __GLIBC__
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+
+void *malloc(size_t size) {
+    _allocs++;
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size) {
+    _allocs++;
+    return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+    _allocs++;
+    return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr) {
+    __libc_free(ptr);
+}
+#define ALLOC_COUNTED   (true)
+#else
+#define ALLOC_COUNTED   (false)
+#endif
+
+static uint64_t allocs_flush(void) {
+    __atomic_fetch_add(&_allocs_total, _allocs, __ATOMIC_RELAXED);
+    _allocs = 0;
+    return __atomic_load_n(&_allocs_total, __ATOMIC_RELAXED);
+}
+
+/*
+ * keys
+ */
+typedef struct bkey_s {
+    char *name;
+    size_t len;
+} bkey_t;
+
+static bool binkeys = false;
+static bkey_t *keys = NULL;     /* keys inserted */
+static bkey_t *misses = NULL;   /* keys never inserted */
+
+static void make_keys(bkey_t *k, int n, bool bin, uint64_t seed) {
+    int i;
+    for (i = 0; i < n; i++) {
+        if (bin == true) {
+            uint64_t v[2];
+            v[0] = (seed + i) * 0x9E3779B97F4A7C15ULL;
+            v[1] = v[0] ^ (v[0] >> 29) ^ (uint64_t) i;
+            k[i].len = sizeof(v);
+            k[i].name = (char *) malloc(k[i].len);
+            memcpy(k[i].name, v, sizeof(v));
+        } else {
+            char buf[32];
+            k[i].len = snprintf(buf, sizeof(buf), "key:%" PRIu64 ":%d",
+                                seed, i);
+            // not strdup(), which sanitizers intercept around free().
+            k[i].name = (char *) malloc(k[i].len + 1);
+            memcpy(k[i].name, buf, k[i].len + 1);
+        }
+    }
+}
+
+static void free_keys(bkey_t *k, int n) {
+    int i;
+    for (i = 0; i < n; i++) {
+        free(k[i].name);
+    }
+    free(k);
+}
+
+/*
+ * container adapters
+ */
+typedef struct bench_s {
+    const char *name;
+    bool keyed;         /* keyed map, otherwise a sequence */
+    bool binary;        /* takes binary keys */
+    int maxsize;        /* larger sizes are skipped, 0 for no limit */
+
+    void *(*create)(int n, int threads);
+    bool (*put)(void *c, int i);            /* insert or push */
+    bool (*get)(void *c, const bkey_t *k, int i);
+    bool (*del)(void *c, int i);            /* delete or pop */
+    size_t (*iterate)(void *c);
+    void (*destroy)(void *c);
+} bench_t;
+
+static int64_t value = 0x1234;
+
+/* qhashtbl */
+static void *hashtbl_create(int n, int threads) {
+    return qhashtbl(n, (threads > 1) ? QHASHTBL_THREADSAFE : 0);
+}
+static bool hashtbl_put(void *c, int i) {
+    qhashtbl_t *tbl = (qhashtbl_t *) c;
+    if (binkeys == true) {
+        return tbl->puthashed(tbl, keys[i].name, keys[i].len,
+                              tbl->hash(tbl, keys[i].name, keys[i].len),
+                              &value, sizeof(value));
+    }
+    return tbl->put(tbl, keys[i].name, &value, sizeof(value));
+}
+static bool hashtbl_get(void *c, const bkey_t *k, int i) {
+    qhashtbl_t *tbl = (qhashtbl_t *) c;
+    if (binkeys == true) {
+        return tbl->gethashed(tbl, k[i].name, k[i].len,
+                              tbl->hash(tbl, k[i].name, k[i].len), NULL,
+                              false) != NULL;
+    }
+    return tbl->get(tbl, k[i].name, NULL, false) != NULL;
+}
+static bool hashtbl_del(void *c, int i) {
+    qhashtbl_t *tbl = (qhashtbl_t *) c;
+    if (binkeys == true) {
+        return tbl->removehashed(tbl, keys[i].name, keys[i].len,
+                                 tbl->hash(tbl, keys[i].name, keys[i].len));
+    }
+    return tbl->remove(tbl, keys[i].name);
+}
+static size_t hashtbl_iterate(void *c) {
+    qhashtbl_t *tbl = (qhashtbl_t *) c;
+    qhnobj_t obj;
+    size_t n = 0;
+    memset((void *) &obj, 0, sizeof(obj));
+    tbl->lock(tbl);
+    while (tbl->getnext(tbl, &obj, false) == true)
+        n++;
+    tbl->unlock(tbl);
+    return n;
+}
+static void hashtbl_destroy(void *c) {
+    ((qhashtbl_t *) c)->free((qhashtbl_t *) c);
+}
+
+/* qhasharr */
+static void *hasharr_create(int n, int threads) {
+    int max = n + n / 2;
+    size_t memsize = qhasharr_calculate_memsize(max);
+    void *mem = malloc(memsize);
+    return qhasharr_opt(mem, memsize, 0, 0,
+                        (threads > 1) ? QHASHARR_CONCURRENT : 0);
+}
+static bool hasharr_put(void *c, int i) {
+    qhasharr_t *tbl = (qhasharr_t *) c;
+    return tbl->put(tbl, keys[i].name, &value, sizeof(value));
+}
+static bool hasharr_get(void *c, const bkey_t *k, int i) {
+    qhasharr_t *tbl = (qhasharr_t *) c;
+    void *v = tbl->get(tbl, k[i].name, NULL);
+    free(v);
+    return v != NULL;
+}
+static bool hasharr_del(void *c, int i) {
+    qhasharr_t *tbl = (qhasharr_t *) c;
+    return tbl->remove(tbl, keys[i].name);
+}
+static size_t hasharr_iterate(void *c) {
+    qhasharr_t *tbl = (qhasharr_t *) c;
+    qnobj_t obj;
+    int idx = 0;
+    size_t n = 0;
+    while (tbl->getnext(tbl, &obj, &idx) == true) {
+        free(obj.name);
+        free(obj.data);
+        n++;
+    }
+    return n;
+}
+static void hasharr_destroy(void *c) {
+    qhasharr_t *tbl = (qhasharr_t *) c;
+    void *mem = tbl->data;
+    tbl->free(tbl);
+    free(mem);
+}
+
+/* qlisttbl */
+static void *listtbl_create(int n, int threads) {
+    return qlisttbl((threads > 1) ? QLISTTBL_THREADSAFE : 0);
+}
+static bool listtbl_put(void *c, int i) {
+    qlisttbl_t *tbl = (qlisttbl_t *) c;
+    return tbl->put(tbl, keys[i].name, &value, sizeof(value));
+}
+static bool listtbl_get(void *c, const bkey_t *k, int i) {
+    qlisttbl_t *tbl = (qlisttbl_t *) c;
+    return tbl->get(tbl, k[i].name, NULL, false) != NULL;
+}
+static bool listtbl_del(void *c, int i) {
+    qlisttbl_t *tbl = (qlisttbl_t *) c;
+    return tbl->remove(tbl, keys[i].name) > 0;
+}
+static size_t listtbl_iterate(void *c) {
+    qlisttbl_t *tbl = (qlisttbl_t *) c;
+    qdlnobj_t obj;
+    size_t n = 0;
+    memset((void *) &obj, 0, sizeof(obj));
+    tbl->lock(tbl);
+    while (tbl->getnext(tbl, &obj, NULL, false) == true)
+        n++;
+    tbl->unlock(tbl);
+    return n;
+}
+static void listtbl_destroy(void *c) {
+    ((qlisttbl_t *) c)->free((qlisttbl_t *) c);
+}
+
+/* qlist */
+static void *list_create(int n, int threads) {
+    return qlist((threads > 1) ? QLIST_THREADSAFE : 0);
+}
+static bool list_put(void *c, int i) {
+    qlist_t *list = (qlist_t *) c;
+    return list->addlast(list, &value, sizeof(value));
+}
+static bool list_del(void *c, int i) {
+    qlist_t *list = (qlist_t *) c;
+    return list->removefirst(list);
+}
+static size_t list_iterate(void *c) {
+    qlist_t *list = (qlist_t *) c;
+    qdlobj_t obj;
+    size_t n = 0;
+    memset((void *) &obj, 0, sizeof(obj));
+    list->lock(list);
+    while (list->getnext(list, &obj, false) == true)
+        n++;
+    list->unlock(list);
+    return n;
+}
+static void list_destroy(void *c) {
+    ((qlist_t *) c)->free((qlist_t *) c);
+}
+
+/* qvector */
+static void *vector_create(int n, int threads) {
+    return qvector((threads > 1) ? QVECTOR_THREADSAFE : 0);
+}
+static bool vector_put(void *c, int i) {
+    qvector_t *vector = (qvector_t *) c;
+    return vector->add(vector, &value, sizeof(value));
+}
+static bool vector_get(void *c, const bkey_t *k, int i) {
+    qvector_t *vector = (qvector_t *) c;
+    return vector->getat(vector, i, NULL, false) != NULL;
+}
+static bool vector_del(void *c, int i) {
+    qvector_t *vector = (qvector_t *) c;
+    return vector->removeat(vector, -1);
+}
+static size_t vector_iterate(void *c) {
+    qvector_t *vector = (qvector_t *) c;
+    size_t n, size = vector->size(vector);
+    for (n = 0; n < size; n++) {
+        if (vector->getat(vector, (int) n, NULL, false) == NULL)
+            break;
+    }
+    return n;
+}
+static void vector_destroy(void *c) {
+    ((qvector_t *) c)->free((qvector_t *) c);
+}
+
+/* qqueue */
+static void *queue_create(int n, int threads) {
+    return qqueue((threads > 1) ? QQUEUE_THREADSAFE : 0);
+}
+static bool queue_put(void *c, int i) {
+    qqueue_t *queue = (qqueue_t *) c;
+    return queue->push(queue, &value, sizeof(value));
+}
+static bool queue_del(void *c, int i) {
+    qqueue_t *queue = (qqueue_t *) c;
+    void *v = queue->pop(queue, NULL);
+    free(v);
+    return v != NULL;
+}
+static void queue_destroy(void *c) {
+    ((qqueue_t *) c)->free((qqueue_t *) c);
+}
+
+static const bench_t benches[] = {
+    { "qhashtbl", true, true, 0, hashtbl_create, hashtbl_put, hashtbl_get,
+      hashtbl_del, hashtbl_iterate, hashtbl_destroy },
+    { "qhasharr", true, false, 0, hasharr_create, hasharr_put, hasharr_get,
+      hasharr_del, hasharr_iterate, hasharr_destroy },
+    { "qlisttbl", true, false, 10000, listtbl_create, listtbl_put,
+      listtbl_get, listtbl_del, listtbl_iterate, listtbl_destroy },
+    { "qlist", false, false, 0, list_create, list_put, NULL, list_del,
+      list_iterate, list_destroy },
+    { "qvector", false, false, 0, vector_create, vector_put, vector_get,
+      vector_del, vector_iterate, vector_destroy },
+    { "qqueue", false, false, 0, queue_create, queue_put, NULL, queue_del,
+      NULL, queue_destroy },
+    { NULL }
+};
+
+/*
+ * runner
+ */
+enum { OP_PUT, OP_GETHIT, OP_GETMISS, OP_DEL };
+
+typedef struct worker_s {
+    const bench_t *b;
+    void *c;
+    int op;
+    int begin, end;
+    pthread_barrier_t *barrier;
+    int failed;
+} worker_t;
+
+static void run_slice(worker_t *w) {
+    const bench_t *b = w->b;
+    int i;
+    for (i = w->begin; i < w->end; i++) {
+        bool ok = false;
+        switch (w->op) {
+            case OP_PUT:
+                ok = b->put(w->c, i);
+                break;
+            case OP_GETHIT:
+                ok = b->get(w->c, keys, i);
+                break;
+            case OP_GETMISS:
+                ok = !b->get(w->c, misses, i);
+                break;
+            case OP_DEL:
+                ok = b->del(w->c, i);
+                break;
+        }
+        if (ok == false)
+            w->failed++;
+    }
+}
+
+static void *worker_main(void *arg) {
+    worker_t *w = (worker_t *) arg;
+    pthread_barrier_wait(w->barrier);
+    run_slice(w);
+    allocs_flush();
+    return NULL;
+}
+
+static int64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void report(const bench_t *b, const char *op, int n, int threads,
+                   int64_t ns, uint64_t allocs, int failed) {
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    printf("{\"container\":\"%s\",\"op\":\"%s\",\"size\":%d,\"threads\":%d,"
+           "\"key\":\"%s\",\"ns_per_op\":%.1f,\"allocs_per_op\":%.2f,"
+           "\"peak_rss_kb\":%ld,\"failed\":%d}\n",
+           b->name, op, n, threads,
+           (b->keyed == false) ? "none" : (binkeys ? "bin" : "str"),
+           (double) ns / n, (ALLOC_COUNTED) ? (double) allocs / n : -1.0,
+           ru.ru_maxrss, failed);
+    fflush(stdout);
+}
+
+static void run_op(const bench_t *b, void *c, int op, const char *opname,
+                   int n, int threads) {
+    worker_t w[threads];
+    pthread_t tids[threads];
+    pthread_barrier_t barrier;
+    int t, failed = 0;
+
+    uint64_t allocs = allocs_flush();
+    int64_t start;
+    if (threads == 1) {
+        w[0].b = b;
+        w[0].c = c;
+        w[0].op = op;
+        w[0].begin = 0;
+        w[0].end = n;
+        w[0].failed = 0;
+        start = now_ns();
+        run_slice(&w[0]);
+        failed = w[0].failed;
+    } else {
+        pthread_barrier_init(&barrier, NULL, threads + 1);
+        for (t = 0; t < threads; t++) {
+            w[t].b = b;
+            w[t].c = c;
+            w[t].op = op;
+            w[t].begin = (int) ((int64_t) n * t / threads);
+            w[t].end = (int) ((int64_t) n * (t + 1) / threads);
+            w[t].barrier = &barrier;
+            w[t].failed = 0;
+            pthread_create(&tids[t], NULL, worker_main, &w[t]);
+        }
+        allocs = allocs_flush();
+        start = now_ns();
+        pthread_barrier_wait(&barrier);
+        for (t = 0; t < threads; t++) {
+            pthread_join(tids[t], NULL);
+            failed += w[t].failed;
+        }
+        pthread_barrier_destroy(&barrier);
+    }
+    int64_t elapsed = now_ns() - start;
+    allocs = allocs_flush() - allocs;
+
+    report(b, opname, n, threads, elapsed, allocs, failed);
+}
+
+static void run_iterate(const bench_t *b, void *c, int n, int threads) {
+    uint64_t allocs = allocs_flush();
+    int64_t start = now_ns();
+    size_t found = b->iterate(c);
+    int64_t elapsed = now_ns() - start;
+    allocs = allocs_flush() - allocs;
+    report(b, "iterate", n, threads, elapsed, allocs,
+           (found == (size_t) n) ? 0 : 1);
+}
+
+static void run_bench(const bench_t *b, int n, int threads) {
+    keys = (bkey_t *) malloc(sizeof(bkey_t) * n);
+    misses = (bkey_t *) malloc(sizeof(bkey_t) * n);
+    make_keys(keys, n, binkeys, 1);
+    make_keys(misses, n, binkeys, 2);
+
+    void *c = b->create(n, threads);
+    if (c == NULL) {
+        fprintf(stderr, "%s: can't create for size %d\n", b->name, n);
+        free_keys(keys, n);
+        free_keys(misses, n);
+        return;
+    }
+    run_op(b, c, OP_PUT, (b->keyed) ? "insert" : "push", n, threads);
+    if (b->get != NULL) {
+        run_op(b, c, OP_GETHIT, (b->keyed) ? "lookup_hit" : "get", n,
+               threads);
+    }
+    if (b->keyed == true)
+        run_op(b, c, OP_GETMISS, "lookup_miss", n, threads);
+    if (b->iterate != NULL)
+        run_iterate(b, c, n, threads);
+    run_op(b, c, OP_DEL, (b->keyed) ? "delete" : "pop", n, threads);
+    b->destroy(c);
+    free_keys(keys, n);
+    free_keys(misses, n);
+}
+
+// each run in a child, so the peak RSS belongs to that run only.
+static void run_child(const bench_t *b, int n, int threads, bool bin) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        binkeys = bin;
+        run_bench(b, n, threads);
+        exit(0);
+    }
+    if (pid > 0)
+        waitpid(pid, NULL, 0);
+}
+
+int main(int argc, char **argv) {
+    int maxsize = 1000000;
+    int maxthreads = 4;
+    const char *only = NULL;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:t:c:h")) != -1) {
+        switch (opt) {
+            case 'n':
+                maxsize = atoi(optarg);
+                break;
+            case 't':
+                maxthreads = atoi(optarg);
+                break;
+            case 'c':
+                only = optarg;
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-n maxsize] [-t threads] "
+                        "[-c container]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    const bench_t *b;
+    for (b = benches; b->name != NULL; b++) {
+        if (only != NULL && strcmp(only, b->name))
+            continue;
+        int n;
+        for (n = 100; n <= maxsize; n *= 10) {
+            if (b->maxsize > 0 && n > b->maxsize)
+                break;
+            run_child(b, n, 1, false);
+            if (b->binary == true)
+                run_child(b, n, 1, true);
+            if (maxthreads > 1)
+                run_child(b, n, maxthreads, false);
+        }
+    }
+
+    return 0;
+}
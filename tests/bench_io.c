@@ -0,0 +1,480 @@
+/*
+ * I/O and HTTP client benchmarks.
+ *
+ * Starts an HTTP/1.1 server on the loopback interface and measures
+ * requests/sec and p50/p99 latency of qhttpclient head/get/put/cmd with
+ * and without keep-alive, and with TLS when built with ENABLE_OPENSSL and
+ * given a certificate. It also measures qio_send() throughput over a
+ * loopback socket and qio_gets() against qio_reader_gets(). Each result is
+ * printed as one JSON object per line.
+ *
+ *   {"bench":"http","op":"get","tls":false,"keepalive":true,
+ *    "requests":5000,"rps":41230.5,"p50_us":22.1,"p99_us":48.9,"failed":0}
+ *
+ * usage: bench_io [-r requests] [-b bodysize] [-s sendmb]
+ *                 [-C cert.pem -k key.pem]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#ifdef ENABLE_OPENSSL
+#include <openssl/ssl.h>
+#endif
+#include "qlibc.h"
+#include "qlibcext.h"
+
+#define LINEBUF     (8192)
+
+static int nrequests = 5000;
+static size_t bodysize = 1024;
+static char *body = NULL;
+
+/*
+ * loopback server fixture
+ */
+typedef struct conn_s {
+    int fd;
+#ifdef ENABLE_OPENSSL
+    SSL *ssl;
+#endif
+} conn_t;
+
+#ifdef ENABLE_OPENSSL
+static SSL_CTX *server_ctx = NULL;
+#endif
+
+static ssize_t conn_read(void *arg, void *buf, size_t nbytes, int timeoutms) {
+    conn_t *conn = (conn_t *) arg;
+#ifdef ENABLE_OPENSSL
+    if (conn->ssl != NULL) {
+        int n = SSL_read(conn->ssl, buf, (int) nbytes);
+        return (n > 0) ? n : -1;
+    }
+#endif
+    // a reader wants whatever is there, qio_read() would wait for nbytes.
+    if (timeoutms >= 0 && qio_wait_readable(conn->fd, timeoutms) <= 0)
+        return -1;
+    return read(conn->fd, buf, nbytes);
+}
+
+static bool conn_write(conn_t *conn, const void *data, size_t nbytes) {
+#ifdef ENABLE_OPENSSL
+    if (conn->ssl != NULL)
+        return SSL_write(conn->ssl, data, (int) nbytes) == (int) nbytes;
+#endif
+    return qio_write(conn->fd, data, nbytes, -1) == (ssize_t) nbytes;
+}
+
+static void *conn_main(void *arg) {
+    conn_t *conn = (conn_t *) arg;
+    char line[LINEBUF];
+    char *scratch = (char *) malloc(LINEBUF);
+
+#ifdef ENABLE_OPENSSL
+    if (server_ctx != NULL) {
+        conn->ssl = SSL_new(server_ctx);
+        SSL_set_fd(conn->ssl, conn->fd);
+        if (SSL_accept(conn->ssl) <= 0)
+            goto done;
+    }
+#endif
+
+    qio_reader_t *reader = qio_reader_custom(conn_read, conn, 16384);
+    while (reader != NULL) {
+        char method[16];
+        if (qio_reader_gets(reader, line, sizeof(line), -1) <= 0)
+            break;
+        if (sscanf(line, "%15s", method) != 1)
+            break;
+
+        // headers
+        off_t clength = 0;
+        bool expect = false, connclose = false;
+        while (qio_reader_gets(reader, line, sizeof(line), -1) > 0
+                && line[0] != '\0') {
+            if (!strncasecmp(line, "Content-Length:", 15))
+                clength = atoll(line + 15);
+            else if (!strncasecmp(line, "Expect:", 7))
+                expect = true;
+            else if (!strncasecmp(line, "Connection:", 11)) {
+                char *v = line + 11;
+                while (*v == ' ')
+                    v++;
+                connclose = (strncasecmp(v, "close", 5) == 0);
+            }
+        }
+
+        if (expect == true) {
+            const char *cont = "HTTP/1.1 100 Continue\r\n\r\n";
+            if (conn_write(conn, cont, strlen(cont)) == false)
+                break;
+        }
+        while (clength > 0) {
+            ssize_t n = qio_reader_read(reader, scratch,
+                                        (clength < LINEBUF) ? clength : LINEBUF,
+                                        -1);
+            if (n <= 0)
+                break;
+            clength -= n;
+        }
+
+        int code = 200;
+        size_t len = 2;
+        const char *data = "ok";
+        if (!strcmp(method, "HEAD") || !strcmp(method, "GET")) {
+            len = bodysize;
+            data = body;
+        } else if (!strcmp(method, "PUT")) {
+            code = 201;
+            len = 0;
+        }
+        int hlen = snprintf(line, sizeof(line),
+                            "HTTP/1.1 %d OK\r\n"
+                            "Content-Length: %zu\r\n"
+                            "Connection: %s\r\n\r\n",
+                            code, len, (connclose) ? "close" : "Keep-Alive");
+        if (conn_write(conn, line, hlen) == false)
+            break;
+        if (strcmp(method, "HEAD") && len > 0
+                && conn_write(conn, data, len) == false)
+            break;
+        if (connclose == true)
+            break;
+    }
+    if (reader != NULL)
+        qio_reader_free(reader);
+
+#ifdef ENABLE_OPENSSL
+done:
+    if (conn->ssl != NULL) {
+        SSL_shutdown(conn->ssl);
+        SSL_free(conn->ssl);
+    }
+#endif
+    close(conn->fd);
+    free(scratch);
+    free(conn);
+    return NULL;
+}
+
+static int listen_loopback(int *port) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    int on = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    socklen_t alen = sizeof(addr);
+    if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) != 0
+            || listen(fd, 1024) != 0
+            || getsockname(fd, (struct sockaddr *) &addr, &alen) != 0) {
+        close(fd);
+        return -1;
+    }
+    *port = ntohs(addr.sin_port);
+    return fd;
+}
+
+static void *server_main(void *arg) {
+    int lfd = (int) (intptr_t) arg;
+    while (true) {
+        int fd = accept(lfd, NULL, NULL);
+        if (fd < 0)
+            continue;
+        int on = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+        conn_t *conn = (conn_t *) calloc(1, sizeof(conn_t));
+        conn->fd = fd;
+        pthread_t tid;
+        if (pthread_create(&tid, NULL, conn_main, conn) != 0) {
+            close(fd);
+            free(conn);
+            continue;
+        }
+        pthread_detach(tid);
+    }
+    return NULL;
+}
+
+/*
+ * client benchmarks
+ */
+static int64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int cmp_int64(const void *a, const void *b) {
+    int64_t x = *(const int64_t *) a, y = *(const int64_t *) b;
+    return (x > y) - (x < y);
+}
+
+enum { OP_HEAD, OP_GET, OP_PUT, OP_CMD };
+static const char *opnames[] = { "head", "get", "put", "cmd" };
+
+static bool do_request(qhttpclient_t *client, int op, int nullfd, int putfd) {
+    int rescode = 0;
+    bool ok = false;
+    switch (op) {
+        case OP_HEAD:
+            ok = client->head(client, "/", &rescode, NULL, NULL);
+            break;
+        case OP_GET: {
+            off_t saved = 0;
+            ok = client->get(client, "/", nullfd, &saved, &rescode, NULL,
+                             NULL, NULL, NULL);
+            break;
+        }
+        case OP_PUT:
+            lseek(putfd, 0, SEEK_SET);
+            ok = client->put(client, "/", putfd, (off_t) bodysize, &rescode,
+                             NULL, NULL, NULL, NULL);
+            break;
+        case OP_CMD: {
+            size_t clen = 0;
+            void *res = client->cmd(client, "POST", "/", body, bodysize,
+                                    &rescode, &clen, NULL, NULL);
+            ok = (res != NULL);
+            free(res);
+            break;
+        }
+    }
+    return ok && rescode >= 200 && rescode < 300;
+}
+
+static void bench_http(int port, bool tls, bool keepalive, int op,
+                       int nullfd, int putfd) {
+    int64_t *lat = (int64_t *) malloc(sizeof(int64_t) * nrequests);
+    qhttpclient_t *client = qhttpclient("127.0.0.1", port);
+    if (client == NULL || lat == NULL)
+        return;
+    if (tls == true && client->setssl(client) == false) {
+        client->free(client);
+        free(lat);
+        return;
+    }
+    client->setkeepalive(client, keepalive);
+    client->settimeout(client, 5000);
+
+    int i, failed = 0;
+    int64_t start = now_ns();
+    for (i = 0; i < nrequests; i++) {
+        int64_t t = now_ns();
+        if (do_request(client, op, nullfd, putfd) == false)
+            failed++;
+        lat[i] = now_ns() - t;
+    }
+    int64_t elapsed = now_ns() - start;
+    client->free(client);
+
+    qsort(lat, nrequests, sizeof(int64_t), cmp_int64);
+    printf("{\"bench\":\"http\",\"op\":\"%s\",\"tls\":%s,\"keepalive\":%s,"
+           "\"requests\":%d,\"rps\":%.1f,\"p50_us\":%.1f,\"p99_us\":%.1f,"
+           "\"failed\":%d}\n",
+           opnames[op], (tls) ? "true" : "false",
+           (keepalive) ? "true" : "false", nrequests,
+           nrequests / (elapsed / 1e9), lat[nrequests / 2] / 1e3,
+           lat[(int) (nrequests * 0.99)] / 1e3, failed);
+    fflush(stdout);
+    free(lat);
+}
+
+/*
+ * I/O benchmarks
+ */
+static int make_tmpfile(size_t size, bool lines) {
+    char path[] = "/tmp/bench_io.XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0)
+        return -1;
+    unlink(path);
+
+    char buf[65536];
+    size_t i;
+    for (i = 0; i < sizeof(buf); i++) {
+        buf[i] = (lines && i % 64 == 63) ? '\n' : 'a' + (i % 26);
+    }
+    size_t written = 0;
+    while (written < size) {
+        size_t n = (size - written < sizeof(buf)) ? size - written : sizeof(buf);
+        if (write(fd, buf, n) != (ssize_t) n) {
+            close(fd);
+            return -1;
+        }
+        written += n;
+    }
+    return fd;
+}
+
+static void *drain_main(void *arg) {
+    int fd = (int) (intptr_t) arg;
+    char buf[65536];
+    while (read(fd, buf, sizeof(buf)) > 0)
+        ;
+    close(fd);
+    return NULL;
+}
+
+static void bench_send(size_t mb) {
+    int port;
+    int lfd = listen_loopback(&port);
+    int fd = make_tmpfile(mb << 20, false);
+    if (lfd < 0 || fd < 0)
+        return;
+
+    int sock = qsocket_open("127.0.0.1", port, 1000);
+    int peer = accept(lfd, NULL, NULL);
+    pthread_t tid;
+    pthread_create(&tid, NULL, drain_main, (void *) (intptr_t) peer);
+
+    lseek(fd, 0, SEEK_SET);
+    int64_t start = now_ns();
+    off_t sent = qio_send(sock, fd, (off_t) (mb << 20), -1);
+    int64_t elapsed = now_ns() - start;
+    close(sock);
+    pthread_join(tid, NULL);
+    close(fd);
+    close(lfd);
+
+    printf("{\"bench\":\"qio_send\",\"bytes\":%jd,\"mb_per_sec\":%.1f}\n",
+           (intmax_t) sent, (sent / 1048576.0) / (elapsed / 1e9));
+    fflush(stdout);
+}
+
+static void bench_gets(bool reader) {
+    size_t size = 2 << 20;
+    int fd = make_tmpfile(size, true);
+    if (fd < 0)
+        return;
+    lseek(fd, 0, SEEK_SET);
+
+    char line[LINEBUF];
+    size_t lines = 0, bytes = 0;
+    qio_reader_t *r = (reader) ? qio_reader(fd, 0) : NULL;
+    int64_t start = now_ns();
+    while (true) {
+        ssize_t n = (reader) ? qio_reader_gets(r, line, sizeof(line), -1)
+                             : qio_gets(fd, line, sizeof(line), -1);
+        if (n <= 0)
+            break;
+        bytes += n;
+        lines++;
+    }
+    int64_t elapsed = now_ns() - start;
+    if (r != NULL)
+        qio_reader_free(r);
+    close(fd);
+
+    printf("{\"bench\":\"%s\",\"lines\":%zu,\"ns_per_line\":%.1f,"
+           "\"mb_per_sec\":%.1f}\n", (reader) ? "qio_reader_gets" : "qio_gets",
+           lines, (double) elapsed / (lines ? lines : 1),
+           (bytes / 1048576.0) / (elapsed / 1e9));
+    fflush(stdout);
+}
+
+int main(int argc, char **argv) {
+    size_t sendmb = 256;
+    const char *cert = NULL, *key = NULL;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "r:b:s:C:k:h")) != -1) {
+        switch (opt) {
+            case 'r':
+                nrequests = atoi(optarg);
+                break;
+            case 'b':
+                bodysize = (size_t) atol(optarg);
+                break;
+            case 's':
+                sendmb = (size_t) atol(optarg);
+                break;
+            case 'C':
+                cert = optarg;
+                break;
+            case 'k':
+                key = optarg;
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-r requests] [-b bodysize] "
+                        "[-s sendmb] [-C cert.pem -k key.pem]\n", argv[0]);
+                return 1;
+        }
+    }
+    if (nrequests < 1)
+        nrequests = 1;
+    signal(SIGPIPE, SIG_IGN);
+
+    body = (char *) malloc(bodysize + 1);
+    memset(body, 'x', bodysize);
+    body[bodysize] = '\0';
+    int nullfd = open("/dev/null", O_WRONLY);
+    int putfd = make_tmpfile(bodysize, false);
+
+    // plain server
+    int port;
+    int lfd = listen_loopback(&port);
+    if (lfd < 0) {
+        fprintf(stderr, "can't listen on loopback.\n");
+        return 1;
+    }
+    pthread_t tid;
+    pthread_create(&tid, NULL, server_main, (void *) (intptr_t) lfd);
+
+    int op, ka;
+    for (ka = 1; ka >= 0; ka--) {
+        for (op = OP_HEAD; op <= OP_CMD; op++) {
+            bench_http(port, false, (bool) ka, op, nullfd, putfd);
+        }
+    }
+
+#ifdef ENABLE_OPENSSL
+    // TLS server, the plain one is no longer used.
+    if (cert != NULL && key != NULL) {
+        SSL_library_init();
+        server_ctx = SSL_CTX_new(SSLv23_server_method());
+        if (SSL_CTX_use_certificate_file(server_ctx, cert, SSL_FILETYPE_PEM) <= 0
+                || SSL_CTX_use_PrivateKey_file(server_ctx, key,
+                                               SSL_FILETYPE_PEM) <= 0) {
+            fprintf(stderr, "can't load %s or %s.\n", cert, key);
+            return 1;
+        }
+        for (ka = 1; ka >= 0; ka--) {
+            for (op = OP_HEAD; op <= OP_CMD; op++) {
+                bench_http(port, true, (bool) ka, op, nullfd, putfd);
+            }
+        }
+    }
+#else
+    if (cert != NULL || key != NULL)
+        fprintf(stderr, "TLS isn't available, configure --with-openssl.\n");
+#endif
+
+    bench_send(sendmb);
+    bench_gets(false);
+    bench_gets(true);
+
+    close(putfd);
+    close(nullfd);
+    free(body);
+    return 0;
+}
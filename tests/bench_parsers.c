@@ -0,0 +1,309 @@
+/*
+ * Parser benchmarks.
+ *
+ * Generates real-world sized inputs and measures the throughput of the text
+ * parsers, so a change of a parsing path can be compared against the last
+ * run. The inputs are:
+ *
+ *   qconfig_str      one huge config of -n lines in sections, a tenth of
+ *                    the values referring to earlier keys by ${key}.
+ *   qconfig_include  a chain of -d files, each @INCLUDE-ing the next one.
+ *   qaconf           a huge qaconf file of -n lines in nested sections.
+ *   qparse_queries   a query string of 1000 parameters, half of them
+ *                    percent-encoded, parsed -r times.
+ *   qhttpclient      a response of 100 headers read by readresponse(),
+ *                    -r times.
+ *
+ * Each result is printed as one JSON object per line.
+ *
+ *   {"bench":"qconfig_str","items":100000,"bytes":4104460,
+ *    "ns_per_item":427.0,"mb_per_sec":91.7}
+ *
+ * Files are made in a temporary directory which is removed at exit.
+ *
+ * usage: bench_parsers [-n lines] [-d depth] [-r repeat]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include "qlibc.h"
+#include "qlibcext.h"
+
+static int nlines = 100000;
+static int depth = 64;
+static int repeat = 1000;
+static char tmpdir[] = "/tmp/bench_parsers.XXXXXX";
+
+static int64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void report(const char *bench, size_t items, size_t bytes,
+                   int64_t elapsed) {
+    printf("{\"bench\":\"%s\",\"items\":%zu,\"bytes\":%zu,"
+           "\"ns_per_item\":%.1f,\"mb_per_sec\":%.1f}\n", bench, items, bytes,
+           (double) elapsed / (items ? items : 1),
+           (bytes / 1048576.0) / (elapsed / 1e9));
+    fflush(stdout);
+}
+
+static bool save(const char *filepath, qstrbuf_t *sb) {
+    size_t len = sb->length(sb);
+    return qfile_save(filepath, sb->getstr(sb, false), len, false)
+            == (ssize_t) len;
+}
+
+/*
+ * qconfig
+ */
+static qstrbuf_t *make_config(int lines, int base) {
+    qstrbuf_t *sb = qstrbuf(0);
+    int i;
+    for (i = 0; i < lines; i++) {
+        if (i % 100 == 0)
+            sb->appendf(sb, "\n# section %d\n[section%d]\n", i / 100,
+                        i / 100);
+        if (i % 10 == 9) {
+            sb->appendf(sb, "key%d = ${section%d.key%d}/suffix\n", base + i,
+                        i / 100, base + i - 1);
+        } else {
+            sb->appendf(sb, "key%d = value of key %d, some text\n",
+                        base + i, base + i);
+        }
+    }
+    return sb;
+}
+
+static void bench_qconfig_str(void) {
+    qstrbuf_t *sb = make_config(nlines, 0);
+    int64_t start = now_ns();
+    qlisttbl_t *tbl = qconfig_parse_str(NULL, sb->getstr(sb, false), '=');
+    int64_t elapsed = now_ns() - start;
+    if (tbl != NULL)
+        tbl->free(tbl);
+    report("qconfig_str", nlines, sb->length(sb), elapsed);
+    sb->free(sb);
+}
+
+static void bench_qconfig_include(void) {
+    int lines = 100;
+    size_t bytes = 0;
+    int i;
+    for (i = 0; i < depth; i++) {
+        qstrbuf_t *sb = make_config(lines, i * lines);
+        if (i + 1 < depth)
+            sb->appendf(sb, "@INCLUDE inc%d.conf\n", i + 1);
+        char *path = qstrdupf("%s/inc%d.conf", tmpdir, i);
+        save(path, sb);
+        bytes += sb->length(sb);
+        free(path);
+        sb->free(sb);
+    }
+
+    char *path = qstrdupf("%s/inc0.conf", tmpdir);
+    int64_t start = now_ns();
+    qlisttbl_t *tbl = qconfig_parse_file(NULL, path, '=');
+    int64_t elapsed = now_ns() - start;
+    if (tbl != NULL)
+        tbl->free(tbl);
+    free(path);
+    report("qconfig_include", (size_t) depth * lines, bytes, elapsed);
+}
+
+/*
+ * qaconf
+ */
+static QAC_CB(confcb) {
+    return NULL;
+}
+
+enum {
+    SECTION_DOMAIN = 2,
+    SECTION_HOST = 4
+};
+
+static qaconf_option_t options[] = {
+        {"Domain", QAC_TAKE_STR, confcb, SECTION_DOMAIN, QAC_SECTION_ROOT},
+        {"Host", QAC_TAKE_STR, confcb, SECTION_HOST, SECTION_DOMAIN},
+        {"TTL", QAC_TAKE_INT, confcb, 0, SECTION_DOMAIN | SECTION_HOST},
+        {"IPv4", QAC_TAKE_STR, confcb, 0, SECTION_HOST},
+        {"TXT", QAC_TAKEALL, confcb, 0, SECTION_HOST},
+        QAC_OPTION_END
+};
+
+static void bench_qaconf(void) {
+    qstrbuf_t *sb = qstrbuf(0);
+    int i, lines = 0;
+    for (i = 0; lines < nlines; i++) {
+        sb->appendf(sb, "<Domain \"domain%d.org\">\n    TTL 86400\n", i);
+        int h;
+        for (h = 0; h < 10; h++) {
+            sb->appendf(sb, "    <Host host%d>\n"
+                        "        IPv4 192.168.%d.%d\n"
+                        "        TXT \"rack %d\" 'row \\'%d\\''\n"
+                        "    </Host>\n", h, i % 256, h, i, h);
+        }
+        sb->appendf(sb, "</Domain>\n");
+        lines += 3 + 10 * 4;
+    }
+    char *path = qstrdupf("%s/qaconf.conf", tmpdir);
+    save(path, sb);
+
+    qaconf_t *conf = qaconf();
+    conf->addoptions(conf, options);
+    int64_t start = now_ns();
+    conf->parse(conf, path, QAC_CASEINSENSITIVE);
+    int64_t elapsed = now_ns() - start;
+    conf->free(conf);
+    free(path);
+    report("qaconf", lines, sb->length(sb), elapsed);
+    sb->free(sb);
+}
+
+/*
+ * qparse_queries
+ */
+static void bench_qparse_queries(void) {
+    qstrbuf_t *sb = qstrbuf(0);
+    int nparams = 1000;
+    int i;
+    for (i = 0; i < nparams; i++) {
+        if (i % 2 == 0) {
+            sb->appendf(sb, "%sname%d=value%d", (i > 0) ? "&" : "", i, i);
+        } else {
+            sb->appendf(sb, "&q%d=%%E3%%81%%82+a%%3Db%%26c%d", i, i);
+        }
+    }
+
+    const char *str = sb->getstr(sb, false);
+    size_t len = sb->length(sb);
+
+    int64_t start = now_ns();
+    for (i = 0; i < repeat; i++) {
+        qlisttbl_t *tbl = qparse_queries(NULL, str, '=', '&', NULL);
+        tbl->free(tbl);
+    }
+    int64_t elapsed = now_ns() - start;
+    report("qparse_queries", (size_t) nparams * repeat, len * repeat,
+           elapsed);
+
+    char *query = (char *) malloc(len + 1);
+    qnobj_t objs[32];
+    start = now_ns();
+    for (i = 0; i < repeat; i++) {
+        memcpy(query, str, len + 1);
+        qparse_queries_inplace(query, '=', '&', objs, 32);
+    }
+    elapsed = now_ns() - start;
+    report("qparse_queries_inplace", (size_t) nparams * repeat, len * repeat,
+           elapsed);
+    free(query);
+    sb->free(sb);
+}
+
+/*
+ * qhttpclient
+ */
+struct memreader_s {
+    const char *data;
+    size_t size;
+    size_t offset;
+};
+
+static ssize_t memread(void *arg, void *buf, size_t nbytes, int timeoutms) {
+    struct memreader_s *r = (struct memreader_s *) arg;
+    if (nbytes > r->size - r->offset)
+        nbytes = r->size - r->offset;
+    memcpy(buf, r->data + r->offset, nbytes);
+    r->offset += nbytes;
+    return nbytes;
+}
+
+static void bench_qhttpclient(void) {
+    qstrbuf_t *sb = qstrbuf(0);
+    sb->appendf(sb, "HTTP/1.1 200 OK\r\n");
+    int i;
+    for (i = 0; i < 97; i++) {
+        sb->appendf(sb, "X-Header-%d: value %d; path=/; max-age=3600\r\n",
+                    i, i);
+    }
+    sb->appendf(sb, "Content-Type: text/html; charset=utf-8\r\n"
+                "Content-Length: 0\r\nConnection: keep-alive\r\n\r\n");
+
+    qhttpclient_t *client = qhttpclient("127.0.0.1", 80);
+    qlisttbl_t *resheaders = qlisttbl(QLISTTBL_UNIQUE
+                                      | QLISTTBL_CASEINSENSITIVE);
+    struct memreader_s r = { sb->getstr(sb, false), sb->length(sb), 0 };
+    int64_t elapsed = 0;
+    for (i = 0; i < repeat; i++) {
+        // read the response from memory instead of a connection.
+        r.offset = 0;
+        client->reader = qio_reader_custom(memread, &r, 0);
+        off_t clength = 0;
+        int64_t start = now_ns();
+        client->readresponse(client, resheaders, &clength);
+        elapsed += now_ns() - start;
+        resheaders->clear(resheaders);
+        qio_reader_free(client->reader);
+        client->reader = NULL;
+    }
+    resheaders->free(resheaders);
+    client->free(client);
+    report("qhttpclient_readresponse", repeat, sb->length(sb) * repeat,
+           elapsed);
+    sb->free(sb);
+}
+
+static void cleanup(void) {
+    char *cmd = qstrdupf("rm -rf %s", tmpdir);
+    if (system(cmd) != 0)
+        fprintf(stderr, "can't remove %s.\n", tmpdir);
+    free(cmd);
+}
+
+int main(int argc, char **argv) {
+    int opt;
+    while ((opt = getopt(argc, argv, "n:d:r:h")) != -1) {
+        switch (opt) {
+            case 'n':
+                nlines = atoi(optarg);
+                break;
+            case 'd':
+                depth = atoi(optarg);
+                break;
+            case 'r':
+                repeat = atoi(optarg);
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-n lines] [-d depth] "
+                        "[-r repeat]\n", argv[0]);
+                return 1;
+        }
+    }
+    if (nlines < 1)
+        nlines = 1;
+    if (depth < 1)
+        depth = 1;
+    if (repeat < 1)
+        repeat = 1;
+
+    if (mkdtemp(tmpdir) == NULL) {
+        fprintf(stderr, "can't make a temporary directory.\n");
+        return 1;
+    }
+    atexit(cleanup);
+
+    bench_qconfig_str();
+    bench_qconfig_include();
+    bench_qaconf();
+    bench_qparse_queries();
+    bench_qhttpclient();
+    return 0;
+}
@@ -0,0 +1,358 @@
+/*
+ * Fuzz targets for the text parsers.
+ *
+ * One target is built per parser by defining one of FUZZ_QCONFIG,
+ * FUZZ_QACONF, FUZZ_QPARSE_QUERIES or FUZZ_QHTTPCLIENT.
+ *
+ *   qconfig         qconfig_parse_str() with '=' separator.
+ *   qaconf          qaconf->parse() of a temporary file, with sections.
+ *   qparse_queries  qparse_queries() and qparse_queries_inplace().
+ *   qhttpclient     qhttpclient->readresponse() and readbody() of a
+ *                   response fed from memory.
+ *
+ * Every target implements LLVMFuzzerTestOneInput(). Built with
+ * -DUSE_LIBFUZZER and -fsanitize=fuzzer, libFuzzer drives it. Otherwise a
+ * main() is built which runs the files and directories given, or stdin
+ * when none is given, so the same binary replays a corpus in `make fuzz`
+ * and works under afl-fuzz. -m N also runs N random mutations of every
+ * input as a cheap smoke fuzzing without clang. An input which crashes is
+ * saved to crash-<target> before the signal is raised again.
+ *
+ * qconfig expands ${!command} by running the command, so '!' is replaced
+ * before the input reaches the parser.
+ *
+ * usage: fuzz_<target> [-m mutations] [-s seed] [file|directory]...
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "qlibc.h"
+#include "qlibcext.h"
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+#if defined(FUZZ_QCONFIG) || defined(FUZZ_QPARSE_QUERIES)
+// copy input into a NUL terminated string.
+static char *dupstr(const uint8_t *data, size_t size) {
+    char *str = (char *) malloc(size + 1);
+    if (str == NULL)
+        return NULL;
+    memcpy(str, data, size);
+    str[size] = '\0';
+    return str;
+}
+#endif
+
+#if defined(FUZZ_QCONFIG)
+#define TARGET  "qconfig"
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    char *str = dupstr(data, size);
+    if (str == NULL)
+        return 0;
+
+    // never run commands.
+    char *p;
+    for (p = str; (p = strchr(p, '!')) != NULL; p++)
+        *p = '_';
+
+    qlisttbl_t *tbl = qconfig_parse_str(NULL, str, '=');
+    if (tbl != NULL)
+        tbl->free(tbl);
+    free(str);
+    return 0;
+}
+
+#elif defined(FUZZ_QACONF)
+#define TARGET  "qaconf"
+
+enum {
+    SECTION_DOMAIN = 2,
+    SECTION_HOST = 4
+};
+
+static QAC_CB(confcb) {
+    return NULL;
+}
+
+static qaconf_option_t options[] = {
+        {"Listen", QAC_TAKE_INT, confcb, 0, QAC_SECTION_ALL},
+        {"Protocols", QAC_TAKEALL, confcb, 0, QAC_SECTION_ROOT},
+        {"IPSEC", QAC_TAKE_BOOL, confcb, 0, QAC_SECTION_ROOT},
+        {"Weight", QAC_TAKE_FLOAT, confcb, 0, QAC_SECTION_ALL},
+        {"Domain", QAC_TAKE_STR, confcb, SECTION_DOMAIN, QAC_SECTION_ROOT},
+        {"MX", QAC_TAKE2 | QAC_A1_INT, confcb, 0, SECTION_DOMAIN},
+        {"Host", QAC_TAKE_STR, confcb, SECTION_HOST, SECTION_DOMAIN},
+        {"IPv4", QAC_TAKE_STR, confcb, 0, SECTION_HOST},
+        {"TXT", QAC_TAKEALL, confcb, 0, SECTION_HOST},
+        QAC_OPTION_END
+};
+
+static char path[] = "/tmp/fuzz_qaconf.XXXXXX";
+static int fd = -1;
+
+static void cleanup(void) {
+    unlink(path);
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    // qaconf reads a file, the same one is rewritten for every input.
+    if (fd < 0) {
+        if ((fd = mkstemp(path)) < 0)
+            return 0;
+        atexit(cleanup);
+    }
+    if (ftruncate(fd, 0) != 0 || pwrite(fd, data, size, 0) != (ssize_t) size)
+        return 0;
+
+    qaconf_t *conf = qaconf();
+    if (conf == NULL)
+        return 0;
+    conf->addoptions(conf, options);
+    conf->parse(conf, path, QAC_CASEINSENSITIVE | QAC_IGNOREUNKNOWN);
+    conf->free(conf);
+    return 0;
+}
+
+#elif defined(FUZZ_QPARSE_QUERIES)
+#define TARGET  "qparse_queries"
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    char *str = dupstr(data, size);
+    if (str == NULL)
+        return 0;
+
+    int count = 0;
+    qlisttbl_t *tbl = qparse_queries(NULL, str, '=', '&', &count);
+    if (tbl != NULL)
+        tbl->free(tbl);
+
+    qnobj_t objs[32];
+    qparse_queries_inplace(str, '=', '&', objs, 32);
+    free(str);
+    return 0;
+}
+
+#elif defined(FUZZ_QHTTPCLIENT)
+#define TARGET  "qhttpclient"
+
+struct memreader_s {
+    const uint8_t *data;
+    size_t size;
+    size_t offset;
+};
+
+static ssize_t memread(void *arg, void *buf, size_t nbytes, int timeoutms) {
+    struct memreader_s *r = (struct memreader_s *) arg;
+    if (nbytes > r->size - r->offset)
+        nbytes = r->size - r->offset;
+    memcpy(buf, r->data + r->offset, nbytes);
+    r->offset += nbytes;
+    return nbytes;
+}
+
+static bool discard(void *userdata, const void *data, size_t size) {
+    return true;
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    qhttpclient_t *client = qhttpclient("127.0.0.1", 80);
+    if (client == NULL)
+        return 0;
+
+    // read the response from memory instead of a connection.
+    struct memreader_s r = { data, size, 0 };
+    client->reader = qio_reader_custom(memread, &r, 0);
+    if (client->reader != NULL) {
+        qlisttbl_t *resheaders = qlisttbl(QLISTTBL_UNIQUE
+                                          | QLISTTBL_CASEINSENSITIVE);
+        off_t clength = 0;
+        int rescode = client->readresponse(client, resheaders, &clength);
+        if (rescode > 0)
+            client->readbody(client, resheaders, clength, discard, NULL);
+        resheaders->free(resheaders);
+
+        qio_reader_free(client->reader);
+        client->reader = NULL;
+    }
+    client->free(client);
+    return 0;
+}
+
+#else
+#error "define FUZZ_QCONFIG, FUZZ_QACONF, FUZZ_QPARSE_QUERIES or FUZZ_QHTTPCLIENT"
+#endif
+
+#ifndef USE_LIBFUZZER
+
+/*
+ * standalone driver
+ */
+static const uint8_t *curdata = NULL;
+static size_t cursize = 0;
+
+static void on_crash(int sig) {
+    int fd = open("crash-" TARGET, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd >= 0) {
+        ssize_t n = write(fd, curdata, cursize);
+        (void) n;
+        close(fd);
+    }
+    signal(sig, SIG_DFL);
+    raise(sig);
+}
+
+static void run(const uint8_t *data, size_t size) {
+    curdata = data;
+    cursize = size;
+    LLVMFuzzerTestOneInput(data, size);
+    curdata = NULL;
+    cursize = 0;
+}
+
+// flip, insert, delete or duplicate a few bytes.
+static size_t mutate(const uint8_t *src, size_t size, uint8_t *dst,
+                     size_t maxsize) {
+    if (size > maxsize)
+        size = maxsize;
+    memcpy(dst, src, size);
+
+    int n = 1 + rand() % 4;
+    while (n-- > 0) {
+        size_t pos = (size > 0) ? (size_t) rand() % size : 0;
+        switch (rand() % 4) {
+            case 0:
+                if (size > 0)
+                    dst[pos] ^= (uint8_t) (1 << (rand() % 8));
+                break;
+            case 1:
+                if (size < maxsize) {
+                    memmove(dst + pos + 1, dst + pos, size - pos);
+                    dst[pos] = "\n\r =&%:<>[]${}\"'\\#\0"[rand() % 20];
+                    size++;
+                }
+                break;
+            case 2:
+                if (size > 0) {
+                    memmove(dst + pos, dst + pos + 1, size - pos - 1);
+                    size--;
+                }
+                break;
+            case 3: {
+                size_t len = 1 + rand() % 64;
+                if (pos + len > size)
+                    len = size - pos;
+                if (size + len <= maxsize) {
+                    memmove(dst + pos + len, dst + pos, size - pos);
+                    size += len;
+                }
+                break;
+            }
+        }
+    }
+    return size;
+}
+
+static int run_file(const char *filepath, int mutations) {
+    size_t size = 0;
+    uint8_t *data = (uint8_t *) qfile_load(filepath, &size);
+    if (data == NULL) {
+        fprintf(stderr, "can't read %s.\n", filepath);
+        return 1;
+    }
+    run(data, size);
+
+    if (mutations > 0) {
+        size_t maxsize = size * 2 + 256;
+        uint8_t *buf = (uint8_t *) malloc(maxsize);
+        int i;
+        for (i = 0; i < mutations; i++) {
+            run(buf, mutate(data, size, buf, maxsize));
+        }
+        free(buf);
+    }
+    free(data);
+    return 0;
+}
+
+static int run_path(const char *filepath, int mutations, int *nfiles) {
+    struct stat st;
+    if (stat(filepath, &st) != 0) {
+        fprintf(stderr, "can't stat %s.\n", filepath);
+        return 1;
+    }
+    if (S_ISDIR(st.st_mode) == false) {
+        (*nfiles)++;
+        return run_file(filepath, mutations);
+    }
+
+    DIR *dir = opendir(filepath);
+    if (dir == NULL)
+        return 1;
+    int failed = 0;
+    struct dirent *ent;
+    while ((ent = readdir(dir)) != NULL) {
+        if (ent->d_name[0] == '.')
+            continue;
+        char *sub = qstrdupf("%s/%s", filepath, ent->d_name);
+        failed += run_path(sub, mutations, nfiles);
+        free(sub);
+    }
+    closedir(dir);
+    return failed;
+}
+
+int main(int argc, char **argv) {
+    int mutations = 0;
+    unsigned int seed = 1;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "m:s:h")) != -1) {
+        switch (opt) {
+            case 'm':
+                mutations = atoi(optarg);
+                break;
+            case 's':
+                seed = (unsigned int) strtoul(optarg, NULL, 10);
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-m mutations] [-s seed] "
+                        "[file|directory]...\n", argv[0]);
+                return 1;
+        }
+    }
+    srand(seed);
+    signal(SIGSEGV, on_crash);
+    signal(SIGBUS, on_crash);
+    signal(SIGFPE, on_crash);
+    signal(SIGABRT, on_crash);
+
+    // AFL feeds stdin unless @@ is given.
+    if (optind >= argc) {
+        size_t size = 0;
+        uint8_t *data = (uint8_t *) qfile_read(stdin, &size);
+        if (data == NULL)
+            return 1;
+        run(data, size);
+        free(data);
+        return 0;
+    }
+
+    int failed = 0, nfiles = 0;
+    for (; optind < argc; optind++) {
+        failed += run_path(argv[optind], mutations, &nfiles);
+    }
+    printf("fuzz_%s: %d inputs, %d mutations each, %s\n", TARGET, nfiles,
+           mutations, (failed == 0) ? "OK" : "FAIL");
+    return (failed == 0) ? 0 : 1;
+}
+
+#endif /* USE_LIBFUZZER */
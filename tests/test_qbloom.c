@@ -0,0 +1,99 @@
+#include <errno.h>
+#include "qunit.h"
+#include "qlibc.h"
+
+QUNIT_START("Test qbloom.c");
+
+TEST("add()/check() and false positive rate") {
+    size_t memsize = qbloom_calculate_memsize(10000, 0.01, 0);
+    ASSERT(memsize > 0);
+    void *memory = malloc(memsize);
+    qbloom_t *bloom = qbloom(memory, memsize, 10000, 0);
+    ASSERT(bloom != NULL);
+
+    char key[32];
+    int i;
+    for (i = 0; i < 10000; i++) {
+        snprintf(key, sizeof(key), "key%d", i);
+        ASSERT(bloom->add(bloom, key) == true);
+    }
+    ASSERT_EQUAL_INT(bloom->size(bloom), 10000);
+
+    // no false negatives
+    for (i = 0; i < 10000; i++) {
+        snprintf(key, sizeof(key), "key%d", i);
+        ASSERT(bloom->check(bloom, key) == true);
+    }
+
+    // false positives around the chosen rate
+    int fp = 0;
+    for (i = 0; i < 10000; i++) {
+        snprintf(key, sizeof(key), "other%d", i);
+        if (bloom->check(bloom, key) == true)
+            fp++;
+    }
+    ASSERT(fp < 200);
+
+    // non-counting filters can't remove keys.
+    ASSERT(bloom->remove(bloom, "key1") == false);
+    ASSERT_EQUAL_INT(errno, ENOTSUP);
+
+    // attach to the existing memory.
+    qbloom_t *bloom2 = qbloom(memory, 0, 0, 0);
+    ASSERT(bloom2 != NULL);
+    ASSERT(bloom2->check(bloom2, "key1") == true);
+    bloom2->free(bloom2);
+
+    bloom->clear(bloom);
+    ASSERT_EQUAL_INT(bloom->size(bloom), 0);
+    ASSERT(bloom->check(bloom, "key1") == false);
+
+    bloom->free(bloom);
+    free(memory);
+
+    ASSERT(qbloom_calculate_memsize(0, 0.01, 0) == 0);
+    ASSERT(qbloom_calculate_memsize(10, 1.0, 0) == 0);
+}
+
+TEST("QBLOOM_COUNTING") {
+    size_t memsize = qbloom_calculate_memsize(1000, 0.01, QBLOOM_COUNTING);
+    void *memory = malloc(memsize);
+    qbloom_t *bloom = qbloom(memory, memsize, 1000, QBLOOM_COUNTING);
+    ASSERT(bloom != NULL);
+
+    char key[32];
+    int i;
+    for (i = 0; i < 1000; i++) {
+        snprintf(key, sizeof(key), "key%d", i);
+        bloom->add(bloom, key);
+    }
+    for (i = 0; i < 1000; i += 2) {
+        snprintf(key, sizeof(key), "key%d", i);
+        ASSERT(bloom->remove(bloom, key) == true);
+    }
+    ASSERT_EQUAL_INT(bloom->size(bloom), 500);
+
+    // remaining keys are still found and most removed ones are gone.
+    int found = 0;
+    for (i = 0; i < 1000; i++) {
+        snprintf(key, sizeof(key), "key%d", i);
+        bool ret = bloom->check(bloom, key);
+        if (i % 2) {
+            ASSERT(ret == true);
+        } else if (ret == true) {
+            found++;
+        }
+    }
+    ASSERT(found < 25);
+
+    // binary keys
+    int64_t num = 1234567890123LL;
+    ASSERT(bloom->adddata(bloom, &num, sizeof(num)) == true);
+    ASSERT(bloom->checkdata(bloom, &num, sizeof(num)) == true);
+    ASSERT(bloom->removedata(bloom, &num, sizeof(num)) == true);
+
+    bloom->free(bloom);
+    free(memory);
+}
+
+QUNIT_END();
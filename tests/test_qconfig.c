@@ -0,0 +1,120 @@
+#include <errno.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "qunit.h"
+#include "qlibc.h"
+#include "qlibcext.h"
+
+#define KEYS        (20)
+#define READERS     (4)
+#define REWRITES    (300)
+
+static char dir[] = "/tmp/test_qconfig.XXXXXX";
+static char cfgpath[256], snappath[256];
+static volatile int writing;
+
+// every version has the same size, so only the contents tell them apart.
+static void write_config(char version) {
+    char tmppath[300], buf[64];
+    snprintf(tmppath, sizeof(tmppath), "%s.tmp", cfgpath);
+    FILE *fp = fopen(tmppath, "w");
+    fprintf(fp, "version = %c\n", version);
+    int i;
+    for (i = 0; i < KEYS; i++) {
+        snprintf(buf, sizeof(buf), "key%02d = %c%02d\n", i, version, i);
+        fputs(buf, fp);
+    }
+    fclose(fp);
+    rename(tmppath, cfgpath);
+}
+
+// true if tbl is one whole version of the config. returns the version.
+static char check_config(qlisttbl_t *tbl) {
+    if (tbl == NULL || tbl->size(tbl) != KEYS + 1)
+        return 0;
+    char *version = tbl->getstr(tbl, "version", false);
+    if (version == NULL || strlen(version) != 1)
+        return 0;
+    int i;
+    for (i = 0; i < KEYS; i++) {
+        char key[16], value[16];
+        snprintf(key, sizeof(key), "key%02d", i);
+        snprintf(value, sizeof(value), "%c%02d", version[0], i);
+        char *v = tbl->getstr(tbl, key, false);
+        if (v == NULL || strcmp(v, value) != 0)
+            return 0;
+    }
+    return version[0];
+}
+
+static void *reader(void *arg) {
+    long failed = 0;
+    while (__atomic_load_n(&writing, __ATOMIC_ACQUIRE) == 1) {
+        qlisttbl_t *tbl = qconfig_parse_cached(NULL, cfgpath, '=', snappath);
+        if (check_config(tbl) == 0)
+            failed++;
+        if (tbl != NULL)
+            tbl->free(tbl);
+    }
+    return (void *) failed;
+}
+
+QUNIT_START("Test qconfig.c");
+
+TEST("Prepare a directory for config files") {
+    ASSERT(mkdtemp(dir) != NULL);
+    snprintf(cfgpath, sizeof(cfgpath), "%s/test.conf", dir);
+    snprintf(snappath, sizeof(snappath), "%s/test.snap", dir);
+}
+
+TEST("qconfig_parse_cached() loads from the snapshot until files change") {
+    write_config('A');
+    qlisttbl_t *tbl = qconfig_parse_cached(NULL, cfgpath, '=', snappath);
+    ASSERT_EQUAL_INT(check_config(tbl), 'A');
+    tbl->free(tbl);
+    ASSERT(access(snappath, F_OK) == 0);
+    tbl = qconfig_parse_cached(NULL, cfgpath, '=', snappath);
+    ASSERT_EQUAL_INT(check_config(tbl), 'A');
+    tbl->free(tbl);
+
+    // same size and likely the same second as the last one.
+    write_config('B');
+    tbl = qconfig_parse_cached(NULL, cfgpath, '=', snappath);
+    ASSERT_EQUAL_INT(check_config(tbl), 'B');
+    tbl->free(tbl);
+}
+
+TEST("Snapshot is read while the config and snapshot are replaced") {
+    pthread_t threads[READERS];
+    int i;
+    writing = 1;
+    for (i = 0; i < READERS; i++) {
+        pthread_create(&threads[i], NULL, reader, NULL);
+    }
+    for (i = 0; i < REWRITES; i++) {
+        write_config('A' + i % 26);
+        usleep(500);
+    }
+    __atomic_store_n(&writing, 0, __ATOMIC_RELEASE);
+    long failed = 0;
+    for (i = 0; i < READERS; i++) {
+        void *ret;
+        pthread_join(threads[i], &ret);
+        failed += (long) ret;
+    }
+    ASSERT_EQUAL_INT(failed, 0);
+
+    // the snapshot left by the readers isn't stale.
+    qlisttbl_t *tbl = qconfig_parse_cached(NULL, cfgpath, '=', snappath);
+    ASSERT_EQUAL_INT(check_config(tbl), 'A' + (REWRITES - 1) % 26);
+    tbl->free(tbl);
+}
+
+TEST("Clean up") {
+    ASSERT(unlink(cfgpath) == 0);
+    unlink(snappath);
+    ASSERT(rmdir(dir) == 0);
+}
+
+QUNIT_END();
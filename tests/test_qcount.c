@@ -0,0 +1,154 @@
+#include <errno.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "qunit.h"
+#include "qlibc.h"
+
+static char dir[] = "/tmp/test_qcount.XXXXXX";
+
+static const char *path(const char *name) {
+    static char buf[4][256];
+    static int n = 0;
+    char *p = buf[n++ % 4];
+    snprintf(p, sizeof(buf[0]), "%s/%s", dir, name);
+    return p;
+}
+
+// path() isn't thread-safe, so the path is made before the threads start.
+struct adder_s {
+    qcount_t *cnt;
+    char path[256];
+};
+
+static void *adder(void *arg) {
+    struct adder_s *a = (struct adder_s *) arg;
+    int i;
+    for (i = 0; i < 10000; i++) {
+        qcount_add(a->cnt, a->path, 1);
+    }
+    return NULL;
+}
+
+QUNIT_START("Test qcount.c");
+
+TEST("Prepare a directory for counter files") {
+    ASSERT(mkdtemp(dir) != NULL);
+}
+
+TEST("qcount_add() registers a counter and qcount_get() reads it") {
+    qcount_t *cnt = qcount(NULL, qcount_memsize(10), -1);
+    ASSERT(cnt != NULL);
+    ASSERT_EQUAL_INT(qcount_add(cnt, path("a"), 1), 1);
+    ASSERT_EQUAL_INT(qcount_add(cnt, path("a"), 5), 6);
+    ASSERT_EQUAL_INT(qcount_add(cnt, path("a"), -2), 4);
+    ASSERT_EQUAL_INT(qcount_get(cnt, path("a")), 4);
+
+    // in memory until synced.
+    ASSERT_EQUAL_INT(qcount_read(path("a")), 0);
+    ASSERT(qcount_sync(cnt) == true);
+    ASSERT_EQUAL_INT(qcount_read(path("a")), 4);
+
+    // a counter starts from its file.
+    ASSERT(qcount_save(path("b"), 100) == true);
+    ASSERT_EQUAL_INT(qcount_add(cnt, path("b"), 1), 101);
+
+    // qcount_get() doesn't register it.
+    ASSERT(qcount_save(path("c"), 7) == true);
+    ASSERT_EQUAL_INT(qcount_get(cnt, path("c")), 7);
+    ASSERT(qcount_save(path("c"), 8) == true);
+    ASSERT_EQUAL_INT(qcount_get(cnt, path("c")), 8);
+
+    // -1 doesn't write at free.
+    qcount_free(cnt);
+    ASSERT_EQUAL_INT(qcount_read(path("b")), 100);
+}
+
+TEST("qcount_free() writes the counters unless syncsec is -1") {
+    qcount_t *cnt = qcount(NULL, qcount_memsize(10), 0);
+    ASSERT_EQUAL_INT(qcount_add(cnt, path("b"), 10), 110);
+    ASSERT_EQUAL_INT(qcount_read(path("b")), 100);
+    qcount_free(cnt);
+    ASSERT_EQUAL_INT(qcount_read(path("b")), 110);
+
+    // and the background writer every second.
+    cnt = qcount(NULL, qcount_memsize(10), 1);
+    ASSERT_EQUAL_INT(qcount_add(cnt, path("b"), 1), 111);
+    int i;
+    for (i = 0; i < 30 && qcount_read(path("b")) != 111; i++) {
+        usleep(100 * 1000);
+    }
+    ASSERT_EQUAL_INT(qcount_read(path("b")), 111);
+    qcount_free(cnt);
+}
+
+TEST("Full registry falls back to the counter file") {
+    qcount_t *cnt = qcount(NULL, qcount_memsize(2), -1);
+    ASSERT_EQUAL_INT(qcount_add(cnt, path("d1"), 1), 1);
+    ASSERT_EQUAL_INT(qcount_add(cnt, path("d2"), 1), 1);
+    ASSERT_EQUAL_INT(qcount_add(cnt, path("d3"), 1), 1);
+    ASSERT_EQUAL_INT(qcount_read(path("d1")), 0);
+    ASSERT_EQUAL_INT(qcount_read(path("d3")), 1);
+    ASSERT_EQUAL_INT(qcount_add(cnt, path("d3"), 1), 2);
+    ASSERT_EQUAL_INT(qcount_get(cnt, path("d3")), 2);
+    qcount_free(cnt);
+}
+
+TEST("Increments from multiple threads") {
+    struct adder_s a;
+    a.cnt = qcount(NULL, qcount_memsize(10), -1);
+    snprintf(a.path, sizeof(a.path), "%s", path("hits"));
+    pthread_t threads[4];
+    int i;
+    for (i = 0; i < 4; i++) {
+        pthread_create(&threads[i], NULL, adder, &a);
+    }
+    for (i = 0; i < 4; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    ASSERT_EQUAL_INT(qcount_get(a.cnt, a.path), 40000);
+    qcount_free(a.cnt);
+}
+
+TEST("qcount_attach() shares counters with another process") {
+    size_t memsize = qcount_memsize(10);
+    void *mem = mmap(NULL, memsize, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    ASSERT(mem != MAP_FAILED);
+    ASSERT(qcount_attach(mem, -1) == NULL && errno == EINVAL);
+
+    qcount_t *cnt = qcount(mem, memsize, -1);
+    ASSERT_EQUAL_INT(qcount_add(cnt, path("e"), 1), 1);
+    pid_t pid = fork();
+    if (pid == 0) {
+        qcount_t *child = qcount_attach(mem, -1);
+        int i;
+        for (i = 0; i < 1000; i++) {
+            qcount_add(child, path("e"), 1);
+            qcount_add(child, path("f"), 2);
+        }
+        qcount_free(child);
+        _exit(0);
+    }
+    int status;
+    ASSERT(waitpid(pid, &status, 0) == pid && WIFEXITED(status));
+    ASSERT_EQUAL_INT(qcount_get(cnt, path("e")), 1001);
+    ASSERT_EQUAL_INT(qcount_get(cnt, path("f")), 2000);
+    ASSERT_EQUAL_INT(qcount_read(path("f")), 0);
+    qcount_free(cnt);
+    munmap(mem, memsize);
+}
+
+TEST("Clean up") {
+    const char *names[] = { "a", "b", "c", "d1", "d2", "d3", "e", "f",
+                            "hits" };
+    size_t i;
+    for (i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        unlink(path(names[i]));
+    }
+    ASSERT(rmdir(dir) == 0);
+}
+
+QUNIT_END();
@@ -0,0 +1,230 @@
+#include <errno.h>
+#include <stdio.h>
+#include "qunit.h"
+#include "qlibc.h"
+
+// src/internal/qinternal.h, which can't be included along with qunit.h.
+extern int _q_encode_simd(int max);
+
+// every length up to this covers a few blocks and every tail length of
+// all the kernels, 16 to 48 bytes wide.
+#define MAXLEN  (200)
+#define BUFSIZE (MAXLEN * 3 + 1)
+
+static const char *ALPHABET[] = {
+    /* QCODEC_BASE64_ENCODE */ NULL,
+    /* QCODEC_BASE64_DECODE */
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/",
+    /* QCODEC_HEX_ENCODE */ NULL,
+    /* QCODEC_HEX_DECODE */ "0123456789abcdefABCDEF",
+    /* QCODEC_URL_ENCODE */
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-._",
+    /* QCODEC_URL_DECODE */ "0123456789abcdefABCDEFxyz-._%+",
+};
+
+// fills random input of the codec. odd seeds mix in characters which
+// make the kernels fall back to the scalar code.
+static void fill(int type, unsigned char *buf, size_t len, unsigned seed) {
+    const char *chars = ALPHABET[type];
+    size_t i, n = (chars != NULL) ? strlen(chars) : 0;
+    unsigned r = seed;
+    for (i = 0; i < len; i++) {
+        r = r * 1103515245 + 12345;
+        unsigned v = (r >> 16);
+        if (chars == NULL || ((seed & 1) && v % 40 == 0)) {
+            buf[i] = (unsigned char) (v >> 3);
+        } else {
+            buf[i] = chars[v % n];
+        }
+    }
+}
+
+static ssize_t code_into(int type, const void *in, size_t len, void *out,
+                         size_t outsize) {
+    switch (type) {
+        case QCODEC_BASE64_ENCODE:
+            return qbase64_encode_into(in, len, out, outsize);
+        case QCODEC_BASE64_DECODE:
+            return qbase64_decode_into(in, len, out, outsize);
+        case QCODEC_HEX_ENCODE:
+            return qhex_encode_into(in, len, out, outsize);
+        case QCODEC_HEX_DECODE:
+            return qhex_decode_into(in, len, out, outsize);
+        case QCODEC_URL_ENCODE:
+            return qurl_encode_into(in, len, out, outsize);
+        case QCODEC_URL_DECODE:
+            return qurl_decode_into(in, len, out, outsize);
+    }
+    return -1;
+}
+
+// compares the kernels of the given level with the scalar code. returns
+// the number of mismatches.
+static int compare_level(int type, int level) {
+    unsigned char in[MAXLEN], ref[BUFSIZE], out[BUFSIZE];
+    int failed = 0;
+    size_t len;
+    unsigned seed;
+    for (len = 0; len <= MAXLEN; len++) {
+        for (seed = 1; seed <= 4; seed++) {
+            fill(type, in, len, seed * 7919 + len);
+            _q_encode_simd(0);
+            ssize_t n1 = code_into(type, in, len, ref, sizeof(ref));
+            _q_encode_simd(level);
+            ssize_t n2 = code_into(type, in, len, out, sizeof(out));
+            if (n1 < 0 || n1 != n2 || memcmp(ref, out, n1 + 1) != 0) {
+                printf("\n  type %d, level %d, len %zu, seed %u mismatch",
+                       type, level, len, seed);
+                failed++;
+            }
+        }
+    }
+    return failed;
+}
+
+// the smallest buffer _into() takes. encoders need the output plus the
+// terminator, decoders are bound by the input length.
+static size_t min_bufsize(int type, const void *in, size_t len) {
+    unsigned char buf[BUFSIZE];
+    switch (type) {
+        case QCODEC_BASE64_DECODE:
+            return (len / 4) * 3 + (len % 4) + 1;
+        case QCODEC_HEX_DECODE:
+            return ((len + 1) / 2) + 1;
+        case QCODEC_URL_DECODE:
+            return len + 1;
+    }
+    return code_into(type, in, len, buf, sizeof(buf)) + 1;
+}
+
+// converts in with a codec, the first split bytes in one call and the rest
+// in step bytes at a time. returns the output length, -1 on failure.
+static ssize_t code_stream(qcodec_t *codec, const unsigned char *in,
+                           size_t len, size_t split, size_t step,
+                           unsigned char *out) {
+    size_t done = 0, total = 0;
+    while (done < len) {
+        size_t size = (done == 0 && split > 0) ? split : step;
+        if (size > len - done)
+            size = len - done;
+        ssize_t n = qcodec_update(codec, in + done, size, out + total,
+                                  qcodec_bound(codec, size));
+        if (n < 0)
+            return -1;
+        done += size;
+        total += n;
+    }
+    ssize_t n = qcodec_final(codec, out + total, 4);
+    return (n < 0) ? -1 : (ssize_t) (total + n);
+}
+
+QUNIT_START("Test qencode.c");
+
+TEST("SIMD kernels give the same results as the scalar code") {
+    int level = _q_encode_simd(-1);
+    int type, l;
+    for (type = QCODEC_BASE64_ENCODE; type <= QCODEC_URL_DECODE; type++) {
+        // levels which aren't supported fall back to the lower ones.
+        for (l = 1; l <= level; l++) {
+            ASSERT_EQUAL_INT(compare_level(type, l), 0);
+        }
+    }
+    _q_encode_simd(level);
+    ASSERT_EQUAL_INT(_q_encode_simd(-1), level);
+}
+
+TEST("Encoders and decoders round trip at every SIMD level") {
+    int level = _q_encode_simd(-1);
+    unsigned char in[MAXLEN], enc[BUFSIZE], dec[BUFSIZE];
+    int l, type, failed = 0;
+    size_t len;
+    for (l = 0; l <= level; l++) {
+        _q_encode_simd(l);
+        for (type = QCODEC_BASE64_ENCODE; type <= QCODEC_URL_ENCODE;
+             type += 2) {
+            for (len = 0; len <= MAXLEN; len++) {
+                fill(QCODEC_BASE64_ENCODE, in, len, len);
+                ssize_t n = code_into(type, in, len, enc, sizeof(enc));
+                if (n < 0
+                    || code_into(type + 1, enc, n, dec, sizeof(dec)) != len
+                    || memcmp(in, dec, len) != 0) {
+                    failed++;
+                }
+            }
+        }
+    }
+    _q_encode_simd(level);
+    ASSERT_EQUAL_INT(failed, 0);
+}
+
+TEST("Known values") {
+    char buf[64];
+    ASSERT_EQUAL_INT(qbase64_encode_into("hello world", 11, buf,
+                                         sizeof(buf)), 16);
+    ASSERT_EQUAL_STR(buf, "aGVsbG8gd29ybGQ=");
+    ASSERT_EQUAL_INT(qbase64_decode_into("aGVs\nbG8=", 9, buf,
+                                         sizeof(buf)), 5);
+    ASSERT_EQUAL_STR(buf, "hello");
+    ASSERT_EQUAL_INT(qhex_encode_into("\x01\xab", 2, buf, sizeof(buf)), 4);
+    ASSERT_EQUAL_STR(buf, "01ab");
+    ASSERT_EQUAL_INT(qhex_decode_into("01aB0", 5, buf, sizeof(buf)), 3);
+    ASSERT(memcmp(buf, "\x01\xab\x00", 3) == 0);
+    ASSERT_EQUAL_INT(qurl_encode_into("a b/c&", 6, buf, sizeof(buf)), 10);
+    ASSERT_EQUAL_STR(buf, "a%20b/c%26");
+    ASSERT_EQUAL_INT(qurl_decode_into("a+b%2Fc%2", 9, buf, sizeof(buf)), 7);
+    ASSERT_EQUAL_STR(buf, "a b/c%2");
+}
+
+TEST("_into() fails with ENOBUFS when the buffer is one byte short") {
+    size_t lens[] = { 0, 1, 2, 3, 15, 16, 17, 31, 32, 33, 48, 100 };
+    unsigned char in[MAXLEN], out[BUFSIZE];
+    int type;
+    size_t i;
+    for (type = QCODEC_BASE64_ENCODE; type <= QCODEC_URL_DECODE; type++) {
+        for (i = 0; i < sizeof(lens) / sizeof(lens[0]); i++) {
+            fill(type, in, lens[i], i);
+            size_t size = min_bufsize(type, in, lens[i]);
+            ASSERT(code_into(type, in, lens[i], out, size) >= 0);
+            errno = 0;
+            ASSERT_EQUAL_INT(code_into(type, in, lens[i], out, size - 1), -1);
+            ASSERT_EQUAL_INT(errno, ENOBUFS);
+        }
+    }
+}
+
+TEST("qcodec gives the same output as one-shot wherever the input is split") {
+    int level = _q_encode_simd(-1);
+    unsigned char in[MAXLEN], ref[BUFSIZE], out[BUFSIZE];
+    int levels[] = { 0, level }, i, type, failed = 0;
+    size_t len = 100, split;
+    unsigned seed;
+    for (i = 0; i < 2; i++) {
+        _q_encode_simd(levels[i]);
+        for (type = QCODEC_BASE64_ENCODE; type <= QCODEC_URL_DECODE;
+             type++) {
+            qcodec_t *codec = qcodec(type);
+            for (seed = 1; seed <= 2; seed++) {
+                fill(type, in, len, seed);
+                ssize_t n = code_into(type, in, len, ref, sizeof(ref));
+                for (split = 0; split <= len; split++) {
+                    if (code_stream(codec, in, len, split, len, out) != n
+                        || memcmp(ref, out, n) != 0) {
+                        printf("\n  type %d, level %d, seed %u, split %zu",
+                               type, levels[i], seed, split);
+                        failed++;
+                    }
+                }
+                // a byte at a time
+                if (code_stream(codec, in, len, 0, 1, out) != n
+                    || memcmp(ref, out, n) != 0) {
+                    failed++;
+                }
+            }
+            qcodec_free(codec);
+        }
+    }
+    _q_encode_simd(level);
+    ASSERT_EQUAL_INT(failed, 0);
+}
+
+QUNIT_END();
@@ -0,0 +1,126 @@
+#include <errno.h>
+#include "qunit.h"
+#include "qlibc.h"
+
+static int check_all(qfrozentbl_t *frozen, int num) {
+    char key[32], value[32];
+    int i, nwrong = 0;
+    for (i = 0; i < num; i++) {
+        snprintf(key, sizeof(key), "key%d", i);
+        snprintf(value, sizeof(value), "value%d", i);
+        char *str = frozen->getstr(frozen, key, false);
+        if (str == NULL || strcmp(str, value) != 0)
+            nwrong++;
+    }
+    return nwrong;
+}
+
+QUNIT_START("Test qfrozentbl.c");
+
+TEST("qfrozentbl() from an array") {
+    qnobj_t objs[] = {
+        { "html", "text/html", 10 },
+        { "css", "text/css", 9 },
+        { "png", "image/png", 10 },
+        { "html", "duplicated", 11 },
+        { "empty", "", 0 }
+    };
+    qfrozentbl_t *tbl = qfrozentbl(objs, 5, 0);
+    ASSERT(tbl != NULL);
+    ASSERT_EQUAL_INT(tbl->size(tbl), 4);
+    ASSERT_EQUAL_STR(tbl->getstr(tbl, "html", false), "text/html");
+    ASSERT_EQUAL_STR(tbl->getstr(tbl, "png", false), "image/png");
+
+    size_t size;
+    char *data = tbl->get(tbl, "css", &size, true);
+    ASSERT_EQUAL_STR(data, "text/css");
+    ASSERT_EQUAL_INT(size, 9);
+    free(data);
+
+    ASSERT(tbl->get(tbl, "empty", &size, false) != NULL);
+    ASSERT_EQUAL_INT(size, 0);
+
+    ASSERT(tbl->get(tbl, "HTML", NULL, false) == NULL);
+    ASSERT_EQUAL_INT(errno, ENOENT);
+    ASSERT(tbl->get(tbl, "gif", NULL, false) == NULL);
+
+    int idx = 0, n = 0;
+    qnobj_t obj;
+    while (tbl->getnext(tbl, &obj, &idx, false) == true) {
+        ASSERT(tbl->getstr(tbl, obj.name, false) == obj.data);
+        n++;
+    }
+    ASSERT_EQUAL_INT(n, 4);
+    tbl->free(tbl);
+
+    // empty table
+    tbl = qfrozentbl(NULL, 0, 0);
+    ASSERT(tbl != NULL);
+    ASSERT(tbl->get(tbl, "html", NULL, false) == NULL);
+    tbl->free(tbl);
+}
+
+TEST("QFROZENTBL_CASEINSENSITIVE") {
+    qnobj_t objs[] = {
+        { "Content-Type", "1", 2 },
+        { "content-length", "2", 2 },
+        { "CONTENT-TYPE", "3", 2 }
+    };
+    qfrozentbl_t *tbl = qfrozentbl(objs, 3, QFROZENTBL_CASEINSENSITIVE);
+    ASSERT_EQUAL_INT(tbl->size(tbl), 2);
+    ASSERT_EQUAL_INT(tbl->getint(tbl, "content-type"), 1);
+    ASSERT_EQUAL_INT(tbl->getint(tbl, "Content-Length"), 2);
+    tbl->free(tbl);
+}
+
+TEST("qhashtbl->freeze()") {
+    int options[] = { 0, QHASHTBL_OPENADDR, QHASHTBL_CONCURRENT };
+    int i, j;
+    for (j = 0; j < 3; j++) {
+        qhashtbl_t *tbl = qhashtbl(0, options[j]);
+        char key[32], value[32];
+        for (i = 0; i < 50000; i++) {
+            snprintf(key, sizeof(key), "key%d", i);
+            snprintf(value, sizeof(value), "value%d", i);
+            tbl->putstr(tbl, key, value);
+        }
+        qfrozentbl_t *frozen = tbl->freeze(tbl);
+        ASSERT(frozen != NULL);
+        ASSERT_EQUAL_INT(frozen->size(frozen), 50000);
+        ASSERT_EQUAL_INT(check_all(frozen, 50000), 0);
+        ASSERT(frozen->get(frozen, "key50000", NULL, false) == NULL);
+
+        // smaller than the chained table
+        qstats_t s1, s2;
+        tbl->stats(tbl, &s1);
+        frozen->stats(frozen, &s2);
+        ASSERT_EQUAL_INT(s2.maxchain, 1);
+        ASSERT(s2.overhead < s1.overhead);
+
+        frozen->free(frozen);
+        tbl->free(tbl);
+    }
+}
+
+TEST("qlisttbl->freeze()") {
+    qlisttbl_t *tbl = qlisttbl(0);
+    tbl->putstr(tbl, "key", "old");
+    tbl->putstr(tbl, "other", "value");
+    tbl->putstr(tbl, "key", "new");
+    qfrozentbl_t *frozen = tbl->freeze(tbl);
+    ASSERT_EQUAL_INT(frozen->size(frozen), 2);
+    ASSERT_EQUAL_STR(frozen->getstr(frozen, "key", false),
+                     tbl->getstr(tbl, "key", false));
+    frozen->free(frozen);
+    tbl->free(tbl);
+
+    tbl = qlisttbl(QLISTTBL_CASEINSENSITIVE | QLISTTBL_LOOKUPFORWARD);
+    tbl->putstr(tbl, "Key", "old");
+    tbl->putstr(tbl, "KEY", "new");
+    frozen = tbl->freeze(tbl);
+    ASSERT_EQUAL_STR(frozen->getstr(frozen, "key", false), "old");
+    frozen->free(frozen);
+    tbl->free(tbl);
+}
+
+QUNIT_END();
@@ -0,0 +1,459 @@
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "qunit.h"
+#include "qlibc.h"
+
+static char memory[1024 * 64];
+
+static void *concurrent_writer(void *arg) {
+    qhasharr_t *tbl = (qhasharr_t *) arg;
+    char key[16], value[128];
+    int i;
+    for (i = 0; i < 20000; i++) {
+        int n = i % 50;
+        snprintf(key, sizeof(key), "key%d", n);
+        snprintf(value, sizeof(value), "%d:%0100d", n, i);
+        tbl->putstr(tbl, key, value);
+        if (i % 3 == 0)
+            tbl->remove(tbl, key);
+    }
+    return NULL;
+}
+
+static void *concurrent_reader(void *arg) {
+    qhasharr_t *tbl = (qhasharr_t *) arg;
+    char key[16];
+    int i;
+    for (i = 0; i < 20000; i++) {
+        int n = i % 50;
+        snprintf(key, sizeof(key), "key%d", n);
+        char *value = tbl->getstr(tbl, key);
+        if (value == NULL)
+            continue;
+        // a torn read would mix up two different values.
+        char *colon = strchr(value, ':');
+        if (atoi(value) != n || colon == NULL || strlen(colon + 1) != 100) {
+            free(value);
+            return (void *) 1;
+        }
+        free(value);
+    }
+    return NULL;
+}
+
+static void update_counter(void *userdata, void *value, bool created) {
+    int64_t n;
+    memcpy(&n, value, sizeof(n));
+    if (created == true)
+        n = *(int64_t *) userdata;
+    n++;
+    memcpy(value, &n, sizeof(n));
+}
+
+QUNIT_START("Test qhasharr.c");
+
+TEST("put()/get()/remove()") {
+    qhasharr_t *tbl = qhasharr(memory, sizeof(memory));
+    ASSERT(tbl->putstr(tbl, "key1", "value1") == true);
+    ASSERT(tbl->putstr(tbl, "key2", "value2") == true);
+    ASSERT(tbl->putstr(tbl, "key1", "value3") == true);
+    ASSERT_EQUAL_INT(tbl->size(tbl, NULL, NULL), 2);
+
+    char *str = tbl->getstr(tbl, "key1");
+    ASSERT_EQUAL_STR(str, "value3");
+    free(str);
+    ASSERT(tbl->remove(tbl, "key1") == true);
+    ASSERT(tbl->getstr(tbl, "key1") == NULL);
+    ASSERT_EQUAL_INT(tbl->size(tbl, NULL, NULL), 1);
+    tbl->free(tbl);
+}
+
+TEST("iterbegin()/iternext()/iterend()") {
+    int options[] = { 0, QHASHARR_CONCURRENT };
+    int k;
+    for (k = 0; k < 2; k++) {
+        qhasharr_t *tbl = qhasharr_opt(memory, sizeof(memory), 0, 0,
+                                       options[k]);
+        char big[200];
+        memset(big, 'x', sizeof(big) - 1);
+        big[sizeof(big) - 1] = '\0';
+        ASSERT(tbl->putstr(tbl, "short", "value") == true);
+        ASSERT(tbl->putstr(tbl, "long", big) == true);
+        ASSERT(tbl->putstr(tbl, "a-key-longer-than-16-bytes", "v") == true);
+
+        int n = 0, nwrong = 0;
+        qiter_t it;
+        tbl->iterbegin(tbl, &it);
+        while (tbl->iternext(tbl, &it) == true) {
+            if (it.namelen == 5 && !strncmp(it.name, "short", 5)) {
+                if (strcmp(it.data, "value") != 0)
+                    nwrong++;
+            } else if (it.namelen == 4 && !strncmp(it.name, "long", 4)) {
+                if (it.size != sizeof(big) || strcmp(it.data, big) != 0)
+                    nwrong++;
+            } else if (it.namelen != 16
+                    || strncmp(it.name, "a-key-longer-tha", 16) != 0
+                    || strcmp(it.data, "v") != 0) {
+                nwrong++;
+            }
+            n++;
+        }
+        ASSERT(tbl->iternext(tbl, &it) == false && errno == ENOENT);
+        tbl->iterend(tbl, &it);
+        ASSERT_EQUAL_INT(n, 3);
+        ASSERT_EQUAL_INT(nwrong, 0);
+
+        // writers can go on after iterend().
+        ASSERT(tbl->remove(tbl, "short") == true);
+        tbl->free(tbl);
+    }
+}
+
+TEST("QHASHARR_FASTHASH and QHASHARR_FINGERPRINT") {
+    qhasharr_t *tbl = qhasharr_opt(memory, sizeof(memory), 0, 0,
+                                   QHASHARR_FASTHASH | QHASHARR_FINGERPRINT);
+    const char *longkey1 = "this-is-a-very-long-key-number-1";
+    const char *longkey2 = "this-is-a-very-long-key-number-2";
+    ASSERT(tbl->putstr(tbl, longkey1, "value1") == true);
+    ASSERT(tbl->putstr(tbl, longkey2, "value2") == true);
+    tbl->free(tbl);
+
+    // options are kept in the memory.
+    tbl = qhasharr(memory, 0);
+    char *str = tbl->getstr(tbl, longkey2);
+    ASSERT_EQUAL_STR(str, "value2");
+    free(str);
+    str = tbl->getstr(tbl, longkey1);
+    ASSERT_EQUAL_STR(str, "value1");
+    free(str);
+    ASSERT(tbl->getstr(tbl, "this-is-a-very-long-key-number-3") == NULL);
+    ASSERT_EQUAL_INT(tbl->size(tbl, NULL, NULL), 2);
+    tbl->free(tbl);
+}
+
+TEST("slot geometry") {
+    ASSERT(qhasharr_calculate_memsize_opt(100, 0, 200)
+           > qhasharr_calculate_memsize(100));
+
+    size_t memsize = qhasharr_calculate_memsize_opt(10, 64, 200);
+    char *mem = (char *) malloc(memsize);
+    qhasharr_t *tbl = qhasharr_opt(mem, memsize, 64, 200, 0);
+    char value[200];
+    memset(value, 'x', sizeof(value));
+    value[sizeof(value) - 1] = '\0';
+    const char *key = "a-key-longer-than-default-keysize-of-16";
+    ASSERT(tbl->putstr(tbl, key, value) == true);
+
+    int maxslots, usedslots;
+    ASSERT_EQUAL_INT(tbl->size(tbl, &maxslots, &usedslots), 1);
+    ASSERT_EQUAL_INT(maxslots, 10);
+    ASSERT_EQUAL_INT(usedslots, 1);
+
+    qnobj_t obj;
+    int idx = 0;
+    ASSERT(tbl->getnext(tbl, &obj, &idx) == true);
+    ASSERT_EQUAL_STR(obj.name, key);
+    ASSERT_EQUAL_STR((char *) obj.data, value);
+    free(obj.name);
+    free(obj.data);
+    tbl->free(tbl);
+
+    ASSERT(qhasharr_opt(mem, memsize, 0, 70000, 0) == NULL);
+    free(mem);
+}
+
+TEST("QHASHARR_EVICT") {
+    size_t memsize = qhasharr_calculate_memsize(10);
+    char *mem = (char *) malloc(memsize);
+    qhasharr_t *tbl = qhasharr_opt(mem, memsize, 0, 0, QHASHARR_EVICT);
+    char key[16];
+    int i;
+    for (i = 0; i < 10; i++) {
+        snprintf(key, sizeof(key), "key%d", i);
+        ASSERT(tbl->putint(tbl, key, i) == true);
+    }
+    for (i = 0; i < 5; i++) {
+        snprintf(key, sizeof(key), "key%d", i);
+        ASSERT_EQUAL_INT(tbl->getint(tbl, key), i);
+    }
+
+    // full table evicts one of cold keys.
+    ASSERT(tbl->putint(tbl, "newkey", 100) == true);
+    ASSERT_EQUAL_INT(tbl->getint(tbl, "newkey"), 100);
+    ASSERT_EQUAL_INT(tbl->size(tbl, NULL, NULL), 10);
+    for (i = 0; i < 5; i++) {
+        snprintf(key, sizeof(key), "key%d", i);
+        ASSERT_EQUAL_INT(tbl->getint(tbl, key), i);
+    }
+    tbl->free(tbl);
+
+    // without the option, it fails.
+    tbl = qhasharr_opt(mem, memsize, 0, 0, 0);
+    for (i = 0; i < 10; i++) {
+        snprintf(key, sizeof(key), "key%d", i);
+        ASSERT(tbl->putint(tbl, key, i) == true);
+    }
+    ASSERT(tbl->putint(tbl, "newkey", 100) == false);
+    ASSERT(errno == ENOBUFS);
+    tbl->free(tbl);
+    free(mem);
+}
+
+TEST("putttl()") {
+    size_t memsize = qhasharr_calculate_memsize(10);
+    char *mem = (char *) malloc(memsize);
+    qhasharr_t *tbl = qhasharr(mem, memsize);
+    ASSERT(tbl->putttl(tbl, "key1", "value1", 7, 1) == true);
+    ASSERT(tbl->putttl(tbl, "key2", "value2", 7, 0) == true);
+    char *str = tbl->getstr(tbl, "key1");
+    ASSERT_EQUAL_STR(str, "value1");
+    free(str);
+    sleep(2);
+    ASSERT(tbl->getstr(tbl, "key1") == NULL);
+    str = tbl->getstr(tbl, "key2");
+    ASSERT_EQUAL_STR(str, "value2");
+    free(str);
+
+    qnobj_t obj;
+    int idx = 0, n = 0;
+    while (tbl->getnext(tbl, &obj, &idx) == true) {
+        ASSERT_EQUAL_STR(obj.name, "key2");
+        free(obj.name);
+        free(obj.data);
+        n++;
+    }
+    ASSERT_EQUAL_INT(n, 1);
+
+    // expired slot is reclaimed when the table is full.
+    char key[16];
+    int i;
+    for (i = 0; i < 8; i++) {
+        snprintf(key, sizeof(key), "key%d", i + 10);
+        ASSERT(tbl->putint(tbl, key, i) == true);
+    }
+    ASSERT(tbl->putint(tbl, "lastkey", 1) == true);
+    ASSERT(tbl->putint(tbl, "overflow", 1) == false);
+    tbl->free(tbl);
+    free(mem);
+}
+
+TEST("update()") {
+    qhasharr_t *tbl = qhasharr(memory, sizeof(memory));
+    int64_t init = 100, n;
+    ASSERT(tbl->update(tbl, "counter", sizeof(n), 0, update_counter,
+                       &init) == true);
+    ASSERT(tbl->update(tbl, "counter", sizeof(n), 0, update_counter,
+                       &init) == true);
+    size_t size;
+    int64_t *value = (int64_t *) tbl->get(tbl, "counter", &size);
+    ASSERT_EQUAL_INT(size, sizeof(n));
+    ASSERT_EQUAL_INT(*value, 102);
+    free(value);
+    ASSERT_EQUAL_INT(tbl->size(tbl, NULL, NULL), 1);
+
+    // a value of different size is replaced.
+    ASSERT(tbl->putstr(tbl, "other", "x") == true);
+    ASSERT(tbl->update(tbl, "other", sizeof(n), 0, update_counter,
+                       &init) == true);
+    value = (int64_t *) tbl->get(tbl, "other", NULL);
+    ASSERT_EQUAL_INT(*value, 101);
+    free(value);
+
+    // values must fit in a slot.
+    ASSERT(tbl->update(tbl, "big", 1000, 0, update_counter, &init) == false);
+    ASSERT_EQUAL_INT(errno, EINVAL);
+    tbl->free(tbl);
+}
+
+TEST("QHASHARR_CONCURRENT") {
+    qhasharr_t *tbl = qhasharr_opt(memory, sizeof(memory), 0, 0,
+                                   QHASHARR_CONCURRENT);
+    pthread_t threads[6];
+    int i;
+    for (i = 0; i < 6; i++) {
+        pthread_create(&threads[i], NULL,
+                       (i < 2) ? concurrent_writer : concurrent_reader, tbl);
+    }
+    bool ok = true;
+    for (i = 0; i < 6; i++) {
+        void *ret;
+        pthread_join(threads[i], &ret);
+        if (ret != NULL)
+            ok = false;
+    }
+    ASSERT(ok == true);
+    ASSERT(tbl->size(tbl, NULL, NULL) <= 50);
+    tbl->free(tbl);
+}
+
+TEST("qhasharr_mmap()") {
+    char path[] = "/tmp/test_qhasharr.XXXXXX";
+    int fd = mkstemp(path);
+    ASSERT(fd >= 0);
+    close(fd);
+
+    // a new table in an empty file.
+    qhasharr_t *tbl = qhasharr_mmap(path, 1000, 0, 64, 0);
+    ASSERT(tbl != NULL);
+    int i;
+    for (i = 0; i < 100; i++) {
+        char key[32];
+        snprintf(key, sizeof(key), "key%d", i);
+        ASSERT(tbl->putint(tbl, key, i) == true);
+    }
+    tbl->free(tbl);
+
+    // warm start with the same geometry, or without geometry.
+    tbl = qhasharr_mmap(path, 1000, 0, 64, 0);
+    ASSERT(tbl != NULL);
+    ASSERT_EQUAL_INT(tbl->size(tbl, NULL, NULL), 100);
+    ASSERT_EQUAL_INT(tbl->getint(tbl, "key42"), 42);
+    ASSERT(tbl->putstr(tbl, "new", "value") == true);
+    ASSERT(tbl->sync(tbl) == true);
+    tbl->free(tbl);
+
+    tbl = qhasharr_mmap(path, 0, 0, 0, 0);
+    ASSERT(tbl != NULL);
+    ASSERT_EQUAL_INT(tbl->size(tbl, NULL, NULL), 101);
+    char *str = tbl->getstr(tbl, "new");
+    ASSERT_EQUAL_STR(str, "value");
+    free(str);
+    tbl->free(tbl);
+
+    // modified after the last checkpoint.
+    tbl = qhasharr_mmap(path, 0, 0, 0, 0);
+    ASSERT(tbl != NULL);
+    tbl->putstr(tbl, "dirty", "value");
+    void *map = tbl->map;
+    size_t mapsize = tbl->mapsize;
+    free(tbl);  // skip checkpoint as if the process crashed
+    munmap(map, mapsize);
+    errno = 0;
+    ASSERT(qhasharr_mmap(path, 0, 0, 0, 0) == NULL);
+    ASSERT_EQUAL_INT(errno, EBADMSG);
+    tbl = qhasharr_mmap(path, 1000, 0, 64, 0);
+    ASSERT(tbl != NULL);
+    ASSERT_EQUAL_INT(tbl->size(tbl, NULL, NULL), 0);
+    tbl->free(tbl);
+
+    // different geometry starts over.
+    tbl = qhasharr_mmap(path, 500, 0, 0, 0);
+    ASSERT(tbl != NULL);
+    int maxslots = 0;
+    tbl->size(tbl, &maxslots, NULL);
+    ASSERT_EQUAL_INT(maxslots, 500);
+    tbl->free(tbl);
+
+    // memory tables don't have a file to sync.
+    tbl = qhasharr(memory, sizeof(memory));
+    ASSERT(tbl->sync(tbl) == false);
+    ASSERT_EQUAL_INT(errno, ENOTSUP);
+    tbl->free(tbl);
+
+    unlink(path);
+}
+
+TEST("stats()") {
+    char memory[1000 * 10];
+    qhasharr_t *tbl = qhasharr(memory, sizeof(memory));
+    int maxslots = 0;
+    tbl->size(tbl, &maxslots, NULL);
+
+    char bigvalue[_Q_HASHARR_VALUESIZE * 2];
+    memset(bigvalue, 'x', sizeof(bigvalue));
+    ASSERT(tbl->put(tbl, "big", bigvalue, sizeof(bigvalue)) == true);
+    ASSERT(tbl->putstr(tbl, "e1", "a") == true);
+    ASSERT(tbl->putstr(tbl, "e1", "b") == true);  // replaced
+    ASSERT(tbl->getstr(tbl, "none") == NULL);
+
+    qstats_t stats;
+    ASSERT(tbl->stats(tbl, &stats) == true);
+    ASSERT_EQUAL_INT(stats.num, 2);
+    ASSERT_EQUAL_INT(stats.slots, maxslots);
+    ASSERT_EQUAL_INT(stats.usedslots, 3);
+    ASSERT(stats.maxchain >= 1);
+    ASSERT_EQUAL_INT(stats.keybytes, 3 + 2);
+    ASSERT_EQUAL_INT(stats.valuebytes, sizeof(bigvalue) + 2);
+    ASSERT_EQUAL_INT(stats.keybytes + stats.valuebytes + stats.overhead,
+                     qhasharr_calculate_memsize(maxslots));
+#ifdef BUILD_STATS
+    ASSERT_EQUAL_INT(stats.puthits, 1);
+    ASSERT_EQUAL_INT(stats.putmisses, 2);
+    ASSERT_EQUAL_INT(stats.getmisses, 1);
+#endif
+    tbl->free(tbl);
+}
+
+TEST("compact()") {
+    size_t memsize = qhasharr_calculate_memsize(600);
+    char *mem = (char *) malloc(memsize);
+    qhasharr_t *tbl = qhasharr(mem, memsize);
+    int maxslots = 0;
+    tbl->size(tbl, &maxslots, NULL);
+    ASSERT_EQUAL_INT(maxslots, 600);
+
+    // churn with long values which take 3 slots each.
+    char key[32], value[_Q_HASHARR_VALUESIZE * 3];
+    int i;
+    for (i = 0; i < 2000; i++) {
+        snprintf(key, sizeof(key), "k%d", (i * 7919) % 150);
+        if (i % 4 == 3) {
+            tbl->remove(tbl, key);
+            continue;
+        }
+        memset(value, 'a' + i % 26, sizeof(value));
+        snprintf(value, sizeof(value), "%d", i);
+        tbl->put(tbl, key, value, sizeof(value));
+    }
+    int num, usedslots;
+    num = tbl->size(tbl, NULL, &usedslots);
+
+    qstats_t before, after;
+    ASSERT(tbl->stats(tbl, &before) == true);
+
+    // incremental steps, then until nothing moves.
+    ASSERT(tbl->compact(tbl, 10) >= 0);
+    int moved;
+    for (i = 0; (moved = tbl->compact(tbl, 0)) > 0; i++);
+    ASSERT_EQUAL_INT(moved, 0);
+    ASSERT(i > 0);
+
+    ASSERT(tbl->stats(tbl, &after) == true);
+    ASSERT(after.maxchain < before.maxchain);
+    ASSERT_EQUAL_INT(tbl->size(tbl, NULL, &i), num);
+    ASSERT_EQUAL_INT(i, usedslots);
+
+    // every value still reads back the same.
+    int found = 0;
+    for (i = 0; i < 150; i++) {
+        snprintf(key, sizeof(key), "k%d", i);
+        size_t size = 0;
+        char *got = (char *) tbl->get(tbl, key, &size);
+        if (got == NULL)
+            continue;
+        found++;
+        ASSERT_EQUAL_INT(size, sizeof(value));
+        int n = atoi(got);
+        memset(value, 'a' + n % 26, sizeof(value));
+        snprintf(value, sizeof(value), "%d", n);
+        ASSERT(memcmp(got, value, sizeof(value)) == 0);
+        free(got);
+    }
+    ASSERT_EQUAL_INT(found, num);
+
+    // free slots are still found after compaction.
+    tbl->clear(tbl);
+    for (i = 0; i < 200; i++) {
+        snprintf(key, sizeof(key), "n%d", i);
+        ASSERT(tbl->put(tbl, key, value, sizeof(value)) == true);
+    }
+    ASSERT(tbl->put(tbl, "full", value, sizeof(value)) == false);
+    ASSERT_EQUAL_INT(errno, ENOBUFS);
+
+    tbl->free(tbl);
+    free(mem);
+}
+
+QUNIT_END();
@@ -0,0 +1,474 @@
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include "qunit.h"
+#include "qlibc.h"
+
+static void *concurrent_worker(void *arg) {
+    qhashtbl_t *tbl = (qhashtbl_t *) arg;
+    char key[32];
+    int i;
+    for (i = 0; i < 1000; i++) {
+        snprintf(key, sizeof(key), "%p-%d", (void *) pthread_self(), i);
+        tbl->putint(tbl, key, i);
+        if (tbl->getint(tbl, key) != i)
+            return (void *) 1;
+        if (i % 2 == 0)
+            tbl->remove(tbl, key);
+    }
+    return NULL;
+}
+
+// remove keys of even values while traversing, returns visited entries.
+static int remove_during_getnext(qhashtbl_t *tbl, bool newmem) {
+    int cnt = 0;
+    qhnobj_t obj;
+    memset((void *) &obj, 0, sizeof(obj));
+    while (tbl->getnext(tbl, &obj, newmem) == true) {
+        if (atoi((char *) obj.data) % 2 == 0)
+            tbl->remove(tbl, obj.name);
+        if (newmem == true) {
+            free(obj.name);
+            free(obj.data);
+        }
+        cnt++;
+    }
+    return cnt;
+}
+
+QUNIT_START("Test qhashtbl.c");
+
+TEST("put()/get()/remove()") {
+    qhashtbl_t *tbl = qhashtbl(0, 0);
+    ASSERT(tbl->putstr(tbl, "key1", "value1") == true);
+    ASSERT(tbl->putstr(tbl, "key2", "value2") == true);
+    ASSERT(tbl->putstr(tbl, "key1", "value3") == true);
+    ASSERT_EQUAL_INT(tbl->size(tbl), 2);
+    ASSERT_EQUAL_STR(tbl->getstr(tbl, "key1", false), "value3");
+    ASSERT_EQUAL_STR(tbl->getstr(tbl, "key2", false), "value2");
+    ASSERT(tbl->remove(tbl, "key1") == true);
+    ASSERT(tbl->getstr(tbl, "key1", false) == NULL);
+    ASSERT(tbl->remove(tbl, "key1") == false);
+    ASSERT_EQUAL_INT(tbl->size(tbl), 1);
+    tbl->free(tbl);
+}
+
+TEST("puthashed()/gethashed()/putref()") {
+    qhashtbl_t *tbl = qhashtbl(0, 0);
+    const char *line = "key1: value1";
+    uint32_t hash = tbl->hash(tbl, line, 4);
+    ASSERT(tbl->puthashed(tbl, line, 4, hash, "value1", 7) == true);
+    ASSERT_EQUAL_STR(tbl->getstr(tbl, "key1", false), "value1");
+    ASSERT_EQUAL_STR(tbl->gethashed(tbl, line, 4, hash, NULL, false), "value1");
+    ASSERT(tbl->gethashed(tbl, line, 3, tbl->hash(tbl, line, 3), NULL,
+                          false) == NULL);
+
+    char refdata[] = "refvalue";
+    ASSERT(tbl->putref(tbl, "key2", refdata, sizeof(refdata)) == true);
+    ASSERT(tbl->getstr(tbl, "key2", false) == refdata);
+    ASSERT(tbl->removehashed(tbl, "key2", 4, tbl->hash(tbl, "key2", 4)) == true);
+    ASSERT_EQUAL_INT(tbl->size(tbl), 1);
+    tbl->free(tbl);
+
+    tbl = qhashtbl(0, QHASHTBL_OPENADDR);
+    ASSERT(tbl->puthashed(tbl, line, 4, hash, "value1", 7) == true);
+    ASSERT_EQUAL_STR(tbl->getstr(tbl, "key1", false), "value1");
+    ASSERT(tbl->putref(tbl, "key2", refdata, sizeof(refdata)) == false);
+    tbl->free(tbl);
+}
+
+TEST("short and long entries replacing each other") {
+    int options[] = { 0, QHASHTBL_NODEPOOL, QHASHTBL_CONCURRENT,
+                      QHASHTBL_RESIZABLE | QHASHTBL_THREADSAFE };
+    char longval[200];
+    memset(longval, 'x', sizeof(longval) - 1);
+    longval[sizeof(longval) - 1] = '\0';
+    int k;
+    for (k = 0; k < (int) (sizeof(options) / sizeof(int)); k++) {
+        qhashtbl_t *tbl = qhashtbl(0, options[k]);
+        ASSERT(tbl->putstr(tbl, "key", "short") == true);
+        ASSERT_EQUAL_STR(tbl->getstr(tbl, "key", false), "short");
+        ASSERT(tbl->putstr(tbl, "key", longval) == true);
+        ASSERT_EQUAL_STR(tbl->getstr(tbl, "key", false), longval);
+        ASSERT(tbl->putstr(tbl, "key", "tiny") == true);
+        ASSERT_EQUAL_STR(tbl->getstr(tbl, "key", false), "tiny");
+        ASSERT(tbl->putstr(tbl, "key", "a bit longer value") == true);
+        ASSERT_EQUAL_STR(tbl->getstr(tbl, "key", false),
+                         "a bit longer value");
+        ASSERT(tbl->putstr(tbl, longval, "short") == true);
+        ASSERT_EQUAL_STR(tbl->getstr(tbl, longval, false), "short");
+        ASSERT_EQUAL_INT(tbl->size(tbl), 2);
+
+        // put back the data of an entry itself
+        qhnobj_t obj;
+        memset((void *) &obj, 0, sizeof(obj));
+        while (tbl->getnext(tbl, &obj, true) == true) {
+            ASSERT(tbl->put(tbl, obj.name, obj.data, obj.size) == true);
+            free(obj.name);
+            free(obj.data);
+        }
+        ASSERT_EQUAL_STR(tbl->getstr(tbl, "key", false),
+                         "a bit longer value");
+        ASSERT(tbl->remove(tbl, "key") == true);
+        ASSERT(tbl->remove(tbl, longval) == true);
+        ASSERT_EQUAL_INT(tbl->size(tbl), 0);
+        tbl->free(tbl);
+    }
+}
+
+TEST("iterbegin()/iternext()/iterend()") {
+    int options[] = { 0, QHASHTBL_THREADSAFE, QHASHTBL_RESIZABLE,
+                      QHASHTBL_OPENADDR, QHASHTBL_CONCURRENT };
+    int k;
+    for (k = 0; k < (int) (sizeof(options) / sizeof(int)); k++) {
+        qhashtbl_t *tbl = qhashtbl(10, options[k]);
+        int i;
+        for (i = 0; i < 1000; i++) {
+            char key[16];
+            snprintf(key, sizeof(key), "key%d", i);
+            tbl->putint(tbl, key, i);
+        }
+
+        int n = 0, nwrong = 0;
+        qiter_t it;
+        tbl->iterbegin(tbl, &it);
+        while (tbl->iternext(tbl, &it) == true) {
+            if (strlen(it.name) != it.namelen
+                    || atoi(it.name + 3) != atoi(it.data)
+                    || tbl->getint(tbl, it.name) != atoi(it.data))
+                nwrong++;
+            n++;
+        }
+        ASSERT(tbl->iternext(tbl, &it) == false && errno == ENOENT);
+        tbl->iterend(tbl, &it);
+        ASSERT_EQUAL_INT(n, 1000);
+        ASSERT_EQUAL_INT(nwrong, 0);
+
+        tbl->clear(tbl);
+        tbl->iterbegin(tbl, &it);
+        ASSERT(tbl->iternext(tbl, &it) == false);
+        tbl->iterend(tbl, &it);
+        tbl->free(tbl);
+    }
+}
+
+TEST("QHASHTBL_FASTHASH") {
+    ASSERT(qhashxx64("", 0) == 0xEF46DB3751D8E999ULL);
+
+    qhashtbl_t *tbl = qhashtbl(0, QHASHTBL_FASTHASH);
+    ASSERT(tbl->hash(tbl, "key1", 4) == qhashxx32("key1", 4));
+    ASSERT(tbl->putstr(tbl, "key1", "value1") == true);
+    ASSERT_EQUAL_STR(tbl->getstr(tbl, "key1", false), "value1");
+    ASSERT(tbl->remove(tbl, "key1") == true);
+    ASSERT_EQUAL_INT(tbl->size(tbl), 0);
+    tbl->free(tbl);
+}
+
+TEST("putbatch()/getbatch()") {
+    qhashtbl_t *tbl = qhashtbl(0, QHASHTBL_THREADSAFE);
+    qnobj_t objs[40];
+    char names[40][16];
+    int i;
+    for (i = 0; i < 40; i++) {
+        snprintf(names[i], sizeof(names[i]), "key%d", i);
+        objs[i].name = names[i];
+        objs[i].data = names[i];
+        objs[i].size = strlen(names[i]) + 1;
+    }
+    ASSERT_EQUAL_INT(tbl->putbatch(tbl, objs, 40), 40);
+    ASSERT_EQUAL_INT(tbl->size(tbl), 40);
+
+    memset((void *) objs, 0, sizeof(objs));
+    for (i = 0; i < 40; i++)
+        objs[i].name = names[(i * 7) % 40];
+    objs[39].name = "nokey";
+    ASSERT_EQUAL_INT(tbl->getbatch(tbl, objs, 40, false), 39);
+    ASSERT_EQUAL_STR((char *) objs[3].data, names[21]);
+    ASSERT(objs[39].data == NULL);
+    tbl->free(tbl);
+}
+
+TEST("QHASHTBL_RESIZABLE") {
+    qhashtbl_t *tbl = qhashtbl(4, QHASHTBL_RESIZABLE);
+    char key[32];
+    int i;
+    for (i = 0; i < 10000; i++) {
+        snprintf(key, sizeof(key), "key%d", i);
+        ASSERT(tbl->putint(tbl, key, i) == true);
+    }
+    ASSERT_EQUAL_INT(tbl->size(tbl), 10000);
+    ASSERT(tbl->range > 4);
+
+    int found = 0;
+    for (i = 0; i < 10000; i++) {
+        snprintf(key, sizeof(key), "key%d", i);
+        if (tbl->getint(tbl, key) == i)
+            found++;
+    }
+    ASSERT_EQUAL_INT(found, 10000);
+
+    int cnt = 0;
+    qhnobj_t obj;
+    memset((void *) &obj, 0, sizeof(obj));
+    while (tbl->getnext(tbl, &obj, false) == true)
+        cnt++;
+    ASSERT_EQUAL_INT(cnt, 10000);
+
+    for (i = 0; i < 9990; i++) {
+        snprintf(key, sizeof(key), "key%d", i);
+        tbl->remove(tbl, key);
+    }
+    ASSERT_EQUAL_INT(tbl->size(tbl), 10);
+    ASSERT_EQUAL_INT(tbl->getint(tbl, "key9995"), 9995);
+    tbl->clear(tbl);
+    ASSERT_EQUAL_INT(tbl->size(tbl), 0);
+    tbl->free(tbl);
+}
+
+TEST("QHASHTBL_RESIZABLE remove during getnext()") {
+    qhashtbl_t *tbl = qhashtbl(4, QHASHTBL_RESIZABLE);
+    char key[32];
+    int i;
+    for (i = 0; i < 1000; i++) {
+        snprintf(key, sizeof(key), "key%d", i);
+        tbl->putint(tbl, key, i);
+    }
+    size_t range = tbl->range;
+
+    // removing 9 of 10 keys would shrink the table halfway through.
+    int cnt = 0;
+    qhnobj_t obj;
+    memset((void *) &obj, 0, sizeof(obj));
+    while (tbl->getnext(tbl, &obj, false) == true) {
+        if (atoi((char *) obj.data) % 10 != 0)
+            tbl->remove(tbl, obj.name);
+        cnt++;
+    }
+    ASSERT_EQUAL_INT(cnt, 1000);
+    ASSERT_EQUAL_INT(tbl->size(tbl), 100);
+
+    // and shrinks once the traversal is over.
+    ASSERT(tbl->range < range);
+    cnt = 0;
+    memset((void *) &obj, 0, sizeof(obj));
+    while (tbl->getnext(tbl, &obj, false) == true)
+        cnt++;
+    ASSERT_EQUAL_INT(cnt, 100);
+    int found = 0;
+    for (i = 0; i < 1000; i += 10) {
+        snprintf(key, sizeof(key), "key%d", i);
+        if (tbl->getint(tbl, key) == i)
+            found++;
+    }
+    ASSERT_EQUAL_INT(found, 100);
+    tbl->free(tbl);
+}
+
+TEST("QHASHTBL_OPENADDR") {
+    qhashtbl_t *tbl = qhashtbl(0, QHASHTBL_OPENADDR);
+    char key[32];
+    int i;
+    for (i = 0; i < 10000; i++) {
+        snprintf(key, sizeof(key), "key%d", i);
+        ASSERT(tbl->putint(tbl, key, i) == true);
+    }
+    ASSERT_EQUAL_INT(tbl->size(tbl), 10000);
+    ASSERT(tbl->putstr(tbl, "key1", "a longer value than before") == true);
+    ASSERT_EQUAL_STR(tbl->getstr(tbl, "key1", false),
+                     "a longer value than before");
+
+    for (i = 0; i < 10000; i += 2) {
+        snprintf(key, sizeof(key), "key%d", i);
+        ASSERT(tbl->remove(tbl, key) == true);
+    }
+    ASSERT_EQUAL_INT(tbl->size(tbl), 5000);
+
+    int found = 0;
+    for (i = 0; i < 10000; i++) {
+        snprintf(key, sizeof(key), "key%d", i);
+        char *str = tbl->getstr(tbl, key, false);
+        if ((i % 2 == 0 && str == NULL) || (i % 2 == 1 && str != NULL))
+            found++;
+    }
+    ASSERT_EQUAL_INT(found, 10000);
+
+    int cnt = 0;
+    qhnobj_t obj;
+    memset((void *) &obj, 0, sizeof(obj));
+    while (tbl->getnext(tbl, &obj, false) == true)
+        cnt++;
+    ASSERT_EQUAL_INT(cnt, 5000);
+
+    tbl->clear(tbl);
+    ASSERT_EQUAL_INT(tbl->size(tbl), 0);
+    ASSERT(tbl->getstr(tbl, "key1", false) == NULL);
+    tbl->free(tbl);
+}
+
+TEST("QHASHTBL_OPENADDR remove during getnext()") {
+    qhashtbl_t *tbl = qhashtbl(0, QHASHTBL_OPENADDR);
+    char key[32];
+    int i;
+    for (i = 0; i < 177; i++) {
+        snprintf(key, sizeof(key), "key%d", i);
+        tbl->putint(tbl, key, i);
+    }
+    ASSERT_EQUAL_INT(remove_during_getnext(tbl, false), 177);
+    ASSERT_EQUAL_INT(tbl->size(tbl), 88);
+    ASSERT_EQUAL_INT(remove_during_getnext(tbl, true), 88);
+    tbl->free(tbl);
+}
+
+TEST("QHASHTBL_CONCURRENT") {
+    ASSERT(qhashtbl(0, QHASHTBL_CONCURRENT | QHASHTBL_RESIZABLE) == NULL);
+
+    qhashtbl_t *tbl = qhashtbl(0, QHASHTBL_CONCURRENT);
+    pthread_t threads[8];
+    int i;
+    for (i = 0; i < 8; i++)
+        pthread_create(&threads[i], NULL, concurrent_worker, tbl);
+    int failed = 0;
+    for (i = 0; i < 8; i++) {
+        void *ret;
+        pthread_join(threads[i], &ret);
+        if (ret != NULL)
+            failed++;
+    }
+    ASSERT_EQUAL_INT(failed, 0);
+    ASSERT_EQUAL_INT(tbl->size(tbl), 8 * 500);
+
+    int cnt = 0;
+    qhnobj_t obj;
+    memset((void *) &obj, 0, sizeof(obj));
+    while (tbl->getnext(tbl, &obj, true) == true) {
+        free(obj.data);
+        free(obj.name);
+        cnt++;
+    }
+    ASSERT_EQUAL_INT(cnt, 8 * 500);
+    tbl->free(tbl);
+}
+
+TEST("QHASHTBL_CONCURRENT remove during getnext()") {
+    // one slot, so every key is in the chain being traversed.
+    qhashtbl_t *tbl = qhashtbl(1, QHASHTBL_CONCURRENT);
+    char key[32];
+    int i;
+    for (i = 0; i < 177; i++) {
+        snprintf(key, sizeof(key), "key%d", i);
+        tbl->putint(tbl, key, i);
+    }
+    ASSERT_EQUAL_INT(remove_during_getnext(tbl, true), 177);
+    ASSERT_EQUAL_INT(tbl->size(tbl), 88);
+    ASSERT_EQUAL_INT(remove_during_getnext(tbl, true), 88);
+    tbl->free(tbl);
+}
+
+TEST("stats()") {
+    int options[] = { 0, QHASHTBL_OPENADDR, QHASHTBL_CONCURRENT };
+    int opt;
+    for (opt = 0; opt < 3; opt++) {
+        qhashtbl_t *tbl = qhashtbl(4, options[opt]);
+        int i;
+        for (i = 0; i < 10; i++)
+            tbl->putstrf(tbl, "k", "v");  // replaced
+        for (i = 0; i < 10; i++) {
+            char key[8];
+            snprintf(key, sizeof(key), "k%d", i);
+            tbl->putstr(tbl, key, "v");
+        }
+        ASSERT(tbl->getstr(tbl, "k0", false) != NULL);
+        ASSERT(tbl->getstr(tbl, "none", false) == NULL);
+
+        qstats_t stats;
+        ASSERT(tbl->stats(tbl, NULL) == false);
+        ASSERT(tbl->stats(tbl, &stats) == true);
+        ASSERT_EQUAL_INT(stats.num, 11);
+        ASSERT(stats.slots >= 4);
+        ASSERT(stats.usedslots > 0 && stats.usedslots <= stats.slots);
+        ASSERT(stats.maxchain >= 1);
+        ASSERT_EQUAL_INT(stats.keybytes, 2 + 10 * 3);
+        ASSERT_EQUAL_INT(stats.valuebytes, 11 * 2);
+        ASSERT(stats.overhead > 0);
+        if (options[opt] != QHASHTBL_OPENADDR) {
+            ASSERT_EQUAL_INT(stats.collisions, 11 - stats.usedslots);
+            ASSERT(stats.loadfactor == 11.0 / 4);
+        }
+#ifdef BUILD_STATS
+        ASSERT_EQUAL_INT(stats.puthits, 9);
+        ASSERT_EQUAL_INT(stats.putmisses, 11);
+        ASSERT_EQUAL_INT(stats.gethits, 1);
+        ASSERT_EQUAL_INT(stats.getmisses, 1);
+#endif
+        tbl->free(tbl);
+    }
+}
+
+TEST("snapshot()/restore()") {
+    char path[] = "/tmp/test_qhashtbl.XXXXXX";
+    int fd = mkstemp(path);
+    ASSERT(fd >= 0);
+    close(fd);
+
+    int options[] = { 0, QHASHTBL_RESIZABLE, QHASHTBL_OPENADDR,
+                      QHASHTBL_CONCURRENT | QHASHTBL_FASTHASH };
+    int opt;
+    for (opt = 0; opt < 4; opt++) {
+        qhashtbl_t *tbl = qhashtbl(10, options[opt]);
+        int i;
+        for (i = 0; i < 1000; i++) {
+            char key[16];
+            snprintf(key, sizeof(key), "key%d", i);
+            tbl->putint(tbl, key, i);
+        }
+        ASSERT(tbl->snapshot(tbl, path) == true);
+
+        // into the same kind of table and the others, possibly rehashed.
+        int opt2;
+        for (opt2 = 0; opt2 < 4; opt2++) {
+            qhashtbl_t *tbl2 = qhashtbl(10, options[opt2]);
+            tbl2->putint(tbl2, "key0", -1);  // replaced
+            tbl2->putint(tbl2, "other", -1);
+            ASSERT_EQUAL_INT(tbl2->restore(tbl2, path), 1000);
+            ASSERT_EQUAL_INT(tbl2->size(tbl2), 1001);
+            for (i = 0; i < 1000; i++) {
+                char key[16];
+                snprintf(key, sizeof(key), "key%d", i);
+                ASSERT_EQUAL_INT(tbl2->getint(tbl2, key), i);
+            }
+            tbl2->free(tbl2);
+        }
+        tbl->free(tbl);
+    }
+
+    // an empty table.
+    qhashtbl_t *tbl = qhashtbl(0, 0);
+    ASSERT(tbl->snapshot(tbl, path) == true);
+    ASSERT_EQUAL_INT(tbl->restore(tbl, path), 0);
+
+    // a corrupted snapshot is refused before anything is loaded.
+    tbl->putstr(tbl, "key", "value");
+    ASSERT(tbl->snapshot(tbl, path) == true);
+    fd = open(path, O_WRONLY);
+    ASSERT(pwrite(fd, "X", 1, 80) == 1);
+    close(fd);
+    qhashtbl_t *tbl2 = qhashtbl(0, 0);
+    ASSERT_EQUAL_INT(tbl2->restore(tbl2, path), -1);
+    ASSERT_EQUAL_INT(errno, EBADMSG);
+    ASSERT_EQUAL_INT(tbl2->size(tbl2), 0);
+    tbl2->free(tbl2);
+
+    // not a qhashtbl snapshot.
+    qlist_t *list = qlist(0);
+    list->addlast(list, "value", 6);
+    ASSERT(list->snapshot(list, path) == true);
+    ASSERT_EQUAL_INT(tbl->restore(tbl, path), -1);
+    ASSERT_EQUAL_INT(errno, EBADMSG);
+    list->free(list);
+    tbl->free(tbl);
+
+    unlink(path);
+}
+
+QUNIT_END();
@@ -0,0 +1,162 @@
+#include <errno.h>
+#include <pthread.h>
+#include "qunit.h"
+#include "qlibc.h"
+
+// QINTMAP_THREADSAFE doesn't lock when built with --disable-threadsafe.
+#ifndef DISABLE_THREADSAFE
+static void *threadsafe_worker(void *arg) {
+    qintmap_t *map = (qintmap_t *) arg;
+    uint64_t base = (uint64_t) (uintptr_t) pthread_self() << 20;
+    int64_t i;
+    for (i = 0; i < 10000; i++) {
+        map->putint(map, base + i, i);
+        if (map->getint(map, base + i) != i)
+            return (void *) 1;
+        if (i % 2 == 0)
+            map->remove(map, base + i);
+    }
+    return NULL;
+}
+#endif
+
+QUNIT_START("Test qintmap.c");
+
+TEST("put()/get()/remove()") {
+    qintmap_t *map = qintmap(0, 0);
+    ASSERT(map->put(map, 1, "value1", 7) == true);
+    ASSERT(map->put(map, 2, "value2", 7) == true);
+    ASSERT(map->put(map, 1, "value3", 7) == true);
+    ASSERT_EQUAL_INT(map->size(map), 2);
+    ASSERT_EQUAL_STR(map->get(map, 1, NULL, false), "value3");
+    ASSERT_EQUAL_STR(map->get(map, 2, NULL, false), "value2");
+    ASSERT(map->get(map, 3, NULL, false) == NULL && errno == ENOENT);
+    ASSERT(map->remove(map, 1) == true);
+    ASSERT(map->get(map, 1, NULL, false) == NULL);
+    ASSERT(map->remove(map, 1) == false && errno == ENOENT);
+    ASSERT_EQUAL_INT(map->size(map), 1);
+
+    // zero and the largest key are ordinary keys.
+    ASSERT(map->putint(map, 0, -1) == true);
+    ASSERT(map->putint(map, UINT64_MAX, 42) == true);
+    ASSERT_EQUAL_INT(map->getint(map, 0), -1);
+    ASSERT_EQUAL_INT(map->getint(map, UINT64_MAX), 42);
+    ASSERT_EQUAL_INT(map->getint(map, 2), 0);
+    ASSERT_EQUAL_INT(errno, EINVAL);
+    map->free(map);
+}
+
+TEST("inline and large values replacing each other") {
+    qintmap_t *map = qintmap(0, 0);
+    char large[100];
+    memset(large, 'x', sizeof(large) - 1);
+    large[sizeof(large) - 1] = '\0';
+
+    ASSERT(map->put(map, 7, "short", 6) == true);
+    ASSERT(map->put(map, 7, large, sizeof(large)) == true);
+    ASSERT_EQUAL_STR(map->get(map, 7, NULL, false), large);
+    ASSERT(map->put(map, 7, "tiny", 5) == true);
+    ASSERT_EQUAL_STR(map->get(map, 7, NULL, false), "tiny");
+
+    // put back data taken from the map itself.
+    size_t size;
+    char *data = map->get(map, 7, &size, false);
+    ASSERT(map->put(map, 8, data, size) == true);
+    ASSERT_EQUAL_STR(map->get(map, 8, NULL, false), "tiny");
+
+    char *copy = map->get(map, 7, &size, true);
+    ASSERT_EQUAL_STR(copy, "tiny");
+    ASSERT_EQUAL_INT(size, 5);
+    free(copy);
+
+    int obj;
+    ASSERT(map->putptr(map, 9, &obj) == true);
+    ASSERT(map->getptr(map, 9) == &obj);
+    ASSERT(map->getptr(map, 10) == NULL && errno == ENOENT);
+    map->free(map);
+}
+
+TEST("sequential and random keys with growing") {
+    qintmap_t *map = qintmap(0, 0);
+    int i, nwrong = 0;
+    for (i = 0; i < 100000; i++) {
+        map->putint(map, (uint64_t) i, i);
+        map->putint(map, (uint64_t) i * 0x100000001ULL + 0xABCDEF, -i);
+    }
+    ASSERT_EQUAL_INT(map->size(map), 200000);
+    for (i = 0; i < 100000; i++) {
+        if (map->getint(map, (uint64_t) i) != i
+                || map->getint(map, (uint64_t) i * 0x100000001ULL
+                               + 0xABCDEF) != -i)
+            nwrong++;
+    }
+    ASSERT_EQUAL_INT(nwrong, 0);
+
+    // remove a half then check the rest are still found.
+    for (i = 0; i < 100000; i += 2)
+        map->remove(map, (uint64_t) i);
+    for (i = 1; i < 100000; i += 2) {
+        if (map->getint(map, (uint64_t) i) != i)
+            nwrong++;
+    }
+    ASSERT_EQUAL_INT(nwrong, 0);
+
+    qstats_t stats;
+    ASSERT(map->stats(map, &stats) == true);
+    ASSERT_EQUAL_INT(stats.num, map->size(map));
+    ASSERT(stats.loadfactor <= 0.85);
+    ASSERT(stats.maxchain >= 1);
+    ASSERT_EQUAL_INT(stats.valuebytes, map->size(map) * sizeof(int64_t));
+    map->free(map);
+}
+
+TEST("getnext()") {
+    qintmap_t *map = qintmap(1000, 0);
+    uint64_t key, sum = 0;
+    for (key = 1; key <= 1000; key++)
+        map->putint(map, key * 1000, (int64_t) key);
+
+    int idx = 0, n = 0;
+    qintmap_obj_t obj;
+    while (map->getnext(map, &obj, &idx, false) == true) {
+        int64_t num;
+        memcpy(&num, obj.data, sizeof(num));
+        if (obj.key == (uint64_t) num * 1000)
+            sum += num;
+        n++;
+    }
+    ASSERT_EQUAL_INT(n, 1000);
+    ASSERT_EQUAL_INT(sum, 500500);
+
+    idx = 0;
+    ASSERT(map->getnext(map, &obj, &idx, true) == true);
+    free(obj.data);
+
+    map->clear(map);
+    ASSERT_EQUAL_INT(map->size(map), 0);
+    idx = 0;
+    ASSERT(map->getnext(map, &obj, &idx, false) == false);
+    map->free(map);
+}
+
+#ifndef DISABLE_THREADSAFE
+TEST("QINTMAP_THREADSAFE") {
+    qintmap_t *map = qintmap(0, QINTMAP_THREADSAFE);
+    pthread_t threads[4];
+    int i;
+    for (i = 0; i < 4; i++)
+        pthread_create(&threads[i], NULL, threadsafe_worker, map);
+    int nfailed = 0;
+    for (i = 0; i < 4; i++) {
+        void *ret;
+        pthread_join(threads[i], &ret);
+        if (ret != NULL)
+            nfailed++;
+    }
+    ASSERT_EQUAL_INT(nfailed, 0);
+    ASSERT_EQUAL_INT(map->size(map), 4 * 5000);
+    map->free(map);
+}
+#endif
+
+QUNIT_END();
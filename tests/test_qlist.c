@@ -0,0 +1,255 @@
+#include <errno.h>
+#include <unistd.h>
+#include "qunit.h"
+#include "qlibc.h"
+
+// order by the first byte only, to check the stability.
+static int cmpfirst(const qdlobj_t *obj1, const qdlobj_t *obj2) {
+    return *(unsigned char *)obj1->data - *(unsigned char *)obj2->data;
+}
+
+QUNIT_START("Test qlist.c");
+
+TEST("addat()/getat()/removeat() against an array model") {
+    int options[] = { 0, QLIST_NODEPOOL };
+    int opt;
+    for (opt = 0; opt < 2; opt++) {
+        qlist_t *list = qlist(options[opt]);
+        int model[200];
+        int num = 0, i, n;
+
+        srand(1);
+        for (n = 0; n < 2000; n++) {
+            int op = rand() % 4;
+            if (num == 0 || (op == 0 && num < 200)) {
+                int index = rand() % (num + 1);
+                ASSERT(list->addat(list, index, &n, sizeof(int)) == true);
+                memmove(&model[index + 1], &model[index],
+                        (num - index) * sizeof(int));
+                model[index] = n;
+                num++;
+            } else if (op == 1) {
+                int index = rand() % num;
+                ASSERT(list->removeat(list, index) == true);
+                memmove(&model[index], &model[index + 1],
+                        (num - index - 1) * sizeof(int));
+                num--;
+            } else if (op == 2) {
+                list->reverse(list);
+                for (i = 0; i < num / 2; i++) {
+                    int tmp = model[i];
+                    model[i] = model[num - 1 - i];
+                    model[num - 1 - i] = tmp;
+                }
+            } else {
+                int index = rand() % num;
+                ASSERT_EQUAL_INT(*(int *) list->getat(list, index, NULL, false),
+                                 model[index]);
+                ASSERT_EQUAL_INT(*(int *) list->getat(list, index - num, NULL,
+                                                      false), model[index]);
+            }
+        }
+
+        ASSERT_EQUAL_INT(list->size(list), num);
+        for (i = 0; i < num; i++) {
+            ASSERT_EQUAL_INT(*(int *) list->getat(list, i, NULL, false),
+                             model[i]);
+        }
+        ASSERT(list->getat(list, num, NULL, false) == NULL);
+        ASSERT(list->getat(list, -num - 1, NULL, false) == NULL);
+        list->free(list);
+    }
+}
+
+TEST("popat()/clear()") {
+    qlist_t *list = qlist(0);
+    int i;
+    for (i = 0; i < 10; i++) {
+        list->addlast(list, &i, sizeof(int));
+    }
+    ASSERT_EQUAL_INT(*(int *) list->getat(list, 5, NULL, false), 5);
+    int *data = list->popat(list, 5, NULL);
+    ASSERT_EQUAL_INT(*data, 5);
+    free(data);
+    ASSERT_EQUAL_INT(*(int *) list->getat(list, 5, NULL, false), 6);
+    ASSERT_EQUAL_INT(*(int *) list->getat(list, 4, NULL, false), 4);
+    list->clear(list);
+    ASSERT(list->getat(list, 0, NULL, false) == NULL);
+    list->addlast(list, &i, sizeof(int));
+    ASSERT_EQUAL_INT(*(int *) list->getat(list, 0, NULL, false), 10);
+    list->free(list);
+}
+
+TEST("QLIST_NODEPOOL with small and large elements") {
+    qlist_t *list = qlist(QLIST_NODEPOOL);
+    char big[1000];
+    int i;
+    memset(big, 'x', sizeof(big));
+    for (i = 0; i < 1000; i++) {
+        if (i % 3 == 0) {
+            big[0] = (char) i;
+            ASSERT(list->addlast(list, big, sizeof(big)) == true);
+        } else {
+            ASSERT(list->addlast(list, &i, sizeof(int)) == true);
+        }
+    }
+    ASSERT_EQUAL_INT(list->datasize(list),
+                     334 * sizeof(big) + 666 * sizeof(int));
+
+    size_t size;
+    char *data = list->popfirst(list, &size);
+    ASSERT(size == sizeof(big) && data[0] == 0 && data[999] == 'x');
+    free(data);
+    int *num = list->popfirst(list, &size);
+    ASSERT(size == sizeof(int) && *num == 1);
+    free(num);
+
+    list->clear(list);
+    ASSERT_EQUAL_INT(list->size(list), 0);
+    ASSERT_EQUAL_INT(list->pool->size(list->pool), 0);
+    ASSERT(list->addlast(list, "abc", 4) == true);
+    ASSERT_EQUAL_STR((char *) list->getfirst(list, NULL, false), "abc");
+    list->free(list);
+}
+
+TEST("sort() is stable and keeps links consistent") {
+    qlist_t *list = qlist(0);
+    ASSERT(list != NULL);
+    list->sort(list, cmpfirst);  // empty list
+    ASSERT_EQUAL_INT(list->size(list), 0);
+
+    srand(7);
+    int i;
+    for (i = 0; i < 10000; i++) {
+        unsigned char item[5];
+        item[0] = rand() % 16;
+        memcpy(item + 1, &i, sizeof(int));
+        list->addlast(list, item, sizeof(item));
+    }
+    list->getat(list, 5000, NULL, false);  // place the finger
+    list->sort(list, cmpfirst);
+    ASSERT_EQUAL_INT(list->size(list), 10000);
+
+    qdlobj_t obj;
+    memset((void *)&obj, 0, sizeof(obj));
+    unsigned char lastkey = 0;
+    int lastseq = -1, n = 0;
+    while (list->getnext(list, &obj, false) == true) {
+        unsigned char *item = (unsigned char *)obj.data;
+        int seq;
+        memcpy(&seq, item + 1, sizeof(int));
+        ASSERT(item[0] >= lastkey);
+        if (item[0] == lastkey) {
+            ASSERT(seq > lastseq);
+        }
+        lastkey = item[0];
+        lastseq = seq;
+        n++;
+    }
+    ASSERT_EQUAL_INT(n, 10000);
+
+    // backward links and the index lookups must agree with forward order.
+    unsigned char *last = list->getlast(list, NULL, false);
+    ASSERT(last[0] == lastkey);
+    ASSERT(((unsigned char *)list->getat(list, -1, NULL, false)) == last);
+    unsigned char *mid = list->getat(list, 5000, NULL, false);
+    ASSERT(mid == list->getat(list, 5000 - 10000, NULL, false));
+
+    list->free(list);
+}
+
+TEST("iterbegin()/iternext()/iterend()") {
+    qlist_t *list = qlist(QLIST_THREADSAFE);
+    qiter_t it;
+    list->iterbegin(list, &it);
+    ASSERT(list->iternext(list, &it) == false);
+    list->iterend(list, &it);
+
+    int i;
+    for (i = 0; i < 100; i++) {
+        list->addlast(list, &i, sizeof(i));
+    }
+    int n = 0, nwrong = 0;
+    list->iterbegin(list, &it);
+    while (list->iternext(list, &it) == true) {
+        if (it.name != NULL || it.size != sizeof(int)
+                || *(const int *) it.data != n)
+            nwrong++;
+        n++;
+    }
+    ASSERT(list->iternext(list, &it) == false && errno == ENOENT);
+    list->iterend(list, &it);
+    ASSERT_EQUAL_INT(n, 100);
+    ASSERT_EQUAL_INT(nwrong, 0);
+    list->free(list);
+}
+
+TEST("stats()") {
+    int options[] = { 0, QLIST_NODEPOOL };
+    int opt;
+    for (opt = 0; opt < 2; opt++) {
+        qlist_t *list = qlist(options[opt]);
+        char big[100];
+        memset(big, 'x', sizeof(big));
+        list->addlast(list, "a", 2);
+        list->addlast(list, big, sizeof(big));
+        ASSERT(list->getat(list, 5, NULL, false) == NULL);
+
+        qstats_t stats;
+        ASSERT(list->stats(list, &stats) == true);
+        ASSERT_EQUAL_INT(stats.num, 2);
+        ASSERT_EQUAL_INT(stats.valuebytes, 2 + sizeof(big));
+        ASSERT_EQUAL_INT(stats.keybytes, 0);
+        ASSERT(stats.overhead >= sizeof(qlist_t) + 2 * sizeof(qdlobj_t));
+#ifdef BUILD_STATS
+        ASSERT_EQUAL_INT(stats.putmisses, 2);
+        ASSERT_EQUAL_INT(stats.getmisses, 1);
+#endif
+        list->free(list);
+    }
+}
+
+TEST("snapshot()/restore()") {
+    char path[] = "/tmp/test_qlist.XXXXXX";
+    int fd = mkstemp(path);
+    ASSERT(fd >= 0);
+    close(fd);
+
+    // elements of various sizes including bigger ones than a write block.
+    qlist_t *list = qlist(0);
+    size_t bigsize = 100 * 1024;
+    char *big = malloc(bigsize);
+    memset(big, 'x', bigsize);
+    int i;
+    for (i = 0; i < 100; i++) {
+        list->addlast(list, big, (i % 10 == 0) ? bigsize : (size_t) i + 1);
+    }
+    ASSERT(list->snapshot(list, path) == true);
+
+    qlist_t *list2 = qlist(QLIST_NODEPOOL);
+    list2->addlast(list2, "first", 6);
+    ASSERT_EQUAL_INT(list2->restore(list2, path), 100);
+    ASSERT_EQUAL_INT(list2->size(list2), 101);
+    ASSERT_EQUAL_INT(list2->datasize(list2), 6 + list->datasize(list));
+    for (i = 0; i < 100; i++) {
+        size_t size;
+        char *data = list2->getat(list2, i + 1, &size, false);
+        ASSERT_EQUAL_INT(size, (i % 10 == 0) ? bigsize : (size_t) i + 1);
+        ASSERT(memcmp(data, big, size) == 0);
+    }
+
+    // the limit of the list is kept.
+    qlist_t *list3 = qlist(0);
+    list3->setsize(list3, 10);
+    ASSERT_EQUAL_INT(list3->restore(list3, path), -1);
+    ASSERT_EQUAL_INT(errno, ENOBUFS);
+    ASSERT_EQUAL_INT(list3->size(list3), 10);
+    list3->free(list3);
+
+    list->free(list);
+    list2->free(list2);
+    free(big);
+    unlink(path);
+}
+
+QUNIT_END();
@@ -0,0 +1,379 @@
+#include <unistd.h>
+#include <errno.h>
+#include "qunit.h"
+#include "qlibc.h"
+
+static int cmpdata(const qdlnobj_t *obj1, const qdlnobj_t *obj2) {
+    return strcmp((char *)obj1->data, (char *)obj2->data);
+}
+
+QUNIT_START("Test qlisttbl.c");
+
+TEST("QLISTTBL_HASHINDEX behaves the same as a linear table") {
+    int optsets[] = {
+        0,
+        QLISTTBL_UNIQUE,
+        QLISTTBL_CASEINSENSITIVE,
+        QLISTTBL_INSERTTOP | QLISTTBL_LOOKUPFORWARD,
+        QLISTTBL_UNIQUE | QLISTTBL_CASEINSENSITIVE | QLISTTBL_NODEPOOL,
+        QLISTTBL_LOOKUPFORWARD | QLISTTBL_THREADSAFE,
+    };
+    int k;
+    for (k = 0; k < (int)(sizeof(optsets) / sizeof(int)); k++) {
+        qlisttbl_t *plain = qlisttbl(optsets[k]);
+        qlisttbl_t *indexed = qlisttbl(optsets[k] | QLISTTBL_HASHINDEX);
+        ASSERT(plain != NULL && indexed != NULL);
+
+        srand(k + 1);
+        int i;
+        for (i = 0; i < 5000; i++) {
+            char name[32], value[32];
+            int key = rand() % 300;
+            snprintf(name, sizeof(name), (rand() % 2) ? "key%d" : "KEY%d", key);
+            snprintf(value, sizeof(value), "value%d", i);
+
+            int op = rand() % 10;
+            if (op < 6) {
+                ASSERT(plain->putstr(plain, name, value) == true);
+                ASSERT(indexed->putstr(indexed, name, value) == true);
+            } else if (op < 7) {
+                ASSERT_EQUAL_INT(indexed->remove(indexed, name),
+                                 plain->remove(plain, name));
+            } else if (op < 9) {
+                char *s1 = plain->getstr(plain, name, false);
+                char *s2 = indexed->getstr(indexed, name, false);
+                ASSERT((s1 == NULL) == (s2 == NULL));
+                if (s1 != NULL) {
+                    ASSERT_EQUAL_STR(s2, s1);
+                }
+            } else {
+                size_t n1 = 0, n2 = 0;
+                qobj_t *m1 = plain->getmulti(plain, name, false, &n1);
+                qobj_t *m2 = indexed->getmulti(indexed, name, false, &n2);
+                ASSERT_EQUAL_INT(n2, n1);
+                size_t j;
+                for (j = 0; j < n1; j++) {
+                    ASSERT_EQUAL_STR((char *)m2[j].data, (char *)m1[j].data);
+                }
+                plain->freemulti(m1);
+                indexed->freemulti(m2);
+            }
+        }
+        ASSERT_EQUAL_INT(indexed->size(indexed), plain->size(plain));
+
+        // table order must be preserved.
+        qdlnobj_t o1, o2;
+        memset((void *)&o1, 0, sizeof(o1));
+        memset((void *)&o2, 0, sizeof(o2));
+        while (plain->getnext(plain, &o1, NULL, false) == true) {
+            ASSERT(indexed->getnext(indexed, &o2, NULL, false) == true);
+            ASSERT_EQUAL_STR(o2.name, o1.name);
+            ASSERT_EQUAL_STR((char *)o2.data, (char *)o1.data);
+        }
+        ASSERT(indexed->getnext(indexed, &o2, NULL, false) == false);
+
+        plain->free(plain);
+        indexed->free(indexed);
+    }
+}
+
+TEST("removeobj() while iterating with getnext() on an index") {
+    qlisttbl_t *tbl = qlisttbl(QLISTTBL_HASHINDEX);
+    ASSERT(tbl != NULL);
+    int i;
+    for (i = 0; i < 200; i++) {
+        tbl->putint(tbl, (i % 2) ? "odd" : "even", i);
+    }
+
+    // remove every other "even" object during the scan.
+    qdlnobj_t obj;
+    memset((void *)&obj, 0, sizeof(obj));
+    int seen = 0;
+    while (tbl->getnext(tbl, &obj, "even", false) == true) {
+        if (seen++ % 2 == 0) {
+            ASSERT(tbl->removeobj(tbl, &obj) == true);
+        }
+    }
+    ASSERT_EQUAL_INT(seen, 100);
+    ASSERT_EQUAL_INT(tbl->size(tbl), 150);
+
+    size_t num = 0;
+    qobj_t *objs = tbl->getmulti(tbl, "even", false, &num);
+    ASSERT_EQUAL_INT(num, 50);
+    tbl->freemulti(objs);
+    ASSERT_EQUAL_INT(tbl->remove(tbl, "odd"), 100);
+    ASSERT_EQUAL_INT(tbl->size(tbl), 50);
+
+    tbl->free(tbl);
+}
+
+TEST("sort() and clear() with an index") {
+    qlisttbl_t *tbl = qlisttbl(QLISTTBL_HASHINDEX | QLISTTBL_CASEINSENSITIVE);
+    ASSERT(tbl != NULL);
+    int i;
+    for (i = 999; i >= 0; i--) {
+        tbl->putstrf(tbl, "Name", "%d", i);
+        tbl->putstrf(tbl, "key", "%04d", i);
+    }
+    tbl->sort(tbl);
+    for (i = 0; i < 1000; i++) {
+        char name[32];
+        snprintf(name, sizeof(name), "KEY%04d", i);
+        ASSERT(tbl->getstr(tbl, name, false) == NULL);
+    }
+    ASSERT_EQUAL_STR(tbl->getstr(tbl, "KEY", false), "0000");
+    ASSERT_EQUAL_STR(tbl->getstr(tbl, "name", false), "0");
+
+    size_t num = 0;
+    qobj_t *objs = tbl->getmulti(tbl, "NAME", false, &num);
+    ASSERT_EQUAL_INT(num, 1000);
+    tbl->freemulti(objs);
+
+    tbl->clear(tbl);
+    ASSERT_EQUAL_INT(tbl->size(tbl), 0);
+    ASSERT(tbl->getstr(tbl, "key", false) == NULL);
+    tbl->putstr(tbl, "key", "again");
+    ASSERT_EQUAL_STR(tbl->getstr(tbl, "KEY", false), "again");
+
+    tbl->free(tbl);
+}
+
+TEST("sort() and sortby() are stable") {
+    qlisttbl_t *tbl = qlisttbl(QLISTTBL_LOOKUPFORWARD);
+    ASSERT(tbl != NULL);
+    tbl->sort(tbl);  // empty table
+    ASSERT_EQUAL_INT(tbl->size(tbl), 0);
+
+    srand(3);
+    int i;
+    for (i = 0; i < 20000; i++) {
+        char name[16];
+        snprintf(name, sizeof(name), "k%02d", rand() % 50);
+        tbl->putstrf(tbl, name, "%05d", i);
+    }
+    tbl->sort(tbl);
+
+    qdlnobj_t obj, prev;
+    memset((void *)&obj, 0, sizeof(obj));
+    memset((void *)&prev, 0, sizeof(prev));
+    int n = 0;
+    while (tbl->getnext(tbl, &obj, NULL, false) == true) {
+        if (n++ > 0) {
+            int c = strcmp(obj.name, prev.name);
+            ASSERT(c >= 0);
+            if (c == 0) {
+                ASSERT(strcmp((char *)obj.data, (char *)prev.data) > 0);
+            }
+        }
+        prev = obj;
+    }
+    ASSERT_EQUAL_INT(n, 20000);
+
+    tbl->sortby(tbl, cmpdata);
+    memset((void *)&obj, 0, sizeof(obj));
+    for (i = 0; tbl->getnext(tbl, &obj, NULL, false) == true; i++) {
+        char value[16];
+        snprintf(value, sizeof(value), "%05d", i);
+        ASSERT_EQUAL_STR((char *)obj.data, value);
+    }
+    ASSERT_EQUAL_INT(i, 20000);
+
+    tbl->free(tbl);
+}
+
+TEST("QLISTTBL_REFERENCE with qparse_queries_inplace()") {
+    char query[] = "a=1&b=%41%42&a=2&c& d =x+y";
+    qnobj_t objs[8];
+    int num = qparse_queries_inplace(query, '=', '&', objs, 8);
+    ASSERT_EQUAL_INT(num, 5);
+    ASSERT(objs[0].name == query);
+    ASSERT_EQUAL_STR(objs[1].name, "b");
+    ASSERT_EQUAL_STR((char *)objs[1].data, "AB");
+    ASSERT_EQUAL_INT(objs[1].size, 3);
+    ASSERT_EQUAL_STR(objs[3].name, "c");
+    ASSERT_EQUAL_STR((char *)objs[3].data, "");
+    ASSERT_EQUAL_STR(objs[4].name, "d");
+    ASSERT_EQUAL_STR((char *)objs[4].data, "x y");
+
+    qlisttbl_t *tbl = qlisttbl(QLISTTBL_REFERENCE | QLISTTBL_NODEPOOL
+                               | QLISTTBL_HASHINDEX);
+    ASSERT(tbl != NULL);
+    ASSERT_EQUAL_INT(tbl->putbatch(tbl, objs, num), 5);
+
+    // the table refers to the query buffer.
+    ASSERT(tbl->getstr(tbl, "a", false) == (char *)objs[2].data);
+    ASSERT_EQUAL_STR(tbl->getstr(tbl, "a", false), "2");
+    ASSERT_EQUAL_INT(tbl->remove(tbl, "a"), 2);
+    ASSERT_EQUAL_STR((char *)objs[0].data, "1");  // buffer is untouched
+    ASSERT_EQUAL_STR(tbl->getstr(tbl, "d", false), "x y");
+
+    ASSERT(tbl->putstr(tbl, "e", "static") == true);
+    ASSERT_EQUAL_STR(tbl->getstr(tbl, "e", false), "static");
+    ASSERT(tbl->putint(tbl, "f", 1) == false);
+    ASSERT_EQUAL_INT(errno, ENOTSUP);
+    ASSERT(tbl->putstrf(tbl, "f", "%d", 1) == false);
+    ASSERT_EQUAL_INT(errno, ENOTSUP);
+    ASSERT_EQUAL_INT(tbl->size(tbl), 4);
+
+    tbl->free(tbl);
+
+    // only the first maxobjs entries are stored.
+    char query2[] = "x=1&y=2&z=3";
+    ASSERT_EQUAL_INT(qparse_queries_inplace(query2, '=', '&', objs, 2), 3);
+    ASSERT_EQUAL_STR(objs[1].name, "y");
+}
+
+TEST("stats()") {
+    int options[] = { QLISTTBL_UNIQUE, QLISTTBL_UNIQUE | QLISTTBL_HASHINDEX };
+    int opt;
+    for (opt = 0; opt < 2; opt++) {
+        qlisttbl_t *tbl = qlisttbl(options[opt]);
+        int i;
+        for (i = 0; i < 100; i++) {
+            char key[8];
+            snprintf(key, sizeof(key), "k%02d", i);
+            tbl->putstr(tbl, key, "v");
+        }
+        tbl->putstr(tbl, "k00", "w");  // replaced
+        ASSERT(tbl->getstr(tbl, "k50", false) != NULL);
+        ASSERT(tbl->getstr(tbl, "none", false) == NULL);
+
+        qstats_t stats;
+        ASSERT(tbl->stats(tbl, &stats) == true);
+        ASSERT_EQUAL_INT(stats.num, 100);
+        ASSERT_EQUAL_INT(stats.keybytes, 100 * 4);
+        ASSERT_EQUAL_INT(stats.valuebytes, 100 * 2);
+        if (options[opt] & QLISTTBL_HASHINDEX) {
+            ASSERT(stats.slots >= 50);
+            ASSERT_EQUAL_INT(stats.collisions, 100 - stats.usedslots);
+            ASSERT(stats.maxchain < 100);
+        } else {
+            ASSERT_EQUAL_INT(stats.slots, 0);
+            ASSERT_EQUAL_INT(stats.maxchain, 100);
+        }
+#ifdef BUILD_STATS
+        ASSERT_EQUAL_INT(stats.puthits, 1);
+        ASSERT_EQUAL_INT(stats.putmisses, 100);
+        ASSERT_EQUAL_INT(stats.gethits, 1);
+        ASSERT_EQUAL_INT(stats.getmisses, 1);
+#endif
+        tbl->free(tbl);
+    }
+}
+
+TEST("iterbegin()/iternext()/iterend()") {
+    int options[] = { 0, QLISTTBL_LOOKUPFORWARD | QLISTTBL_THREADSAFE };
+    int k;
+    for (k = 0; k < 2; k++) {
+        qlisttbl_t *tbl = qlisttbl(options[k]);
+        int i;
+        for (i = 0; i < 100; i++) {
+            char key[16];
+            snprintf(key, sizeof(key), "key%d", i);
+            tbl->putint(tbl, key, i);
+        }
+
+        // same order as getnext()
+        qdlnobj_t obj;
+        memset((void *) &obj, 0, sizeof(obj));
+        qiter_t it;
+        int n = 0, nwrong = 0;
+        tbl->iterbegin(tbl, &it);
+        while (tbl->iternext(tbl, &it) == true) {
+            if (tbl->getnext(tbl, &obj, NULL, false) == false
+                    || it.name != obj.name || it.data != obj.data
+                    || it.namelen != strlen(obj.name))
+                nwrong++;
+            n++;
+        }
+        ASSERT(tbl->iternext(tbl, &it) == false && errno == ENOENT);
+        tbl->iterend(tbl, &it);
+        ASSERT_EQUAL_INT(n, 100);
+        ASSERT_EQUAL_INT(nwrong, 0);
+        tbl->free(tbl);
+    }
+}
+
+TEST("short and long entries") {
+    int options[] = { 0, QLISTTBL_NODEPOOL, QLISTTBL_HASHINDEX,
+                      QLISTTBL_HASHINDEX | QLISTTBL_NODEPOOL };
+    char longval[200];
+    memset(longval, 'x', sizeof(longval) - 1);
+    longval[sizeof(longval) - 1] = '\0';
+    int k;
+    for (k = 0; k < (int)(sizeof(options) / sizeof(int)); k++) {
+        qlisttbl_t *tbl = qlisttbl(options[k] | QLISTTBL_UNIQUE);
+        ASSERT(tbl->putstr(tbl, "key", "short") == true);
+        ASSERT(tbl->putstr(tbl, longval, "short") == true);
+        ASSERT(tbl->putstr(tbl, "key2", longval) == true);
+        ASSERT_EQUAL_STR(tbl->getstr(tbl, "key", false), "short");
+        ASSERT_EQUAL_STR(tbl->getstr(tbl, longval, false), "short");
+        ASSERT_EQUAL_STR(tbl->getstr(tbl, "key2", false), longval);
+        ASSERT(tbl->putstr(tbl, "key2", "tiny") == true);
+        ASSERT_EQUAL_STR(tbl->getstr(tbl, "key2", false), "tiny");
+        ASSERT_EQUAL_INT(tbl->size(tbl), 3);
+        ASSERT_EQUAL_INT(tbl->remove(tbl, longval), 1);
+        tbl->free(tbl);
+    }
+}
+
+TEST("snapshot()/restore()") {
+    char path[] = "/tmp/test_qlisttbl.XXXXXX";
+    int fd = mkstemp(path);
+    ASSERT(fd >= 0);
+    close(fd);
+
+    // duplicated keys and the order are kept. getnext() goes backward.
+    qlisttbl_t *tbl = qlisttbl(0);
+    int i;
+    for (i = 0; i < 300; i++) {
+        char key[8];
+        snprintf(key, sizeof(key), "k%02d", i % 100);
+        tbl->putint(tbl, key, i);
+    }
+    ASSERT(tbl->snapshot(tbl, path) == true);
+
+    int options[] = { 0, QLISTTBL_HASHINDEX };
+    int opt;
+    for (opt = 0; opt < 2; opt++) {
+        qlisttbl_t *tbl2 = qlisttbl(options[opt]);
+        ASSERT_EQUAL_INT(tbl2->restore(tbl2, path), 300);
+        ASSERT_EQUAL_INT(tbl2->size(tbl2), 300);
+        qdlnobj_t obj;
+        memset((void *) &obj, 0, sizeof(obj));
+        for (i = 299; tbl2->getnext(tbl2, &obj, NULL, false) == true; i--) {
+            char key[8];
+            snprintf(key, sizeof(key), "k%02d", i % 100);
+            ASSERT_EQUAL_STR(obj.name, key);
+            ASSERT_EQUAL_INT(atoi(obj.data), i);
+        }
+        ASSERT_EQUAL_INT(i, -1);
+        ASSERT_EQUAL_INT(tbl2->getint(tbl2, "k42"), 242);
+        tbl2->free(tbl2);
+    }
+
+    // a unique table drops the duplicates as put() does.
+    qlisttbl_t *tbl2 = qlisttbl(QLISTTBL_UNIQUE | QLISTTBL_HASHINDEX);
+    tbl2->putint(tbl2, "k00", -1);
+    ASSERT_EQUAL_INT(tbl2->restore(tbl2, path), 300);
+    ASSERT_EQUAL_INT(tbl2->size(tbl2), 100);
+    ASSERT_EQUAL_INT(tbl2->getint(tbl2, "k00"), 200);
+    ASSERT(tbl2->snapshot(tbl2, path) == true);
+    tbl2->free(tbl2);
+
+    tbl2 = qlisttbl(QLISTTBL_UNIQUE);
+    ASSERT_EQUAL_INT(tbl2->restore(tbl2, path), 100);
+    ASSERT_EQUAL_INT(tbl2->getint(tbl2, "k99"), 299);
+    tbl2->free(tbl2);
+
+    // not supported with references.
+    tbl2 = qlisttbl(QLISTTBL_REFERENCE);
+    ASSERT_EQUAL_INT(tbl2->restore(tbl2, path), -1);
+    ASSERT_EQUAL_INT(errno, ENOTSUP);
+    tbl2->free(tbl2);
+
+    tbl->free(tbl);
+    unlink(path);
+}
+
+QUNIT_END();
@@ -0,0 +1,189 @@
+#include <errno.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <pthread.h>
+
+// the Q_MUTEX macros as built with --disable-threadsafe. the functions
+// behind them are called directly for the locking tests, which are left
+// out when the library itself is built that way.
+#ifndef DISABLE_THREADSAFE
+#define LOCKING_TESTS
+#define DISABLE_THREADSAFE
+#endif
+#include "qinternal.h"
+#undef ASSERT
+#include "qunit.h"
+#include "qlibc.h"
+
+// tries the lock from another thread. entered is set once it's in.
+struct contender_s {
+    qmutex_t *x;
+    bool shared;
+    volatile int entered;
+    pthread_t self;
+};
+
+static void *contender(void *arg) {
+    struct contender_s *c = (struct contender_s *) arg;
+    c->self = pthread_self();
+    if (c->shared == true) {
+        _q_mutex_enter_shared(c->x);
+    } else {
+        _q_mutex_enter(c->x);
+    }
+    __atomic_store_n(&(c->entered), 1, __ATOMIC_RELEASE);
+    // hold it until the main thread has looked at the owner.
+    while (__atomic_load_n(&(c->entered), __ATOMIC_ACQUIRE) != 2)
+        usleep(1000);
+    _q_mutex_leave(c->x);
+    return NULL;
+}
+
+// starts a contender and tells whether it got in within 100ms.
+static bool contend(struct contender_s *c, qmutex_t *x, bool shared,
+                    pthread_t *thread) {
+    c->x = x;
+    c->shared = shared;
+    c->entered = 0;
+    pthread_create(thread, NULL, contender, c);
+    int i;
+    for (i = 0; i < 100; i++) {
+        if (__atomic_load_n(&(c->entered), __ATOMIC_ACQUIRE) == 1)
+            return true;
+        usleep(1000);
+    }
+    return false;
+}
+
+static void release(struct contender_s *c, pthread_t thread) {
+    while (__atomic_load_n(&(c->entered), __ATOMIC_ACQUIRE) != 1)
+        usleep(1000);
+    __atomic_store_n(&(c->entered), 2, __ATOMIC_RELEASE);
+    pthread_join(thread, NULL);
+}
+
+QUNIT_START("Test qmutex.c");
+
+#ifdef LOCKING_TESTS
+
+TEST("Recursive exclusive entry") {
+    int i;
+    for (i = 0; i < 2; i++) {
+        bool shared = (i == 1);
+        qmutex_t *x = _q_mutex(true, shared, __FILE__);
+        ASSERT(x != NULL);
+        _q_mutex_enter(x);
+        _q_mutex_enter(x);
+        _q_mutex_enter(x);
+        ASSERT_EQUAL_INT(x->count, 3);
+        ASSERT(pthread_equal(x->owner, pthread_self()));
+        _q_mutex_leave(x);
+        _q_mutex_leave(x);
+        ASSERT_EQUAL_INT(x->count, 1);
+
+        // still held after leaving twice.
+        struct contender_s c;
+        pthread_t thread;
+        ASSERT(contend(&c, x, false, &thread) == false);
+        _q_mutex_leave(x);
+        release(&c, thread);
+        ASSERT_EQUAL_INT(x->count, 0);
+        _q_mutex_free(x);
+    }
+}
+
+TEST("Exclusive entry while holding shared") {
+    // a shared entry of a plain mutex is exclusive, so it nests both ways.
+    qmutex_t *x = _q_mutex(true, false, __FILE__);
+    _q_mutex_enter_shared(x);
+    _q_mutex_enter(x);
+    ASSERT_EQUAL_INT(x->count, 2);
+    _q_mutex_leave(x);
+    _q_mutex_leave(x);
+    ASSERT_EQUAL_INT(x->count, 0);
+    _q_mutex_free(x);
+
+    // the writer of a reader/writer lock can take it shared, like calling
+    // a getter under lock(), and exclusive again from there.
+    x = _q_mutex(true, true, __FILE__);
+    _q_mutex_enter(x);
+    _q_mutex_enter_shared(x);
+    _q_mutex_enter(x);
+    ASSERT_EQUAL_INT(x->count, 3);
+    _q_mutex_leave(x);
+    _q_mutex_leave(x);
+    ASSERT_EQUAL_INT(x->count, 1);
+    _q_mutex_leave(x);
+    ASSERT_EQUAL_INT(x->count, 0);
+
+    // readers share it with each other but not with a writer.
+    struct contender_s c;
+    pthread_t thread;
+    _q_mutex_enter_shared(x);
+    ASSERT(contend(&c, x, true, &thread) == true);
+    release(&c, thread);
+    ASSERT(contend(&c, x, false, &thread) == false);
+    _q_mutex_leave(x);
+    release(&c, thread);
+    _q_mutex_free(x);
+}
+
+TEST("Owner tracking across threads") {
+    int i;
+    for (i = 0; i < 2; i++) {
+        bool shared = (i == 1);
+        qmutex_t *x = _q_mutex(true, shared, __FILE__);
+        struct contender_s c;
+        pthread_t thread;
+
+        // the other thread owns it, so this thread's shared entry of a
+        // reader/writer lock doesn't nest into its write lock.
+        ASSERT(contend(&c, x, false, &thread) == true);
+        ASSERT(pthread_equal(x->owner, c.self));
+        ASSERT_EQUAL_INT(x->count, 1);
+        struct contender_s c2;
+        pthread_t thread2;
+        ASSERT(contend(&c2, x, true, &thread2) == false);
+        release(&c, thread);
+        release(&c2, thread2);
+        ASSERT_EQUAL_INT(x->count, 0);
+
+        // and the owner moves back to this thread.
+        _q_mutex_enter(x);
+        ASSERT(pthread_equal(x->owner, pthread_self()));
+        _q_mutex_leave(x);
+        _q_mutex_free(x);
+    }
+}
+
+#endif
+
+TEST("Q_MUTEX macros are no-ops with DISABLE_THREADSAFE") {
+    qmutex_t *x;
+    Q_MUTEX_NEW(x, false);
+    ASSERT(x != NULL);
+    // entering a non-recursive mutex twice would deadlock if it locked.
+    Q_MUTEX_ENTER(x);
+    Q_MUTEX_ENTER(x);
+    Q_MUTEX_ENTER_SHARED(x);
+    ASSERT_EQUAL_INT(x->count, 0);
+    struct contender_s c;
+    pthread_t thread;
+    ASSERT(contend(&c, x, false, &thread) == true);
+    release(&c, thread);
+    Q_MUTEX_LEAVE(x);
+    Q_MUTEX_LEAVE(x);
+    Q_MUTEX_LEAVE(x);
+    Q_MUTEX_DESTROY(x);
+
+    Q_RWLOCK_NEW(x);
+    ASSERT(x != NULL && x->shared == true);
+    Q_MUTEX_ENTER(x);
+    Q_MUTEX_ENTER_SHARED(x);
+    ASSERT_EQUAL_INT(x->count, 0);
+    Q_MUTEX_LEAVE(x);
+    Q_MUTEX_LEAVE(x);
+    Q_MUTEX_DESTROY(x);
+}
+
+QUNIT_END();
@@ -0,0 +1,75 @@
+#include "qunit.h"
+#include "qlibc.h"
+
+QUNIT_START("Test qpool.c");
+
+TEST("alloc()/release()") {
+    qpool_t *pool = qpool(24, 0);
+    ASSERT(pool != NULL);
+
+    void *objs[1000];
+    int i;
+    for (i = 0; i < 1000; i++) {
+        objs[i] = pool->alloc(pool);
+        ASSERT(objs[i] != NULL);
+        ASSERT(((uintptr_t) objs[i] % 16) == 0);
+        memset(objs[i], i & 0xff, 24);
+    }
+    ASSERT_EQUAL_INT(pool->size(pool), 1000);
+    for (i = 0; i < 1000; i++) {
+        ASSERT(((unsigned char *) objs[i])[23] == (i & 0xff));
+    }
+
+    // released objects are handed out again.
+    void *last = objs[999];
+    pool->release(pool, last);
+    ASSERT(pool->alloc(pool) == last);
+
+    for (i = 0; i < 1000; i++) {
+        pool->release(pool, objs[i]);
+    }
+    ASSERT_EQUAL_INT(pool->size(pool), 0);
+
+    pool->clear(pool);
+    ASSERT(pool->alloc(pool) != NULL);
+    ASSERT_EQUAL_INT(pool->size(pool), 1);
+    pool->free(pool);
+
+    ASSERT(qpool(0, 0) == NULL);
+}
+
+TEST("QHASHTBL_NODEPOOL") {
+    qhashtbl_t *tbl = qhashtbl(0, QHASHTBL_NODEPOOL);
+    char name[32];
+    int i;
+    for (i = 0; i < 10000; i++) {
+        snprintf(name, sizeof(name), "key%d", i);
+        ASSERT(tbl->putint(tbl, name, i) == true);
+    }
+    for (i = 0; i < 10000; i += 2) {
+        snprintf(name, sizeof(name), "key%d", i);
+        ASSERT(tbl->remove(tbl, name) == true);
+    }
+    ASSERT_EQUAL_INT(tbl->size(tbl), 5000);
+    ASSERT_EQUAL_INT(tbl->pool->size(tbl->pool), 5000);
+    ASSERT_EQUAL_INT(tbl->getint(tbl, "key4321"), 4321);
+    tbl->clear(tbl);
+    ASSERT_EQUAL_INT(tbl->pool->size(tbl->pool), 0);
+    tbl->free(tbl);
+}
+
+TEST("QLISTTBL_NODEPOOL") {
+    qlisttbl_t *tbl = qlisttbl(QLISTTBL_NODEPOOL | QLISTTBL_UNIQUE);
+    char name[32];
+    int i;
+    for (i = 0; i < 1000; i++) {
+        snprintf(name, sizeof(name), "key%d", i % 100);
+        ASSERT(tbl->putint(tbl, name, i) == true);
+    }
+    ASSERT_EQUAL_INT(tbl->size(tbl), 100);
+    ASSERT_EQUAL_INT(tbl->pool->size(tbl->pool), 100);
+    ASSERT_EQUAL_INT(tbl->getint(tbl, "key42"), 942);
+    tbl->free(tbl);
+}
+
+QUNIT_END();
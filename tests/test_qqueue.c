@@ -0,0 +1,197 @@
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "qunit.h"
+#include "qlibc.h"
+
+#define LF_PRODUCERS (4)
+#define LF_CONSUMERS (4)
+#define LF_ITEMS (100000)
+
+static qqueue_t *lfqueue;
+static int64_t lfsum[LF_CONSUMERS];
+
+static void *lf_producer(void *arg) {
+    int64_t i, base = (intptr_t) arg * LF_ITEMS;
+    for (i = 1; i <= LF_ITEMS; i++) {
+        while (lfqueue->pushint(lfqueue, base + i) == false);
+    }
+    return NULL;
+}
+
+static void *lf_consumer(void *arg) {
+    int n;
+    for (n = 0; n < LF_ITEMS * LF_PRODUCERS / LF_CONSUMERS; n++) {
+        size_t size;
+        int64_t *num = lfqueue->popwait(lfqueue, &size, -1);
+        if (num == NULL || size != sizeof(int64_t))
+            break;
+        lfsum[(intptr_t) arg] += *num;
+        free(num);
+    }
+    return NULL;
+}
+
+static void *delayed_push(void *arg) {
+    usleep(100 * 1000);
+    lfqueue->pushstr(lfqueue, "wake up");
+    return NULL;
+}
+
+QUNIT_START("Test qqueue.c");
+
+TEST("push()/pop() with wrap around and growth") {
+    qqueue_t *queue = qqueue(0);
+    int64_t next = 0, expect = 0;
+    int i, j;
+
+    // keep head moving so the ring wraps and grows while wrapped.
+    for (i = 0; i < 50; i++) {
+        for (j = 0; j < i + 3; j++) {
+            ASSERT(queue->pushint(queue, next++) == true);
+        }
+        for (j = 0; j < i + 1; j++) {
+            ASSERT_EQUAL_INT(queue->popint(queue), expect++);
+        }
+    }
+    ASSERT_EQUAL_INT(queue->size(queue), (size_t) (next - expect));
+    ASSERT_EQUAL_INT(queue->getint(queue), expect);
+    for (i = 0; i < queue->size(queue); i++) {
+        ASSERT_EQUAL_INT(*(int64_t *) queue->getat(queue, i, NULL, false),
+                         expect + i);
+    }
+    while (queue->size(queue) > 0) {
+        ASSERT_EQUAL_INT(queue->popint(queue), expect++);
+    }
+    ASSERT(next == expect);
+    ASSERT(queue->pop(queue, NULL) == NULL && errno == ENOENT);
+    queue->free(queue);
+}
+
+TEST("large elements and popat()") {
+    qqueue_t *queue = qqueue(QQUEUE_THREADSAFE);
+    char big[100];
+    int i;
+    for (i = 0; i < 10; i++) {
+        memset(big, 'a' + i, sizeof(big) - 1);
+        big[sizeof(big) - 1] = '\0';
+        const char *str = (i % 2) ? big : big + 90;
+        ASSERT(queue->pushstr(queue, str) == true);
+    }
+
+    char *str = queue->popat(queue, 3, NULL);
+    ASSERT(strlen(str) == 99 && str[0] == 'd');
+    free(str);
+    str = queue->popat(queue, -2, NULL);
+    ASSERT_EQUAL_STR(str, "iiiiiiiii");
+    free(str);
+    str = queue->popstr(queue);
+    ASSERT_EQUAL_STR(str, "aaaaaaaaa");
+    free(str);
+    str = queue->getat(queue, 3, NULL, false);
+    ASSERT(strlen(str) == 99 && str[0] == 'f');
+    ASSERT_EQUAL_INT(queue->size(queue), 7);
+    queue->clear(queue);
+    ASSERT_EQUAL_INT(queue->size(queue), 0);
+    queue->free(queue);
+}
+
+TEST("setsize()") {
+    qqueue_t *queue = qqueue(0);
+    queue->setsize(queue, 3);
+    ASSERT(queue->pushint(queue, 1) == true);
+    ASSERT(queue->pushint(queue, 2) == true);
+    ASSERT(queue->pushint(queue, 3) == true);
+    ASSERT(queue->pushint(queue, 4) == false && errno == ENOBUFS);
+    ASSERT_EQUAL_INT(queue->popint(queue), 1);
+    ASSERT(queue->pushint(queue, 4) == true);
+    queue->free(queue);
+}
+
+TEST("qstack push()/pop()") {
+    qstack_t *stack = qstack(0);
+    int i;
+    for (i = 0; i < 100; i++) {
+        ASSERT(stack->pushint(stack, i) == true);
+    }
+    ASSERT_EQUAL_INT(stack->getint(stack), 99);
+    ASSERT_EQUAL_INT(*(int64_t *) stack->getat(stack, -1, NULL, false), 0);
+    for (i = 99; i >= 0; i--) {
+        ASSERT_EQUAL_INT(stack->popint(stack), i);
+    }
+    ASSERT_EQUAL_INT(stack->size(stack), 0);
+    stack->free(stack);
+}
+
+TEST("qqueue_lockfree() QQUEUE_SPSC") {
+    qqueue_t *queue = qqueue_lockfree(5, QQUEUE_SPSC);
+    char big[100];
+    int i, j;
+    memset(big, 'x', sizeof(big));
+    ASSERT_EQUAL_INT(queue->setsize(queue, 0), 8);
+    for (i = 0; i < 8; i++) {
+        ASSERT(queue->pushint(queue, i) == true);
+    }
+    ASSERT(queue->pushint(queue, 8) == false && errno == ENOBUFS);
+    ASSERT(queue->get(queue, NULL, false) == NULL && errno == ENOTSUP);
+    for (j = 0; j < 8; j++) {
+        ASSERT_EQUAL_INT(queue->popint(queue), j);
+        big[0] = 'a' + j;
+        ASSERT(queue->push(queue, big, (j % 2) ? sizeof(big) : 8) == true);
+    }
+    ASSERT_EQUAL_INT(queue->size(queue), 8);
+    for (j = 0; j < 4; j++) {
+        size_t size;
+        char *data = queue->pop(queue, &size);
+        ASSERT(data[0] == 'a' + j && data[size - 1] == 'x');
+        ASSERT(size == ((j % 2) ? sizeof(big) : 8));
+        free(data);
+    }
+    queue->clear(queue);
+    ASSERT_EQUAL_INT(queue->size(queue), 0);
+    ASSERT(queue->pop(queue, NULL) == NULL && errno == ENOENT);
+    queue->free(queue);
+}
+
+TEST("qqueue_lockfree() with concurrent producers and consumers") {
+    pthread_t producers[LF_PRODUCERS], consumers[LF_CONSUMERS];
+    intptr_t i;
+    lfqueue = qqueue_lockfree(1024, 0);
+    for (i = 0; i < LF_CONSUMERS; i++) {
+        pthread_create(&consumers[i], NULL, lf_consumer, (void *) i);
+    }
+    for (i = 0; i < LF_PRODUCERS; i++) {
+        pthread_create(&producers[i], NULL, lf_producer, (void *) i);
+    }
+    for (i = 0; i < LF_PRODUCERS; i++) {
+        pthread_join(producers[i], NULL);
+    }
+    int64_t sum = 0;
+    for (i = 0; i < LF_CONSUMERS; i++) {
+        pthread_join(consumers[i], NULL);
+        sum += lfsum[i];
+    }
+
+    // every element is taken exactly once.
+    int64_t n = (int64_t) LF_ITEMS * LF_PRODUCERS;
+    ASSERT(sum == n * (n + 1) / 2);
+    ASSERT_EQUAL_INT(lfqueue->size(lfqueue), 0);
+    lfqueue->free(lfqueue);
+}
+
+TEST("popwait()") {
+    qqueue_t *queue = qqueue(QQUEUE_THREADSAFE);
+    ASSERT(queue->popwait(queue, NULL, 0) == NULL && errno == ENOENT);
+    ASSERT(queue->popwait(queue, NULL, 50) == NULL && errno == ETIMEDOUT);
+
+    pthread_t thread;
+    lfqueue = queue;
+    pthread_create(&thread, NULL, delayed_push, NULL);
+    char *str = queue->popwait(queue, NULL, 10000);
+    ASSERT(str != NULL && !strcmp(str, "wake up"));
+    free(str);
+    pthread_join(thread, NULL);
+    queue->free(queue);
+}
+
+QUNIT_END();
@@ -0,0 +1,203 @@
+#include <errno.h>
+#include <string.h>
+#include <sched.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "qunit.h"
+#include "qlibc.h"
+
+// src/internal/qinternal.h, which can't be included along with qunit.h.
+extern void _q_rcu_stall(void (*stall)(void));
+
+#define MAGIC   (0x5152435555524351LL)
+
+struct obj_s {
+    int64_t magic;
+    int64_t value;
+};
+
+static int nfreed = 0;
+
+static struct obj_s *newobj(int64_t value) {
+    struct obj_s *obj = (struct obj_s *) malloc(sizeof(struct obj_s));
+    obj->magic = MAGIC;
+    obj->value = value;
+    return obj;
+}
+
+static void freeobj(void *obj) {
+    // poison it, so a reader still using it notices.
+    ((struct obj_s *) obj)->magic = 0;
+    __atomic_add_fetch(&nfreed, 1, __ATOMIC_RELAXED);
+    free(obj);
+}
+
+// keeps the poisoned objects until the end of a test, so a reader touching
+// one notices even when the memory would have been reused.
+#define BURIED  (20000)
+static struct obj_s *buried[BURIED];
+static int nburied = 0;
+
+static void buryobj(void *obj) {
+    ((struct obj_s *) obj)->magic = 0;
+    buried[__atomic_fetch_add(&nburied, 1, __ATOMIC_RELAXED)] = obj;
+}
+
+struct reader_s {
+    qrcu_t *rcu;
+    bool stop;
+    int bad;
+    int64_t reads;
+};
+
+static void *reader(void *arg) {
+    struct reader_s *r = (struct reader_s *) arg;
+    int64_t last = 0;
+    while (__atomic_load_n(&r->stop, __ATOMIC_RELAXED) == false) {
+        int token;
+        struct obj_s *obj = (struct obj_s *) r->rcu->acquire(r->rcu, &token);
+        if (obj->magic != MAGIC || obj->value < last)
+            r->bad++;
+        last = obj->value;
+        r->rcu->release(r->rcu, token);
+        r->reads++;
+    }
+    return NULL;
+}
+
+// some readers sleep after reading the phase in acquire(), during which
+// publish() flips it and may drain the counter they're about to increment.
+static void stall(void) {
+    static __thread int calls = 0;
+    if (++calls % 16 == 0)
+        usleep(200);
+}
+
+// holds the object across a yield, giving publish() the time to retire it.
+static void *holder(void *arg) {
+    struct reader_s *r = (struct reader_s *) arg;
+    while (__atomic_load_n(&r->stop, __ATOMIC_RELAXED) == false) {
+        int token;
+        struct obj_s *obj = (struct obj_s *) r->rcu->acquire(r->rcu, &token);
+        if (obj->magic != MAGIC)
+            r->bad++;
+        sched_yield();
+        if (obj->magic != MAGIC)
+            r->bad++;
+        r->rcu->release(r->rcu, token);
+        r->reads++;
+    }
+    return NULL;
+}
+
+QUNIT_START("Test qrcu.c");
+
+TEST("acquire()/publish()") {
+    nfreed = 0;
+    qrcu_t *rcu = qrcu(newobj(1), freeobj);
+    ASSERT(rcu != NULL);
+    ASSERT_EQUAL_INT(rcu->version(rcu), 0);
+
+    int token;
+    struct obj_s *obj = (struct obj_s *) rcu->acquire(rcu, &token);
+    ASSERT_EQUAL_INT(obj->value, 1);
+    rcu->release(rcu, token);
+
+    ASSERT(rcu->publish(rcu, newobj(2)) == true);
+    ASSERT_EQUAL_INT(nfreed, 1);
+    ASSERT_EQUAL_INT(rcu->version(rcu), 1);
+    obj = (struct obj_s *) rcu->acquire(rcu, &token);
+    ASSERT_EQUAL_INT(obj->value, 2);
+    rcu->release(rcu, token);
+
+    rcu->free(rcu);
+    ASSERT_EQUAL_INT(nfreed, 2);
+}
+
+TEST("readers never see a freed object") {
+    nfreed = 0;
+    qrcu_t *rcu = qrcu(newobj(0), freeobj);
+    struct reader_s readers[4];
+    pthread_t threads[4];
+    int i;
+    for (i = 0; i < 4; i++) {
+        memset(&readers[i], 0, sizeof(struct reader_s));
+        readers[i].rcu = rcu;
+        pthread_create(&threads[i], NULL, reader, &readers[i]);
+    }
+
+    int64_t v;
+    for (v = 1; v <= 2000; v++) {
+        rcu->publish(rcu, newobj(v));
+    }
+
+    int bad = 0;
+    for (i = 0; i < 4; i++) {
+        __atomic_store_n(&readers[i].stop, true, __ATOMIC_RELAXED);
+        pthread_join(threads[i], NULL);
+        bad += readers[i].bad;
+    }
+    ASSERT_EQUAL_INT(bad, 0);
+    ASSERT_EQUAL_INT(nfreed, 2000);
+    ASSERT_EQUAL_INT(rcu->version(rcu), 2000);
+    rcu->free(rcu);
+}
+
+TEST("readers stalled in acquire() never see a retired object") {
+    nburied = 0;
+    qrcu_t *rcu = qrcu(newobj(0), buryobj);
+    _q_rcu_stall(stall);
+    struct reader_s readers[8];
+    pthread_t threads[8];
+    int i;
+    for (i = 0; i < 8; i++) {
+        memset(&readers[i], 0, sizeof(struct reader_s));
+        readers[i].rcu = rcu;
+        pthread_create(&threads[i], NULL, holder, &readers[i]);
+    }
+
+    int64_t v;
+    for (v = 1; v < BURIED; v++) {
+        rcu->publish(rcu, newobj(v));
+        sched_yield();  // let the readers run between publishes
+    }
+
+    int bad = 0;
+    for (i = 0; i < 8; i++) {
+        __atomic_store_n(&readers[i].stop, true, __ATOMIC_RELAXED);
+        pthread_join(threads[i], NULL);
+        bad += readers[i].bad;
+    }
+    _q_rcu_stall(NULL);
+    ASSERT_EQUAL_INT(bad, 0);
+    ASSERT_EQUAL_INT(nburied, BURIED - 1);
+    rcu->free(rcu);
+    for (i = 0; i < nburied; i++) {
+        free(buried[i]);
+    }
+}
+
+TEST("publish qlisttbl") {
+    qlisttbl_t *tbl = qlisttbl(0);
+    tbl->putstr(tbl, "key", "value1");
+    qrcu_t *rcu = qrcu(tbl, NULL);
+
+    int token;
+    qlisttbl_t *conf = (qlisttbl_t *) rcu->acquire(rcu, &token);
+    ASSERT_EQUAL_STR(conf->getstr(conf, "key", false), "value1");
+    rcu->release(rcu, token);
+
+    qlisttbl_t *tbl2 = qlisttbl(0);
+    tbl2->putstr(tbl2, "key", "value2");
+    rcu->publish(rcu, tbl2);
+    tbl->free(tbl);  // no reader can see it any more
+
+    conf = (qlisttbl_t *) rcu->acquire(rcu, &token);
+    ASSERT_EQUAL_STR(conf->getstr(conf, "key", false), "value2");
+    rcu->release(rcu, token);
+
+    rcu->free(rcu);
+    tbl2->free(tbl2);
+}
+
+QUNIT_END();
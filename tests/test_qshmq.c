@@ -0,0 +1,159 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "qunit.h"
+#include "qlibc.h"
+
+#ifndef DISABLE_IPC
+
+#define CAPACITY    (4096)  // small enough for producers to wait on space
+#define MESSAGES    (20000)
+
+struct msg_s {
+    int producer;
+    int seq;
+    unsigned char payload[64];
+};
+
+// messages are 8 to 63 bytes, the payload filled by the sequence number.
+static size_t msg_make(struct msg_s *m, int producer, int seq) {
+    size_t len = seq % 56;
+    m->producer = producer;
+    m->seq = seq;
+    memset(m->payload, seq & 0xFF, len);
+    return offsetof(struct msg_s, payload) + len;
+}
+
+static bool msg_check(const struct msg_s *m, ssize_t size) {
+    size_t len = m->seq % 56;
+    if (size != (ssize_t) (offsetof(struct msg_s, payload) + len))
+        return false;
+    size_t i;
+    for (i = 0; i < len; i++) {
+        if (m->payload[i] != (m->seq & 0xFF))
+            return false;
+    }
+    return true;
+}
+
+static qshmq_t *shmq_new(void **mem, size_t *memsize) {
+    *memsize = qshmq_memsize(CAPACITY);
+    *mem = mmap(NULL, *memsize, PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (*mem == MAP_FAILED)
+        return NULL;
+    return qshmq_init(*mem, *memsize);
+}
+
+// forks a producer which attaches the queue and pushes its messages.
+// half of them are built in place by reserve() and commit().
+static pid_t producer(void *mem, int id, int count) {
+    pid_t pid = fork();
+    if (pid != 0)
+        return pid;
+
+    qshmq_t *q = qshmq_attach(mem);
+    if (q == NULL)
+        _exit(1);
+    int seq;
+    for (seq = 0; seq < count; seq++) {
+        struct msg_s m;
+        size_t size = msg_make(&m, id, seq);
+        if (seq % 2 == 0) {
+            if (qshmq_push(q, &m, size, -1) == false)
+                _exit(2);
+        } else {
+            void *ptr = qshmq_reserve(q, size, -1);
+            if (ptr == NULL)
+                _exit(3);
+            memcpy(ptr, &m, size);
+            if (qshmq_commit(q, ptr) == false)
+                _exit(4);
+        }
+    }
+    _exit(0);
+}
+
+static bool reaped(pid_t pid) {
+    int status;
+    return (waitpid(pid, &status, 0) == pid && WIFEXITED(status)
+            && WEXITSTATUS(status) == 0);
+}
+
+QUNIT_START("Test qshmq.c");
+
+TEST("Messages pushed by another process pop in order") {
+    void *mem;
+    size_t memsize;
+    qshmq_t *q = shmq_new(&mem, &memsize);
+    ASSERT(q != NULL);
+    ASSERT_EQUAL_INT(qshmq_capacity(q), CAPACITY);
+
+    pid_t pid = producer(mem, 1, MESSAGES);
+    ASSERT(pid > 0);
+    int seq, failed = 0;
+    for (seq = 0; seq < MESSAGES; seq++) {
+        struct msg_s m;
+        ssize_t size = qshmq_pop(q, &m, sizeof(m), 5000);
+        if (size < 0 || m.producer != 1 || m.seq != seq
+            || msg_check(&m, size) == false) {
+            failed++;
+            if (size < 0)
+                break;
+        }
+    }
+    ASSERT_EQUAL_INT(failed, 0);
+    ASSERT(reaped(pid) == true);
+    ASSERT_EQUAL_INT(qshmq_used(q), 0);
+    ASSERT(qshmq_pop(q, NULL, 0, 0) == -1 && errno == EAGAIN);
+
+    ASSERT(qshmq_free(q) == true);
+    munmap(mem, memsize);
+}
+
+TEST("Messages of each of several producers pop in order") {
+    void *mem;
+    size_t memsize;
+    qshmq_t *q = shmq_new(&mem, &memsize);
+    ASSERT(q != NULL);
+
+    pid_t pids[4];
+    int next[4] = { 0, 0, 0, 0 };
+    int i, failed = 0;
+    for (i = 0; i < 4; i++) {
+        pids[i] = producer(mem, i, MESSAGES / 4);
+        ASSERT(pids[i] > 0);
+    }
+    for (i = 0; i < MESSAGES; i++) {
+        struct msg_s m;
+        size_t size;
+        // read it in place.
+        struct msg_s *p = (struct msg_s *) qshmq_peek(q, &size, 5000);
+        if (p == NULL) {
+            failed++;
+            break;
+        }
+        memcpy(&m, p, size);
+        if (qshmq_consume(q) == false || m.producer < 0 || m.producer >= 4
+            || m.seq != next[m.producer]++
+            || msg_check(&m, size) == false) {
+            failed++;
+        }
+    }
+    ASSERT_EQUAL_INT(failed, 0);
+    for (i = 0; i < 4; i++) {
+        ASSERT(reaped(pids[i]) == true);
+        ASSERT_EQUAL_INT(next[i], MESSAGES / 4);
+    }
+    ASSERT(qshmq_consume(q) == false && errno == ENOENT);
+
+    ASSERT(qshmq_free(q) == true);
+    munmap(mem, memsize);
+}
+
+#endif
+
+QUNIT_END();
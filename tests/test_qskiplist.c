@@ -0,0 +1,93 @@
+#include "qunit.h"
+#include "qlibc.h"
+
+QUNIT_START("Test qskiplist.c");
+
+TEST("put()/get()/remove() against a hash table") {
+    qskiplist_t *tbl = qskiplist(0);
+    qhashtbl_t *model = qhashtbl(0, 0);
+    ASSERT(tbl != NULL && model != NULL);
+
+    srand(11);
+    int i;
+    for (i = 0; i < 20000; i++) {
+        char name[32];
+        snprintf(name, sizeof(name), "key%04d", rand() % 2000);
+        int op = rand() % 4;
+        if (op < 2) {
+            ASSERT(tbl->putint(tbl, name, i) == true);
+            model->putint(model, name, i);
+        } else if (op < 3) {
+            ASSERT(tbl->remove(tbl, name) == model->remove(model, name));
+        } else {
+            ASSERT_EQUAL_INT(tbl->getint(tbl, name), model->getint(model, name));
+        }
+    }
+    ASSERT_EQUAL_INT(tbl->size(tbl), model->size(model));
+
+    // traversal is in key order.
+    qskiplist_obj_t obj;
+    memset((void *)&obj, 0, sizeof(obj));
+    char last[32] = "";
+    size_t n = 0;
+    while (tbl->getnext(tbl, &obj, false) == true) {
+        ASSERT(strcmp(obj.name, last) > 0);
+        ASSERT_EQUAL_STR((char *)obj.data, model->getstr(model, obj.name, false));
+        snprintf(last, sizeof(last), "%s", obj.name);
+        n++;
+    }
+    ASSERT_EQUAL_INT(n, tbl->size(tbl));
+
+    tbl->clear(tbl);
+    ASSERT_EQUAL_INT(tbl->size(tbl), 0);
+    ASSERT(tbl->get(tbl, "key0001", NULL, false) == NULL);
+    ASSERT(tbl->putstr(tbl, "key0001", "again") == true);
+    ASSERT_EQUAL_STR(tbl->getstr(tbl, "key0001", false), "again");
+
+    tbl->free(tbl);
+    model->free(model);
+}
+
+TEST("getrange()/getprefix()") {
+    qskiplist_t *tbl = qskiplist(QSKIPLIST_THREADSAFE);
+    ASSERT(tbl != NULL);
+    int i;
+    for (i = 999; i >= 0; i--) {
+        char name[32];
+        snprintf(name, sizeof(name), "%03d", i);
+        tbl->putint(tbl, name, i);
+    }
+
+    qskiplist_obj_t obj;
+    memset((void *)&obj, 0, sizeof(obj));
+    int expect = 250;
+    while (tbl->getrange(tbl, &obj, "250", "500", true) == true) {
+        ASSERT_EQUAL_INT(atoi((char *)obj.data), expect++);
+        free(obj.name);
+        free(obj.data);
+    }
+    ASSERT_EQUAL_INT(expect, 500);
+
+    // unbounded sides
+    memset((void *)&obj, 0, sizeof(obj));
+    for (i = 0; tbl->getrange(tbl, &obj, NULL, "010", false) == true; i++);
+    ASSERT_EQUAL_INT(i, 10);
+    memset((void *)&obj, 0, sizeof(obj));
+    for (i = 0; tbl->getrange(tbl, &obj, "990", NULL, false) == true; i++);
+    ASSERT_EQUAL_INT(i, 10);
+    memset((void *)&obj, 0, sizeof(obj));
+    ASSERT(tbl->getrange(tbl, &obj, "999x", NULL, false) == false);
+
+    memset((void *)&obj, 0, sizeof(obj));
+    expect = 420;
+    while (tbl->getprefix(tbl, &obj, "42", false) == true) {
+        ASSERT_EQUAL_INT(atoi((char *)obj.data), expect++);
+    }
+    ASSERT_EQUAL_INT(expect, 430);
+    memset((void *)&obj, 0, sizeof(obj));
+    ASSERT(tbl->getprefix(tbl, &obj, "x", false) == false);
+
+    tbl->free(tbl);
+}
+
+QUNIT_END();
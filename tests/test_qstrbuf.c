@@ -0,0 +1,108 @@
+#include <errno.h>
+#include "qunit.h"
+#include "qlibc.h"
+
+QUNIT_START("Test qstrbuf.c");
+
+TEST("append()/append_n()/appendf()") {
+    qstrbuf_t *sb = qstrbuf(4);
+    ASSERT(sb != NULL);
+    ASSERT_EQUAL_STR(sb->getstr(sb, false), "");
+    ASSERT_EQUAL_INT(sb->length(sb), 0);
+
+    static char model[32 * 1024] = "";
+    int i;
+    for (i = 0; i < 2000; i++) {
+        switch (i % 3) {
+            case 0:
+                ASSERT(sb->append(sb, "abc") == true);
+                qstrcatf(model, "abc");
+                break;
+            case 1:
+                ASSERT(sb->append_n(sb, "defgh", 2) == true);
+                qstrcatf(model, "de");
+                break;
+            default:
+                ASSERT(sb->appendf(sb, "[%d:%s]", i, "x") == true);
+                qstrcatf(model, "[%d:%s]", i, "x");
+                break;
+        }
+    }
+    ASSERT_EQUAL_INT(sb->length(sb), strlen(model));
+    ASSERT_EQUAL_STR(sb->getstr(sb, false), model);
+
+    // a long formatted string which doesn't fit in the room left.
+    char big[5000];
+    memset(big, 'z', sizeof(big) - 1);
+    big[sizeof(big) - 1] = '\0';
+    ASSERT(sb->appendf(sb, "%s!", big) == true);
+    qstrcatf(model, "%s!", big);
+    ASSERT_EQUAL_STR(sb->getstr(sb, false), model);
+
+    char *copy = sb->getstr(sb, true);
+    ASSERT_EQUAL_STR(copy, model);
+    free(copy);
+
+    ASSERT(sb->append(sb, NULL) == false);
+    ASSERT_EQUAL_INT(errno, EINVAL);
+
+    sb->free(sb);
+}
+
+TEST("reserve()/truncate()/clear()/steal()") {
+    qstrbuf_t *sb = qstrbuf(0);
+    ASSERT(sb != NULL);
+
+    // reading straight into the reserved room.
+    ASSERT(sb->reserve(sb, 1000) == true);
+    char *room = sb->getstr(sb, false) + sb->length(sb);
+    memset(room, 'a', 1000);
+    ASSERT(sb->append_n(sb, room, 1000) == true);
+    ASSERT(sb->getstr(sb, false) + sb->length(sb) == room + 1000);
+    ASSERT_EQUAL_INT(sb->length(sb), 1000);
+
+    ASSERT(sb->truncate(sb, 2000) == false);
+    ASSERT_EQUAL_INT(errno, ERANGE);
+    ASSERT(sb->truncate(sb, 3) == true);
+    ASSERT_EQUAL_STR(sb->getstr(sb, false), "aaa");
+
+    // binary data
+    ASSERT(sb->append_n(sb, "\0b", 2) == true);
+    ASSERT_EQUAL_INT(sb->length(sb), 5);
+    ASSERT(memcmp(sb->getstr(sb, false), "aaa\0b", 6) == 0);
+
+    size_t len = 0;
+    char *str = sb->steal(sb, &len);
+    ASSERT_EQUAL_INT(len, 5);
+    ASSERT(memcmp(str, "aaa\0b", 6) == 0);
+    free(str);
+
+    // empty after steal(), and can be used again.
+    ASSERT_EQUAL_INT(sb->length(sb), 0);
+    ASSERT_EQUAL_STR(sb->getstr(sb, false), "");
+    str = sb->steal(sb, &len);
+    ASSERT_EQUAL_STR(str, "");
+    ASSERT_EQUAL_INT(len, 0);
+    free(str);
+    ASSERT(sb->appendf(sb, "%d", 123) == true);
+    ASSERT_EQUAL_STR(sb->getstr(sb, false), "123");
+
+    sb->clear(sb);
+    ASSERT_EQUAL_INT(sb->length(sb), 0);
+    ASSERT_EQUAL_STR(sb->getstr(sb, false), "");
+
+    sb->free(sb);
+}
+
+TEST("qvector->tostring()") {
+    qvector_t *vector = qvector(0);
+    vector->addstr(vector, "AB");
+    vector->addstrf(vector, "%d", 12);
+    vector->add(vector, "CD", 3);
+    char *final = vector->tostring(vector);
+    ASSERT_EQUAL_STR(final, "AB12CD");
+    free(final);
+    vector->free(vector);
+}
+
+QUNIT_END();
@@ -41,4 +41,89 @@ TEST("qstrtrim_tail()") {
     ASSERT_EQUAL_STR(qstrtrim_tail(strdup(" a ")), " a");
 }
 
+TEST("qstrreplace()") {
+    char src[256], *ret;
+    const char *modes[4] = { "tn", "tr", "sn", "sr" };
+    const char *expects[4] = {
+        "W_lcom_ to ___ qD_cod_r Proj_ct.",
+        "W_lcom_ to ___ qD_cod_r Proj_ct.",
+        "Welcome to _ qDecoder Project.",
+        "Welcome to _ qDecoder Project."
+    };
+    int i;
+    for (i = 0; i < 4; i++) {
+        strcpy(src, "Welcome to The qDecoder Project.");
+        ret = qstrreplace(modes[i], src, "The", "_");
+        ASSERT_EQUAL_STR(ret, expects[i]);
+        if (modes[i][1] == 'n') {
+            ASSERT_EQUAL_STR(src, "Welcome to The qDecoder Project.");
+            free(ret);
+        } else {
+            ASSERT(ret == src);
+        }
+    }
+
+    ret = qstrreplace("sn", "aaaa", "aa", "b");
+    ASSERT_EQUAL_STR(ret, "bb");
+    free(ret);
+    ret = qstrreplace("sn", "abc", "", "x");
+    ASSERT_EQUAL_STR(ret, "abc");
+    free(ret);
+    ret = qstrreplace("tn", "a-b_c", "-_", "<>");
+    ASSERT_EQUAL_STR(ret, "a<>b<>c");
+    free(ret);
+    ASSERT(qstrreplace("xn", "abc", "a", "b") == NULL);
+}
+
+TEST("qstrreplace_multi()") {
+    const char *tokens[] = { "{a}", "{ab}", "{", "" };
+    const char *words[] = { "1", "2", "[", "never" };
+    char *ret = qstrreplace_multi("x{a}{ab}{b}{", tokens, words, 4);
+    ASSERT_EQUAL_STR(ret, "x12[b}[");
+    free(ret);
+
+    // replaced words are not scanned again.
+    const char *tokens2[] = { "a", "b" };
+    const char *words2[] = { "b", "a" };
+    ret = qstrreplace_multi("aabb", tokens2, words2, 2);
+    ASSERT_EQUAL_STR(ret, "bbaa");
+    free(ret);
+
+    ret = qstrreplace_multi("", tokens2, words2, 2);
+    ASSERT_EQUAL_STR(ret, "");
+    free(ret);
+    ret = qstrreplace_multi("abc", NULL, NULL, 0);
+    ASSERT_EQUAL_STR(ret, "abc");
+    free(ret);
+}
+
+TEST("qstrtok()/qstrtokenizer()") {
+    char *str = strdup("a:b::d,e");
+    char stop;
+    int offset = 0;
+    ASSERT_EQUAL_STR(qstrtok(str, ":,", &stop, &offset), "a");
+    ASSERT_EQUAL_INT(stop, ':');
+    ASSERT_EQUAL_STR(qstrtok(str, ":,", &stop, &offset), "b");
+    ASSERT_EQUAL_STR(qstrtok(str, ":,", &stop, &offset), "");
+    ASSERT_EQUAL_STR(qstrtok(str, ":,", &stop, &offset), "d");
+    ASSERT_EQUAL_INT(stop, ',');
+    ASSERT_EQUAL_STR(qstrtok(str, ":,", &stop, &offset), "e");
+    ASSERT_EQUAL_INT(stop, '\0');
+    ASSERT(qstrtok(str, ":,", &stop, &offset) == NULL);
+    free(str);
+
+    qlist_t *list = qstrtokenizer("a:bc::d", ":");
+    ASSERT_EQUAL_INT(list->size(list), 4);
+    const char *expects[] = { "a", "bc", "", "d" };
+    int i;
+    for (i = 0; i < 4; i++) {
+        size_t size;
+        char *token = list->popfirst(list, &size);
+        ASSERT_EQUAL_STR(token, expects[i]);
+        ASSERT_EQUAL_INT(size, strlen(expects[i]) + 1);
+        free(token);
+    }
+    list->free(list);
+}
+
 QUNIT_END();
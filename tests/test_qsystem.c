@@ -0,0 +1,146 @@
+#include <errno.h>
+#include <stdio.h>
+#include <unistd.h>
+#include "qunit.h"
+#include "qlibc.h"
+
+// counts live allocations, prefixing each with its size.
+struct counter_s {
+    long live;
+    long calls;
+    long sized;
+};
+
+static void *cnt_malloc(void *arg, size_t size) {
+    struct counter_s *c = (struct counter_s *) arg;
+    size_t *p = (size_t *) malloc(sizeof(size_t) * 2 + size);
+    if (p == NULL)
+        return NULL;
+    p[0] = size;
+    c->live++;
+    c->calls++;
+    return p + 2;
+}
+
+static void *cnt_realloc(void *arg, void *ptr, size_t size) {
+    struct counter_s *c = (struct counter_s *) arg;
+    if (ptr == NULL)
+        return cnt_malloc(arg, size);
+    size_t *p = (size_t *) realloc((size_t *) ptr - 2,
+                                   sizeof(size_t) * 2 + size);
+    if (p == NULL)
+        return NULL;
+    p[0] = size;
+    c->calls++;
+    return p + 2;
+}
+
+static void cnt_free(void *arg, void *ptr, size_t size) {
+    struct counter_s *c = (struct counter_s *) arg;
+    size_t *p = (size_t *) ptr - 2;
+    if (size > 0) {
+        // a sized free is given the requested or the usable size.
+        if (size != p[0])
+            abort();
+        c->sized++;
+    }
+    c->live--;
+    free(p);
+}
+
+static size_t cnt_usable_size(void *arg, void *ptr) {
+    return ((size_t *) ptr)[-2];
+}
+
+QUNIT_START("Test qsystem.c");
+
+TEST("qlibc_set_allocator() routes allocation of containers") {
+    struct counter_s c = { 0, 0, 0 };
+    qlibc_allocator_t allocator = {
+        cnt_malloc, cnt_realloc, cnt_free, cnt_usable_size, &c
+    };
+    ASSERT(qlibc_set_allocator(&allocator) == true);
+
+    qhashtbl_t *tbl = qhashtbl(0, 0);
+    int i;
+    for (i = 0; i < 1000; i++) {
+        tbl->putstrf(tbl, "a very long key name to be allocated", "%d", i);
+        char *key = qstrdupf("key%d", i);
+        tbl->putint(tbl, key, i);
+        qlibc_free(key);
+    }
+    qstrbuf_t *sb = qstrbuf(0);
+    for (i = 0; i < 1000; i++) {
+        sb->appendf(sb, "%d,", i);
+    }
+    ASSERT(c.calls > 0);
+    ASSERT(c.live > 0);
+    tbl->free(tbl);
+    sb->free(sb);
+    ASSERT(c.sized > 0);
+    ASSERT_EQUAL_INT(c.live, 0);
+
+    ASSERT(qlibc_set_allocator(NULL) == true);
+}
+
+TEST("strings returned to the caller come from the allocator") {
+    struct counter_s c = { 0, 0, 0 };
+    qlibc_allocator_t allocator = {
+        cnt_malloc, cnt_realloc, cnt_free, NULL, &c
+    };
+    ASSERT(qlibc_set_allocator(&allocator) == true);
+
+    char *str = qstrdupf("%s-%d", "abc", 123);
+    ASSERT_EQUAL_STR(str, "abc-123");
+    ASSERT_EQUAL_INT(c.live, 1);
+    qlibc_free(str);
+    ASSERT_EQUAL_INT(c.live, 0);
+
+    char path[] = "/tmp/test_qsystem.XXXXXX";
+    int fd = mkstemp(path);
+    ASSERT(fd >= 0);
+    close(fd);
+    ASSERT(qfile_save(path, "a = 1\nb = 2\n# comment\nc\n", 24, false)
+           == 24);
+    size_t size = 0;
+    char *data = qfile_load(path, &size);
+    ASSERT_EQUAL_INT(size, 24);
+    qlibc_free(data);
+
+    qlisttbl_t *tbl = qlisttbl(0);
+    ASSERT_EQUAL_INT(tbl->load(tbl, path, '=', false), 3);
+    ASSERT_EQUAL_STR(tbl->getstr(tbl, "b", false), "2");
+    ASSERT_EQUAL_STR(tbl->getstr(tbl, "c", false), "");
+    tbl->free(tbl);
+    unlink(path);
+    ASSERT_EQUAL_INT(c.live, 0);
+
+    ASSERT(qlibc_set_allocator(NULL) == true);
+}
+
+TEST("qlibc_set_allocator() rejects incomplete allocator") {
+    qlibc_allocator_t allocator = { cnt_malloc, NULL, cnt_free, NULL, NULL };
+    ASSERT(qlibc_set_allocator(&allocator) == false && errno == EINVAL);
+}
+
+TEST("qstrcatf() and qfile_read() without custom allocator") {
+    char buf[64] = "abc";
+    ASSERT(qstrcatf(buf, "-%d-%s", 10, "x") == buf);
+    ASSERT_EQUAL_STR(buf, "abc-10-x");
+
+    FILE *fp = tmpfile();
+    int i;
+    for (i = 0; i < 10000; i++) {
+        fprintf(fp, "%04d\n", i % 10000);
+    }
+    rewind(fp);
+    size_t size = 0;
+    char *data = qfile_read(fp, &size);
+    fclose(fp);
+    ASSERT_EQUAL_INT(size, 50000);
+    ASSERT_EQUAL_INT(strlen(data), 50000);
+    ASSERT(strncmp(data + 49995, "9999\n", 5) == 0);
+    free(data);
+}
+
+QUNIT_END();
@@ -0,0 +1,114 @@
+#include <errno.h>
+#include "qunit.h"
+#include "qlibc.h"
+
+static void *square(void *arg) {
+    long v = (long) arg;
+    return (void *) (v * v);
+}
+
+static void *count(void *arg) {
+    __atomic_add_fetch((int *) arg, 1, __ATOMIC_RELAXED);
+    return NULL;
+}
+
+// sums 1..n by splitting it over nested tasks.
+struct sum_s {
+    qthreadpool_t *pool;
+    long from;
+    long to;
+};
+
+static void *sum(void *arg) {
+    struct sum_s *s = (struct sum_s *) arg;
+    if (s->to - s->from < 100) {
+        long v = 0, i;
+        for (i = s->from; i <= s->to; i++) v += i;
+        return (void *) v;
+    }
+    long mid = (s->from + s->to) / 2;
+    struct sum_s left = { s->pool, s->from, mid };
+    struct sum_s right = { s->pool, mid + 1, s->to };
+    qthreadpool_future_t *future = s->pool->async(s->pool, sum, &left);
+    long v = (long) sum(&right);
+    return (void *) (v + (long) s->pool->get(s->pool, future));
+}
+
+static void fill(void *arg, size_t begin, size_t end) {
+    int *v = (int *) arg;
+    size_t i;
+    for (i = begin; i < end; i++) v[i] += (int) i;
+}
+
+QUNIT_START("Test qthreadpool.c");
+
+TEST("async()/get()") {
+    qthreadpool_t *pool = qthreadpool(4);
+    ASSERT(pool != NULL);
+    ASSERT_EQUAL_INT(pool->size(pool), 4);
+
+    qthreadpool_future_t *futures[100];
+    long i;
+    for (i = 0; i < 100; i++) {
+        futures[i] = pool->async(pool, square, (void *) i);
+        ASSERT(futures[i] != NULL);
+    }
+    for (i = 0; i < 100; i++) {
+        ASSERT_EQUAL_INT((long) pool->get(pool, futures[i]), i * i);
+    }
+
+    ASSERT(pool->async(pool, NULL, NULL) == NULL);
+    ASSERT_EQUAL_INT(errno, EINVAL);
+    pool->free(pool);
+}
+
+TEST("submit()/wait()") {
+    qthreadpool_t *pool = qthreadpool(3);
+    int counter = 0;
+    int i, nsubmits = 0;
+    for (i = 0; i < 10000; i++) {
+        if (pool->submit(pool, count, &counter) == true)
+            nsubmits++;
+    }
+    ASSERT_EQUAL_INT(nsubmits, 10000);
+    ASSERT(pool->wait(pool) == true);
+    ASSERT_EQUAL_INT(counter, 10000);
+    ASSERT_EQUAL_INT(pool->pending(pool), 0);
+    pool->free(pool);
+}
+
+TEST("nested tasks don't starve the pool") {
+    qthreadpool_t *pool = qthreadpool(2);
+    struct sum_s s = { pool, 1, 100000 };
+    qthreadpool_future_t *future = pool->async(pool, sum, &s);
+    ASSERT_EQUAL_INT((long) pool->get(pool, future), 100000L * 100001 / 2);
+    pool->free(pool);
+}
+
+TEST("parallel_for()") {
+    qthreadpool_t *pool = qthreadpool(4);
+    int *v = (int *) calloc(100003, sizeof(int));
+    ASSERT(pool->parallel_for(pool, 0, 100003, 0, fill, v) == true);
+    ASSERT(pool->parallel_for(pool, 3, 100003, 7, fill, v) == true);
+    ASSERT(pool->parallel_for(pool, 5, 5, 0, fill, v) == true);
+    int i, nwrong = 0;
+    for (i = 0; i < 100003; i++) {
+        if (v[i] != ((i < 3) ? i : i * 2))
+            nwrong++;
+    }
+    ASSERT_EQUAL_INT(nwrong, 0);
+    free(v);
+    pool->free(pool);
+}
+
+TEST("qthreadpool_shared()") {
+    qthreadpool_t *pool = qthreadpool_shared();
+    ASSERT(pool != NULL);
+    ASSERT(pool == qthreadpool_shared());
+    qthreadpool_future_t *future = pool->async(pool, square, (void *) 7L);
+    ASSERT_EQUAL_INT((long) pool->get(pool, future), 49);
+    pool->free(pool);  // no-op
+    ASSERT(pool->size(pool) > 0);
+}
+
+QUNIT_END();
@@ -0,0 +1,99 @@
+#include <errno.h>
+#include <stdio.h>
+#include <time.h>
+#include "qunit.h"
+#include "qlibc.h"
+
+QUNIT_START("Test qtime.c");
+
+TEST("qtime_gmt_httpstr() formats RFC 1123 dates") {
+    char buf[QTIME_HTTPSTR_SIZE];
+    ASSERT_EQUAL_INT(qtime_gmt_httpstr(buf, 784111777), 29);
+    ASSERT_EQUAL_STR(buf, "Sun, 06 Nov 1994 08:49:37 GMT");
+    ASSERT_EQUAL_INT(qtime_gmt_httpstr(buf, 951868799), 29);
+    ASSERT_EQUAL_STR(buf, "Tue, 29 Feb 2000 23:59:59 GMT");
+    ASSERT_EQUAL_INT(qtime_gmt_httpstr(buf, 1), 29);
+    ASSERT_EQUAL_STR(buf, "Thu, 01 Jan 1970 00:00:01 GMT");
+
+    char *str = qtime_gmt_str(784111777);
+    ASSERT_EQUAL_STR(str, "Sun, 06 Nov 1994 08:49:37 GMT");
+    free(str);
+    ASSERT_EQUAL_STR(qtime_gmt_staticstr(784111777),
+                     "Sun, 06 Nov 1994 08:49:37 GMT");
+}
+
+TEST("qtime_gmt_httpstr() agrees with strftime()") {
+    char buf[QTIME_HTTPSTR_SIZE], ref[64];
+    time_t t;
+    int failed = 0;
+    // every few hours over 50 years, through leap days and centuries.
+    for (t = 1; t < 50L * 366 * 86400; t += 3 * 3600 + 7 * 60 + 11) {
+        qtime_gmt_httpstr(buf, t);
+        qtime_gmt_strf(ref, sizeof(ref), t, "%a, %d %b %Y %H:%M:%S GMT");
+        if (strcmp(buf, ref) != 0)
+            failed++;
+    }
+    ASSERT_EQUAL_INT(failed, 0);
+}
+
+TEST("qtime_parse_gmtstr() with GMT and numeric zones") {
+    ASSERT_EQUAL_INT(qtime_parse_gmtstr("Sun, 06 Nov 1994 08:49:37 GMT"),
+                     784111777);
+    ASSERT_EQUAL_INT(qtime_parse_gmtstr("Sun, 06 Nov 1994 08:49:37 UTC"),
+                     784111777);
+    ASSERT_EQUAL_INT(qtime_parse_gmtstr("Mon, 05 May 2008 03:50:39 +0900"),
+                     1209927039);
+    ASSERT_EQUAL_INT(qtime_parse_gmtstr("Sun, 06 Nov 1994 08:49:37 +0000"),
+                     784111777);
+    ASSERT_EQUAL_INT(qtime_parse_gmtstr("Sun, 06 Nov 1994 08:49:37 -0500"),
+                     784129777);
+}
+
+TEST("qtime_parse_gmtstr() falls back to strptime() for other forms") {
+    // single digit day and full weekday name don't fit the fixed format.
+    ASSERT_EQUAL_INT(qtime_parse_gmtstr("Sun, 6 Nov 1994 08:49:37 GMT"),
+                     784111777);
+    ASSERT_EQUAL_INT(qtime_parse_gmtstr("Sunday, 06 Nov 1994 08:49:37 GMT"),
+                     784111777);
+    ASSERT_EQUAL_INT(qtime_parse_gmtstr("Mon, 5 May 2008 03:50:39 +0900"),
+                     1209927039);
+    ASSERT_EQUAL_INT(qtime_parse_gmtstr("Sun, 6 Nov 1994 08:49:37 -0500"),
+                     784129777);
+}
+
+TEST("qtime_parse_gmtstr() fails on invalid fields") {
+    // neither the fixed format nor strptime() takes these.
+    const char *bad[] = {
+        "Sun, 32 Nov 1994 08:49:37 GMT",
+        "Sun, 00 Nov 1994 08:49:37 GMT",
+        "Sun, 06 Foo 1994 08:49:37 GMT",
+        "Sun, 06 Nov 1994 24:49:37 GMT",
+        "Sun, 06 Nov 1994 08:60:37 GMT",
+        "Sun, 06 Nov 1994 08:49:62 GMT",
+        "Sun, 06 Nov 1994 0a:49:37 GMT",
+        "Sun, 06 Nov 19x4 08:49:37 GMT",
+        "Sun, 06 Nov",
+        "",
+    };
+    size_t i;
+    for (i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        ASSERT(qtime_parse_gmtstr(bad[i]) <= 0);
+    }
+}
+
+TEST("qtime_parse_gmtstr() reads back what qtime_gmt_httpstr() wrote") {
+    char buf[QTIME_HTTPSTR_SIZE];
+    time_t t;
+    int failed = 0;
+    for (t = 1; t < 50L * 366 * 86400; t += 3 * 3600 + 7 * 60 + 11) {
+        qtime_gmt_httpstr(buf, t);
+        if (qtime_parse_gmtstr(buf) != t)
+            failed++;
+    }
+    ASSERT_EQUAL_INT(failed, 0);
+
+    t = time(NULL);
+    ASSERT_EQUAL_INT(qtime_parse_gmtstr(qtime_gmt_staticstr(t)), t);
+}
+
+QUNIT_END();
@@ -0,0 +1,112 @@
+#include <errno.h>
+#include <stdio.h>
+#include "qunit.h"
+#include "qlibc.h"
+#include "qlibcext.h"
+
+// src/internal/qinternal.h, which can't be included along with qunit.h.
+extern void _q_tokenbucket_clock(long ms);
+
+static long now = 1000000;
+
+// moves the stopped clock forward.
+static void advance(long ms) {
+    now += ms;
+    _q_tokenbucket_clock(now);
+}
+
+QUNIT_START("Test qtokenbucket.c");
+
+TEST("qtokenbucket refill and consume") {
+    qtokenbucket_t bucket;
+    advance(0);
+    qtokenbucket_init(&bucket, 5, 10, 100);
+    ASSERT(qtokenbucket_consume(&bucket, 5) == true);
+    ASSERT(qtokenbucket_consume(&bucket, 1) == false);
+    ASSERT_EQUAL_INT(qtokenbucket_waittime(&bucket, 1), 10);
+
+    // 100 tokens per second is one every 10ms.
+    advance(9);
+    ASSERT(qtokenbucket_consume(&bucket, 1) == false);
+    advance(1);
+    ASSERT(qtokenbucket_consume(&bucket, 1) == true);
+    ASSERT(qtokenbucket_consume(&bucket, 1) == false);
+
+    // never more than max_tokens.
+    advance(1000);
+    ASSERT_EQUAL_INT(qtokenbucket_waittime(&bucket, 10), 0);
+    ASSERT(qtokenbucket_consume(&bucket, 10) == true);
+    ASSERT(qtokenbucket_consume(&bucket, 1) == false);
+    ASSERT_EQUAL_INT(qtokenbucket_waittime(&bucket, 10), 100);
+
+    // a request bigger than the tokens takes nothing.
+    advance(50);
+    ASSERT(qtokenbucket_consume(&bucket, 6) == false);
+    ASSERT(qtokenbucket_consume(&bucket, 5) == true);
+    ASSERT(qtokenbucket_consume(&bucket, 1) == false);
+}
+
+TEST("qtokenbucket_sharded refill and consume") {
+    qtokenbucket_sharded_t bucket;
+    advance(0);
+    ASSERT(qtokenbucket_sharded_init(&bucket, 0, 100, 1000) == true);
+    ASSERT(qtokenbucket_sharded_consume(&bucket, 1) == false);
+    ASSERT_EQUAL_INT(qtokenbucket_sharded_waittime(&bucket, 1), 1);
+    ASSERT_EQUAL_INT(qtokenbucket_sharded_waittime(&bucket, 10), 10);
+
+    // refilled every 1ms, 1000 tokens per second is one.
+    advance(1);
+    ASSERT(qtokenbucket_sharded_consume(&bucket, 1) == true);
+    ASSERT(qtokenbucket_sharded_consume(&bucket, 1) == false);
+
+    // never more than max_tokens, wherever they're cached.
+    advance(1000);
+    ASSERT_EQUAL_INT(qtokenbucket_sharded_waittime(&bucket, 100), 0);
+    int i, got = 0;
+    for (i = 0; i < 200; i++) {
+        if (qtokenbucket_sharded_consume(&bucket, 1) == true)
+            got++;
+    }
+    ASSERT_EQUAL_INT(got, 100);
+    ASSERT(qtokenbucket_sharded_consume(&bucket, 0) == true);
+
+    ASSERT(qtokenbucket_sharded_init(&bucket, 0, 0, 1) == false
+           && errno == EINVAL);
+}
+
+TEST("qtokenbucket_table refill and consume per key") {
+    size_t memsize = qhasharr_calculate_memsize(100);
+    void *mem = malloc(memsize);
+    qhasharr_t *store = qhasharr(mem, memsize);
+    ASSERT(store != NULL);
+    qtokenbucket_table_t *tbl = qtokenbucket_table(store, 3, 1, 0);
+    ASSERT(tbl != NULL);
+
+    // a new bucket starts full.
+    advance(0);
+    ASSERT_EQUAL_INT(qtokenbucket_table_waittime(tbl, "a", 3), 0);
+    ASSERT(qtokenbucket_table_consume(tbl, "a", 1) == true);
+    ASSERT(qtokenbucket_table_consume(tbl, "a", 2) == true);
+    ASSERT(qtokenbucket_table_consume(tbl, "a", 1) == false);
+    ASSERT(qtokenbucket_table_consume(tbl, "b", 3) == true);
+    ASSERT_EQUAL_INT(qtokenbucket_table_waittime(tbl, "a", 1), 1000);
+
+    advance(999);
+    ASSERT(qtokenbucket_table_consume(tbl, "a", 1) == false);
+    advance(1);
+    ASSERT(qtokenbucket_table_consume(tbl, "a", 1) == true);
+    ASSERT(qtokenbucket_table_consume(tbl, "a", 1) == false);
+
+    advance(10000);
+    ASSERT(qtokenbucket_table_consume(tbl, "a", 3) == true);
+    ASSERT(qtokenbucket_table_consume(tbl, "a", 1) == false);
+    ASSERT(qtokenbucket_table_consume(tbl, "b", 4) == false);
+    ASSERT(qtokenbucket_table_consume(tbl, "b", 3) == true);
+
+    qtokenbucket_table_free(tbl);
+    store->free(store);
+    free(mem);
+    _q_tokenbucket_clock(0);
+}
+
+QUNIT_END();
@@ -0,0 +1,155 @@
+#include <errno.h>
+#include <stdio.h>
+#include "qunit.h"
+#include "qlibc.h"
+
+QTYPED_VECTOR(intvec, int)
+QTYPED_QUEUE(intq, int)
+QTYPED_HASHTBL(intmap, uint64_t, int, qtyped_hash_int, QTYPED_EQ_INT)
+QTYPED_HASHTBL(strmap, const char *, int, qtyped_hash_str, QTYPED_EQ_STR)
+
+// every key collides, so removal has to shift probe chains back.
+#define BADHASH(k)  ((uint32_t) ((k) % 4))
+QTYPED_HASHTBL(badmap, int, int, BADHASH, QTYPED_EQ_INT)
+
+QUNIT_START("Test qtyped.h");
+
+TEST("QTYPED_VECTOR add()/getat()/setat()/removeat()") {
+    intvec_t *v = intvec(0);
+    int i;
+    for (i = 0; i < 1000; i++) {
+        ASSERT(intvec_add(v, i) == true);
+    }
+    ASSERT_EQUAL_INT(intvec_size(v), 1000);
+    ASSERT_EQUAL_INT(*intvec_getat(v, 500), 500);
+    ASSERT_EQUAL_INT(*intvec_getat(v, -1), 999);
+    ASSERT(intvec_getat(v, 1000) == NULL && errno == ERANGE);
+    ASSERT(intvec_getat(v, -1001) == NULL && errno == ERANGE);
+
+    ASSERT(intvec_setat(v, 10, -1) == true);
+    ASSERT_EQUAL_INT(*intvec_getat(v, 10), -1);
+
+    ASSERT(intvec_removeat(v, 0) == true);
+    ASSERT(intvec_removeat(v, -1) == true);
+    ASSERT_EQUAL_INT(intvec_size(v), 998);
+    ASSERT_EQUAL_INT(*intvec_getat(v, 0), 1);
+    ASSERT_EQUAL_INT(*intvec_getat(v, -1), 998);
+
+    intvec_clear(v);
+    ASSERT_EQUAL_INT(intvec_size(v), 0);
+    ASSERT(intvec_removeat(v, 0) == false);
+    intvec_free(v);
+}
+
+TEST("QTYPED_QUEUE push()/pop() across ring wrap and growth") {
+    intq_t *q = intq(0);
+    int i, value = -1, next = 0;
+    for (i = 0; i < 10000; i++) {
+        ASSERT(intq_push(q, i) == true);
+        if (i % 3 == 0) {
+            ASSERT(intq_pop(q, &value) == true);
+            ASSERT_EQUAL_INT(value, next++);
+        }
+    }
+    ASSERT_EQUAL_INT(intq_size(q), 10000 - next);
+    ASSERT(intq_get(q, &value) == true && value == next);
+    ASSERT_EQUAL_INT(*intq_getat(q, 0), next);
+    ASSERT_EQUAL_INT(*intq_getat(q, -1), 9999);
+    ASSERT(intq_getat(q, 10000) == NULL && errno == ERANGE);
+    while (intq_pop(q, &value) == true) {
+        ASSERT_EQUAL_INT(value, next++);
+    }
+    ASSERT_EQUAL_INT(next, 10000);
+    ASSERT(intq_pop(q, NULL) == false && errno == ENOENT);
+    intq_free(q);
+}
+
+TEST("QTYPED_QUEUE with max size") {
+    intq_t *q = intq(3);
+    ASSERT(intq_push(q, 1) == true);
+    ASSERT(intq_push(q, 2) == true);
+    ASSERT(intq_push(q, 3) == true);
+    ASSERT(intq_push(q, 4) == false && errno == ENOBUFS);
+    ASSERT(intq_pop(q, NULL) == true);
+    ASSERT(intq_push(q, 4) == true);
+    intq_clear(q);
+    ASSERT_EQUAL_INT(intq_size(q), 0);
+    intq_free(q);
+}
+
+TEST("QTYPED_HASHTBL put()/get()/remove() with integer keys") {
+    intmap_t *tbl = intmap(0);
+    ASSERT(intmap_put(tbl, 1, 10) == true);
+    ASSERT(intmap_put(tbl, 2, 20) == true);
+    ASSERT(intmap_put(tbl, 1, 30) == true);
+    ASSERT_EQUAL_INT(intmap_size(tbl), 2);
+    ASSERT_EQUAL_INT(*intmap_get(tbl, 1), 30);
+    ASSERT(intmap_get(tbl, 3) == NULL && errno == ENOENT);
+    ASSERT(intmap_remove(tbl, 1) == true);
+    ASSERT(intmap_remove(tbl, 1) == false && errno == ENOENT);
+    intmap_clear(tbl);
+
+    // grow through several resizes, remove every other one.
+    uint64_t i;
+    for (i = 0; i < 100000; i++) {
+        ASSERT(intmap_put(tbl, i * 7919, (int) i) == true);
+    }
+    for (i = 0; i < 100000; i += 2) {
+        ASSERT(intmap_remove(tbl, i * 7919) == true);
+    }
+    ASSERT_EQUAL_INT(intmap_size(tbl), 50000);
+    for (i = 0; i < 100000; i++) {
+        int *value = intmap_get(tbl, i * 7919);
+        ASSERT((i % 2 == 0) ? value == NULL : *value == (int) i);
+    }
+
+    intmap_clear(tbl);
+    ASSERT_EQUAL_INT(intmap_size(tbl), 0);
+    ASSERT(intmap_get(tbl, 7919) == NULL);
+    intmap_free(tbl);
+}
+
+TEST("QTYPED_HASHTBL remove() in colliding chains") {
+    badmap_t *tbl = badmap(0);
+    int i, j;
+    for (i = 0; i < 8; i++) {
+        ASSERT(badmap_put(tbl, i, i * 10) == true);
+    }
+    // remove from the head, middle and tail of the probe chains.
+    int order[] = { 0, 5, 7, 2, 4, 1, 6, 3 };
+    for (i = 0; i < 8; i++) {
+        ASSERT(badmap_remove(tbl, order[i]) == true);
+        for (j = i + 1; j < 8; j++) {
+            int *value = badmap_get(tbl, order[j]);
+            ASSERT(value != NULL && *value == order[j] * 10);
+        }
+    }
+    ASSERT_EQUAL_INT(badmap_size(tbl), 0);
+    badmap_free(tbl);
+}
+
+TEST("QTYPED_HASHTBL string keys and getnext()") {
+    char keys[100][16];
+    strmap_t *tbl = strmap(100);
+    int i;
+    for (i = 0; i < 100; i++) {
+        snprintf(keys[i], sizeof(keys[i]), "key%d", i);
+        ASSERT(strmap_put(tbl, keys[i], i) == true);
+    }
+    ASSERT_EQUAL_INT(*strmap_get(tbl, "key42"), 42);
+    ASSERT(strmap_get(tbl, "key100") == NULL);
+
+    size_t idx = 0;
+    const char *key;
+    int *value = NULL, cnt = 0, sum = 0;
+    while (strmap_getnext(tbl, &idx, &key, &value) == true) {
+        ASSERT_EQUAL_INT(atoi(key + 3), *value);
+        sum += *value;
+        cnt++;
+    }
+    ASSERT_EQUAL_INT(cnt, 100);
+    ASSERT_EQUAL_INT(sum, 99 * 100 / 2);
+    strmap_free(tbl);
+}
+
+QUNIT_END();
@@ -0,0 +1,126 @@
+#include <unistd.h>
+#include "qunit.h"
+#include "qlibc.h"
+
+QUNIT_START("Test qvector.c");
+
+TEST("add()/getat()/setat() with fixed size elements") {
+    qvector_t *vector = qvector(0);
+    int i;
+    for (i = 0; i < 1000; i++) {
+        ASSERT(vector->add(vector, &i, sizeof(int)) == true);
+    }
+    ASSERT_EQUAL_INT(vector->size(vector), 1000);
+    ASSERT_EQUAL_INT(vector->datasize(vector), 1000 * sizeof(int));
+
+    size_t size;
+    ASSERT_EQUAL_INT(*(int *) vector->getat(vector, 500, &size, false), 500);
+    ASSERT_EQUAL_INT(size, sizeof(int));
+    ASSERT_EQUAL_INT(*(int *) vector->getat(vector, -1, NULL, false), 999);
+    ASSERT(vector->getat(vector, 1000, NULL, false) == NULL);
+
+    int num = -1;
+    ASSERT(vector->setat(vector, 10, &num, sizeof(int)) == true);
+    ASSERT_EQUAL_INT(*(int *) vector->getat(vector, 10, NULL, false), -1);
+
+    int *array = (int *) vector->toarray(vector, &size);
+    ASSERT_EQUAL_INT(size, 1000 * sizeof(int));
+    ASSERT_EQUAL_INT(array[10], -1);
+    ASSERT_EQUAL_INT(array[999], 999);
+    free(array);
+
+    ASSERT(vector->removeat(vector, 0) == true);
+    ASSERT_EQUAL_INT(*(int *) vector->getat(vector, 0, NULL, false), 1);
+    ASSERT_EQUAL_INT(vector->size(vector), 999);
+    vector->free(vector);
+}
+
+TEST("variable size elements") {
+    qvector_t *vector = qvector(QVECTOR_THREADSAFE);
+    ASSERT(vector->addstr(vector, "AB") == true);
+    ASSERT(vector->addstr(vector, "CD") == true);
+    ASSERT(vector->addstrf(vector, "%d", 12345) == true);
+    ASSERT(vector->addstr(vector, "EF") == true);
+
+    char *str = vector->tostring(vector);
+    ASSERT_EQUAL_STR(str, "ABCD12345EF");
+    free(str);
+
+    size_t size;
+    char *data = vector->getat(vector, 2, &size, true);
+    ASSERT_EQUAL_INT(size, 5);
+    ASSERT(!memcmp(data, "12345", 5));
+    free(data);
+
+    ASSERT(vector->setat(vector, 1, "X", 1) == true);
+    ASSERT(vector->setat(vector, 0, "LONGER", 6) == true);
+    str = vector->tostring(vector);
+    ASSERT_EQUAL_STR(str, "LONGERX12345EF");
+    free(str);
+
+    ASSERT(vector->removeat(vector, 2) == true);
+    str = vector->tostring(vector);
+    ASSERT_EQUAL_STR(str, "LONGERXEF");
+    free(str);
+    ASSERT_EQUAL_INT(vector->datasize(vector), 9);
+
+    vector->clear(vector);
+    ASSERT_EQUAL_INT(vector->size(vector), 0);
+    ASSERT(vector->tostring(vector) == NULL);
+    ASSERT(vector->addstr(vector, "new") == true);
+    str = vector->tostring(vector);
+    ASSERT_EQUAL_STR(str, "new");
+    free(str);
+    vector->free(vector);
+}
+
+TEST("snapshot()/restore()") {
+    char path[] = "/tmp/test_qvector.XXXXXX";
+    int fd = mkstemp(path);
+    ASSERT(fd >= 0);
+    close(fd);
+
+    // fixed size elements stay in fixed size mode.
+    qvector_t *vector = qvector(0);
+    int i;
+    for (i = 0; i < 1000; i++) {
+        vector->add(vector, &i, sizeof(int));
+    }
+    ASSERT(vector->snapshot(vector, path) == true);
+
+    qvector_t *vector2 = qvector(QVECTOR_THREADSAFE);
+    ASSERT_EQUAL_INT(vector2->restore(vector2, path), 1000);
+    ASSERT_EQUAL_INT(vector2->size(vector2), 1000);
+    ASSERT_EQUAL_INT(vector2->objsize, sizeof(int));
+    for (i = 0; i < 1000; i++) {
+        size_t size;
+        int *data = vector2->getat(vector2, i, &size, false);
+        ASSERT_EQUAL_INT(size, sizeof(int));
+        ASSERT_EQUAL_INT(*data, i);
+    }
+    vector2->free(vector2);
+
+    // variable size elements.
+    vector->clear(vector);
+    for (i = 0; i < 100; i++) {
+        vector->addstrf(vector, "%d", i * 1000);
+    }
+    ASSERT(vector->snapshot(vector, path) == true);
+    vector2 = qvector(0);
+    ASSERT_EQUAL_INT(vector2->restore(vector2, path), 100);
+    for (i = 0; i < 100; i++) {
+        char expect[16];
+        size_t size;
+        snprintf(expect, sizeof(expect), "%d", i * 1000);
+        char *str = vector2->getat(vector2, i, &size, false);
+        ASSERT_EQUAL_INT(size, strlen(expect));
+        ASSERT(memcmp(str, expect, size) == 0);
+    }
+    ASSERT_EQUAL_INT(vector2->datasize(vector2), vector->datasize(vector));
+    vector2->free(vector2);
+
+    vector->free(vector);
+    unlink(path);
+}
+
+QUNIT_END();